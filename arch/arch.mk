@@ -22,10 +22,11 @@ LIBARCH_SOURCES := \
 	spinlock.cc \
 	dlopen_mutex.cc \
         file_functions.cc \
+	crc32c.cc \
 
 
 ifeq ($(ARCH),x86_64)
-LIBARCH_SOURCES += simd_vector_avx.cc
+LIBARCH_SOURCES += simd_vector_avx.cc crc32c_sse42.cc
 endif
 
 LIBARCH_LINK := \
@@ -50,6 +51,7 @@ $(eval $(call library,gc,$(LIBGC_SOURCES),$(LIBGC_LINK)))
 # Note: we should be able to get away without this, but we get a segfault on
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
+$(eval $(call set_single_compile_option,crc32c_sse42.cc,-msse4.2))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
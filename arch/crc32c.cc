@@ -0,0 +1,170 @@
+/* crc32c.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   CRC-32C checksums; portable implementation and dispatch.
+
+   The arithmetic is done on the "raw" CRC (without the pre and post
+   inversion), which is linear: the raw CRC of a + b is the raw CRC of a
+   shifted by the length of b (ie, multiplied by x^(8 * length(b)) modulo
+   the polynomial) xor the raw CRC of b.  This is what allows the SSE4.2
+   version to work on several streams at once.
+*/
+
+#include "crc32c.h"
+#include "crc32c_impl.h"
+#include "mldb/arch/arch.h"
+#include "mldb/arch/simd.h"
+#include <cstring>
+
+
+namespace MLDB {
+
+namespace {
+
+/// CRC-32C polynomial, bit reversed
+constexpr uint32_t CRC32C_POLY = 0x82f63b78;
+
+/// Multiply a and b modulo the polynomial, in the bit reversed domain
+uint32_t multModP(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+/// Return x^(8 * n) modulo the polynomial
+uint32_t xPow8n(size_t n)
+{
+    uint32_t p = 1u << 31;  // x^0
+    uint32_t sq = 1u << 23;  // x^8
+    while (n) {
+        if (n & 1)
+            p = multModP(sq, p);
+        sq = multModP(sq, sq);
+        n >>= 1;
+    }
+    return p;
+}
+
+struct Tables {
+    Tables()
+    {
+        for (unsigned i = 0;  i < 256;  ++i) {
+            uint32_t crc = i;
+            for (unsigned j = 0;  j < 8;  ++j)
+                crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            bytes[0][i] = crc;
+        }
+        for (unsigned i = 0;  i < 256;  ++i) {
+            uint32_t crc = bytes[0][i];
+            for (unsigned j = 1;  j < 8;  ++j) {
+                crc = bytes[0][crc & 0xff] ^ (crc >> 8);
+                bytes[j][i] = crc;
+            }
+        }
+    }
+
+    /// Tables for slicing by 8
+    uint32_t bytes[8][256];
+};
+
+const Tables & tables()
+{
+    static const Tables result;
+    return result;
+}
+
+/// Raw CRC of the given bytes, eight at a time
+uint32_t crc32cSoftware(uint32_t crc, const char * p, size_t n)
+{
+    const auto & t = tables().bytes;
+
+    while (n && ((uintptr_t)p & 7)) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --n;
+    }
+
+    while (n >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        word ^= crc;
+        crc = t[7][word & 0xff]
+            ^ t[6][(word >> 8) & 0xff]
+            ^ t[5][(word >> 16) & 0xff]
+            ^ t[4][(word >> 24) & 0xff]
+            ^ t[3][(word >> 32) & 0xff]
+            ^ t[2][(word >> 40) & 0xff]
+            ^ t[1][(word >> 48) & 0xff]
+            ^ t[0][word >> 56];
+        p += 8;
+        n -= 8;
+    }
+
+    while (n--) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+typedef uint32_t (*Crc32cImpl) (uint32_t crc, const char * p, size_t n);
+
+Crc32cImpl crc32cImpl = &crc32cSoftware;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHIFTING                                                                  */
+/*****************************************************************************/
+
+// Used by crc32c_sse42.cc to recombine its streams
+
+Crc32cShifter::
+Crc32cShifter(size_t n)
+{
+    uint32_t xn = xPow8n(n);
+    for (unsigned i = 0;  i < 4;  ++i) {
+        for (unsigned j = 0;  j < 256;  ++j) {
+            table[i][j] = multModP(xn, j << (8 * i));
+        }
+    }
+}
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+#if MLDB_INTEL_ISA && MLDB_BITS == 64
+        if (has_sse42()) {
+            crc32cImpl = &crc32cSse42;
+        }
+#endif
+    }
+} atInit;
+
+} // file scope
+
+uint32_t crc32c(const void * data, size_t length, uint32_t crc)
+{
+    return ~crc32cImpl(~crc, reinterpret_cast<const char *>(data), length);
+}
+
+uint32_t crc32cCombine(uint32_t crc1, uint32_t crc2, size_t length2)
+{
+    // The pre and post inversions of the first CRC cancel out through the
+    // shift; those of the second one are already there.
+    return multModP(xPow8n(length2), crc1) ^ crc2;
+}
+
+} // namespace MLDB
@@ -0,0 +1,31 @@
+/* crc32c.h                                                        -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   CRC-32C (Castagnoli) checksums, as used by iSCSI, ext4 and most storage
+   formats.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace MLDB {
+
+/** Return the CRC-32C of the given bytes.  Passing the CRC of the
+    previous bytes as crc allows a buffer to be checksummed in pieces:
+    crc32c(b, nb, crc32c(a, na)) == crc32c(a + b, na + nb).
+
+    This uses the SSE4.2 crc32 instruction on three independent streams at
+    once when the CPU supports it, running at several bytes per cycle, and
+    a table-driven implementation otherwise.
+*/
+uint32_t crc32c(const void * data, size_t length, uint32_t crc = 0);
+
+/** Return the CRC-32C of the concatenation of two buffers, given the
+    CRC-32C of each one and the length of the second.  This allows pieces
+    of a buffer to be checksummed in parallel.
+*/
+uint32_t crc32cCombine(uint32_t crc1, uint32_t crc2, size_t length2);
+
+} // namespace MLDB
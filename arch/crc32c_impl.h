@@ -0,0 +1,34 @@
+/* crc32c_impl.h                                                   -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Internals of the CRC-32C implementation, shared between the portable and
+   the SSE4.2 versions.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace MLDB {
+
+/** Shifts a raw CRC-32C by a fixed number of zero bytes, with a table
+    lookup per byte of the CRC. */
+struct Crc32cShifter {
+    Crc32cShifter(size_t numBytes);
+
+    uint32_t operator () (uint32_t crc) const
+    {
+        return table[0][crc & 0xff]
+            ^ table[1][(crc >> 8) & 0xff]
+            ^ table[2][(crc >> 16) & 0xff]
+            ^ table[3][crc >> 24];
+    }
+
+    uint32_t table[4][256];
+};
+
+/// Raw CRC-32C (no pre or post inversion) using the SSE4.2 instruction
+uint32_t crc32cSse42(uint32_t crc, const char * p, size_t n);
+
+} // namespace MLDB
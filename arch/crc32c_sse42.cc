@@ -0,0 +1,92 @@
+/* crc32c_sse42.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   CRC-32C using the SSE4.2 crc32 instruction.  Compiled with -msse4.2, and
+   only called once the CPU has been checked to support it.
+
+   The instruction has a latency of three cycles but a throughput of one
+   per cycle, so large buffers are split into three consecutive blocks
+   which are checksummed at the same time, and whose CRCs are then
+   combined.
+*/
+
+#include "crc32c_impl.h"
+#include <cstring>
+#include <nmmintrin.h>
+
+
+namespace MLDB {
+
+namespace {
+
+/// Size of each of the three blocks for large buffers
+constexpr size_t LONG_BLOCK = 8192;
+
+/// Size of each of the three blocks for the remainder
+constexpr size_t SHORT_BLOCK = 256;
+
+inline uint64_t load64(const char * p)
+{
+    uint64_t result;
+    std::memcpy(&result, p, 8);
+    return result;
+}
+
+/* Checksum three consecutive blocks of blockSize bytes at once, and
+   recombine them into crc.  blockSize must be a multiple of 8. */
+inline uint32_t
+crc32cThreeBlocks(uint32_t crc, const char * p, size_t blockSize,
+                  const Crc32cShifter & shift)
+{
+    uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+    const char * end = p + blockSize;
+    for (;  p < end;  p += 8) {
+        crc0 = _mm_crc32_u64(crc0, load64(p));
+        crc1 = _mm_crc32_u64(crc1, load64(p + blockSize));
+        crc2 = _mm_crc32_u64(crc2, load64(p + 2 * blockSize));
+    }
+    crc = shift(crc0) ^ crc1;
+    return shift(crc) ^ crc2;
+}
+
+} // file scope
+
+uint32_t crc32cSse42(uint32_t crc, const char * p, size_t n)
+{
+    static const Crc32cShifter shiftLong(LONG_BLOCK);
+    static const Crc32cShifter shiftShort(SHORT_BLOCK);
+
+    // Align to 8 bytes
+    while (n && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --n;
+    }
+
+    while (n >= 3 * LONG_BLOCK) {
+        crc = crc32cThreeBlocks(crc, p, LONG_BLOCK, shiftLong);
+        p += 3 * LONG_BLOCK;
+        n -= 3 * LONG_BLOCK;
+    }
+
+    while (n >= 3 * SHORT_BLOCK) {
+        crc = crc32cThreeBlocks(crc, p, SHORT_BLOCK, shiftShort);
+        p += 3 * SHORT_BLOCK;
+        n -= 3 * SHORT_BLOCK;
+    }
+
+    uint64_t crc64 = crc;
+    while (n >= 8) {
+        crc64 = _mm_crc32_u64(crc64, load64(p));
+        p += 8;
+        n -= 8;
+    }
+    crc = crc64;
+
+    while (n--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return crc;
+}
+
+} // namespace MLDB
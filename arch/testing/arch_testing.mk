@@ -20,6 +20,7 @@ ifeq ($(ARCH),x86_64)
 $(eval $(call test,sse2_math_test,arch,boost))
 $(eval $(call test,simd_test,arch,boost))
 $(eval $(call test,cpuid_test,arch,boost))
+$(eval $(call test,crc32c_test,arch,boost))
 endif
 
 ifeq ($(WITH_CUDA),1)
@@ -0,0 +1,87 @@
+/* crc32c_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the CRC-32C checksums.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/crc32c.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+/// Bit at a time reference implementation
+uint32_t crc32cReference(const char * p, size_t n)
+{
+    uint32_t crc = ~0u;
+    for (size_t i = 0;  i < n;  ++i) {
+        crc ^= (unsigned char)p[i];
+        for (unsigned j = 0;  j < 8;  ++j)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+    }
+    return ~crc;
+}
+
+std::vector<char> randomBytes(size_t n)
+{
+    std::mt19937 rng(n);
+    std::vector<char> result(n);
+    for (auto & c: result)
+        c = rng();
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_known_values )
+{
+    BOOST_CHECK_EQUAL(crc32c("", 0), 0);
+    BOOST_CHECK_EQUAL(crc32c("123456789", 9), 0xe3069283);
+
+    // From RFC 3720, appendix B.4
+    std::string zeros(32, '\0');
+    BOOST_CHECK_EQUAL(crc32c(zeros.data(), 32), 0x8a9136aa);
+    std::string ones(32, '\xff');
+    BOOST_CHECK_EQUAL(crc32c(ones.data(), 32), 0x62a8ab43);
+}
+
+BOOST_AUTO_TEST_CASE( test_lengths_and_alignments )
+{
+    // Covers the unaligned start, the three block paths and the tail
+    auto bytes = randomBytes(100000);
+    for (size_t len: { 1, 7, 8, 9, 100, 767, 768, 769, 5000,
+                       24575, 24576, 24577, 60000, 99992 }) {
+        for (size_t offset = 0;  offset < 8;  ++offset) {
+            BOOST_CHECK_EQUAL(crc32c(bytes.data() + offset, len),
+                              crc32cReference(bytes.data() + offset, len));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_incremental_and_combine )
+{
+    auto bytes = randomBytes(70000);
+    uint32_t whole = crc32c(bytes.data(), bytes.size());
+
+    for (size_t split: { 0, 1, 13, 8192, 30000, 69999, 70000 }) {
+        uint32_t first = crc32c(bytes.data(), split);
+        uint32_t second = crc32c(bytes.data() + split, bytes.size() - split);
+
+        BOOST_CHECK_EQUAL(crc32c(bytes.data() + split,
+                                 bytes.size() - split, first),
+                          whole);
+        BOOST_CHECK_EQUAL(crc32cCombine(first, second, bytes.size() - split),
+                          whole);
+    }
+}
@@ -3,9 +3,10 @@
 LIBBLOCK_SOURCES:= \
 	memory_region.cc \
 	zip_serializer.cc \
-	file_serializer.cc
+	file_serializer.cc \
+	compressed_region.cc
 
-$(eval $(call library,block,$(LIBBLOCK_SOURCES),vfs $(LIBARCHIVE_LIB_NAME) types))
+$(eval $(call library,block,$(LIBBLOCK_SOURCES),vfs $(LIBARCHIVE_LIB_NAME) types base zstd lz4))
 
 $(eval $(call include_sub_make,testing))
 
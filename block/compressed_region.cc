@@ -0,0 +1,796 @@
+/** compressed_region.cc                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Seekable, block-compressed representation of a frozen memory region.
+
+    Layout of a compressed region (native byte order):
+
+        Header              64 bytes, see below
+        Index               numBlocks + 1 offsets of the blocks, from the
+                            start of the region, as uint64_t
+        Blocks              each one compressed on its own
+
+    A block whose stored size is equal to its uncompressed size is stored
+    without compression.
+*/
+
+#include "compressed_region.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/vm.h"
+#include "mldb/arch/format.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/ext/zstd/lib/zstd.h"
+#include "mldb/ext/lz4/lz4.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <linux/userfaultfd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+enum Codec: uint32_t {
+    CODEC_NONE = 0,
+    CODEC_ZSTD = 1,
+    CODEC_LZ4 = 2
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint64_t length;       ///< Uncompressed length
+    uint64_t blockSize;    ///< Uncompressed size of each block
+    uint64_t numBlocks;
+    uint64_t reserved[3];
+};
+
+static_assert(sizeof(Header) == 64, "Compressed region header must be 64 bytes");
+
+const char MAGIC[8] = { 'M', 'L', 'D', 'B', 'C', 'R', 'G', '1' };
+
+constexpr uint32_t VERSION = 1;
+
+Codec parseCodec(const std::string & compression)
+{
+    if (compression == "zstd")
+        return CODEC_ZSTD;
+    else if (compression == "lz4")
+        return CODEC_LZ4;
+    else if (compression == "none" || compression.empty())
+        return CODEC_NONE;
+    throw AnnotatedException
+        (400, "Unknown block compression '" + compression
+         + "'; expected zstd, lz4 or none");
+}
+
+size_t roundUpToPage(size_t n)
+{
+    return (n + page_size - 1) & ~size_t(page_offset_mask);
+}
+
+/** Compress a single block.  Returns an empty string if it doesn't get
+    any smaller, in which case it is stored as-is. */
+std::string compressBlock(Codec codec, int level, const char * data, size_t n)
+{
+    std::string result;
+
+    switch (codec) {
+    case CODEC_NONE:
+        return result;
+    case CODEC_ZSTD: {
+        result.resize(ZSTD_compressBound(n));
+        size_t res = ZSTD_compress(&result[0], result.size(), data, n, level);
+        if (ZSTD_isError(res)) {
+            throw AnnotatedException
+                (500, string("Error compressing block with zstd: ")
+                 + ZSTD_getErrorName(res));
+        }
+        result.resize(res);
+        break;
+    }
+    case CODEC_LZ4: {
+        result.resize(LZ4_compressBound(n));
+        int res = LZ4_compress_default(data, &result[0], n, result.size());
+        if (res <= 0) {
+            throw AnnotatedException(500, "Error compressing block with lz4");
+        }
+        result.resize(res);
+        break;
+    }
+    }
+
+    if (result.size() >= n)
+        result.clear();
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPRESS REGION                                                           */
+/*****************************************************************************/
+
+void
+CompressedRegionOptions::
+check() const
+{
+    parseCodec(compression);
+}
+
+FrozenMemoryRegion
+compressRegion(const FrozenMemoryRegion & region,
+               MappedSerializer & serializer,
+               const CompressedRegionOptions & options)
+{
+    Codec codec = parseCodec(options.compression);
+    size_t blockSize = roundUpToPage(std::max<size_t>(options.blockSize, 1));
+    size_t length = region.length();
+    size_t numBlocks = (length + blockSize - 1) / blockSize;
+
+    std::vector<std::string> compressed(numBlocks);
+
+    auto doBlock = [&] (size_t i)
+        {
+            size_t start = i * blockSize;
+            size_t n = std::min(blockSize, length - start);
+            compressed[i] = compressBlock(codec, options.level,
+                                          region.data() + start, n);
+        };
+
+    parallelMap(0, numBlocks, doBlock);
+
+    size_t indexOffset = sizeof(Header);
+    size_t blocksOffset = indexOffset + (numBlocks + 1) * sizeof(uint64_t);
+    size_t totalLength = blocksOffset;
+    for (size_t i = 0;  i < numBlocks;  ++i) {
+        totalLength += compressed[i].empty()
+            ? std::min(blockSize, length - i * blockSize)
+            : compressed[i].size();
+    }
+
+    auto out = serializer.allocateWritable(totalLength, alignof(uint64_t));
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.codec = codec;
+    header.length = length;
+    header.blockSize = blockSize;
+    header.numBlocks = numBlocks;
+    std::memcpy(out.data(), &header, sizeof(header));
+
+    uint64_t * index = reinterpret_cast<uint64_t *>(out.data() + indexOffset);
+    size_t offset = blocksOffset;
+    for (size_t i = 0;  i < numBlocks;  ++i) {
+        index[i] = offset;
+        if (compressed[i].empty()) {
+            size_t n = std::min(blockSize, length - i * blockSize);
+            std::memcpy(out.data() + offset, region.data() + i * blockSize, n);
+            offset += n;
+        }
+        else {
+            std::memcpy(out.data() + offset, compressed[i].data(),
+                        compressed[i].size());
+            offset += compressed[i].size();
+        }
+        // Free as we go to halve the peak memory usage
+        std::string().swap(compressed[i]);
+    }
+    index[numBlocks] = offset;
+    ExcAssertEqual(offset, totalLength);
+
+    return out.freeze();
+}
+
+
+/*****************************************************************************/
+/* COMPRESSED REGION                                                         */
+/*****************************************************************************/
+
+struct CompressedRegion::Itl {
+    Itl(FrozenMemoryRegion compressed_, size_t maxCachedBlocks)
+        : compressed(std::move(compressed_)),
+          maxCachedBlocks(std::max<size_t>(maxCachedBlocks, 1))
+    {
+        if (!isCompressed(compressed)) {
+            throw AnnotatedException
+                (400, "Region is not a block compressed region");
+        }
+
+        std::memcpy(&header, compressed.data(), sizeof(header));
+        if (header.version != VERSION) {
+            throw AnnotatedException
+                (400, MLDB::format("Unknown compressed region version %d",
+                                   (int)header.version));
+        }
+        if (header.codec > CODEC_LZ4) {
+            throw AnnotatedException
+                (400, MLDB::format("Unknown compressed region codec %d",
+                                   (int)header.codec));
+        }
+        if (header.blockSize == 0
+            || header.numBlocks
+               != (header.length + header.blockSize - 1) / header.blockSize
+            || (compressed.length() - sizeof(Header)) / sizeof(uint64_t)
+               < header.numBlocks + 1) {
+            throw AnnotatedException
+                (400, "Compressed region has an inconsistent header");
+        }
+
+        index = reinterpret_cast<const uint64_t *>
+            (compressed.data() + sizeof(Header));
+        if (index[header.numBlocks] > compressed.length()) {
+            throw AnnotatedException
+                (400, "Compressed region is truncated");
+        }
+    }
+
+    FrozenMemoryRegion compressed;
+    Header header;
+    const uint64_t * index = nullptr;
+
+    /// Uncompressed size of the given block
+    size_t blockLength(size_t blockNum) const
+    {
+        return std::min<size_t>(header.blockSize,
+                                header.length - blockNum * header.blockSize);
+    }
+
+    /** Decompress the given block into out, which must have space for
+        blockLength(blockNum) bytes. */
+    void decompressBlock(size_t blockNum, char * out) const
+    {
+        if (blockNum >= header.numBlocks) {
+            throw AnnotatedException
+                (400, MLDB::format("Block %zd out of range in compressed "
+                                   "region of %zd blocks",
+                                   blockNum, (size_t)header.numBlocks));
+        }
+
+        size_t n = blockLength(blockNum);
+        size_t start = index[blockNum], end = index[blockNum + 1];
+        if (end < start || end > compressed.length()) {
+            throw AnnotatedException
+                (400, MLDB::format("Compressed region block %zd has an "
+                                   "invalid extent", blockNum));
+        }
+        const char * src = compressed.data() + start;
+        size_t srcLength = end - start;
+
+        if (srcLength == n) {
+            std::memcpy(out, src, n);
+            return;
+        }
+
+        size_t decompressed = 0;
+        switch (header.codec) {
+        case CODEC_ZSTD: {
+            size_t res = ZSTD_decompress(out, n, src, srcLength);
+            if (ZSTD_isError(res)) {
+                throw AnnotatedException
+                    (400, string("Error decompressing zstd block: ")
+                     + ZSTD_getErrorName(res));
+            }
+            decompressed = res;
+            break;
+        }
+        case CODEC_LZ4: {
+            int res = LZ4_decompress_safe(src, out, srcLength, n);
+            if (res < 0) {
+                throw AnnotatedException
+                    (400, "Error decompressing lz4 block");
+            }
+            decompressed = res;
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (decompressed != n) {
+            throw AnnotatedException
+                (400, MLDB::format("Compressed region block %zd decompressed "
+                                   "to %zd bytes instead of %zd",
+                                   blockNum, decompressed, n));
+        }
+    }
+
+    FrozenMemoryRegion getBlock(size_t blockNum)
+    {
+        {
+            std::unique_lock<std::mutex> guard(cacheMutex);
+            auto it = cache.find(blockNum);
+            if (it != cache.end()) {
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->second;
+            }
+        }
+
+        // Decompress without holding the lock, so that several threads can
+        // do so at once.  Two threads may decompress the same block; the
+        // second one simply uses the first one's copy.
+        size_t n = blockLength(blockNum);
+        auto buf = std::make_shared<std::vector<char> >(n);
+        decompressBlock(blockNum, buf->data());
+        FrozenMemoryRegion result(buf, buf->data(), n);
+
+        std::unique_lock<std::mutex> guard(cacheMutex);
+        auto it = cache.find(blockNum);
+        if (it != cache.end())
+            return it->second->second;
+
+        lru.emplace_front(blockNum, result);
+        cache[blockNum] = lru.begin();
+        while (lru.size() > maxCachedBlocks) {
+            cache.erase(lru.back().first);
+            lru.pop_back();
+        }
+
+        return result;
+    }
+
+    size_t maxCachedBlocks;
+    std::mutex cacheMutex;
+    typedef std::list<std::pair<size_t, FrozenMemoryRegion> > Lru;
+    Lru lru;  ///< Most recently used at the front
+    std::unordered_map<size_t, Lru::iterator> cache;
+};
+
+
+/*****************************************************************************/
+/* LAZY MAPPINGS                                                             */
+/*****************************************************************************/
+
+/* An uncompressed view is an anonymous mapping registered with userfaultfd.
+   The first access to one of its pages stops the faulting thread and sends
+   a message to one of the handler threads, which decompresses the
+   whole block containing the page and installs it atomically with
+   UFFDIO_COPY, which wakes up the thread.  Once there are too many blocks
+   resident, the oldest one is dropped with MADV_DONTNEED so that the next
+   access faults again.
+
+   Since the userfaultfd is created without UFFD_USER_MODE_ONLY, accesses by
+   the kernel (eg, a write() from the view) are also resolved.
+
+   A block which can't be decompressed is reported the way the kernel
+   reports an I/O error under a file mapping: the error is logged, the
+   block reads as zeros and the faulting thread gets a SIGBUS.
+*/
+
+namespace {
+
+struct LazyMapping {
+    LazyMapping(std::shared_ptr<CompressedRegion::Itl> source,
+                size_t maxResidentBlocks)
+        : source(std::move(source)),
+          maxResidentBlocks(std::max<size_t>(maxResidentBlocks, 1))
+    {
+        mappedLength = roundUpToPage(this->source->header.length);
+        void * mem = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                          -1, 0);
+        if (mem == MAP_FAILED) {
+            throw AnnotatedException
+                (500, string("Couldn't reserve address space for "
+                             "uncompressed region: ") + strerror(errno));
+        }
+        start = reinterpret_cast<char *>(mem);
+        resident.resize(this->source->header.numBlocks, false);
+    }
+
+    ~LazyMapping();
+
+    /** Resolve a fault at the given address by the given thread. */
+    void handleFault(int uffd, uintptr_t address, pid_t tid)
+    {
+        size_t blockSize = source->header.blockSize;
+        size_t blockNum = (address - (uintptr_t)start) / blockSize;
+        char * blockStart = start + blockNum * blockSize;
+        size_t n = source->blockLength(blockNum);
+        size_t copyLength = roundUpToPage(n);
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            if (resident[blockNum]) {
+                // Another thread faulted on the same block at the same time
+                wake(uffd, blockStart, copyLength);
+                return;
+            }
+        }
+
+        static thread_local std::shared_ptr<char> buffer;
+        static thread_local size_t bufferLength = 0;
+        if (bufferLength < blockSize) {
+            void * mem = nullptr;
+            if (posix_memalign(&mem, page_size, blockSize))
+                throw std::bad_alloc();
+            buffer.reset(reinterpret_cast<char *>(mem), free);
+            bufferLength = blockSize;
+        }
+
+        try {
+            source->decompressBlock(blockNum, buffer.get());
+        } catch (const std::exception & exc) {
+            cerr << "error decompressing lazily mapped block " << blockNum
+                 << ": " << exc.what() << endl;
+            failBlock(uffd, blockNum, tid);
+            return;
+        }
+        std::memset(buffer.get() + n, 0, copyLength - n);
+
+        // Blocks are installed and evicted whole under the lock, so that
+        // each one is either entirely mapped or entirely missing.
+        std::unique_lock<std::mutex> guard(mutex);
+        if (resident[blockNum]) {
+            wake(uffd, blockStart, copyLength);
+            return;
+        }
+
+        struct uffdio_copy copy;
+        copy.dst = (uintptr_t)blockStart;
+        copy.src = (uintptr_t)buffer.get();
+        copy.len = copyLength;
+        copy.mode = 0;
+        copy.copy = 0;
+
+        while (ioctl(uffd, UFFDIO_COPY, &copy) == -1) {
+            if (errno == EAGAIN) {
+                // Partial copy; carry on from where it stopped
+                if (copy.copy > 0) {
+                    copy.dst += copy.copy;
+                    copy.src += copy.copy;
+                    copy.len -= copy.copy;
+                }
+                copy.copy = 0;
+                continue;
+            }
+            if (errno == EEXIST) {
+                wake(uffd, blockStart, copyLength);
+                break;
+            }
+            cerr << "error resolving fault in lazily mapped block "
+                 << blockNum << ": " << strerror(errno) << endl;
+            guard.unlock();
+            failBlock(uffd, blockNum, tid);
+            return;
+        }
+
+        addResident(blockNum);
+    }
+
+    /** Resolve a fault on a block that couldn't be decompressed: map zeros
+        in its place so that the thread isn't left waiting, and send it a
+        SIGBUS. */
+    void failBlock(int uffd, size_t blockNum, pid_t tid)
+    {
+        char * blockStart = start + blockNum * source->header.blockSize;
+        size_t length = roundUpToPage(source->blockLength(blockNum));
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            if (!resident[blockNum]) {
+                struct uffdio_zeropage zero;
+                zero.range.start = (uintptr_t)blockStart;
+                zero.range.len = length;
+                zero.mode = UFFDIO_ZEROPAGE_MODE_DONTWAKE;
+                zero.zeropage = 0;
+                if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) == 0
+                    || errno == EEXIST)
+                    addResident(blockNum);
+            }
+        }
+
+        // The signal is pending before the thread returns to user space
+        syscall(SYS_tgkill, getpid(), tid, SIGBUS);
+        wake(uffd, blockStart, length);
+    }
+
+    /** Record that the block is mapped, and drop the oldest blocks if
+        there are too many.  Must be called with the mutex held. */
+    void addResident(size_t blockNum)
+    {
+        size_t blockSize = source->header.blockSize;
+        resident[blockNum] = true;
+        residentOrder.push_back(blockNum);
+
+        while (residentOrder.size() > maxResidentBlocks) {
+            size_t victim = residentOrder.front();
+            residentOrder.pop_front();
+            resident[victim] = false;
+            madvise(start + victim * blockSize,
+                    roundUpToPage(source->blockLength(victim)),
+                    MADV_DONTNEED);
+        }
+    }
+
+    static void wake(int uffd, char * addr, size_t len)
+    {
+        struct uffdio_range range;
+        range.start = (uintptr_t)addr;
+        range.len = len;
+        ioctl(uffd, UFFDIO_WAKE, &range);
+    }
+
+    std::shared_ptr<CompressedRegion::Itl> source;
+    char * start = nullptr;
+    size_t mappedLength = 0;
+
+    std::mutex mutex;
+    size_t maxResidentBlocks;
+    std::vector<bool> resident;
+    std::list<size_t> residentOrder;  ///< Oldest first
+};
+
+/** Owns the userfaultfd and the threads that resolve the faults of all of
+    the lazy mappings.  Created the first time it's needed and lives until
+    the end of the process. */
+struct FaultHandler {
+    FaultHandler()
+    {
+        uffd = syscall(__NR_userfaultfd, O_CLOEXEC);
+        if (uffd == -1) {
+            throw AnnotatedException
+                (500, string("userfaultfd: ") + strerror(errno));
+        }
+
+        struct uffdio_api api;
+        api.api = UFFD_API;
+        // Tells us which thread faulted, so that it can be signalled
+        api.features = UFFD_FEATURE_THREAD_ID;
+        if (ioctl(uffd, UFFDIO_API, &api) == -1) {
+            int err = errno;
+            close(uffd);
+            throw AnnotatedException
+                (500, string("userfaultfd API: ") + strerror(err));
+        }
+
+        unsigned numThreads
+            = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+        for (unsigned i = 0;  i < numThreads;  ++i) {
+            std::thread(&FaultHandler::run, this).detach();
+        }
+    }
+
+    static FaultHandler * get()
+    {
+        static FaultHandler * result = [] () -> FaultHandler *
+            {
+                const char * env = getenv("MLDB_LAZY_DECOMPRESSION");
+                if (env && string(env) == "0")
+                    return nullptr;
+                try {
+                    return new FaultHandler();
+                } catch (const std::exception & exc) {
+                    return nullptr;
+                }
+            } ();
+        return result;
+    }
+
+    /** Register a mapping.  Its address range is watched until it is
+        unmapped. */
+    void add(const std::shared_ptr<LazyMapping> & mapping)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            mappings[(uintptr_t)mapping->start] = mapping;
+        }
+
+        struct uffdio_register reg;
+        reg.range.start = (uintptr_t)mapping->start;
+        reg.range.len = mapping->mappedLength;
+        reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+        if (ioctl(uffd, UFFDIO_REGISTER, &reg) == -1) {
+            int err = errno;
+            remove(mapping.get());
+            throw AnnotatedException
+                (500, string("Couldn't register uncompressed region with "
+                             "userfaultfd: ") + strerror(err));
+        }
+    }
+
+    void remove(LazyMapping * mapping)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        mappings.erase((uintptr_t)mapping->start);
+    }
+
+    std::shared_ptr<LazyMapping> find(uintptr_t address)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = mappings.upper_bound(address);
+        if (it == mappings.begin())
+            return nullptr;
+        --it;
+        auto result = it->second.lock();
+        if (!result
+            || address >= (uintptr_t)result->start + result->mappedLength)
+            return nullptr;
+        return result;
+    }
+
+    void run()
+    {
+        for (;;) {
+            struct uffd_msg msg;
+            ssize_t res = read(uffd, &msg, sizeof(msg));
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res != sizeof(msg)) {
+                cerr << "error reading from userfaultfd: "
+                     << strerror(errno) << endl;
+                abort();
+            }
+            if (msg.event != UFFD_EVENT_PAGEFAULT)
+                continue;
+
+            uintptr_t address = msg.arg.pagefault.address;
+            auto mapping = find(address);
+            if (!mapping) {
+                // Can't happen: the faulting thread holds a reference to
+                // the region it's accessing.
+                cerr << "userfaultfd fault at unknown address "
+                     << (void *)address << endl;
+                abort();
+            }
+            mapping->handleFault(uffd, address, msg.arg.pagefault.feat.ptid);
+        }
+    }
+
+    int uffd = -1;
+    std::mutex mutex;
+    std::map<uintptr_t, std::weak_ptr<LazyMapping> > mappings;
+};
+
+LazyMapping::
+~LazyMapping()
+{
+    // Nothing can fault on it anymore, as nothing references it.  The
+    // munmap() also unregisters it with the userfaultfd.
+    FaultHandler::get()->remove(this);
+    munmap(start, mappedLength);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPRESSED REGION                                                         */
+/*****************************************************************************/
+
+CompressedRegion::
+CompressedRegion(FrozenMemoryRegion compressed, size_t maxCachedBlocks)
+    : itl(std::make_shared<Itl>(std::move(compressed), maxCachedBlocks))
+{
+}
+
+CompressedRegion::
+~CompressedRegion()
+{
+}
+
+bool
+CompressedRegion::
+isCompressed(const FrozenMemoryRegion & region)
+{
+    return region.length() >= sizeof(Header)
+        && std::memcmp(region.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+size_t
+CompressedRegion::
+length() const
+{
+    return itl->header.length;
+}
+
+size_t
+CompressedRegion::
+blockSize() const
+{
+    return itl->header.blockSize;
+}
+
+size_t
+CompressedRegion::
+numBlocks() const
+{
+    return itl->header.numBlocks;
+}
+
+FrozenMemoryRegion
+CompressedRegion::
+getBlock(size_t blockNum) const
+{
+    if (blockNum >= numBlocks()) {
+        throw AnnotatedException
+            (400, MLDB::format("Block %zd out of range in compressed "
+                               "region of %zd blocks",
+                               blockNum, numBlocks()));
+    }
+    return itl->getBlock(blockNum);
+}
+
+void
+CompressedRegion::
+read(size_t offset, size_t length, char * out) const
+{
+    if (offset > this->length() || length > this->length() - offset) {
+        throw AnnotatedException
+            (400, MLDB::format("Read of %zd bytes at offset %zd is out of "
+                               "range in compressed region of %zd bytes",
+                               length, offset, this->length()));
+    }
+
+    size_t bs = blockSize();
+    while (length > 0) {
+        size_t blockNum = offset / bs;
+        size_t inBlock = offset % bs;
+        auto block = itl->getBlock(blockNum);
+        size_t n = std::min(length, block.length() - inBlock);
+        std::memcpy(out, block.data() + inBlock, n);
+        out += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+FrozenMemoryRegion
+CompressedRegion::
+mapUncompressed(size_t maxResidentBlocks) const
+{
+    FaultHandler * handler = FaultHandler::get();
+    if (!handler || length() == 0 || blockSize() % page_size != 0)
+        return decompressAll();
+
+    auto mapping = std::make_shared<LazyMapping>(itl, maxResidentBlocks);
+    handler->add(mapping);
+    return FrozenMemoryRegion(mapping, mapping->start, length());
+}
+
+FrozenMemoryRegion
+CompressedRegion::
+decompressAll() const
+{
+    auto buf = std::make_shared<std::vector<char> >(length());
+
+    auto doBlock = [&] (size_t i)
+        {
+            itl->decompressBlock(i, buf->data() + i * blockSize());
+        };
+
+    parallelMap(0, numBlocks(), doBlock);
+
+    return FrozenMemoryRegion(buf, buf->data(), buf->size());
+}
+
+bool
+CompressedRegion::
+lazyMappingAvailable()
+{
+    return FaultHandler::get() != nullptr;
+}
+
+} // namespace MLDB
@@ -0,0 +1,108 @@
+/** compressed_region.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Seekable, block-compressed representation of a frozen memory region.
+*/
+
+#pragma once
+
+#include "memory_region.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COMPRESSED REGION                                                         */
+/*****************************************************************************/
+
+/** Options for compressRegion(). */
+struct CompressedRegionOptions {
+    /// Codec for the blocks: "zstd", "lz4" or "none"
+    std::string compression = "zstd";
+
+    /// Compression level; only used by zstd
+    int level = 3;
+
+    /// Size of each independently compressed block.  Rounded up to a
+    /// multiple of the page size, so that blocks can be mapped in.
+    size_t blockSize = 128 * 1024;
+
+    /// Throw a 400 error if the codec isn't known
+    void check() const;
+};
+
+/** Compress the given region into a seekable container, allocated from the
+    given serializer.  The region is cut into blocks of blockSize bytes
+    which are compressed independently (in parallel), followed by an index
+    of their offsets, so that any byte can be found by decompressing a
+    single block.  Blocks which don't compress are stored as-is.
+*/
+FrozenMemoryRegion
+compressRegion(const FrozenMemoryRegion & region,
+               MappedSerializer & serializer,
+               const CompressedRegionOptions & options
+                   = CompressedRegionOptions());
+
+/** Read access to a region written by compressRegion().  Copies of a
+    CompressedRegion share the same block cache.
+*/
+struct CompressedRegion {
+    /** Open the compressed region.  Up to maxCachedBlocks decompressed
+        blocks are kept for getBlock() and read().  Throws if the region
+        isn't in the compressed format.
+    */
+    CompressedRegion(FrozenMemoryRegion compressed,
+                     size_t maxCachedBlocks = 16);
+
+    ~CompressedRegion();
+
+    /// Return whether the region is in the compressed format
+    static bool isCompressed(const FrozenMemoryRegion & region);
+
+    /// Length of the uncompressed data
+    size_t length() const;
+
+    /// Size of each block, except maybe the last
+    size_t blockSize() const;
+
+    /// Number of blocks
+    size_t numBlocks() const;
+
+    /// Return the uncompressed contents of the given block
+    FrozenMemoryRegion getBlock(size_t blockNum) const;
+
+    /// Copy the given range of the uncompressed data into out
+    void read(size_t offset, size_t length, char * out) const;
+
+    /** Return the whole uncompressed data as an ordinary frozen region.
+
+        Where the kernel allows it (userfaultfd), this reserves address
+        space for the uncompressed data and decompresses blocks on demand,
+        the first time one of their pages is touched.  At most
+        maxResidentBlocks blocks are kept in memory; the oldest are dropped
+        and decompressed again if they're used again.  Otherwise, the data
+        is all decompressed up front.
+
+        A block which turns out to be corrupt when it's faulted in is
+        logged, reads as zeros, and raises SIGBUS in the accessing thread,
+        like an I/O error under a mapped file.  decompressAll() throws
+        instead.
+    */
+    FrozenMemoryRegion mapUncompressed(size_t maxResidentBlocks = 64) const;
+
+    /// Decompress all of the data (in parallel) into memory
+    FrozenMemoryRegion decompressAll() const;
+
+    /** Return whether mapUncompressed() can decompress blocks on demand
+        in this process.  MLDB_LAZY_DECOMPRESSION=0 turns it off.
+    */
+    static bool lazyMappingAvailable();
+
+    struct Itl;
+
+private:
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -9,8 +9,10 @@
 #include "memory_region_impl.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/arch/vm.h"
+#include "mldb/vfs/io_uring.h"
 
 #include <mutex>
+#include <iostream>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -29,8 +31,8 @@ namespace MLDB {
 /*****************************************************************************/
 
 struct FileSerializer::Itl {
-    Itl(Utf8String filename_)
-        : filename(std::move(filename_))
+    Itl(Utf8String filename_, bool writeback)
+        : filename(std::move(filename_)), writeback(writeback)
     {
         fd = open(filename.rawData(), O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
         if (fd == -1) {
@@ -38,16 +40,35 @@ struct FileSerializer::Itl {
                 (400, "Failed to open memory map file: "
                  + string(strerror(errno)));
         }
+
+        if (!writeback) {
+            const char * env = getenv("MLDB_FILE_SERIALIZER_WRITEBACK");
+            this->writeback = env && string(env) == "1";
+        }
+
+        if (this->writeback && IoUring::available()) {
+            try {
+                ring.reset(new IoUring(WRITEBACK_BATCH_SIZE * 2));
+                if (!ring->supportsWriteback())
+                    ring.reset();
+            } catch (const std::exception & exc) {
+                // Fall back to synchronous writeback
+                ring.reset();
+            }
+        }
     }
     
-    ~Itl()
+    ~Itl() noexcept
     {
-        if (arenas.empty())
-            return;
-
-        commit();
-
-        arenas.clear();
+        if (!arenas.empty()) {
+            try {
+                commit();
+            } catch (const std::exception & exc) {
+                cerr << "error committing memory map file " << filename
+                     << ": " << exc.what() << endl;
+            }
+            arenas.clear();
+        }
 
         ::close(fd);
     }
@@ -65,6 +86,8 @@ struct FileSerializer::Itl {
         if (arenas.empty())
             return;
 
+        finishWriteback();
+
         size_t realLength = arenas.back().startOffset + arenas.back().currentOffset;
 
         int res = ::ftruncate(fd, realLength);
@@ -74,6 +97,82 @@ struct FileSerializer::Itl {
         }
     }
 
+    /* Start writing the pages of a frozen region back to the file, so that
+       the writes to the device are spread over the serialization instead
+       of all happening when the pages are evicted or the file is synced.
+       Writebacks are sent to io_uring in batches; without it, the
+       writeback of each region is started synchronously. */
+    void startWriteback(const void * data, size_t length)
+    {
+        if (!writeback || length == 0)
+            return;
+
+        std::unique_lock<std::mutex> guard(mutex);
+
+        const char * p = reinterpret_cast<const char *>(data);
+        const Arena * arena = nullptr;
+        for (auto & a: arenas) {
+            const char * start = reinterpret_cast<const char *>(a.addr);
+            if (p >= start && p + length <= start + a.length) {
+                arena = &a;
+                break;
+            }
+        }
+        if (!arena)
+            return;
+
+        uint64_t offset = arena->startOffset
+            + (p - reinterpret_cast<const char *>(arena->addr));
+        uint64_t end = offset + length;
+        offset &= ~(uint64_t)page_offset_mask;
+        end = (end + page_offset_mask) & ~(uint64_t)page_offset_mask;
+
+        if (!ring) {
+            ::sync_file_range(fd, offset, end - offset,
+                              SYNC_FILE_RANGE_WRITE);
+            return;
+        }
+
+        reapWriteback();
+        while (ring->inFlight() >= WRITEBACK_BATCH_SIZE * 2)
+            checkWriteback(ring->waitCompletion());
+        if (!ring->queueWriteback(fd, offset, end - offset, 0))
+            throw AnnotatedException(500, "io_uring submission queue full");
+        if (++numQueued == WRITEBACK_BATCH_SIZE) {
+            ring->submit();
+            numQueued = 0;
+        }
+    }
+
+    /* Collect the writebacks that have finished, without waiting. */
+    void reapWriteback()
+    {
+        IoUring::Completion completion;
+        while (ring->tryGetCompletion(completion))
+            checkWriteback(completion);
+    }
+
+    /* Wait for all writebacks to finish.  Must be called with the mutex
+       held. */
+    void finishWriteback()
+    {
+        if (!ring)
+            return;
+        ring->submit();
+        numQueued = 0;
+        while (ring->inFlight())
+            checkWriteback(ring->waitCompletion());
+    }
+
+    void checkWriteback(const IoUring::Completion & completion)
+    {
+        if (completion.result < 0) {
+            throw AnnotatedException
+                (500, "writeback of memory map file failed: "
+                 + string(strerror(-completion.result)));
+        }
+    }
+
     std::shared_ptr<void>
     allocateWritableImpl(uint64_t bytesRequired, size_t alignment)
     {
@@ -203,6 +302,13 @@ struct FileSerializer::Itl {
     int fd = -1;
     size_t currentlyAllocated = 0;
 
+    bool writeback = false;  ///< Start the writeback of frozen regions
+
+    /// Number of frozen regions whose writeback is submitted at once
+    static constexpr unsigned WRITEBACK_BATCH_SIZE = 16;
+    std::unique_ptr<IoUring> ring;  ///< Null if io_uring isn't available
+    unsigned numQueued = 0;         ///< Writebacks queued but not submitted
+
     struct Arena {
         Arena(void * addr, size_t startOffset, size_t length)
             : addr(addr), startOffset(startOffset), length(length)
@@ -255,8 +361,8 @@ struct FileSerializer::Itl {
 };
 
 FileSerializer::
-FileSerializer(Utf8String filename)
-    : itl(new Itl(filename))
+FileSerializer(Utf8String filename, bool writeback)
+    : itl(new Itl(filename, writeback))
 {
 }
 
@@ -286,6 +392,7 @@ FrozenMemoryRegion
 FileSerializer::
 freeze(MutableMemoryRegion & region)
 {
+    itl->startWriteback(region.data(), region.length());
     return FrozenMemoryRegion(region.handle(), region.data(), region.length());
 }
 
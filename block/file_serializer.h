@@ -19,10 +19,17 @@ namespace MLDB {
 
 /** Mapped serializer that allocates things from a file that is then memory
     mapped.  This allows for unused data to be paged out.
+
+    If writeback is true (or MLDB_FILE_SERIALIZER_WRITEBACK=1 is set), the
+    writeback of each frozen region to the file is started straight away,
+    through io_uring when it's available, so that the device writes are
+    spread over the serialization rather than all happening on commit.
+    It's off by default, as it costs extra I/O for files which are
+    deleted before their pages would have been written.
 */
 
 struct FileSerializer: public MappedSerializer {
-    FileSerializer(Utf8String filename);
+    FileSerializer(Utf8String filename, bool writeback = false);
 
     virtual ~FileSerializer();
 
@@ -177,13 +177,8 @@ mapFile(const Url & filename, size_t startOffset, ssize_t length)
         length = buf.st_size;
     }
 
-    cerr << "file goes from 0 for " << length << " bytes" << endl;
-    
     size_t mapOffset = startOffset & ~(page_size - 1);
     size_t mapLength = (length - mapOffset + page_size -1) & ~(page_size - 1);
-    
-    cerr << "mapping from " << mapOffset << " for " << mapLength << " bytes"
-         << endl;
 
     std::shared_ptr<void> addr
         (mmap(nullptr, mapLength,
@@ -198,9 +193,6 @@ mapFile(const Url & filename, size_t startOffset, ssize_t length)
 
     const char * start = reinterpret_cast<const char *>(addr.get());
     start += (startOffset % page_size);
-
-    cerr << "taking off " << (startOffset % page_size) << " bytes" << endl;
-    cerr << "length = " << length << endl;
     
     return FrozenMemoryRegion(std::move(addr), start, length);
 }
@@ -0,0 +1,331 @@
+/* compressed_region_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of block compressed memory regions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/block/compressed_region.h"
+#include "mldb/block/zip_serializer.h"
+#include "mldb/types/url.h"
+#include "mldb/arch/vm.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+/// Compressible data: random runs of a small alphabet
+std::shared_ptr<std::string> makeData(size_t n)
+{
+    std::mt19937 rng(n);
+    auto result = std::make_shared<std::string>(n, '\0');
+    for (size_t i = 0;  i < n;) {
+        char c = 'a' + rng() % 8;
+        size_t run = 1 + rng() % 20;
+        for (;  run > 0 && i < n;  --run)
+            (*result)[i++] = c;
+    }
+    return result;
+}
+
+FrozenMemoryRegion toRegion(std::shared_ptr<std::string> str)
+{
+    return FrozenMemoryRegion(str, str->data(), str->size());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_round_trip )
+{
+    for (std::string compression: { "zstd", "lz4", "none" }) {
+        for (size_t n: { 0, 1, 4096, 65536, 65537, 1000000 }) {
+            BOOST_TEST_CONTEXT(compression << " " << n) {
+                auto data = makeData(n);
+                CompressedRegionOptions options;
+                options.compression = compression;
+                options.blockSize = 65536;
+
+                MemorySerializer serializer;
+                auto compressed
+                    = compressRegion(toRegion(data), serializer, options);
+                BOOST_CHECK(CompressedRegion::isCompressed(compressed));
+                if (compression != "none" && n >= 65536)
+                    BOOST_CHECK_LT(compressed.length(), n);
+
+                CompressedRegion region(compressed, 4);
+                BOOST_CHECK_EQUAL(region.length(), n);
+                BOOST_CHECK_EQUAL(region.blockSize(), 65536);
+                BOOST_CHECK_EQUAL(region.numBlocks(), (n + 65535) / 65536);
+
+                auto all = region.decompressAll();
+                BOOST_CHECK(std::string(all.data(), all.length()) == *data);
+
+                auto mapped = region.mapUncompressed(2);
+                BOOST_CHECK(std::string(mapped.data(), mapped.length())
+                            == *data);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_random_access )
+{
+    auto data = makeData(3000000);
+    CompressedRegionOptions options;
+    options.compression = "lz4";
+
+    MemorySerializer serializer;
+    CompressedRegion region(compressRegion(toRegion(data), serializer, options),
+                            3);
+
+    std::mt19937 rng(1);
+    for (size_t i = 0;  i < 1000;  ++i) {
+        size_t offset = rng() % data->size();
+        size_t len = rng() % std::min<size_t>(300000, data->size() - offset);
+        std::string out(len, '\0');
+        region.read(offset, len, &out[0]);
+        BOOST_REQUIRE(out == data->substr(offset, len));
+    }
+
+    BOOST_CHECK_THROW(region.read(data->size() - 1, 2, nullptr),
+                      std::exception);
+    BOOST_CHECK_THROW(region.getBlock(region.numBlocks()), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_mapping_eviction )
+{
+    auto data = makeData(5000000);
+    MemorySerializer serializer;
+    CompressedRegion region(compressRegion(toRegion(data), serializer));
+
+    cerr << "lazy mapping available: "
+         << CompressedRegion::lazyMappingAvailable() << endl;
+
+    // Only two blocks can be resident at a time, so with several threads
+    // reading all over the region blocks are constantly being dropped and
+    // faulted in again.
+    auto mapped = region.mapUncompressed(2);
+    BOOST_REQUIRE_EQUAL(mapped.length(), data->size());
+
+    std::atomic<size_t> errors(0);
+    auto runThread = [&] (int threadNum)
+        {
+            std::mt19937 rng(threadNum);
+            for (size_t i = 0;  i < 2000;  ++i) {
+                size_t offset = rng() % data->size();
+                if (mapped.data()[offset] != (*data)[offset])
+                    ++errors;
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 8;  ++i)
+        threads.emplace_back(runThread, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+
+    // Accesses from the kernel go through the same path
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(pipe(fds), 0);
+    size_t offset = 3 * 128 * 1024 + 17;
+    BOOST_REQUIRE_EQUAL(write(fds[1], mapped.data() + offset, 100), 100);
+    char buf[100];
+    BOOST_REQUIRE_EQUAL(::read(fds[0], buf, 100), 100);
+    BOOST_CHECK(std::string(buf, 100) == data->substr(offset, 100));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE( test_corrupt_region )
+{
+    auto notCompressed = makeData(1000);
+    BOOST_CHECK(!CompressedRegion::isCompressed(toRegion(notCompressed)));
+    BOOST_CHECK_THROW(CompressedRegion region(toRegion(notCompressed)),
+                      std::exception);
+
+    auto data = makeData(300000);
+    MemorySerializer serializer;
+    auto compressed = compressRegion(toRegion(data), serializer);
+    auto copy = std::make_shared<std::string>(compressed.data(),
+                                              compressed.length());
+
+    // Truncated index or blocks
+    BOOST_CHECK_THROW(CompressedRegion(toRegion(std::make_shared<std::string>
+                                                (copy->substr(0, 70)))),
+                      std::exception);
+    BOOST_CHECK_THROW(CompressedRegion
+                      (toRegion(std::make_shared<std::string>
+                                (copy->substr(0, copy->size() - 1)))),
+                      std::exception);
+
+    // Damaged index: the first block runs past the end
+    uint64_t badOffset = copy->size() + 1;
+    std::memcpy(&(*copy)[64 + 8], &badOffset, 8);
+    CompressedRegion damaged(toRegion(copy));
+    BOOST_CHECK_THROW(damaged.getBlock(0), std::exception);
+    BOOST_CHECK_THROW(damaged.decompressAll(), std::exception);
+}
+
+namespace {
+
+sigjmp_buf sigbusJump;
+
+void onSigbus(int)
+{
+    siglongjmp(sigbusJump, 1);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_lazy_mapping_corrupt_block )
+{
+    if (!CompressedRegion::lazyMappingAvailable()) {
+        cerr << "lazy mapping isn't available; skipping" << endl;
+        return;
+    }
+
+    auto data = makeData(600000);
+    MemorySerializer serializer;
+    auto compressed = compressRegion(toRegion(data), serializer);
+    auto copy = std::make_shared<std::string>(compressed.data(),
+                                              compressed.length());
+
+    // The first two blocks are damaged; the others are fine
+    uint64_t badOffset = copy->size() + 1;
+    std::memcpy(&(*copy)[64 + 8], &badOffset, 8);
+    CompressedRegion damaged(toRegion(copy));
+    auto mapped = damaged.mapUncompressed();
+
+    // The good blocks can still be read
+    size_t offset = 2 * damaged.blockSize() + 10;
+    BOOST_CHECK_EQUAL(mapped.data()[offset], (*data)[offset]);
+
+    // Touching the bad one is an error for the accessing thread only
+    struct sigaction action, oldAction;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSigbus;
+    sigaction(SIGBUS, &action, &oldAction);
+
+    volatile bool gotSigbus = false;
+    if (sigsetjmp(sigbusJump, 1) == 0) {
+        volatile char c = mapped.data()[0];
+        (void)c;
+    }
+    else gotSigbus = true;
+
+    sigaction(SIGBUS, &oldAction, nullptr);
+    BOOST_CHECK(gotSigbus);
+
+    // And the handler is still there for the others
+    offset = 4 * damaged.blockSize() + 10;
+    BOOST_CHECK_EQUAL(mapped.data()[offset], (*data)[offset]);
+}
+
+BOOST_AUTO_TEST_CASE( test_zip_entries )
+{
+    std::string filename = "./build/x86_64/tmp/compressed_region_test."
+        + std::to_string(getpid()) + ".zip";
+    auto big = makeData(1000000);
+    std::string small = "small entry";
+
+    // Entries that only look compressed are returned as they are
+    auto lookalike = makeData(10000);
+    lookalike->replace(0, 8, "MLDBCRG1");
+
+    {
+        CompressedRegionOptions options;
+        options.compression = "zstd";
+        ZipStructuredSerializer serializer(filename, options);
+        serializer.addRegion(toRegion(big), "big");
+        serializer.addRegion(toRegion(std::make_shared<std::string>(small)),
+                             "small");
+        serializer.newStructure("sub")->addRegion(toRegion(big), "big");
+        serializer.addRegion(toRegion(lookalike), "lookalike");
+        serializer.commit();
+    }
+
+    ZipStructuredReconstituter reconstituter{Url("file://" + filename)};
+
+    auto region = reconstituter.getRegion("big");
+    BOOST_CHECK(std::string(region.data(), region.length()) == *big);
+
+    auto smallRegion = reconstituter.getRegion("small");
+    BOOST_CHECK_EQUAL(std::string(smallRegion.data(), smallRegion.length()),
+                      small);
+
+    auto subRegion = reconstituter.getStructure("sub")->getRegion("big");
+    BOOST_CHECK(std::string(subRegion.data(), subRegion.length()) == *big);
+
+    // This one is really block compressed
+    auto lookalikeRegion = reconstituter.getRegion("lookalike");
+    BOOST_CHECK(std::string(lookalikeRegion.data(), lookalikeRegion.length())
+                == *lookalike);
+
+    ::unlink(filename.c_str());
+
+    {
+        ZipStructuredSerializer serializer(filename);
+        serializer.addRegion(toRegion(lookalike), "lookalike");
+        serializer.commit();
+    }
+
+    ZipStructuredReconstituter plain{Url("file://" + filename)};
+    lookalikeRegion = plain.getRegion("lookalike");
+    BOOST_CHECK(std::string(lookalikeRegion.data(), lookalikeRegion.length())
+                == *lookalike);
+
+    ::unlink(filename.c_str());
+
+    // Names used for the file's own entries can't be written at the root
+    {
+        ZipStructuredSerializer serializer(filename);
+        auto region = toRegion(std::make_shared<std::string>(small));
+        BOOST_CHECK_THROW(serializer.addRegion(region, "__crc32c"),
+                          std::exception);
+        BOOST_CHECK_THROW(serializer.addRegion(region, "__blockcompressed"),
+                          std::exception);
+        serializer.newStructure("sub")->addRegion(region, "__crc32c");
+        serializer.commit();
+
+        // The file is finished once committed
+        BOOST_CHECK_THROW(serializer.addRegion(region, "late"),
+                          std::exception);
+    }
+
+    ZipStructuredReconstituter reserved{Url("file://" + filename)};
+    auto directory = reserved.getDirectory();
+    BOOST_REQUIRE_EQUAL(directory.size(), 1);
+    BOOST_CHECK_EQUAL(directory[0].name, PathElement("sub"));
+    auto sub = directory[0].getStructure();
+    auto subDirectory = sub->getDirectory();
+    BOOST_REQUIRE_EQUAL(subDirectory.size(), 1);
+    auto reservedRegion = subDirectory[0].getBlock();
+    BOOST_CHECK_EQUAL(std::string(reservedRegion.data(),
+                                  reservedRegion.length()),
+                      small);
+
+    ::unlink(filename.c_str());
+
+    CompressedRegionOptions badOptions;
+    badOptions.compression = "unknown";
+    BOOST_CHECK_THROW(ZipStructuredSerializer serializer(filename, badOptions),
+                      std::exception);
+    ::unlink(filename.c_str());
+}
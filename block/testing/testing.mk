@@ -1 +1,3 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+$(eval $(call test,compressed_region_test,block types arch,boost))
@@ -6,10 +6,16 @@
 */
 
 #include "zip_serializer.h"
+#include "compressed_region.h"
 #include "memory_region_impl.h"
 #include "types/annotated_exception.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/arch/timers.h"
+#include "mldb/arch/crc32c.h"
+#include "mldb/arch/format.h"
+#include "mldb/arch/vm.h"
+#include <atomic>
+#include <exception>
 
 // libarchive support
 #include "mldb/ext/libarchive/libarchive/archive.h"
@@ -20,6 +26,30 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/** Name of the entry at the root of the zip file that holds the CRC-32C of
+    every other entry, one "<crc in hex> <path>" line per entry.  Zip files
+    have their own CRC-32 for each entry, but it's slow to compute and it
+    isn't checked when entries are memory mapped.
+*/
+const PathElement CHECKSUMS_ENTRY("__crc32c");
+
+/** Name of the entry at the root of the zip file that lists the entries
+    which were block compressed (see compressed_region.h), one path per
+    line.  It's only written if there are some.
+*/
+const PathElement BLOCK_COMPRESSED_ENTRY("__blockcompressed");
+
+/** Is this the name of one of the entries above, which can't be used for
+    an entry at the root of the file? */
+bool isReservedEntry(const PathElement & name)
+{
+    return name == CHECKSUMS_ENTRY || name == BLOCK_COMPRESSED_ENTRY;
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* ZIP STRUCTURED SERIALIZER                                                 */
@@ -38,8 +68,15 @@ struct ZipStructuredSerializer::Itl {
 };
 
 struct ZipStructuredSerializer::BaseItl: public Itl {
-    BaseItl(Utf8String filename)
+    BaseItl(Utf8String filename,
+            std::unique_ptr<CompressedRegionOptions> blockCompression = nullptr)
+        : blockCompression(std::move(blockCompression))
     {
+        // Entries are compressed as they're written; fail early rather
+        // than there
+        if (this->blockCompression)
+            this->blockCompression->check();
+
         stream.open(filename.rawString());
         a.reset(archive_write_new(),
                 [] (struct archive * a) { archive_write_free(a); });
@@ -61,6 +98,27 @@ struct ZipStructuredSerializer::BaseItl: public Itl {
 
     ~BaseItl()
     {
+        // Normally this was done by commit(), which can report errors
+        if (!finished) {
+            try {
+                finish();
+            } catch (const std::exception & exc) {
+                cerr << "error finishing zip file: " << exc.what() << endl;
+            }
+        }
+    }
+
+    /** Write the entries that describe the others and close the archive.
+        No more entries can be written afterwards. */
+    void finish()
+    {
+        if (finished)
+            return;
+        finished = true;
+        if (entryError)
+            std::rethrow_exception(entryError);
+        writeBlockCompressed();
+        writeChecksums();
         cerr << "closing archive file" << endl;
         archive_op(archive_write_close);
     }
@@ -104,7 +162,8 @@ struct ZipStructuredSerializer::BaseItl: public Itl {
         std::shared_ptr<struct archive_entry> entry;
     };
 
-    void writeEntry(Path name, FrozenMemoryRegion region)
+    void writeEntry(Path name, FrozenMemoryRegion region,
+                    bool isBlockCompressed = false)
     {
         Entry entry;
         entry.op(archive_entry_set_pathname, name.toUtf8String().rawData());
@@ -122,10 +181,64 @@ struct ZipStructuredSerializer::BaseItl: public Itl {
         if (written != region.length()) {
             throw AnnotatedException(500, "Not all data written");
         }
+
+        checksums += MLDB::format("%08x ", crc32c(region.data(),
+                                                  region.length()))
+            + name.toUtf8String().rawString() + "\n";
+        if (isBlockCompressed)
+            blockCompressed += name.toUtf8String().rawString() + "\n";
+    }
+
+    /** Write the entry, block compressed if block compression is on and
+        it makes it smaller. */
+    void writeMaybeCompressed(Path name, FrozenMemoryRegion region)
+    {
+        checkNotFinished(name);
+
+        if (blockCompression && region.length() >= page_size) {
+            MemorySerializer serializer;
+            auto compressed = compressRegion(region, serializer,
+                                             *blockCompression);
+            if (compressed.length() < region.length()) {
+                writeEntry(std::move(name), std::move(compressed),
+                           true /* isBlockCompressed */);
+                return;
+            }
+        }
+        writeEntry(std::move(name), std::move(region));
+    }
+
+    void checkNotFinished(const Path & name) const
+    {
+        if (finished) {
+            throw AnnotatedException
+                (500, "Zip file entry " + name.toUtf8String()
+                 + " written after the file was committed");
+        }
+    }
+
+    /** Write the entry with the list of block compressed entries. */
+    void writeBlockCompressed()
+    {
+        if (blockCompressed.empty())
+            return;
+        auto handle = std::make_shared<std::string>(std::move(blockCompressed));
+        writeEntry(BLOCK_COMPRESSED_ENTRY,
+                   FrozenMemoryRegion(handle, handle->data(), handle->size()));
+    }
+
+    /** Write the entry with the checksums of all of the others. */
+    void writeChecksums()
+    {
+        std::string contents = std::move(checksums);
+        auto handle = std::make_shared<std::string>(contents);
+        writeEntry(CHECKSUMS_ENTRY,
+                   FrozenMemoryRegion(handle, handle->data(), handle->size()));
     }
 
     virtual void commit()
     {
+        finish();
     }
 
     virtual Path path() const
@@ -173,6 +286,11 @@ struct ZipStructuredSerializer::BaseItl: public Itl {
 
     filter_ostream stream;
     std::shared_ptr<struct archive> a;
+    std::string checksums;  ///< Contents of the checksums entry
+    std::string blockCompressed;  ///< Contents of the block compressed entry
+    std::unique_ptr<CompressedRegionOptions> blockCompression;
+    bool finished = false;  ///< Has finish() been called?
+    std::exception_ptr entryError;  ///< First error writing an entry
 };
 
 struct ZipStructuredSerializer::RelativeItl: public Itl {
@@ -215,7 +333,15 @@ struct ZipStructuredSerializer::EntrySerializer: public MemorySerializer {
         Path name = itl->path() + entryName;
         //cerr << "finishing entry " << name << " with "
         //     << frozen.length() << " bytes" << endl;
-        itl->base()->writeEntry(name, std::move(frozen));
+        // Can't throw from here; the error is reported on commit instead
+        try {
+            itl->base()->writeMaybeCompressed(name, std::move(frozen));
+        } catch (const std::exception & exc) {
+            cerr << "error writing zip file entry " << name << ": "
+                 << exc.what() << endl;
+            if (!itl->base()->entryError)
+                itl->base()->entryError = std::current_exception();
+        }
     }
 
     virtual void commit() override
@@ -238,6 +364,15 @@ ZipStructuredSerializer(Utf8String filename)
 {
 }
 
+ZipStructuredSerializer::
+ZipStructuredSerializer(Utf8String filename,
+                        CompressedRegionOptions blockCompression)
+    : itl(new BaseItl(filename,
+                      std::make_unique<CompressedRegionOptions>
+                          (std::move(blockCompression))))
+{
+}
+
 ZipStructuredSerializer::
 ZipStructuredSerializer(ZipStructuredSerializer * parent,
                         PathElement relativePath)
@@ -261,6 +396,12 @@ std::shared_ptr<MappedSerializer>
 ZipStructuredSerializer::
 newEntry(const PathElement & name)
 {
+    if (itl->path().empty() && isReservedEntry(name)) {
+        throw AnnotatedException
+            (400, "Zip file entry name " + name.toUtf8String()
+             + " is reserved");
+    }
+    itl->base()->checkNotFinished(itl->path() + name);
     return std::make_shared<EntrySerializer>(itl.get(), name);
 }
 
@@ -299,6 +440,55 @@ struct ZipStructuredReconstituter::Itl {
         Path path;
         std::map<PathElement, Entry> children;
         FrozenMemoryRegion region;
+        bool hasChecksum = false;
+        uint32_t checksum = 0;
+        mutable std::atomic<bool> verified { false };
+        bool isBlockCompressed = false;
+
+        /// Uncompressed view of a block compressed entry, once asked for
+        mutable std::shared_ptr<const FrozenMemoryRegion> uncompressed;
+
+        /** Return the region of the entry, verifying its checksum the first
+            time.  This is done here rather than when the file is opened so
+            that only the entries which are used are read in.  Entries
+            written with block compression are returned uncompressed; their
+            blocks are decompressed as they're accessed. */
+        const FrozenMemoryRegion & getRegion() const
+        {
+            const FrozenMemoryRegion & stored = getStoredRegion();
+            if (!isBlockCompressed)
+                return stored;
+
+            auto result = std::atomic_load(&uncompressed);
+            if (!result) {
+                auto view = std::make_shared<const FrozenMemoryRegion>
+                    (CompressedRegion(stored).mapUncompressed());
+                // Only ever set once, so that the returned reference stays
+                // valid
+                if (std::atomic_compare_exchange_strong
+                    (&uncompressed, &result, view))
+                    result = view;
+            }
+            return *result;
+        }
+
+        /** Return the region as stored in the file, verifying its
+            checksum. */
+        const FrozenMemoryRegion & getStoredRegion() const
+        {
+            if (hasChecksum && !verified.load(std::memory_order_acquire)) {
+                uint32_t actual = crc32c(region.data(), region.length());
+                if (actual != checksum) {
+                    throw AnnotatedException
+                        (500, "Zip file entry " + path.toUtf8String()
+                         + " is corrupt: its checksum is "
+                         + MLDB::format("%08x instead of %08x",
+                                        actual, checksum));
+                }
+                verified.store(true, std::memory_order_release);
+            }
+            return region;
+        }
     };
 
     const Entry * root = nullptr;
@@ -361,11 +551,93 @@ struct ZipStructuredReconstituter::Itl {
             current->region = this->region.range(offset, offset + length);
         }
 
+        readChecksums();
+        readBlockCompressed();
+
         this->root = &rootStorage;
 
         cerr << "reading Zip entries took " << timer.elapsed() << endl;
     }
 
+    /** Attach the checksums in the checksums entry, if there is one (older
+        files don't have it), to their entries. */
+    void readChecksums()
+    {
+        auto it = rootStorage.children.find(CHECKSUMS_ENTRY);
+        if (it == rootStorage.children.end())
+            return;
+
+        std::string contents(it->second.region.data(),
+                             it->second.region.length());
+        rootStorage.children.erase(it);
+
+        size_t pos = 0;
+        while (pos < contents.size()) {
+            size_t eol = contents.find('\n', pos);
+            if (eol == std::string::npos || eol < pos + 10
+                || contents[pos + 8] != ' ') {
+                throw AnnotatedException
+                    (500, "Zip file has a corrupt checksums entry");
+            }
+
+            uint32_t checksum
+                = std::stoul(contents.substr(pos, 8), nullptr, 16);
+            Path path = Path::parse(contents.substr(pos + 9, eol - pos - 9));
+            pos = eol + 1;
+
+            Entry * current = &rootStorage;
+            for (auto e: path) {
+                auto it = current->children.find(e);
+                if (it == current->children.end()) {
+                    current = nullptr;
+                    break;
+                }
+                current = &it->second;
+            }
+            if (!current)
+                continue;
+
+            current->hasChecksum = true;
+            current->checksum = checksum;
+        }
+    }
+
+    /** Mark the entries listed in the block compressed entry, if there is
+        one, as being block compressed. */
+    void readBlockCompressed()
+    {
+        auto it = rootStorage.children.find(BLOCK_COMPRESSED_ENTRY);
+        if (it == rootStorage.children.end())
+            return;
+
+        const FrozenMemoryRegion & region = it->second.getStoredRegion();
+        std::string contents(region.data(), region.length());
+        rootStorage.children.erase(it);
+
+        size_t pos = 0;
+        while (pos < contents.size()) {
+            size_t eol = contents.find('\n', pos);
+            if (eol == std::string::npos) {
+                throw AnnotatedException
+                    (500, "Zip file has a corrupt block compressed entry");
+            }
+            Path path = Path::parse(contents.substr(pos, eol - pos));
+            pos = eol + 1;
+
+            Entry * current = &rootStorage;
+            for (auto e: path) {
+                auto it = current->children.find(e);
+                if (it == current->children.end()) {
+                    throw AnnotatedException
+                        (500, "Zip file block compressed entry "
+                         + path.toUtf8String() + " is missing");
+                }
+                current = &it->second;
+            }
+            current->isBlockCompressed = true;
+        }
+    }
+
     // Perform a libarchive operation
     template<typename Fn, typename... Args>
     bool archive_op(Fn&& op, Args&&... args)
@@ -427,16 +699,19 @@ getDirectory() const
         StructuredReconstituter::Entry entry;
         entry.name = ch.first;
 
-        if (ch.second.region.data()) {
-            FrozenMemoryRegion region = ch.second.region;
-            entry.getBlock = [=] () { return region; };
+        // The entries are owned by the reconstituter for the whole file,
+        // which like for getStructure() needs to outlive these
+        const Itl::Entry * child = &ch.second;
+
+        if (child->region.data()) {
+            entry.getBlock = [child] () { return child->getRegion(); };
         }
 
-        if (!ch.second.children.empty()) {
-            entry.getStructure = [=] ()
+        if (!child->children.empty()) {
+            entry.getStructure = [child] ()
                 {
                     return std::shared_ptr<ZipStructuredReconstituter>
-                        (new ZipStructuredReconstituter(new Itl(&ch.second)));
+                        (new ZipStructuredReconstituter(new Itl(child)));
                 };
         }
 
@@ -469,7 +744,7 @@ getRegion(const PathElement & name) const
         throw AnnotatedException
             (400, "Child structure " + name.toUtf8String() + " not found");
     }
-    return it->second.region;
+    return it->second.getRegion();
 }
 
 } // namespace MLDB
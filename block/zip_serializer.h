@@ -8,6 +8,7 @@
 #pragma once
 
 #include "memory_region.h"
+#include "compressed_region.h"
 
 
 namespace MLDB {
@@ -17,10 +18,26 @@ namespace MLDB {
 /* ZIP STRUCTURED SERIALIZER                                                 */
 /*****************************************************************************/
 
-/** Structured serializer that writes a zip file. */
+/** Structured serializer that writes a zip file.  The entry names
+    __crc32c and __blockcompressed at the root of the file are reserved
+    for its own use.  commit() on the root serializer finishes the file,
+    after which no more entries can be written; otherwise this is done on
+    destruction, where errors can only be logged.
+*/
 
 struct ZipStructuredSerializer: public StructuredSerializer {
     ZipStructuredSerializer(Utf8String filename);
+
+    /** Write a zip file whose entries are block compressed with the given
+        options (see compressed_region.h), so that they can still be
+        accessed randomly.  Entries smaller than a page, or which don't
+        compress, are stored as-is.  The compressed entries are listed in
+        a separate entry, and the ZipStructuredReconstituter decompresses
+        them transparently.  Throws if the options aren't valid.
+    */
+    ZipStructuredSerializer(Utf8String filename,
+                            CompressedRegionOptions blockCompression);
+
     ~ZipStructuredSerializer();
 
     virtual std::shared_ptr<StructuredSerializer>
@@ -42,6 +42,8 @@ LIBMLDB_BUILTIN_BASE_LINK:= \
 	runner \
 	git2 \
 	ssh2 \
+	http \
+	io_base \
 
 # Shared_mutex only in C++17
 $(eval $(call set_compile_option,dist_table_procedure.cc,-std=c++1z))
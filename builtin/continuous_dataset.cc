@@ -23,6 +23,10 @@
 #include "mldb/builtin/merged_dataset.h"
 #include "mldb/utils/log.h"
 #include "mldb/types/structure_description.h"
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <thread>
 
 
 using namespace std;
@@ -60,7 +64,7 @@ struct ContinuousDataset::Itl final {
     Itl(MldbEngine * engine, const ContinuousDatasetConfig & config)
         : engine(engine),
           current(gcLock),
-          lastCommit(Date::now().secondsSinceEpoch()),
+          lastRotate(Date::now().secondsSinceEpoch()),
           logger(MLDB::getMldbLog<ContinuousWindowDataset>())
     {
         initRoutes();
@@ -93,9 +97,18 @@ struct ContinuousDataset::Itl final {
                                  "continuousDatasetConfig", config);
         }
         
+        // Started last, since a thread that's still joinable when the
+        // constructor throws terminates the process
+        saveThread = std::thread([this] () { runSaveThread(); });
+
         // Perform a first rotation, so that everything is properly set
         // up for the rotation.
-        rotate(Date::positiveInfinity());
+        try {
+            rotate(Date::positiveInfinity()).get();
+        } MLDB_CATCH_ALL {
+            stopSaveThread();
+            throw;
+        }
 
         ExcAssert(current.val);
 
@@ -112,6 +125,22 @@ struct ContinuousDataset::Itl final {
 
     ~Itl()
     {
+        // Stop rotating, then let the save thread finish what's queued
+        // so that nothing that was recorded is lost.
+        timer = WatchT<Date>();
+        stopSaveThread();
+    }
+
+    /** Tell the save thread to finish what's queued and exit, and wait
+        for it to do so. */
+    void stopSaveThread()
+    {
+        {
+            std::unique_lock<std::mutex> guard(saveQueueMutex);
+            shutdown = true;
+        }
+        saveQueueChanged.notify_all();
+        saveThread.join();
     }
 
     MldbEngine * engine;
@@ -169,38 +198,66 @@ struct ContinuousDataset::Itl final {
     GcLock gcLock;
     RcuProtected<Current> current;
 
-    /// Mutex for phase 1 of the rotate, which is to swap out the datasets.
+    /// Mutex for swapping out the current dataset.  This is only held for
+    /// the swap; saving happens on the save thread.
     std::mutex rotateMutex;
 
-    /// Mutex for phase 2 of the rotate, which is to save the dataset.  The
-    /// mutex for phase 1 is released once this mutex is acquired.
-    std::mutex saveMutex;
-
     /// Used live datasets to know about datasets that are created and
     /// rotated.
     WatchesT<std::shared_ptr<Dataset> > datasetWatches;
 
-    /// Date of the last commit
-    std::atomic<double> lastCommit;
+    /// Date of the last rotation.  Everything recorded before this is in
+    /// a dataset that's saved or queued to be saved.
+    std::atomic<double> lastRotate;
 
-    shared_ptr<spdlog::logger> logger;
+    /// Completes once the save queued by the last rotation is done.
+    /// Protected by rotateMutex.
+    std::shared_future<void> lastSaved;
 
-    /** Rotate the dataset, atomically, and add it to the metadata store. */
-    void rotate(Date commitStarted)
-    {
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
+    /// Storage dataset created ahead of time on the save thread, so that
+    /// the next rotation doesn't have to wait for createStorageDataset.
+    /// Protected by rotateMutex.
+    std::shared_ptr<Dataset> spareDataset;
 
-        std::unique_lock<std::mutex> rotateGuard(rotateMutex);
+    /// Thread that freezes and saves rotated datasets and creates spare
+    /// storage datasets, in the order they were queued.  Neither recording
+    /// nor the commit timer waits for it; commit() does.
+    std::thread saveThread;
+    std::mutex saveQueueMutex;
+    std::condition_variable saveQueueChanged;
+    std::deque<std::function<void ()> > saveQueue;
+    bool shutdown = false;
 
-        // If we already commited after the time rotate() was called, then
-        // nothing to do.
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
+    shared_ptr<spdlog::logger> logger;
+
+    void runSaveThread()
+    {
+        for (;;) {
+            std::function<void ()> job;
+            {
+                std::unique_lock<std::mutex> guard(saveQueueMutex);
+                saveQueueChanged.wait(guard, [&] ()
+                                      { return shutdown || !saveQueue.empty(); });
+                if (saveQueue.empty())
+                    return;  // shutdown, and nothing left to save
+                job = std::move(saveQueue.front());
+                saveQueue.pop_front();
+            }
+            job();
+        }
+    }
 
-        // First, create a new storage dataset to hold anything that comes
-        // along while we're rotating the old
+    void queueSaveJob(std::function<void ()> job)
+    {
+        {
+            std::unique_lock<std::mutex> guard(saveQueueMutex);
+            saveQueue.emplace_back(std::move(job));
+        }
+        saveQueueChanged.notify_one();
+    }
 
+    std::shared_ptr<Dataset> newStorageDataset()
+    {
         ProcedureRunConfig runConfig;
 
         auto storageOutput
@@ -208,33 +265,94 @@ struct ContinuousDataset::Itl final {
 
         INFO_MSG(logger) << "output of storage is " << jsonEncode(storageOutput);
 
+        return obtainDataset(engine,
+                             storageOutput.results.getField("config")
+                             .convert<PolyConfig>(), nullptr);
+    }
+
+    /** Create the next storage dataset ahead of time on the save thread. */
+    void queuePrepareSpare()
+    {
+        queueSaveJob([this] ()
+            {
+                try {
+                    auto spare = newStorageDataset();
+                    std::unique_lock<std::mutex> guard(rotateMutex);
+                    if (!spareDataset)
+                        spareDataset = std::move(spare);
+                } MLDB_CATCH_ALL {
+                    // Not fatal; the next rotation will create its own
+                    WARNING_MSG(logger)
+                        << "couldn't create spare storage dataset: "
+                        << getExceptionString();
+                }
+            });
+    }
+
+    /** Rotate the dataset atomically, and queue the old one to be frozen,
+        saved and added to the metadata store on the save thread.  The
+        returned future is ready once that's done, and rethrows any error
+        from saving.
+    */
+    std::shared_future<void> rotate(Date commitStarted)
+    {
+        std::unique_lock<std::mutex> rotateGuard(rotateMutex);
+
+        // If we already rotated after the time rotate() was called, then
+        // everything recorded up to then is already on its way to being
+        // saved.
+        if (lastRotate.load() > commitStarted.secondsSinceEpoch()
+            && lastSaved.valid())
+            return lastSaved;
+
+        // First, get a new storage dataset to hold anything that comes
+        // along while we're saving the old
         std::unique_ptr<Current> newCurrent(new Current());
-        newCurrent->dataset
-            = obtainDataset(engine,
-                            storageOutput.results.getField("config")
-                            .convert<PolyConfig>(), nullptr);
+        newCurrent->dataset = std::move(spareDataset);
+        if (!newCurrent->dataset)
+            newCurrent->dataset = newStorageDataset();
         
         // Now, swap it in...
-        auto old = current.replaceCustomCleanup(newCurrent.release());
+        std::shared_ptr<Current> old
+            (current.replaceCustomCleanup(newCurrent.release()));
+        lastRotate = Date::now().secondsSinceEpoch();
+
+        auto promise = std::make_shared<std::promise<void> >();
+        lastSaved = promise->get_future().share();
 
         // In initialization, we don't have an old dataset so we get out
         // here.
-        if (!old || !old->dataset)
-            return;
+        if (!old || !old->dataset) {
+            promise->set_value();
+            queuePrepareSpare();
+            return lastSaved;
+        }
 
-        std::unique_lock<std::mutex> saveGuard(saveMutex);
+        queueSaveJob([this, old, promise] ()
+            {
+                try {
+                    save(*old);
+                    promise->set_value();
+                } MLDB_CATCH_ALL {
+                    ERROR_MSG(logger) << "error saving continuous dataset "
+                                      << old->dataset->config_->id << ": "
+                                      << getExceptionString();
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        queuePrepareSpare();
+
+        return lastSaved;
+    }
 
-        // If we already commited after the time rotate() was called, then
-        // nothing to do.
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
-        
-        // Release the rotate mutex
-        rotateGuard.unlock();
-        
-        std::shared_ptr<Dataset> savedDataset = old->dataset;
+    /** Freeze and save a dataset that has been rotated out, and add it to
+        the metadata store.  Runs on the save thread.
+    */
+    void save(Current & old)
+    {
+        std::shared_ptr<Dataset> savedDataset = old.dataset;
 
-        // ... and wait for all users to stop using it.  Once we're past this
+        // Wait for all users to stop using it.  Once we're past this
         // line, there is no possibility that old will be modified by
         // any thread, and so we can save it, etc.  There still may be external
         // users who have the shared pointer to the dataset to read from, though,
@@ -242,11 +360,9 @@ struct ContinuousDataset::Itl final {
         gcLock.visibleBarrier();
 
         // If there is no data in the dataset, then don't save anything
-        if (!old->hasData) {
-            lastCommit = commitStarted.secondsSinceEpoch();
+        if (!old.hasData)
             return;
-        }
-        
+
         // Now we can run our procedure to save the dataset, and get back
         // its metadata
         ProcedureRunConfig saveRunConfig;
@@ -281,9 +397,6 @@ struct ContinuousDataset::Itl final {
         metadataDataset->recordRow(rowName, metadata);
 
         datasetWatches.trigger(savedDataset);
-
-        // We now know that everything is committed up to lastCommit.
-        lastCommit = commitStarted.secondsSinceEpoch();
     }
 
     virtual void commit()
@@ -291,7 +404,7 @@ struct ContinuousDataset::Itl final {
         // Force a write-out of the dataset.  We only exit once it's
         // done.  This allows a call to commit() to be used to guarantee
         // that what was written up to now is actually in the database.
-        rotate(Date::now());
+        rotate(Date::now()).get();
     }
 
     virtual RestRequestMatchResult
@@ -469,6 +582,147 @@ ContinuousWindowDatasetConfigDescription()
 }
 
 
+/*****************************************************************************/
+/* CONTINUOUS WINDOW CACHE                                                   */
+/*****************************************************************************/
+
+/** Cache of the stored datasets that windows load, and of the merged
+    blocks built from them, shared by all windows in the process.
+
+    Successive windows over a continuous dataset overlap almost entirely.
+    The stored datasets of a window (in metadata order) are cut into blocks
+    before each dataset whose id hashes onto a boundary, so a block is the
+    same whichever window it's in.  Each block is merged once and reused by
+    every window covering it; when a window slides, only the blocks where
+    datasets enter or leave are merged, and the window itself merges the
+    blocks rather than every dataset.
+
+    Entries are weak, so datasets and blocks are freed once no window uses
+    them.
+*/
+
+struct ContinuousWindowCache {
+
+    /// On average, one dataset in this many starts a new block
+    static constexpr uint64_t BLOCK_BOUNDARY_MODULUS = 8;
+
+    typedef std::pair<MldbEngine *, Utf8String> Key;
+
+    std::mutex mutex;
+    std::map<Key, std::weak_ptr<Dataset> > datasets;
+    std::map<Key, std::weak_ptr<Dataset> > blocks;
+
+    std::shared_ptr<Dataset>
+    lookup(std::map<Key, std::weak_ptr<Dataset> > & entries, const Key & key)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+        return it->second.lock();
+    }
+
+    /** Insert an entry.  If another thread got there first, its version
+        is returned instead so that everyone shares the same one.
+    */
+    std::shared_ptr<Dataset>
+    insert(std::map<Key, std::weak_ptr<Dataset> > & entries, const Key & key,
+           std::shared_ptr<Dataset> dataset)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto & entry = entries[key];
+        if (auto existing = entry.lock())
+            return existing;
+        entry = dataset;
+        return dataset;
+    }
+
+    void pruneExpired()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (auto * entries: { &datasets, &blocks }) {
+            for (auto it = entries->begin();  it != entries->end();) {
+                if (it->second.expired())
+                    it = entries->erase(it);
+                else ++it;
+            }
+        }
+    }
+
+    std::shared_ptr<Dataset>
+    getDataset(MldbEngine * engine, const PolyConfigT<const Dataset> & config)
+    {
+        Key key(engine, jsonEncodeStr(config));
+        if (auto result = lookup(datasets, key))
+            return result;
+        return insert(datasets, key, obtainDataset(engine, config));
+    }
+
+    std::shared_ptr<Dataset>
+    getBlock(MldbEngine * engine,
+             const std::vector<PolyConfigT<const Dataset> > & configs,
+             const std::vector<std::shared_ptr<Dataset> > & loaded,
+             size_t first, size_t last)
+    {
+        if (last - first == 1)
+            return loaded[first];
+
+        Utf8String ids;
+        for (size_t i = first;  i < last;  ++i)
+            ids += configs[i].id + "\n";
+
+        Key key(engine, ids);
+        if (auto result = lookup(blocks, key))
+            return result;
+
+        std::vector<std::shared_ptr<Dataset> > toMerge(loaded.begin() + first,
+                                                       loaded.begin() + last);
+        return insert(blocks, key,
+                      std::make_shared<MergedDataset>(engine,
+                                                      std::move(toMerge)));
+    }
+
+    /** Return a dataset with the merged contents of the given stored
+        datasets, reusing whatever has already been loaded and merged.
+    */
+    std::shared_ptr<Dataset>
+    getWindow(MldbEngine * engine,
+              const std::vector<PolyConfigT<const Dataset> > & configs)
+    {
+        pruneExpired();
+
+        std::vector<std::shared_ptr<Dataset> > loaded(configs.size());
+        parallelMap(0, configs.size(), [&] (size_t i)
+                    {
+                        loaded[i] = getDataset(engine, configs[i]);
+                    });
+
+        std::vector<size_t> blockStarts;
+        for (size_t i = 0;  i < configs.size();  ++i) {
+            if (i == 0
+                || RowPath(configs[i].id).hash() % BLOCK_BOUNDARY_MODULUS == 0)
+                blockStarts.push_back(i);
+        }
+        blockStarts.push_back(configs.size());
+
+        std::vector<std::shared_ptr<Dataset> > windowBlocks;
+        for (size_t i = 0;  i + 1 < blockStarts.size();  ++i) {
+            windowBlocks.push_back(getBlock(engine, configs, loaded,
+                                            blockStarts[i],
+                                            blockStarts[i + 1]));
+        }
+
+        if (windowBlocks.size() == 1)
+            return windowBlocks[0];
+        
+        // Also throws if there are no datasets at all
+        return std::make_shared<MergedDataset>(engine, std::move(windowBlocks));
+    }
+};
+
+static ContinuousWindowCache windowCache;
+
+
 /*****************************************************************************/
 /* CONTINUOUS WINDOW DATASET                                                 */
 /*****************************************************************************/
@@ -491,11 +745,11 @@ reconstituteConfig(MatrixNamedRow row)
     return jsonDecode<PolyConfigT<const Dataset> >(current);
 }
 
-PolyConfigT<const Dataset>
+std::vector<PolyConfigT<const Dataset> >
 ContinuousWindowDataset::
-getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
-                 Date from,
-                 Date to)
+getDatasetConfigs(std::shared_ptr<SqlExpression> datasetsWhere,
+                  Date from,
+                  Date to)
 {
     // Construct a query that gets us our datasets from from and to
     // This is earliest <= to and latest >= from
@@ -522,13 +776,25 @@ getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
     // 1.  Use from and to
     // 2.  If datasets overhang, then add a filter in
     
-    MergedDatasetConfig params;
+    std::vector<PolyConfigT<const Dataset> > result;
 
     for (auto & ds: datasets) {
         // Reconstitute a configuration
-        params.datasets.emplace_back(reconstituteConfig(std::move(ds)));
+        result.emplace_back(reconstituteConfig(std::move(ds)));
     }
-    
+
+    return result;
+}
+
+PolyConfigT<const Dataset>
+ContinuousWindowDataset::
+getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
+                 Date from,
+                 Date to)
+{
+    MergedDatasetConfig params;
+    params.datasets = getDatasetConfigs(datasetsWhere, from, to);
+
     PolyConfigT<const Dataset> result;
     result.type = "merged";
     result.params = params;
@@ -553,12 +819,12 @@ ContinuousWindowDataset(MldbEngine * owner,
                              "continuousDatasetConfig", config);
     }
 
-    PolyConfigT<const Dataset> toLoadConfig;
+    std::vector<PolyConfigT<const Dataset> > toLoad;
 
     try {
         // Query the metadata dataset for the datasets that we need to load
-        // up, and turn it into a merged dataset configuration.
-        toLoadConfig = getDatasetConfig(config.datasetFilter, config.from, config.to);
+        // up.
+        toLoad = getDatasetConfigs(config.datasetFilter, config.from, config.to);
     } MLDB_CATCH_ALL {
         rethrowException(-1, "Error initializing continuous window dataset in "
                              "metadata query: " + getExceptionString(),
@@ -566,9 +832,9 @@ ContinuousWindowDataset(MldbEngine * owner,
     }
 
     try {
-        // Obtain the merged dataset, recursively
+        // Merge them, sharing what's already loaded with other windows
         std::shared_ptr<Dataset> underlying
-            = obtainDataset(engine, toLoadConfig);
+            = windowCache.getWindow(engine, toLoad);
         setUnderlying(underlying);
     } MLDB_CATCH_ALL {
         rethrowException(-1, "Error initializing continuous window dataset in "
@@ -111,6 +111,17 @@ struct ContinuousWindowDataset: public ForwardedDataset {
     /// Dataset in which our metadata lives
     std::shared_ptr<Dataset> metadataDataset;
 
+    /** Query the metadata for the configurations of the stored datasets
+        that overlap [earliest, latest] and match the filter.
+    */
+    std::vector<PolyConfigT<const Dataset> >
+    getDatasetConfigs(std::shared_ptr<SqlExpression> datasetFilter,
+                      Date earliest,
+                      Date latest);
+
+    /** Return the configuration of a merged dataset over the datasets
+        from getDatasetConfigs().
+    */
     PolyConfigT<const Dataset>
     getDatasetConfig(std::shared_ptr<SqlExpression> datasetFilter,
                      Date earliest,
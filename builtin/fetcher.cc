@@ -13,10 +13,21 @@
 #include "mldb/types/value_description.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/types/url.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/http/http_client.h"
+#include "mldb/io/legacy_event_loop.h"
 
 #include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <memory>
+#include <future>
+#include <list>
+#include <unordered_map>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
 
 using namespace std;
 
@@ -31,6 +42,11 @@ namespace MLDB {
 
 struct FetcherFunctionConfig {
     int maxConcurrentFetch = -1;
+    bool async = false;
+    int maxConnectionsPerHost = 32;
+    int timeoutSeconds = 60;
+    uint64_t responseCacheBytes = 0;
+    double responseCacheSeconds = 300;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(FetcherFunctionConfig);
@@ -44,6 +60,30 @@ FetcherFunctionConfigDescription()
     addField("maxConcurrentFetch", &FetcherFunctionConfig::maxConcurrentFetch,
              "The maximum number of concurrent fetching operations to allow."
              "-1 leaves the control to MLDB.", -1);
+    addField("async", &FetcherFunctionConfig::async,
+             "Fetch http:// and https:// URLs over a shared pool of "
+             "keep-alive connections driven by a single event loop, "
+             "rather than opening a new connection for each fetch.  Other "
+             "URI schemes are always fetched synchronously.",
+             false);
+    addField("maxConnectionsPerHost",
+             &FetcherFunctionConfig::maxConnectionsPerHost,
+             "The maximum number of simultaneous connections to a single "
+             "host when fetching asynchronously.  Connections are kept "
+             "alive and reused between fetches.", 32);
+    addField("timeoutSeconds", &FetcherFunctionConfig::timeoutSeconds,
+             "Time after which an asynchronous fetch fails with a timeout "
+             "error.  -1 means no timeout.", 60);
+    addField("responseCacheBytes",
+             &FetcherFunctionConfig::responseCacheBytes,
+             "Maximum total size of the successfully fetched contents to "
+             "keep in memory, so that fetching the same URL again doesn't "
+             "contact the server.  The least recently used contents are "
+             "dropped first.  0 disables the cache.", (uint64_t)0);
+    addField("responseCacheSeconds",
+             &FetcherFunctionConfig::responseCacheSeconds,
+             "Time after which contents in the response cache are no "
+             "longer used, and the URL is fetched again.", 300.0);
 
     onPostValidate = [&] (FetcherFunctionConfig * cfg,
                           JsonParsingContext & context)
@@ -52,6 +92,18 @@ FetcherFunctionConfigDescription()
             throw MLDB::Exception("maxConcurrentFetch accepts values equal or "
                                   "greater to 1 or equal to -1");
         }
+        if (cfg->maxConnectionsPerHost < 1) {
+            throw MLDB::Exception("maxConnectionsPerHost must be equal or "
+                                  "greater to 1");
+        }
+        if (cfg->timeoutSeconds < 1 && cfg->timeoutSeconds != -1) {
+            throw MLDB::Exception("timeoutSeconds accepts values equal or "
+                                  "greater to 1 or equal to -1");
+        }
+        if (!(cfg->responseCacheSeconds > 0)) {
+            throw MLDB::Exception("responseCacheSeconds must be greater "
+                                  "than 0");
+        }
     };
 }
 
@@ -93,6 +145,373 @@ FetcherOutputDescription::FetcherOutputDescription()
              "successful.");
 }
 
+namespace {
+
+/** Contents of a fetched URL, with the timestamp they're valid at. */
+struct FetchedContent {
+    CellValue blob;
+    Date timestamp;
+};
+
+
+/*****************************************************************************/
+/* ASYNC FETCH POOL                                                          */
+/*****************************************************************************/
+
+/** Pool of HTTP clients used to fetch asynchronously, one per host.  Each
+    client keeps its connections alive between requests, and they all
+    share a single event loop thread.  Clients are kept so that their
+    connections survive from one query to the next, until they have been
+    idle for IDLE_SECONDS.
+*/
+
+struct AsyncFetchPool {
+    /// Time with nothing in flight after which a client is closed
+    static constexpr double IDLE_SECONDS = 60.0;
+
+    struct Client {
+        Client(LegacyEventLoop & loop, const std::string & baseUrl,
+               int maxConnections)
+            : http(loop, baseUrl, maxConnections)
+        {
+        }
+
+        HttpClient http;
+        int numInFlight = 0;  ///< Protected by clientsLock
+        Date lastUsed;        ///< Protected by clientsLock
+    };
+
+    AsyncFetchPool()
+    {
+        loop.start();
+    }
+
+    /** Return the client for the given scheme://host[:port], creating it
+        if necessary, and count one more request in flight on it.  The
+        client won't be closed before release() is called for the request.
+        This method is thread-safe.
+    */
+    Client & acquire(const std::string & baseUrl, int maxConnections)
+    {
+        auto key = std::make_pair(baseUrl, maxConnections);
+
+        std::unique_lock<std::mutex> guard(clientsLock);
+        auto & client = clients[key];
+        if (!client)
+            client.reset(new Client(loop, baseUrl, maxConnections));
+        ++client->numInFlight;
+        return *client;
+    }
+
+    /** Called once a request made on a client from acquire() is done. */
+    void release(Client & client)
+    {
+        std::unique_lock<std::mutex> guard(clientsLock);
+        --client.numInFlight;
+        client.lastUsed = Date::now();
+    }
+
+    /** Close the clients that have been idle for long enough.  Closing a
+        client waits for the event loop, so this can't be called from
+        the event loop thread (ie, from a response callback).
+    */
+    void evictIdle()
+    {
+        std::vector<std::unique_ptr<Client> > evicted;
+        {
+            std::unique_lock<std::mutex> guard(clientsLock);
+            Date now = Date::now();
+            if (lastEviction.plusSeconds(IDLE_SECONDS) > now)
+                return;
+            lastEviction = now;
+
+            for (auto it = clients.begin();  it != clients.end();) {
+                if (it->second->numInFlight == 0
+                    && it->second->lastUsed.plusSeconds(IDLE_SECONDS) < now) {
+                    evicted.emplace_back(std::move(it->second));
+                    it = clients.erase(it);
+                }
+                else ++it;
+            }
+        }
+        // The clients are closed here, outside of the lock
+    }
+
+    LegacyEventLoop loop;
+    std::mutex clientsLock;
+    std::map<std::pair<std::string, int>, std::unique_ptr<Client> > clients;
+    Date lastEviction = Date::now();
+};
+
+AsyncFetchPool & getAsyncFetchPool()
+{
+    static AsyncFetchPool pool;
+    return pool;
+}
+
+bool isHttpUrl(const std::string & url)
+{
+    return url.compare(0, 7, "http://") == 0
+        || url.compare(0, 8, "https://") == 0;
+}
+
+/** Return the scheme://host[:port] part of the given URL. */
+std::string getBaseUrl(const Url & url)
+{
+    std::string result = url.scheme() + "://" + url.host();
+    if (url.port() != -1)
+        result += ":" + std::to_string(url.port());
+    return result;
+}
+
+/** Return the value of the given header, or an empty string if there is
+    none.  The headers are the raw lines of the response, and the name
+    must be lowercase and include the trailing colon.
+*/
+std::string getHeader(const std::string & headers, const char * name)
+{
+    size_t nameLength = strlen(name);
+
+    for (size_t pos = 0;  pos < headers.size();) {
+        size_t eol = headers.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = headers.size();
+
+        if (eol - pos > nameLength
+            && strncasecmp(headers.c_str() + pos, name, nameLength) == 0) {
+            std::string value(headers, pos + nameLength,
+                              eol - pos - nameLength);
+            size_t first = value.find_first_not_of(" \t");
+            size_t last = value.find_last_not_of(" \t\r");
+            if (first == std::string::npos)
+                return std::string();
+            return value.substr(first, last - first + 1);
+        }
+
+        pos = eol + 1;
+    }
+
+    return std::string();
+}
+
+/** Return the date in the Last-Modified header, or notADate if there
+    is none.
+*/
+Date getLastModified(const std::string & headers)
+{
+    std::string value = getHeader(headers, "last-modified:");
+    if (value.empty())
+        return Date::notADate();
+
+    static const char format[] = "%a, %d %b %Y %H:%M:%S %Z"; // rfc 1123
+    struct tm tm;
+    bzero(&tm, sizeof(tm));
+    if (!strptime(value.c_str(), format, &tm))
+        return Date::notADate();
+    return Date(1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/** Return the URL that the Location header of a redirection from the
+    given URL points to.
+*/
+std::string resolveLocation(const Url & from, const std::string & location)
+{
+    if (isHttpUrl(location))
+        return location;
+    if (location.compare(0, 2, "//") == 0)
+        return from.scheme() + ":" + location;
+    if (!location.empty() && location[0] == '/')
+        return getBaseUrl(from) + location;
+
+    std::string path = from.path();
+    return getBaseUrl(from) + path.substr(0, path.rfind('/') + 1) + location;
+}
+
+/// Same limit as the synchronous path, which lets curl follow them
+constexpr int MAX_REDIRECTS = 20;
+
+/** Fetch the given http:// or https:// URL over the pool, and fulfill the
+    promise with its contents.  Redirections are followed, and any status
+    other than 200 is an error, as for the synchronous path.  Only the
+    event loop thread is used while the request is in flight.  Also called
+    from the event loop thread to follow redirections.
+*/
+void startFetchAsync(const std::string & url,
+                     std::shared_ptr<std::promise<FetchedContent> > promise,
+                     int maxConnections, int timeoutSeconds,
+                     int numRedirects = 0)
+{
+    Url parsed(url);
+    if (!parsed.valid())
+        throw AnnotatedException(400, "Invalid URL '" + url + "'");
+
+    std::string resource = parsed.path();
+    std::string query = parsed.query();
+    if (!query.empty())
+        resource += "?" + query;
+
+    auto & pool = getAsyncFetchPool();
+    auto & client = pool.acquire(getBaseUrl(parsed), maxConnections);
+
+    auto onResponse = [=,&pool,&client] (const HttpRequest & rq,
+                                         HttpClientError error,
+                                         int status,
+                                         std::string && headers,
+                                         std::string && body)
+        {
+            pool.release(client);
+
+            try {
+                if (error != HttpClientError::None) {
+                    throw AnnotatedException
+                        (400, "HTTP error reading " + url + "\n\n"
+                         + HttpClientCallbacks::errorMessage(error));
+                }
+
+                std::string location = getHeader(headers, "location:");
+                if (status >= 300 && status < 400 && !location.empty()) {
+                    if (numRedirects == MAX_REDIRECTS) {
+                        throw AnnotatedException
+                            (400, "Too many redirections reading " + url);
+                    }
+                    startFetchAsync(resolveLocation(parsed, location),
+                                    promise, maxConnections, timeoutSeconds,
+                                    numRedirects + 1);
+                    return;
+                }
+
+                if (status != 200) {
+                    throw AnnotatedException
+                        (400, "HTTP code " + std::to_string(status)
+                         + " reading " + url + "\n\n"
+                         + std::string(body, 0, 1024));
+                }
+
+                Date lastModified = getLastModified(headers);
+                promise->set_value({ CellValue::blob(std::move(body)),
+                                     lastModified.isADate()
+                                     ? lastModified : Date::now() });
+            } MLDB_CATCH_ALL {
+                promise->set_exception(std::current_exception());
+            }
+        };
+
+    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(onResponse);
+    if (!client.http.get(resource, callbacks, {}, {}, timeoutSeconds)) {
+        pool.release(client);
+        throw MLDB::Exception("The HTTP client could not enqueue the "
+                              "request for " + url);
+    }
+}
+
+/** Fetch the given http:// or https:// URL asynchronously, and return a
+    future for its contents.
+*/
+std::future<FetchedContent>
+fetchAsync(const std::string & url, int maxConnections, int timeoutSeconds)
+{
+    getAsyncFetchPool().evictIdle();
+
+    auto promise = std::make_shared<std::promise<FetchedContent> >();
+    auto result = promise->get_future();
+    startFetchAsync(url, std::move(promise), maxConnections, timeoutSeconds);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* FETCHER RESPONSE CACHE                                                    */
+/*****************************************************************************/
+
+/** Cache of fetched contents keyed by URL.  Contents are only returned
+    for maxAgeSeconds after they were fetched.  The total size of the
+    contents is bounded, and the least recently used are dropped first.
+*/
+
+struct FetcherResponseCache {
+    FetcherResponseCache(uint64_t maxBytes, double maxAgeSeconds)
+        : maxBytes(maxBytes), maxAgeSeconds(maxAgeSeconds)
+    {
+    }
+
+    /** Return the key under which the contents of the given URL are
+        cached.  Different spellings of the same URL share their key.
+    */
+    static std::string getKey(const std::string & url)
+    {
+        Url parsed(url);
+        return parsed.valid() ? parsed.canonical() : url;
+    }
+
+    bool get(const std::string & key, FetchedContent & result)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it == index.end())
+            return false;
+
+        Entry & entry = *it->second;
+        if (entry.fetched.plusSeconds(maxAgeSeconds) < Date::now()) {
+            totalBytes -= entry.content.blob.blobLength();
+            entries.erase(it->second);
+            index.erase(it);
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        result = entry.content;
+        return true;
+    }
+
+    void put(const std::string & key, const FetchedContent & content,
+             Date fetched)
+    {
+        uint64_t size = content.blob.blobLength();
+        if (size > maxBytes)
+            return;
+
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            totalBytes -= it->second->content.blob.blobLength();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+
+        entries.push_front({ key, content, fetched });
+        index[key] = entries.begin();
+        totalBytes += size;
+
+        while (totalBytes > maxBytes) {
+            auto & oldest = entries.back();
+            totalBytes -= oldest.content.blob.blobLength();
+            index.erase(oldest.key);
+            entries.pop_back();
+        }
+    }
+
+    const uint64_t maxBytes;
+    const double maxAgeSeconds;
+
+private:
+    struct Entry {
+        std::string key;
+        FetchedContent content;
+        Date fetched;  ///< When the request for the contents was made
+    };
+
+    typedef std::list<Entry> Entries;
+
+    std::mutex mutex;
+    Entries entries;  ///< Most recently used first
+    std::unordered_map<std::string, Entries::iterator> index;
+    uint64_t totalBytes = 0;
+};
+
+} // file scope
+
+
 struct FetcherFunction: public ValueFunctionT<FetcherArgs, FetcherOutput> {
     FetcherFunction(MldbEngine * owner,
                     PolyConfig config,
@@ -103,6 +522,11 @@ struct FetcherFunction: public ValueFunctionT<FetcherArgs, FetcherOutput> {
         maxConcurrency = functionConfig.maxConcurrentFetch;
         cv = make_shared<std::condition_variable>();
         mtx = make_shared<std::mutex>();
+        if (functionConfig.responseCacheBytes > 0) {
+            cache = std::make_shared<FetcherResponseCache>
+                (functionConfig.responseCacheBytes,
+                 functionConfig.responseCacheSeconds);
+        }
     }
 
     struct ConcurrencyHandler {
@@ -135,53 +559,173 @@ struct FetcherFunction: public ValueFunctionT<FetcherArgs, FetcherOutput> {
             mutex & mtx;
     };
     
+    static FetcherOutput fetchedOutput(FetchedContent fetched)
+    {
+        FetcherOutput result;
+        result.content = ExpressionValue(std::move(fetched.blob),
+                                         fetched.timestamp);
+        result.error = ExpressionValue::null(Date::notADate());
+        return result;
+    }
+
+    /// Output for the exception currently being handled
+    static FetcherOutput errorOutput()
+    {
+        FetcherOutput result;
+        result.content = ExpressionValue::null(Date::notADate());
+        result.error = ExpressionValue(getExceptionString(), Date::now());
+        return result;
+    }
+
     virtual FetcherOutput applyT(const ApplierT & applier,
                                  FetcherArgs args) const
     {
         ConcurrencyHandler concurrencyHandler(maxConcurrency,
                                               *cv.get(), *mtx.get());
-        FetcherOutput result;
-        Utf8String url = args.url;
         try {
-                filter_istream stream(url.rawString(),
-                                      { { "mapped", "true" },
-                                        { "httpArbitraryTooSlowAbort", "1"} });
-
-            
-            const char * mappedAddr;
-            size_t mappedSize;
-            std::tie(mappedAddr, mappedSize) = stream.mapped();
-
-            CellValue blob;
-            if (mappedAddr) {
-                blob = CellValue::blob(mappedAddr, mappedSize);
+            return fetchedOutput(fetch(args.url.rawString()));
+        }
+        MLDB_CATCH_ALL {
+            return errorOutput();
+        }
+    }
+
+    /** When fetching asynchronously, all of the http:// and https:// URLs
+        of the batch are put in flight together, up to maxConcurrentFetch
+        of them at a time, and this thread only waits for them to finish.
+        Other URLs are then fetched one at a time as for applyT().
+    */
+    virtual std::vector<FetcherOutput>
+    applyBatchT(const ApplierT & applier,
+                std::vector<FetcherArgs> inputs) const override
+    {
+        if (!functionConfig.async)
+            return BaseT::applyBatchT(applier, std::move(inputs));
+
+        size_t n = inputs.size();
+        std::vector<FetcherOutput> result(n);
+        std::vector<std::future<FetchedContent> > pending(n);
+        std::vector<std::string> keys(n);
+        std::vector<Date> started(n);
+        std::vector<size_t> sync;
+        std::deque<size_t> inFlight;
+
+        size_t maxInFlight = n;
+        if (functionConfig.maxConcurrentFetch != -1)
+            maxInFlight = functionConfig.maxConcurrentFetch;
+
+        auto finish = [&] (size_t i)
+            {
+                try {
+                    FetchedContent fetched = pending[i].get();
+                    if (cache)
+                        cache->put(keys[i], fetched, started[i]);
+                    result[i] = fetchedOutput(std::move(fetched));
+                }
+                MLDB_CATCH_ALL {
+                    result[i] = errorOutput();
+                }
+            };
+
+        for (size_t i = 0;  i < n;  ++i) {
+            const std::string & url = inputs[i].url.rawString();
+            if (!isHttpUrl(url)) {
+                sync.push_back(i);
+                continue;
+            }
+
+            try {
+                if (cache) {
+                    FetchedContent fetched;
+                    keys[i] = FetcherResponseCache::getKey(url);
+                    if (cache->get(keys[i], fetched)) {
+                        result[i] = fetchedOutput(std::move(fetched));
+                        continue;
+                    }
+                }
+
+                while (inFlight.size() >= maxInFlight) {
+                    finish(inFlight.front());
+                    inFlight.pop_front();
+                }
+
+                started[i] = Date::now();
+                pending[i] = fetchAsync(url,
+                                        functionConfig.maxConnectionsPerHost,
+                                        functionConfig.timeoutSeconds);
+                inFlight.push_back(i);
             }
-            else {
-                std::ostringstream streamo;
-                streamo << stream.rdbuf();
-                blob = CellValue::blob(streamo.str());
+            MLDB_CATCH_ALL {
+                result[i] = errorOutput();
             }
-            stream.close();
+        }
+
+        for (size_t i: inFlight)
+            finish(i);
+
+        for (size_t i: sync)
+            result[i] = applyT(applier, std::move(inputs[i]));
+
+        return result;
+    }
 
-            FsObjectInfo info = stream.info();
-            ExcAssert(info.exists);
-            result.content = ExpressionValue(std::move(blob),
-                                             info.lastModified.isADate()
-                                             ? info.lastModified
-                                             : Date::now());
-            result.error = ExpressionValue::null(Date::notADate());
+    FetchedContent fetch(const std::string & url) const
+    {
+        FetchedContent result;
+        std::string key;
+        if (cache) {
+            key = FetcherResponseCache::getKey(url);
+            if (cache->get(key, result))
+                return result;
         }
-        MLDB_CATCH_ALL {
-            result.content = ExpressionValue::null(Date::notADate());
-            result.error = ExpressionValue(getExceptionString(), Date::now());
+
+        Date started = Date::now();
+        if (functionConfig.async && isHttpUrl(url)) {
+            result = fetchAsync(url,
+                                functionConfig.maxConnectionsPerHost,
+                                functionConfig.timeoutSeconds).get();
         }
+        else {
+            result = fetchSync(url);
+        }
+
+        if (cache)
+            cache->put(key, result, started);
         return result;
     }
 
+    static FetchedContent fetchSync(const std::string & url)
+    {
+        filter_istream stream(url,
+                              { { "mapped", "true" },
+                                { "httpArbitraryTooSlowAbort", "1"} });
+
+        const char * mappedAddr;
+        size_t mappedSize;
+        std::tie(mappedAddr, mappedSize) = stream.mapped();
+
+        CellValue blob;
+        if (mappedAddr) {
+            blob = CellValue::blob(mappedAddr, mappedSize);
+        }
+        else {
+            std::ostringstream streamo;
+            streamo << stream.rdbuf();
+            blob = CellValue::blob(streamo.str());
+        }
+        stream.close();
+
+        FsObjectInfo info = stream.info();
+        ExcAssert(info.exists);
+        return { std::move(blob),
+                 info.lastModified.isADate() ? info.lastModified : Date::now() };
+    }
+
     FetcherFunctionConfig functionConfig;
     mutable int maxConcurrency;
     mutable shared_ptr<condition_variable> cv;
     mutable shared_ptr<mutex> mtx;
+    std::shared_ptr<FetcherResponseCache> cache;
 };
 
 static RegisterFunctionType<FetcherFunction, FetcherFunctionConfig>
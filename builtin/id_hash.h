@@ -10,6 +10,8 @@
 #pragma once
 
 #include "mldb/utils/lightweight_hash.h"
+#include <memory>
+#include <vector>
 
 namespace MLDB {
 
@@ -169,6 +171,15 @@ struct IdHashes {
         buckets[bucketNum(value.first)].insert(value);
     }
 
+    /** Set the given bits in the bitmap of key, inserting it if it's not
+        already there. */
+    void addBits(uint64_t key, uint32_t bits)
+    {
+        auto res = buckets[bucketNum(key)].insert(IdHashBucket(key, bits));
+        if (!res.second)
+            res.first->second |= bits;
+    }
+
     size_t size() const
     {
         size_t result = 0;
@@ -251,5 +262,176 @@ struct IdHashes {
     }
 };
 
+
+/** Set of IdHashes that can be extended with more keys without being
+    copied, so that a copy of it can be extended while the original is
+    still in use.
+
+    It's a stack of layers, each an IdHashes, which are shared between the
+    copies.  Adding keys puts them in a new layer on top, which is merged
+    into the layers below it as long as they are no more than twice its
+    size.  So the layers get geometrically smaller towards the top, there
+    are O(log n) of them and each key is copied O(log n) times over a
+    sequence of additions.
+
+    A key may be in several layers; its bitmap is the union of the bitmaps
+    in each of them.
+*/
+struct LayeredIdHashes {
+
+    typedef IdHashes Layer;
+
+    /** Make it contain only the given layer. */
+    void reset(std::shared_ptr<const Layer> layer)
+    {
+        numKeys = layer->size();
+        layers = { std::move(layer) };
+    }
+
+    /** Set the given bits in the bitmap of each of the keys. */
+    void add(const std::vector<uint64_t> & keys, uint32_t bits)
+    {
+        auto layer = std::make_shared<Layer>();
+        for (auto & k: keys) {
+            layer->addBits(k, bits);
+        }
+
+        layer->forEach([&] (uint64_t key, uint32_t bits)
+                       {
+                           if (getDefault(key, 0) == 0)
+                               ++numKeys;
+                           return true;
+                       });
+
+        size_t size = layer->size();
+        while (!layers.empty() && layers.back()->size() <= 2 * size) {
+            auto merged = std::make_shared<Layer>(*layers.back());
+            layer->forEach([&] (uint64_t key, uint32_t bits)
+                           {
+                               merged->addBits(key, bits);
+                               return true;
+                           });
+            layers.pop_back();
+            layer = std::move(merged);
+            size = layer->size();
+        }
+
+        layers.emplace_back(std::move(layer));
+    }
+
+    size_t size() const
+    {
+        return numKeys;
+    }
+
+    uint32_t getDefault(uint64_t key, uint32_t def = (uint32_t)-1) const
+    {
+        uint32_t result = 0;
+        for (auto & l: layers)
+            result |= l->getDefault(key, 0);
+        return result ? result : def;
+    }
+
+    /** Call fn once for each key, with its full bitmap. */
+    template<typename Fn>
+    bool forEach(const Fn & fn) const
+    {
+        for (size_t i = 0;  i < layers.size();  ++i) {
+            auto onEntry = [&] (uint64_t key, uint32_t bits)
+                {
+                    if (inLowerLayer(key, i))
+                        return true;
+                    return fn(key, bits | getHigher(key, i));
+                };
+            if (!layers[i]->forEach(onEntry))
+                return false;
+        }
+        return true;
+    }
+
+    struct const_iterator {
+        const_iterator()
+            : source(nullptr), layer(-1), remaining(0)
+        {
+        }
+
+        const_iterator(const LayeredIdHashes * source)
+            : source(source), layer(-1), remaining(0)
+        {
+            settle();
+        }
+
+        IdHashBucket operator * () const
+        {
+            return current;
+        }
+
+        void operator ++ ()
+        {
+            ++it;
+            --remaining;
+            settle();
+        }
+
+    private:
+        /// Skip to the next key that isn't in a lower layer
+        void settle()
+        {
+            for (;;) {
+                while (remaining == 0) {
+                    if (++layer >= (int)source->layers.size())
+                        return;
+                    it = source->layers[layer]->begin();
+                    remaining = source->layers[layer]->size();
+                }
+
+                IdHashBucket entry = *it;
+                if (!source->inLowerLayer(entry.first, layer)) {
+                    current = IdHashBucket
+                        (entry.first,
+                         entry.second | source->getHigher(entry.first, layer));
+                    return;
+                }
+
+                ++it;
+                --remaining;
+            }
+        }
+
+        const LayeredIdHashes * source;
+        int layer;
+        size_t remaining;  ///< Entries of the current layer not yet visited
+        IdHashes::const_iterator it;
+        IdHashBucket current;
+    };
+
+    const_iterator begin() const
+    {
+        return const_iterator(this);
+    }
+
+private:
+    /// Bottom (biggest) layer first
+    std::vector<std::shared_ptr<const Layer> > layers;
+    size_t numKeys = 0;
+
+    bool inLowerLayer(uint64_t key, size_t layer) const
+    {
+        for (size_t i = 0;  i < layer;  ++i) {
+            if (layers[i]->count(key))
+                return true;
+        }
+        return false;
+    }
+
+    uint32_t getHigher(uint64_t key, size_t layer) const
+    {
+        uint32_t result = 0;
+        for (size_t i = layer + 1;  i < layers.size();  ++i)
+            result |= layers[i]->getDefault(key, 0);
+        return result;
+    }
+};
+
 } // namespace MLDB
 
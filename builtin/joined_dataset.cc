@@ -7,6 +7,7 @@
 
 #include "joined_dataset.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/base/parallel.h"
 #include "mldb/base/parallel_merge_sort.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
@@ -22,6 +23,7 @@
 #include "mldb/utils/compact_vector.h"
 #include "mldb/engine/dataset_utils.h"
 #include <functional>
+#include <mutex>
 
 using namespace std;
 using namespace std::placeholders;
@@ -49,6 +51,10 @@ JoinedDatasetConfigDescription()
              "Field to join on");
     addField("qualification", &JoinedDatasetConfig::qualification,
              "Type of join");
+    addField("lazy", &JoinedDatasetConfig::lazy,
+             "Evaluate the join on demand rather than when the dataset is "
+             "created.  Rows are looked up by probing each side, and are "
+             "streamed in the order of the left dataset.", false);
 }
 
 struct JoinedDataset::Itl
@@ -95,6 +101,47 @@ struct JoinedDataset::Itl
         JoinedDataset::Itl* source;
     };
 
+    /** Row stream for a lazy join, which generates the names of the
+        joined rows on the fly from the probe index.
+    */
+    struct LazyJoinedRowStream : public RowStream {
+
+        LazyJoinedRowStream(const JoinedDataset::Itl* source) : source(source)
+        {
+        }
+
+        virtual std::shared_ptr<RowStream> clone() const
+        {
+            return std::make_shared<LazyJoinedRowStream>(source);
+        }
+
+        virtual void initAt(size_t start)
+        {
+            source->seekLazy(start, leftIndex, matchIndex);
+        }
+
+        virtual const RowPath & rowName(RowPath & storage) const
+        {
+            return storage = source->getLazyRowName(leftIndex, matchIndex);
+        }
+
+        virtual RowPath next()
+        {
+            RowPath result = source->getLazyRowName(leftIndex, matchIndex);
+            source->advanceLazy(leftIndex, matchIndex);
+            return result;
+        }
+
+        virtual void advance()
+        {
+            source->advanceLazy(leftIndex, matchIndex);
+        }
+
+    private:
+        size_t leftIndex = 0, matchIndex = 0;
+        const JoinedDataset::Itl* source;
+    };
+
     /// Rows in the joined dataset
     std::vector<RowEntry> rows;
 
@@ -141,13 +188,154 @@ struct JoinedDataset::Itl
     Utf8String childAliases[JOIN_SIDE_MAX]; //Alias of the (direct) joined tables left and right
     std::vector<Utf8String> tableNames; //sub tables from both side + direct childs left and right
 
+    /// Is the join evaluated on demand?  If so, the rows, rowIndex,
+    /// leftRowIndex and rightRowIndex above are only filled in when
+    /// something needs them (see ensureMaterialized()).
+    bool lazy = false;
+
+    /// Join style, for the lazy case
+    AnnotatedJoinCondition::Style style = AnnotatedJoinCondition::EMPTY;
+
+    /// For the lazy case, do we output unmatched rows on each side?
+    bool outerLeft = false, outerRight = false;
+
+    /** Evaluates one side of the join condition on a single row, so that
+        rows can be matched up without running a query over the whole
+        side.
+    */
+    struct SideEvaluator {
+        SideEvaluator(const Dataset & dataset,
+                      const AnnotatedJoinCondition::Side & side,
+                      bool joinable)
+            : matrix(dataset.getMatrixView()), dataset(dataset),
+              scope(dataset, ""),
+              key(side.selectExpression->bind(scope)),
+              where(side.where->bind(scope)),
+              joinable(joinable)
+        {
+            // The usual ON clause compares plain columns.  Their values can
+            // be read straight from the column index, without evaluating
+            // each row.
+            auto read = std::dynamic_pointer_cast<ReadColumnExpression>
+                (side.selectExpression);
+            if (read && side.where->isConstantTrue()) {
+                keyColumn = read->columnName;
+                keyIsColumn = !keyColumn.empty();
+            }
+        }
+
+        std::shared_ptr<MatrixView> matrix;
+        const Dataset & dataset;
+        SqlExpressionDatasetScope scope;
+        BoundSqlExpression key;
+        BoundSqlExpression where;
+
+        /// False if the constant part of the join condition is false
+        bool joinable;
+
+        /// Column that is the key, if it's a plain column with no WHERE
+        ColumnPath keyColumn;
+        bool keyIsColumn = false;
+
+        /** Return the value that the row is joined on, or a null value
+            if it can't be joined with any row on the other side.
+        */
+        ExpressionValue getKey(const RowPath & rowName) const
+        {
+            if (!joinable)
+                return ExpressionValue();
+            ExpressionValue row = dataset.getRowExpr(rowName);
+            auto rowScope = scope.getRowScope(rowName, row);
+            ExpressionValue storage;
+            if (!where(rowScope, storage, GET_LATEST).isTrue())
+                return ExpressionValue();
+            return key(rowScope, GET_LATEST);
+        }
+
+        /** Return the value that each of the given rows is joined on, as
+            getKey() would.  A key that's a plain column is read from the
+            column index in one pass rather than row by row.
+        */
+        std::vector<ExpressionValue>
+        getKeys(const std::vector<RowPath> & rows) const
+        {
+            size_t n = rows.size();
+            std::vector<ExpressionValue> result(n);
+            if (!joinable || n == 0)
+                return result;
+
+            auto columns = dataset.getColumnIndex();
+            if (!keyIsColumn || !columns->knownColumn(keyColumn)) {
+                parallelMap(0, n, [&] (size_t i)
+                    {
+                        result[i] = getKey(rows[i]);
+                    });
+                return result;
+            }
+
+            // Latest value of the column in each row that has it
+            std::unordered_map<RowHash, std::pair<CellValue, Date> > latest;
+            for (auto & r: columns->getColumn(keyColumn).rows) {
+                auto it = latest.emplace(std::get<0>(r),
+                                         std::make_pair(std::get<1>(r),
+                                                        std::get<2>(r)));
+                if (!it.second && std::get<2>(r) > it.first->second.second)
+                    it.first->second = { std::get<1>(r), std::get<2>(r) };
+            }
+
+            for (size_t i = 0;  i < n;  ++i) {
+                auto it = latest.find(rows[i]);
+                if (it != latest.end())
+                    result[i] = ExpressionValue(std::move(it->second.first),
+                                                it->second.second);
+            }
+            return result;
+        }
+    };
+
+    std::unique_ptr<SideEvaluator> leftSide, rightSide;
+
+    struct KeyHash {
+        size_t operator () (const ExpressionValue & key) const
+        {
+            return key.hash();
+        }
+    };
+
+    /// Hash table for the right side of a lazy join
+    struct RightTable {
+        std::vector<RowPath> rows;              ///< Rows on the right
+        std::vector<ssize_t> rowBuckets;        ///< Bucket of each, or -1
+        std::vector<std::vector<size_t> > buckets;  ///< Rows with each key
+        std::unordered_map<ExpressionValue, size_t, KeyHash> bucketIndex;
+    };
+
+    /// Index of the output rows of a lazy join, driven by the left side
+    struct ProbeIndex {
+        std::vector<RowPath> leftRows;          ///< Rows on the left
+        std::vector<ssize_t> leftBuckets;       ///< Right bucket of each
+        std::vector<uint64_t> offsets;          ///< First output row of each
+        std::vector<size_t> rightOnly;          ///< Unmatched right rows
+        std::vector<char> bucketUsed;           ///< Is bucket matched?
+
+        size_t rowCount() const
+        {
+            return offsets.back() + rightOnly.size();
+        }
+    };
+
+    mutable std::once_flag rightTableOnce, probeIndexOnce, materializeOnce;
+    mutable std::unique_ptr<RightTable> rightTable;
+    mutable std::unique_ptr<ProbeIndex> probeIndex;
+
     Itl(SqlBindingScope & scope,
         std::shared_ptr<TableExpression> leftExpr,
         BoundTableExpression left,
         std::shared_ptr<TableExpression> rightExpr,
         BoundTableExpression right,
         std::shared_ptr<SqlExpression> on,
-        JoinQualification qualification)
+        JoinQualification qualification,
+        bool lazy)
     {
         bool debug = false;
 
@@ -237,11 +425,16 @@ struct JoinedDataset::Itl
             
             // We can use a fast path, since we have simple non-filtered
             // equijoin
-            makeJoinConstantWhere(condition, scope, left, right,
-                                  qualification);            
+            if (lazy)
+                makeJoinLazy(condition, qualification);
+            else makeJoinConstantWhere(condition, scope, left, right,
+                                       qualification);
 
         } else {
 
+            // Complex join conditions need the pipeline, which runs over
+            // everything anyway, so they are never lazy.
+
             // Complex join condition.  We need to generate the full set of
             // values.  To do this, we use the new executor.
             auto gotElement = [&] (std::shared_ptr<PipelineResults> & res) -> bool {
@@ -324,18 +517,15 @@ struct JoinedDataset::Itl
         }
     }
 
-     /* This is called to record a new entry from the join. */
-    void recordJoinRow(const RowPath & leftName, RowHash leftHash,
-                       const RowPath & rightName, RowHash rightHash)
+    /** Return the name of the row made by joining the given rows. */
+    RowPath getJoinedRowName(const RowPath & leftName,
+                             const RowPath & rightName) const
     {
-        bool debug = false;
-        RowPath rowName;
-
         if (chainedJoinDepth > 0 && !leftName.empty()) {
-            rowName = RowPath(leftName.toUtf8String() + "-" + "[" + rightName.toUtf8String() + "]");
+            return RowPath(leftName.toUtf8String() + "-" + "[" + rightName.toUtf8String() + "]");
         }
         else if (chainedJoinDepth == 0) {
-            rowName = RowPath("[" + leftName.toUtf8String() + "]" + "-" + "[" + rightName.toUtf8String() + "]");
+            return RowPath("[" + leftName.toUtf8String() + "]" + "-" + "[" + rightName.toUtf8String() + "]");
         }
         else {
             Utf8String left;
@@ -343,8 +533,16 @@ struct JoinedDataset::Itl
                 left += "[]-";
             }
 
-            rowName = RowPath(left + "[" + rightName.toUtf8String() + "]");
+            return RowPath(left + "[" + rightName.toUtf8String() + "]");
         }
+    }
+
+     /* This is called to record a new entry from the join. */
+    void recordJoinRow(const RowPath & leftName, RowHash leftHash,
+                       const RowPath & rightName, RowHash rightHash)
+    {
+        bool debug = false;
+        RowPath rowName = getJoinedRowName(leftName, rightName);
 
 #if 0
         cerr << "rowName = " << rowName << endl;
@@ -628,11 +826,375 @@ struct JoinedDataset::Itl
         }
     }
 
+    /** Set up a lazy join.  Nothing is evaluated here; the right side is
+        hashed on the first lookup that needs it, and the left side is
+        probed against it when the rows are first enumerated.
+    */
+    void makeJoinLazy(const AnnotatedJoinCondition & condition,
+                      JoinQualification qualification)
+    {
+        if (condition.style != AnnotatedJoinCondition::CROSS_JOIN
+            && condition.style != AnnotatedJoinCondition::EQUIJOIN) {
+            throw AnnotatedException(400, "Unknown or empty Join expression",
+                                      "condition", condition);
+        }
+
+        this->lazy = true;
+        style = condition.style;
+        outerLeft = qualification == JOIN_LEFT || qualification == JOIN_FULL;
+        outerRight = qualification == JOIN_RIGHT || qualification == JOIN_FULL;
+
+        bool joinable = condition.constantWhere->constantValue().isTrue();
+        leftSide.reset(new SideEvaluator(*leftDataset, condition.left,
+                                         joinable));
+        rightSide.reset(new SideEvaluator(*rightDataset, condition.right,
+                                          joinable));
+    }
+
+    const RightTable & getRightTable() const
+    {
+        std::call_once(rightTableOnce, [&] ()
+            {
+                std::unique_ptr<RightTable> result(new RightTable());
+                result->rows = rightSide->matrix->getRowPaths();
+
+                size_t n = result->rows.size();
+                std::vector<ExpressionValue> keys
+                    = rightSide->getKeys(result->rows);
+
+                // Serially, so that the rows within a bucket keep the order
+                // of the right dataset
+                result->rowBuckets.resize(n, -1);
+                for (size_t i = 0;  i < n;  ++i) {
+                    if (keys[i].empty())
+                        continue;
+                    auto it = result->bucketIndex.emplace
+                        (std::move(keys[i]), result->buckets.size()).first;
+                    if (it->second == result->buckets.size())
+                        result->buckets.emplace_back();
+                    result->buckets[it->second].push_back(i);
+                    result->rowBuckets[i] = it->second;
+                }
+
+                rightTable = std::move(result);
+            });
+
+        return *rightTable;
+    }
+
+    const ProbeIndex & getProbeIndex() const
+    {
+        std::call_once(probeIndexOnce, [&] ()
+            {
+                const RightTable & right = getRightTable();
+
+                std::unique_ptr<ProbeIndex> result(new ProbeIndex());
+                result->leftRows = leftSide->matrix->getRowPaths();
+
+                size_t n = result->leftRows.size();
+                result->leftBuckets.resize(n, -1);
+                if (n > 0 && !right.buckets.empty()) {
+                    std::vector<ExpressionValue> keys
+                        = leftSide->getKeys(result->leftRows);
+                    parallelMap(0, n, [&] (size_t i)
+                        {
+                            if (keys[i].empty())
+                                return;
+                            auto it = right.bucketIndex.find(keys[i]);
+                            if (it != right.bucketIndex.end())
+                                result->leftBuckets[i] = it->second;
+                        });
+                }
+
+                result->bucketUsed.resize(right.buckets.size(), false);
+                result->offsets.resize(n + 1);
+                result->offsets[0] = 0;
+                for (size_t i = 0;  i < n;  ++i) {
+                    ssize_t bucket = result->leftBuckets[i];
+                    size_t count = outerLeft;
+                    if (bucket != -1) {
+                        count = right.buckets[bucket].size();
+                        result->bucketUsed[bucket] = true;
+                    }
+                    result->offsets[i + 1] = result->offsets[i] + count;
+                }
+
+                if (outerRight) {
+                    for (size_t i = 0;  i < right.rows.size();  ++i) {
+                        ssize_t bucket = right.rowBuckets[i];
+                        if (bucket == -1 || !result->bucketUsed[bucket])
+                            result->rightOnly.push_back(i);
+                    }
+                }
+
+                probeIndex = std::move(result);
+            });
+
+        return *probeIndex;
+    }
+
+    /** Position the (leftIndex, matchIndex) cursor of a lazy join on the
+        given output row.  Output rows are ordered by left row, then by
+        the matching right rows, followed by the unmatched right rows
+        with leftIndex equal to the number of left rows.
+    */
+    void seekLazy(size_t row, size_t & leftIndex, size_t & matchIndex) const
+    {
+        const ProbeIndex & probe = getProbeIndex();
+        if (row >= probe.offsets.back()) {
+            leftIndex = probe.leftRows.size();
+            matchIndex = row - probe.offsets.back();
+            return;
+        }
+
+        auto it = std::upper_bound(probe.offsets.begin(), probe.offsets.end(),
+                                   row);
+        leftIndex = it - probe.offsets.begin() - 1;
+        matchIndex = row - probe.offsets[leftIndex];
+    }
+
+    void advanceLazy(size_t & leftIndex, size_t & matchIndex) const
+    {
+        const ProbeIndex & probe = *probeIndex;
+        size_t nleft = probe.leftRows.size();
+        ++matchIndex;
+        while (leftIndex < nleft
+               && matchIndex >= (probe.offsets[leftIndex + 1]
+                                 - probe.offsets[leftIndex])) {
+            ++leftIndex;
+            matchIndex = 0;
+        }
+    }
+
+    void getLazySideNames(size_t leftIndex, size_t matchIndex,
+                          RowPath & leftName, RowPath & rightName) const
+    {
+        const ProbeIndex & probe = *probeIndex;
+        const RightTable & right = *rightTable;
+
+        if (leftIndex == probe.leftRows.size()) {
+            leftName = RowPath();
+            rightName = right.rows[probe.rightOnly.at(matchIndex)];
+            return;
+        }
+
+        leftName = probe.leftRows[leftIndex];
+        ssize_t bucket = probe.leftBuckets[leftIndex];
+        if (bucket == -1)
+            rightName = RowPath();
+        else rightName = right.rows[right.buckets[bucket][matchIndex]];
+    }
+
+    RowPath getLazyRowName(size_t leftIndex, size_t matchIndex) const
+    {
+        RowPath leftName, rightName;
+        getLazySideNames(leftIndex, matchIndex, leftName, rightName);
+        return getJoinedRowName(leftName, rightName);
+    }
+
+    /** Call onRow for each row of a lazy join from start, stopping after
+        limit rows (-1 means all) or when onRow returns false.
+    */
+    template<typename Fn>
+    void forEachLazyRow(ssize_t start, ssize_t limit, Fn && onRow) const
+    {
+        const ProbeIndex & probe = getProbeIndex();
+        ssize_t total = probe.rowCount();
+        ssize_t end = limit == -1 ? total : std::min(total, start + limit);
+
+        size_t leftIndex, matchIndex;
+        RowPath leftName, rightName;
+        for (ssize_t row = start;  row < end;  ++row) {
+            if (row == start)
+                seekLazy(start, leftIndex, matchIndex);
+            else advanceLazy(leftIndex, matchIndex);
+            getLazySideNames(leftIndex, matchIndex, leftName, rightName);
+            if (!onRow(leftName, rightName))
+                return;
+        }
+    }
+
+    /** Does the given pair of rows from each side make a row of the
+        lazy join?  Either may be empty for an outer row.
+    */
+    bool isLazyRow(const RowPath & leftName, const RowPath & rightName) const
+    {
+        if (leftName.empty() && rightName.empty())
+            return false;
+        if (!leftName.empty() && !leftSide->matrix->knownRow(leftName))
+            return false;
+        if (!rightName.empty() && !rightSide->matrix->knownRow(rightName))
+            return false;
+
+        if (!leftName.empty() && !rightName.empty()) {
+            ExpressionValue leftKey = leftSide->getKey(leftName);
+            return !leftKey.empty() && leftKey == rightSide->getKey(rightName);
+        }
+        else if (!leftName.empty()) {
+            if (!outerLeft)
+                return false;
+            ExpressionValue leftKey = leftSide->getKey(leftName);
+            return leftKey.empty()
+                || !getRightTable().bucketIndex.count(leftKey);
+        }
+        else {
+            if (!outerRight)
+                return false;
+            ExpressionValue rightKey = rightSide->getKey(rightName);
+            if (rightKey.empty())
+                return true;
+            const RightTable & right = getRightTable();
+            auto it = right.bucketIndex.find(rightKey);
+            return it == right.bucketIndex.end()
+                || !getProbeIndex().bucketUsed.at(it->second);
+        }
+    }
+
+    /** Find the rows on each side that make up the given row of a lazy
+        join, by taking its name apart.  Since row names may themselves
+        contain the separators, each possible split is tried until one
+        makes a row of the join.
+    */
+    bool findLazyRow(const RowPath & rowName,
+                     RowPath & leftName, RowPath & rightName) const
+    {
+        if (rowName.size() != 1)
+            return false;
+
+        std::string name = rowName[0].getBytes();
+        if (name.size() < 4 || name.back() != ']')
+            return false;
+
+        auto parse = [] (const std::string & str, RowPath & result)
+            {
+                if (str.empty()) {
+                    result = RowPath();
+                    return true;
+                }
+                auto parsed = RowPath::tryParse(Utf8String(str));
+                result = std::move(parsed.first);
+                return parsed.second;
+            };
+
+        for (size_t pos = name.find("-[");  pos != std::string::npos;
+             pos = name.find("-[", pos + 1)) {
+            std::string leftStr = name.substr(0, pos);
+            std::string rightStr = name.substr(pos + 2,
+                                               name.size() - pos - 3);
+
+            if (chainedJoinDepth == 0) {
+                if (leftStr.size() < 2 || leftStr[0] != '['
+                    || leftStr.back() != ']')
+                    continue;
+                leftStr = leftStr.substr(1, leftStr.size() - 2);
+            }
+
+            RowPath left, right;
+            if (!parse(rightStr, right))
+                continue;
+
+            // For chained joins, an empty left row is written as a
+            // sequence of "[]-"
+            if (chainedJoinDepth > 0
+                && getJoinedRowName(RowPath(), right) == rowName
+                && isLazyRow(RowPath(), right)) {
+                leftName = RowPath();
+                rightName = std::move(right);
+                return true;
+            }
+
+            if (!parse(leftStr, left))
+                continue;
+
+            if (getJoinedRowName(left, right) == rowName
+                && isLazyRow(left, right)) {
+                leftName = std::move(left);
+                rightName = std::move(right);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /** Build the full set of rows and indexes for a lazy join, for the
+        operations that need them.  This is a no-op for a join that was
+        built up front.
+    */
+    void ensureMaterialized() const
+    {
+        if (!lazy)
+            return;
+
+        std::call_once(materializeOnce, [&] ()
+            {
+                size_t rowCount = getProbeIndex().rowCount();
+                if (style == AnnotatedJoinCondition::CROSS_JOIN
+                    && rowCount > 100000000) {
+                    throw AnnotatedException
+                        (400, "Cross join too big: cowardly refusing to "
+                         "materialize row IDs for a dataset with > "
+                         "100,000,000 rows",
+                         "rowCount", rowCount);
+                }
+
+                // The row index is only ever written here, once
+                auto mutableThis = const_cast<Itl *>(this);
+                mutableThis->rows.reserve(rowCount);
+
+                auto onRow = [&] (const RowPath & leftName,
+                                  const RowPath & rightName)
+                    {
+                        mutableThis->recordJoinRow
+                            (leftName,
+                             leftName.empty() ? RowHash() : RowHash(leftName),
+                             rightName,
+                             rightName.empty() ? RowHash() : RowHash(rightName));
+                        return true;
+                    };
+
+                forEachLazyRow(0, -1, onRow);
+            });
+    }
+
+    /** Find the rows on each side that make up the given joined row.
+        Returns false if there is no such row.
+    */
+    bool getSideNames(const RowPath & rowName,
+                      RowPath & leftName, RowPath & rightName) const
+    {
+        if (lazy)
+            return findLazyRow(rowName, leftName, rightName);
+
+        auto it = rowIndex.find(rowName);
+        if (it == rowIndex.end())
+            return false;
+
+        const RowEntry & row = rows.at(it->second);
+        if (rowName != row.rowName)
+            return false;
+
+        leftName = row.leftName;
+        rightName = row.rightName;
+        return true;
+    }
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
         std::vector<RowPath> result;
 
+        if (lazy) {
+            forEachLazyRow(start, limit, [&] (const RowPath & leftName,
+                                              const RowPath & rightName)
+                           {
+                               result.push_back(getJoinedRowName(leftName,
+                                                                 rightName));
+                               return true;
+                           });
+            return result;
+        }
+
         for (auto & r: rows) {
             result.push_back(r.rowName);
         }
@@ -645,6 +1207,17 @@ struct JoinedDataset::Itl
     {
         std::vector<RowHash> result;
 
+        if (lazy) {
+            forEachLazyRow(start, limit, [&] (const RowPath & leftName,
+                                              const RowPath & rightName)
+                           {
+                               result.emplace_back(getJoinedRowName(leftName,
+                                                                    rightName));
+                               return true;
+                           });
+            return result;
+        }
+
         for (auto & r: rows) {
             result.push_back(r.rowHash);
         }
@@ -656,23 +1229,23 @@ struct JoinedDataset::Itl
 
     virtual bool knownRow(const RowPath & rowName) const
     {
+        if (lazy) {
+            RowPath leftName, rightName;
+            return findLazyRow(rowName, leftName, rightName);
+        }
         return rowIndex.count(rowName);
     }
 
     virtual bool knownRowHash(const RowHash & rowHash) const
     {
+        ensureMaterialized();
         return rowIndex.count(rowHash);
     }
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const
     {
-        auto it = rowIndex.find(rowName);
-        if (it == rowIndex.end())
-            return MatrixNamedRow();
-        
-        const RowEntry & row = rows.at(it->second);
-
-        if (rowName != row.rowName)
+        RowPath leftName, rightName;
+        if (!getSideNames(rowName, leftName, rightName))
             return MatrixNamedRow();
 
         MatrixNamedRow result;
@@ -706,8 +1279,8 @@ struct JoinedDataset::Itl
                 rowValue.forEachAtomDestructive(onAtom);
             };                          
 
-        doRow(*leftDataset, row.leftName, leftColumns);
-        doRow(*rightDataset, row.rightName, rightColumns);
+        doRow(*leftDataset, leftName, leftColumns);
+        doRow(*rightDataset, rightName, rightColumns);
 
         return result;
 
@@ -718,12 +1291,8 @@ struct JoinedDataset::Itl
     {
         StructValue result;
 
-        auto it = rowIndex.find(rowName);
-        if (it == rowIndex.end())
-            return result;
-
-        const RowEntry & row = rows.at(it->second);
-        if (rowName != row.rowName)
+        RowPath leftName, rightName;
+        if (!getSideNames(rowName, leftName, rightName))
             return result;
 
         auto doRow = [&] (const Dataset & dataset,
@@ -762,8 +1331,8 @@ struct JoinedDataset::Itl
                 result.emplace_back(PathElement(childName), ExpressionValue(childresult));
         };
 
-        doRow(*leftDataset, row.leftName, leftColumnsExpr, childAliases[JOIN_SIDE_LEFT]);
-        doRow(*rightDataset, row.rightName, rightColumnsExpr, childAliases[JOIN_SIDE_RIGHT]);
+        doRow(*leftDataset, leftName, leftColumnsExpr, childAliases[JOIN_SIDE_LEFT]);
+        doRow(*rightDataset, rightName, rightColumnsExpr, childAliases[JOIN_SIDE_RIGHT]);
 
         return result;
 
@@ -771,6 +1340,7 @@ struct JoinedDataset::Itl
 
     virtual RowPath getRowPath(const RowHash & rowHash) const
     {
+        ensureMaterialized();
         auto it = rowIndex.find(rowHash);
         if (it == rowIndex.end())
             throw AnnotatedException(500, "Joined dataset did not find row with given hash",
@@ -820,6 +1390,8 @@ struct JoinedDataset::Itl
         if (it == columnIndex.end())
             throw AnnotatedException(500, "Joined dataset did not find column ",
                                       "columnName", columnName);
+
+        ensureMaterialized();
         
         auto doGetColumn = [&] (const Dataset & dataset,
                                 const SideRowIndex & index,
@@ -875,6 +1447,8 @@ struct JoinedDataset::Itl
 
     virtual size_t getRowCount() const
     {
+        if (lazy)
+            return getProbeIndex().rowCount();
         return rowIndex.size();
     }
 
@@ -886,15 +1460,11 @@ struct JoinedDataset::Itl
     RowPath getSubRowName(const RowPath & name, JoinSide side) const
     {   
         ExcAssert(side < JOIN_SIDE_MAX);
-        RowHash rowHash(name);
-        auto iter = rowIndex.find(rowHash);
-        if (iter == rowIndex.end())
+        RowPath leftName, rightName;
+        if (!getSideNames(name, leftName, rightName))
             return RowPath();
 
-        int64_t index = iter->second;
-        const RowEntry& entry = rows[index];
-
-        return JOIN_SIDE_LEFT == side ? entry.leftName : entry.rightName;
+        return JOIN_SIDE_LEFT == side ? leftName : rightName;
     };
 
     RowHash getSubRowHash(const RowPath & name, JoinSide side) const
@@ -910,16 +1480,9 @@ struct JoinedDataset::Itl
                                 const RowPath & name, JoinSide side) const
     {
         ExcAssert(side < JOIN_SIDE_MAX);
-        RowHash rowHash(name);
-        auto iter = rowIndex.find(rowHash);
-        if (iter == rowIndex.end())
+        RowPath subRowPath = getSubRowName(name, side);
+        if (subRowPath.empty())
             return RowPath();
-   
-
-        int64_t index = iter->second;
-        const RowEntry& entry = rows[index];
-
-        RowPath subRowPath = JOIN_SIDE_LEFT == side ? entry.leftName : entry.rightName;
 
         return (JOIN_SIDE_LEFT == side ? *leftDataset : *rightDataset)
             .getOriginalRowName(tableName, subRowPath);
@@ -1020,7 +1583,8 @@ JoinedDataset(MldbEngine * owner,
     itl.reset(new Itl(scope,
                       joinConfig.left, std::move(left),
                       joinConfig.right, std::move(right),
-                      joinConfig.on, joinConfig.qualification));
+                      joinConfig.on, joinConfig.qualification,
+                      joinConfig.lazy));
 }
 
 JoinedDataset::
@@ -1046,7 +1610,7 @@ JoinedDataset(SqlBindingScope & scope,
     itl.reset(new Itl(scope,
                       leftExpr, std::move(left),
                       rightExpr, std::move(right),
-                      on, qualification));
+                      on, qualification, false /* lazy */));
 }
 
 JoinedDataset::
@@ -1079,6 +1643,8 @@ std::shared_ptr<RowStream>
 JoinedDataset::
 getRowStream() const
 {
+    if (itl->lazy)
+        return make_shared<JoinedDataset::Itl::LazyJoinedRowStream>(itl.get());
     return make_shared<JoinedDataset::Itl::JoinedRowStream>(itl.get());
 }
 
@@ -1224,8 +1790,8 @@ overrideFunction(const Utf8String & tableName,
                      const SqlRowScope & scope)
                 {
                     auto & row = scope.as<SqlExpressionDatasetScope::RowScope>();
-                    RowHash rowHash(row.getRowHash());
-                    return ExpressionValue(itl->rows[itl->rowIndex[rowHash]].leftName, Date::negativeInfinity());
+                    return ExpressionValue(itl->getSubRowName(row.getRowPath(), JOIN_SIDE_LEFT),
+                                           Date::negativeInfinity());
                 },
                 std::make_shared<Utf8StringValueInfo>()
             };
@@ -1235,8 +1801,8 @@ overrideFunction(const Utf8String & tableName,
                      const SqlRowScope & scope)
                 {
                     auto & row = scope.as<SqlExpressionDatasetScope::RowScope>();
-                    RowHash rowHash(row.getRowHash());
-                    return ExpressionValue(itl->rows[itl->rowIndex[rowHash]].rightName, Date::negativeInfinity());
+                    return ExpressionValue(itl->getSubRowName(row.getRowPath(), JOIN_SIDE_RIGHT),
+                                           Date::negativeInfinity());
                 },
                 std::make_shared<Utf8StringValueInfo>()
             };
@@ -26,6 +26,7 @@ struct JoinedDatasetConfig {
     std::shared_ptr<TableExpression> right;
     std::shared_ptr<SqlExpression> on;
     JoinQualification qualification;
+    bool lazy = false;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(JoinedDatasetConfig);
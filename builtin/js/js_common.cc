@@ -376,14 +376,16 @@ void to_js(JS::JSValue & value, const CellValue & val)
         value = v8::Null(isolate);
     else if (val.isExactDouble())
         to_js(value, val.toDouble());
-    else if (val.isUtf8String())
-        to_js(value, val.toUtf8String());
+    else if (val.isString()) {
+        // Convert straight from the cell's storage, without an
+        // intermediate string copy
+        value = v8::String::NewFromUtf8(isolate, val.stringChars(),
+                                        v8::String::kNormalString,
+                                        val.toStringLength());
+    }
     else if (val.isTimestamp()) {
         to_js(value, val.toTimestamp());
     }
-    else if (val.isString()) {
-        to_js(value, val.toString());
-    }
     else {
         // Get our context so we can return a proper object
         JsPluginContext * cxt = JsContextScope::current();
@@ -391,6 +393,48 @@ void to_js(JS::JSValue & value, const CellValue & val)
     }
 }
 
+v8::Local<v8::Value> embeddingToTypedArray(const ExpressionValue & val)
+{
+    if (!val.isEmbedding())
+        return v8::Local<v8::Value>();
+
+    switch (val.getEmbeddingType()) {
+    case ST_FLOAT32:
+    case ST_FLOAT64:
+    case ST_INT8:
+    case ST_UINT8:
+    case ST_INT16:
+    case ST_UINT16:
+    case ST_INT32:
+    case ST_UINT32:
+    case ST_INT64:
+    case ST_UINT64:
+    case ST_BOOL:
+    case ST_ATOM:
+        break;
+    default:
+        return v8::Local<v8::Value>();
+    }
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+
+    size_t n = 1;
+    for (auto & d: val.getEmbeddingShape())
+        n *= d;
+
+    // Convert directly into the array buffer's storage.  Atoms may not
+    // all be numbers, in which case the caller falls back to the generic
+    // conversion.
+    auto buffer = v8::ArrayBuffer::New(isolate, n * sizeof(double));
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        val.convertEmbedding(buffer->GetContents().Data(), n, ST_FLOAT64);
+    } catch (const std::exception &) {
+        return v8::Local<v8::Value>();
+    }
+    return v8::Float64Array::New(buffer, 0, n);
+}
+
 PathElement from_js(const JS::JSValue & value, PathElement *)
 {
     if (value->IsNull() || value->IsUndefined())
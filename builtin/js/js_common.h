@@ -95,6 +95,12 @@ Path from_js_ref(const JS::JSValue & value, Path * = 0);
 
 void to_js(JS::JSValue & value, const ExpressionValue & val);
 
+/** Convert a dense numeric embedding into a Float64Array, without going
+    through the generic row conversion.  Returns an empty handle if the
+    value is not an embedding or not all of its values are numbers.
+*/
+v8::Local<v8::Value> embeddingToTypedArray(const ExpressionValue & val);
+
 ExpressionValue from_js(const JS::JSValue & value, ExpressionValue * = 0);
 
 ExpressionValue from_js_ref(const JS::JSValue & value, ExpressionValue * = 0);
@@ -7,6 +7,7 @@
 
 #include "js_common.h"
 #include "mldb_js.h"
+#include "mldb/core/mldb_engine.h"
 #include "mldb/arch/thread_specific.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
@@ -14,6 +15,10 @@
 #include "mldb/sql/sql_expression.h"
 
 #include <boost/algorithm/string.hpp>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -22,11 +27,201 @@ namespace MLDB {
 
 struct JsFunctionData;
 
+
+/*****************************************************************************/
+/* JS CODE CACHE                                                             */
+/*****************************************************************************/
+
+/** Process-wide cache of compiled scripts, keyed by their source text.
+
+    Compiled V8 scripts belong to a single isolate and each thread runs
+    functions in its own isolate, so what is shared here is the
+    serialized code cache which can be loaded into any isolate without
+    parsing and compiling the source again.
+*/
+
+struct JsCodeCache {
+
+    /// Maximum number of scripts to hold; the least recently used one is
+    /// dropped to make room for a new one
+    static constexpr size_t MAX_ENTRIES = 1000;
+
+    std::shared_ptr<const std::string> get(const Utf8String & source)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = entries.find(source);
+        if (it == entries.end())
+            return nullptr;
+        lru.splice(lru.begin(), lru, it->second.lruPosition);
+        return it->second.data;
+    }
+
+    void put(const Utf8String & source, std::string data)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = entries.find(source);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second.lruPosition);
+            it->second.data
+                = std::make_shared<const std::string>(std::move(data));
+            return;
+        }
+
+        while (entries.size() >= MAX_ENTRIES) {
+            entries.erase(lru.back());
+            lru.pop_back();
+        }
+
+        lru.push_front(source);
+        Entry & entry = entries[source];
+        entry.data = std::make_shared<const std::string>(std::move(data));
+        entry.lruPosition = lru.begin();
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const std::string> data;
+        std::list<Utf8String>::iterator lruPosition;
+    };
+
+    std::mutex mutex;
+    std::list<Utf8String> lru;  ///< Sources, most recently used first
+    std::unordered_map<Utf8String, Entry> entries;
+};
+
+static JsCodeCache codeCache;
+
+
+/*****************************************************************************/
+/* JS THREAD FUNCTION CACHE                                                  */
+/*****************************************************************************/
+
+/** Scripts compiled into a thread's isolate, ready to be bound into a
+    context.  These are kept between bindings of the same script, so that
+    repeatedly running a query doesn't compile the function in each thread
+    each time.  Each binding still gets a new context to run it in, so that
+    global state set by one binding is never seen by another.
+
+    Only the owning thread accesses the cache, except to retire bindings.
+*/
+
+struct JsThreadFunctionCache {
+
+    /// Maximum number of scripts to keep per thread
+    static constexpr size_t MAX_ENTRIES = 128;
+
+    struct Entry {
+        ~Entry()
+        {
+            script.Reset();
+        }
+
+        v8::Persistent<v8::UnboundScript> script;
+        uint64_t lastUsed = 0;
+    };
+
+    /// Context of a binding, with the function bound into it
+    struct Binding {
+        ~Binding()
+        {
+            context.Reset();
+            function.Reset();
+        }
+
+        v8::Persistent<v8::Context> context;
+        v8::Persistent<v8::Function> function;
+    };
+
+    /// Source of the function
+    typedef Utf8String Key;
+
+    Entry * get(const Key & key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+        it->second->lastUsed = ++clock;
+        return it->second.get();
+    }
+
+    Entry * insert(Key key)
+    {
+        evict();
+        auto & entry = entries[std::move(key)];
+        entry.reset(new Entry());
+        entry->lastUsed = ++clock;
+        return entry.get();
+    }
+
+    /** Hand over a binding that's no longer needed.  Bindings are
+        destroyed from whichever thread drops the bound function, but their
+        handles can only be released by the thread that owns the isolate,
+        which does so the next time it binds a function.
+    */
+    void retire(std::unique_ptr<Binding> binding)
+    {
+        std::unique_lock<std::mutex> guard(retiredMutex);
+        retired.emplace_back(std::move(binding));
+    }
+
+    /// Release the retired bindings; called by the owning thread
+    void releaseRetired()
+    {
+        std::vector<std::unique_ptr<Binding> > toRelease;
+        {
+            std::unique_lock<std::mutex> guard(retiredMutex);
+            toRelease.swap(retired);
+        }
+    }
+
+    static JsThreadFunctionCache * getForMyThread()
+    {
+        // Like the thread's isolate, this is never freed
+        static __thread JsThreadFunctionCache * result = 0;
+
+        if (!result) {
+            result = new JsThreadFunctionCache();
+        }
+
+        return result;
+    }
+
+private:
+    void evict()
+    {
+        while (entries.size() >= MAX_ENTRIES) {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin();  it != entries.end();  ++it) {
+                if (it->second->lastUsed < oldest->second->lastUsed)
+                    oldest = it;
+            }
+            entries.erase(oldest);
+        }
+    }
+
+    std::map<Key, std::unique_ptr<Entry> > entries;
+    uint64_t clock = 0;
+
+    std::mutex retiredMutex;
+    std::vector<std::unique_ptr<Binding> > retired;
+};
+
+
+/*****************************************************************************/
+/* JS FUNCTION DATA                                                          */
+/*****************************************************************************/
+
 /** Data for a JS function for each thread. */
 struct JsFunctionThreadData {
     JsFunctionThreadData()
-        : isolate(0), data(0)
+        : isolate(0), cache(0), data(0)
+    {
+    }
+
+    ~JsFunctionThreadData()
     {
+        if (binding)
+            cache->retire(std::move(binding));
     }
 
     bool initialized() const
@@ -35,9 +230,8 @@ struct JsFunctionThreadData {
     }
 
     JsIsolate * isolate;
-    v8::Persistent<v8::Context> context;
-    v8::Persistent<v8::Script> script;
-    v8::Persistent<v8::Function> function;
+    JsThreadFunctionCache * cache;
+    std::unique_ptr<JsThreadFunctionCache::Binding> binding;
     const JsFunctionData * data;
 
     void initialize(const JsFunctionData & data);
@@ -52,7 +246,24 @@ struct JsFunctionData {
     Utf8String scriptSource;
     std::string filenameForErrorMessages;
     std::vector<std::string> params;
+
+    /// For each parameter, should an embedding be passed as a Float64Array?
+    std::vector<bool> typedArrayParams;
+
     std::shared_ptr<JsPluginContext> context;
+
+    /// Source of the function expression, which is what is compiled
+    Utf8String functionSource() const
+    {
+        Utf8String result = "(function(";
+        for (size_t i = 0;  i < params.size();  ++i) {
+            if (i > 0)
+                result += ",";
+            result += params[i];
+        }
+        result += ") {\n" + scriptSource + "\n})";
+        return result;
+    }
 };
 
 void
@@ -64,61 +275,96 @@ initialize(const JsFunctionData & data)
     if (isolate)
         return;
 
-    isolate = JsIsolate::getIsolateForMyThread();
+    JsIsolate * threadIsolate = JsIsolate::getIsolateForMyThread();
     this->data = &data;
 
-    //v8::Locker locker(this->isolate->isolate);
-    v8::Isolate::Scope isolate(this->isolate->isolate);
+    //v8::Locker locker(threadIsolate->isolate);
+    v8::Isolate::Scope isolate(threadIsolate->isolate);
 
-    HandleScope handle_scope(this->isolate->isolate);
+    HandleScope handle_scope(threadIsolate->isolate);
 
-    // Create a new context.
-    this->context.Reset(this->isolate->isolate,
-                        Context::New(this->isolate->isolate));
+    JsThreadFunctionCache * cache = JsThreadFunctionCache::getForMyThread();
+    cache->releaseRetired();
+
+    // Each binding runs in a context of its own, so that globals set by
+    // the script don't leak from one binding into another
+    v8::Local<v8::Context> context = Context::New(threadIsolate->isolate);
 
     // Enter the created context for compiling and
     // running the hello world script. 
-    Context::Scope context_scope(this->context.Get(this->isolate->isolate));
+    Context::Scope context_scope(context);
 
     // Add the mldb object to the context
     auto mldb = MldbJS::registerMe()->NewInstance();
-    mldb->SetInternalField(0, v8::External::New(this->isolate->isolate,
+    mldb->SetInternalField(0, v8::External::New(threadIsolate->isolate,
                                                 data.engine));
-    mldb->SetInternalField(1, v8::External::New(this->isolate->isolate,
+    mldb->SetInternalField(1, v8::External::New(threadIsolate->isolate,
                                                 data.context.get()));
-    this->context.Get(this->isolate->isolate)
-        ->Global()
-        ->Set(String::NewFromUtf8(this->isolate->isolate,
-                                 "mldb"), mldb);
-    
-    Utf8String jsFunctionSource = data.scriptSource;
-
-    // Create a string containing the JavaScript source code.
-    Handle<String> source
-        = String::NewFromUtf8(this->isolate->isolate,
-                              jsFunctionSource.rawString().c_str());
+    context->Global()
+        ->Set(String::NewFromUtf8(threadIsolate->isolate,
+                                  "mldb"), mldb);
 
     TryCatch trycatch;
     //trycatch.SetVerbose(true);
 
-    // This is equivalent to fntocall = new Function('arg1', ..., 'script');
-    auto function
-        = this->context.Get(this->isolate->isolate)
-        ->Global()
-        ->Get(v8::String::NewFromUtf8(this->isolate->isolate, "Function"))
-        .As<v8::Object>();
-    
-    std::vector<v8::Handle<v8::Value> > argv;
-    for (unsigned i = 0;  i != data.params.size();  ++i)
-        argv.push_back(v8::String::NewFromUtf8(this->isolate->isolate,
-                                               data.params[i].c_str()));
-    argv.push_back(source);
+    Utf8String functionSource = data.functionSource();
 
-    v8::Local<v8::Function> compiled 
-        = function->CallAsConstructor(argv.size(), &argv[0])
-        .As<v8::Function>();
+    // If this thread has already compiled the script, it only needs to be
+    // bound to the new context
+    v8::Local<v8::UnboundScript> unbound;
+    if (auto entry = cache->get(functionSource)) {
+        unbound = entry->script.Get(threadIsolate->isolate);
+    }
+    else {
+        // Create a string containing the JavaScript source code.  This is
+        // equivalent to new Function('arg1', ..., 'script'), but compiling
+        // it as a script lets us use the code cache.
+        Handle<String> source
+            = String::NewFromUtf8(threadIsolate->isolate,
+                                  functionSource.rawData(),
+                                  String::kNormalString,
+                                  functionSource.rawLength());
+
+        // Another thread may already have compiled it; if so, load its
+        // code.  The cached data is owned by the cache entry, which we
+        // hold onto until the compilation is done.
+        std::shared_ptr<const std::string> cachedCode
+            = codeCache.get(functionSource);
+
+        ScriptCompiler::CachedData * cachedData = nullptr;
+        if (cachedCode) {
+            cachedData = new ScriptCompiler::CachedData
+                ((const uint8_t *)cachedCode->data(), cachedCode->size());
+        }
+        ScriptCompiler::Source scriptSource(source, cachedData);
+
+        unbound = ScriptCompiler::CompileUnbound
+            (threadIsolate->isolate, &scriptSource,
+             cachedCode
+             ? ScriptCompiler::kConsumeCodeCache
+             : ScriptCompiler::kProduceCodeCache);
+
+        if (!unbound.IsEmpty()) {
+            if (!cachedCode) {
+                const ScriptCompiler::CachedData * produced
+                    = scriptSource.GetCachedData();
+                if (produced && produced->data && produced->length > 0) {
+                    codeCache.put(functionSource,
+                                  std::string((const char *)produced->data,
+                                              produced->length));
+                }
+            }
+
+            cache->insert(functionSource)->script
+                .Reset(threadIsolate->isolate, unbound);
+        }
+    }
 
-    if (compiled.IsEmpty()) {  
+    v8::Local<v8::Value> compiled;
+    if (!unbound.IsEmpty())
+        compiled = unbound->BindToCurrentContext()->Run();
+
+    if (compiled.IsEmpty() || !compiled->IsFunction()) {
         auto rep = convertException(trycatch, "Compiling jseval script");
         MLDB_TRACE_EXCEPTIONS(false);
         throw AnnotatedException(400, "Exception compiling jseval script",
@@ -127,7 +373,12 @@ initialize(const JsFunctionData & data)
                                   "provenance", data.filenameForErrorMessages);
     }
 
-    this->function.Reset(this->isolate->isolate, compiled);
+    this->binding.reset(new JsThreadFunctionCache::Binding());
+    this->binding->context.Reset(threadIsolate->isolate, context);
+    this->binding->function.Reset(threadIsolate->isolate,
+                                  compiled.As<v8::Function>());
+    this->cache = cache;
+    this->isolate = threadIsolate;
 }
 
 ExpressionValue
@@ -144,15 +395,24 @@ run(const std::vector<ExpressionValue> & args,
 
     HandleScope handle_scope(this->isolate->isolate);
 
+    auto jsContext = this->binding->context.Get(this->isolate->isolate);
+
     // Enter the created context for compiling and
     // running the hello world script. 
-    Context::Scope context_scope(this->context.Get(this->isolate->isolate));
+    Context::Scope context_scope(jsContext);
 
     Date ts = Date::negativeInfinity();
 
     std::vector<v8::Handle<v8::Value> > argv;
     for (unsigned i = 2;  i < args.size();  ++i) {
-        if (args[i].isRow()) {
+        size_t paramNum = i - 2;
+        v8::Local<v8::Value> typedArray;
+        if (paramNum < data->typedArrayParams.size()
+            && data->typedArrayParams[paramNum]
+            && !(typedArray = embeddingToTypedArray(args[i])).IsEmpty()) {
+            argv.push_back(typedArray);
+        }
+        else if (args[i].isRow()) {
             RowValue row;
             args[i].appendToRow(Path(), row);
             argv.push_back(JS::toJS(row));
@@ -166,9 +426,8 @@ run(const std::vector<ExpressionValue> & args,
     TryCatch trycatch;
     //trycatch.SetVerbose(true);
 
-    auto result = this->function.Get(this->isolate->isolate)
-        ->Call(this->context.Get(this->isolate->isolate)->Global(),
-               argv.size(), &argv[0]);
+    auto result = this->binding->function.Get(this->isolate->isolate)
+        ->Call(jsContext->Global(), argv.size(), argv.data());
     
     if (result.IsEmpty()) {  
         auto rep = convertException(trycatch, "Running jseval script");
@@ -220,6 +479,33 @@ runJsFunction(const std::vector<ExpressionValue> & args,
     return threadData->run(args, context);
 }
 
+/** Plugin context used by jseval for an engine.  Creating one sets up a
+    new isolate and context, which is much more expensive than running a
+    typical jseval expression, so there is one per engine, attached to it
+    and shared between all bindings.
+*/
+struct JsEvalContext {
+    std::shared_ptr<JsPluginContext> context;
+};
+
+static std::shared_ptr<JsEvalContext>
+getJsEvalContext(const Utf8String & name, MldbEngine * engine)
+{
+    static const int attachmentKey = 0;
+
+    auto create = [&] () -> std::shared_ptr<void>
+        {
+            auto result = std::make_shared<JsEvalContext>();
+            result->context.reset
+                (new JsPluginContext(name, engine,
+                                     nullptr /* no plugin context */));
+            return result;
+        };
+
+    return std::static_pointer_cast<JsEvalContext>
+        (engine->getAttachment(&attachmentKey, create));
+}
+
 BoundFunction bindJsEval(const Utf8String & name,
                          const std::vector<BoundSqlExpression> & args,
                          const SqlBindingScope & context)
@@ -235,12 +521,21 @@ BoundFunction bindJsEval(const Utf8String & name,
     runner->engine = context.getMldbEngine();
     runner->scriptSource = scriptSource;
     runner->filenameForErrorMessages = "<<eval>>";
-    runner->context.reset(new JsPluginContext(name, runner->engine,
-                                              nullptr /* no plugin context */));
+    auto evalContext = getJsEvalContext(name, runner->engine);
+    runner->context = evalContext->context;
                           
     string params = args[1].constantValue().toString();
     boost::split(runner->params, params,
                  boost::is_any_of(","));
+
+    // Parameters named with a trailing [] take embeddings as typed arrays
+    for (auto & p: runner->params) {
+        boost::trim(p);
+        bool typedArray = boost::ends_with(p, "[]");
+        if (typedArray)
+            p.resize(p.size() - 2);
+        runner->typedArrayParams.push_back(typedArray);
+    }
     
     // 3.  We don't know what it returns; TODO: allow it to be specified
     auto info = std::make_shared<AnyValueInfo>();
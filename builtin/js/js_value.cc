@@ -134,22 +134,18 @@ void to_js_bool(JSValue & jsval, bool value)
 void to_js(JSValue & jsval, const std::string & value)
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    bool isAscii = true;
-    for (unsigned i = 0;  i < value.size() && isAscii;  ++i)
-        if (value[i] == 0 || value[i] > 127)
-            isAscii = false;
-    if (isAscii)
-        jsval = v8::String::NewFromUtf8(isolate, value.c_str());
-    else {
-        // Assume utf-8
-        jsval = v8::String::NewFromUtf8(isolate, value.c_str());
-    }
+    // Assume utf-8; passing the length avoids a strlen()
+    jsval = v8::String::NewFromUtf8(isolate, value.data(),
+                                    v8::String::kNormalString,
+                                    value.size());
 }
 
 void to_js(JSValue & jsval, const Utf8String & value)
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    jsval = v8::String::NewFromUtf8(isolate, value.rawData());
+    jsval = v8::String::NewFromUtf8(isolate, value.rawData(),
+                                    v8::String::kNormalString,
+                                    value.rawLength());
 }
 
 void to_js(JSValue & jsval, const char * value)
@@ -14,7 +14,9 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/engine/dataset_utils.h"
 #include "mldb/utils/log.h"
-#include <thread>
+#include "mldb/base/parallel.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/rest_request_binding.h"
 #include <sstream>
 
 
@@ -41,6 +43,31 @@ MergedDatasetConfigDescription()
 }
 
 
+/*****************************************************************************/
+/* MERGED DATASET STATUS                                                     */
+/*****************************************************************************/
+
+namespace {
+
+struct MergedDatasetStatus {
+    std::vector<Any> datasets;
+    std::vector<PolyConfigT<const Dataset> > appendedDatasets;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MergedDatasetStatus);
+
+DEFINE_STRUCTURE_DESCRIPTION_INLINE(MergedDatasetStatus)
+{
+    addField("datasets", &MergedDatasetStatus::datasets,
+             "Status of each of the merged datasets");
+    addField("appendedDatasets", &MergedDatasetStatus::appendedDatasets,
+             "Datasets added to the merge since it was created, which are "
+             "not part of its configuration");
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* MERGED INTERNAL REPRESENTATION                                            */
 /*****************************************************************************/
@@ -49,19 +76,31 @@ MergedDatasetConfigDescription()
 struct MergedDataset::Itl
     : public MatrixView, public ColumnIndex {
 
-    IdHashes rowIndex;
-    IdHashes columnIndex;
+    /// Row and column hashes, with the bitmap of the datasets that hold
+    /// each one.  Layered so that appends don't copy them.
+    LayeredIdHashes rowIndex;
+    LayeredIdHashes columnIndex;
 
     /// Datasets that it was constructed with
     std::vector<std::shared_ptr<Dataset> > datasetsIn;
 
-    /// Datasets that were actually merged.  There will be a maximum of 31
+    /// Datasets that were actually merged.  There will be a maximum of 32
     /// of them, as any more will be sub-merged
     std::vector<std::shared_ptr<Dataset> > datasets;
 
     /// Matrix view.  Length is the same as that of datasets.
     std::vector<std::shared_ptr<MatrixView> > matrices;
 
+    /// Internal representation of each of the datasets that is itself a
+    /// sub-merge, or null for those that were merged directly.  Length is
+    /// the same as that of datasets.  Used to route requests for only some
+    /// columns all the way down to the sources that contain them.
+    std::vector<std::shared_ptr<const Itl> > subMerges;
+
+    /// Configurations of the datasets appended since construction, for the
+    /// status.  Only set on the index of the MergedDataset itself.
+    std::vector<PolyConfigT<const Dataset> > appendedConfigs;
+
     shared_ptr<spdlog::logger> logger;
 
     Itl(MldbEngine * engine, std::vector<std::shared_ptr<Dataset> > datasets)
@@ -85,12 +124,24 @@ struct MergedDataset::Itl
         DEBUG_MSG(logger) << outputDatasets(datasets);
         DEBUG_MSG(logger) << "sorting datasets to merge from biggest to smallest";
 
-        std::sort(datasets.begin(), datasets.end(),
-                  [] (std::shared_ptr<Dataset> p1,
-                      std::shared_ptr<Dataset> p2)
-                  {
-                    return p1->getRowCount() > p2->getRowCount();
-                  });
+        // Counting rows can be expensive, so do it once per dataset and
+        // in parallel rather than on each comparison
+        std::vector<std::pair<size_t, std::shared_ptr<Dataset> > >
+            counted(datasets.size());
+        auto countRows = [&] (int i)
+            {
+                counted[i] = { datasets[i]->getRowCount(), datasets[i] };
+            };
+        parallelMap(0, datasets.size(), countRows);
+
+        std::stable_sort(counted.begin(), counted.end(),
+                         [] (const std::pair<size_t, std::shared_ptr<Dataset> > & p1,
+                             const std::pair<size_t, std::shared_ptr<Dataset> > & p2)
+                         {
+                             return p1.first > p2.first;
+                         });
+        for (size_t i = 0;  i < counted.size();  ++i)
+            datasets[i] = std::move(counted[i].second);
 
         DEBUG_MSG(logger) << outputDatasets(datasets);
         std::vector<std::shared_ptr<Dataset> > toMerge;
@@ -105,70 +156,52 @@ struct MergedDataset::Itl
 
         for (unsigned i = 0;  i < numDirect;  ++i) {
             toMerge.push_back(datasets[i]);
+            subMerges.push_back(nullptr);
         }
 
-        // The rest get broken down into groups of 31, pre-merged, and then added
+        // The rest get broken down into groups of 31, pre-merged, and then
+        // added.  The groups are independent so are merged in parallel.
+        std::vector<std::vector<std::shared_ptr<Dataset> > > groups;
         for (int current = numDirect;  current < datasets.size();  ) {
-            //cerr << "current = " << current << " toMerge.size() = "
-            //     << toMerge.size() << endl;
             vector<std::shared_ptr<Dataset> > subToMerge;
             for (; current < datasets.size() && subToMerge.size() < 31;  ++current) {
-                //cerr << "adding " << current << endl;
                 subToMerge.push_back(datasets[current]);
             }
-
-            //cerr << "merging " << subToMerge.size() << " files" << endl;
-
-            toMerge.push_back(std::make_shared<MergedDataset>(engine, subToMerge));
-            //cerr << "done merging " << subToMerge.size() << " files" << endl;
+            groups.emplace_back(std::move(subToMerge));
         }
 
-        ExcAssertLessEqual(toMerge.size(), 32);
-    
-        auto getRowHashes = [&] (int datasetIndex)
+        std::vector<std::shared_ptr<MergedDataset> > merged(groups.size());
+        auto mergeGroup = [&] (int i)
             {
-                auto dataset = toMerge[datasetIndex];
-                MergeHashEntries result;
-                vector<RowHash> rows = dataset->getMatrixView()->getRowHashes();
-                std::sort(rows.begin(), rows.end());
-                ExcAssert(std::unique(rows.begin(), rows.end()) == rows.end());
-
-                result.reserve(rows.size());
-                for (auto r: rows)
-                    result.add(r.hash(), 1ULL << datasetIndex);
-                return result;
+                merged[i] = std::make_shared<MergedDataset>(engine, groups[i]);
             };
+        parallelMap(0, groups.size(), mergeGroup);
 
-        auto getColumnHashes = [&] (int datasetIndex)
-            {
-                auto dataset = toMerge[datasetIndex];
-                MergeHashEntries result;
-                vector<ColumnPath> cols = dataset->getMatrixView()->getColumnPaths();
-                std::sort(cols.begin(), cols.end());
-                ExcAssert(std::unique(cols.begin(), cols.end()) == cols.end());
-                result.reserve(cols.size());
-                for (auto c: cols)
-                    result.add(c.hash(), 1ULL << datasetIndex);
-                return result;
-            };
+        for (auto & m: merged) {
+            subMerges.push_back(m->itl);
+            toMerge.emplace_back(std::move(m));
+        }
 
-        auto initRowBucket = [&] (int i, MergeHashEntryBucket & b)
-            {
-                auto & b2 = rowIndex.buckets[i];
+        ExcAssertLessEqual(toMerge.size(), 32);
 
-                b2.reserve(b.size());
+        // 2.  Extract the row and column hashes of every dataset in
+        //     parallel, and then merge them bucket by bucket.
+        size_t n = toMerge.size();
+        std::vector<MergeHashEntries> rowEntries(n), columnEntries(n);
 
-                for (auto & e: b) {
-                    uint64_t h = e.hash;
-                    uint32_t bm = e.bitmap;
-                    b2.insert(make_pair(h, bm));
-                }
+        auto extract = [&] (int i)
+            {
+                if (i < n)
+                    rowEntries[i] = getRowHashEntries(*toMerge[i], i);
+                else columnEntries[i - n]
+                         = getColumnHashEntries(*toMerge[i - n], i - n);
             };
 
-        auto initColumnBucket = [&] (int i, MergeHashEntryBucket & b)
-            {
-                auto & b2 = columnIndex.buckets[i];
+        DEBUG_MSG(logger) << "extracting hashes of columns and rows";
+        parallelMap(0, 2 * n, extract);
 
+        auto initBucket = [] (IdHash & b2, MergeHashEntryBucket & b)
+            {
                 b2.reserve(b.size());
 
                 for (auto & e: b) {
@@ -178,12 +211,23 @@ struct MergedDataset::Itl
                 }
             };
 
-        std::thread mergeColumns([&] () { extractAndMerge(toMerge.size(), getColumnHashes, initColumnBucket); });
-        std::thread mergeRows([&] () { extractAndMerge(toMerge.size(), getRowHashes, initRowBucket); });
-
         DEBUG_MSG(logger) << "merging columns and rows";
-        mergeColumns.join();
-        mergeRows.join();
+        auto rows = std::make_shared<IdHashes>();
+        auto columns = std::make_shared<IdHashes>();
+        extractAndMerge(n,
+                        [&] (int i) { return std::move(rowEntries[i]); },
+                        [&] (int i, MergeHashEntryBucket & b)
+                        {
+                            initBucket(rows->buckets[i], b);
+                        });
+        extractAndMerge(n,
+                        [&] (int i) { return std::move(columnEntries[i]); },
+                        [&] (int i, MergeHashEntryBucket & b)
+                        {
+                            initBucket(columns->buckets[i], b);
+                        });
+        rowIndex.reset(std::move(rows));
+        columnIndex.reset(std::move(columns));
 
         this->datasetsIn = std::move(datasets);
         this->datasets = std::move(toMerge);
@@ -196,9 +240,169 @@ struct MergedDataset::Itl
                           << this->getColumnPaths(0, -1).size() << " columns";
     }
 
+    /** Copy of the index of another merge, used as the starting point of
+        an append.  The underlying datasets and the layers of the row and
+        column indexes are shared, not copied. */
+    Itl(const Itl & other)
+        : rowIndex(other.rowIndex),
+          columnIndex(other.columnIndex),
+          datasetsIn(other.datasetsIn),
+          datasets(other.datasets),
+          matrices(other.matrices),
+          subMerges(other.subMerges),
+          appendedConfigs(other.appendedConfigs),
+          logger(other.logger)
+    {
+    }
+
+    static MergeHashEntries
+    getRowHashEntries(const Dataset & dataset, int datasetIndex)
+    {
+        MergeHashEntries result;
+        vector<RowHash> rows = dataset.getMatrixView()->getRowHashes();
+        std::sort(rows.begin(), rows.end());
+        ExcAssert(std::unique(rows.begin(), rows.end()) == rows.end());
+
+        result.reserve(rows.size());
+        for (auto r: rows)
+            result.add(r.hash(), 1ULL << datasetIndex);
+        return result;
+    }
+
+    static MergeHashEntries
+    getColumnHashEntries(const Dataset & dataset, int datasetIndex)
+    {
+        MergeHashEntries result;
+        vector<ColumnPath> cols = dataset.getMatrixView()->getColumnPaths();
+        std::sort(cols.begin(), cols.end());
+        ExcAssert(std::unique(cols.begin(), cols.end()) == cols.end());
+        result.reserve(cols.size());
+        for (auto c: cols)
+            result.add(c.hash(), 1ULL << datasetIndex);
+        return result;
+    }
+
+    /** Can another dataset be appended without rebuilding the tree? */
+    bool hasRoom() const
+    {
+        if (datasets.size() < 32)
+            return true;
+        for (auto & s: subMerges) {
+            if (s && s->hasRoom())
+                return true;
+        }
+        return false;
+    }
+
+    /** Return a new index with the given dataset merged in.  The dataset
+        takes a free slot if there is one, or else goes into the last
+        sub-merge with room, so only the indexes along that path are
+        extended, by a layer holding the new dataset's hashes; the other
+        datasets aren't read again.  When the tree is full, it is rebuilt.
+    */
+    std::shared_ptr<Itl>
+    append(MldbEngine * engine, std::shared_ptr<Dataset> dataset) const
+    {
+        if (!hasRoom()) {
+            std::vector<std::shared_ptr<Dataset> > all = datasetsIn;
+            all.emplace_back(std::move(dataset));
+            return std::make_shared<Itl>(engine, std::move(all));
+        }
+
+        auto result = std::make_shared<Itl>(*this);
+        result->datasetsIn.push_back(dataset);
+
+        int bit = -1;
+        if (datasets.size() < 32) {
+            bit = datasets.size();
+            result->datasets.push_back(dataset);
+            result->matrices.push_back(dataset->getMatrixView());
+            result->subMerges.push_back(nullptr);
+        }
+        else {
+            for (int i = datasets.size() - 1;  i >= 0 && bit == -1;  --i) {
+                if (subMerges[i] && subMerges[i]->hasRoom())
+                    bit = i;
+            }
+            ExcAssertNotEqual(bit, -1);
+
+            auto sub = subMerges[bit]->append(engine, dataset);
+            result->datasets[bit].reset(new MergedDataset(engine, sub));
+            result->matrices[bit] = sub;
+            result->subMerges[bit] = sub;
+        }
+
+        uint32_t mask = 1U << bit;
+        auto matrix = dataset->getMatrixView();
+        std::vector<uint64_t> hashes;
+        for (auto & r: matrix->getRowHashes())
+            hashes.push_back(r.hash());
+        result->rowIndex.add(hashes, mask);
+        hashes.clear();
+        for (auto & c: matrix->getColumnPaths())
+            hashes.push_back(c.hash());
+        result->columnIndex.add(hashes, mask);
+
+        return result;
+    }
+
+    /** Which of the merged datasets (and recursively, which of the
+        datasets within each sub-merge) contain at least one of a set of
+        columns.  Calculated once for a set of columns and then used to
+        read each row from only those datasets.
+    */
+    struct ColumnRoute {
+        uint32_t bitmap = 0;
+        std::vector<ColumnRoute> subRoutes;
+    };
+
+    ColumnRoute routeColumns(const std::vector<ColumnPath> & columnNames) const
+    {
+        ColumnRoute result;
+        for (auto & c: columnNames)
+            result.bitmap |= getColumnBitmap(c);
+
+        result.subRoutes.resize(datasets.size());
+        for (size_t i = 0;  i < datasets.size();  ++i) {
+            if (subMerges[i] && (result.bitmap & (1U << i)))
+                result.subRoutes[i] = subMerges[i]->routeColumns(columnNames);
+        }
+        return result;
+    }
+
+    /** Return the parts of the given row held by the datasets on the
+        given route.  Columns outside of those on the route may also be
+        returned.
+    */
+    MatrixNamedRow getRoutedRow(const RowPath & rowName,
+                                const ColumnRoute & route) const
+    {
+        MatrixNamedRow result;
+        result.rowName = rowName;
+        result.rowHash = rowName;
+
+        uint32_t bitmap = getRowBitmap(rowName) & route.bitmap;
+        while (bitmap) {
+            int bit = MLDB::lowest_bit(bitmap, -1);
+            bitmap = bitmap & ~(1U << bit);
+
+            MatrixNamedRow row
+                = subMerges[bit]
+                ? subMerges[bit]->getRoutedRow(rowName, route.subRoutes[bit])
+                : matrices[bit]->getRow(rowName);
+
+            result.columns.insert(result.columns.end(),
+                                  std::make_move_iterator(row.columns.begin()),
+                                  std::make_move_iterator(row.columns.end()));
+        }
+
+        return result;
+    }
+
     struct MergedRowStream : public RowStream {
 
-        MergedRowStream(const MergedDataset::Itl* source) : source(source)
+        MergedRowStream(std::shared_ptr<const MergedDataset::Itl> source)
+            : source(std::move(source))
         {            
         }
 
@@ -248,6 +452,9 @@ struct MergedDataset::Itl
             for (size_t i = 0;  i < columnNames.size();  ++i) {
                 pathToPosition[columnNames[i]] = i;
             }
+
+            // Only the datasets that have one of the columns are read
+            auto route = source->routeColumns(columnNames);
             
             std::vector<std::vector<int> > outputPositions
                 (source->datasets.size());
@@ -255,6 +462,11 @@ struct MergedDataset::Itl
                 (source->datasets.size());
 
             for (size_t i = 0;  i < source->datasets.size();  ++i) {
+                // Sub-merges only return the routed part of each row, so
+                // positions can't be used for them
+                if (!(route.bitmap & (1U << i)) || source->subMerges[i])
+                    continue;
+
                 // For this dataset, find a linear mapping between the
                 // input column position and the output it gives.
                 const Dataset & d = *source->datasets[i];
@@ -298,7 +510,7 @@ struct MergedDataset::Itl
             }
 
             while (numValues--) {
-                uint32_t bitmap = (*it).second;
+                uint32_t bitmap = (*it).second & route.bitmap;
                 
                 RowPath storage;
                 const RowPath & rowName = this->rowName(storage);
@@ -308,7 +520,10 @@ struct MergedDataset::Itl
                     bitmap = bitmap & ~(1 << bit);
 
                     MatrixNamedRow row
-                        = source->datasets[bit]->getMatrixView()->getRow(rowName);
+                        = source->subMerges[bit]
+                        ? source->subMerges[bit]->getRoutedRow
+                              (rowName, route.subRoutes[bit])
+                        : source->matrices[bit]->getRow(rowName);
                     
                     if (!outputPositions[bit].empty()) {
                         ExcAssertEqual(row.columns.size(),
@@ -335,8 +550,8 @@ struct MergedDataset::Itl
             }
         }
 
-        const MergedDataset::Itl* source;
-        IdHashes::const_iterator it;
+        std::shared_ptr<const MergedDataset::Itl> source;
+        LayeredIdHashes::const_iterator it;
 
     };
        
@@ -658,6 +873,8 @@ MergedDataset(MldbEngine * owner,
     }
 
     itl.reset(new Itl(engine, datasets));
+    datasetConfig = std::move(mergeConfig);
+    initRoutes();
 }
 
 MergedDataset::
@@ -666,6 +883,14 @@ MergedDataset(MldbEngine * owner,
     : Dataset(owner)
 {
     itl.reset(new Itl(engine, datasetsToMerge));
+    initRoutes();
+}
+
+MergedDataset::
+MergedDataset(MldbEngine * owner, std::shared_ptr<Itl> itl)
+    : Dataset(owner), itl(std::move(itl))
+{
+    initRoutes();
 }
 
 MergedDataset::
@@ -673,13 +898,81 @@ MergedDataset::
 {
 }
 
+void
+MergedDataset::
+initRoutes()
+{
+    router = std::make_shared<RestRequestRouter>();
+    addRouteSyncJsonReturn(*router, "/datasets", {"POST"},
+                           "Add a dataset to the merge",
+                           "Status of the merged datasets",
+                           &MergedDataset::appendConfig,
+                           this,
+                           JsonParam<PolyConfigT<const Dataset> >
+                           ("dataset", "Dataset to add to the merge"));
+}
+
+std::shared_ptr<MergedDataset::Itl>
+MergedDataset::
+current() const
+{
+    return std::atomic_load(&itl);
+}
+
+void
+MergedDataset::
+append(std::shared_ptr<Dataset> dataset)
+{
+    if (!dataset)
+        throw MLDB::Exception("Attempt to append a null dataset to a merge");
+
+    // Datasets without an id (such as those created inside of a query)
+    // can't be referred to from the status
+    auto config = dataset->getConfigPtr();
+    if (config && !config->id.empty()) {
+        PolyConfigT<const Dataset> ref;
+        ref.id = config->id;
+        append(std::move(dataset), &ref);
+    }
+    else append(std::move(dataset), nullptr);
+}
+
+void
+MergedDataset::
+append(std::shared_ptr<Dataset> dataset,
+       const PolyConfigT<const Dataset> * config)
+{
+    std::unique_lock<std::mutex> guard(appendMutex);
+    auto oldItl = current();
+    std::shared_ptr<Itl> newItl = oldItl->append(engine, std::move(dataset));
+
+    // The configuration stays as it was constructed; the appended datasets
+    // are reported in the status instead.  The new index isn't visible to
+    // anyone else yet, so it can be modified.
+    newItl->appendedConfigs = oldItl->appendedConfigs;
+    if (config)
+        newItl->appendedConfigs.push_back(*config);
+
+    std::atomic_store(&itl, std::move(newItl));
+}
+
+Any
+MergedDataset::
+appendConfig(const PolyConfigT<const Dataset> & dataset)
+{
+    append(obtainDataset(engine, dataset, nullptr /*onProgress*/), &dataset);
+    return getStatus();
+}
+
 Any
 MergedDataset::
 getStatus() const
 {
-    std::vector<Any> result;
-    for (auto & d: itl->datasets)
-        result.emplace_back(d->getStatus());
+    auto current = this->current();
+    MergedDatasetStatus result;
+    for (auto & d: current->datasets)
+        result.datasets.emplace_back(d->getStatus());
+    result.appendedDatasets = current->appendedConfigs;
     return result;
 }
 
@@ -687,28 +980,37 @@ std::pair<Date, Date>
 MergedDataset::
 getTimestampRange() const
 {
-    return itl->getTimestampRange();
+    return current()->getTimestampRange();
 }
 
 std::shared_ptr<MatrixView>
 MergedDataset::
 getMatrixView() const
 {
-    return itl;
+    return current();
 }
 
 std::shared_ptr<ColumnIndex>
 MergedDataset::
 getColumnIndex() const
 {
-    return itl;
+    return current();
 }
 
 std::shared_ptr<RowStream> 
 MergedDataset::
 getRowStream() const
 {
-    return make_shared<MergedDataset::Itl::MergedRowStream>(itl.get());
+    return make_shared<MergedDataset::Itl::MergedRowStream>(current());
+}
+
+RestRequestMatchResult
+MergedDataset::
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
+{
+    return router->processRequest(connection, request, context);
 }
 
 static RegisterDatasetType<MergedDataset, MergedDatasetConfig> 
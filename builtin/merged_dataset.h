@@ -14,6 +14,8 @@
 
 #include "mldb/core/dataset.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/rest/rest_request_fwd.h"
+#include <mutex>
 
 
 namespace MLDB {
@@ -46,6 +48,14 @@ struct MergedDataset: public Dataset {
 
     virtual ~MergedDataset();
 
+    /** Add another dataset to the merge.  Only the row and column names of
+        the new dataset are read; the existing index is extended rather than
+        being rebuilt from all of the datasets.  Queries that are already
+        running continue to see the merge as it was before.  If the dataset
+        has an id, it's listed in the appended datasets of the status.
+    */
+    void append(std::shared_ptr<Dataset> dataset);
+
     virtual Any getStatus() const;
     virtual void recordRowItl(const RowPath & rowName,
           const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
@@ -59,10 +69,33 @@ struct MergedDataset: public Dataset {
 
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const;
+
 private:
     MergedDatasetConfig datasetConfig;
     struct Itl;
+
+    /// Constructor used internally to wrap an already built index
+    MergedDataset(MldbEngine * owner, std::shared_ptr<Itl> itl);
+
+    /// Current index.  This is replaced (never modified) on append, so it
+    /// must be accessed via current().
     std::shared_ptr<Itl> itl;
+    std::shared_ptr<Itl> current() const;
+
+    /// Serializes appends against each other
+    std::mutex appendMutex;
+
+    /// Append the dataset, and list config in the status unless it's null
+    void append(std::shared_ptr<Dataset> dataset,
+                const PolyConfigT<const Dataset> * config);
+
+    std::shared_ptr<RestRequestRouter> router;
+    void initRoutes();
+    Any appendConfig(const PolyConfigT<const Dataset> & dataset);
 };
 
 } // namespace MLDB
@@ -14,6 +14,10 @@
 #include "mldb/utils/string_functions.h"
 #include "mldb/utils/profile.h"
 #include "mldb/utils/distribution.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include <atomic>
+#include <unordered_map>
 
 using namespace std;
 
@@ -103,6 +107,141 @@ PoolingFunction(MldbEngine * owner,
     columnNames = boundEmbeddingDataset.dataset->getRowInfo()->allColumnNames();
 }
 
+
+/*****************************************************************************/
+/* POOLING EMBEDDING INDEX                                                   */
+/*****************************************************************************/
+
+/** In-memory copy of the embedding dataset, used to pool directly instead
+    of running the SQL query for each row.  Rows are looked up by the
+    string that rowName() returns, which is what the query matches against
+    the keys of the words, and their coordinates are stored contiguously in
+    the order of the function's columnNames.
+
+    Only dense embeddings with one numeric value per cell and a single
+    timestamp per row can be pooled this way, as those are the ones for
+    which the result is the same as the query's (up to single precision,
+    which is what embedding datasets store anyway); for anything else,
+    usable is false and the query is used.
+
+    The copy is tied to the generation of the dataset it was made from, so
+    that it is rebuilt whenever the dataset's contents change.
+*/
+struct PoolingEmbeddingIndex {
+    // What the index was built from, to know when it needs a refresh
+    const Dataset * dataset = nullptr;
+    int64_t generation = -1;
+
+    bool usable = false;
+    size_t numColumns = 0;
+    std::unordered_map<Utf8String, uint32_t> rowIndex;
+    std::vector<float> values;  ///< numRows x numColumns, row major
+    std::vector<Date> rowTimestamps;
+
+    const float * row(uint32_t i) const
+    {
+        return values.data() + (size_t)i * numColumns;
+    }
+
+    bool matches(const Dataset * dataset, int64_t generation) const
+    {
+        return this->dataset == dataset
+            && this->generation == generation;
+    }
+
+    /** Fill in the index from the given dataset.  Returns false if the
+        dataset can't be represented exactly.
+    */
+    bool load(const Dataset & dataset,
+              const std::vector<ColumnPath> & columnNames)
+    {
+        auto matrix = dataset.getMatrixView();
+        numColumns = columnNames.size();
+        if (numColumns == 0)
+            return false;
+
+        std::unordered_map<ColumnPath, uint32_t> columnIndex;
+        for (uint32_t i = 0;  i < numColumns;  ++i)
+            columnIndex[columnNames[i]] = i;
+
+        std::vector<RowPath> rowPaths = matrix->getRowPaths();
+        values.resize(rowPaths.size() * numColumns);
+        rowTimestamps.resize(rowPaths.size());
+
+        auto onRow = [&] (size_t i) -> bool
+            {
+                MatrixNamedRow row = matrix->getRow(rowPaths[i]);
+                if (row.columns.size() != numColumns)
+                    return false;
+
+                float * out = values.data() + i * numColumns;
+                std::vector<bool> seen(numColumns, false);
+                Date ts = std::get<2>(row.columns.front());
+
+                for (auto & c: row.columns) {
+                    auto it = columnIndex.find(std::get<0>(c));
+                    if (it == columnIndex.end() || seen[it->second])
+                        return false;
+                    const CellValue & val = std::get<1>(c);
+                    if (!val.isNumber() || std::isnan(val.toDouble()))
+                        return false;
+                    if (std::get<2>(c) != ts)
+                        return false;
+                    seen[it->second] = true;
+                    out[it->second] = val.toDouble();
+                }
+
+                rowTimestamps[i] = ts;
+                return true;
+            };
+
+        if (!parallelMapHaltable(0, rowPaths.size(), onRow))
+            return false;
+
+        rowIndex.reserve(rowPaths.size());
+        for (uint32_t i = 0;  i < rowPaths.size();  ++i)
+            rowIndex.emplace(rowPaths[i].toUtf8String(), i);
+
+        return true;
+    }
+};
+
+std::shared_ptr<const PoolingEmbeddingIndex>
+PoolingFunction::
+getIndex() const
+{
+    const Dataset * dataset = boundEmbeddingDataset.dataset.get();
+
+    // Read before the contents, so that a change made while we load is
+    // picked up by the next call
+    int64_t generation = dataset->getGeneration();
+
+    std::unique_lock<std::mutex> guard(indexMutex);
+
+    // Without a generation there is no way to tell that a copy is stale
+    if (generation == -1) {
+        index.reset();
+        return nullptr;
+    }
+
+    if (!index || !index->matches(dataset, generation)) {
+        auto newIndex = std::make_shared<PoolingEmbeddingIndex>();
+        newIndex->dataset = dataset;
+        newIndex->generation = generation;
+        newIndex->usable = newIndex->load(*dataset, columnNames);
+        if (!newIndex->usable) {
+            // Don't keep the partially loaded values around
+            newIndex->values.clear();
+            newIndex->values.shrink_to_fit();
+            newIndex->rowTimestamps.clear();
+            newIndex->rowIndex.clear();
+        }
+        index = std::move(newIndex);
+    }
+
+    return index->usable ? index : nullptr;
+}
+
 struct PoolingFunctionApplier: public FunctionApplierT<PoolingInput, PoolingOutput> {
     PoolingFunctionApplier(const PoolingFunction * owner,
                            SqlBindingScope & outerContext,
@@ -115,6 +254,126 @@ struct PoolingFunctionApplier: public FunctionApplierT<PoolingInput, PoolingOutp
     std::unique_ptr<FunctionApplier> queryApplier;
 };
 
+namespace {
+
+// Written so that they are vectorized by the compiler, like those in
+// arch/simd_vector.cc
+void vec_min(const float * x, float * r, size_t n)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = x[i] < r[i] ? x[i] : r[i];
+}
+
+void vec_max(const float * x, float * r, size_t n)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = x[i] > r[i] ? x[i] : r[i];
+}
+
+/** Timestamp of the output of the min or max aggregator, which takes the
+    earliest timestamp of the rows holding the extreme value of each column
+    and the latest of those over the columns.
+*/
+Date extremeTimestamp(const PoolingEmbeddingIndex & index,
+                      const std::vector<uint32_t> & rows,
+                      const float * extreme)
+{
+    Date result = Date::negativeInfinity();
+    for (size_t j = 0;  j < index.numColumns;  ++j) {
+        Date ts = Date::positiveInfinity();
+        for (uint32_t r: rows) {
+            if (index.row(r)[j] == extreme[j])
+                ts.setMin(index.rowTimestamps[r]);
+        }
+        result.setMax(ts);
+    }
+    return result;
+}
+
+} // file scope
+
+PoolingOutput
+PoolingFunction::
+applyNative(const PoolingEmbeddingIndex & index,
+            PoolingInput input) const
+{
+    size_t n = index.numColumns;
+    size_t num_embed_cols = n * functionConfig.aggregators.size();
+
+    Date outputTs = input.words.getEffectiveTimestamp();
+
+    // Rows of the embedding named by a key of the words, each one once
+    std::vector<uint32_t> rows;
+    if (input.words.isRow()) {
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & val)
+            {
+                auto it = index.rowIndex.find(columnName.toUtf8String());
+                if (it != index.rowIndex.end())
+                    rows.push_back(it->second);
+                return true;
+            };
+        input.words.forEachColumn(onColumn);
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    }
+
+    std::vector<double> outputEmbedding;
+    outputEmbedding.reserve(num_embed_cols);
+
+    if (rows.empty()) {
+        // Same as an empty query output in applyT()
+        outputEmbedding.resize(num_embed_cols, 0.0);
+        return {ExpressionValue(std::move(outputEmbedding), outputTs)};
+    }
+
+    Date earliest = Date::positiveInfinity(), latest = Date::negativeInfinity();
+    for (uint32_t r: rows) {
+        earliest.setMin(index.rowTimestamps[r]);
+        latest.setMax(index.rowTimestamps[r]);
+    }
+
+    std::vector<double> total;
+    std::vector<float> extreme;
+
+    for (auto & agg: functionConfig.aggregators) {
+        if (agg == "sum" || agg == "avg") {
+            if (total.empty()) {
+                total.resize(n, 0.0);
+                for (uint32_t r: rows)
+                    SIMD::vec_add(total.data(), index.row(r), total.data(), n);
+            }
+            if (agg == "sum") {
+                outputEmbedding.insert(outputEmbedding.end(),
+                                       total.begin(), total.end());
+            }
+            else {
+                for (double v: total)
+                    outputEmbedding.push_back(v / rows.size());
+            }
+            outputTs.setMax(latest);
+        }
+        else {
+            const float * first = index.row(rows[0]);
+            extreme.assign(first, first + n);
+            for (size_t i = 1;  i < rows.size();  ++i) {
+                if (agg == "min")
+                    vec_min(index.row(rows[i]), extreme.data(), n);
+                else vec_max(index.row(rows[i]), extreme.data(), n);
+            }
+            outputEmbedding.insert(outputEmbedding.end(),
+                                   extreme.begin(), extreme.end());
+            if (earliest == latest)
+                outputTs.setMax(latest);
+            else outputTs.setMax(extremeTimestamp(index, rows, extreme.data()));
+        }
+    }
+
+    ExcAssertEqual(outputEmbedding.size(), num_embed_cols);
+
+    return {ExpressionValue(std::move(outputEmbedding), outputTs)};
+}
+
 PoolingOutput 
 PoolingFunction::
 applyT(const ApplierT & applier_, PoolingInput input) const
@@ -123,6 +382,12 @@ applyT(const ApplierT & applier_, PoolingInput input) const
 
     auto & applier = static_cast<const PoolingFunctionApplier &>(applier_);
 
+    // Looked up on each call rather than when bound, as appliers are kept
+    // around and the embedding may have changed since
+    auto index = getIndex();
+    if (index)
+        return applyNative(*index, std::move(input));
+
     size_t num_embed_cols = columnNames.size() * functionConfig.aggregators.size();
 
     Date outputTs = input.words.getEffectiveTimestamp();
@@ -136,7 +401,10 @@ applyT(const ApplierT & applier_, PoolingInput input) const
     outputEmbedding.reserve(num_embed_cols);
 
     if (queryOutput.empty()) {
-        outputEmbedding.resize(num_embed_cols, 0.0);  // TODO: should be NaN?
+        // None of the words are in the embedding.  The aggregators have
+        // nothing to work on, so the pooled embedding is all zeros rather
+        // than missing values, which keeps it usable as a feature vector.
+        outputEmbedding.resize(num_embed_cols, 0.0);
     }
     else {
         for (auto & agg: functionConfig.aggregators) {
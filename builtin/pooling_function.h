@@ -12,6 +12,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/optional.h"
 #include "mldb/builtin/sql_functions.h"
+#include <mutex>
 
 
 namespace MLDB {
@@ -50,6 +51,8 @@ struct PoolingOutput {
 
 DECLARE_STRUCTURE_DESCRIPTION(PoolingOutput);
 
+struct PoolingEmbeddingIndex;
+
 struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     PoolingFunction(MldbEngine * owner,
                    PolyConfig config,
@@ -71,6 +74,22 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     std::vector<ColumnPath> columnNames;
 
     SelectExpression select;
+
+    /** Return the in-memory copy of the embedding used to pool without
+        going through SQL, building or rebuilding it if the embedding
+        dataset has changed since the last call.  Returns null if the
+        embedding can't be pooled natively, in which case the SQL query is
+        used instead.
+    */
+    std::shared_ptr<const PoolingEmbeddingIndex> getIndex() const;
+
+private:
+    /// Pool using the in-memory embedding rather than the SQL query
+    PoolingOutput applyNative(const PoolingEmbeddingIndex & index,
+                              PoolingInput input) const;
+
+    mutable std::mutex indexMutex;
+    mutable std::shared_ptr<const PoolingEmbeddingIndex> index;
 };
 
 } // namespace MLDB
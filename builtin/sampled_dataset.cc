@@ -9,8 +9,15 @@
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/types/annotated_exception.h"
+#include "mldb/base/parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <queue>
 #include <random>
 #include <unordered_set>
 
@@ -27,9 +34,40 @@ namespace MLDB {
 
 std::random_device rd;
 
+DEFINE_ENUM_DESCRIPTION(SamplingMethod);
+
+SamplingMethodDescription::
+SamplingMethodDescription()
+{
+    addValue("indexed", SAMPLING_INDEXED,
+             "Pick rows at random from the full list of rows of the "
+             "dataset.  This gives an exact uniform sample, and is the only "
+             "method that supports sampling with replacement, but it needs "
+             "the names of all rows in memory.");
+    addValue("reservoir", SAMPLING_RESERVOIR,
+             "Stream through the rows of the dataset, keeping the requested "
+             "number of rows with the lowest pseudo-random priority.  This "
+             "gives an exact uniform sample without replacement, keeping "
+             "only the sampled rows in memory.");
+    addValue("bernoulli", SAMPLING_BERNOULLI,
+             "Stream through the rows of the dataset, keeping each row "
+             "independently if the hash of its name is under a threshold. "
+             "The number of rows in the sample is only approximately the "
+             "requested number, but the same rows are kept for the same "
+             "seed even as other rows are added to the dataset.");
+    addValue("block", SAMPLING_BLOCK,
+             "Keep whole blocks of consecutive rows, reading only the rows "
+             "of the blocks that are kept.  The blocks are the natural "
+             "chunks of the dataset (for example those of a tabular "
+             "dataset), or blocks of `blockRows` rows.  This is the fastest "
+             "method, but rows in a block are correlated, so it's only "
+             "suitable for approximate analytics.");
+}
+
 SampledDatasetConfig::
 SampledDatasetConfig() :
-        rows(0), fraction(0), withReplacement(false)
+        rows(0), fraction(0), withReplacement(false),
+        sampling(SAMPLING_INDEXED), blockRows(0)
 {
     seed = rd();
 }
@@ -53,6 +91,10 @@ void validateConfig(SampledDatasetConfig * config)
         throw MLDB::Exception(SampledDataset::getErrorMsg(MLDB::format("The 'fraction' parameter needs to "
                     "be between 0 and 1. Value provided is '%0.4f'", config->fraction)));
     }
+    if (config->withReplacement && config->sampling != SAMPLING_INDEXED) {
+        throw MLDB::Exception(SampledDataset::getErrorMsg("Only the 'indexed' "
+                    "sampling method can sample with replacement."));
+    }
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(SampledDatasetConfig);
@@ -80,6 +122,16 @@ SampledDatasetConfigDescription()
               "this parameter is to permit reproducible random samples. "
               "This parameter is optional, with the default value being "
               "selected randomly for each sample.");
+    addField("sampling", &SampledDatasetConfig::sampling,
+             "Method used to choose the rows of the sample.  The methods "
+             "other than `indexed` stream through the rows of the dataset, "
+             "over multiple threads, and only keep the sampled rows in "
+             "memory.", SAMPLING_INDEXED);
+    addField("blockRows", &SampledDatasetConfig::blockRows,
+             "Number of rows in each block for the `block` sampling method, "
+             "and in each part of the dataset that is streamed in parallel "
+             "for the other streaming methods.  The default of 0 uses the "
+             "natural chunks of the dataset where it has them.", unsigned(0));
 
     onPostValidate = [] (SampledDatasetConfig * config,
                          JsonParsingContext & context)
@@ -114,6 +166,16 @@ struct SampledDataset::Itl
           matrix(dataset->getMatrixView()),
           index(dataset->getColumnIndex()),
           columnCount(matrix->getColumnPaths().size())
+    {
+        if (config.sampling == SAMPLING_INDEXED)
+            sampleIndexed(config);
+        else sampleStreaming(config);
+
+        for (auto & rowName: sampledRows)
+            sampledRowsIndex.insert(rowName);
+    }
+
+    void sampleIndexed(const SampledDatasetConfig & config)
     {
         // get all existing rows
         auto rows = matrix->getRowHashes();
@@ -146,10 +208,270 @@ struct SampledDataset::Itl
             }
 
             sampledRowsHash.emplace_back(rows[sample_index]);
+            sampledRows.emplace_back(matrix->getRowPath(rows[sample_index]));
+        }
+    }
 
-            auto rowName = matrix->getRowPath(rows[sample_index]);
-            sampledRows.emplace_back(rowName);
-            sampledRowsIndex.insert(rowName);
+    /** Pseudo-random 64 bit value for the given value and seed, used as
+        a sampling priority.  Deterministic so that the sample doesn't
+        depend on how the rows are split between threads.
+    */
+    static uint64_t samplingHash(uint64_t seed, uint64_t value)
+    {
+        // splitmix64 finalizer
+        uint64_t z = value + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /** Return the hash under which a value is kept with the probability
+        fraction.
+    */
+    static uint64_t samplingThreshold(double fraction)
+    {
+        if (fraction >= 1.0)
+            return std::numeric_limits<uint64_t>::max();
+        return fraction * 18446744073709551616.0;  // 2^64
+    }
+
+    /** Contiguous parts of the rows of the dataset, which are read in
+        parallel.
+    */
+    struct Partitions {
+        std::vector<size_t> offsets;  ///< Start of each part, plus the end
+        std::shared_ptr<RowStream> stream;
+        std::vector<std::shared_ptr<RowStream> > streams;  ///< If natural
+        std::vector<RowPath> rows;    ///< If the dataset can't stream
+
+        size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        /// Call onRow(rowNum, rowName) for each row of the given part
+        template<typename Fn>
+        void scan(size_t part, Fn && onRow) const
+        {
+            size_t begin = offsets[part], end = offsets[part + 1];
+            if (begin == end)
+                return;
+            if (!stream) {
+                for (size_t i = begin;  i < end;  ++i)
+                    onRow(i, rows[i]);
+                return;
+            }
+
+            std::shared_ptr<RowStream> partStream;
+            if (!streams.empty())
+                partStream = streams[part];
+            else {
+                partStream = stream->clone();
+                partStream->initAt(begin);
+            }
+            for (size_t i = begin;  i < end;  ++i)
+                onRow(i, partStream->next());
+        }
+    };
+
+    Partitions getPartitions(size_t blockRows) const
+    {
+        Partitions result;
+
+        size_t numRows = matrix->getRowCount();
+        if (numRows == 0)
+            return result;
+
+        result.stream = dataset->getRowStream();
+        if (!result.stream)
+            result.rows = matrix->getRowPaths();
+
+        // Streams that know their own structure (for example the chunks of
+        // a tabular dataset) split themselves
+        if (result.stream && blockRows == 0
+            && result.stream->supportsExtendedInterface()) {
+            result.streams = result.stream->parallelize(numRows,
+                                                        RowStream::AUTO,
+                                                        &result.offsets);
+            if (!result.offsets.empty() && result.offsets.back() == numRows)
+                return result;
+            result.streams.clear();
+            result.offsets.clear();
+        }
+
+        if (blockRows == 0)
+            blockRows = std::max<size_t>(1, (numRows + 255) / 256);
+
+        for (size_t i = 0;  i < numRows;  i += blockRows)
+            result.offsets.push_back(i);
+        result.offsets.push_back(numRows);
+
+        return result;
+    }
+
+    void sampleStreaming(const SampledDatasetConfig & config)
+    {
+        Partitions parts = getPartitions(config.blockRows);
+        size_t numRows = parts.size() ? parts.offsets.back() : 0;
+        uint64_t seed = config.seed;
+
+        // Rows that are kept, with the position and priority of each
+        struct Sampled {
+            uint64_t priority;
+            size_t rowNum;
+            RowPath rowName;
+
+            bool operator < (const Sampled & other) const
+            {
+                return std::tie(priority, rowNum)
+                    < std::tie(other.priority, other.rowNum);
+            }
+        };
+
+        std::vector<std::vector<Sampled> > kept(parts.size());
+
+        if (config.sampling == SAMPLING_RESERVOIR) {
+            size_t wanted = config.rows != 0 ? config.rows
+                                             : numRows * config.fraction;
+            if (wanted > numRows) {
+                throw MLDB::Exception("Requested more rows without replacement than "
+                        "available number of rows in original dataset.");
+            }
+
+            // The sample is the wanted rows with the lowest priority, kept
+            // in a single max-heap shared by the parts.  Once it's full,
+            // its top is the cutoff that a row needs to beat to get in, so
+            // each part only buffers a few candidates at a time and memory
+            // stays O(wanted) however many parts there are.
+            static constexpr size_t MERGE_BATCH = 1024;
+            std::mutex heapMutex;
+            std::priority_queue<Sampled> heap;
+            std::atomic<uint64_t> cutoff(std::numeric_limits<uint64_t>::max());
+
+            auto merge = [&] (std::vector<Sampled> & candidates)
+                {
+                    std::unique_lock<std::mutex> guard(heapMutex);
+                    for (auto & c: candidates) {
+                        if (heap.size() < wanted)
+                            heap.push(std::move(c));
+                        else if (c < heap.top()) {
+                            heap.pop();
+                            heap.push(std::move(c));
+                        }
+                    }
+                    candidates.clear();
+                    if (heap.size() == wanted)
+                        cutoff.store(heap.top().priority,
+                                     std::memory_order_relaxed);
+                };
+
+            auto doPart = [&] (size_t part)
+                {
+                    std::vector<Sampled> candidates;
+                    auto onRow = [&] (size_t rowNum, const RowPath & rowName)
+                    {
+                        uint64_t priority
+                            = samplingHash(seed, RowHash(rowName).hash());
+                        // Equal priorities are ordered by row number when
+                        // merged
+                        if (priority > cutoff.load(std::memory_order_relaxed))
+                            return;
+                        candidates.push_back({ priority, rowNum, rowName });
+                        if (candidates.size() == MERGE_BATCH)
+                            merge(candidates);
+                    };
+                    if (wanted > 0)
+                        parts.scan(part, onRow);
+                    merge(candidates);
+                };
+
+            if (parts.size() > 0)
+                parallelMap(0, parts.size(), doPart);
+
+            std::vector<Sampled> all;
+            all.reserve(heap.size());
+            while (!heap.empty()) {
+                all.push_back(heap.top());
+                heap.pop();
+            }
+            std::reverse(all.begin(), all.end());
+
+            kept.clear();
+            kept.emplace_back(std::move(all));
+        }
+        else {
+            double fraction = config.fraction;
+            if (config.rows != 0)
+                fraction = numRows ? 1.0 * config.rows / numRows : 1.0;
+            uint64_t threshold = samplingThreshold(fraction);
+
+            std::vector<char> keepPart(parts.size(), true);
+
+            if (config.sampling == SAMPLING_BLOCK && parts.size() > 0) {
+                // Choose the blocks up front, so that only those are read
+                std::vector<std::pair<uint64_t, size_t> > priorities;
+                for (size_t i = 0;  i < parts.size();  ++i)
+                    priorities.emplace_back(samplingHash(seed, i), i);
+
+                if (config.rows != 0) {
+                    // Lowest priority blocks until we have enough rows
+                    std::sort(priorities.begin(), priorities.end());
+                    std::fill(keepPart.begin(), keepPart.end(), false);
+                    size_t total = 0;
+                    for (auto & p: priorities) {
+                        if (total >= config.rows)
+                            break;
+                        keepPart[p.second] = true;
+                        total += parts.offsets[p.second + 1]
+                            - parts.offsets[p.second];
+                    }
+                }
+                else {
+                    bool any = false;
+                    for (auto & p: priorities) {
+                        keepPart[p.second] = p.first < threshold;
+                        any = any || keepPart[p.second];
+                    }
+                    // Never return an empty sample of a non-empty dataset
+                    if (!any)
+                        keepPart[std::min_element(priorities.begin(),
+                                                  priorities.end())->second]
+                            = true;
+                }
+            }
+
+            auto doPart = [&] (size_t part)
+                {
+                    if (!keepPart[part])
+                        return;
+                    auto onRow = [&] (size_t rowNum, const RowPath & rowName)
+                    {
+                        if (config.sampling == SAMPLING_BLOCK
+                            || samplingHash(seed, RowHash(rowName).hash())
+                               < threshold)
+                            kept[part].push_back({ 0, rowNum, rowName });
+                    };
+                    parts.scan(part, onRow);
+                };
+
+            if (parts.size() > 0)
+                parallelMap(0, parts.size(), doPart);
+        }
+
+        // Output in the order of the underlying dataset
+        std::vector<Sampled> all;
+        for (auto & k: kept)
+            all.insert(all.end(),
+                       std::make_move_iterator(k.begin()),
+                       std::make_move_iterator(k.end()));
+        std::sort(all.begin(), all.end(),
+                  [] (const Sampled & s1, const Sampled & s2)
+                  {
+                      return s1.rowNum < s2.rowNum;
+                  });
+
+        sampledRows.reserve(all.size());
+        sampledRowsHash.reserve(all.size());
+        for (auto & s: all) {
+            sampledRowsHash.emplace_back(s.rowName);
+            sampledRows.emplace_back(std::move(s.rowName));
         }
     }
 
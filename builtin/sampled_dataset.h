@@ -16,7 +16,16 @@ namespace MLDB {
 /*****************************************************************************/
 /* SAMPLED DATASET CONFIG                                                    */
 /*****************************************************************************/
-        
+
+enum SamplingMethod {
+    SAMPLING_INDEXED,    ///< Pick random indexes into the list of all rows
+    SAMPLING_RESERVOIR,  ///< Stream rows, keeping those with lowest priority
+    SAMPLING_BERNOULLI,  ///< Stream rows, keeping each with a probability
+    SAMPLING_BLOCK       ///< Keep whole blocks of consecutive rows
+};
+
+DECLARE_ENUM_DESCRIPTION(SamplingMethod);
+
 struct SampledDatasetConfig {
 
     SampledDatasetConfig();
@@ -27,6 +36,8 @@ struct SampledDatasetConfig {
     unsigned rows;
     float fraction;
     bool withReplacement;
+    SamplingMethod sampling;
+    unsigned blockRows;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(SampledDatasetConfig);
@@ -8,6 +8,7 @@
 #include "mldb/builtin/sql_functions.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/types/basic_value_descriptions.h"
@@ -102,17 +103,6 @@ SqlQueryFunction(MldbEngine * owner,
     functionConfig = config.params.convert<SqlQueryFunctionConfig>();
 }
 
-Any
-SqlQueryFunction::
-getStatus() const
-{
-    Json::Value result;
-    result["expression"]["query"]["surface"] = functionConfig.query.stm->surface;
-    result["expression"]["query"]["ast"] = functionConfig.query.stm->print();
-    result["info"] = jsonEncode(getFunctionInfo());
-    return result;
-}
-
 /** Structure that does all the work of the SQL expression function. */
 struct SqlQueryFunctionApplier: public FunctionApplier {
     SqlQueryFunctionApplier(const SqlQueryFunction * function,
@@ -161,12 +151,156 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
                                                      SCHEMA_CLOSED));
             break;
         }
+
+        isKeyedLookup = bindKeyedLookup(*config.query.stm);
+        if (!isKeyedLookup)
+            plan["type"] = "pipeline";
     }
 
     virtual ~SqlQueryFunctionApplier()
     {
     }
 
+    /** Queries of the form
+
+            SELECT ... FROM dataset WHERE rowName() = <expression of $params>
+
+        (or rowPath(), on either side of the equality), with no OFFSET,
+        LIMIT or HAVING, match at most one row, which is found with a
+        single lookup in the dataset.  For these we bind the expressions
+        once against the dataset and look up the row directly on each
+        call, rather than starting the pipeline (which binds and plans the
+        whole query again) for every row the function is applied to.
+
+        Returns false, which means that the pipeline will be used, when the
+        query isn't of this form.
+    */
+    bool bindKeyedLookup(const SelectStatement & stm)
+    {
+        // NAMED_COLUMNS reads the whole result, with its offset and limit
+        if (function->functionConfig.output != FIRST_ROW)
+            return false;
+
+        // Only a named dataset, which can be looked up by row
+        auto dataset = dynamic_cast<const DatasetExpression *>(stm.from.get());
+        if (!dataset || !dataset->config.empty())
+            return false;
+
+        // Aggregators produce a row even when nothing matches
+        if (!stm.groupBy.empty() || !stm.select.findAggregators(false).empty())
+            return false;
+
+        if (stm.when.when && !stm.when.when->isConstantTrue())
+            return false;
+
+        // An offset or limit can drop the matching row, and HAVING filters
+        // it out.  ORDER BY can't change which row comes first when there
+        // is at most one.
+        if (stm.offset != 0 || stm.limit != -1)
+            return false;
+        if (stm.having && !stm.having->isConstantTrue())
+            return false;
+
+        auto comparison
+            = dynamic_cast<const ComparisonExpression *>(stm.where.get());
+        if (!comparison || comparison->op != "=")
+            return false;
+
+        auto getRowFunction = [] (const SqlExpression & expr)
+            -> const FunctionCallExpression *
+            {
+                auto call = dynamic_cast<const FunctionCallExpression *>(&expr);
+                if (call && call->tableName.empty() && call->args.empty()
+                    && (call->functionName == "rowName"
+                        || call->functionName == "rowPath"))
+                    return call;
+                return nullptr;
+            };
+
+        // The key can only depend on the parameters, not on the row
+        auto isKey = [] (const SqlExpression & expr)
+            {
+                auto unbound = expr.getUnbound();
+                return unbound.vars.empty() && unbound.tables.empty()
+                    && unbound.wildcards.empty() && !unbound.hasRowFunctions()
+                    && !unbound.funcs.count("rowName");
+            };
+
+        const FunctionCallExpression * call = nullptr;
+        std::shared_ptr<SqlExpression> key;
+        if ((call = getRowFunction(*comparison->lhs))
+            && isKey(*comparison->rhs)) {
+            key = comparison->rhs;
+        }
+        else if ((call = getRowFunction(*comparison->rhs))
+                 && isKey(*comparison->lhs)) {
+            key = comparison->lhs;
+        }
+        else return false;
+
+        try {
+            SqlExpressionMldbScope mldbScope(function->engine);
+            BoundTableExpression bound = stm.from->bind(mldbScope, nullptr);
+            if (!bound.dataset)
+                return false;
+
+            from = bound.dataset;
+            lookupScope.reset(new SqlExpressionDatasetScope(bound));
+            boundKey = key->bind(*lookupScope);
+            boundWhere = stm.where->bind(*lookupScope);
+            boundSelect = stm.select.bind(*lookupScope);
+
+            plan["dataset"] = bound.asName;
+        } catch (const std::exception &) {
+            // Something that only the pipeline knows how to bind
+            from.reset();
+            lookupScope.reset();
+            return false;
+        }
+
+        keyIsRowName = call->functionName == "rowName";
+
+        plan["type"] = "keyedLookup";
+        plan["keyFunction"] = call->functionName;
+        plan["key"] = key->surface;
+
+        return true;
+    }
+
+    /** Apply a query bound by bindKeyedLookup(). */
+    ExpressionValue applyKeyedLookup(const BoundParameters & params) const
+    {
+        MatrixNamedRow noRow;
+        auto paramScope = SqlExpressionDatasetScope::getRowScope(noRow, &params);
+
+        ExpressionValue keyStorage;
+        const ExpressionValue & key
+            = boundKey(paramScope, keyStorage, GET_LATEST);
+
+        // Nothing is equal to null
+        if (key.empty())
+            return ExpressionValue();
+
+        // The same key conversion as the row generator for the pipeline
+        RowPath rowPath = keyIsRowName
+            ? RowPath::tryParse(key.toUtf8String()).first
+            : key.coerceToPath();
+
+        auto matrix = from->getMatrixView();
+        if (!matrix->knownRow(rowPath))
+            return ExpressionValue();
+
+        MatrixNamedRow row = matrix->getRow(rowPath);
+        auto rowScope = SqlExpressionDatasetScope::getRowScope(row, &params);
+
+        // Check the condition on the row, like the pipeline does
+        ExpressionValue whereStorage;
+        if (!boundWhere(rowScope, whereStorage, GET_LATEST).isTrue())
+            return ExpressionValue();
+
+        return boundSelect(rowScope, GET_ALL);
+    }
+
     ExpressionValue apply(const ExpressionValue & context) const
     {
         // 1.  Run our generator, finding all rows
@@ -176,6 +310,9 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
                 return context.getColumn(name);
             };
 
+        if (isKeyedLookup)
+            return applyKeyedLookup(params);
+
         auto executor = boundPipeline->start(params);
 
         switch (function->functionConfig.output) {
@@ -281,8 +418,33 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
     std::shared_ptr<Dataset> from;
     std::shared_ptr<PipelineElement> pipeline;
     std::shared_ptr<BoundPipelineElement> boundPipeline;
+
+    /// How the query is run; reported in the function status
+    Json::Value plan = Json::Value(Json::objectValue);
+
+    /// Set when the query was bound by bindKeyedLookup()
+    bool isKeyedLookup = false;
+    bool keyIsRowName = false;
+    std::unique_ptr<SqlExpressionDatasetScope> lookupScope;
+    BoundSqlExpression boundKey;
+    BoundSqlExpression boundWhere;
+    BoundSqlExpression boundSelect;
 };
 
+Any
+SqlQueryFunction::
+getStatus() const
+{
+    SqlQueryFunctionApplier applier(this, functionConfig);
+
+    Json::Value result;
+    result["expression"]["query"]["surface"] = functionConfig.query.stm->surface;
+    result["expression"]["query"]["ast"] = functionConfig.query.stm->print();
+    result["info"] = jsonEncode(applier.info);
+    result["plan"] = applier.plan;
+    return result;
+}
+
 std::unique_ptr<FunctionApplier>
 SqlQueryFunction::
 bind(SqlBindingScope & outerContext,
@@ -2355,6 +2355,13 @@ commit()
 {
 }
 
+int64_t
+Dataset::
+getGeneration() const
+{
+    return -1;
+}
+
 BoundFunction
 Dataset::
 overrideFunction(const Utf8String&,
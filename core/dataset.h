@@ -533,6 +533,17 @@ struct Dataset: public MldbEntity {
     */
     virtual void commit();
 
+    /** Return a number that changes each time the contents visible through
+        the dataset change, so that what is computed from those contents
+        can be cached and reused until it changes.  It must be read before
+        the contents, so that a change in between is noticed the next
+        time.
+
+        The default returns -1, which means that the dataset doesn't keep
+        track, and that its contents may change at any time.
+    */
+    virtual int64_t getGeneration() const;
+
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
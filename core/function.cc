@@ -119,6 +119,39 @@ apply(const ExpressionValue & input) const
     return function->apply(*this, input);
 }
 
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    ExcAssert(function);
+    return function->applyBatch(*this, inputs);
+}
+
+
+/*****************************************************************************/
+/* PREPARED FUNCTION APPLIER                                                 */
+/*****************************************************************************/
+
+ExpressionValue
+PreparedFunctionApplier::
+applyPositional(std::vector<ExpressionValue> values) const
+{
+    if (values.size() != inputNames.size()) {
+        throw AnnotatedException(400, "Prepared function application expected "
+                                 + std::to_string(inputNames.size())
+                                 + " input values but got "
+                                 + std::to_string(values.size()));
+    }
+
+    StructValue input;
+    input.reserve(values.size());
+    for (size_t i = 0;  i < values.size();  ++i) {
+        input.emplace_back(inputNames[i], std::move(values[i]));
+    }
+
+    return applier->apply(std::move(input));
+}
+
 
 /*****************************************************************************/
 /* FUNCTION                                                                  */
@@ -174,6 +207,18 @@ getFunctionInfo() const
                         + " needs to override getFunctionInfo()");
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (auto & input: inputs)
+        result.emplace_back(apply(applier, input));
+    return result;
+}
+
 RestRequestMatchResult
 Function::
 handleRequest(RestConnection & connection,
@@ -34,6 +34,7 @@ struct SqlRowExpression;
 struct ExpressionValueInfo;
 struct RowValueInfo;
 struct KnownColumn;
+struct PreparedApplierCache;
 
 typedef EntityType<Function> FunctionType;
 
@@ -116,6 +117,30 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to each of the inputs
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
+};
+
+
+/*****************************************************************************/
+/* PREPARED FUNCTION APPLIER                                                 */
+/*****************************************************************************/
+
+/** An applier that was bound once for inputs passed positionally, ie as a
+    list of values in the order of inputNames.  Returned by
+    Function::prepare().
+*/
+
+struct PreparedFunctionApplier {
+    /// Scope that the applier was bound in, which it may refer to
+    std::shared_ptr<SqlBindingScope> outerScope;
+    std::shared_ptr<const FunctionApplier> applier;
+    std::vector<PathElement> inputNames;  ///< Name of each positional input
+
+    /// Apply to the given values, one per input name
+    ExpressionValue applyPositional(std::vector<ExpressionValue> values) const;
 };
 
 
@@ -189,6 +214,18 @@ struct Function: public MldbEntity {
     */
     ExpressionValue call(const ExpressionValue & input) const;
 
+    /** Return an applier for inputs passed positionally with the given
+        names, which are comma separated or a JSON array of strings.  The
+        applier is bound on the first call for a given set of names and
+        cached with the function, so this is cheap to call on every
+        request.  It is bound again if a function or dataset that it
+        looked up by name has since been replaced or deleted.
+
+        Like call(), this is defined in function_collection.cc.
+    */
+    std::shared_ptr<const PreparedFunctionApplier>
+    prepare(const Utf8String & inputNames) const;
+
     /** Method to overwrite to handle a request.  By default, the function
         will return that it can't handle any requests.  Used to expose
         function-specific functionality.
@@ -206,7 +243,20 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Apply the function to each of the inputs, returning the outputs in
+        the same order.  The default calls apply() on each one in turn.
+        Functions that spend their time waiting on something else, such as
+        the network, can override it to wait for all of them at once.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     friend class FunctionApplier;
+
+private:
+    /// Appliers returned by prepare(); created on first use
+    mutable std::shared_ptr<PreparedApplierCache> preparedCache_;
 };
 
 
@@ -5,6 +5,8 @@
 
 #include "mldb_engine.h"
 #include "mldb/types/string.h"
+#include <map>
+#include <mutex>
 
 namespace MLDB {
 
@@ -20,9 +22,44 @@ const Utf8String & EMPTY_UTF8 = getEmptyUtf8Impl();
 /* MLDB ENGINE                                                               */
 /*****************************************************************************/
 
+struct MldbEngine::Attachments {
+    std::mutex mutex;
+    std::map<const void *, std::shared_ptr<void> > entries;
+};
+
+MldbEngine::
+MldbEngine()
+    : attachments(new Attachments())
+{
+}
+
 MldbEngine::
 ~MldbEngine()
 {
 }
 
+std::shared_ptr<void>
+MldbEngine::
+getAttachment(const void * key,
+              const std::function<std::shared_ptr<void> ()> & create)
+{
+    std::unique_lock<std::mutex> guard(attachments->mutex);
+    auto & result = attachments->entries[key];
+    if (!result)
+        result = create();
+    return result;
+}
+
+void
+MldbEngine::
+clearAttachments()
+{
+    // Destroy them outside of the lock, in case they call back in
+    std::map<const void *, std::shared_ptr<void> > entries;
+    {
+        std::unique_lock<std::mutex> guard(attachments->mutex);
+        entries.swap(attachments->entries);
+    }
+}
+
 } // namespace MLDB
@@ -55,6 +55,8 @@ extern const Utf8String & EMPTY_UTF8;
 
 struct MldbEngine {
 
+    MldbEngine();
+
     virtual ~MldbEngine();
     
     typedef std::function<bool (const Json::Value & progress)> OnProgress;
@@ -194,6 +196,31 @@ struct MldbEngine {
     
     virtual std::shared_ptr<Sensor>
     getSensor(const Utf8String & sensorName) const = 0;
+
+
+    /*************************************************************************/
+    /* ATTACHMENTS                                                           */
+    /*************************************************************************/
+
+    /** Return the object attached to this engine under the given key,
+        calling create() to make it if there is none yet.  This is for
+        per-engine state kept by code that isn't an entity, such as caches,
+        which needs to live exactly as long as the engine.  The key is
+        normally the address of a static variable of the caller.
+    */
+    std::shared_ptr<void>
+    getAttachment(const void * key,
+                  const std::function<std::shared_ptr<void> ()> & create);
+
+protected:
+    /** Release all attachments.  Called from shutdown, after the entities
+        that may be using them are gone.
+    */
+    void clearAttachments();
+
+private:
+    struct Attachments;
+    std::unique_ptr<Attachments> attachments;
 };
 
 } // namespace MLDB
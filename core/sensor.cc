@@ -14,7 +14,12 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/sql/expression_value.h"
 #include "mldb/sql/builtin_functions.h"
+#include "mldb/sql/sql_expression.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/io/ring_buffer.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/format.h"
 
 namespace MLDB {
 
@@ -40,9 +45,26 @@ createSensor(MldbEngine * engine,
 /* SENSOR                                                                    */
 /*****************************************************************************/
 
+struct Sensor::Itl {
+    typedef RingBufferHistory<ExpressionValue> History;
+
+    /// Serializes enabling and growing the history
+    std::mutex historyMutex;
+
+    /// Sample history; null if not enabled.  Always accessed atomically,
+    /// since it's replaced when the history grows.
+    std::shared_ptr<History> history;
+
+    std::shared_ptr<History> getHistory() const
+    {
+        return std::atomic_load(&history);
+    }
+};
+
 Sensor::
 Sensor(MldbEngine * engine)
-    : engine(static_cast<MldbEngine *>(engine))
+    : engine(static_cast<MldbEngine *>(engine)),
+      itl(new Itl())
 {
 }
 
@@ -65,6 +87,64 @@ getVersion() const
     return Any();
 }
 
+ExpressionValue
+Sensor::
+sample()
+{
+    ExpressionValue result = latest();
+    if (auto history = itl->getHistory())
+        history->push(result);
+    return result;
+}
+
+void
+Sensor::
+recordHistory(std::vector<ExpressionValue> values)
+{
+    if (auto history = itl->getHistory())
+        history->pushBatch(std::move(values));
+}
+
+void
+Sensor::
+enableHistory(size_t numSamples)
+{
+    if (numSamples == 0)
+        return;
+    if (numSamples > MAX_HISTORY_SAMPLES) {
+        throw AnnotatedException
+            (400, MLDB::format("A sensor's history can keep at most %zd "
+                               "samples, not %zd",
+                               MAX_HISTORY_SAMPLES, numSamples));
+    }
+    std::unique_lock<std::mutex> guard(itl->historyMutex);
+    auto current = itl->getHistory();
+    if (current && current->capacity() >= numSamples)
+        return;
+    std::shared_ptr<Itl::History> newHistory
+        = current
+        ? std::make_shared<Itl::History>(numSamples, *current)
+        : std::make_shared<Itl::History>(numSamples);
+    std::atomic_store(&itl->history, std::move(newHistory));
+}
+
+size_t
+Sensor::
+historyCapacity() const
+{
+    auto history = itl->getHistory();
+    return history ? history->capacity() : 0;
+}
+
+std::vector<std::pair<uint64_t, std::shared_ptr<const ExpressionValue> > >
+Sensor::
+history(size_t maxSamples) const
+{
+    if (auto history = itl->getHistory())
+        return history->last(maxSamples);
+    return {};
+}
+
 RestRequestMatchResult
 Sensor::
 handleRequest(RestConnection & connection,
@@ -116,7 +196,7 @@ BoundFunction readSensorFunction(const Utf8String & fnName,
     auto exec = [=] (const std::vector<ExpressionValue> & input,
                      const SqlRowScope & context)
         {
-            return sensor->latest();
+            return sensor->sample();
         };
     
     return BoundFunction(exec, sensor->resultInfo());
@@ -125,4 +205,101 @@ BoundFunction readSensorFunction(const Utf8String & fnName,
 static RegisterFunction registerReadSensor("read_sensor", readSensorFunction);
 
 
+/*****************************************************************************/
+/* SENSOR HISTORY TABLE FUNCTION                                             */
+/*****************************************************************************/
+
+// Overridden by libmldb.so when it loads up; defined in
+// builtin_dataset_functions.cc
+extern std::shared_ptr<Dataset>
+(*createSubDatasetFromRowsFn) (MldbEngine *, const std::vector<NamedRowValue> &);
+
+// defined in table_expression_operations.cc
+BoundTableExpression
+bindDataset(std::shared_ptr<Dataset> dataset, Utf8String asName);
+
+struct SensorHistoryOptions {
+    Utf8String sensor;
+    uint64_t samples = 100;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(SensorHistoryOptions);
+
+DEFINE_STRUCTURE_DESCRIPTION_INLINE(SensorHistoryOptions)
+{
+    addField("sensor", &SensorHistoryOptions::sensor,
+             "ID of the sensor to read the history of");
+    addField("samples", &SensorHistoryOptions::samples,
+             "Maximum number of recent samples to return", (uint64_t)100);
+}
+
+/** Table function that returns the most recent samples of a sensor, one row
+    per sample, without having to record them into a dataset.  The row name
+    is the sequence number of the sample.  Samples that are rows keep their
+    columns; others are returned in a single column called value.
+
+    The sensor's history needs to have been enabled; this only reads it.
+*/
+BoundTableExpression
+sensorHistory(const Utf8String & fnName,
+              const std::vector<BoundTableExpression> & args,
+              const ExpressionValue & options,
+              const SqlBindingScope & context,
+              const Utf8String & alias,
+              const ProgressFunc & onProgress)
+{
+    if (!args.empty())
+        throw AnnotatedException(400, "The 'sensor_history' function takes "
+                                 "no dataset arguments, only an options row "
+                                 "like sensor_history({sensor: 'id', "
+                                 "samples: 100})");
+
+    auto config = jsonDecode<SensorHistoryOptions>(options.extractJson());
+    if (config.sensor.empty())
+        throw AnnotatedException(400, "The 'sensor_history' function needs "
+                                 "the 'sensor' option to be set to the ID "
+                                 "of a sensor",
+                                 "options", options);
+
+    PolyConfig sensorConfig;
+    sensorConfig.id = config.sensor;
+    auto sensor = obtainSensor(context.getMldbEngine(), sensorConfig);
+
+    if (sensor->historyCapacity() == 0) {
+        throw AnnotatedException(400, "The history of sensor '" + config.sensor
+                                 + "' isn't enabled; enable it with "
+                                 "PUT /v1/sensors/" + config.sensor
+                                 + "/history {\"samples\": <n>}");
+    }
+
+    static const PathElement valueColumn("value");
+
+    std::vector<NamedRowValue> rows;
+    for (auto & s: sensor->history(config.samples)) {
+        NamedRowValue row;
+        row.rowName = RowPath(PathElement(s.first));
+        row.rowHash = row.rowName;
+        const ExpressionValue & value = *s.second;
+        if (value.isRow()) {
+            value.forEachColumn([&] (const PathElement & columnName,
+                                     const ExpressionValue & val)
+                                {
+                                    row.columns.emplace_back(columnName, val);
+                                    return true;
+                                });
+        }
+        else {
+            row.columns.emplace_back(valueColumn, value);
+        }
+        rows.emplace_back(std::move(row));
+    }
+
+    auto ds = createSubDatasetFromRowsFn(context.getMldbEngine(), rows);
+    return bindDataset(ds, alias);
+}
+
+static std::shared_ptr<void> registerSensorHistory
+    = registerDatasetFunction("sensor_history", sensorHistory);
+
+
 } // namespace MLDB
@@ -61,6 +61,42 @@ struct Sensor: MldbEntity {
     virtual std::shared_ptr<ExpressionValueInfo>
     resultInfo() const = 0;
 
+    /** Read the latest value from the sensor, recording it in the sensor's
+        history if history is enabled.  This is what read_sensor() calls;
+        sensors implement latest(), not this.
+    */
+    ExpressionValue sample();
+
+    /** Record a batch of values in the sensor's history, for sensors that
+        produce several samples per poll (for example a buffer of audio
+        frames).  Does nothing if history isn't enabled.
+    */
+    void recordHistory(std::vector<ExpressionValue> values);
+
+    /// Largest number of samples that a sensor's history can keep
+    static constexpr size_t MAX_HISTORY_SAMPLES = 100000;
+
+    /** Keep the last numSamples values that pass through sample() or
+        recordHistory() in a ring buffer.  History can only grow; asking
+        for less than is already kept has no effect.  Throws a 400 error
+        if numSamples is more than MAX_HISTORY_SAMPLES.  Thread safe.
+
+        This is done through the PUT /v1/sensors/<id>/history route.
+    */
+    void enableHistory(size_t numSamples);
+
+    /// Number of samples kept in the history, or zero if it's not enabled
+    size_t historyCapacity() const;
+
+    /** Return up to maxSamples of the most recent values in the sensor's
+        history, oldest first, each with its sequence number.  The values
+        are shared with the history rather than copied, and stay valid
+        after they're overwritten there.  Returns nothing if history isn't
+        enabled.
+    */
+    std::vector<std::pair<uint64_t, std::shared_ptr<const ExpressionValue> > >
+    history(size_t maxSamples) const;
+
     /** Method to overwrite to handle a request.  By default, the sensor
         will return that it can't handle any requests.
     */
@@ -86,6 +122,10 @@ struct Sensor: MldbEntity {
     handleStaticRoute(RestConnection & connection,
                       const RestRequest & request,
                       RestRequestParsingContext & context) const;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
 };
 
 /*****************************************************************************/
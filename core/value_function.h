@@ -155,6 +155,19 @@ struct ValueFunctionT: public ValueFunction {
     {
         return call(std::move(input));
     }
+
+    /** Apply the function to each of the inputs.  The default calls
+        applyT() on each one in turn.
+    */
+    virtual std::vector<Output>
+    applyBatchT(const ApplierT & applier, std::vector<Input> inputs) const
+    {
+        std::vector<Output> result;
+        result.reserve(inputs.size());
+        for (auto & input: inputs)
+            result.emplace_back(applyT(applier, std::move(input)));
+        return result;
+    }
     
     virtual std::unique_ptr<Applier>
     bindT(SqlBindingScope & outerContext,
@@ -198,6 +211,30 @@ private:
         return toOutput(&out);
     }
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override
+    {
+        const auto * downcast
+            = dynamic_cast<const FunctionApplierT<Input, Output> *>(&applier);
+        if (!downcast) {
+            throw AnnotatedException(500, "Couldn't downcast applier");
+        }
+
+        std::vector<Input> in(inputs.size());
+        for (size_t i = 0;  i < inputs.size();  ++i)
+            fromInput(&in[i], inputs[i]);
+
+        std::vector<Output> out = applyBatchT(*downcast, std::move(in));
+        ExcAssertEqual(out.size(), inputs.size());
+
+        std::vector<ExpressionValue> result;
+        result.reserve(out.size());
+        for (auto & o: out)
+            result.emplace_back(toOutput(&o));
+        return result;
+    }
+
     template<typename InputT, typename OutputT>
     friend class FunctionApplierT;
 };
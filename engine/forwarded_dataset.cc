@@ -126,6 +126,15 @@ commit()
     current->commit();
 }
 
+int64_t
+ForwardedDataset::
+getGeneration() const
+{
+    auto current = underlying.load();
+    ExcAssert(current);
+    return current->getGeneration();
+}
+
 std::vector<MatrixNamedRow>
 ForwardedDataset::
 queryStructured(const SelectExpression & select,
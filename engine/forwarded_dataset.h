@@ -56,6 +56,8 @@ struct ForwardedDataset: public Dataset {
 
     virtual void commit();
 
+    virtual int64_t getGeneration() const;
+
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
                     const WhenExpression & when,
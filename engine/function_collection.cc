@@ -13,8 +13,12 @@
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/core/dataset.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/vector_description.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 
 using namespace std;
@@ -115,6 +119,247 @@ call(const ExpressionValue & input) const
     return applier->apply(input);
 }
 
+
+/*****************************************************************************/
+/* PREPARED APPLIER CACHE                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** An entity that was looked up by name when an applier was bound.  If the
+    name now refers to something else, or a dataset's contents have changed
+    (as appliers may capture them when bound), the applier needs to be bound
+    again.
+*/
+struct PreparedDependency {
+    enum Kind {
+        FUNCTION,
+        DATASET
+    } kind;
+    Utf8String name;
+    std::weak_ptr<MldbEntity> entity;  ///< What it was; null if not found
+    bool found;
+    int64_t generation = -1;  ///< Dataset's getGeneration() when bound
+
+    bool isCurrent(const MldbEngine & engine) const
+    {
+        if (kind == FUNCTION) {
+            auto current = engine.tryGetFunction(name);
+            if (!found)
+                return !current;
+            return current && current == entity.lock();
+        }
+
+        auto current = engine.tryGetDataset(name);
+        if (!found)
+            return !current;
+        return current && current == entity.lock()
+            && current->getGeneration() == generation;
+    }
+
+    /** Can a change to this dependency be detected by isCurrent()? */
+    bool isTracked() const
+    {
+        return kind == FUNCTION || !found || generation != -1;
+    }
+};
+
+/** Scope that the appliers returned by Function::prepare() are bound in.
+    It records the functions and datasets that are looked up by name, so
+    that the cached applier can be dropped if any of them are replaced or
+    deleted.
+*/
+struct PreparedBindingScope: public SqlExpressionMldbScope {
+
+    PreparedBindingScope(const MldbEngine * mldb)
+        : SqlExpressionMldbScope(mldb)
+    {
+    }
+
+    virtual BoundFunction
+    doGetFunction(const Utf8String & tableName,
+                  const Utf8String & functionName,
+                  const std::vector<BoundSqlExpression> & args,
+                  SqlBindingScope & argScope) override
+    {
+        // Record before binding, so that a function replaced in between
+        // will be picked up on the next call
+        if (tableName.empty()) {
+            auto fn = mldb->tryGetFunction(functionName);
+            dependencies.push_back({ PreparedDependency::FUNCTION,
+                                     functionName, fn, !!fn });
+        }
+        return SqlExpressionMldbScope
+            ::doGetFunction(tableName, functionName, args, argScope);
+    }
+
+    virtual std::shared_ptr<Dataset>
+    doGetDataset(const Utf8String & datasetName) override
+    {
+        auto result = SqlExpressionMldbScope::doGetDataset(datasetName);
+        // Read before the binding reads the contents, so that a change in
+        // between will be picked up on the next call
+        dependencies.push_back({ PreparedDependency::DATASET,
+                                 datasetName, result, !!result,
+                                 result ? result->getGeneration() : -1 });
+        return result;
+    }
+
+    std::vector<PreparedDependency> dependencies;
+};
+
+} // file scope
+
+/** Appliers returned by Function::prepare(), by the exact inputNames string
+    they were asked for, so that a hit costs no parsing.  The least recently
+    used entry is dropped when the cache is full.
+*/
+struct PreparedApplierCache {
+    /// Number of different input names kept
+    static constexpr size_t MAX_ENTRIES = 256;
+
+    struct Entry {
+        std::shared_ptr<const PreparedFunctionApplier> applier;
+        std::vector<PreparedDependency> dependencies;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    /// Return the entry for the given key, marking it as most recently used
+    std::shared_ptr<const Entry> get(const std::string & key)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+        lru.splice(lru.begin(), lru, it->second->lruPosition);
+        return it->second;
+    }
+
+    /** Insert an entry, unless another one that is still current was
+        inserted in the meantime, and return the entry to use. */
+    std::shared_ptr<const Entry>
+    insert(const std::string & key,
+           const std::shared_ptr<const Entry> & replaced,
+           std::shared_ptr<Entry> entry)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            if (it->second != replaced)
+                return it->second;
+            lru.erase(it->second->lruPosition);
+            entries.erase(it);
+        }
+
+        while (entries.size() >= MAX_ENTRIES) {
+            entries.erase(lru.back());
+            lru.pop_back();
+        }
+
+        lru.push_front(key);
+        entry->lruPosition = lru.begin();
+        return entries.emplace(key, std::move(entry)).first->second;
+    }
+
+    std::mutex lock;
+    std::list<std::string> lru;  ///< Keys, most recently used first
+    std::unordered_map<std::string, std::shared_ptr<const Entry> > entries;
+};
+
+namespace {
+
+std::vector<PathElement>
+parsePreparedInputNames(const Utf8String & inputNames)
+{
+    std::vector<PathElement> result;
+    if (inputNames.startsWith("[")) {
+        for (auto & name: jsonDecodeStr<std::vector<Utf8String> >(inputNames))
+            result.emplace_back(name);
+    }
+    else {
+        const std::string & str = inputNames.rawString();
+        size_t start = 0;
+        while (start <= str.size()) {
+            size_t end = str.find(',', start);
+            if (end == std::string::npos)
+                end = str.size();
+            result.emplace_back(Utf8String(str.substr(start, end - start)));
+            start = end + 1;
+        }
+    }
+
+    auto sorted = result;
+    std::sort(sorted.begin(), sorted.end());
+    auto dup = std::adjacent_find(sorted.begin(), sorted.end());
+    if (dup != sorted.end()) {
+        throw AnnotatedException(400, "Input name '" + dup->toUtf8String()
+                                 + "' is repeated in inputNames",
+                                 "inputNames", inputNames);
+    }
+
+    return result;
+}
+
+} // file scope
+
+std::shared_ptr<const PreparedFunctionApplier>
+Function::
+prepare(const Utf8String & inputNames) const
+{
+    if (inputNames.empty()) {
+        throw AnnotatedException(400, "Prepared function application requires "
+                                 "the inputNames parameter");
+    }
+
+    auto cache = std::atomic_load(&preparedCache_);
+    if (!cache) {
+        auto newCache = std::make_shared<PreparedApplierCache>();
+        if (std::atomic_compare_exchange_strong(&preparedCache_, &cache,
+                                                newCache))
+            cache = std::move(newCache);
+    }
+
+    MldbEngine * owner = MldbEntity::getOwner(this->engine);
+
+    // The applier may have been bound against functions or datasets that
+    // have since been replaced, in which case it's bound again
+    auto found = cache->get(inputNames.rawString());
+    if (found) {
+        bool current = true;
+        for (auto & d: found->dependencies) {
+            if (!d.isCurrent(*owner)) {
+                current = false;
+                break;
+            }
+        }
+        if (current)
+            return found->applier;
+    }
+
+    // Bind outside of the lock, as it can be slow.  If two threads race to
+    // prepare the same names, the first one to finish wins.
+    auto scope = std::make_shared<PreparedBindingScope>(owner);
+    auto result = std::make_shared<PreparedFunctionApplier>();
+    result->inputNames = parsePreparedInputNames(inputNames);
+    result->outerScope = scope;
+    auto info = this->getFunctionInfo();
+    result->applier = this->bind(*scope, info.input);
+
+    // If a dataset doesn't track its changes, there's no telling when the
+    // applier would be stale, so it's not cached
+    for (auto & d: scope->dependencies) {
+        if (!d.isTracked())
+            return result;
+    }
+
+    auto entry = std::make_shared<PreparedApplierCache::Entry>();
+    entry->applier = std::move(result);
+    entry->dependencies = std::move(scope->dependencies);
+
+    return cache->insert(inputNames.rawString(), found, std::move(entry))
+        ->applier;
+}
+
 /*****************************************************************************/
 /* FUNCTION COLLECTION                                                       */
 /*****************************************************************************/
@@ -134,13 +379,20 @@ applyFunction(const Function * function,
               const std::string & outputFormat,
               RestConnection & connection) const
 {
-    StructValue inputExpr;
-    inputExpr.reserve(input.size());
+    // Use the same cached appliers as the /prepared route, keyed on the
+    // (sorted) names of the input values, so that the function isn't bound
+    // again on every call.
+    std::vector<Utf8String> inputNames;
+    std::vector<ExpressionValue> values;
+    inputNames.reserve(input.size());
+    values.reserve(input.size());
     for (auto & i: input) {
-        inputExpr.emplace_back(i.first, i.second);
+        inputNames.emplace_back(i.first);
+        values.emplace_back(i.second);
     }
 
-    ExpressionValue output = function->call(std::move(inputExpr));
+    auto prepared = function->prepare(jsonEncodeStr(inputNames));
+    ExpressionValue output = prepared->applyPositional(std::move(values));
 
     //cerr << "output = " << jsonEncode(output) << endl;
 
@@ -195,6 +447,120 @@ applyFunction(const Function * function,
     }
 }
 
+void
+FunctionCollection::
+applyPrepared(const Function * function,
+              const RestRequest & request,
+              RestConnection & connection) const
+{
+    // This is the online scoring path, so the parameters are taken
+    // straight from the request rather than through the generic decoding
+    // of the other routes.
+    Utf8String inputNames;
+    const std::string * input = nullptr;
+    std::string outputFormat = "json";
+
+    for (auto & p: request.params) {
+        if (p.first == "inputNames")
+            inputNames = p.second;
+        else if (p.first == "input")
+            input = &p.second.rawString();
+        else if (p.first == "outputFormat")
+            outputFormat = p.second.rawString();
+        else throw AnnotatedException(400, "Unknown parameter '" + p.first
+                                      + "' for prepared application");
+    }
+
+    auto prepared = function->prepare(inputNames);
+    size_t numInputs = prepared->inputNames.size();
+
+    std::vector<ExpressionValue> values;
+    values.reserve(numInputs);
+
+    if (request.header.contentType == "application/octet-stream") {
+        // Binary: one little endian double per input
+        if (input) {
+            throw AnnotatedException(400, "Binary input must be passed as "
+                                     "the request body");
+        }
+        if (request.payload.size() != numInputs * sizeof(double)) {
+            throw AnnotatedException(400, "Binary input for "
+                                     + std::to_string(numInputs)
+                                     + " inputs must be "
+                                     + std::to_string(numInputs * sizeof(double))
+                                     + " bytes; got "
+                                     + std::to_string(request.payload.size()));
+        }
+        const char * data = request.payload.data();
+        for (size_t i = 0;  i < numInputs;  ++i) {
+            double d;
+            std::memcpy(&d, data + i * sizeof(double), sizeof(double));
+            values.emplace_back(d, Date::notADate());
+        }
+    }
+    else {
+        // JSON array of values, in the order of inputNames
+        if (!input)
+            input = &request.payload;
+        if (input->empty()) {
+            throw AnnotatedException(400, "Prepared function application "
+                                     "requires an input");
+        }
+
+        static auto valDesc = getExpressionValueDescriptionNoTimestamp();
+
+        StreamingJsonParsingContext context("input", input->data(),
+                                            input->size());
+        if (!context.isArray()) {
+            throw AnnotatedException(400, "Input for prepared function "
+                                     "application must be an array of "
+                                     "values in the order of inputNames",
+                                     "input", *input);
+        }
+        context.forEachElement([&] ()
+            {
+                values.emplace_back();
+                valDesc->parseJson(&values.back(), context);
+            });
+        context.expectEof();
+    }
+
+    ExpressionValue output = prepared->applyPositional(std::move(values));
+
+    if (outputFormat == "json") {
+        Utf8String str;
+        Utf8StringJsonPrintingContext context(str);
+        output.extractJson(context);
+        connection.sendResponse(200, str.stealRawString(), "application/json");
+    }
+    else if (outputFormat == "binary") {
+        // One double per atom of the output, in order
+        std::string result;
+        result.reserve(output.getAtomCount() * sizeof(double));
+        auto onAtom = [&] (const Path & columnName, const Path & prefix,
+                           const CellValue & val, Date ts)
+            {
+                if (!val.isNumber()) {
+                    throw AnnotatedException(400, "Binary output requires "
+                                             "numeric outputs; '"
+                                             + columnName.toUtf8String()
+                                             + "' is not a number");
+                }
+                double d = val.toDouble();
+                result.append((const char *)&d, sizeof(d));
+                return true;
+            };
+        output.forEachAtom(onAtom);
+        connection.sendResponse(200, std::move(result),
+                                "application/octet-stream");
+    }
+    else {
+        throw AnnotatedException(400, "Unknown 'outputFormat' for prepared "
+                                  "application: got " + outputFormat
+                                  + ", accepted is 'json' or 'binary'");
+    }
+}
+
 void
 FunctionCollection::
 applyBatch(const Function * function,
@@ -224,40 +590,50 @@ applyBatch(const Function * function,
     
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    auto parseInput = [&] (const Json::Value & val)
         {
             StructuredJsonParsingContext context(val);
-            ExpressionValue inputExpr
-                = ExpressionValue::parseJson(context, ts);
-            ExpressionValue output
-                = function->apply(*applier, std::move(inputExpr));
-            output.extractJson(printingContext);
+            return ExpressionValue::parseJson(context, ts);
         };
 
     if (inputs.isNull()) {
         connection.sendResponse(200, inputs, "application/json");
         return;
     }
-    else if (inputs.isArray()) {
-        printingContext.startArray(inputs.size());
+    else if (inputs.isArray() || inputs.isObject()) {
+        // All inputs are given to the function together, so that it can
+        // work on them at the same time
+        std::vector<ExpressionValue> inputExprs;
         for (auto it = inputs.begin(), end = inputs.end();
              it != end;  ++it) {
-            printingContext.newArrayElement();
-            doInput(*it);
+            inputExprs.emplace_back(parseInput(*it));
         }
-        printingContext.endArray();
-    }
-    else if (inputs.isObject()) {
-        printingContext.startObject();
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.startMember(it.memberName());
-            doInput(*it);
+
+        std::vector<ExpressionValue> outputs
+            = applier->applyBatch(inputExprs);
+
+        if (inputs.isArray()) {
+            printingContext.startArray(inputs.size());
+            for (auto & output: outputs) {
+                printingContext.newArrayElement();
+                output.extractJson(printingContext);
+            }
+            printingContext.endArray();
+        }
+        else {
+            size_t i = 0;
+            printingContext.startObject();
+            for (auto it = inputs.begin(), end = inputs.end();
+                 it != end;  ++it, ++i) {
+                printingContext.startMember(it.memberName());
+                outputs[i].extractJson(printingContext);
+            }
+            printingContext.endObject();
         }
-        printingContext.endObject();
     }
     else {
-        doInput(inputs);
+        function->apply(*applier, parseInput(inputs))
+            .extractJson(printingContext);
     }
 
     connection.sendResponse(200, str.stealRawString(), "application/json");
@@ -306,6 +682,16 @@ initRoutes(RouteManager & manager)
                   PassConnectionId()
                   );
 
+    addRouteAsync(*manager.valueNode, "/prepared", { "GET", "POST" },
+                  "Apply a function to input values given positionally, "
+                  "using an applier that is bound once per set of input names",
+                  &FunctionCollection::applyPrepared,
+                  manager.getCollection,
+                  getFunction,
+                  PassRequest(),
+                  PassConnectionId()
+                  );
+
     const char * outputFormatDefStr2 = "String describing output format: "
         "'json' is JSON output (the output of the expression will be turned "
         "back into a vanilla JSON object, dropping any non-JSON types like "
@@ -36,6 +36,13 @@ struct FunctionCollection: public PolyCollection<Function> {
                        const std::string & outputFormat,
                        RestConnection & connection) const;
     
+    /** Apply the function using an applier prepared for the given
+        inputNames, with the input as a JSON array of positional values or
+        a binary array of doubles.  See Function::prepare(). */
+    void applyPrepared(const Function * function,
+                       const RestRequest & request,
+                       RestConnection & connection) const;
+
     void applyBatch(const Function * function,
                     const Json::Value & inputs,
                     const std::string & inputFormat,
@@ -10,6 +10,8 @@
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/core/sensor.h"
+#include "mldb/types/annotated_exception.h"
 
 using namespace std;
 
@@ -160,6 +162,40 @@ initRoutes(RouteManager & manager)
     manager.valueNode->addRoute(Rx("/static/(.*)", "<resource>"), {"GET"},
                                 "Get static files of of instantiated sensor",
                                 handleStaticRoute, Json::Value());
+
+    // Enable the history of the sensor, which sensor_history() reads
+    RestRequestRouter::OnProcessRequest handlePutHistoryRoute
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               RestRequestParsingContext & cxt)
+        {
+            Sensor * sensor = getSensor(cxt);
+
+            try {
+                Json::Value params = Json::parse(req.payload);
+                if (!params.isObject() || !params["samples"].isIntegral()
+                    || params["samples"].asInt() <= 0) {
+                    throw AnnotatedException
+                        (400, "Enabling the history of a sensor needs a "
+                         "positive number of samples, like "
+                         "{\"samples\": 100}",
+                         "payload", req.payload);
+                }
+                sensor->enableHistory(params["samples"].asUInt());
+
+                Json::Value result;
+                result["samples"] = (uint64_t)sensor->historyCapacity();
+                connection.sendResponse(200, result);
+                return RestRequestRouter::MR_YES;
+            }
+            catch (const AnnotatedException & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+        };
+
+    manager.valueNode->addRoute("/history", {"PUT"},
+                                "Keep a history of the sensor's samples",
+                                handlePutHistoryRoute, Json::Value());
 }
 
 Any
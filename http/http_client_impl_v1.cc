@@ -455,28 +455,24 @@ onCurlTimerEvent(long timeoutMs)
         throw MLDB::Exception("unhandled timeout value: %ld", timeoutMs);
     }
 
+    /* A timeout of 0 means "as soon as possible".  Calling
+       curl_multi_socket_action from here would be a recursive call, which
+       recent versions of libcurl refuse with CURLM_RECURSIVE_API_CALL, so
+       the timer is armed to expire immediately instead. */
     struct itimerspec timespec;
     memset(&timespec, 0, sizeof(timespec));
     if (timeoutMs > 0) {
         timespec.it_value.tv_sec = timeoutMs / 1000;
         timespec.it_value.tv_nsec = (timeoutMs % 1000) * 1000000;
     }
+    else if (timeoutMs == 0) {
+        timespec.it_value.tv_nsec = 1;
+    }
     int res = ::timerfd_settime(timerFd_, 0, &timespec, nullptr);
     if (res == -1) {
         throw MLDB::Exception(errno, "timerfd_settime");
     }
 
-    if (timeoutMs == 0) {
-        int runningHandles;
-        CURLMcode rc = ::curl_multi_socket_action(multi_.get(),
-                                                  CURL_SOCKET_TIMEOUT, 0,
-                                                  &runningHandles);
-        if (rc != ::CURLM_OK) {
-            throw MLDB::Exception("curl error " + to_string(rc));
-        }
-        checkMultiInfos();
-    }
-
     return 0;
 }
 
@@ -0,0 +1,350 @@
+/** http_connection_pool.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Connection pool shared between HttpRestProxy objects.
+*/
+
+#include "mldb/base/exc_assert.h"
+#include "http_connection_pool.h"
+#include "http_rest_proxy_impl.h"
+#include "mldb/types/structure_description.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HTTP HOST STATS                                                           */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(HttpHostStats);
+
+HttpHostStatsDescription::
+HttpHostStatsDescription()
+{
+    addField("requests", &HttpHostStats::requests,
+             "Number of requests performed against the host");
+    addField("errors", &HttpHostStats::errors,
+             "Number of requests that failed without getting a response");
+    addField("coalesced", &HttpHostStats::coalesced,
+             "Number of GET requests answered by an identical concurrent "
+             "request");
+    addField("newConnections", &HttpHostStats::newConnections,
+             "Number of connections that had to be opened");
+    addField("waited", &HttpHostStats::waited,
+             "Number of requests that had to wait for a free slot");
+    addField("totalSeconds", &HttpHostStats::totalSeconds,
+             "Total time taken by the requests performed");
+    addField("maxSeconds", &HttpHostStats::maxSeconds,
+             "Time taken by the longest request");
+    addField("connectSeconds", &HttpHostStats::connectSeconds,
+             "Total time spent setting up connections");
+}
+
+
+/*****************************************************************************/
+/* HTTP CONNECTION POOL                                                      */
+/*****************************************************************************/
+
+struct HttpConnectionPool::Itl {
+    Itl(int maxRequestsPerHost)
+        : maxRequestsPerHost(maxRequestsPerHost),
+          share(curl_share_init())
+    {
+        ExcAssert(share);
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &Itl::lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &Itl::unlockShare);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 // 7.57.0
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+
+    ~Itl()
+    {
+        // Handles need to go before the share they use
+        for (auto h: idle)
+            delete h;
+        idle.clear();
+        curl_share_cleanup(share);
+    }
+
+    static void lockShare(CURL *, curl_lock_data data, curl_lock_access,
+                          void * userptr)
+    {
+        auto itl = reinterpret_cast<Itl *>(userptr);
+        itl->shareLocks[data % CURL_LOCK_DATA_LAST].lock();
+    }
+
+    static void unlockShare(CURL *, curl_lock_data data, void * userptr)
+    {
+        auto itl = reinterpret_cast<Itl *>(userptr);
+        itl->shareLocks[data % CURL_LOCK_DATA_LAST].unlock();
+    }
+
+    /// State kept for each host
+    struct Host {
+        int running = 0;
+        int maxRequests = -1;  ///< Overrides the pool's limit if >= 0
+        std::condition_variable slotFree;
+        HttpHostStats stats;
+    };
+
+    /// Limit on requests for the given host; zero or less is no limit
+    int getLimit(const Host & host) const
+    {
+        return host.maxRequests >= 0 ? host.maxRequests : maxRequestsPerHost;
+    }
+
+    Host & getHost(const std::string & host)
+    {
+        auto & result = hosts[host];
+        if (!result)
+            result.reset(new Host());
+        return *result;
+    }
+
+    /// Maximum number of idle handles kept around
+    static constexpr size_t MAX_IDLE_HANDLES = 256;
+
+    int maxRequestsPerHost;
+
+    CURLSH * share;
+    std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+    /// Protects everything below
+    mutable std::mutex lock;
+    std::vector<HttpRestProxy::ConnectionHandler *> idle;
+    std::unordered_map<std::string, std::unique_ptr<Host> > hosts;
+
+    /// GETs currently running, for coalescing
+    std::unordered_map<std::string,
+                       std::shared_future<HttpRestResponse> > inFlight;
+};
+
+HttpConnectionPool::
+HttpConnectionPool(int maxRequestsPerHost)
+    : itl(new Itl(maxRequestsPerHost))
+{
+}
+
+HttpConnectionPool::
+~HttpConnectionPool()
+{
+}
+
+std::shared_ptr<HttpConnectionPool>
+HttpConnectionPool::
+shared()
+{
+    static std::shared_ptr<HttpConnectionPool> result = [] ()
+        {
+            int maxRequestsPerHost = 64;
+            if (const char * env = getenv("MLDB_HTTP_MAX_REQUESTS_PER_HOST"))
+                maxRequestsPerHost = std::stoi(env);
+            return std::make_shared<HttpConnectionPool>(maxRequestsPerHost);
+        }();
+    return result;
+}
+
+void
+HttpConnectionPool::
+setMaxRequestsPerHost(int maxRequestsPerHost)
+{
+    std::unique_lock<std::mutex> guard(itl->lock);
+    itl->maxRequestsPerHost = maxRequestsPerHost;
+    for (auto & h: itl->hosts)
+        h.second->slotFree.notify_all();
+}
+
+void
+HttpConnectionPool::
+setMaxRequestsForHost(const std::string & hostKey, int maxRequests)
+{
+    std::unique_lock<std::mutex> guard(itl->lock);
+    auto & host = itl->getHost(hostKey);
+    host.maxRequests = maxRequests;
+    host.slotFree.notify_all();
+}
+
+std::map<std::string, HttpHostStats>
+HttpConnectionPool::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(itl->lock);
+    std::map<std::string, HttpHostStats> result;
+    for (auto & h: itl->hosts)
+        result[h.first] = h.second->stats;
+    return result;
+}
+
+void
+HttpConnectionPool::
+clearStats()
+{
+    std::unique_lock<std::mutex> guard(itl->lock);
+    for (auto & h: itl->hosts)
+        h.second->stats = HttpHostStats();
+}
+
+std::string
+HttpConnectionPool::
+getHostKey(const std::string & uri)
+{
+    size_t start = uri.find("://");
+    start = (start == std::string::npos ? 0 : start + 3);
+    size_t end = uri.find_first_of("/?#", start);
+    std::string scheme = start ? uri.substr(0, start - 3) : "http";
+    std::string host = uri.substr(start, end == std::string::npos
+                                  ? std::string::npos : end - start);
+
+    // Strip any credentials, and add the default port so that both forms
+    // of the URI are counted together.
+    size_t at = host.rfind('@');
+    if (at != std::string::npos)
+        host = host.substr(at + 1);
+    size_t bracket = host.rfind(']');
+    size_t colon = host.rfind(':');
+    if (colon == std::string::npos
+        || (bracket != std::string::npos && colon < bracket)) {
+        host += (scheme == "https" ? ":443" : ":80");
+    }
+    for (auto & c: host)
+        c = tolower(c);
+    return scheme + "://" + host;
+}
+
+HttpRestProxy::ConnectionHandler *
+HttpConnectionPool::
+acquireHandle()
+{
+    {
+        std::unique_lock<std::mutex> guard(itl->lock);
+        if (!itl->idle.empty()) {
+            auto result = itl->idle.back();
+            itl->idle.pop_back();
+            return result;
+        }
+    }
+    return new HttpRestProxy::ConnectionHandler();
+}
+
+void
+HttpConnectionPool::
+releaseHandle(HttpRestProxy::ConnectionHandler * handle)
+{
+    handle->reset();
+    std::unique_lock<std::mutex> guard(itl->lock);
+    if (itl->idle.size() < Itl::MAX_IDLE_HANDLES) {
+        itl->idle.push_back(handle);
+        return;
+    }
+    guard.unlock();
+    delete handle;
+}
+
+CURLcode
+HttpConnectionPool::
+perform(const std::string & hostKey,
+        HttpRestProxy::ConnectionHandler & handle,
+        bool limited)
+{
+    // Reset by each reset() of the handle, so set here for every request
+    handle.add_data_option(CURLOPT_SHARE, itl->share);
+
+    Itl::Host * host;
+    {
+        std::unique_lock<std::mutex> guard(itl->lock);
+        host = &itl->getHost(hostKey);
+        auto hasSlot = [&] ()
+            {
+                int limit = itl->getLimit(*host);
+                return limit <= 0 || host->running < limit;
+            };
+        if (limited && !hasSlot()) {
+            host->stats.waited += 1;
+            host->slotFree.wait(guard, hasSlot);
+        }
+        if (limited)
+            host->running += 1;
+    }
+
+    CURLcode code = handle.perform();
+
+    double seconds = 0, connectSeconds = 0;
+    long newConnections = 0;
+    curl_easy_getinfo((CURL *)handle, CURLINFO_TOTAL_TIME, &seconds);
+    curl_easy_getinfo((CURL *)handle, CURLINFO_CONNECT_TIME, &connectSeconds);
+    curl_easy_getinfo((CURL *)handle, CURLINFO_NUM_CONNECTS, &newConnections);
+
+    {
+        std::unique_lock<std::mutex> guard(itl->lock);
+        if (limited) {
+            host->running -= 1;
+            host->slotFree.notify_one();
+        }
+
+        auto & stats = host->stats;
+        stats.requests += 1;
+        if (code != CURLE_OK)
+            stats.errors += 1;
+        stats.newConnections += newConnections;
+        stats.totalSeconds += seconds;
+        stats.maxSeconds = std::max(stats.maxSeconds, seconds);
+        if (newConnections)
+            stats.connectSeconds += connectSeconds;
+    }
+
+    return code;
+}
+
+HttpRestResponse
+HttpConnectionPool::
+coalesce(const std::string & hostKey,
+         const std::string & key,
+         const std::function<HttpRestResponse ()> & doRequest)
+{
+    std::promise<HttpRestResponse> promise;
+    {
+        std::unique_lock<std::mutex> guard(itl->lock);
+        auto it = itl->inFlight.find(key);
+        if (it != itl->inFlight.end()) {
+            // Someone else is already asking; wait for their answer
+            auto future = it->second;
+            itl->getHost(hostKey).stats.coalesced += 1;
+            guard.unlock();
+            return future.get();
+        }
+
+        itl->inFlight.emplace(key, promise.get_future().share());
+    }
+
+    auto finish = [&] ()
+        {
+            std::unique_lock<std::mutex> guard(itl->lock);
+            itl->inFlight.erase(key);
+        };
+
+    try {
+        HttpRestResponse result = doRequest();
+        finish();
+        promise.set_value(result);
+        return result;
+    } catch (...) {
+        finish();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,132 @@
+/** http_connection_pool.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Connection pool shared between HttpRestProxy objects.
+*/
+
+#pragma once
+
+#include "http_rest_proxy.h"
+#include "mldb/types/value_description_fwd.h"
+#include <curl/curl.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HTTP HOST STATS                                                           */
+/*****************************************************************************/
+
+/** Statistics about the requests made to a host through a connection
+    pool. */
+struct HttpHostStats {
+    uint64_t requests = 0;        ///< Requests performed (not coalesced)
+    uint64_t errors = 0;          ///< Requests that failed without a response
+    uint64_t coalesced = 0;       ///< GETs answered by an identical request
+    uint64_t newConnections = 0;  ///< Connections that had to be opened
+    uint64_t waited = 0;          ///< Requests that waited for a free slot
+    double totalSeconds = 0;      ///< Total time of the requests performed
+    double maxSeconds = 0;        ///< Longest request
+    double connectSeconds = 0;    ///< Total time spent setting up connections
+
+    /// Average time of a request, in seconds
+    double meanSeconds() const
+    {
+        return requests ? totalSeconds / requests : 0.0;
+    }
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(HttpHostStats);
+
+
+/*****************************************************************************/
+/* HTTP CONNECTION POOL                                                      */
+/*****************************************************************************/
+
+/** Pool of HTTP connections used by HttpRestProxy.
+
+    Requests made through the same pool share a single curl connection
+    cache, so that keep-alive connections to a host are reused by every
+    proxy talking to it, along with DNS results and TLS sessions.  Curl
+    handles are recycled too.
+
+    The number of requests running at once against any given host is
+    bounded; extra requests wait for a slot.  Long polls, which the server
+    can hold open for as long as it likes, don't count against the bound.
+    Identical GET requests that are running at the same time can be
+    coalesced if the proxy or the request asks for it (see
+    HttpRestProxy::RequestFlags), in which case only one of them goes to
+    the server and they all get its response.
+
+    By default, all proxies use the pool returned by shared().
+*/
+
+struct HttpConnectionPool {
+    /** Create a pool that runs at most maxRequestsPerHost requests at once
+        against each host.  Zero means no limit. */
+    HttpConnectionPool(int maxRequestsPerHost = 64);
+
+    ~HttpConnectionPool();
+
+    /** Return the pool shared by all proxies that weren't given their own.
+        Its limit comes from the MLDB_HTTP_MAX_REQUESTS_PER_HOST environment
+        variable if it is set. */
+    static std::shared_ptr<HttpConnectionPool> shared();
+
+    /** Change the maximum number of concurrent requests per host.  Requests
+        that are already running aren't affected. */
+    void setMaxRequestsPerHost(int maxRequestsPerHost);
+
+    /** Change the maximum number of concurrent requests against a single
+        host, given by its scheme://host:port key (see getHostKey()), in
+        place of the pool's limit.  Zero means no limit, and a negative
+        number goes back to the pool's limit. */
+    void setMaxRequestsForHost(const std::string & hostKey,
+                               int maxRequests);
+
+    /** Return the statistics of each host that was used, keyed by
+        scheme://host:port. */
+    std::map<std::string, HttpHostStats> getStats() const;
+
+    /** Clear the statistics. */
+    void clearStats();
+
+    /** Return the scheme://host:port part of the given URI, which is what
+        requests are limited and counted by. */
+    static std::string getHostKey(const std::string & uri);
+
+    /* The following are used by HttpRestProxy. */
+
+    /// Take a curl handle from the pool, or create a new one
+    HttpRestProxy::ConnectionHandler * acquireHandle();
+
+    /// Return a handle to the pool once a request is done
+    void releaseHandle(HttpRestProxy::ConnectionHandler * handle);
+
+    /** Perform a request using the given handle, and record its
+        statistics.  If limited is true, it waits for the host to have a
+        free slot first.  The handle is hooked up to the pool's connection
+        cache before the request is performed. */
+    CURLcode perform(const std::string & host,
+                     HttpRestProxy::ConnectionHandler & handle,
+                     bool limited = true);
+
+    /** Run the given function to perform a GET, unless an identical one
+        (with the same key) is already running, in which case its response
+        or exception is returned instead. */
+    HttpRestResponse
+    coalesce(const std::string & host,
+             const std::string & key,
+             const std::function<HttpRestResponse ()> & doRequest);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
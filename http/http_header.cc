@@ -219,8 +219,82 @@ expectUrlEncodedString(ParseContext & context,
     return result;
 }
 
+/** Parse "key=value&key2=value2..." up to a space or the end. */
+void parseQueryParams(ParseContext & context, RestParams & queryParams)
+{
+    do {
+        string key = expectUrlEncodedString(context, "=& ");
+        if (context.match_literal('=')) {
+            string value = expectUrlEncodedString(context, "& ");
+            queryParams.push_back(make_pair(key, value));
+        } else {
+            queryParams.push_back(make_pair(key, ""));
+        }
+    } while (context.match_literal('&'));
+}
+
+/** Parse a "Name: value" header field, up to but not including the
+    end of line, into the header. */
+void parseHeaderField(ParseContext & context, HttpHeader & parsed)
+{
+    string name = context.expect_text("\r\n:");
+    for (auto & c: name)
+        c = tolower(c);
+    context.expect_literal(':');
+    context.match_whitespace();
+    if (name == "content-length") {
+        parsed.contentLength = context.expect_long_long();
+    }
+    else if (name == "content-type")
+        parsed.contentType = context.expect_text('\r');
+    else if (name == "transfer-encoding") {
+        string transferEncoding
+            = context.expect_text('\r');
+        for (auto & c: transferEncoding)
+            c = tolower(c);
+
+        if (transferEncoding != "chunked")
+            throw MLDB::Exception("unknown transfer-encoding");
+        parsed.isChunked = true;
+    }
+    else {
+        string value = context.expect_text('\r');
+        parsed.headers[name] = value;
+    }
+}
+
 } // file scope
 
+void
+HttpHeader::
+setRequestLine(const char * verbData, size_t verbSize,
+               const char * urlData, size_t urlSize,
+               const char * versionData, size_t versionSize)
+{
+    verb.assign(verbData, verbSize);
+    version.assign(versionData, versionSize);
+
+    const char * query = (const char *)memchr(urlData, '?', urlSize);
+    if (!query) {
+        resource.assign(urlData, urlSize);
+        return;
+    }
+
+    resource.assign(urlData, query - urlData);
+    ParseContext context("request line", query + 1, urlData + urlSize);
+    parseQueryParams(context, queryParams);
+}
+
+void
+HttpHeader::
+addHeaderLine(const char * data, size_t size)
+{
+    if (size <= 2)
+        return;  // blank line at the end of the headers
+    ParseContext context("request header", data, data + size);
+    parseHeaderField(context, *this);
+}
+
 void
 HttpHeader::
 parse(const std::string & headerAndData, bool checkBodyLength)
@@ -238,48 +312,14 @@ parse(const std::string & headerAndData, bool checkBodyLength)
         context.expect_literal(' ');
         parsed.resource = context.expect_text(" ?");
         if (context.match_literal('?')) {
-            do {
-                string key = expectUrlEncodedString(context, "=& ");
-                if (context.match_literal('=')) {
-                    string value = expectUrlEncodedString(context, "& ");
-                    queryParams.push_back(make_pair(key, value));
-                } else {
-                    queryParams.push_back(make_pair(key, ""));
-                }
-            } while (context.match_literal('&'));
+            parseQueryParams(context, queryParams);
         }
         context.expect_literal(' ');
         parsed.version = context.expect_text('\r');
         context.expect_eol();
 
         while (!context.match_literal("\r\n")) {
-            string name = context.expect_text("\r\n:");
-            for (auto & c: name)
-                c = tolower(c);
-            //cerr << "name = " << name << endl;
-            context.expect_literal(':');
-            context.match_whitespace();
-            if (name == "content-length") {
-                parsed.contentLength = context.expect_long_long();
-                //cerr << "******* set cntentLength " << parsed.contentLength
-                //     << endl;
-            }
-            else if (name == "content-type")
-                parsed.contentType = context.expect_text('\r');
-            else if (name == "transfer-encoding") {
-                string transferEncoding
-                    = context.expect_text('\r');
-                for (auto & c: transferEncoding)
-                    c = tolower(c);
-
-                if (transferEncoding != "chunked")
-                    throw MLDB::Exception("unknown transfer-encoding");
-                parsed.isChunked = true;
-            }
-            else {
-                string value = context.expect_text('\r');
-                parsed.headers[name] = value;
-            }
+            parseHeaderField(context, parsed);
             context.expect_eol();
         }
 
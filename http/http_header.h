@@ -88,6 +88,20 @@ struct HttpHeader {
 
     void parse(const std::string & headerAndData, bool checkBodyLength = true);
 
+    /** Set the verb, resource, query parameters and version from the parts
+        of a request line, as reported by HttpRequestParser::onRequestStart.
+        Together with addHeaderLine(), this fills in the header without
+        reassembling and re-parsing it.
+    */
+    void setRequestLine(const char * verbData, size_t verbSize,
+                        const char * urlData, size_t urlSize,
+                        const char * versionData, size_t versionSize);
+
+    /** Add a "Name: value\r\n" header line, as reported by
+        HttpParser::onHeader.  The empty line that ends the headers is
+        ignored. */
+    void addHeaderLine(const char * data, size_t size);
+
     std::string verb;       // GET, PUT, etc
     std::string resource;   // after the get
     std::string version;    // after the get
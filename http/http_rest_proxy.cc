@@ -18,6 +18,7 @@
 
 #include "http_rest_proxy.h"
 #include "http_rest_proxy_impl.h"
+#include "http_connection_pool.h"
 
 using namespace std;
 
@@ -161,7 +162,7 @@ urlEncode(const Utf8String & str)
 struct HttpRestProxy::Itl {
     Itl(std::string serviceUri, HttpRestProxy * owner)
         : serviceUri(std::move(serviceUri)), noSSLChecks(false), debug(false),
-          owner(owner)
+          owner(owner), pool(HttpConnectionPool::shared()), requestFlags(0)
     {
     }
 
@@ -178,43 +179,23 @@ struct HttpRestProxy::Itl {
 
     HttpRestProxy * owner;
 
-    /** Lock for connection pool. */
-    mutable std::mutex lock;
+    /** Pool that connections are taken from and returned to. */
+    std::shared_ptr<HttpConnectionPool> pool;
 
-    /** List of inactive handles.  These can be selected from when a new
-        connection needs to be made.
-    */
-    mutable std::vector<Connection> inactive;
+    /** RequestFlags added to those of every request. */
+    int requestFlags;
 
     std::vector<std::string> cookies;
 
     HttpRestProxy::Connection
     getConnection() const
     {
-        std::unique_lock<std::mutex> guard(lock);
-
-        if (inactive.empty()) {
-            return Connection(new ConnectionHandler, owner);
-        }
-        else {
-            Connection res(std::move(inactive.back()));
-            inactive.pop_back();
-
-            // Set proxy to this, so when it's destroyed it's put on our list
-            ExcAssert(res.proxy == nullptr);
-            res.proxy = owner;
-            return res;
-        }
+        return Connection(pool->acquireHandle(), owner);
     }
     
     void doneConnection(ConnectionHandler * conn)
     {
-        std::unique_lock<std::mutex> guard(lock);
-        conn->reset();
-
-        // Put a Connection with a null handler on the list so it's
-        // destroyed when done
-        inactive.emplace_back(conn, nullptr);
+        pool->releaseHandle(conn);
     }
 };
 
@@ -236,6 +217,35 @@ init(const std::string & serviceUri)
     itl->serviceUri = serviceUri;
 }
 
+void
+HttpRestProxy::
+setConnectionPool(std::shared_ptr<HttpConnectionPool> pool)
+{
+    ExcAssert(pool);
+    itl->pool = std::move(pool);
+}
+
+std::shared_ptr<HttpConnectionPool>
+HttpRestProxy::
+getConnectionPool() const
+{
+    return itl->pool;
+}
+
+void
+HttpRestProxy::
+setRequestFlags(int flags)
+{
+    itl->requestFlags = flags;
+}
+
+int
+HttpRestProxy::
+requestFlags() const
+{
+    return itl->requestFlags;
+}
+
 void
 HttpRestProxy::
 setCookieFromResponse(const Response& r)
@@ -290,11 +300,12 @@ get(const std::string & resource,
     OnData onData,
     OnHeader onHeader,
     bool followRedirect,
-    bool abortOnSlowConnection) const
+    bool abortOnSlowConnection,
+    int flags) const
 {
     return perform("GET", resource, Content(), queryParams, headers,
                    timeout, exceptions, onData, onHeader, followRedirect,
-                   abortOnSlowConnection);
+                   abortOnSlowConnection, flags);
 }
 
 HttpRestResponse
@@ -309,7 +320,51 @@ perform(const std::string & verb,
         OnData onData,
         OnHeader onHeader,
         bool followRedirect,
-        bool abortOnSlowConnection) const
+        bool abortOnSlowConnection,
+        int flags) const
+{
+    flags |= itl->requestFlags;
+
+    auto doRequest = [&] ()
+        {
+            return doPerform(verb, resource, content, queryParams, headers,
+                             timeout, exceptions, onData, onHeader,
+                             followRedirect, abortOnSlowConnection, flags);
+        };
+
+    // Plain GETs with nothing streamed back can share their response with
+    // identical ones running at the same time, if the caller allows it.
+    if (!(flags & COALESCE_GET)
+        || verb != "GET" || content.data || onData || onHeader)
+        return doRequest();
+
+    std::string uri = itl->serviceUri + resource + queryParams.uriEscaped();
+    std::string key = uri;
+    for (auto & h: headers)
+        key += "\n" + h.first.rawString() + ": " + h.second.rawString();
+    for (auto & c: itl->cookies)
+        key += "\n" + c;
+    key += MLDB::format("\n%f %d %d %d", timeout, exceptions,
+                        followRedirect, abortOnSlowConnection);
+
+    return itl->pool->coalesce(HttpConnectionPool::getHostKey(uri), key,
+                               doRequest);
+}
+
+HttpRestResponse
+HttpRestProxy::
+doPerform(const std::string & verb,
+          const std::string & resource,
+          const Content & content,
+          const RestParams & queryParams,
+          const RestParams & headers,
+          double timeout,
+          bool exceptions,
+          OnData onData,
+          OnHeader onHeader,
+          bool followRedirect,
+          bool abortOnSlowConnection,
+          int flags) const
 {
     string responseHeaders;
     string body;
@@ -429,7 +484,9 @@ perform(const std::string & verb,
 
         myRequest.add_header_option(curlHeaders);
 
-        CURLcode code = myRequest.perform();
+        CURLcode code = itl->pool->perform(HttpConnectionPool::getHostKey(uri),
+                                           *connection,
+                                           !(flags & LONG_POLL));
         response.body_ = body;
         if (code != CURLE_OK) {
             if (!exceptions) {
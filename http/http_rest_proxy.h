@@ -9,6 +9,7 @@
 
 #include <mutex>
 #include <functional>
+#include <memory>
 #include "mldb/http/http_header.h"
 
 namespace Json {
@@ -17,6 +18,8 @@ struct Value;
 
 namespace MLDB {
 
+struct HttpConnectionPool;
+
 
 /*****************************************************************************/
 /* HTTP REST RESPONSE                                                        */
@@ -167,6 +170,22 @@ struct HttpRestProxy {
     /** Add a cookie to the connection. */
     void setCookie(const std::string & value);
 
+    /** Flags that change how a request uses the connection pool.  They
+        can be given to each request, and set for all of the requests of a
+        proxy with setRequestFlags(). */
+    enum RequestFlags {
+        /** A GET that can be answered with the response of an identical
+            GET that is already running, rather than going to the server
+            itself.  Only for requests whose response doesn't depend on
+            when they are made. */
+        COALESCE_GET = 1 << 0,
+
+        /** A request that the server may hold open for a long time, such
+            as a long poll.  It doesn't take up one of the host's request
+            slots, so that it can't hold up other requests. */
+        LONG_POLL = 1 << 1
+    };
+
     /// Callback function for when data is received
     typedef std::function<bool (const std::string &)> OnData;
 
@@ -202,13 +221,16 @@ struct HttpRestProxy {
                  OnData onData = nullptr,
                  OnHeader onHeader = nullptr,
                  bool followRedirect = false,
-                 bool abortOnSlowConnection = false) const;
+                 bool abortOnSlowConnection = false,
+                 int flags = 0) const;
 
     /** Perform a synchronous request from end to end. 
         Note that when followRedirect is set, the onHeader
         callback will be called for each redirect, that is, 
         any response with code in [300, 400), but onData
         is only called on the last request.
+        The flags are a combination of RequestFlags, which are added to
+        those of the proxy.
      **/
     Response perform(const std::string & verb,
                      const std::string & resource,
@@ -220,20 +242,52 @@ struct HttpRestProxy {
                      OnData onData = nullptr,
                      OnHeader onHeader = nullptr,
                      bool followRedirect = false,
-                     bool abortOnSlowConnection = false) const;
-    
+                     bool abortOnSlowConnection = false,
+                     int flags = 0) const;
+
+    /** Set RequestFlags that apply to every request made through this
+        proxy.  None are set by default. */
+    void setRequestFlags(int flags);
+
+    /** Return the RequestFlags that apply to every request. */
+    int requestFlags() const;
+
+    /** Use the given connection pool instead of the shared one.  Must be
+        called before any requests are made. */
+    void setConnectionPool(std::shared_ptr<HttpConnectionPool> pool);
+
+    /** Return the connection pool used by this proxy. */
+    std::shared_ptr<HttpConnectionPool> getConnectionPool() const;
+
 public:
     /** Get a connection. */
     struct Connection;
     Connection getConnection() const;
 
 private:
+    friend struct HttpConnectionPool;
+
     /** Private type that implements a connection handler. */
     struct ConnectionHandler;
     struct Itl;
     std::unique_ptr<Itl> itl;
 
     void doneConnection(ConnectionHandler * conn);
+
+    /** Perform the request; perform() does this unless the request is
+        coalesced with another one. */
+    Response doPerform(const std::string & verb,
+                       const std::string & resource,
+                       const Content & content,
+                       const RestParams & queryParams,
+                       const RestParams & headers,
+                       double timeout,
+                       bool exceptions,
+                       OnData onData,
+                       OnHeader onHeader,
+                       bool followRedirect,
+                       bool abortOnSlowConnection,
+                       int flags) const;
 };
 
 std::ostream &
@@ -61,6 +61,46 @@ HttpResponse(int responseCode,
 }
 
 
+std::string
+HttpResponse::
+toWire() const
+{
+    string responseStr;
+    responseStr.reserve(16384 + body.length());
+
+    responseStr.append("HTTP/1.1 ");
+    responseStr.append(to_string(responseCode));
+    responseStr.append(" ");
+    responseStr.append(responseStatus);
+    responseStr.append("\r\n");
+
+    if (contentType != "") {
+        responseStr.append("Content-Type: ");
+        responseStr.append(contentType);
+        responseStr.append("\r\n");
+    }
+
+    if (sendBody) {
+        responseStr.append("Content-Length: ");
+        responseStr.append(to_string(body.length()));
+        responseStr.append("\r\n");
+        responseStr.append("Connection: Keep-Alive\r\n");
+    }
+
+    for (auto & h: extraHeaders) {
+        responseStr.append(h.first);
+        responseStr.append(": ");
+        responseStr.append(h.second);
+        responseStr.append("\r\n");
+    }
+
+    responseStr.append("\r\n");
+    responseStr.append(body);
+
+    return responseStr;
+}
+
+
 /****************************************************************************/
 /* HTTP HANDLER                                                             */
 /****************************************************************************/
@@ -165,39 +205,7 @@ putResponseOnWire(const HttpResponse & response,
                   std::function<void ()> onSendFinished,
                   NextAction next)
 {
-    string responseStr;
-    responseStr.reserve(16384 + response.body.length());
-
-    responseStr.append("HTTP/1.1 ");
-    responseStr.append(to_string(response.responseCode));
-    responseStr.append(" ");
-    responseStr.append(response.responseStatus);
-    responseStr.append("\r\n");
-
-    if (response.contentType != "") {
-        responseStr.append("Content-Type: ");
-        responseStr.append(response.contentType);
-        responseStr.append("\r\n");
-    }
-
-    if (response.sendBody) {
-        responseStr.append("Content-Length: ");
-        responseStr.append(to_string(response.body.length()));
-        responseStr.append("\r\n");
-        responseStr.append("Connection: Keep-Alive\r\n");
-    }
-
-    for (auto & h: response.extraHeaders) {
-        responseStr.append(h.first);
-        responseStr.append(": ");
-        responseStr.append(h.second);
-        responseStr.append("\r\n");
-    }
-
-    responseStr.append("\r\n");
-    responseStr.append(response.body);
-
-    send(std::move(responseStr), std::move(next), std::move(onSendFinished));
+    send(response.toWire(), std::move(next), std::move(onSendFinished));
 }
 
 void
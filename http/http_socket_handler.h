@@ -84,6 +84,9 @@ struct HttpResponse {
                  std::vector<std::pair<std::string, std::string> > extraHeaders
                      = std::vector<std::pair<std::string, std::string> >());
 
+    /** Return the status line, headers and body as sent on the wire. */
+    std::string toWire() const;
+
     int responseCode;
     std::string responseStatus;
     std::string contentType;
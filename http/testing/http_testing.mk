@@ -9,6 +9,7 @@ $(eval $(call library,test_services,test_http_services.cc,http io_base))
 $(eval $(call program,http_client_bench,boost_program_options http test_services value_description))
 $(eval $(call test,http_client_test,http test_services,boost))
 $(eval $(call test,http_client_online_test,http io_base,boost manual))
+$(eval $(call test,http_connection_pool_test,http,boost))
 
 # The following tests needs to be adapted to the new network code:
 # $(eval $(call test,endpoint_unit_test,http,boost))
@@ -4,7 +4,8 @@
    This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
    Ring buffer for when there are one or more producers and one consumer
-   chasing each other.
+   chasing each other, and a history ring buffer that keeps the most recent
+   values for any number of readers.
 */
 
 #pragma once
@@ -12,8 +13,12 @@
 #include <vector>
 #include "mldb/arch/futex.h"
 #include "mldb/arch/spinlock.h"
+#include "mldb/base/exc_assert.h"
 #include <mutex>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 
 namespace MLDB {
 
@@ -399,5 +404,169 @@ struct RingBufferSRMW : public RingBufferBase<Request> {
     }
 };
 
+
+/*****************************************************************************/
+/* RING BUFFER HISTORY                                                       */
+/*****************************************************************************/
+
+/** Ring buffer that keeps the last capacity() values pushed, overwriting
+    the oldest one once it's full.  Unlike the ring buffers above, reading
+    doesn't consume anything: any number of readers can look at the most
+    recent values while one or more writers push new ones.
+
+    Values are immutable once pushed and are handed out as shared pointers,
+    so reading never copies a value, and a reader can hold on to a value
+    after it's been overwritten in the ring.  Writers reserve their
+    sequence numbers with an atomic increment.  Slots are accessed with the
+    atomic shared_ptr operations, which are not lock-free: the standard
+    library guards them with a small pool of mutexes, held just long enough
+    to swap a pointer.  A writer that is overtaken by one that has already
+    come round the ring to the same slot drops its value rather than
+    overwriting the newer one.
+
+    Every value gets a sequence number, starting at zero, which readers
+    get back with the value.  Readers skip slots whose value has been
+    overwritten or hasn't been stored yet, so with concurrent writers a
+    read can have gaps in its sequence numbers.
+*/
+
+template<typename T>
+struct RingBufferHistory {
+    RingBufferHistory(size_t capacity)
+        : slots(capacity), reserved(0)
+    {
+        ExcAssertGreater(capacity, 0);
+    }
+
+    /** Create a ring buffer with a different capacity that starts off with
+        the most recent values in other, with the same sequence numbers.
+        Values that are pushed into other while this runs may not be
+        copied.
+    */
+    RingBufferHistory(size_t capacity, const RingBufferHistory & other)
+        : RingBufferHistory(capacity)
+    {
+        auto values = other.last(capacity);
+        uint64_t end = values.empty() ? 0 : values.back().first + 1;
+        for (auto & v: values) {
+            slots[v.first % capacity]
+                = std::make_shared<const Entry>(v.first, *v.second);
+        }
+        reserved = end;
+    }
+
+    typedef std::pair<uint64_t, std::shared_ptr<const T> > Sample;
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    /** Total number of values that have been pushed. */
+    uint64_t numPushed() const
+    {
+        return reserved.load();
+    }
+
+    /** Push a value, overwriting the oldest one if the buffer is full.
+        Returns the sequence number of the value.
+    */
+    uint64_t push(T value)
+    {
+        uint64_t seq = reserve();
+        set(seq, std::move(value));
+        return seq;
+    }
+
+    /** Reserve n consecutive sequence numbers, returning the first one.
+        Each must then be given its value with set().  push() does both.
+    */
+    uint64_t reserve(size_t n = 1)
+    {
+        return reserved.fetch_add(n);
+    }
+
+    /** Store the value for a sequence number returned by reserve().  Does
+        nothing if a newer value is already in its slot.
+    */
+    void set(uint64_t seq, T value)
+    {
+        store(std::make_shared<const Entry>(seq, std::move(value)));
+    }
+
+    /** Push a batch of values, which get consecutive sequence numbers.
+        Returns the sequence number of the first one.
+    */
+    uint64_t pushBatch(std::vector<T> values)
+    {
+        if (values.empty())
+            return reserved.load();
+        uint64_t first = reserve(values.size());
+        // If the batch is bigger than the ring, only the end is kept
+        size_t start = values.size() > slots.size()
+            ? values.size() - slots.size() : 0;
+        for (size_t i = start;  i < values.size();  ++i) {
+            set(first + i, std::move(values[i]));
+        }
+        return first;
+    }
+
+    /** Return up to n of the most recent values with their sequence
+        numbers, oldest first.
+    */
+    std::vector<Sample> last(size_t n) const
+    {
+        uint64_t end = numPushed();
+        n = std::min<uint64_t>({ (uint64_t)n, end, (uint64_t)slots.size() });
+
+        std::vector<Sample> result;
+        result.reserve(n);
+        for (uint64_t seq = end - n;  seq < end;  ++seq) {
+            auto entry = std::atomic_load(&slots[seq % slots.size()]);
+            if (!entry || entry->seq != seq)
+                continue;  // overwritten, or not stored yet
+            result.emplace_back(seq, std::shared_ptr<const T>(entry, &entry->value));
+        }
+        return result;
+    }
+
+    /** Return the most recent value, or a null pointer if nothing has been
+        pushed yet.
+    */
+    std::shared_ptr<const T> latest() const
+    {
+        auto result = last(1);
+        return result.empty() ? nullptr : std::move(result[0].second);
+    }
+
+private:
+    struct Entry {
+        Entry(uint64_t seq, T value)
+            : seq(seq), value(std::move(value))
+        {
+        }
+
+        uint64_t seq;
+        T value;
+    };
+
+    /* Put the entry in its slot, unless the slot already has a newer one
+       from a writer that reserved its sequence number later but stored it
+       first. */
+    void store(std::shared_ptr<const Entry> entry)
+    {
+        auto & slot = slots[entry->seq % slots.size()];
+        auto current = std::atomic_load(&slot);
+        do {
+            if (current && current->seq > entry->seq)
+                return;
+        } while (!std::atomic_compare_exchange_weak(&slot, &current, entry));
+    }
+
+    std::vector<std::shared_ptr<const Entry> > slots;
+    std::atomic<uint64_t> reserved;  ///< Next sequence number to give out
+};
+
+
 } // namespace MLDB
 
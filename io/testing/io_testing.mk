@@ -5,3 +5,4 @@ $(eval $(call test,async_writer_bench,io_base,boost))
 $(eval $(call test,epoll_test,io_base,boost))
 $(eval $(call test,message_channel_test,io_base,boost))
 $(eval $(call test,message_loop_test,io_base,boost))
+$(eval $(call test,ring_buffer_history_test,io_base,boost))
@@ -0,0 +1,162 @@
+// This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+/* ring_buffer_history_test.cc                                     -*- C++ -*-
+   Test for the history ring buffer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/io/ring_buffer.h"
+#include <thread>
+#include <atomic>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_ring_buffer_history_basics )
+{
+    RingBufferHistory<int> history(4);
+    BOOST_CHECK_EQUAL(history.capacity(), 4);
+    BOOST_CHECK_EQUAL(history.numPushed(), 0);
+    BOOST_CHECK(!history.latest());
+    BOOST_CHECK(history.last(10).empty());
+
+    for (int i = 0;  i < 3;  ++i)
+        BOOST_CHECK_EQUAL(history.push(i), i);
+
+    auto values = history.last(10);
+    BOOST_REQUIRE_EQUAL(values.size(), 3);
+    for (int i = 0;  i < 3;  ++i) {
+        BOOST_CHECK_EQUAL(values[i].first, i);
+        BOOST_CHECK_EQUAL(*values[i].second, i);
+    }
+
+    // Overwrite the oldest ones
+    for (int i = 3;  i < 10;  ++i)
+        history.push(i);
+
+    values = history.last(10);
+    BOOST_REQUIRE_EQUAL(values.size(), 4);
+    for (int i = 0;  i < 4;  ++i) {
+        BOOST_CHECK_EQUAL(values[i].first, i + 6);
+        BOOST_CHECK_EQUAL(*values[i].second, i + 6);
+    }
+
+    values = history.last(2);
+    BOOST_REQUIRE_EQUAL(values.size(), 2);
+    BOOST_CHECK_EQUAL(*values[0].second, 8);
+    BOOST_CHECK_EQUAL(*values[1].second, 9);
+    BOOST_CHECK_EQUAL(*history.latest(), 9);
+
+    // Values we hold stay valid once they're overwritten
+    auto held = history.latest();
+    for (int i = 10;  i < 20;  ++i)
+        history.push(i);
+    BOOST_CHECK_EQUAL(*held, 9);
+    BOOST_CHECK_EQUAL(*history.latest(), 19);
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_buffer_history_batch )
+{
+    RingBufferHistory<std::string> history(5);
+    BOOST_CHECK_EQUAL(history.pushBatch({ "a", "b", "c" }), 0);
+    BOOST_CHECK_EQUAL(history.pushBatch({}), 3);
+
+    // Bigger than the ring; only the end should be kept
+    BOOST_CHECK_EQUAL(history.pushBatch({ "d", "e", "f", "g", "h", "i", "j" }),
+                      3);
+    BOOST_CHECK_EQUAL(history.numPushed(), 10);
+
+    auto values = history.last(100);
+    BOOST_REQUIRE_EQUAL(values.size(), 5);
+    BOOST_CHECK_EQUAL(values[0].first, 5);
+    BOOST_CHECK_EQUAL(*values[0].second, "f");
+    BOOST_CHECK_EQUAL(values[4].first, 9);
+    BOOST_CHECK_EQUAL(*values[4].second, "j");
+
+    // Growing keeps the sequence numbers
+    RingBufferHistory<std::string> bigger(8, history);
+    BOOST_CHECK_EQUAL(bigger.numPushed(), 10);
+    BOOST_CHECK_EQUAL(bigger.push("k"), 10);
+    values = bigger.last(100);
+    BOOST_REQUIRE_EQUAL(values.size(), 6);
+    BOOST_CHECK_EQUAL(values[0].first, 5);
+    BOOST_CHECK_EQUAL(*values[0].second, "f");
+    BOOST_CHECK_EQUAL(*values[5].second, "k");
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_buffer_history_slow_writer )
+{
+    RingBufferHistory<int> history(2);
+
+    // The writer of 0 is overtaken by the writer of 2, which has the same
+    // slot, before it stores its value
+    uint64_t slow = history.reserve();
+    history.push(1);
+    history.push(2);
+    history.set(slow, 0);
+
+    auto values = history.last(2);
+    BOOST_REQUIRE_EQUAL(values.size(), 2);
+    BOOST_CHECK_EQUAL(values[0].first, 1);
+    BOOST_CHECK_EQUAL(*values[0].second, 1);
+    BOOST_CHECK_EQUAL(values[1].first, 2);
+    BOOST_CHECK_EQUAL(*values[1].second, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_buffer_history_concurrent )
+{
+    RingBufferHistory<std::pair<int, uint64_t> > history(64);
+
+    int numWriters = 4;
+    uint64_t numPerWriter = 10000;
+    std::atomic<bool> finished(false);
+    std::atomic<int> errors(0);
+
+    auto reader = [&] ()
+        {
+            while (!finished) {
+                auto values = history.last(64);
+                uint64_t lastSeen[4] = { 0, 0, 0, 0 };
+                for (size_t i = 0;  i < values.size();  ++i) {
+                    // Sequence numbers increase, and so do the values from
+                    // each writer
+                    if (i > 0 && values[i].first <= values[i - 1].first)
+                        ++errors;
+                    int writer = values[i].second->first;
+                    uint64_t n = values[i].second->second;
+                    if (n < lastSeen[writer])
+                        ++errors;
+                    lastSeen[writer] = n;
+                }
+            }
+        };
+
+    auto writer = [&] (int writer)
+        {
+            for (uint64_t i = 0;  i < numPerWriter;  ++i)
+                history.push({ writer, i });
+        };
+
+    std::vector<std::thread> readers;
+    for (int i = 0;  i < 2;  ++i)
+        readers.emplace_back(reader);
+    std::vector<std::thread> writers;
+    for (int i = 0;  i < numWriters;  ++i)
+        writers.emplace_back(writer, i);
+
+    for (auto & t: writers)
+        t.join();
+    finished = true;
+    for (auto & t: readers)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(history.numPushed(), numWriters * numPerWriter);
+    BOOST_CHECK_EQUAL(history.last(1000).size(), 64);
+}
@@ -273,6 +273,9 @@ struct EmbeddingDataset::Itl
     std::atomic<EmbeddingDatasetRepr *> uncommitted;
     std::string address;
 
+    /// Number of commits that changed the committed representation
+    std::atomic<int64_t> generation { 0 };
+
     RestRequestRouter router;
 
     shared_ptr<spdlog::logger> logger;
@@ -938,6 +941,7 @@ struct EmbeddingDataset::Itl
         
         committed.replace(uncommitted);
         uncommitted = nullptr;
+        ++generation;
 
         if (!address.empty()) {
             INFO_MSG(logger) << "saving embedding";
@@ -1084,6 +1088,13 @@ commit()
 {
     return itl->commit();
 }
+
+int64_t
+EmbeddingDataset::
+getGeneration() const
+{
+    return itl->generation;
+}
     
 std::pair<Date, Date>
 EmbeddingDataset::
@@ -57,6 +57,8 @@ struct EmbeddingDataset: public Dataset {
 
     virtual void commit();
 
+    virtual int64_t getGeneration() const;
+
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
     virtual std::shared_ptr<RowStream> getRowStream() const;
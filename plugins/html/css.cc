@@ -273,6 +273,131 @@ parse(MLDB::ParseContext & context)
 }
 
 
+/*****************************************************************************/
+/* COMPILED SELECTOR                                                         */
+/*****************************************************************************/
+
+namespace {
+
+// Add nodes for the given selector, whose first elements have the given
+// predecessors.  Returns the set of nodes that terminate a match of the
+// selector, or false if the selector can't be compiled.
+bool compileSelector(const Selector & selector,
+                     uint64_t predecessors,
+                     bool child,
+                     CompiledSelector & compiled,
+                     uint64_t & terminals)
+{
+    if (auto terminal = dynamic_cast<const SelectorTerminal *>(&selector)) {
+        if (compiled.nodes.size() == CompiledSelector::MAX_NODES)
+            return false;
+
+        CompiledSelector::Node node;
+        node.child = child;
+        node.predecessors = predecessors;
+
+        const SelectorSequence & sequence = *terminal->terminal;
+        if (auto type = dynamic_cast<const TypeSelector *>
+            (sequence.initial.get())) {
+            node.tag = type->tagName;
+        }
+        else if (!dynamic_cast<const UniversalSelector *>
+                 (sequence.initial.get())) {
+            return false;
+        }
+
+        for (auto & modifier: sequence.modifiers) {
+            if (auto cls = dynamic_cast<const ClassModifier *>
+                (modifier.get())) {
+                node.classes.push_back(cls->className);
+            }
+            else if (auto id = dynamic_cast<const IdModifier *>
+                     (modifier.get())) {
+                if (!node.id.empty() && node.id != id->idName)
+                    return false;
+                node.id = id->idName;
+            }
+            else return false;
+        }
+
+        terminals = uint64_t(1) << compiled.nodes.size();
+        compiled.nodes.emplace_back(std::move(node));
+        return true;
+    }
+    else if (auto op = dynamic_cast<const SelectorOp *>(&selector)) {
+        if (op->op != SelectorOp::DESCENDENT && op->op != SelectorOp::CHILD)
+            return false;
+        uint64_t leftTerminals = 0;
+        if (!compileSelector(*op->left, predecessors, child, compiled,
+                             leftTerminals))
+            return false;
+        return compileSelector(*op->right, leftTerminals,
+                               op->op == SelectorOp::CHILD,
+                               compiled, terminals);
+    }
+    else if (auto un = dynamic_cast<const SelectorUnion *>(&selector)) {
+        terminals = 0;
+        for (auto & e: un->elements) {
+            uint64_t elementTerminals = 0;
+            if (!compileSelector(*e, predecessors, child, compiled,
+                                 elementTerminals))
+                return false;
+            terminals |= elementTerminals;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+} // file scope
+
+std::shared_ptr<const CompiledSelector>
+CompiledSelector::
+compile(const Selector & selector)
+{
+    auto result = std::make_shared<CompiledSelector>();
+    if (!compileSelector(selector, 0 /* predecessors */, false /* child */,
+                         *result, result->accepting))
+        return nullptr;
+    return result;
+}
+
+uint64_t
+CompiledSelector::
+step(uint64_t parentMatched, uint64_t parentAvailable,
+     const PathElement & element) const
+{
+    uint64_t result = 0;
+    for (size_t i = 0;  i < nodes.size();  ++i) {
+        const Node & node = nodes[i];
+        if (node.predecessors) {
+            uint64_t prev = node.child ? parentMatched : parentAvailable;
+            if (!(prev & node.predecessors))
+                continue;
+        }
+        if (node.match(element))
+            result |= uint64_t(1) << i;
+    }
+    return result;
+}
+
+bool
+CompiledSelector::Node::
+match(const PathElement & element) const
+{
+    if (!tag.empty() && element.tag != tag)
+        return false;
+    if (!id.empty() && !element.hasId(id))
+        return false;
+    for (auto & c: classes) {
+        if (!element.hasClass(c))
+            return false;
+    }
+    return true;
+}
+
+
 /*****************************************************************************/
 /* VALUE DESCRIPTIONS                                                        */
 /*****************************************************************************/
@@ -404,6 +404,101 @@ struct SelectorUnion: public Selector {
     }
 };
 
+/*****************************************************************************/
+/* COMPILED SELECTOR                                                         */
+/*****************************************************************************/
+
+/** A selector compiled into a matching automaton.  Selector::match() needs
+    the whole path and enumerates all of the match locations within it for
+    each element tested, whereas a compiled selector keeps a small set of
+    active states for each level of the path and updates it as elements
+    are entered and exited.  This allows a selector to be evaluated in a
+    single streaming pass over a document, with constant work per tag.
+
+    Only selectors made of type, class and id tests joined with the
+    descendent and child combinators can be compiled; compile() returns
+    null for anything else, in which case Selector::match() should be used
+    instead.
+*/
+
+struct CompiledSelector {
+
+    /** Compile the given selector.  Returns null if the selector uses
+        features that can't be compiled.
+    */
+    static std::shared_ptr<const CompiledSelector>
+    compile(const Selector & selector);
+
+    /** Matching state over a path.  Elements are entered and exited in
+        document order; matches() tells whether the innermost element
+        that is currently entered matches the selector.
+    */
+    struct Matcher {
+        Matcher(const CompiledSelector * selector = nullptr)
+            : selector(selector)
+        {
+        }
+
+        const CompiledSelector * selector;
+
+        void enter(const PathElement & element)
+        {
+            uint64_t parentMatched = 0, parentAvailable = 0;
+            if (!levels.empty()) {
+                parentMatched = levels.back().first;
+                parentAvailable = levels.back().second;
+            }
+            uint64_t matched
+                = selector->step(parentMatched, parentAvailable, element);
+            levels.emplace_back(matched, parentAvailable | matched);
+        }
+
+        void exit()
+        {
+            ExcAssert(!levels.empty());
+            levels.pop_back();
+        }
+
+        bool matches() const
+        {
+            return !levels.empty()
+                && (levels.back().first & selector->accepting);
+        }
+
+        void clear()
+        {
+            levels.clear();
+        }
+
+    private:
+        /// For each level, the states matched at exactly that level and
+        /// the states matched at that level or any of its ancestors.
+        std::vector<std::pair<uint64_t, uint64_t> > levels;
+    };
+
+    /// Return the set of states matched at an element, given the states
+    /// matched by its parent and by any of its ancestors.
+    uint64_t step(uint64_t parentMatched, uint64_t parentAvailable,
+                  const PathElement & element) const;
+
+    /// Maximum number of nodes; states are stored in a 64 bit mask
+    static constexpr size_t MAX_NODES = 64;
+
+    struct Node {
+        Utf8String tag;   ///< Required tag name; empty means any
+        Utf8String id;    ///< Required id; empty means any
+        std::vector<Utf8String> classes;  ///< Required classes
+        bool child = false;  ///< Predecessor must be parent, not ancestor
+        uint64_t predecessors = 0;  ///< Empty means can start anywhere
+
+        bool match(const PathElement & element) const;
+    };
+
+    std::vector<Node> nodes;
+    uint64_t accepting = 0;   ///< States which signify a match
+};
+
+
 PREDECLARE_VALUE_DESCRIPTION(std::shared_ptr<Selector>);
 
 
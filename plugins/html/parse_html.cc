@@ -195,18 +195,37 @@ void parseHtml(const CellValue & html,
         throw AnnotatedException(500, "Error finishing HTTP parser: "
                                   + string(hubbub_error_to_string(err)));
     }
-
-    hubbub_charset_source source;
-    cerr << "charset is " << hubbub_parser_read_charset(parser, &source)
-         << endl;
 }
 
+/** Handler that keeps track of the path to the current element, and
+    whether it matches the selector.  When the selector could be
+    compiled, matching is done incrementally as tags are entered and
+    exited rather than by re-examining the whole path.
+*/
 struct ExtractHandler: public ParseHandler {
 
-    std::shared_ptr<Css::Selector> selector = Css::Selector::STAR;
-    
+    ExtractHandler(std::shared_ptr<Css::Selector> selector,
+                   std::shared_ptr<const Css::CompiledSelector> compiled)
+        : selector(std::move(selector)),
+          compiled(std::move(compiled)),
+          matcher(this->compiled.get())
+    {
+    }
+
+    std::shared_ptr<Css::Selector> selector;
+    std::shared_ptr<const Css::CompiledSelector> compiled;
+    Css::CompiledSelector::Matcher matcher;
+
     Css::Path path;
 
+    /// Does the current element match the selector?
+    bool matches() const
+    {
+        if (compiled)
+            return matcher.matches();
+        return selector->match(path);
+    }
+
     Utf8String pathToString() const
     {
         return path.toString();
@@ -248,6 +267,8 @@ struct ExtractHandler: public ParseHandler {
             element.classes.emplace_back(std::move(s));
         }
 
+        if (compiled)
+            matcher.enter(element);
         path.emplace_back(std::move(element));
 
         return HUBBUB_OK;
@@ -260,6 +281,8 @@ struct ExtractHandler: public ParseHandler {
         if (toString(tag.name) != path.back().tag)
             return HUBBUB_OK;
         path.pop_back();
+        if (compiled)
+            matcher.exit();
         return HUBBUB_OK;
     }
 
@@ -364,18 +387,16 @@ regParseHtml(htmlPackage(),
 
 struct LinkExtracter: public ExtractHandler {
 
+    using ExtractHandler::ExtractHandler;
+
     vector<Utf8String> links;
 
     virtual hubbub_error handleStartTag(const hubbub_tag & tag)
     {
         ExtractHandler::handleStartTag(tag);
 
-        if (toString(tag.name) == "a"
-            && selector->match(path)) {
-            Utf8String loc = getAttr(tag, "href");
-            links.push_back(loc);
-            
-            cerr << "link " << pathToString() << " at loc " << loc << endl;
+        if (path.back().tag == "a" && matches()) {
+            links.emplace_back(getAttr(tag, "href"));
         }
         return HUBBUB_OK;
     }
@@ -411,21 +432,13 @@ ExtractLinksOptionsDescription()
 }
 
 ExpressionValue
-extract_links(const std::vector<ExpressionValue> & args,
-              const SqlRowScope & context)
+extract_links(const ExpressionValue & html,
+              const std::shared_ptr<Css::Selector> & selector,
+              const std::shared_ptr<const Css::CompiledSelector> & compiled)
 {
-    checkArgsSize(args.size(), 1, 2, "extract_links");
-
-    ExtractLinksOptions options;
+    CellValue input = html.coerceToBlob();
 
-    if (args.size() > 1) {
-        options = args[1].extractT<ExtractLinksOptions>();
-    }
-
-    CellValue input = args[0].coerceToBlob();
-
-    LinkExtracter parser;
-    parser.selector = options.selector;
+    LinkExtracter parser(selector, compiled);
     parseHtml(input, parser);
     
     vector<CellValue> vals;
@@ -435,7 +448,7 @@ extract_links(const std::vector<ExpressionValue> & args,
     }
 
     return ExpressionValue(std::move(vals),
-                           args[0].getEffectiveTimestamp());
+                           html.getEffectiveTimestamp());
 }
 
 BoundFunction
@@ -446,10 +459,40 @@ bind_extract_links(const Utf8String &functionName,
     // Return an escaped string from a path
     checkArgsSize(args.size(), 1, 2, "extract_links");
 
-    return {
-        extract_links,
-        std::make_shared<EmbeddingValueInfo>(ST_UTF8STRING)
-    };
+    auto info = std::make_shared<EmbeddingValueInfo>(ST_UTF8STRING);
+
+    if (args.size() > 1 && !args[1].info->isConst()) {
+        // Options vary per row; we need to parse and compile the selector
+        // each time
+        auto exec = [] (const std::vector<ExpressionValue> & args,
+                        const SqlRowScope & scope) -> ExpressionValue
+            {
+                auto options = args[1].extractT<ExtractLinksOptions>();
+                return extract_links
+                    (args[0], options.selector,
+                     Css::CompiledSelector::compile(*options.selector));
+            };
+        return { exec, info };
+    }
+
+    // Constant options.  The selector is parsed and compiled once here,
+    // and the compiled automaton is shared between all applications.
+    ExtractLinksOptions options;
+    if (args.size() > 1) {
+        options = args[1].constantValue().extractT<ExtractLinksOptions>();
+    }
+    
+    std::shared_ptr<Css::Selector> selector = options.selector;
+    std::shared_ptr<const Css::CompiledSelector> compiled
+        = Css::CompiledSelector::compile(*selector);
+
+    auto exec = [=] (const std::vector<ExpressionValue> & args,
+                     const SqlRowScope & scope) -> ExpressionValue
+        {
+            return extract_links(args[0], selector, compiled);
+        };
+
+    return { exec, info };
 }
 
 static RegisterFunction
@@ -462,11 +505,12 @@ register_extract_links("extract_links", bind_extract_links);
 
 struct TextExtracter: public ParseHandler {
 
-    Utf8String text;
+    /// Raw text; it's validated once at the end rather than per fragment
+    std::string text;
 
     virtual hubbub_error handleText(const hubbub_string & text)
     {
-        this->text += toString(text);
+        this->text.append((const char *)text.ptr, text.len);
         return HUBBUB_OK;
     }
 };
@@ -482,7 +526,7 @@ extract_text(const std::vector<ExpressionValue> & args,
     TextExtracter parser;
     parseHtml(input, parser);
     
-    return ExpressionValue(std::move(parser.text),
+    return ExpressionValue(Utf8String(std::move(parser.text)),
                            args[0].getEffectiveTimestamp());
 }
 
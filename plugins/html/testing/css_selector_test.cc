@@ -73,3 +73,54 @@ BOOST_AUTO_TEST_CASE( test_css_selector_parsing )
     BOOST_CHECK_EQUAL(sel->match(Path::parse("h1 h3 h1")), false);
     BOOST_CHECK_EQUAL(sel->match(Path::parse("")), false);
 }
+
+BOOST_AUTO_TEST_CASE( test_compiled_selector_matches_interpreted )
+{
+    using namespace Css;
+
+    vector<string> selectors = {
+        "", "*", "h1", "h1 h2", "h1>h2", "h1 *", "h1>*",
+        "h1 h2 h3", "h1>h2 h3", "h1 h2>h3", "h1.big", "h1#title",
+        "div.a.b span", "h1, h2", "div h1, h2"
+    };
+
+    vector<string> paths = {
+        "", "h1", "h2", "h1 h2", "h1 h1", "h2 h1", "h3 h1 h2",
+        "h1 h1 h1", "h1 h3 h1", "h1 h2 h3", "h1 h3 h2 h3",
+        "h1 h2 h4 h3", "h1.big", "h1.small", "h1#title", "h1#other",
+        "div.a.b span", "div.a span", "div.b.a p span", "div h1 h2"
+    };
+
+    for (auto & s: selectors) {
+        auto sel = Selector::parse(s);
+        auto compiled = CompiledSelector::compile(*sel);
+        BOOST_REQUIRE(compiled);
+
+        for (auto & p: paths) {
+            Path path = Path::parse(p);
+
+            // Check the match at each prefix of the path, which is how
+            // the matcher is used while streaming through a document
+            CompiledSelector::Matcher matcher(compiled.get());
+            Path prefix;
+            for (auto & element: path) {
+                prefix.push_back(element);
+                matcher.enter(element);
+                BOOST_CHECK_MESSAGE(matcher.matches() == sel->match(prefix),
+                                    "selector '" << s << "' path '"
+                                    << prefix.toString() << "'");
+            }
+
+            // Exiting back to the root must restore the previous state
+            while (!prefix.empty()) {
+                BOOST_CHECK_EQUAL(matcher.matches(), sel->match(prefix));
+                prefix.pop_back();
+                matcher.exit();
+            }
+            BOOST_CHECK(!matcher.matches());
+        }
+    }
+
+    // Sibling combinators can't be compiled
+    BOOST_CHECK(!CompiledSelector::compile(*Selector::parse("h1+h2")));
+}
@@ -6,11 +6,13 @@ LIBALGEBRA_SOURCES := \
         lapack.cc \
 	ilaenv.c \
         svd.cc \
-        matrix_ops.cc
+        matrix_ops.cc \
+        sparse_glz.cc \
+        blocked_gemm.cc
 
 $(eval $(call add_sources,$(LIBALGEBRA_SOURCES)))
 
-LIBALGEBRA_LINK :=	utils lapack blas db
+LIBALGEBRA_LINK :=	utils lapack blas db base arch
 
 $(eval $(call library,algebra,$(LIBALGEBRA_SOURCES),$(LIBALGEBRA_LINK)))
 
@@ -0,0 +1,101 @@
+/* blocked_gemm.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Cache-blocked single precision matrix multiply.
+*/
+
+#include "blocked_gemm.h"
+#include "mldb/arch/simd_vector.h"
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SGEMM                                                                     */
+/*****************************************************************************/
+
+namespace {
+
+// Block sizes.  A packed KC x NC panel of B (256kb) should stay in the L2
+// cache, and a row of it plus a row of C in the L1 cache.
+enum {
+    MC = 64,    ///< Rows of A packed at once
+    KC = 128,   ///< Inner dimension of each panel
+    NC = 512    ///< Columns of B packed at once
+};
+
+} // file scope
+
+void sgemm(bool trans_a, bool trans_b,
+           size_t m, size_t n, size_t k,
+           float alpha,
+           const float * A, size_t lda,
+           const float * B, size_t ldb,
+           float beta,
+           float * C, size_t ldc)
+{
+    if (m == 0 || n == 0)
+        return;
+
+    for (size_t i = 0;  i < m;  ++i) {
+        float * c = C + i * ldc;
+        if (beta == 0.0f)
+            std::fill(c, c + n, 0.0f);
+        else if (beta != 1.0f)
+            MLDB::SIMD::vec_scale(c, beta, c, n);
+    }
+
+    if (alpha == 0.0f || k == 0)
+        return;
+
+    std::vector<float> packed_a(MC * KC), packed_b(KC * NC);
+
+    for (size_t j0 = 0;  j0 < n;  j0 += NC) {
+        size_t nc = std::min<size_t>(NC, n - j0);
+
+        for (size_t p0 = 0;  p0 < k;  p0 += KC) {
+            size_t kc = std::min<size_t>(KC, k - p0);
+
+            // Pack the kc x nc panel of op(B) so that its rows are
+            // contiguous
+            for (size_t p = 0;  p < kc;  ++p) {
+                float * b = &packed_b[p * nc];
+                if (trans_b) {
+                    for (size_t j = 0;  j < nc;  ++j)
+                        b[j] = B[(j0 + j) * ldb + p0 + p];
+                }
+                else {
+                    const float * row = B + (p0 + p) * ldb + j0;
+                    std::copy(row, row + nc, b);
+                }
+            }
+
+            for (size_t i0 = 0;  i0 < m;  i0 += MC) {
+                size_t mc = std::min<size_t>(MC, m - i0);
+
+                // Pack the mc x kc block of alpha * op(A)
+                for (size_t i = 0;  i < mc;  ++i) {
+                    float * a = &packed_a[i * kc];
+                    for (size_t p = 0;  p < kc;  ++p)
+                        a[p] = alpha * (trans_a
+                                        ? A[(p0 + p) * lda + i0 + i]
+                                        : A[(i0 + i) * lda + p0 + p]);
+                }
+
+                for (size_t i = 0;  i < mc;  ++i) {
+                    float * c = C + (i0 + i) * ldc + j0;
+                    const float * a = &packed_a[i * kc];
+                    for (size_t p = 0;  p < kc;  ++p)
+                        MLDB::SIMD::vec_add(c, a[p], &packed_b[p * nc], c, nc);
+                }
+            }
+        }
+    }
+}
+
+} // namespace ML
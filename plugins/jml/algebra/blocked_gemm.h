@@ -0,0 +1,41 @@
+/* blocked_gemm.h                                                  -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Cache-blocked single precision matrix multiply.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SGEMM                                                                     */
+/*****************************************************************************/
+
+/** Calculate C = alpha * op(A) * op(B) + beta * C, where op(X) is either X
+    or its transpose.  All matrices are row major: op(A) is m x k, op(B) is
+    k x n and C is m x n, and lda, ldb and ldc give the distance between the
+    start of each row of A, B and C.
+
+    The multiplication is done over panels of A and B that are packed so
+    that they stay in cache, and the inner loop is a SIMD multiply-add over
+    a row of the packed B panel.  It runs on the calling thread; callers
+    that need more are expected to parallelize over independent
+    multiplies.
+
+    Zeros in A are multiplied through like any other value, so NaNs and
+    infinities in B propagate to C.  As with BLAS, C is not read when beta
+    is zero and A and B are not read when alpha is zero.
+*/
+void sgemm(bool trans_a, bool trans_b,
+           size_t m, size_t n, size_t k,
+           float alpha,
+           const float * A, size_t lda,
+           const float * B, size_t ldb,
+           float beta,
+           float * C, size_t ldc);
+
+} // namespace ML
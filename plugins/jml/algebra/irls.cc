@@ -62,6 +62,7 @@ std::string print(Regularization regularization)
     case Regularization_none:        return "NONE";
     case Regularization_l1:          return "L1";
     case Regularization_l2:          return "L2";
+    case Regularization_elastic_net: return "ELASTIC_NET";
     default:           return format("Regularization(%d)", regularization);
     }
 }
@@ -76,8 +77,10 @@ Regularization parse_regularization_function(const std::string & regularization_
         regularization = Regularization_l1;
     else if (lowercase(regularization_name) == "l2")
         regularization = Regularization_l2;
+    else if (lowercase(regularization_name) == "elastic_net")
+        regularization = Regularization_elastic_net;
     else throw Exception("parse_regularization_function(): option '"
-                         + regularization_name + "' is not known ('none', 'l1', 'l2' accepted)");
+                         + regularization_name + "' is not known ('none', 'l1', 'l2', 'elastic_net' accepted)");
     return regularization;
 }
 
@@ -954,10 +957,11 @@ const char * Enum_Info<ML::Link_Function>::NAME
 COMPACT_PERSISTENT_ENUM_IMPL(Regularization);
   
 const Enum_Opt<ML::Regularization>
-Enum_Info<ML::Regularization>::OPT[3] = {
+Enum_Info<ML::Regularization>::OPT[4] = {
     { "none", ML::Regularization_none },
     { "l1",   ML::Regularization_l1 },
-    { "l2",   ML::Regularization_l2 }};
+    { "l2",   ML::Regularization_l2 },
+    { "elastic_net", ML::Regularization_elastic_net }};
 
 const char * Enum_Info<ML::Regularization>::NAME
    = "Regularization";
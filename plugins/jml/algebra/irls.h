@@ -27,6 +27,7 @@ enum Regularization{
     Regularization_none = 0,
     Regularization_l1,
     Regularization_l2,
+    Regularization_elastic_net  ///< Mix of l1 and l2; sparse solver only
 };
 
 COMPACT_PERSISTENT_ENUM_DECL(Regularization);
@@ -370,5 +371,5 @@ perform_irls(const distribution<double> & correct,
 
 
 DECLARE_ENUM_INFO(ML::Link_Function, 5);
-DECLARE_ENUM_INFO(ML::Regularization, 3);
+DECLARE_ENUM_INFO(ML::Regularization, 4);
 
@@ -0,0 +1,463 @@
+/* sparse_glz.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Training of generalized linear models over sparse, high dimensional
+   feature vectors.
+*/
+
+#include "sparse_glz.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CSR_MATRIX                                                                */
+/*****************************************************************************/
+
+void
+CSR_Matrix::
+add_row(const std::vector<std::pair<int, float> > & row)
+{
+    for (auto & v: row) {
+        if (v.first < 0 || v.first >= ncols)
+            throw MLDB::Exception("CSR_Matrix::add_row(): column %d out of "
+                                  "range", v.first);
+        columns.push_back(v.first);
+        values.push_back(v.second);
+    }
+    row_offsets.push_back(values.size());
+}
+
+CSR_Matrix
+CSR_Matrix::
+transpose() const
+{
+    CSR_Matrix result(nrows());
+    result.row_offsets.assign(ncols + 1, 0);
+
+    for (int c: columns)
+        result.row_offsets[c + 1] += 1;
+    for (int c = 0;  c < ncols;  ++c)
+        result.row_offsets[c + 1] += result.row_offsets[c];
+
+    result.columns.resize(nnz());
+    result.values.resize(nnz());
+
+    std::vector<size_t> pos(result.row_offsets.begin(),
+                            result.row_offsets.end() - 1);
+    for (size_t r = 0;  r < nrows();  ++r) {
+        for (size_t i = row_offsets[r];  i < row_offsets[r + 1];  ++i) {
+            size_t p = pos[columns[i]]++;
+            result.columns[p] = r;
+            result.values[p] = values[i];
+        }
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SPARSE GLZ                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/** Smooth part of the objective: weighted average loss plus the l2
+    penalty. */
+struct Sparse_GLZ_Objective {
+    Sparse_GLZ_Objective(const CSR_Matrix & x,
+                         const distribution<double> & correct,
+                         const distribution<double> & w,
+                         Link_Function link,
+                         bool add_bias,
+                         double l2)
+        : x(x), xt(x.transpose()), correct(correct), link(link),
+          add_bias(add_bias), l2(l2), nx(x.nrows()), nf(x.ncols),
+          nv(nf + add_bias), w(w), residuals(nx), losses(nx)
+    {
+        double total = w.total();
+        if (total <= 0.0)
+            throw MLDB::Exception("train_sparse_glz(): no weight in examples");
+        this->w /= total;
+    }
+
+    static constexpr size_t ROW_CHUNK = 1024;
+    static constexpr size_t COLUMN_CHUNK = 4096;
+
+    const CSR_Matrix & x;
+    CSR_Matrix xt;
+    const distribution<double> & correct;
+    Link_Function link;
+    bool add_bias;
+    double l2;
+    size_t nx, nf, nv;
+
+    distribution<double> w;  ///< Weights, normalized to sum to one
+    mutable std::vector<double> residuals, losses;
+
+    /** Return the objective at the given point and put its gradient into
+        grad. */
+    double operator () (const distribution<double> & beta,
+                        distribution<double> & grad) const
+    {
+        double bias = add_bias ? beta[nf] : 0.0;
+
+        // Loss and residual of each example, in parallel over rows
+        auto onRows = [&] (size_t first, size_t last)
+            {
+                for (size_t i = first;  i < last;  ++i) {
+                    double z = bias;
+                    for (size_t j = x.row_offsets[i];
+                         j < x.row_offsets[i + 1];  ++j)
+                        z += x.values[j] * beta[x.columns[j]];
+                    double y = correct[i];
+                    if (link == LOGIT) {
+                        // log(1 + exp(z)) - y z, computed stably
+                        double p = 1.0 / (1.0 + exp(-z));
+                        losses[i] = w[i] * (log1p(exp(-fabs(z)))
+                                            + std::max(z, 0.0) - y * z);
+                        residuals[i] = w[i] * (p - y);
+                    }
+                    else {
+                        double e = z - y;
+                        losses[i] = 0.5 * w[i] * e * e;
+                        residuals[i] = w[i] * e;
+                    }
+                }
+            };
+
+        if (nx > 0)
+            MLDB::parallelMapChunked(0, nx, ROW_CHUNK, onRows);
+
+        // Gradient, in parallel over columns
+        grad.resize(nv);
+        auto onColumns = [&] (size_t first, size_t last)
+            {
+                for (size_t c = first;  c < last;  ++c) {
+                    double g = 0.0;
+                    for (size_t j = xt.row_offsets[c];
+                         j < xt.row_offsets[c + 1];  ++j)
+                        g += xt.values[j] * residuals[xt.columns[j]];
+                    grad[c] = g + l2 * beta[c];
+                }
+            };
+
+        if (nf > 0)
+            MLDB::parallelMapChunked(0, nf, COLUMN_CHUNK, onColumns);
+
+        // Summed in order so that the result is deterministic
+        double result = 0.0, bias_grad = 0.0;
+        for (size_t i = 0;  i < nx;  ++i) {
+            result += losses[i];
+            bias_grad += residuals[i];
+        }
+        if (add_bias)
+            grad[nf] = bias_grad;
+
+        if (l2 != 0.0) {
+            double sumsq
+                = nf ? MLDB::SIMD::vec_dotprod(&beta[0], &beta[0], nf) : 0.0;
+            result += 0.5 * l2 * sumsq;
+        }
+
+        return result;
+    }
+};
+
+/** Return the matrix made up of the given rows of x. */
+CSR_Matrix select_rows(const CSR_Matrix & x, const std::vector<size_t> & rows)
+{
+    CSR_Matrix result(x.ncols);
+    for (size_t r: rows) {
+        result.columns.insert(result.columns.end(),
+                              x.columns.begin() + x.row_offsets[r],
+                              x.columns.begin() + x.row_offsets[r + 1]);
+        result.values.insert(result.values.end(),
+                             x.values.begin() + x.row_offsets[r],
+                             x.values.begin() + x.row_offsets[r + 1]);
+        result.row_offsets.push_back(result.values.size());
+    }
+    return result;
+}
+
+distribution<double> select(const distribution<double> & v,
+                            const std::vector<size_t> & rows)
+{
+    distribution<double> result(rows.size());
+    for (size_t i = 0;  i < rows.size();  ++i)
+        result[i] = v[rows[i]];
+    return result;
+}
+
+/** Choose the regularization factor when it's auto-determined.  Every
+    fifth example is held out, and the factor out of 1e-1, 1e-2, ... 1e-8
+    whose model has the lowest loss over the held out examples is
+    returned.  With too few examples to hold any out, the default of 1e-5
+    is used.
+*/
+double choose_regularization_factor(const CSR_Matrix & x,
+                                    const distribution<double> & correct,
+                                    const distribution<double> & w,
+                                    Link_Function link,
+                                    bool add_bias,
+                                    Regularization regularization,
+                                    double l1_ratio,
+                                    int max_iter,
+                                    double epsilon)
+{
+    static constexpr double DEFAULT_FACTOR = 1e-5;
+
+    std::vector<size_t> trainRows, testRows;
+    double trainWeight = 0.0, testWeight = 0.0;
+    for (size_t i = 0;  i < x.nrows();  ++i) {
+        if (i % 5 == 4) {
+            testRows.push_back(i);
+            testWeight += w[i];
+        }
+        else {
+            trainRows.push_back(i);
+            trainWeight += w[i];
+        }
+    }
+
+    if (trainWeight <= 0.0 || testWeight <= 0.0)
+        return DEFAULT_FACTOR;
+
+    CSR_Matrix trainX = select_rows(x, trainRows);
+    CSR_Matrix testX = select_rows(x, testRows);
+    distribution<double> trainCorrect = select(correct, trainRows);
+    distribution<double> trainW = select(w, trainRows);
+    distribution<double> testCorrect = select(correct, testRows);
+    distribution<double> testW = select(w, testRows);
+
+    // Unregularized loss over the held out examples
+    Sparse_GLZ_Objective testLoss(testX, testCorrect, testW, link, add_bias,
+                                  0.0 /* l2 */);
+
+    double bestFactor = DEFAULT_FACTOR;
+    double bestLoss = INFINITY;
+    distribution<double> grad;
+    for (double factor = 1e-1;  factor >= 1e-8;  factor /= 10.0) {
+        distribution<double> beta
+            = train_sparse_glz(trainX, trainCorrect, trainW, link, add_bias,
+                               regularization, factor, l1_ratio,
+                               max_iter, epsilon);
+        double loss = testLoss(beta, grad);
+        if (loss < bestLoss) {
+            bestLoss = loss;
+            bestFactor = factor;
+        }
+    }
+
+    return bestFactor;
+}
+
+double sign_of(double x)
+{
+    return (x > 0.0) - (x < 0.0);
+}
+
+} // file scope
+
+distribution<double>
+train_sparse_glz(const CSR_Matrix & x,
+                 const distribution<double> & correct,
+                 const distribution<double> & w,
+                 Link_Function link,
+                 bool add_bias,
+                 Regularization regularization,
+                 double regularization_factor,
+                 double l1_ratio,
+                 int max_iter,
+                 double epsilon)
+{
+    if (link != LOGIT && link != LINEAR)
+        throw MLDB::Exception("train_sparse_glz(): only LOGIT and LINEAR link "
+                              "functions are supported, not "
+                              + print(link));
+    if (correct.size() != x.nrows() || w.size() != x.nrows())
+        throw MLDB::Exception("train_sparse_glz(): wrong number of examples");
+
+    switch (regularization) {
+    case Regularization_none:        l1_ratio = 0.0;  regularization_factor = 0.0;  break;
+    case Regularization_l1:          l1_ratio = 1.0;  break;
+    case Regularization_l2:          l1_ratio = 0.0;  break;
+    case Regularization_elastic_net:
+        if (l1_ratio < 0.0 || l1_ratio > 1.0)
+            throw MLDB::Exception("train_sparse_glz(): l1_ratio must be "
+                                  "between 0 and 1");
+        break;
+    default:
+        throw MLDB::Exception("Unknown regularization method in "
+                              "train_sparse_glz");
+    }
+
+    if (regularization_factor < 0.0) {
+        regularization_factor
+            = choose_regularization_factor(x, correct, w, link, add_bias,
+                                           regularization, l1_ratio,
+                                           max_iter, epsilon);
+    }
+
+    double l1 = regularization_factor * l1_ratio;
+    double l2 = regularization_factor * (1.0 - l1_ratio);
+
+    Sparse_GLZ_Objective f(x, correct, w, link, add_bias, l2);
+    size_t nf = f.nf, nv = f.nv;
+    if (nv == 0)
+        return distribution<double>();
+
+    // Full objective, including the l1 penalty on the non-bias weights
+    auto objective = [&] (const distribution<double> & beta,
+                          distribution<double> & grad)
+        {
+            double result = f(beta, grad);
+            if (l1 != 0.0) {
+                double total = 0.0;
+                for (size_t j = 0;  j < nf;  ++j)
+                    total += fabs(beta[j]);
+                result += l1 * total;
+            }
+            return result;
+        };
+
+    // Gradient of the full objective where it exists, or the smallest
+    // subgradient otherwise
+    auto pseudoGradient = [&] (const distribution<double> & beta,
+                               const distribution<double> & grad,
+                               distribution<double> & pg)
+        {
+            pg = grad;
+            if (l1 == 0.0)
+                return;
+            for (size_t j = 0;  j < nf;  ++j) {
+                if (beta[j] > 0.0)
+                    pg[j] = grad[j] + l1;
+                else if (beta[j] < 0.0)
+                    pg[j] = grad[j] - l1;
+                else if (grad[j] + l1 < 0.0)
+                    pg[j] = grad[j] + l1;
+                else if (grad[j] - l1 > 0.0)
+                    pg[j] = grad[j] - l1;
+                else pg[j] = 0.0;
+            }
+        };
+
+    auto dot = [&] (const distribution<double> & a,
+                    const distribution<double> & b)
+        {
+            return MLDB::SIMD::vec_dotprod(&a[0], &b[0], nv);
+        };
+
+    static constexpr size_t HISTORY = 10;
+    std::deque<distribution<double> > s_hist, y_hist;
+    std::deque<double> rho_hist;
+
+    distribution<double> beta(nv, 0.0), grad, pg, dir(nv);
+    distribution<double> new_beta(nv), new_grad;
+
+    double value = objective(beta, grad);
+    pseudoGradient(beta, grad, pg);
+
+    for (int iter = 0;  iter < max_iter;  ++iter) {
+        double largest = 0.0;
+        for (double g: pg)
+            largest = std::max(largest, fabs(g));
+        if (largest < epsilon)
+            break;
+
+        // Two loop recursion to get the quasi-Newton direction
+        dir = -pg;
+        size_t m = s_hist.size();
+        std::vector<double> alpha(m);
+        for (int k = m - 1;  k >= 0;  --k) {
+            alpha[k] = rho_hist[k] * dot(s_hist[k], dir);
+            MLDB::SIMD::vec_add(&dir[0], -alpha[k], &y_hist[k][0], &dir[0], nv);
+        }
+        if (m > 0) {
+            double gamma = dot(s_hist[m - 1], y_hist[m - 1])
+                / dot(y_hist[m - 1], y_hist[m - 1]);
+            dir *= gamma;
+        }
+        for (size_t k = 0;  k < m;  ++k) {
+            double b = rho_hist[k] * dot(y_hist[k], dir);
+            MLDB::SIMD::vec_add(&dir[0], alpha[k] - b, &s_hist[k][0], &dir[0], nv);
+        }
+
+        // Keep within the orthant of descent for the l1 term
+        if (l1 != 0.0) {
+            for (size_t j = 0;  j < nf;  ++j)
+                if (dir[j] * pg[j] >= 0.0)
+                    dir[j] = 0.0;
+        }
+
+        if (dot(dir, pg) >= 0.0) {
+            // Not a descent direction; start again from steepest descent
+            dir = -pg;
+            s_hist.clear();  y_hist.clear();  rho_hist.clear();
+        }
+
+        // Backtracking line search, projecting onto the orthant
+        double step = (iter == 0 ? 1.0 / std::max(1.0, pg.two_norm()) : 1.0);
+        double new_value = value;
+        bool found = false;
+
+        for (int tries = 0;  tries < 40 && !found;  ++tries, step *= 0.5) {
+            for (size_t j = 0;  j < nv;  ++j)
+                new_beta[j] = beta[j] + step * dir[j];
+
+            if (l1 != 0.0) {
+                for (size_t j = 0;  j < nf;  ++j) {
+                    double orthant = beta[j] != 0.0 ? sign_of(beta[j]) : sign_of(-pg[j]);
+                    if (sign_of(new_beta[j]) != orthant)
+                        new_beta[j] = 0.0;
+                }
+            }
+
+            new_value = objective(new_beta, new_grad);
+
+            distribution<double> moved = new_beta - beta;
+            found = new_value <= value + 1e-4 * dot(pg, moved);
+        }
+
+        if (!found)
+            break;  // can't make any more progress
+
+        distribution<double> s = new_beta - beta;
+        distribution<double> y = new_grad - grad;
+        double sy = dot(s, y);
+        if (sy > 1e-10) {
+            s_hist.emplace_back(std::move(s));
+            y_hist.emplace_back(std::move(y));
+            rho_hist.push_back(1.0 / sy);
+            if (s_hist.size() > HISTORY) {
+                s_hist.pop_front();  y_hist.pop_front();  rho_hist.pop_front();
+            }
+        }
+
+        // Stop if we've stalled
+        bool stalled = value - new_value <= 1e-12 * fabs(value);
+
+        beta.swap(new_beta);
+        grad.swap(new_grad);
+        value = new_value;
+        pseudoGradient(beta, grad, pg);
+
+        if (stalled)
+            break;
+    }
+
+    return beta;
+}
+
+} // namespace ML
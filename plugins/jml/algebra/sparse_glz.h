@@ -0,0 +1,98 @@
+/* sparse_glz.h                                                    -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Training of generalized linear models over sparse, high dimensional
+   feature vectors.
+*/
+
+#pragma once
+
+#include <vector>
+#include "mldb/utils/distribution.h"
+#include "irls.h"
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CSR_MATRIX                                                                */
+/*****************************************************************************/
+
+/** Sparse matrix in compressed sparse row format.  For training, each row
+    is an example and each column a variable.
+*/
+
+struct CSR_Matrix {
+    CSR_Matrix(int ncols = 0)
+        : ncols(ncols), row_offsets(1, 0)
+    {
+    }
+
+    int ncols;                         ///< Number of columns
+    std::vector<size_t> row_offsets;   ///< nrows + 1 offsets into the below
+    std::vector<int> columns;          ///< Column of each non-zero value
+    std::vector<float> values;         ///< Non-zero values
+
+    size_t nrows() const { return row_offsets.size() - 1; }
+    size_t nnz() const { return values.size(); }
+
+    /** Add a row, given as (column, value) pairs.  The columns don't need
+        to be sorted but can't be repeated.
+    */
+    void add_row(const std::vector<std::pair<int, float> > & row);
+
+    /** Return the transpose, which is the compressed sparse column
+        representation of this matrix. */
+    CSR_Matrix transpose() const;
+};
+
+
+/*****************************************************************************/
+/* SPARSE GLZ                                                                */
+/*****************************************************************************/
+
+/** Train a generalized linear model over a sparse matrix, using the
+    L-BFGS algorithm.  When there is an l1 penalty, the orthant-wise
+    variant (OWL-QN) is used so that the weights are sparse too.  The loss
+    and gradient are evaluated over multiple threads.
+
+    The objective minimized is the weighted average loss over the examples
+    plus
+
+        regularization_factor * (l1_ratio * |b|_1 + (1 - l1_ratio) / 2 |b|_2^2)
+
+    where l1_ratio is 1 for Regularization_l1, 0 for Regularization_l2 and
+    the given value for Regularization_elastic_net.  The bias term isn't
+    regularized.
+
+    If regularization_factor is negative, it is chosen by holding out every
+    fifth example, training with factors of 1e-1, 1e-2, ... 1e-8 over the
+    others and keeping the one with the lowest loss on the held out
+    examples.  The model is then trained again over all of the examples.
+
+    \param x          nx x nv sparse matrix of examples.
+    \param correct    target value for each example (0 or 1 for LOGIT).
+    \param w          weight of each example.
+    \param link       LOGIT (logistic loss) or LINEAR (squared loss).
+    \param add_bias   add an unregularized bias term, which is returned
+                      as the last of the nv + 1 weights.
+    \param max_iter   maximum number of iterations.
+    \param epsilon    stop once the largest component of the (pseudo)
+                      gradient is below this.
+
+    \returns          a vector with nv (+1 with add_bias) entries, giving
+                      the trained weights.
+*/
+distribution<double>
+train_sparse_glz(const CSR_Matrix & x,
+                 const distribution<double> & correct,
+                 const distribution<double> & w,
+                 Link_Function link,
+                 bool add_bias,
+                 Regularization regularization = Regularization_l2,
+                 double regularization_factor = 1e-5,
+                 double l1_ratio = 0.5,
+                 int max_iter = 1000,
+                 double epsilon = 1e-4);
+
+} // namespace ML
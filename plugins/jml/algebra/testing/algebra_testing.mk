@@ -2,3 +2,5 @@
 
 $(eval $(call test,least_squares_test,algebra utils arch,boost))
 $(eval $(call test,remove_dependent_test,algebra,boost))
+$(eval $(call test,sparse_glz_test,algebra,boost))
+$(eval $(call test,blocked_gemm_test,algebra,boost))
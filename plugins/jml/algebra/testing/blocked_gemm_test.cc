@@ -0,0 +1,127 @@
+/* blocked_gemm_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the blocked matrix multiply.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/algebra/blocked_gemm.h"
+#include <random>
+#include <vector>
+#include <cmath>
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+/** Straightforward version to compare against. */
+void naive_gemm(bool trans_a, bool trans_b,
+                size_t m, size_t n, size_t k, float alpha,
+                const vector<float> & A, size_t lda,
+                const vector<float> & B, size_t ldb,
+                float beta, vector<float> & C, size_t ldc)
+{
+    for (size_t i = 0;  i < m;  ++i) {
+        for (size_t j = 0;  j < n;  ++j) {
+            double total = 0.0;
+            for (size_t p = 0;  p < k;  ++p) {
+                float a = trans_a ? A[p * lda + i] : A[i * lda + p];
+                float b = trans_b ? B[j * ldb + p] : B[p * ldb + j];
+                total += a * b;
+            }
+            C[i * ldc + j] = alpha * total + beta * C[i * ldc + j];
+        }
+    }
+}
+
+void check_gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                float alpha, float beta)
+{
+    std::mt19937 rng(m * 1000 + n * 10 + k);
+    std::uniform_real_distribution<float> val(-1.0, 1.0);
+
+    // Leave some padding at the end of each row to test the strides
+    size_t lda = (trans_a ? m : k) + 3;
+    size_t ldb = (trans_b ? k : n) + 1;
+    size_t ldc = n + 2;
+
+    vector<float> A((trans_a ? k : m) * lda), B((trans_b ? n : k) * ldb);
+    vector<float> C(m * ldc);
+    for (auto & v: A)
+        v = val(rng);
+    for (auto & v: B)
+        v = val(rng);
+    for (auto & v: C)
+        v = val(rng);
+
+    // Some zeros in A, which must still be multiplied through
+    for (size_t i = 0;  i < A.size();  i += 7)
+        A[i] = 0.0;
+
+    vector<float> expected = C;
+    naive_gemm(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb,
+               beta, expected, ldc);
+    sgemm(trans_a, trans_b, m, n, k, alpha, A.data(), lda, B.data(), ldb,
+          beta, C.data(), ldc);
+
+    double max_error = 0.0;
+    for (size_t i = 0;  i < m;  ++i)
+        for (size_t j = 0;  j < n;  ++j)
+            max_error = std::max<double>(max_error,
+                                         fabs(C[i * ldc + j]
+                                              - expected[i * ldc + j]));
+
+    BOOST_CHECK_LT(max_error, 1e-3 * std::max<size_t>(1, k / 100));
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_sgemm_small )
+{
+    for (bool ta: { false, true })
+        for (bool tb: { false, true })
+            check_gemm(ta, tb, 3, 5, 4, 1.0, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgemm_blocks )
+{
+    // Sizes that aren't multiples of the block sizes in any dimension
+    for (bool ta: { false, true })
+        for (bool tb: { false, true })
+            check_gemm(ta, tb, 131, 1030, 300, 0.5, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgemm_scaling )
+{
+    check_gemm(false, false, 17, 9, 33, -2.0, 0.25);
+
+    // With alpha = 0, C is only scaled
+    check_gemm(false, true, 10, 10, 10, 0.0, 3.0);
+
+    // With k = 0, the same
+    check_gemm(true, false, 10, 10, 0, 1.0, 0.5);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgemm_non_finite )
+{
+    // A zero in A times a NaN or infinity in B is NaN, as with any other
+    // gemm; it mustn't be skipped
+    vector<float> A = { 0.0, 1.0,
+                        0.0, 0.0 };
+    vector<float> B = { NAN, INFINITY,
+                        2.0, 3.0 };
+    vector<float> C(4, 0.0);
+
+    sgemm(false, false, 2, 2, 2, 1.0, A.data(), 2, B.data(), 2,
+          0.0, C.data(), 2);
+
+    BOOST_CHECK(std::isnan(C[0]));
+    BOOST_CHECK(std::isnan(C[1]));
+    BOOST_CHECK(std::isnan(C[2]));
+    BOOST_CHECK(std::isnan(C[3]));
+}
@@ -0,0 +1,206 @@
+/* sparse_glz_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the sparse GLZ trainer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/algebra/sparse_glz.h"
+#include <cmath>
+#include <random>
+#include <set>
+#include <iostream>
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_csr_transpose )
+{
+    CSR_Matrix m(4);
+    m.add_row({ { 0, 1.0 }, { 3, 2.0 } });
+    m.add_row({});
+    m.add_row({ { 3, 3.0 }, { 1, 4.0 } });
+
+    BOOST_CHECK_EQUAL(m.nrows(), 3);
+    BOOST_CHECK_EQUAL(m.nnz(), 4);
+    BOOST_CHECK_THROW(m.add_row({ { 4, 1.0 } }), std::exception);
+
+    CSR_Matrix t = m.transpose();
+    BOOST_CHECK_EQUAL(t.nrows(), 4);
+    BOOST_CHECK_EQUAL(t.ncols, 3);
+    BOOST_CHECK_EQUAL(t.nnz(), 4);
+
+    vector<size_t> offsets = { 0, 1, 2, 2, 4 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(t.row_offsets.begin(), t.row_offsets.end(),
+                                  offsets.begin(), offsets.end());
+    vector<int> columns = { 0, 2, 0, 2 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(t.columns.begin(), t.columns.end(),
+                                  columns.begin(), columns.end());
+    vector<float> values = { 1.0, 4.0, 2.0, 3.0 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(t.values.begin(), t.values.end(),
+                                  values.begin(), values.end());
+}
+
+namespace {
+
+/** Make a problem with many features, of which only the first few are
+    informative and each example has only a handful. */
+void make_problem(CSR_Matrix & x, distribution<double> & correct,
+                  int nx, int nf, int informative, bool classification)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> feature(0, nf - 1);
+    std::uniform_int_distribution<int> useful(0, informative - 1);
+
+    x = CSR_Matrix(nf);
+    correct.resize(nx);
+
+    for (int i = 0;  i < nx;  ++i) {
+        std::set<int> features;
+        for (unsigned j = 0;  j < 10;  ++j)
+            features.insert(feature(rng));
+        features.insert(useful(rng));
+
+        std::vector<std::pair<int, float> > row;
+        double score = -0.5;
+        for (int f: features) {
+            row.emplace_back(f, 1.0);
+            if (f < informative)
+                score += (f % 2 ? 1.0 : -1.0);
+        }
+        x.add_row(row);
+
+        if (classification)
+            correct[i] = score > 0;
+        else correct[i] = score;
+    }
+}
+
+double accuracy(const CSR_Matrix & x, const distribution<double> & correct,
+                const distribution<double> & weights)
+{
+    int nf = x.ncols, right = 0;
+    for (size_t i = 0;  i < x.nrows();  ++i) {
+        double z = weights[nf];
+        for (size_t j = x.row_offsets[i];  j < x.row_offsets[i + 1];  ++j)
+            z += x.values[j] * weights[x.columns[j]];
+        right += (z > 0) == (correct[i] > 0.5);
+    }
+    return 1.0 * right / x.nrows();
+}
+
+int nonzero(const distribution<double> & weights)
+{
+    int result = 0;
+    for (double w: weights)
+        result += (w != 0.0);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_sparse_logistic )
+{
+    int nx = 5000, nf = 1 << 16, informative = 8;
+    CSR_Matrix x;
+    distribution<double> correct;
+    make_problem(x, correct, nx, nf, informative, true /* classification */);
+    distribution<double> w(nx, 1.0);
+
+    distribution<double> l2
+        = train_sparse_glz(x, correct, w, LOGIT, true /* bias */,
+                           Regularization_l2, 1e-4);
+    BOOST_REQUIRE_EQUAL(l2.size(), nf + 1);
+    cerr << "l2 accuracy " << accuracy(x, correct, l2)
+         << " nonzero " << nonzero(l2) << endl;
+    BOOST_CHECK_GT(accuracy(x, correct, l2), 0.98);
+
+    // The informative features have the right sign
+    for (int f = 0;  f < informative;  ++f)
+        BOOST_CHECK_EQUAL(l2[f] > 0, f % 2 == 1);
+
+    // l1 makes most of the weights zero, without losing accuracy
+    distribution<double> l1
+        = train_sparse_glz(x, correct, w, LOGIT, true /* bias */,
+                           Regularization_l1, 1e-3);
+    cerr << "l1 accuracy " << accuracy(x, correct, l1)
+         << " nonzero " << nonzero(l1) << endl;
+    BOOST_CHECK_GT(accuracy(x, correct, l1), 0.98);
+    BOOST_CHECK_LT(nonzero(l1), nonzero(l2) / 10);
+    for (int f = 0;  f < informative;  ++f)
+        BOOST_CHECK_NE(l1[f], 0.0);
+
+    distribution<double> en
+        = train_sparse_glz(x, correct, w, LOGIT, true /* bias */,
+                           Regularization_elastic_net, 1e-3, 0.5);
+    cerr << "elastic net accuracy " << accuracy(x, correct, en)
+         << " nonzero " << nonzero(en) << endl;
+    BOOST_CHECK_GT(accuracy(x, correct, en), 0.98);
+    BOOST_CHECK_LT(nonzero(en), nonzero(l2));
+    BOOST_CHECK_GE(nonzero(en), nonzero(l1));
+
+    BOOST_CHECK_THROW(train_sparse_glz(x, correct, w, PROBIT, true),
+                      std::exception);
+    BOOST_CHECK_THROW(train_sparse_glz(x, correct, w, LOGIT, true,
+                                       Regularization_elastic_net, 1e-3, 2.0),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_linear )
+{
+    int nx = 2000, nf = 1000, informative = 8;
+    CSR_Matrix x;
+    distribution<double> correct;
+    make_problem(x, correct, nx, nf, informative, false /* classification */);
+    distribution<double> w(nx, 1.0);
+
+    // The target is exactly linear, so without regularization we should
+    // find it
+    distribution<double> trained
+        = train_sparse_glz(x, correct, w, LINEAR, true /* bias */,
+                           Regularization_none, 0.0, 0.0, 1000, 1e-8);
+
+    for (int f = 0;  f < informative;  ++f)
+        BOOST_CHECK_CLOSE(trained[f], f % 2 ? 1.0 : -1.0, 0.1);
+    BOOST_CHECK_CLOSE(trained[nf], -0.5, 0.1);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_auto_regularization )
+{
+    // A negative regularization factor is chosen on held out examples,
+    // rather than being used as a (negative) penalty
+    int nx = 2000, nf = 4096, informative = 8;
+    CSR_Matrix x;
+    distribution<double> correct;
+    make_problem(x, correct, nx, nf, informative, true /* classification */);
+    distribution<double> w(nx, 1.0);
+
+    for (auto regularization: { Regularization_l2, Regularization_l1 }) {
+        distribution<double> trained
+            = train_sparse_glz(x, correct, w, LOGIT, true /* bias */,
+                               regularization, -1.0);
+        BOOST_REQUIRE_EQUAL(trained.size(), nf + 1);
+        for (double v: trained)
+            BOOST_REQUIRE(std::isfinite(v));
+        cerr << "auto " << regularization << " accuracy "
+             << accuracy(x, correct, trained)
+             << " nonzero " << nonzero(trained) << endl;
+        BOOST_CHECK_GT(accuracy(x, correct, trained), 0.95);
+        for (int f = 0;  f < informative;  ++f)
+            BOOST_CHECK_EQUAL(trained[f] > 0, f % 2 == 1);
+    }
+
+    // Too few examples to hold any out uses the default
+    CSR_Matrix small(2);
+    small.add_row({ { 0, 1.0 } });
+    small.add_row({ { 1, 1.0 } });
+    distribution<double> smallCorrect = { 1.0, 0.0 }, smallW = { 1.0, 1.0 };
+    BOOST_CHECK_EQUAL(train_sparse_glz(small, smallCorrect, smallW, LOGIT,
+                                       true, Regularization_l2, -1.0),
+                      train_sparse_glz(small, smallCorrect, smallW, LOGIT,
+                                       true, Regularization_l2, 1e-5));
+}
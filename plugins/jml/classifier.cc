@@ -10,6 +10,8 @@
 #include "classifier.h"
 #include "mldb/plugins/jml/jml/classifier.h"
 #include "dataset_feature_space.h"
+#include "feature_space_cache.h"
+#include "frozen_classifier.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/core/dataset.h"
 #include "mldb/engine/bound_queries.h"
@@ -136,6 +138,20 @@ ClassifierConfigDescription()
              "URL where the model file (with extension '.cls') should be saved. "
              "This file can be loaded by the ![](%%doclink classifier function). "
              "This parameter is optional unless the `functionName` parameter is used.");
+    addField("featureCacheUrl", &ClassifierConfig::featureCacheUrl,
+             "Directory (a `file://` URL) in which to cache the type and "
+             "values of the feature columns.  Training several classifiers "
+             "over the same feature columns of the same version of the "
+             "dataset then extracts them only once.  No caching is done "
+             "when this is empty.");
+    addField("frozenModel", &ClassifierConfig::frozenModel,
+             "Save the model in the frozen format, where the trees are "
+             "flattened into arrays that the ![](%%doclink classifier function) "
+             "memory maps instead of reading them.  Frozen models load in "
+             "the same time whatever their size, and processes that load "
+             "the same model file share its memory.  Only decision trees "
+             "and ensembles of them (bagged decision trees and random "
+             "forests) can be frozen.", false);
     addField("functionName", &ClassifierConfig::functionName,
              "If specified, an instance of the ![](%%doclink classifier function) of this name will be created using "
              "the trained model. Note that to use this parameter, the `modelFileUrl` must "
@@ -345,8 +361,10 @@ run(const ProcedureRunConfig & run,
 
     // TODO: it's not the feature space itself, but indeed the output of
     // the select expression that's important...
-    auto featureSpace = std::make_shared<DatasetFeatureSpace>
-        (boundDataset.dataset, labelInfo, knownInputColumns);
+    auto featureSpace = FeatureSpaceCache::get
+        (boundDataset.dataset, runProcConf.trainingData.stm->from->print(),
+         labelInfo, knownInputColumns, false /* bucketize */,
+         runProcConf.featureCacheUrl);
 
     INFO_MSG(logger) << "initialized feature space in " << timer.elapsed();
 
@@ -972,7 +990,10 @@ run(const ProcedureRunConfig & run,
 
     if (!runProcConf.modelFileUrl.empty()) {
         try {
-            classifier.save(runProcConf.modelFileUrl.toDecodedString());
+            if (runProcConf.frozenModel)
+                FrozenTreeEnsemble::save(*classifier.impl,
+                                         runProcConf.modelFileUrl);
+            else classifier.save(runProcConf.modelFileUrl.toDecodedString());
         }
         MLDB_CATCH_ALL {
             rethrowException(400, "Error saving classifier to '"
@@ -1032,7 +1053,30 @@ ClassifyFunction(MldbEngine * owner,
 
     itl.reset(new Itl());
 
-    itl->classifier.load(functionConfig.modelFileUrl.toDecodedString());
+    // Frozen models are mapped rather than read.  Only local files can be
+    // mapped, so other URLs are read once, and then loaded in whichever
+    // format they turn out to be.
+    const Url & url = functionConfig.modelFileUrl;
+    if (url.scheme() == "file") {
+        if (FrozenTreeEnsemble::isFrozen(url))
+            itl->classifier.impl = FrozenTreeEnsemble::load(url);
+        else itl->classifier.load(url.toDecodedString());
+    }
+    else {
+        filter_istream stream(url);
+        auto data = std::make_shared<std::string>
+            (std::istreambuf_iterator<char>(stream),
+             std::istreambuf_iterator<char>());
+        if (FrozenTreeEnsemble::isFrozen(data->data(), data->size())) {
+            FrozenMemoryRegion region(data, data->data(), data->size());
+            itl->classifier.impl
+                = std::make_shared<FrozenTreeEnsemble>(std::move(region));
+        }
+        else {
+            DB::Store_Reader store(data->data(), data->size());
+            itl->classifier.reconstitute(store);
+        }
+    }
 
     itl->featureSpace = itl->classifier.feature_space<DatasetFeatureSpace>();
 
@@ -1367,6 +1411,11 @@ ExplainFunction(MldbEngine * owner,
                 const std::function<bool (const Json::Value &)> & onProgress)
     : ClassifyFunction(owner, config, onProgress)
 {
+    if (dynamic_cast<const FrozenTreeEnsemble *>(itl->classifier.impl.get()))
+        throw AnnotatedException
+            (400, "The classifier.explain function can't explain frozen "
+             "models; train the model without the 'frozenModel' parameter",
+             "modelFileUrl", functionConfig.modelFileUrl);
 }
 
 ExplainFunction::
@@ -53,6 +53,12 @@ struct ClassifierConfig : public ProcedureConfig {
     /// Where to save the classifier to
     Url modelFileUrl;
 
+    /// Directory in which to keep the extracted feature space between runs
+    Url featureCacheUrl;
+
+    /// Save the model in the flat, memory mapped format
+    bool frozenModel = false;
+
     /// Configuration of the algorithm.  If empty, the configurationFile
     /// will be used instead.
     Json::Value configuration;
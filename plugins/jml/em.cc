@@ -13,12 +13,14 @@
 #include "mldb/arch/math_builtins.h"
 
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 
 #include <random>
-#include <mutex>
+#include <numeric>
+#include <algorithm>
 
 #include "mldb/plugins/jml/algebra/matrix_ops.h"
-#include "mldb/plugins/jml/algebra/least_squares.h"
 #include "mldb/types/jml_serialization.h"
 
 using namespace std;
@@ -34,69 +36,286 @@ double distance(const distribution<double> & x,
     return (x - y).two_norm();
 }
 
-double gaussianDistance(const distribution<double> & pt,
-                        const distribution<double> & origin,
-                        const MatrixType& covarianceMatrix, 
-                        const  MatrixType & invertCovarianceMatrix,
-                        float determinant)
+namespace {
+
+/** Sufficient statistics of the points assigned to each cluster: the
+    total responsibility, and the responsibility weighted sums of the
+    points and of their outer products (only the upper triangle is kept,
+    or only the diagonal for diagonal covariances).
+*/
+struct SufficientStatistics {
+    SufficientStatistics(int numClusters = 0, int numDimensions = 0,
+                         bool diagonal = false)
+        : numClusters(numClusters), numDimensions(numDimensions),
+          diagonal(diagonal),
+          weights(numClusters),
+          sums(numClusters * numDimensions),
+          squares(numClusters * numDimensions
+                  * (diagonal ? 1 : numDimensions))
+    {
+    }
+
+    int numClusters;
+    int numDimensions;
+    bool diagonal;
+    std::vector<double> weights;
+    std::vector<double> sums;
+    std::vector<double> squares;
+
+    double * sum(int cluster)
+    {
+        return sums.data() + cluster * numDimensions;
+    }
+
+    double * square(int cluster)
+    {
+        return squares.data()
+            + cluster * numDimensions * (diagonal ? 1 : numDimensions);
+    }
+
+    void add(const double * point, const double * resp)
+    {
+        int d = numDimensions;
+        for (int c = 0;  c < numClusters;  ++c) {
+            double r = resp[c];
+            if (r == 0.0)
+                continue;
+            weights[c] += r;
+            SIMD::vec_add(sum(c), r, point, sum(c), d);
+            double * sq = square(c);
+            if (diagonal) {
+                SIMD::vec_add_sqr(sq, r, point, sq, d);
+                continue;
+            }
+            for (int i = 0;  i < d;  ++i) {
+                double * row = sq + i * d;
+                SIMD::vec_add(row + i, r * point[i], point + i, row + i,
+                              d - i);
+            }
+        }
+    }
+
+    void add(const SufficientStatistics & other, double k = 1.0)
+    {
+        SIMD::vec_add(weights.data(), k, other.weights.data(),
+                      weights.data(), weights.size());
+        SIMD::vec_add(sums.data(), k, other.sums.data(),
+                      sums.data(), sums.size());
+        SIMD::vec_add(squares.data(), k, other.squares.data(),
+                      squares.data(), squares.size());
+    }
+
+    void scale(double k)
+    {
+        SIMD::vec_scale(weights.data(), k, weights.data(), weights.size());
+        SIMD::vec_scale(sums.data(), k, sums.data(), sums.size());
+        SIMD::vec_scale(squares.data(), k, squares.data(), squares.size());
+    }
+};
+
+/** E step: accumulate the sufficient statistics of the given points (all
+    of them if indexes is null) under the current clusters, and record
+    the most likely cluster of each point.  The points are split into one
+    part per thread, and the parts are merged in order so that the result
+    doesn't depend on the scheduling.
+*/
+SufficientStatistics
+expectation(const EstimationMaximisation & em,
+            const std::vector<distribution<double>> & points,
+            const int * indexes, size_t n,
+            std::vector<int> & in_cluster,
+            bool diagonal)
 {
-    auto xToU = pt - origin;
-    auto variance = invertCovarianceMatrix * xToU ;
+    static constexpr size_t MIN_PART_SIZE = 256;
+
+    int numClusters = em.clusters.size();
+    int numDimensions = points[0].size();
+
+    size_t numParts
+        = std::max<size_t>(1, std::min<size_t>(numCpus(),
+                                               n / MIN_PART_SIZE));
+    std::vector<SufficientStatistics>
+        parts(numParts,
+              SufficientStatistics(numClusters, numDimensions, diagonal));
+
+    auto onPart = [&] (size_t p)
+        {
+            std::vector<double> resp(numClusters), scratch(numDimensions);
+            for (size_t i = n * p / numParts;  i < n * (p + 1) / numParts;
+                 ++i) {
+                size_t index = indexes ? indexes[i] : i;
+                const double * point = points[index].data();
+                in_cluster[index]
+                    = em.responsibilities(point, resp.data(),
+                                          scratch.data());
+                parts[p].add(point, resp.data());
+            }
+        };
+
+    parallelMap(0, numParts, onPart);
 
-    double value_exponent = -0.5f*xToU.dotprod(variance);
-    double determinantCovMatrix = determinant;
+    for (size_t p = 1;  p < numParts;  ++p)
+        parts[0].add(parts[p]);
 
-    if (determinantCovMatrix < 0)
-      determinantCovMatrix = fabs(determinantCovMatrix);
+    return std::move(parts[0]);
+}
+
+/** M step: set the parameters of the clusters from the sufficient
+    statistics.  Clusters without members are left where they are.  The
+    total weight is scaled by weightScale, for when the statistics were
+    normalized.
+*/
+void
+maximization(EstimationMaximisation & em,
+             SufficientStatistics & stats,
+             double weightScale)
+{
+    int d = stats.numDimensions;
+
+    auto onCluster = [&] (size_t c)
+        {
+            auto & cluster = em.clusters[c];
+            double weight = stats.weights[c];
+            cluster.totalWeight = weight * weightScale;
+            if (cluster.totalWeight < 0.000001f)
+                return;
+
+            const double * sum = stats.sum(c);
+            const double * sq = stats.square(c);
+            for (int i = 0;  i < d;  ++i)
+                cluster.centroid[i] = sum[i] / weight;
+
+            const auto & mu = cluster.centroid;
+            auto & cov = cluster.covarianceMatrix;
+            cov.resize(boost::extents[d][d]);
+            for (int i = 0;  i < d;  ++i) {
+                if (stats.diagonal) {
+                    std::fill(cov[i].begin(), cov[i].end(), 0.0);
+                    cov[i][i] = sq[i] / weight - mu[i] * mu[i];
+                }
+                else {
+                    for (int j = i;  j < d;  ++j)
+                        cov[i][j] = cov[j][i]
+                            = sq[i * d + j] / weight - mu[i] * mu[j];
+                }
+                // Rounding can make a null variance slightly negative
+                cov[i][i] = std::max(cov[i][i], 0.0);
+            }
 
-    double distance
-        = (1.0f / (pow(2.0f * 3.14159, pt.size() / 2.0f)
-                   * sqrt(determinantCovMatrix))) 
-        * std::exp(value_exponent);
-    
-    return distance;
+            cluster.prepare();
+        };
 
+    parallelMap(0, em.clusters.size(), onCluster);
 }
 
+} // file scope
 
-boost::multi_array<double, 2>
-EstimateCovariance(int i,
-                   const std::vector<distribution<double>> & points, 
-                   const  MatrixType& distanceMatrix,
-                   double totalWeight,
-                   distribution<double> average)
+void
+EstimationMaximisation::Cluster::
+prepare()
 {
-    boost::multi_array<double, 2> variant;
-
-    if (totalWeight < 0.000001f)
-      return variant;
+    int d = centroid.size();
+    ExcAssertEqual(covarianceMatrix.shape()[0], d);
+    ExcAssertEqual(covarianceMatrix.shape()[1], d);
+
+    const auto & cov = covarianceMatrix;
+
+    diagonal = true;
+    for (int i = 0;  i < d && diagonal;  ++i)
+        for (int j = 0;  j < d && diagonal;  ++j)
+            diagonal = i == j || cov[i][j] == 0.0;
+
+    double logDeterminant = 0.0;
+    invertCovarianceMatrix.resize(boost::extents[d][d]);
+    std::fill(invertCovarianceMatrix.data(),
+              invertCovarianceMatrix.data() + d * d, 0.0);
+
+    if (diagonal) {
+        invVariances.resize(d);
+        for (int i = 0;  i < d;  ++i) {
+            if (cov[i][i] < MIN_VARIANCE) {
+                invVariances[i] = 0.0;
+                continue;
+            }
+            invVariances[i] = 1.0 / cov[i][i];
+            logDeterminant += std::log(cov[i][i]);
+            invertCovarianceMatrix[i][i] = invVariances[i];
+        }
+        cholesky.resize(boost::extents[0][0]);
+        invCholeskyDiagonal.clear();
+    }
+    else {
+        // Cholesky decomposition cov = L L^T.  A pivot that is too small
+        // means that the direction is degenerate given the previous ones,
+        // in which case its column is dropped.
+        cholesky.resize(boost::extents[d][d]);
+        std::fill(cholesky.data(), cholesky.data() + d * d, 0.0);
+        invCholeskyDiagonal.resize(d);
+        auto & L = cholesky;
+
+        for (int j = 0;  j < d;  ++j) {
+            double pivot = cov[j][j]
+                - SIMD::vec_twonorm_sqr(&L[j][0], j);
+            if (pivot < MIN_VARIANCE) {
+                invCholeskyDiagonal[j] = 0.0;
+                continue;
+            }
+            double ljj = std::sqrt(pivot);
+            L[j][j] = ljj;
+            invCholeskyDiagonal[j] = 1.0 / ljj;
+            logDeterminant += 2.0 * std::log(ljj);
+            for (int i = j + 1;  i < d;  ++i)
+                L[i][j] = (cov[i][j] - SIMD::vec_dotprod(&L[i][0], &L[j][0], j))
+                    / ljj;
+        }
 
-    variant.resize(boost::extents[average.size()][average.size()]);
-    for (int n = 0; n < distanceMatrix.shape()[0]; ++n)
-    {
-        distribution<double> pt = points[n] - average;
-        double distance = distanceMatrix[n][i];
-        int dim = average.size();
-        MatrixType variantPt(boost::extents[dim][dim]);
-
-	    for (unsigned i = 0;  i < dim;  ++i)
-	    {
-	        for (unsigned j = 0;  j < dim;  ++j)
-	        {
-	            variantPt[i][j] = pt[i]*pt[j] * distance;    
-	        }
-	    }
-
-        if (n == 0) {                                    
-            variant = std::move(variantPt);
+        // Inverse of the covariance, (L^-1)^T L^-1, which is kept in the
+        // model file
+        MatrixType W(boost::extents[d][d]);
+        std::fill(W.data(), W.data() + d * d, 0.0);
+        for (int k = 0;  k < d;  ++k) {
+            // Column k of L^-1 by forward substitution
+            for (int i = k;  i < d;  ++i) {
+                double v = (i == k);
+                for (int j = k;  j < i;  ++j)
+                    v -= L[i][j] * W[j][k];
+                W[i][k] = v * invCholeskyDiagonal[i];
+            }
         }
-        else {
-            variant = std::move(variant + variantPt);
+        for (int i = 0;  i < d;  ++i)
+            for (int j = 0;  j < d;  ++j)
+                for (int k = std::max(i, j);  k < d;  ++k)
+                    invertCovarianceMatrix[i][j] += W[k][i] * W[k][j];
+    }
+
+    pseudoDeterminant = std::exp(logDeterminant);
+    logNormalization = -0.5 * (d * std::log(2.0 * M_PI) + logDeterminant);
+}
+
+double
+EstimationMaximisation::Cluster::
+logDensity(const double * point, double * scratch) const
+{
+    int d = centroid.size();
+    SIMD::vec_minus(point, centroid.data(), scratch, d);
+
+    double mahalanobis;
+    if (diagonal) {
+        mahalanobis = SIMD::vec_accum_prod3(scratch, scratch,
+                                            invVariances.data(), d);
+    }
+    else {
+        // Solve L y = x - mu in place; the squared norm of y is the
+        // squared Mahalanobis distance
+        for (int i = 0;  i < d;  ++i) {
+            double v = scratch[i] - SIMD::vec_dotprod(&cholesky[i][0],
+                                                      scratch, i);
+            scratch[i] = v * invCholeskyDiagonal[i];
         }
+        mahalanobis = SIMD::vec_twonorm_sqr(scratch, d);
     }
 
-    variant = variant / totalWeight;
-    return variant;
+    return logNormalization - 0.5 * mahalanobis;
 }
 
 void
@@ -105,7 +324,9 @@ train(const std::vector<distribution<double>> & points,
       std::vector<int> & in_cluster,
       int nbClusters,
       int maxIterations,
-      int randomSeed) 
+      int randomSeed,
+      bool diagonalCovariance,
+      size_t batchSize)
 {
     using namespace std;
 
@@ -119,9 +340,6 @@ train(const std::vector<distribution<double>> & points,
     in_cluster.resize(npoints, -1);
     clusters.resize(nbClusters);
 
-    boost::multi_array<double, 2> distanceMatrix
-        (boost::extents[npoints][nbClusters]);
-
     // Smart initialization of the centroids
     // Same as Kmeans at the moment
     clusters[0].centroid = points[rng() % points.size()];
@@ -143,8 +361,6 @@ train(const std::vector<distribution<double>> & points,
 
                 double dist = distance(points[randomIdx], clusters[k].centroid);
 
-                distanceMatrix[j][i] = dist;
-
                 if (dist < distMin) {
                     distMin = dist;
                 }
@@ -162,109 +378,61 @@ train(const std::vector<distribution<double>> & points,
 
     int numdimensions = points[0].size();
     for (int i=0; i < nbClusters; ++i) {
-
         ML::setIdentity<double>(numdimensions, clusters[i].covarianceMatrix);
-        clusters[i].invertCovarianceMatrix
-            .resize(boost::extents[numdimensions][numdimensions]);
-        clusters[i].invertCovarianceMatrix = clusters[i].covarianceMatrix;
-        clusters[i].pseudoDeterminant = 1.0f; 
+        clusters[i].prepare();
     }
 
-    for (int iter = 0;  iter < maxIterations;  ++iter) {
-
-        // How many have changed cluster?  Used to know when the cluster
-        // contents are stable
-        std::atomic<int> changes(0);
+    if (batchSize == 0 || batchSize >= npoints) {
+        for (int iter = 0;  iter < maxIterations;  ++iter) {
+            //Step 1: assign each point to a distribution in the mixture
+            auto stats = expectation(*this, points, nullptr, npoints,
+                                     in_cluster, diagonalCovariance);
 
-        //Step 1: assign each point to a distribution in the mixture
-
-        auto findNewCluster = [&] (int i) {
-            
-            int best_cluster = this->assign(points[i], distanceMatrix, i);
-
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
-            }
-        };
-
-        for (int i = 0; i < points.size(); ++i)
-            findNewCluster(i);
-
-        //Step 2: maximizing distribution's parameters 
-        for (auto & c : clusters) {
-            // If no member, we want to leave it there
-            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-            c.totalWeight = 0.0f;
+            //Step 2: maximizing distribution's parameters
+            maximization(*this, stats, 1.0);
         }
+    }
+    else {
+        // Stepwise EM: the statistics of each batch, normalized by its
+        // size, are interpolated into running statistics with a decreasing
+        // step size, and the parameters are updated after each batch
+        // (Liang and Klein, Online EM for Unsupervised Models, 2009).
+        static constexpr double STEP_SIZE_DECAY = 0.7;
 
-        std::vector<std::mutex> locks(clusters.size());
+        vector<int> order(npoints);
+        std::iota(order.begin(), order.end(), 0);
 
-        auto addToMeanForPoint = [&] (int i) {
+        SufficientStatistics running(nbClusters, numdimensions,
+                                     diagonalCovariance);
+        int step = 0;
 
-            auto point = points[i];
-            for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-                double distance = distanceMatrix[i][cluster];
-                clusters[cluster].centroid += point * distance;
-                clusters[cluster].totalWeight += distance;
-            }
-        };
+        for (int iter = 0;  iter < maxIterations;  ++iter) {
+            std::shuffle(order.begin(), order.end(), rng);
 
-        // calculate mean
-        for (int i = 0; i < points.size(); ++i) {
-            addToMeanForPoint(i);
-        }
+            for (size_t first = 0;  first < npoints;  first += batchSize) {
+                size_t num = std::min<size_t>(batchSize, npoints - first);
+                auto stats = expectation(*this, points, order.data() + first,
+                                         num, in_cluster, diagonalCovariance);
 
-        //normalizeMean
-        for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-            if (clusters[cluster].totalWeight > 0.000001f)
-                {
-                    clusters[cluster].centroid
-                        = clusters[cluster].centroid
-                        / clusters[cluster].totalWeight;
-                }
-        }
-	     
-        //calculate covariant matrix
-        for (int i = 0; i < clusters.size(); ++i) {
-            clusters[i].covarianceMatrix
-                = EstimateCovariance(i, points, distanceMatrix,
-                                     clusters[i].totalWeight,
-                                     clusters[i].centroid);
-            ExcAssertEqual(clusters[i].covarianceMatrix.shape()[0],
-                           clusters[i].covarianceMatrix.shape()[1]);
-
-            auto svdMatrix = clusters[i].covarianceMatrix;
-            MatrixType VT,U;
-            distribution<double> svalues;
-            ML::svd_square(svdMatrix, VT, U, svalues);
-
-            //Remove small values and calculate pseudo determinant
-            double pseudoDeterminant = 1.0f;
-            auto invertSingularValues = svalues;
-            for (int i = 0; i < svalues.size(); ++i) {
-
-                if (svalues[i] < 0.0001f) {
-                    svalues[i] = 0.0f;
-                    invertSingularValues[i] = 0.0f;
-                }
-                else {
-                    pseudoDeterminant *= svalues[i];
-                    invertSingularValues[i] = 1.0f / svalues[i];
-                }
-            }
+                double eta = pow(step + 2, -STEP_SIZE_DECAY);
+                if (step == 0)
+                    eta = 1.0;
+                ++step;
 
-            // calculate pseudo inverse and pseudo determinant
+                running.scale(1.0 - eta);
+                running.add(stats, eta / num);
 
-            // We dont actually need the pseudo covariant but it sould look
-            // like this
-            // MatrixType pseudoCovariant = U * diag(svalues) * VT;
-            
-            clusters[i].invertCovarianceMatrix
-                = transpose(VT) * diag(invertSingularValues) * transpose(U);
-            clusters[i].pseudoDeterminant = pseudoDeterminant;
+                maximization(*this, running, npoints);
+            }
         }
     }
+
+    // The assignments above were made before the last update of the
+    // clusters (in stepwise mode, as each batch was seen); assign all of
+    // the points again under the final clusters so that they agree with
+    // assign()
+    expectation(*this, points, nullptr, npoints, in_cluster,
+                diagonalCovariance);
 }
 
 int
@@ -285,45 +453,41 @@ assign(const distribution<double> & point,
     if (clusters.size() == 0)
         throw MLDB::Exception("Did you train your em?");
 
-    distribution<double> distances(clusters.size());
-    for (int i=0; i < clusters.size(); ++i) {
-        distances[i]
-            = gaussianDistance(point, clusters[i].centroid,
-                               clusters[i].covarianceMatrix,
-                               clusters[i].invertCovarianceMatrix,
-                               clusters[i].pseudoDeterminant);
-    }
+    distribution<double> resp(clusters.size());
+    distribution<double> scratch(point.size());
+    int best_cluster = responsibilities(point.data(), resp.data(),
+                                        scratch.data());
 
-    double distMin = 0;
-    int best_cluster = -1;
-    double totalWeight = 0.0f;
-
-    for (int i=0; i < clusters.size(); ++i) {
+    if (pIndex >= 0) {
+        for (int i=0; i < clusters.size(); ++i)
+            distanceMatrix[pIndex][i] = resp[i];
+    }
 
-        double distance = distances[i];
+    return best_cluster;
+}
 
-        if (pIndex >= 0) {
-            totalWeight += distance;
-            distanceMatrix[pIndex][i] = distance;
-        }	    
-        
-        if (distances[i] > distMin) {
-            distMin = distances[i];
+int
+EstimationMaximisation::
+responsibilities(const double * point, double * resp,
+                 double * scratch) const
+{
+    int k = clusters.size();
+
+    // Work in log space so that points far from every cluster still get
+    // assigned to the nearest one
+    int best_cluster = 0;
+    for (int i = 0;  i < k;  ++i) {
+        resp[i] = clusters[i].logDensity(point, scratch);
+        if (resp[i] > resp[best_cluster])
             best_cluster = i;
-        }
     }
 
-    if (pIndex >= 0 && totalWeight > 0) {
-        for (int i=0; i < clusters.size(); ++i) {
-            distanceMatrix[pIndex][i] /= totalWeight;
-        }
-    }
+    double maxLogDensity = resp[best_cluster];
+    for (int i = 0;  i < k;  ++i)
+        resp[i] -= maxLogDensity;
+    SIMD::vec_exp(resp, resp, k);
+    SIMD::vec_scale(resp, 1.0 / SIMD::vec_sum(resp, k), resp, k);
 
-    // Most likely these are points with all distance at 0, often during the
-    // first iteration
-    if (best_cluster == -1)
-        best_cluster = 0;
-    
     return best_cluster;
 }
 
@@ -369,6 +533,7 @@ reconstitute(MLDB::DB::Store_Reader & store)
         store >> clusters[i].covarianceMatrix;
         store >> clusters[i].invertCovarianceMatrix;
         store >> clusters[i].pseudoDeterminant;
+        clusters[i].prepare();
     }    
 
     store >> columnNames;
@@ -24,17 +24,47 @@ struct EstimationMaximisation
         boost::multi_array<double, 2> covarianceMatrix;
         boost::multi_array<double, 2> invertCovarianceMatrix;
         double pseudoDeterminant;
+
+        /** Factor the covariance matrix so that the density can be
+            evaluated quickly, and update the inverse and the determinant
+            from it.  Directions with a variance under MIN_VARIANCE are
+            ignored.  Must be called whenever the covariance changes. */
+        void prepare();
+
+        /** Return the log of the density of the gaussian at the given
+            point.  scratch must have room for one value per dimension. */
+        double logDensity(const double * point, double * scratch) const;
+
+        // Derived from the covariance matrix by prepare(); not serialized
+        bool diagonal = false;
+        boost::multi_array<double, 2> cholesky;   ///< Lower triangular factor
+        distribution<double> invCholeskyDiagonal; ///< 1 / diagonal of factor
+        distribution<double> invVariances;        ///< When diagonal
+        double logNormalization = 0.0;
     };
 
+    /// Variance below which a direction is considered degenerate
+    static constexpr double MIN_VARIANCE = 0.0001;
+
     std::vector<Cluster> clusters;
     std::vector<MLDB::Utf8String> columnNames;
 
+    /** Train the mixture.  With diagonalCovariance, the covariance of the
+        clusters is restricted to its diagonal, which costs O(d) instead
+        of O(d^2) per point and cluster.  With a non-zero batchSize, the
+        parameters are updated after each batch of that many points with
+        stepwise (online) EM, and maxIterations is the number of passes
+        over the points.  in_cluster is filled in with the most likely
+        cluster of each point under the final model.
+    */
     void
     train(const std::vector<distribution<double>> & points,
           std::vector<int> & in_cluster,
           int nbClusters,
           int maxIterations,
-          int randomSeed); 
+          int randomSeed,
+          bool diagonalCovariance = false,
+          size_t batchSize = 0);
 
     int
     assign(const distribution<double> & point,
@@ -42,6 +72,13 @@ struct EstimationMaximisation
            int pIndex) const;
     int
     assign(const distribution<double> & point) const;
+
+    /** Fill in resp with the probability that the point belongs to each
+        cluster, and return the most likely cluster.  scratch must have
+        room for one value per dimension. */
+    int
+    responsibilities(const double * point, double * resp,
+                     double * scratch) const;
   
     void serialize(MLDB::DB::Store_Writer & store) const;
     void reconstitute(MLDB::DB::Store_Reader & store);
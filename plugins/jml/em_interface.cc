@@ -93,7 +93,18 @@ EMConfigDescription()
     addField("maxIterations", &EMConfig::maxIterations,
              "Maximum number of iterations to perform.  If no convergance is "
              "reached within this number of iterations, the current clustering "
-             "will be returned.", 100);
+             "will be returned.  When `batchSize` is set, this is the number "
+             "of passes over the data.", 100);
+    addField("diagonalCovariance", &EMConfig::diagonalCovariance,
+             "If true, the covariance matrix of each cluster is restricted to "
+             "its diagonal, ie the dimensions are considered to be "
+             "independent within a cluster.  This makes training much faster "
+             "when there are many dimensions.", false);
+    addField("batchSize", &EMConfig::batchSize,
+             "If non-zero, the clusters are updated after each batch of this "
+             "many rows (online EM) instead of once per pass over all of the "
+             "rows, which converges in fewer passes over large datasets.",
+             0);
     addField("functionName", &EMConfig::functionName,
              "If specified, a function of this name will be created using "
              "the training result.");
@@ -137,6 +148,10 @@ run(const ProcedureRunConfig & run,
             return onProgress(value);
         };
 
+    if (runProcConf.batchSize < 0)
+        throw AnnotatedException(400, "batchSize must not be negative",
+                                 "batchSize", runProcConf.batchSize);
+
     if (!runProcConf.modelFileUrl.empty()) {
         checkWritability(runProcConf.modelFileUrl.toDecodedString(),
                          "modelFileUrl");
@@ -172,7 +187,8 @@ run(const ProcedureRunConfig & run,
     int numIterations = emConfig.maxIterations;
 
     DEBUG_MSG(logger) << "EM training start";
-    em.train(vecs, inCluster, numClusters, numIterations, 0);
+    em.train(vecs, inCluster, numClusters, numIterations, 0,
+             runProcConf.diagonalCovariance, runProcConf.batchSize);
     DEBUG_MSG(logger) << "EM training end";
 
     // Let the model know about its column names
@@ -30,7 +30,9 @@ struct EMConfig : public ProcedureConfig  {
     EMConfig()
         : numInputDimensions(-1),
           numClusters(10),
-          maxIterations(100)
+          maxIterations(100),
+          diagonalCovariance(false),
+          batchSize(0)
     {
         centroids.withType("embedding");
     }
@@ -43,6 +45,8 @@ struct EMConfig : public ProcedureConfig  {
     int numInputDimensions;
     int numClusters;
     int maxIterations;
+    bool diagonalCovariance;
+    int batchSize;
     Url modelFileUrl;
 
     Utf8String functionName;
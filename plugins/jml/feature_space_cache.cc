@@ -0,0 +1,473 @@
+/** feature_space_cache.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Cache of dataset feature spaces.
+*/
+
+#include "feature_space_cache.h"
+#include "mldb/block/zip_serializer.h"
+#include "mldb/types/db/persistent.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/ext/highwayhash.h"
+#include "mldb/utils/json_utils.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/utils/log.h"
+#include <mutex>
+#include <list>
+#include <map>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FEATURE SPACE CACHE                                                       */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::unordered_map<ColumnHash, DatasetFeatureSpace::ColumnInfo>
+ColumnInfos;
+
+/// Version of the files written to the cache directory
+static constexpr char CACHE_FILE_VERSION = 1;
+
+struct CacheEntries {
+    std::mutex mutex;
+
+    /// Most recently used at the front
+    std::list<std::pair<std::string, std::shared_ptr<const ColumnInfos> > >
+    entries;
+
+    std::shared_ptr<const ColumnInfos> find(const std::string & key)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (auto it = entries.begin();  it != entries.end();  ++it) {
+            if (it->first == key) {
+                entries.splice(entries.begin(), entries, it);
+                return it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(const std::string & key,
+                std::shared_ptr<const ColumnInfos> infos)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        entries.remove_if([&] (const std::pair<std::string,
+                                   std::shared_ptr<const ColumnInfos> > & e)
+                          { return e.first == key; });
+        entries.emplace_front(key, std::move(infos));
+        while (entries.size() > FeatureSpaceCache::MAX_ENTRIES)
+            entries.pop_back();
+    }
+
+    void clear()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        entries.clear();
+    }
+
+    /// Dataset object that each key was last used for in this process
+    std::map<std::string, std::weak_ptr<const Dataset> > owners;
+
+    /** Record that the key is now used for the given dataset.  Returns
+        false if it was last used for another dataset object, such as one
+        that was deleted and created again with the same name and shape,
+        in which case what's cached under the key can't be trusted.
+    */
+    bool claim(const std::string & key,
+               const std::shared_ptr<const Dataset> & dataset)
+    {
+        static constexpr size_t MAX_OWNERS = 4096;
+
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = owners.find(key);
+        bool same = it == owners.end() || it->second.lock() == dataset;
+        if (!same)
+            entries.remove_if([&] (const std::pair<std::string,
+                                       std::shared_ptr<const ColumnInfos> > & e)
+                              { return e.first == key; });
+        if (it == owners.end() && owners.size() >= MAX_OWNERS)
+            owners.erase(owners.begin());
+        owners[key] = dataset;
+        return same;
+    }
+};
+
+CacheEntries & cacheEntries()
+{
+    static CacheEntries result;
+    return result;
+}
+
+/** Name of the file in the cache directory for the given key.  The key
+    itself is stored in the file to guard against hash collisions. */
+Url getCacheFile(const Url & cacheDirectory, const std::string & key)
+{
+    uint64_t hash = sipHash(defaultHashSeedStable.u64, key.data(), key.size());
+    std::string dir = cacheDirectory.toDecodedString();
+    if (dir.empty() || dir.back() != '/')
+        dir += '/';
+    return Url(dir + MLDB::format("%016llx.fs.zip", (unsigned long long)hash));
+}
+
+void serialize(DB::Store_Writer & store, const std::vector<CellValue> & values)
+{
+    store << DB::compact_size_t(values.size());
+    for (auto & v: values)
+        store << jsonEncodeStr(v);
+}
+
+void reconstitute(DB::Store_Reader & store, std::vector<CellValue> & values)
+{
+    DB::compact_size_t n(store);
+    values.resize(n);
+    for (auto & v: values) {
+        std::string s;
+        store >> s;
+        v = jsonDecodeStr<CellValue>(s);
+    }
+}
+
+void serialize(DB::Store_Writer & store, const OrdinalValues & values)
+{
+    store << values.active << values.offset;
+    serialize(store, values.splits);
+}
+
+void reconstitute(DB::Store_Reader & store, OrdinalValues & values)
+{
+    store >> values.active >> values.offset;
+    reconstitute(store, values.splits);
+}
+
+void serialize(DB::Store_Writer & store, const CategoricalValues & values)
+{
+    store << values.offset;
+    serialize(store, values.buckets);
+}
+
+void reconstitute(DB::Store_Reader & store, CategoricalValues & values)
+{
+    store >> values.offset;
+    reconstitute(store, values.buckets);
+}
+
+void serialize(DB::Store_Writer & store, const BucketDescriptions & desc)
+{
+    store << desc.hasNulls
+          << desc.numeric.active << desc.numeric.offset << desc.numeric.splits
+          << desc.strings.offset
+          << DB::compact_size_t(desc.strings.buckets.size());
+    for (auto & s: desc.strings.buckets)
+        store << s.rawString();
+    serialize(store, desc.blobs);
+    serialize(store, desc.paths);
+    serialize(store, desc.timestamps);
+    serialize(store, desc.intervals);
+}
+
+void reconstitute(DB::Store_Reader & store, BucketDescriptions & desc)
+{
+    store >> desc.hasNulls
+          >> desc.numeric.active >> desc.numeric.offset >> desc.numeric.splits
+          >> desc.strings.offset;
+    DB::compact_size_t numStrings(store);
+    desc.strings.buckets.clear();
+    desc.strings.buckets.reserve(numStrings);
+    for (size_t i = 0;  i < numStrings;  ++i) {
+        std::string s;
+        store >> s;
+        desc.strings.buckets.emplace_back(std::move(s));
+    }
+    reconstitute(store, desc.blobs);
+    reconstitute(store, desc.paths);
+    reconstitute(store, desc.timestamps);
+    reconstitute(store, desc.intervals);
+}
+
+size_t numBucketWords(const BucketList & buckets)
+{
+    return (buckets.entryBits * buckets.numEntries + 63) / 64;
+}
+
+/** Write the column information to a zip file.  The metadata goes into
+    the "md" entry; each non-empty bucket list goes in its own entry, which
+    is stored uncompressed so that it can be mapped directly.  The file is
+    written under a temporary name and renamed so that concurrent readers
+    never see a partial file.
+*/
+void saveCacheFile(const Url & file, const std::string & key,
+                   const ColumnInfos & infos)
+{
+    Url tmpFile(file.toDecodedString()
+                + MLDB::format(".tmp.%d", (int)getpid()));
+
+    {
+        ZipStructuredSerializer serializer(tmpFile.toUtf8String());
+
+        std::ostringstream stream;
+        {
+            DB::Store_Writer store(stream);
+            store << CACHE_FILE_VERSION << key
+                  << DB::compact_size_t(infos.size());
+
+            std::shared_ptr<StructuredSerializer> bucketSerializer;
+            int n = 0;
+            for (auto & i: infos) {
+                const DatasetFeatureSpace::ColumnInfo & info = i.second;
+                store << info.columnName.toUtf8String().rawString()
+                      << info.index << info.distinctValues;
+                info.info.serialize(store);
+
+                const BucketList & buckets = info.buckets;
+                bool hasBuckets = buckets.storage && buckets.numEntries > 0;
+                store << hasBuckets;
+                if (hasBuckets) {
+                    store << buckets.entryBits << buckets.numBuckets
+                          << (uint64_t)buckets.numEntries;
+
+                    FrozenMemoryRegion region
+                        (buckets.storage,
+                         reinterpret_cast<const char *>(buckets.storage.get()),
+                         numBucketWords(buckets) * sizeof(uint64_t));
+                    if (!bucketSerializer)
+                        bucketSerializer = serializer.newStructure("buckets");
+                    bucketSerializer->addRegion(region,
+                                                PathElement(std::to_string(n)));
+                }
+                ++n;
+                serialize(store, info.bucketDescriptions);
+            }
+        }
+
+        auto md = std::make_shared<std::string>(stream.str());
+        serializer.addRegion(FrozenMemoryRegion(md, md->data(), md->size()),
+                             "md");
+        serializer.commit();
+    }
+
+    if (::rename(tmpFile.path().c_str(), file.path().c_str()) == -1) {
+        tryEraseUriObject(tmpFile.toDecodedString());
+        throw AnnotatedException(500, "Couldn't rename feature space cache file: "
+                                 + string(strerror(errno)));
+    }
+}
+
+/** Load the column information back from a zip file, mapping in the
+    bucket lists.  Returns null if the file is for a different key. */
+std::shared_ptr<const ColumnInfos>
+loadCacheFile(const Url & file, const std::string & key)
+{
+    auto reconstituter = std::make_shared<ZipStructuredReconstituter>(file);
+    FrozenMemoryRegion md = reconstituter->getRegion("md");
+    DB::Store_Reader store(md.data(), md.length());
+
+    char version;
+    store >> version;
+    if (version != CACHE_FILE_VERSION)
+        return nullptr;
+
+    std::string storedKey;
+    store >> storedKey;
+    if (storedKey != key)
+        return nullptr;
+
+    auto result = std::make_shared<ColumnInfos>();
+
+    DB::compact_size_t numColumns(store);
+    std::shared_ptr<StructuredReconstituter> bucketEntries;
+
+    for (size_t n = 0;  n < numColumns;  ++n) {
+        DatasetFeatureSpace::ColumnInfo info;
+        std::string columnName;
+        store >> columnName >> info.index >> info.distinctValues;
+        info.columnName = ColumnPath::parse(columnName);
+        store >> info.info;
+
+        bool hasBuckets;
+        store >> hasBuckets;
+        if (hasBuckets) {
+            uint64_t numEntries;
+            store >> info.buckets.entryBits >> info.buckets.numBuckets
+                  >> numEntries;
+            info.buckets.numEntries = numEntries;
+
+            if (!bucketEntries)
+                bucketEntries = reconstituter->getStructure("buckets");
+            auto region = std::make_shared<FrozenMemoryRegion>
+                (bucketEntries->getRegion(PathElement(std::to_string(n))));
+            size_t numWords = numBucketWords(info.buckets);
+            if (region->length() != numWords * sizeof(uint64_t))
+                throw MLDB::Exception("feature space cache file "
+                                      + file.toDecodedString()
+                                      + " has a truncated bucket list");
+
+            if ((size_t)region->data() % alignof(uint64_t) == 0) {
+                // Point directly into the mapped file
+                info.buckets.storage = std::shared_ptr<const uint64_t>
+                    (region, reinterpret_cast<const uint64_t *>(region->data()));
+            }
+            else {
+                std::shared_ptr<uint64_t> copy(new uint64_t[numWords],
+                                               [] (uint64_t * p) { delete[] p; });
+                std::memcpy(copy.get(), region->data(), region->length());
+                info.buckets.storage = std::move(copy);
+            }
+        }
+
+        reconstitute(store, info.bucketDescriptions);
+
+        ColumnHash ch(info.columnName);
+        result->emplace(ch, std::move(info));
+    }
+
+    return result;
+}
+
+} // file scope
+
+std::string
+FeatureSpaceCache::
+getKey(const Dataset & dataset,
+       const Utf8String & datasetSource,
+       const std::set<ColumnPath> & includeColumns,
+       bool bucketize)
+{
+    Json::Value key;
+    key["source"] = datasetSource.rawString();
+    if (dataset.getConfigPtr())
+        key["config"] = jsonEncode(*dataset.getConfigPtr());
+
+    // The version of the dataset, which changes whenever its contents do.
+    // Generations start again when a dataset is loaded again, so its shape
+    // also goes in for the entries read back from the cache directory.
+    key["generation"] = dataset.getGeneration();
+    key["rowCount"] = dataset.getRowCount();
+    key["columnCount"] = dataset.getMatrixView()->getColumnCount();
+
+    for (auto & c: includeColumns)
+        key["columns"].append(c.toUtf8String().rawString());
+    key["bucketize"] = bucketize;
+
+    return key.toStringNoNewLine();
+}
+
+std::shared_ptr<DatasetFeatureSpace>
+FeatureSpaceCache::
+get(std::shared_ptr<Dataset> dataset,
+    const Utf8String & datasetSource,
+    ML::Feature_Info labelInfo,
+    const std::set<ColumnPath> & includeColumns,
+    bool bucketize,
+    const Url & cacheDirectory)
+{
+    static auto logger = MLDB::getMldbLog<FeatureSpaceCache>();
+
+    // Caching is opt-in
+    if (cacheDirectory.empty()) {
+        return std::make_shared<DatasetFeatureSpace>
+            (dataset, labelInfo, includeColumns, bucketize);
+    }
+
+    if (cacheDirectory.scheme() != "file")
+        throw AnnotatedException
+            (400, "Feature space cache directory must be a file:// URL, not '"
+             + cacheDirectory.toUtf8String() + "'");
+
+    // Nothing would tell us that such a dataset has changed
+    if (dataset->getGeneration() == -1) {
+        DEBUG_MSG(logger) << "dataset doesn't track changes; not caching "
+                          << "its feature space";
+        return std::make_shared<DatasetFeatureSpace>
+            (dataset, labelInfo, includeColumns, bucketize);
+    }
+
+    std::string key = getKey(*dataset, datasetSource, includeColumns,
+                             bucketize);
+
+    auto makeResult = [&] (const ColumnInfos & infos)
+        {
+            auto result = std::make_shared<DatasetFeatureSpace>();
+            result->labelInfo = labelInfo;
+            result->columnInfo = infos;
+            return result;
+        };
+
+    auto & entries = cacheEntries();
+
+    // A different dataset object with the same key means that the data
+    // was replaced without changing its shape; build it again
+    bool trusted = entries.claim(key, dataset);
+    if (!trusted)
+        DEBUG_MSG(logger) << "dataset was replaced; not using its cached "
+                          << "feature space";
+
+    Url file = getCacheFile(cacheDirectory, key);
+    bool haveFile = tryGetUriObjectInfo(file.toDecodedString());
+
+    auto save = [&] (const ColumnInfos & infos)
+        {
+            if (haveFile && trusted)
+                return;
+            try {
+                makeUriDirectory(file.toDecodedString());
+                saveCacheFile(file, key, infos);
+            } catch (const std::exception & exc) {
+                // The cache is an optimization only; training goes on
+                INFO_MSG(logger) << "couldn't save feature space cache file "
+                                 << file.toDecodedString() << ": "
+                                 << exc.what();
+            }
+        };
+
+    if (auto found = entries.find(key)) {
+        DEBUG_MSG(logger) << "feature space found in memory";
+        save(*found);
+        return makeResult(*found);
+    }
+
+    if (haveFile && trusted) {
+        try {
+            if (auto loaded = loadCacheFile(file, key)) {
+                DEBUG_MSG(logger) << "feature space loaded from "
+                                  << file.toDecodedString();
+                entries.insert(key, loaded);
+                return makeResult(*loaded);
+            }
+        } catch (const std::exception & exc) {
+            INFO_MSG(logger) << "couldn't load feature space cache file "
+                             << file.toDecodedString() << ": " << exc.what();
+        }
+        // Damaged or from another key; rebuild and overwrite it
+        trusted = false;
+    }
+
+    auto result = std::make_shared<DatasetFeatureSpace>
+        (dataset, labelInfo, includeColumns, bucketize);
+    auto infos = std::make_shared<const ColumnInfos>(result->columnInfo);
+    entries.insert(key, infos);
+    save(*infos);
+
+    return result;
+}
+
+void
+FeatureSpaceCache::
+clear()
+{
+    cacheEntries().clear();
+}
+
+} // namespace MLDB
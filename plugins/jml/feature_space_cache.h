@@ -0,0 +1,80 @@
+/** feature_space_cache.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Cache of dataset feature spaces, so that training several models over
+    the same data doesn't extract the features again each time.
+*/
+
+#pragma once
+
+#include "dataset_feature_space.h"
+#include "mldb/types/url.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FEATURE SPACE CACHE                                                       */
+/*****************************************************************************/
+
+/** Process-wide cache of the column information of DatasetFeatureSpace
+    objects, including the bucket descriptions and bucketed column data
+    when they were bucketized.
+
+    Caching only happens when a cache directory is given.  Entries are
+    keyed by where the dataset came from (its configuration and the FROM
+    clause that bound it), its version (as given by its generation and its
+    row and column counts), the set of columns and whether they were
+    bucketized.  Datasets that don't track their generation are never
+    cached.  Within a process, a key is also tied to the dataset
+    object it was built for: a dataset that is deleted and created again
+    with the same name, configuration and shape but other values gets its
+    features extracted again, and the entry is overwritten.  Nothing can
+    tell such datasets apart across a restart, so a cache directory should
+    only be reused by datasets whose contents follow their configuration.
+
+    The most recently used entries are kept in memory.  They are also
+    written to the cache directory as zip files whose bucket lists are
+    memory mapped back when they're next needed, so they survive a restart
+    and can be paged out under memory pressure.
+*/
+
+struct FeatureSpaceCache {
+
+    /** Return a feature space for the given columns of the dataset,
+        taking its column information from the cache if possible or
+        building it and adding it to the cache otherwise.  The feature
+        space itself belongs to the caller, so its label info can be
+        modified; only the column information is shared.
+
+        datasetSource identifies the dataset for those that don't have
+        a configuration of their own, and is normally the FROM clause
+        of the training query.  cacheDirectory, if not empty, must be
+        a file:// URL; if it's empty, the feature space is built without
+        going through the cache.
+    */
+    static std::shared_ptr<DatasetFeatureSpace>
+    get(std::shared_ptr<Dataset> dataset,
+        const Utf8String & datasetSource,
+        ML::Feature_Info labelInfo,
+        const std::set<ColumnPath> & includeColumns,
+        bool bucketize,
+        const Url & cacheDirectory = Url());
+
+    /** Return the key under which a feature space is cached. */
+    static std::string
+    getKey(const Dataset & dataset,
+           const Utf8String & datasetSource,
+           const std::set<ColumnPath> & includeColumns,
+           bool bucketize);
+
+    /** Drop all entries held in memory.  Those in cache directories are
+        left alone. */
+    static void clear();
+
+    /// Maximum number of entries held in memory
+    static constexpr size_t MAX_ENTRIES = 8;
+};
+
+} // namespace MLDB
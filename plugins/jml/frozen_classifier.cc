@@ -0,0 +1,799 @@
+/** frozen_classifier.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Flat, memory mappable representation of decision tree ensembles.
+*/
+
+#include "frozen_classifier.h"
+#include "mldb/plugins/jml/jml/committee.h"
+#include "mldb/plugins/jml/jml/decision_tree.h"
+#include "mldb/plugins/jml/jml/feature_set.h"
+#include "mldb/block/file_serializer.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/types/db/persistent.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/vm.h"
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FILE FORMAT                                                               */
+/*****************************************************************************/
+
+namespace {
+
+static const char FROZEN_MAGIC[8] = { 'M', 'L', 'D', 'B', '.', 'F', 'T', 'E' };
+static constexpr uint32_t FROZEN_VERSION = 1;
+
+/// Alignment of each section within the file
+static constexpr size_t SECTION_ALIGNMENT = 64;
+
+/// Child pointers with this bit set are leaves; others are nodes
+static constexpr uint32_t LEAF_BIT = 0x80000000;
+
+/// Child pointer for a missing child
+static constexpr uint32_t NO_CHILD = 0xffffffff;
+
+struct FrozenFeature {
+    int32_t type;
+    int32_t arg1;
+    int32_t arg2;
+};
+
+struct Section {
+    uint64_t offset;
+    uint64_t length;
+};
+
+enum {
+    FEATURE_SPACE,   ///< Serialized feature space
+    FEATURES,        ///< FrozenFeature for each feature split on
+    BIAS,            ///< Float per label
+    TREES,           ///< TreeEntry per tree
+    NODES,           ///< Node per split
+    LEAVES,          ///< Float per label per leaf
+    NUM_SECTIONS
+};
+
+} // file scope
+
+struct FrozenTreeEnsemble::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t labelCount;
+    uint32_t encoding;
+    uint32_t committee;
+    FrozenFeature predicted;
+    uint32_t unused;
+    Section sections[NUM_SECTIONS];
+};
+
+struct FrozenTreeEnsemble::TreeEntry {
+    uint32_t root;
+    float weight;
+};
+
+struct FrozenTreeEnsemble::Node {
+    float splitVal;
+    uint32_t feature;    ///< Index in the FEATURES section
+    uint8_t op;          ///< Split::Op
+    uint8_t unused[3];
+    uint32_t child[3];   ///< Indexed by false, true and MISSING
+
+    /** Same as Split::apply(float), without the feature lookup. */
+    MLDB_ALWAYS_INLINE int apply(float featureVal) const
+    {
+        if (isnanf(featureVal))
+            return MISSING;
+        int all = (featureVal < splitVal)
+            | ((featureVal == splitVal) << 1)
+            | 4;
+        return (all & (1 << op)) != 0;
+    }
+};
+
+static_assert(sizeof(FrozenTreeEnsemble::Header) == 136,
+              "frozen header layout changed");
+static_assert(sizeof(FrozenTreeEnsemble::TreeEntry) == 8,
+              "frozen tree layout changed");
+static_assert(sizeof(FrozenTreeEnsemble::Node) == 24,
+              "frozen node layout changed");
+
+
+/*****************************************************************************/
+/* FREEZING                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+/** Accumulates the trees of a classifier into flat arrays. */
+struct Flattener {
+    Flattener(const Classifier_Impl & top)
+        : labelCount(top.label_count()),
+          bias(top.label_count(), 0.0f)
+    {
+    }
+
+    size_t labelCount;
+    vector<float> bias;
+    vector<FrozenTreeEnsemble::TreeEntry> trees;
+    vector<FrozenTreeEnsemble::Node> nodes;
+    vector<float> leaves;
+    vector<Feature> features;
+    map<Feature, uint32_t> featureIndex;
+
+    void add(const Classifier_Impl & classifier, float weight)
+    {
+        if (classifier.label_count() != labelCount)
+            throw MLDB::Exception("can't freeze classifier: sub-classifier "
+                                  "has %zd labels instead of %zd",
+                                  classifier.label_count(), labelCount);
+
+        if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+            // The bias is only sized once a classifier is added
+            if (committee->bias.size() > labelCount)
+                throw MLDB::Exception("can't freeze committee: bias has "
+                                      "too many labels");
+            for (size_t i = 0;  i < committee->bias.size();  ++i)
+                bias[i] += weight * committee->bias[i];
+            for (size_t i = 0;  i < committee->classifiers.size();  ++i) {
+                if (committee->weights[i] == 0.0)
+                    continue;
+                add(*committee->classifiers[i],
+                    weight * committee->weights[i]);
+            }
+        }
+        else if (auto tree = dynamic_cast<const Decision_Tree *>(&classifier)) {
+            uint32_t root = addPtr(tree->tree.root);
+            trees.push_back({ root, weight });
+        }
+        else throw MLDB::Exception("can't freeze classifier of type "
+                                   + classifier.class_id());
+    }
+
+    uint32_t addPtr(const Tree::Ptr & ptr)
+    {
+        if (!ptr)
+            return NO_CHILD;
+
+        if (!ptr.node()) {
+            const distribution<float> & pred = ptr.leaf()->pred;
+            if (pred.size() != labelCount)
+                throw MLDB::Exception("can't freeze decision tree: leaf has "
+                                      "%zd predictions instead of %zd",
+                                      pred.size(), labelCount);
+            size_t index = leaves.size() / labelCount;
+            if (index >= LEAF_BIT)
+                throw MLDB::Exception("can't freeze classifier: too many "
+                                      "leaves");
+            leaves.insert(leaves.end(), pred.begin(), pred.end());
+            return LEAF_BIT | index;
+        }
+
+        const Tree::Node & node = *ptr.node();
+
+        size_t index = nodes.size();
+        if (index >= LEAF_BIT)
+            throw MLDB::Exception("can't freeze classifier: too many nodes");
+        nodes.emplace_back();
+
+        FrozenTreeEnsemble::Node frozen;
+        std::memset(&frozen, 0, sizeof(frozen));
+        frozen.splitVal = node.split.split_val();
+        frozen.feature = getFeatureIndex(node.split.feature());
+        frozen.op = node.split.op();
+        frozen.child[true] = addPtr(node.child_true);
+        frozen.child[false] = addPtr(node.child_false);
+        frozen.child[MISSING] = addPtr(node.child_missing);
+
+        nodes[index] = frozen;
+        return index;
+    }
+
+    uint32_t getFeatureIndex(const Feature & feature)
+    {
+        auto it = featureIndex.find(feature);
+        if (it != featureIndex.end())
+            return it->second;
+        uint32_t index = features.size();
+        featureIndex[feature] = index;
+        features.push_back(feature);
+        return index;
+    }
+};
+
+/** Offset of the next section of the given length, and update the
+    running length of the file. */
+Section addSection(size_t & length, size_t sectionLength)
+{
+    length = (length + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT
+        * SECTION_ALIGNMENT;
+    Section result{ length, sectionLength };
+    length += sectionLength;
+    return result;
+}
+
+void writeSection(char * file, const Section & section, const void * data)
+{
+    if (section.length)
+        std::memcpy(file + section.offset, data, section.length);
+}
+
+} // file scope
+
+bool
+FrozenTreeEnsemble::
+canFreeze(const Classifier_Impl & classifier)
+{
+    if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+        for (auto & c: committee->classifiers) {
+            if (!canFreeze(*c))
+                return false;
+        }
+        return true;
+    }
+    return dynamic_cast<const Decision_Tree *>(&classifier);
+}
+
+void
+FrozenTreeEnsemble::
+save(const Classifier_Impl & classifier, const Url & url)
+{
+    if (!canFreeze(classifier))
+        throw AnnotatedException
+            (400, "Only decision trees and committees of decision trees "
+             "(such as random forests and bagged trees) can be saved in "
+             "the frozen format; this classifier is of type "
+             + classifier.class_id());
+
+    Flattener flattener(classifier);
+    flattener.add(classifier, 1.0f);
+
+    std::ostringstream featureSpaceStream;
+    {
+        DB::Store_Writer store(featureSpaceStream);
+        store << classifier.feature_space();
+    }
+    std::string featureSpace = featureSpaceStream.str();
+
+    vector<FrozenFeature> features;
+    for (auto & f: flattener.features)
+        features.push_back({ f.type(), f.arg1(), f.arg2() });
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FROZEN_MAGIC, sizeof(FROZEN_MAGIC));
+    header.version = FROZEN_VERSION;
+    header.labelCount = classifier.label_count();
+    header.encoding = classifier.output_encoding();
+    header.committee = !!dynamic_cast<const Committee *>(&classifier);
+    const Feature & predicted = classifier.predicted();
+    header.predicted = { predicted.type(), predicted.arg1(), predicted.arg2() };
+
+    size_t length = sizeof(Header);
+    Section * sections = header.sections;
+    sections[FEATURE_SPACE] = addSection(length, featureSpace.size());
+    sections[FEATURES]
+        = addSection(length, features.size() * sizeof(FrozenFeature));
+    sections[BIAS] = addSection(length, flattener.bias.size() * sizeof(float));
+    sections[TREES]
+        = addSection(length, flattener.trees.size() * sizeof(TreeEntry));
+    sections[NODES] = addSection(length, flattener.nodes.size() * sizeof(Node));
+    sections[LEAVES]
+        = addSection(length, flattener.leaves.size() * sizeof(float));
+
+    // Local files are built in place in a mapped file; others are built in
+    // memory and then written out.
+    bool local = url.scheme() == "file";
+    std::string tmpPath;
+    std::unique_ptr<MappedSerializer> serializer;
+    if (local) {
+        tmpPath = url.path() + MLDB::format(".tmp-%d", (int)getpid());
+        serializer.reset(new FileSerializer(tmpPath));
+    }
+    else serializer.reset(new MemorySerializer());
+
+    try {
+        MutableMemoryRegion region
+            = serializer->allocateWritable(length, page_size);
+        char * file = region.data();
+        std::memset(file, 0, length);
+        std::memcpy(file, &header, sizeof(header));
+        writeSection(file, sections[FEATURE_SPACE], featureSpace.data());
+        writeSection(file, sections[FEATURES], features.data());
+        writeSection(file, sections[BIAS], flattener.bias.data());
+        writeSection(file, sections[TREES], flattener.trees.data());
+        writeSection(file, sections[NODES], flattener.nodes.data());
+        writeSection(file, sections[LEAVES], flattener.leaves.data());
+
+        FrozenMemoryRegion frozen = region.freeze();
+        serializer->commit();
+
+        if (local) {
+            serializer.reset();
+            if (::rename(tmpPath.c_str(), url.path().c_str()) == -1)
+                throw AnnotatedException
+                    (400, "Couldn't rename frozen classifier file to "
+                     + url.toUtf8String() + ": " + strerror(errno));
+        }
+        else {
+            filter_ostream stream(url);
+            stream.write(frozen.data(), frozen.length());
+            stream.close();
+        }
+    } catch (...) {
+        if (local) {
+            serializer.reset();
+            ::unlink(tmpPath.c_str());
+        }
+        throw;
+    }
+}
+
+bool
+FrozenTreeEnsemble::
+isFrozen(const Url & url)
+{
+    filter_istream stream(url);
+    char magic[sizeof(FROZEN_MAGIC)];
+    stream.read(magic, sizeof(magic));
+    return isFrozen(magic, stream.gcount());
+}
+
+bool
+FrozenTreeEnsemble::
+isFrozen(const char * data, size_t length)
+{
+    return length >= sizeof(FROZEN_MAGIC)
+        && std::memcmp(data, FROZEN_MAGIC, sizeof(FROZEN_MAGIC)) == 0;
+}
+
+std::shared_ptr<FrozenTreeEnsemble>
+FrozenTreeEnsemble::
+load(const Url & url)
+{
+    if (url.scheme() == "file")
+        return std::make_shared<FrozenTreeEnsemble>(mapFile(url));
+
+    filter_istream stream(url);
+    auto data = std::make_shared<std::string>
+        (std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    FrozenMemoryRegion region(data, data->data(), data->size());
+    return std::make_shared<FrozenTreeEnsemble>(std::move(region));
+}
+
+
+/*****************************************************************************/
+/* FROZEN TREE ENSEMBLE                                                      */
+/*****************************************************************************/
+
+FrozenTreeEnsemble::
+FrozenTreeEnsemble(FrozenMemoryRegion region_)
+    : region(std::move(region_)), optimized_(false)
+{
+    const char * file = region.data();
+    size_t length = region.length();
+
+    if (length < sizeof(Header)
+        || std::memcmp(file, FROZEN_MAGIC, sizeof(FROZEN_MAGIC)) != 0)
+        throw MLDB::Exception("FrozenTreeEnsemble: not a frozen classifier");
+
+    const Header & header = *reinterpret_cast<const Header *>(file);
+    if (header.version != FROZEN_VERSION)
+        throw MLDB::Exception("FrozenTreeEnsemble: can't load version %d; "
+                              "only version %d is supported",
+                              header.version, FROZEN_VERSION);
+
+    for (auto & s: header.sections) {
+        if (s.offset % SECTION_ALIGNMENT != 0
+            || s.offset > length || s.length > length - s.offset)
+            throw MLDB::Exception("FrozenTreeEnsemble: corrupt file");
+    }
+
+    size_t labelCount = header.labelCount;
+    if (labelCount == 0
+        || header.encoding > OE_PM_ONE
+        || header.sections[BIAS].length != labelCount * sizeof(float)
+        || header.sections[FEATURES].length % sizeof(FrozenFeature) != 0
+        || header.sections[TREES].length % sizeof(TreeEntry) != 0
+        || header.sections[NODES].length % sizeof(Node) != 0
+        || header.sections[LEAVES].length % (labelCount * sizeof(float)) != 0)
+        throw MLDB::Exception("FrozenTreeEnsemble: corrupt file");
+
+    auto getSection = [&] (int section)
+        {
+            return file + header.sections[section].offset;
+        };
+
+    bias_ = reinterpret_cast<const float *>(getSection(BIAS));
+    trees_ = reinterpret_cast<const TreeEntry *>(getSection(TREES));
+    nodes_ = reinterpret_cast<const Node *>(getSection(NODES));
+    leaves_ = reinterpret_cast<const float *>(getSection(LEAVES));
+    numTrees_ = header.sections[TREES].length / sizeof(TreeEntry);
+    numNodes_ = header.sections[NODES].length / sizeof(Node);
+    numLeaves_ = header.sections[LEAVES].length / (labelCount * sizeof(float));
+    committee_ = header.committee;
+    encoding_ = (Output_Encoding)header.encoding;
+
+    auto frozenFeatures
+        = reinterpret_cast<const FrozenFeature *>(getSection(FEATURES));
+    size_t numFeatures = header.sections[FEATURES].length / sizeof(FrozenFeature);
+
+    // The nodes are used in place, so they're checked here to make sure
+    // that prediction can't read outside of the file or use an unknown
+    // split operation.  Nodes are written before their children, so
+    // requiring each child to come after its parent also rules out cycles.
+    auto validPtr = [&] (uint32_t ptr, size_t minNode)
+        {
+            return ptr == NO_CHILD
+                || ((ptr & LEAF_BIT) ? (ptr & ~LEAF_BIT) < numLeaves_
+                                     : ptr >= minNode && ptr < numNodes_);
+        };
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        if (!validPtr(trees_[i].root, 0))
+            throw MLDB::Exception("FrozenTreeEnsemble: corrupt file");
+    }
+    for (size_t i = 0;  i < numNodes_;  ++i) {
+        const Node & node = nodes_[i];
+        if (node.feature >= numFeatures
+            || node.op > Split::NOT_MISSING
+            || !validPtr(node.child[false], i + 1)
+            || !validPtr(node.child[true], i + 1)
+            || !validPtr(node.child[MISSING], i + 1))
+            throw MLDB::Exception("FrozenTreeEnsemble: corrupt file");
+    }
+    for (size_t i = 0;  i < numFeatures;  ++i) {
+        auto & f = frozenFeatures[i];
+        features_.emplace_back(f.type, f.arg1, f.arg2);
+    }
+
+    DB::Store_Reader store(getSection(FEATURE_SPACE),
+                           header.sections[FEATURE_SPACE].length);
+    std::shared_ptr<Feature_Space> fs;
+    store >> fs;
+    fs->freeze();
+
+    init(fs, Feature(header.predicted.type, header.predicted.arg1,
+                     header.predicted.arg2),
+         labelCount);
+}
+
+namespace {
+
+struct StandardGetFeatures {
+    StandardGetFeatures(const Feature_Set & features,
+                        const vector<Feature> & featureTable)
+        : features(features), featureTable(featureTable)
+    {
+    }
+
+    const Feature_Set & features;
+    const vector<Feature> & featureTable;
+
+    template<class Node>
+    Split::Weights operator () (const Node & node) const
+    {
+        Split split(featureTable[node.feature], node.splitVal,
+                    (Split::Op)node.op);
+        return split.apply(features);
+    }
+};
+
+struct OptimizedGetFeatures {
+    OptimizedGetFeatures(const float * features, const int * denseIndex)
+        : features(features), denseIndex(denseIndex)
+    {
+    }
+
+    const float * features;
+    const int * denseIndex;
+
+    template<class Node>
+    MLDB_ALWAYS_INLINE Split::Weights operator () (const Node & node) const
+    {
+        Split::Weights result;
+        result[node.apply(features[denseIndex[node.feature]])] = 1.0f;
+        return result;
+    }
+};
+
+// The results accumulators are the same as those of Decision_Tree, so that
+// the predictions are identical to those of the classifier that was frozen.
+
+struct AccumResults {
+    explicit AccumResults(double * accum, int nl, double weight)
+        : accum(accum), nl(nl), weight(weight)
+    {
+    }
+
+    double * accum;
+    int nl;
+    double weight;
+
+    MLDB_ALWAYS_INLINE
+    void operator () (const float * dist, float weight1)
+    {
+        if (MLDB_LIKELY(nl == 2)) {
+            double factor = weight1 * weight;
+            accum[0] += dist[0] * factor;
+            accum[1] += dist[1] * factor;
+            return;
+        }
+
+        for (unsigned i = 0;  i < nl;  ++i)
+            accum[i] += dist[i] * weight1 * weight;
+    }
+};
+
+struct DistResults {
+    explicit DistResults(double * accum, int nl)
+        : accum(accum), nl(nl)
+    {
+        std::fill(accum, accum + nl, 0.0);
+    }
+
+    double * accum;
+    int nl;
+
+    MLDB_ALWAYS_INLINE
+    void operator () (const float * dist, float weight)
+    {
+        for (unsigned i = 0;  i < nl;  ++i)
+            accum[i] += dist[i] * weight;
+    }
+};
+
+struct LabelResults {
+    explicit LabelResults(int label)
+        : label(label), result(0.0)
+    {
+    }
+
+    MLDB_ALWAYS_INLINE
+    void operator () (const float * dist, float weight)
+    {
+        result += weight * dist[label];
+    }
+
+    int label;
+    double result;
+};
+
+} // file scope
+
+template<class GetFeatures, class Results>
+void
+FrozenTreeEnsemble::
+predictRecursive(const GetFeatures & getFeatures,
+                 Results & results,
+                 uint32_t ptr,
+                 double weight) const
+{
+    if (ptr == NO_CHILD)
+        return;
+
+    if (ptr & LEAF_BIT) {
+        results(leaves_ + (ptr & ~LEAF_BIT) * label_count(), weight);
+        return;
+    }
+
+    const Node & node = nodes_[ptr];
+
+    Split::Weights weights = getFeatures(node);
+
+    // Same order as Decision_Tree, so that sums are taken in the same order
+    if (weights[true] > 0.0)
+        predictRecursive(getFeatures, results, node.child[true],
+                         weights[true]);
+    if (weights[false] > 0.0)
+        predictRecursive(getFeatures, results, node.child[false],
+                         weights[false]);
+    if (weights[MISSING] > 0.0)
+        predictRecursive(getFeatures, results, node.child[MISSING],
+                         weights[MISSING]);
+}
+
+float
+FrozenTreeEnsemble::
+predict(int label, const Feature_Set & features,
+        PredictionContext * context) const
+{
+    if (label < 0 || label >= label_count())
+        throw MLDB::Exception("FrozenTreeEnsemble::predict(): invalid label");
+
+    StandardGetFeatures getFeatures(features, features_);
+
+    float result = bias_[label];
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        LabelResults results(label);
+        predictRecursive(getFeatures, results, trees_[i].root);
+        result += trees_[i].weight * (float)results.result;
+    }
+    return result;
+}
+
+Label_Dist
+FrozenTreeEnsemble::
+predict(const Feature_Set & features,
+        PredictionContext * context) const
+{
+    StandardGetFeatures getFeatures(features, features_);
+
+    int nl = label_count();
+    Label_Dist result(bias_, bias_ + nl);
+    double accum[nl];
+
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        DistResults results(accum, nl);
+        predictRecursive(getFeatures, results, trees_[i].root);
+        for (unsigned j = 0;  j < nl;  ++j)
+            result[j] += trees_[i].weight * (float)accum[j];
+    }
+
+    return result;
+}
+
+bool
+FrozenTreeEnsemble::
+optimization_supported() const
+{
+    return true;
+}
+
+bool
+FrozenTreeEnsemble::
+predict_is_optimized() const
+{
+    return optimized_;
+}
+
+bool
+FrozenTreeEnsemble::
+optimize_impl(Optimization_Info & info)
+{
+    vector<int> denseIndex(features_.size());
+    for (size_t i = 0;  i < features_.size();  ++i) {
+        auto it = info.feature_to_optimized_index.find(features_[i]);
+        if (it == info.feature_to_optimized_index.end())
+            throw MLDB::Exception("FrozenTreeEnsemble::optimize(): "
+                                  "feature not found");
+        denseIndex[i] = it->second;
+    }
+
+    denseIndex_ = std::move(denseIndex);
+    return optimized_ = true;
+}
+
+Label_Dist
+FrozenTreeEnsemble::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    OptimizedGetFeatures getFeatures(features, denseIndex_.data());
+
+    int nl = label_count();
+    double accum[nl];
+
+    if (!committee_) {
+        // A single decision tree
+        DistResults results(accum, nl);
+        for (size_t i = 0;  i < numTrees_;  ++i)
+            predictRecursive(getFeatures, results, trees_[i].root);
+        return Label_Dist(accum, accum + nl);
+    }
+
+    std::copy(bias_, bias_ + nl, accum);
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        AccumResults results(accum, nl, trees_[i].weight);
+        predictRecursive(getFeatures, results, trees_[i].root);
+    }
+
+    return Label_Dist(accum, accum + nl);
+}
+
+void
+FrozenTreeEnsemble::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       double * accum,
+                       double weight,
+                       PredictionContext * context) const
+{
+    OptimizedGetFeatures getFeatures(features, denseIndex_.data());
+
+    int nl = label_count();
+    for (unsigned i = 0;  i < nl;  ++i)
+        accum[i] += weight * bias_[i];
+
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        AccumResults results(accum, nl, weight * trees_[i].weight);
+        predictRecursive(getFeatures, results, trees_[i].root);
+    }
+}
+
+float
+FrozenTreeEnsemble::
+optimized_predict_impl(int label,
+                       const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    if (label < 0 || label >= label_count())
+        throw MLDB::Exception("FrozenTreeEnsemble::predict(): invalid label");
+
+    OptimizedGetFeatures getFeatures(features, denseIndex_.data());
+
+    float result = bias_[label];
+    for (size_t i = 0;  i < numTrees_;  ++i) {
+        LabelResults results(label);
+        predictRecursive(getFeatures, results, trees_[i].root);
+        result += trees_[i].weight * (float)results.result;
+    }
+    return result;
+}
+
+std::string
+FrozenTreeEnsemble::
+print() const
+{
+    return summary();
+}
+
+std::string
+FrozenTreeEnsemble::
+summary() const
+{
+    return MLDB::format("Frozen tree ensemble: %zd trees, %zd nodes, "
+                        "%zd leaves", numTrees_, numNodes_, numLeaves_);
+}
+
+std::vector<Feature>
+FrozenTreeEnsemble::
+all_features() const
+{
+    return features_;
+}
+
+Output_Encoding
+FrozenTreeEnsemble::
+output_encoding() const
+{
+    return encoding_;
+}
+
+void
+FrozenTreeEnsemble::
+serialize(DB::Store_Writer & store) const
+{
+    throw MLDB::Exception("FrozenTreeEnsemble can't be serialized; "
+                          "use FrozenTreeEnsemble::save()");
+}
+
+void
+FrozenTreeEnsemble::
+reconstitute(DB::Store_Reader & store,
+             const std::shared_ptr<const Feature_Space> & features)
+{
+    throw MLDB::Exception("FrozenTreeEnsemble can't be reconstituted; "
+                          "use FrozenTreeEnsemble::load()");
+}
+
+FrozenTreeEnsemble *
+FrozenTreeEnsemble::
+make_copy() const
+{
+    return new FrozenTreeEnsemble(*this);
+}
+
+} // namespace MLDB
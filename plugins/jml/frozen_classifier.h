@@ -0,0 +1,151 @@
+/** frozen_classifier.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Flat, memory mappable representation of decision tree ensembles.
+*/
+
+#pragma once
+
+#include "mldb/plugins/jml/jml/classifier.h"
+#include "mldb/block/memory_region.h"
+#include "mldb/types/url.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FROZEN TREE ENSEMBLE                                                      */
+/*****************************************************************************/
+
+/** A decision tree, or a (possibly nested) committee of decision trees as
+    produced by random forests and bagging, flattened into arrays of fixed
+    size records so that it can be used straight from a memory mapped file.
+
+    The file is made of a header followed by sections aligned on 64 bytes:
+    the serialized feature space, the table of features that are split on,
+    the bias, the trees (root and weight), the nodes (feature, split value,
+    operation and the index of the true, false and missing children) and
+    the leaves (the prediction for each label).
+
+    Loading a model maps the file and reconstitutes the feature space; the
+    trees are never copied, so models load in time independent of their
+    size and the pages holding them are shared between all of the
+    processes that map the same file.
+
+    Predictions are the same as those of the classifier that was frozen,
+    except for nested committees which are flattened into a single one,
+    which can change the order in which floating point sums are taken.
+*/
+
+class FrozenTreeEnsemble : public ML::Classifier_Impl {
+public:
+    /** Return true if the given classifier is made only of decision trees
+        and committees of them, which is what can be frozen. */
+    static bool canFreeze(const ML::Classifier_Impl & classifier);
+
+    /** Write the given classifier to the given URL in the frozen format.
+        Local files are written to a temporary file that is then renamed,
+        so that processes that have the previous version mapped keep on
+        seeing it.  Throws if canFreeze() returns false.
+    */
+    static void save(const ML::Classifier_Impl & classifier, const Url & url);
+
+    /** Return true if the file at the given URL is in the frozen format. */
+    static bool isFrozen(const Url & url);
+
+    /** Return true if the given file contents are in the frozen format. */
+    static bool isFrozen(const char * data, size_t length);
+
+    /** Load a frozen classifier.  file:// URLs are memory mapped; others
+        are read into memory. */
+    static std::shared_ptr<FrozenTreeEnsemble> load(const Url & url);
+
+    /** Construct over the given frozen memory, which holds the whole of
+        a file written by save(). */
+    explicit FrozenTreeEnsemble(FrozenMemoryRegion region);
+
+    size_t numTrees() const { return numTrees_; }
+    size_t numNodes() const { return numNodes_; }
+    size_t numLeaves() const { return numLeaves_; }
+
+    using Classifier_Impl::predict;
+
+    virtual float predict(int label, const ML::Feature_Set & features,
+                          ML::PredictionContext * context = 0) const;
+
+    virtual ML::Label_Dist
+    predict(const ML::Feature_Set & features,
+            ML::PredictionContext * context = 0) const;
+
+    virtual bool optimization_supported() const;
+
+    virtual bool predict_is_optimized() const;
+
+    virtual bool optimize_impl(ML::Optimization_Info & info);
+
+    virtual ML::Label_Dist
+    optimized_predict_impl(const float * features,
+                           const ML::Optimization_Info & info,
+                           ML::PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_impl(const float * features,
+                           const ML::Optimization_Info & info,
+                           double * accum,
+                           double weight,
+                           ML::PredictionContext * context = 0) const;
+
+    virtual float
+    optimized_predict_impl(int label,
+                           const float * features,
+                           const ML::Optimization_Info & info,
+                           ML::PredictionContext * context = 0) const;
+
+    virtual std::string print() const;
+
+    virtual std::string summary() const;
+
+    virtual std::vector<ML::Feature> all_features() const;
+
+    virtual ML::Output_Encoding output_encoding() const;
+
+    /** Frozen classifiers are only written by save(); these throw. */
+    virtual void serialize(DB::Store_Writer & store) const;
+    virtual void
+    reconstitute(DB::Store_Reader & store,
+                 const std::shared_ptr<const ML::Feature_Space> & features);
+
+    virtual std::string class_id() const { return "FROZEN_TREE_ENSEMBLE"; }
+
+    /** Copies share the frozen memory. */
+    virtual FrozenTreeEnsemble * make_copy() const;
+
+    struct Header;
+    struct TreeEntry;
+    struct Node;
+
+private:
+    template<class GetFeatures, class Results>
+    void predictRecursive(const GetFeatures & getFeatures,
+                          Results & results,
+                          uint32_t ptr,
+                          double weight = 1.0) const;
+
+    FrozenMemoryRegion region;    ///< Holds the whole file
+    const TreeEntry * trees_;
+    const Node * nodes_;
+    const float * leaves_;        ///< label_count() floats per leaf
+    const float * bias_;          ///< label_count() floats
+    size_t numTrees_;
+    size_t numNodes_;
+    size_t numLeaves_;
+    bool committee_;              ///< Was frozen from a committee?
+    ML::Output_Encoding encoding_;
+
+    std::vector<ML::Feature> features_;  ///< Feature of each split
+    std::vector<int> denseIndex_;        ///< Optimized index of each feature
+    bool optimized_;
+};
+
+} // namespace MLDB
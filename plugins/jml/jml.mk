@@ -10,7 +10,7 @@ LIBJML_UTILS_LINK := \
 
 $(eval $(call library,jml_utils,$(LIBJML_UTILS_SOURCES),$(LIBJML_UTILS_LINK)))
 
-$(eval $(call include_sub_makes,algebra stats tsne jml))
+$(eval $(call include_sub_makes,algebra stats tsne jml neural))
 
 LIBML_SOURCES := \
 	dense_classifier.cc \
@@ -51,13 +51,16 @@ LIBMLDB_JML_PLUGIN_SOURCES:= \
 	experiment_procedure.cc \
 	randomforest.cc \
 	dataset_feature_space.cc \
+	feature_space_cache.cc \
+	frozen_classifier.cc \
 	kmeans_interface.cc \
 	em_interface.cc \
 	tsne_interface.cc \
 
 
 LIBMLDB_JML_PLUGIN_LINK:= \
-	ml
+	ml \
+	block
 
 $(eval $(call library,mldb_jml_plugin,$(LIBMLDB_JML_PLUGIN_SOURCES),$(LIBMLDB_JML_PLUGIN_LINK)))
 
@@ -17,6 +17,7 @@
 #include "mldb/plugins/jml/algebra/matrix_ops.h"
 #include "mldb/plugins/jml/algebra/lapack.h"
 #include "mldb/plugins/jml/algebra/least_squares.h"
+#include "mldb/plugins/jml/algebra/sparse_glz.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parallel.h"
 #include "mldb/utils/string_functions.h"
@@ -57,6 +58,8 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(max_regularization_iteration, "max_regularization_iteration", unparsedKeys);
     config.findAndRemove(regularization_epsilon, "regularization_epsilon", unparsedKeys);
     config.findAndRemove(feature_proportion, "feature_proportion", unparsedKeys);
+    config.findAndRemove(solver, "solver", unparsedKeys);
+    config.findAndRemove(l1_ratio, "l1_ratio", unparsedKeys);
 }
 
 void
@@ -74,6 +77,8 @@ defaults()
     max_regularization_iteration = 1000;
     regularization_epsilon = 1e-4;
     feature_proportion = 1.0;
+    solver = GLZ_Solver_irls;
+    l1_ratio = 0.5;
 }
 
 Config_Options
@@ -110,7 +115,16 @@ options() const
              " stability (but much slower training)")
         .add("feature_proportion", feature_proportion, "0 to 1",
              "use only a (random) portion of available features when training"
-             " classifier");
+             " classifier")
+        .add("solver", solver,
+             "training algorithm: irls builds a dense matrix of all features"
+             " and examples; lbfgs works on sparse features, which is needed"
+             " for large numbers of mostly absent (eg, hashed) features, but"
+             " supports only the logit and linear link functions and ignores"
+             " normalize and condition")
+        .add("l1_ratio", l1_ratio, "0 to 1",
+             "proportion of the regularization that is l1 with the"
+             " elastic_net regularization (lbfgs solver only)");
 
     return result;
 }
@@ -282,6 +296,15 @@ train_weighted(Thread_Context & thread_context,
             indexes.push_back(x);
     }
 
+    if (solver == GLZ_Solver_lbfgs) {
+        train_sparse(data, weights, indexes, result);
+        return 0.0;
+    }
+
+    if (regularization == Regularization_elastic_net)
+        throw Exception("GLZ_Classifier_Generator: elastic_net regularization"
+                        " requires the lbfgs solver");
+
     size_t nx2 = indexes.size();
 
     //cerr << "nx = " << nx << " nv = " << nv << " nx * nv = " << nx * nv
@@ -426,6 +449,132 @@ train_weighted(Thread_Context & thread_context,
 }
 
 
+void
+GLZ_Classifier_Generator::
+train_sparse(const Training_Data & data,
+             const boost::multi_array<float, 2> & weights,
+             const std::vector<int> & indexes,
+             GLZ_Classifier & result) const
+{
+    Feature predicted = model.predicted();
+    size_t nl = result.label_count();
+    bool regression_problem = (nl == 1);
+    size_t nx2 = indexes.size();
+    int nf = result.features.size();
+
+    // Which variables each feature (or feature value for categorical ones)
+    // feeds
+    std::map<Feature, std::vector<int> > byFeature;
+    std::map<std::pair<Feature, float>, int> byValue;
+    for (int i = 0;  i < nf;  ++i) {
+        auto & spec = result.features[i];
+        if (spec.type == GLZ_Classifier::Feature_Spec::VALUE_EQUALS)
+            byValue[{ spec.feature, spec.value }] = i;
+        else byFeature[spec.feature].push_back(i);
+    }
+
+    Timer t;
+
+    const vector<Label> & labels = data.index().labels(predicted);
+
+    std::vector<std::vector<std::pair<int, float> > > rows(nx2);
+    vector<distribution<double> > w(nl, distribution<double>(nx2));
+    vector<distribution<double> > correct(nl, distribution<double>(nx2));
+
+    auto onIndex = [&] (int index)
+        {
+            int x = indexes[index];
+            auto & row = rows[index];
+
+            // Like decode(), only the first value of each feature is used,
+            // and missing or non-finite values are zero
+            bool first = true;
+            Feature prev;
+            for (auto fv: data[x]) {
+                if (!first && fv.first == prev)
+                    continue;
+                first = false;
+                prev = fv.first;
+
+                float val = fv.second;
+                if (isnan(val))
+                    continue;
+
+                auto it = byFeature.find(fv.first);
+                if (it != byFeature.end()) {
+                    for (int i: it->second) {
+                        float decoded = val;
+                        if (result.features[i].type
+                            == GLZ_Classifier::Feature_Spec::PRESENCE)
+                            decoded = 1.0;
+                        else if (!isfinite(decoded))
+                            decoded = 0.0;
+                        if (decoded != 0.0)
+                            row.emplace_back(i, decoded);
+                    }
+                }
+
+                auto it2 = byValue.find({ fv.first, val });
+                if (it2 != byValue.end())
+                    row.emplace_back(it2->second, 1.0);
+            }
+
+            if (regression_problem) {
+                correct[0][index] = labels[x].value();
+                w[0][index] = weights[x][0];
+            }
+            else if (nl == 2 && weights.shape()[1] == 1) {
+                correct[0][index] = (double)(labels[x] == 0);
+                correct[1][index] = (double)(labels[x] == 1);
+                w[0][index] = weights[x][0];
+            }
+            else {
+                for (unsigned l = 0;  l < nl;  ++l) {
+                    correct[l][index] = (double)(labels[x] == l);
+                    w[l][index] = weights[x][l];
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, nx2, onIndex);
+
+    CSR_Matrix matrix(nf);
+    for (auto & row: rows) {
+        matrix.add_row(row);
+        std::vector<std::pair<int, float> >().swap(row);
+    }
+
+    if (verbosity > 0)
+        cerr << "sparse marshalling: " << t.elapsed() << " for "
+             << matrix.nnz() << " non-zero values over " << nx2
+             << " examples and " << nf << " features" << endl;
+    t.restart();
+
+    int nlr = nl;
+    if (nl == 2) nlr = 1;
+
+    result.weights.clear();
+    for (unsigned l = 0;  l < nlr;  ++l) {
+        distribution<double> trained
+            = train_sparse_glz(matrix, correct[l], w[l], link_function,
+                               add_bias, regularization,
+                               regularization_factor, l1_ratio,
+                               max_regularization_iteration,
+                               regularization_epsilon);
+        result.weights.push_back(trained.cast<float>());
+    }
+
+    if (verbosity > 0)
+        cerr << "lbfgs: " << t.elapsed() << endl;
+
+    if (nl == 2) {
+        // weights for second label are the mirror of those of the first
+        // label
+        result.weights.push_back(-1.0F * result.weights.front());
+    }
+}
+
+
 /*****************************************************************************/
 /* REGISTRATION                                                              */
 /*****************************************************************************/
@@ -437,4 +586,12 @@ Register_Factory<Classifier_Generator, GLZ_Classifier_Generator>
 
 } // file scope
 
+const Enum_Opt<ML::GLZ_Solver>
+Enum_Info<ML::GLZ_Solver>::OPT[2] = {
+    { "irls",  ML::GLZ_Solver_irls },
+    { "lbfgs", ML::GLZ_Solver_lbfgs }};
+
+const char * Enum_Info<ML::GLZ_Solver>::NAME
+   = "GLZ_Solver";
+
 } // namespace ML
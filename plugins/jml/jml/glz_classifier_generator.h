@@ -19,6 +19,17 @@
 namespace ML {
 
 
+/*****************************************************************************/
+/* GLZ_SOLVER                                                                */
+/*****************************************************************************/
+
+/** Algorithm used to train the GLZ. */
+enum GLZ_Solver {
+    GLZ_Solver_irls,    ///< Dense IRLS; needs nx x nv doubles of memory
+    GLZ_Solver_lbfgs    ///< Sparse L-BFGS; for many, mostly absent features
+};
+
+
 /*****************************************************************************/
 /* GLZ_CLASSIFIER_GENERATOR                                                  */
 /*****************************************************************************/
@@ -68,6 +79,8 @@ public:
     int max_regularization_iteration; ///< Maximum number of iterations in regularization
     double regularization_epsilon; ///< Epsilon to use when looking for convergence in regularization
     bool condition;         ///< Do we condition the feature matrix beforehand?
+    GLZ_Solver solver;      ///< Training algorithm
+    double l1_ratio;        ///< Proportion of l1 for elastic_net regularization
 
     Link_Function link_function;
     float feature_proportion;
@@ -82,10 +95,21 @@ public:
                          const boost::multi_array<float, 2> & weights,
                          const std::vector<Feature> & features,
                          GLZ_Classifier & result) const;
+
+private:
+    /** Train over a sparse representation of the given examples, once the
+        features of result have been chosen. */
+    void train_sparse(const Training_Data & data,
+                      const boost::multi_array<float, 2> & weights,
+                      const std::vector<int> & indexes,
+                      GLZ_Classifier & result) const;
 };
 
 
 } // namespace ML
 
 
+DECLARE_ENUM_INFO(ML::GLZ_Solver, 2);
+
+
 #endif /* __boosting__glz_classifier_generator_h__ */
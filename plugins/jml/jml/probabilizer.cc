@@ -12,6 +12,7 @@
 #include "training_index.h"
 #include "mldb/plugins/jml/jml/classifier.h"
 #include "mldb/plugins/jml/stats/moments.h"
+#include "mldb/plugins/jml/stats/calibration.h"
 #include "mldb/utils/distribution_ops.h"
 #include "mldb/utils/distribution_simd.h"
 #include "mldb/utils/xdiv.h"
@@ -60,8 +61,27 @@ ProbabilizerModelDescription()
              ML::LOGIT);
     addField("params", &ProbabilizerModel::params,
              "Parameterization of probabilizer");
+    addField("scores", &ProbabilizerModel::scores,
+             "Scores of the points of an isotonic probabilizer");
+    addField("probs", &ProbabilizerModel::probs,
+             "Probabilities of the points of an isotonic probabilizer");
 }
 
+namespace {
+
+/** Correction to the bias of a GLZ probabilizer to account for the
+    example weights that change the proportion of each label. */
+double rareEventsCorrection(double trueOneRate, double sampleOneRate)
+{
+    // http://gking.harvard.edu/files/0s.pdf, section 4.2
+    // Logistic Regression in Rare Events Data (Gary King and Langche Zeng)
+
+    return -log((1 - trueOneRate) / trueOneRate
+                * sampleOneRate / (1 - sampleOneRate));
+}
+
+} // file scope
+
 void
 ProbabilizerModel::
 train(const std::vector<std::tuple<float, float, float> >& fvs,
@@ -108,13 +128,7 @@ train(const std::vector<std::tuple<float, float, float> >& fvs,
 
     INFO_MSG(logger) << "probParams = " << probParams;
 
-    // http://gking.harvard.edu/files/0s.pdf, section 4.2
-    // Logistic Regression in Rare Events Data (Gary King and Langche Zeng)
-
-    double correction = -log((1 - trueOneRate) / trueOneRate
-                             * sampleOneRate / (1 - sampleOneRate));
-
-    probParams[1] += correction;
+    probParams[1] += rareEventsCorrection(trueOneRate, sampleOneRate);
 
     INFO_MSG(logger) << "paramAfter = " << probParams[1];
 
@@ -126,16 +140,121 @@ train(const std::vector<std::tuple<float, float, float> >& fvs,
     glz.params[0] = params;
 }
 
+void
+ProbabilizerModel::
+train(const Score_Histogram & histogram,
+      const std::string & style,
+      ML::Link_Function link)
+{
+    auto logger = MLDB::getMldbLog<ProbabilizerModel>();
+
+    if (style != "glz" && style != "isotonic")
+        throw MLDB::Exception("Unknown probabilizer style '" + style + "'");
+
+    // Only the bins with examples in them take part
+    std::vector<const Score_Histogram::Bin *> bins;
+    for (auto & b: histogram.bins)
+        if (b.weight > 0.0)
+            bins.push_back(&b);
+
+    size_t nx = bins.size();
+    if (nx == 0)
+        throw MLDB::Exception("Can't train a probabilizer without examples");
+
+    Score_Histogram::Bin total = histogram.total();
+    double trueOneRate = total.pos_rate();
+    double sampleOneRate = 1.0 * total.pos_count / total.count;
+
+    INFO_MSG(logger) << "training " << style << " probabilizer on " << nx
+                     << " bins for " << total.count << " examples; "
+                     << "trueOneRate = " << trueOneRate
+                     << " sampleOneRate = " << sampleOneRate;
+
+    this->style = style;
+    this->link = link;
+    params.clear();
+    scores.clear();
+    probs.clear();
+
+    if (style == "glz") {
+        // Each bin is an example at its mean score, with a fractional
+        // label and the weight of its examples
+        boost::multi_array<double, 2> outputs(boost::extents[2][nx]);
+        distribution<double> correct(nx), weights(nx);
+
+        for (unsigned x = 0;  x < nx;  ++x) {
+            outputs[0][x] = bins[x]->mean_score();
+            outputs[1][x] = 1.0;
+            correct[x]    = bins[x]->pos_rate();
+            weights[x]    = bins[x]->weight;
+        }
+
+        ML::Ridge_Regressor regressor;
+        params = ML::run_irls(correct, outputs, weights, link, regressor);
+
+        INFO_MSG(logger) << "probParams = " << params;
+
+        params[1] += rareEventsCorrection(trueOneRate, sampleOneRate);
+    }
+    else {
+        // The positive rate of the bins, made non-decreasing.  Each block
+        // becomes a point at its mean score.
+        std::vector<double> y(nx), w(nx);
+        for (unsigned x = 0;  x < nx;  ++x) {
+            y[x] = bins[x]->pos_rate();
+            w[x] = bins[x]->weight;
+        }
+
+        for (auto & block: pool_adjacent_violators(y.data(), w.data(), nx)) {
+            double scoreWeight = 0.0;
+            for (size_t x = block.first;  x < block.last;  ++x)
+                scoreWeight += bins[x]->score_weight;
+            scores.push_back(scoreWeight / block.weight);
+            probs.push_back(block.value);
+        }
+
+        INFO_MSG(logger) << "isotonic probabilizer has " << scores.size()
+                         << " points";
+    }
+
+    glz.link = link;
+    glz.params.resize(1);
+    glz.params[0] = params;
+}
+
+float
+ProbabilizerModel::
+apply(float score) const
+{
+    if (style != "isotonic")
+        return glz.apply(ML::Label_Dist(1, score))[0];
+
+    if (scores.empty())
+        throw MLDB::Exception("Isotonic probabilizer has no points");
+
+    // Constant beyond the first and last points, linear in between
+    auto it = std::upper_bound(scores.begin(), scores.end(), score);
+    if (it == scores.begin())
+        return probs.front();
+    if (it == scores.end())
+        return probs.back();
+
+    size_t i = it - scores.begin();
+    double frac = (score - scores[i - 1]) / (scores[i] - scores[i - 1]);
+    return probs[i - 1] + frac * (probs[i] - probs[i - 1]);
+}
+
 void 
 ProbabilizerModel::
 serialize(DB::Store_Writer & store) const
 {
-    const int version = 0;
+    const int version = 1;
 
     store << version;
     store << style;
     store << link;
     store << params;
+    store << scores << probs;
 }
 
 void 
@@ -144,9 +263,16 @@ reconstitute(DB::Store_Reader & store)
 {
     int version = 0;
     store >> version;
+    if (version > 1)
+        throw MLDB::Exception("Unknown ProbabilizerModel version %d",
+                              version);
     store >> style;
     store >> link;
     store >> params;
+    scores.clear();
+    probs.clear();
+    if (version >= 1)
+        store >> scores >> probs;
 
     glz.link = link;
     glz.params.resize(1);
@@ -335,12 +335,27 @@ operator >> (DB::Store_Reader & store, GLZ_Probabilizer & prob);
 /* PROBABILIZER                                                          */
 /*****************************************************************************/
 
+struct Score_Histogram;
+
 struct ProbabilizerModel
 {
     //Score, label, weight
     void train(const std::vector<std::tuple<float, float, float> >& fvs,
                ML::Link_Function link);
 
+    /** Train from a histogram of the scores rather than from each example,
+        which only costs as much as the number of bins.  The "glz" style
+        fits the GLZ on the mean score and positive rate of each bin (for
+        the logit link, this is Platt scaling); the "isotonic" style fits
+        an isotonic regression over the bins.
+    */
+    void train(const Score_Histogram & histogram,
+               const std::string & style,
+               ML::Link_Function link);
+
+    /** Return the probability for the given score. */
+    float apply(float score) const;
+
     void serialize(DB::Store_Writer & store) const;
     void reconstitute(DB::Store_Reader & store);
 
@@ -348,6 +363,11 @@ struct ProbabilizerModel
     ML::Link_Function link = LOGIT;
     distribution<double> params;
     ML::GLZ_Probabilizer glz;
+
+    /// For the isotonic style, probability at each score; the probability
+    /// is interpolated between them
+    std::vector<double> scores;
+    std::vector<double> probs;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProbabilizerModel);
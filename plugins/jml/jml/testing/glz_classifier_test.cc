@@ -239,6 +239,88 @@ BOOST_AUTO_TEST_CASE( test_glz_classifier_missing2 )
     BOOST_CHECK(info);
 }
 
+BOOST_AUTO_TEST_CASE( test_glz_classifier_lbfgs )
+{
+    cerr << endl << endl << endl << "lbfgs" << endl;
+
+    /* Same as the missing test, but with the sparse solver, over features
+       that are sometimes missing and categorical features. */
+
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1a", REAL);
+    fs.add_feature("feature1b", REAL);
+    fs.add_feature("feature2",  REAL);
+    fs.add_feature("feature3",  Feature_Info(CATEGORICAL, false, false));
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+    
+    float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features;
+
+        features.push_back(i % 3  == 0);
+        if (i % 2 == 0) {
+            features.push_back(i % 3  == 0);
+            features.push_back(NaN);
+        }
+        else {
+            features.push_back(NaN);
+            features.push_back(i % 3  == 0);
+        }
+        features.push_back(i % 5  == 0);
+        features.push_back(i % 7);
+
+        std::shared_ptr<Feature_Set> fset
+            = fs.encode(features);
+
+        data.add_example(fset);
+    }
+
+    Configuration config;
+    config.parse_string(config_options, "inbuilt config file");
+    config.parse_string("solver=lbfgs\nregularization=elastic_net\n",
+                        "lbfgs config");
+
+    GLZ_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    BOOST_CHECK(unparsedKeys.empty());
+    BOOST_CHECK_EQUAL(generator.solver, GLZ_Solver_lbfgs);
+    generator.init(fsp, fs.features()[0]);
+
+    distribution<float> training_weights(nfv, 1);
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    Thread_Context context;
+
+    std::shared_ptr<Classifier_Impl> classifier
+        = generator.generate(context, data, training_weights, features);
+
+    // The output is a normal GLZ
+    auto glz = std::dynamic_pointer_cast<GLZ_Classifier>(classifier);
+    BOOST_REQUIRE(glz);
+    BOOST_CHECK_EQUAL(glz->weights.size(), 2);
+
+    float accuracy = classifier->accuracy(data).first;
+    cerr << "accuracy = " << accuracy << endl;
+    BOOST_CHECK_EQUAL(accuracy, 1);
+
+    // elastic_net isn't supported by the default solver
+    generator.solver = GLZ_Solver_irls;
+    {
+        MLDB_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(generator.generate(context, data, training_weights,
+                                             features),
+                          Exception);
+    }
+}
+
 #define do_decode(val, type)                           \
     classifier.decode_value(val, \
                             GLZ_Classifier::Feature_Spec(Feature(1),    \
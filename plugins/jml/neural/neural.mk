@@ -14,6 +14,7 @@ LIBNEURAL_SOURCES := \
 	transfer_function.cc \
 	layer_stack.cc \
 	discriminative_trainer.cc \
+	parallel_trainer.cc \
 	auto_encoder.cc \
 	auto_encoder_stack.cc \
 	twoway_layer.cc \
@@ -22,7 +23,7 @@ LIBNEURAL_SOURCES := \
 	reconstruct_layer_adaptor.cc \
 	output_encoder.cc
 
-LIBNEURAL_LINK :=	utils db algebra arch judy boosting stats
+LIBNEURAL_LINK :=	utils db algebra arch base judy boosting stats
 
 $(eval $(call library,neural,$(LIBNEURAL_SOURCES),$(LIBNEURAL_LINK)))
 
@@ -7,6 +7,7 @@
 */
 
 #include "output_encoder.h"
+#include "mldb/plugins/jml/stats/auc.h"
 #include "mldb/types/db/persistent.h"
 
 
@@ -180,7 +181,27 @@ Output_Encoder::
 calc_auc(const std::vector<float> & outputs,
                 const std::vector<Label> & labels) const
 {
-    return 0.0;
+    // The outputs are those of the first output of the network.  Which
+    // labels push it towards value_true depends on the encoding.
+    std::vector<float> targets(labels.size());
+
+    switch (mode) {
+    case BINARY:
+        for (unsigned i = 0;  i < labels.size();  ++i)
+            targets[i] = labels[i].label() != 0;
+        break;
+
+    case MULTICLASS:
+        for (unsigned i = 0;  i < labels.size();  ++i)
+            targets[i] = labels[i].label() == 0;
+        break;
+
+    default:
+        // Not a classification problem
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return ML::calc_auc(outputs, targets, 0.0f, 1.0f);
 }
 
 void
@@ -57,7 +57,9 @@ struct Output_Encoder {
 
     distribution<float> decode(const distribution<float> & encoded) const;
 
-    /** For a classification problem, calculates the AUC metric. */
+    /** For a classification problem, calculates the AUC error (one minus
+        the area under the curve, as ML::calc_auc) of the first output.
+        Returns NaN for a regression problem. */
     double calc_auc(const std::vector<float> & outputs,
                     const std::vector<Label> & labels) const;
 
@@ -0,0 +1,388 @@
+/* parallel_trainer.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Multithreaded training of stacks of dense layers.
+*/
+
+#include "parallel_trainer.h"
+#include "mldb/plugins/jml/algebra/blocked_gemm.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* PARALLEL_TRAINER                                                          */
+/*****************************************************************************/
+
+/** Working space to propagate a block of examples. */
+struct Parallel_Trainer::Block {
+    Block(const std::vector<Dense_Layer<float> *> & layers, int block_size)
+        : values(layers.size() + 1)
+    {
+        size_t widest = layers[0]->inputs();
+        values[0].resize(block_size * layers[0]->inputs());
+        for (unsigned l = 0;  l < layers.size();  ++l) {
+            values[l + 1].resize(block_size * layers[l]->outputs());
+            widest = std::max(widest, layers[l]->outputs());
+        }
+        errors.resize(block_size * widest);
+        input_errors.resize(block_size * widest);
+        derivs.resize(widest);
+    }
+
+    /// Input of the network, then the output of each layer, for each
+    /// example in the block
+    std::vector<std::vector<float> > values;
+
+    /// Errors at the output and input of the current layer in bprop
+    std::vector<float> errors, input_errors;
+
+    /// Derivative of the transfer function for one example
+    std::vector<float> derivs;
+};
+
+/** Gradient of the error with respect to the parameters of each layer. */
+struct Parallel_Trainer::Gradient {
+    Gradient(const std::vector<Dense_Layer<float> *> & layers)
+        : weights(layers.size()), bias(layers.size())
+    {
+        for (unsigned l = 0;  l < layers.size();  ++l) {
+            weights[l].resize(layers[l]->inputs() * layers[l]->outputs());
+            bias[l].resize(layers[l]->outputs());
+        }
+    }
+
+    std::vector<std::vector<float> > weights, bias;
+
+    void clear()
+    {
+        for (auto & w: weights)
+            std::fill(w.begin(), w.end(), 0.0f);
+        for (auto & b: bias)
+            std::fill(b.begin(), b.end(), 0.0f);
+    }
+
+    void add(const Gradient & other)
+    {
+        for (unsigned l = 0;  l < weights.size();  ++l) {
+            MLDB::SIMD::vec_add(&weights[l][0], &other.weights[l][0],
+                                &weights[l][0], weights[l].size());
+            MLDB::SIMD::vec_add(&bias[l][0], &other.bias[l][0],
+                                &bias[l][0], bias[l].size());
+        }
+    }
+};
+
+Parallel_Trainer::
+Parallel_Trainer(Layer_Stack<Layer> & stack)
+    : block_size(64)
+{
+    if (!supports(stack))
+        throw Exception("Parallel_Trainer: can only train stacks of "
+                        "Dense_Layer<float> without missing value replacement");
+
+    for (unsigned i = 0;  i < stack.size();  ++i)
+        layers.push_back(dynamic_cast<Dense_Layer<float> *>(&stack[i]));
+}
+
+bool
+Parallel_Trainer::
+supports(const Layer_Stack<Layer> & stack)
+{
+    if (stack.size() == 0)
+        return false;
+
+    for (unsigned i = 0;  i < stack.size();  ++i) {
+        auto layer = dynamic_cast<const Dense_Layer<float> *>(&stack[i]);
+        if (!layer)
+            return false;
+        if (layer->missing_values != MV_NONE
+            && layer->missing_values != MV_ZERO)
+            return false;
+        if (i > 0 && layer->inputs() != stack[i - 1].outputs())
+            return false;
+    }
+
+    return true;
+}
+
+void
+Parallel_Trainer::
+fprop(const std::vector<const float *> & data,
+      const int * examples, size_t n, Block & block) const
+{
+    size_t ni = layers[0]->inputs();
+    bool zero_missing = layers[0]->missing_values == MV_ZERO;
+
+    float * input = &block.values[0][0];
+    for (size_t e = 0;  e < n;  ++e) {
+        const float * x = data[examples[e]];
+        float * row = input + e * ni;
+        for (size_t i = 0;  i < ni;  ++i) {
+            if (!std::isnan(x[i]))
+                row[i] = x[i];
+            else if (zero_missing)
+                row[i] = 0.0f;
+            else throw Exception("missing value with MV_NONE");
+        }
+    }
+
+    for (unsigned l = 0;  l < layers.size();  ++l) {
+        const Dense_Layer<float> & layer = *layers[l];
+        size_t ni = layer.inputs(), no = layer.outputs();
+
+        const float * in = &block.values[l][0];
+        float * out = &block.values[l + 1][0];
+
+        // Activations for the whole block in one multiply
+        sgemm(false, false, n, no, ni, 1.0f, in, ni,
+              layer.weights.data(), no, 0.0f, out, no);
+
+        for (size_t e = 0;  e < n;  ++e) {
+            float * row = out + e * no;
+            MLDB::SIMD::vec_add(row, &layer.bias[0], row, no);
+            layer.transfer_function->transfer(row, row, no);
+        }
+    }
+}
+
+void
+Parallel_Trainer::
+bprop(Block & block, size_t n, Gradient & gradient) const
+{
+    for (int l = layers.size() - 1;  l >= 0;  --l) {
+        const Dense_Layer<float> & layer = *layers[l];
+        size_t ni = layer.inputs(), no = layer.outputs();
+
+        const float * in = &block.values[l][0];
+        const float * out = &block.values[l + 1][0];
+        float * errors = &block.errors[0];
+
+        // Errors at the activation, which are also the bias gradient
+        for (size_t e = 0;  e < n;  ++e) {
+            float * row = errors + e * no;
+            layer.transfer_function->derivative(out + e * no,
+                                                &block.derivs[0], no);
+            MLDB::SIMD::vec_prod(&block.derivs[0], row, row, no);
+            MLDB::SIMD::vec_add(&gradient.bias[l][0], row,
+                                &gradient.bias[l][0], no);
+        }
+
+        // Weight gradient is the outer product of inputs and errors,
+        // summed over the block
+        sgemm(true, false, ni, no, n, 1.0f, in, ni, errors, no,
+              1.0f, &gradient.weights[l][0], no);
+
+        if (l == 0)
+            break;
+
+        // Errors at the input, which is the output of the layer below
+        sgemm(false, true, n, ni, no, 1.0f, errors, no,
+              layer.weights.data(), no, 0.0f, &block.input_errors[0], ni);
+        block.errors.swap(block.input_errors);
+    }
+}
+
+void
+Parallel_Trainer::
+update(const Gradient & gradient, float learning_rate) const
+{
+    for (unsigned l = 0;  l < layers.size();  ++l) {
+        Dense_Layer<float> & layer = *layers[l];
+        float * weights = layer.weights.data();
+        MLDB::SIMD::vec_add(weights, -learning_rate, &gradient.weights[l][0],
+                            weights, gradient.weights[l].size());
+        MLDB::SIMD::vec_add(&layer.bias[0], -learning_rate,
+                            &gradient.bias[l][0], &layer.bias[0],
+                            gradient.bias[l].size());
+    }
+}
+
+std::pair<double, double>
+Parallel_Trainer::
+train_iter(const std::vector<const float *> & data,
+           const std::vector<Label> & labels,
+           const std::vector<float> & weights,
+           const Output_Encoder & encoder,
+           Thread_Context & thread_context,
+           int minibatch_size,
+           float learning_rate,
+           Parallel_Training mode,
+           bool randomize_order) const
+{
+    int nx = data.size();
+    if (nx == 0)
+        return make_pair(0.0, 0.0);
+
+    vector<int> examples(nx);
+    std::iota(examples.begin(), examples.end(), 0);
+
+    if (randomize_order) {
+        std::mt19937 rng(thread_context.random());
+        std::shuffle(examples.begin(), examples.end(), rng);
+    }
+
+    size_t no = layers.back()->outputs();
+
+    // Output and error for each example, in the order of examples
+    distribution<float> outputs(nx);
+    vector<double> errors(nx);
+
+    /* Propagate the n examples starting at position x of the examples
+       forwards and backwards, accumulating the gradient. */
+    auto trainBlock = [&] (size_t x, size_t n, Block & block,
+                           Gradient & gradient)
+        {
+            fprop(data, &examples[x], n, block);
+
+            const float * out = &block.values.back()[0];
+            float * derrors = &block.errors[0];
+
+            for (size_t e = 0;  e < n;  ++e) {
+                int ex = examples[x + e];
+                distribution<float> target = encoder.target(labels[ex]);
+                float weight = weights.empty() ? 1.0 : weights[ex];
+
+                double error = 0.0;
+                for (size_t o = 0;  o < no;  ++o) {
+                    float diff = target[o] - out[e * no + o];
+                    error += diff * diff;
+                    derrors[e * no + o] = -2.0 * diff * weight;
+                }
+
+                outputs[x + e] = out[e * no];
+                errors[x + e] = sqrt(error);
+            }
+
+            bprop(block, n, gradient);
+        };
+
+    if (mode == PT_HOGWILD) {
+        // Each shard of examples is trained on its own, updating the
+        // shared parameters as it goes
+        int num_shards = std::min<int>(MLDB::numCpus() * 4,
+                                       (nx + block_size - 1) / block_size);
+        size_t shard_size = (nx + num_shards - 1) / num_shards;
+
+        auto onShard = [&] (int shard)
+            {
+                Block block(layers, block_size);
+                Gradient gradient(layers);
+
+                size_t end = std::min<size_t>(nx, (shard + 1) * shard_size);
+                for (size_t x = shard * shard_size;  x < end;  x += block_size) {
+                    gradient.clear();
+                    trainBlock(x, std::min<size_t>(block_size, end - x),
+                               block, gradient);
+                    update(gradient, learning_rate);
+                }
+            };
+
+        MLDB::parallelMap(0, num_shards, onShard);
+    }
+    else if (mode == PT_ALLREDUCE) {
+        if (minibatch_size <= 0)
+            minibatch_size = nx;
+
+        // Each minibatch is split into one chunk per thread; the gradients
+        // of the chunks are summed in order before the update, so that the
+        // result doesn't depend on scheduling
+        int num_chunks = std::min<int>(MLDB::numCpus(),
+                                       (minibatch_size + block_size - 1)
+                                       / block_size);
+        num_chunks = std::max(num_chunks, 1);
+
+        vector<Block> blocks(num_chunks, Block(layers, block_size));
+        vector<Gradient> gradients(num_chunks, Gradient(layers));
+
+        for (size_t x0 = 0;  x0 < nx;  x0 += minibatch_size) {
+            size_t x1 = std::min<size_t>(nx, x0 + minibatch_size);
+            size_t chunk_size = (x1 - x0 + num_chunks - 1) / num_chunks;
+
+            auto onChunk = [&] (int chunk)
+                {
+                    gradients[chunk].clear();
+                    size_t end = std::min(x1, x0 + (chunk + 1) * chunk_size);
+                    for (size_t x = x0 + chunk * chunk_size;  x < end;
+                         x += block_size) {
+                        trainBlock(x, std::min<size_t>(block_size, end - x),
+                                   blocks[chunk], gradients[chunk]);
+                    }
+                };
+
+            MLDB::parallelMap(0, num_chunks, onChunk);
+
+            for (int i = 1;  i < num_chunks;  ++i)
+                gradients[0].add(gradients[i]);
+
+            update(gradients[0], learning_rate);
+        }
+    }
+    else throw Exception("Parallel_Trainer: unsupported mode " + print(mode));
+
+    double total_error = 0.0;
+    for (double e: errors)
+        total_error += e;
+
+    vector<Label> test_labels(nx);
+    for (unsigned i = 0;  i < nx;  ++i)
+        test_labels[i] = labels[examples[i]];
+
+    return make_pair(sqrt(total_error / nx),
+                     encoder.calc_auc(outputs, test_labels));
+}
+
+std::pair<double, double>
+Parallel_Trainer::
+test(const std::vector<const float *> & data,
+     const std::vector<Label> & labels,
+     const Output_Encoder & encoder) const
+{
+    int nx = data.size();
+    if (nx == 0)
+        return make_pair(0.0, 0.0);
+
+    vector<int> examples(nx);
+    std::iota(examples.begin(), examples.end(), 0);
+
+    size_t no = layers.back()->outputs();
+
+    distribution<float> outputs(nx);
+    vector<double> errors(nx);
+
+    auto onBlocks = [&] (size_t x0, size_t x1)
+        {
+            Block block(layers, block_size);
+            for (size_t x = x0;  x < x1;  x += block_size) {
+                size_t n = std::min<size_t>(block_size, x1 - x);
+                fprop(data, &examples[x], n, block);
+
+                const float * out = &block.values.back()[0];
+                for (size_t e = 0;  e < n;  ++e) {
+                    outputs[x + e] = out[e * no];
+                    errors[x + e] = pow(labels[x + e] - out[e * no], 2);
+                }
+            }
+        };
+
+    // A few blocks per job so that each has work to do
+    MLDB::parallelMapChunked(0, nx, block_size * 16, onBlocks);
+
+    double total_error = 0.0;
+    for (double e: errors)
+        total_error += e;
+
+    return make_pair(sqrt(total_error / nx),
+                     encoder.calc_auc(outputs, labels));
+}
+
+} // namespace ML
@@ -0,0 +1,98 @@
+/* parallel_trainer.h                                              -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Multithreaded training of stacks of dense layers, propagating blocks of
+   examples at a time.
+*/
+
+#pragma once
+
+#include "dense_layer.h"
+#include "layer_stack.h"
+#include "output_encoder.h"
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* PARALLEL_TRAINER                                                          */
+/*****************************************************************************/
+
+/** Trainer for a stack of dense layers via backpropagation.  Examples are
+    propagated through the network in blocks, so that the forward and
+    backward passes are cache-blocked matrix multiplies rather than a
+    vector-matrix multiply per example, and the blocks are spread over
+    all of the cores.
+
+    There are two ways of combining the work of the threads:
+
+    - PT_HOGWILD shards the examples over the threads, and each thread
+      applies the update from each of its blocks directly to the shared
+      parameters, without any locking.  Updates from different threads may
+      occasionally overwrite each other, which has very little effect on
+      stochastic gradient descent but removes all synchronization.  The
+      result is not deterministic.
+    - PT_ALLREDUCE splits each mini-batch over the threads and sums their
+      gradients in a fixed order before making a single update, which
+      gives the same result however the blocks are scheduled.
+*/
+
+struct Parallel_Trainer {
+
+    /** Set up to train the given layer stack, whose parameters will be
+        updated in place.  It must be supported (see below).
+    */
+    Parallel_Trainer(Layer_Stack<Layer> & stack);
+
+    /** Can the given stack be trained?  Each layer must be a
+        Dense_Layer<float> that doesn't use missing value replacement. */
+    static bool supports(const Layer_Stack<Layer> & stack);
+
+    /** Train one iteration over the data.  Returns the same as
+        Discriminative_Trainer::train_iter.
+
+        For PT_HOGWILD, the parameters are updated after every block and
+        minibatch_size is ignored.
+    */
+    std::pair<double, double>
+    train_iter(const std::vector<const float *> & data,
+               const std::vector<Label> & labels,
+               const std::vector<float> & weights,
+               const Output_Encoder & encoder,
+               Thread_Context & thread_context,
+               int minibatch_size,
+               float learning_rate,
+               Parallel_Training mode,
+               bool randomize_order = false) const;
+
+    /** Evaluate the network over the data.  Returns the same as
+        Discriminative_Trainer::test.
+    */
+    std::pair<double, double>
+    test(const std::vector<const float *> & data,
+         const std::vector<Label> & labels,
+         const Output_Encoder & encoder) const;
+
+    /// Number of examples propagated together
+    int block_size;
+
+private:
+    std::vector<Dense_Layer<float> *> layers;
+
+    struct Block;
+    struct Gradient;
+
+    /** Propagate the n given examples forwards through the network,
+        leaving the outputs of each layer in the block. */
+    void fprop(const std::vector<const float *> & data,
+               const int * examples, size_t n, Block & block) const;
+
+    /** Propagate the errors of the last layer in block backwards through
+        the network, accumulating the gradient. */
+    void bprop(Block & block, size_t n, Gradient & gradient) const;
+
+    /** Apply the given gradient to the parameters. */
+    void update(const Gradient & gradient, float learning_rate) const;
+};
+
+} // namespace ML
@@ -50,28 +50,53 @@ std::ostream & operator << (std::ostream & stream, Sampling smp)
 
 BYTE_PERSISTENT_ENUM_IMPL(Sampling);
 
+std::string print(Parallel_Training pt)
+{
+    switch (pt) {
+    case PT_MINIBATCH: return "MINIBATCH";
+    case PT_HOGWILD:   return "HOGWILD";
+    case PT_ALLREDUCE: return "ALLREDUCE";
+    default: return format("Parallel_Training(%d)", pt);
+    }
+}
+
+std::ostream & operator << (std::ostream & stream, Parallel_Training pt)
+{
+    return stream << print(pt);
+}
+
 
-const Enum_Opt<MLDB::Transfer_Function_Type>
-Enum_Info<MLDB::Transfer_Function_Type>::
-OPT[Enum_Info<MLDB::Transfer_Function_Type>::NUM] = {
-    { "logsig",      MLDB::TF_LOGSIG   },
-    { "tanh",        MLDB::TF_TANH     },
-    { "tanhs",       MLDB::TF_TANHS    },
-    { "identity",    MLDB::TF_IDENTITY },
-    { "softmax",     MLDB::TF_SOFTMAX },
-    { "nonstandard", MLDB::TF_NONSTANDARD }
+const Enum_Opt<ML::Transfer_Function_Type>
+Enum_Info<ML::Transfer_Function_Type>::
+OPT[Enum_Info<ML::Transfer_Function_Type>::NUM] = {
+    { "logsig",      ML::TF_LOGSIG   },
+    { "tanh",        ML::TF_TANH     },
+    { "tanhs",       ML::TF_TANHS    },
+    { "identity",    ML::TF_IDENTITY },
+    { "softmax",     ML::TF_SOFTMAX },
+    { "nonstandard", ML::TF_NONSTANDARD }
 };
 
-const char * Enum_Info<MLDB::Transfer_Function_Type>::NAME
+const char * Enum_Info<ML::Transfer_Function_Type>::NAME
     = "Transfer_Function_Type";
 
-const Enum_Opt<MLDB::Sampling>
-Enum_Info<MLDB::Sampling>::OPT[Enum_Info<MLDB::Sampling>::NUM] = {
-    { "deterministic", MLDB::SAMP_DETERMINISTIC },
-    { "stochastic_bin", MLDB::SAMP_BINARY_STOCHASTIC },
-    { "stochastic_real", MLDB::SAMP_REAL_STOCHASTIC }
+const Enum_Opt<ML::Sampling>
+Enum_Info<ML::Sampling>::OPT[Enum_Info<ML::Sampling>::NUM] = {
+    { "deterministic", ML::SAMP_DETERMINISTIC },
+    { "stochastic_bin", ML::SAMP_BINARY_STOCHASTIC },
+    { "stochastic_real", ML::SAMP_REAL_STOCHASTIC }
+};
+
+const char * Enum_Info<ML::Sampling>::NAME = "Sampling";
+
+const Enum_Opt<ML::Parallel_Training>
+Enum_Info<ML::Parallel_Training>::
+OPT[Enum_Info<ML::Parallel_Training>::NUM] = {
+    { "minibatch", ML::PT_MINIBATCH },
+    { "hogwild",   ML::PT_HOGWILD   },
+    { "allreduce", ML::PT_ALLREDUCE }
 };
 
-const char * Enum_Info<MLDB::Sampling>::NAME = "Sampling";
+const char * Enum_Info<ML::Parallel_Training>::NAME = "Parallel_Training";
 
 } // namespace ML
@@ -42,10 +42,22 @@ std::ostream & operator << (std::ostream & stream, Sampling smp);
 
 BYTE_PERSISTENT_ENUM_DECL(Sampling);
 
+/** How the training of a network is split over multiple threads */
+enum Parallel_Training {
+    PT_MINIBATCH,   ///< One example at a time; threads share each minibatch
+    PT_HOGWILD,     ///< Blocks of examples; lock-free asynchronous updates
+    PT_ALLREDUCE    ///< Blocks of examples; gradients summed per minibatch
+};
+
+std::string print(Parallel_Training pt);
+
+std::ostream & operator << (std::ostream & stream, Parallel_Training pt);
+
 } // namespace ML
 
-DECLARE_ENUM_INFO(MLDB::Transfer_Function_Type, 6);
-DECLARE_ENUM_INFO(MLDB::Sampling, 3);
+DECLARE_ENUM_INFO(ML::Transfer_Function_Type, 6);
+DECLARE_ENUM_INFO(ML::Sampling, 3);
+DECLARE_ENUM_INFO(ML::Parallel_Training, 3);
 
 
 #endif /* __jml__perceptron_defs_h__ */
@@ -29,6 +29,7 @@
 #include "mldb/utils/pair_utils.h"
 #include "mldb/plugins/jml/neural/dense_layer.h"
 #include "discriminative_trainer.h"
+#include "parallel_trainer.h"
 
 using namespace std;
 
@@ -99,6 +100,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(do_decorrelate, "decorrelate", unparsedKeys);
     config.findAndRemove(do_normalize, "normalize", unparsedKeys);
     config.findAndRemove(target_value, "target_value", unparsedKeys);
+    config.findAndRemove(parallel, "parallel", unparsedKeys);
 }
 
 void
@@ -115,6 +117,7 @@ defaults()
     do_normalize = true;
     batch_size = 1024;
     target_value = 0.8;
+    parallel = PT_MINIBATCH;
 }
 
 Config_Options
@@ -141,7 +144,12 @@ options() const
              "normalize to zero mean and unit std before training")
         .add("batch_size", batch_size, "0.0-1.0 or 1 - nvectors",
              "number of samples in each \"mini batch\" for stochastic")
-        .add("target_value", target_value, "0.0-1.0", "the output for a 1 that we ask the network to provide");
+        .add("target_value", target_value, "0.0-1.0", "the output for a 1 that we ask the network to provide")
+        .add("parallel", parallel,
+             "how to train over multiple threads: minibatch (one example "
+             "at a time), hogwild (blocks of examples with lock-free "
+             "updates) or allreduce (blocks of examples, gradients summed "
+             "over each minibatch)");
     
     return result;
 }
@@ -261,6 +269,17 @@ generate(Thread_Context & context,
     Discriminative_Trainer trainer;
     trainer.layer = &train_stack;
 
+    // The block trainers evaluate layers with matrix multiplies, but only
+    // know about dense layers
+    std::unique_ptr<Parallel_Trainer> block_trainer;
+    if (parallel != PT_MINIBATCH) {
+        if (Parallel_Trainer::supports(train_stack))
+            block_trainer.reset(new Parallel_Trainer(train_stack));
+        else log("perceptron_generator", 1)
+                 << "network can't be trained with " << parallel
+                 << "; training one example at a time" << endl;
+    }
+
     bool randomize = false;
     float sample_proportion = 1.0;
 
@@ -289,17 +308,31 @@ generate(Thread_Context & context,
         {
             PROFILE_FUNCTION(t_train);
             
-            std::tie(train_acc, train_rmse)
-                = trainer.train_iter(examples, labels, training_ex_weights,
-                                     output_encoder,
-                                     context, our_batch_size, learning_rate,
-                                     verbosity, sample_proportion, randomize);
+            if (block_trainer)
+                std::tie(train_acc, train_rmse)
+                    = block_trainer->train_iter(examples, labels,
+                                                training_ex_weights,
+                                                output_encoder,
+                                                context, our_batch_size,
+                                                learning_rate, parallel,
+                                                randomize);
+            else
+                std::tie(train_acc, train_rmse)
+                    = trainer.train_iter(examples, labels, training_ex_weights,
+                                         output_encoder,
+                                         context, our_batch_size, learning_rate,
+                                         verbosity, sample_proportion, randomize);
         }
 
         if (validate_is_train) {
             validate_acc = train_acc;
             validate_rmse = train_rmse;
         }
+        else if (block_trainer) {
+            std::tie(validate_acc, validate_rmse)
+                = block_trainer->test(val_examples, val_labels,
+                                      output_encoder);
+        }
         else {
             std::tie(validate_acc, validate_rmse)
                 = trainer.test(val_examples, val_labels, validate_ex_weights,
@@ -68,6 +68,7 @@ public:
     bool do_normalize;
     float batch_size;
     float target_value;
+    Parallel_Training parallel;
 
     std::string arch_str;
 
@@ -11,3 +11,4 @@
 #$(eval $(call test,perceptron_test,neural utils boosting,boost manual))
 #$(eval $(call test,output_encoder_test,neural,boost))
 
+$(eval $(call test,parallel_trainer_test,neural,boost))
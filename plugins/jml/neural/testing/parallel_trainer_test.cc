@@ -0,0 +1,191 @@
+/* parallel_trainer_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Unit tests for the multithreaded trainer of dense layer stacks.
+*/
+
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#undef NDEBUG
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/neural/parallel_trainer.h"
+#include "mldb/plugins/jml/neural/discriminative_trainer.h"
+#include "mldb/utils/smart_ptr_utils.h"
+#include <random>
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+struct Problem {
+    Problem(int nx, int nf)
+        : values(nx, vector<float>(nf))
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> val(-1.0, 1.0);
+
+        for (int x = 0;  x < nx;  ++x) {
+            double total = 0.0;
+            for (int f = 0;  f < nf;  ++f) {
+                values[x][f] = val(rng);
+                total += (f % 2 ? 1.0 : -1.0) * values[x][f];
+            }
+            data.push_back(&values[x][0]);
+            labels.push_back(total > 0);
+        }
+
+        weights.resize(nx, 1.0 / nx);
+
+        encoder.mode = Output_Encoder::BINARY;
+        encoder.value_true = 0.8;
+        encoder.value_false = -0.8;
+        encoder.num_inputs = encoder.num_outputs = 1;
+    }
+
+    vector<vector<float> > values;
+    vector<const float *> data;
+    vector<Label> labels;
+    vector<float> weights;
+    Output_Encoder encoder;
+};
+
+Layer_Stack<Layer> make_network(int nf, int nh)
+{
+    Thread_Context context(42);
+    Layer_Stack<Layer> result("test");
+    result.add(make_sp(new Dense_Layer<float>("hidden", nf, nh, TF_TANH,
+                                              MV_NONE, context)));
+    result.add(make_sp(new Dense_Layer<float>("output", nh, 1, TF_TANH,
+                                              MV_NONE, context)));
+    return result;
+}
+
+double max_difference(const Layer_Stack<Layer> & s1,
+                      const Layer_Stack<Layer> & s2)
+{
+    Parameters_Copy<float> p1(s1.parameters()), p2(s2.parameters());
+    BOOST_REQUIRE_EQUAL(p1.values.size(), p2.values.size());
+    double result = 0.0;
+    for (unsigned i = 0;  i < p1.values.size();  ++i)
+        result = std::max<double>(result, fabs(p1.values[i] - p2.values[i]));
+    return result;
+}
+
+double accuracy(const Layer_Stack<Layer> & network, const Problem & problem)
+{
+    int correct = 0;
+    for (unsigned x = 0;  x < problem.data.size();  ++x) {
+        float output;
+        network.apply(problem.data[x], &output);
+        correct += (output > 0) == (problem.labels[x] > 0);
+    }
+    return 1.0 * correct / problem.data.size();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_supports )
+{
+    Layer_Stack<Layer> network = make_network(4, 3);
+    BOOST_CHECK(Parallel_Trainer::supports(network));
+
+    Thread_Context context;
+    Layer_Stack<Layer> missing("missing");
+    missing.add(make_sp(new Dense_Layer<float>("input", 4, 3, TF_TANH,
+                                               MV_DENSE, context)));
+    BOOST_CHECK(!Parallel_Trainer::supports(missing));
+    BOOST_CHECK_THROW(Parallel_Trainer trainer(missing), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_allreduce_matches_single_example_training )
+{
+    int nx = 1000, nf = 20, nh = 10;
+    Problem problem(nx, nf);
+
+    Layer_Stack<Layer> network1 = make_network(nf, nh);
+    Layer_Stack<Layer> network2 = make_network(nf, nh);
+    BOOST_CHECK_EQUAL(max_difference(network1, network2), 0.0);
+
+    Thread_Context context;
+
+    Discriminative_Trainer trainer1;
+    trainer1.layer = &network1;
+
+    Parallel_Trainer trainer2(network2);
+
+    // Both make one update per minibatch of 100, so should end up with
+    // the same parameters apart from rounding
+    for (unsigned i = 0;  i < 3;  ++i) {
+        trainer1.train_iter(problem.data, problem.labels, problem.weights,
+                            problem.encoder, context, 100, 0.5,
+                            0 /* verbosity */, 1.0, false);
+        trainer2.train_iter(problem.data, problem.labels, problem.weights,
+                            problem.encoder, context, 100, 0.5,
+                            PT_ALLREDUCE);
+    }
+
+    BOOST_CHECK_LT(max_difference(network1, network2), 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE( test_hogwild_learns )
+{
+    int nx = 10000, nf = 20, nh = 10;
+    Problem problem(nx, nf);
+
+    Layer_Stack<Layer> network = make_network(nf, nh);
+    Parallel_Trainer trainer(network);
+    Thread_Context context;
+
+    double rmse_before
+        = trainer.test(problem.data, problem.labels, problem.encoder).first;
+
+    std::pair<double, double> trained;
+    for (unsigned i = 0;  i < 20;  ++i)
+        trained = trainer.train_iter(problem.data, problem.labels,
+                                     problem.weights, problem.encoder,
+                                     context, 0, 10.0, PT_HOGWILD,
+                                     true /* randomize */);
+
+    auto tested = trainer.test(problem.data, problem.labels, problem.encoder);
+    double rmse_after = tested.first;
+
+    cerr << "rmse before " << rmse_before << " after " << rmse_after
+         << " accuracy " << accuracy(network, problem)
+         << " auc error " << tested.second << endl;
+    BOOST_CHECK_LT(rmse_after, rmse_before);
+    BOOST_CHECK_GT(accuracy(network, problem), 0.95);
+    BOOST_CHECK_LT(trained.second, 0.05);
+    BOOST_CHECK_LT(tested.second, 0.05);
+}
+
+BOOST_AUTO_TEST_CASE( test_auc_follows_encoding )
+{
+    Problem problem(1000, 20);
+    Layer_Stack<Layer> network = make_network(20, 10);
+    Parallel_Trainer trainer(network);
+    Thread_Context context;
+
+    for (unsigned i = 0;  i < 10;  ++i)
+        trainer.train_iter(problem.data, problem.labels, problem.weights,
+                           problem.encoder, context, 0, 10.0, PT_HOGWILD);
+
+    // With two outputs, the first one is that of class 0, so the same
+    // outputs rank the examples the other way round
+    Output_Encoder multiclass = problem.encoder;
+    multiclass.mode = Output_Encoder::MULTICLASS;
+
+    auto binary = trainer.test(problem.data, problem.labels, problem.encoder);
+    auto inverted = trainer.test(problem.data, problem.labels, multiclass);
+    BOOST_CHECK_LT(binary.second, 0.1);
+    BOOST_CHECK_CLOSE(inverted.second, 1.0 - binary.second, 1e-3);
+
+    // Regression has no AUC
+    Output_Encoder regression = problem.encoder;
+    regression.mode = Output_Encoder::REGRESSION;
+    BOOST_CHECK(std::isnan(trainer.test(problem.data, problem.labels,
+                                        regression).second));
+}
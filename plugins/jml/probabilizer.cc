@@ -8,6 +8,7 @@
 
 #include "probabilizer.h"
 #include "mldb/plugins/jml/jml/probabilizer.h"
+#include "mldb/plugins/jml/stats/calibration.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/core/dataset.h"
 #include "mldb/sql/sql_expression.h"
@@ -16,6 +17,7 @@
 #include "mldb/utils/distribution.h"
 #include "mldb/base/scope.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/per_thread_accumulator.h"
 #include "mldb/plugins/jml/jml/thread_context.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/utils/vector_utils.h"
@@ -70,6 +72,20 @@ ProbabilizerConfigDescription()
     addField("link", &ProbabilizerConfig::link,
              "Link function to use.",
              ML::LOGIT);
+    addField("style", &ProbabilizerConfig::style,
+             "Kind of probabilizer to train.  `glz` (the default) fits a "
+             "generalized linear model with the given `link` function; with "
+             "the `logit` link this is Platt scaling.  `isotonic` fits a "
+             "non-decreasing, piecewise linear function of the score, and "
+             "ignores the `link` parameter.",
+             std::string("glz"));
+    addField("numBins", &ProbabilizerConfig::numBins,
+             "Number of bins of the histogram of scores that the probabilizer "
+             "is fitted on.  Fitting on a histogram costs the same no matter "
+             "how many rows there are, at the price of the resolution of the "
+             "scores.  With 0 (the default), a `glz` probabilizer is fitted "
+             "on each row and an `isotonic` one on 10000 bins.",
+             0);
     addField("modelFileUrl", &ProbabilizerConfig::modelFileUrl,
              "URL where the model file (with extension '.prb') should be saved. "
              "This file can be loaded by the ![](%%doclink probabilizer function). "
@@ -123,6 +139,15 @@ run(const ProcedureRunConfig & run,
 
     auto runProcConf = applyRunConfOverProcConf(probabilizerConfig, run);
 
+    if (runProcConf.style != "glz" && runProcConf.style != "isotonic")
+        throw AnnotatedException(400, "Unknown probabilizer style '"
+                                 + runProcConf.style + "'; must be 'glz' "
+                                 "or 'isotonic'",
+                                 "style", runProcConf.style);
+    if (runProcConf.numBins < 0)
+        throw AnnotatedException(400, "numBins must not be negative",
+                                 "numBins", runProcConf.numBins);
+
 
     auto onProgress2 = [&] (const Json::Value & progress)
         {
@@ -144,23 +169,21 @@ run(const ProcedureRunConfig & run,
     std::vector<std::shared_ptr<SqlExpression> > extra
         = { score, label, weight };
 
-    // Build it
+    // Each thread keeps its own arrays, which are used in place
 
-    // ...
+    struct ThreadAccum {
+        std::vector<float> scores, labels, weights;
+    };
 
-    std::mutex fvsLock;
-    std::vector<std::tuple<float, float, float> > fvs;
+    PerThreadAccumulator<ThreadAccum> accum;
 
     auto processor = [&] (NamedRowValue & row,
                            const std::vector<ExpressionValue> & extraVals)
         {
-            float score = extraVals.at(0).toDouble();
-            float label = extraVals.at(1).toDouble();
-            float weight = extraVals.at(2).toDouble();
-
-            std::unique_lock<std::mutex> guard(fvsLock);
-
-            fvs.emplace_back(score, label, weight);
+            ThreadAccum & thr = accum.get();
+            thr.scores.push_back(extraVals.at(0).toDouble());
+            thr.labels.push_back(extraVals.at(1).toDouble());
+            thr.weights.push_back(extraVals.at(2).toDouble());
             return true;
         };
 
@@ -173,7 +196,43 @@ run(const ProcedureRunConfig & run,
                    runProcConf.trainingData.stm->limit);
 
     ProbabilizerModel probabilizer;
-    probabilizer.train(fvs, runProcConf.link);
+
+    int numBins = runProcConf.numBins;
+    if (numBins == 0 && runProcConf.style == "isotonic")
+        numBins = 10000;
+
+    if (numBins == 0) {
+        // Each thread's arrays are freed as soon as they've been copied,
+        // so they don't all exist twice at once
+        size_t numRows = 0;
+        accum.forEach([&] (ThreadAccum * thr)
+                      {
+                          numRows += thr->scores.size();
+                      });
+
+        std::vector<std::tuple<float, float, float> > fvs;
+        fvs.reserve(numRows);
+        accum.forEach([&] (ThreadAccum * thr)
+                      {
+                          for (size_t i = 0;  i < thr->scores.size();  ++i)
+                              fvs.emplace_back(thr->scores[i], thr->labels[i],
+                                               thr->weights[i]);
+                          *thr = ThreadAccum();
+                      });
+        probabilizer.train(fvs, runProcConf.link);
+    }
+    else {
+        std::vector<Score_Histogram::Examples> examples;
+        accum.forEach([&] (ThreadAccum * thr)
+                      {
+                          examples.push_back({ thr->scores.data(),
+                                               thr->labels.data(),
+                                               thr->weights.data(),
+                                               thr->scores.size() });
+                      });
+        auto histogram = Score_Histogram::build(examples, numBins);
+        probabilizer.train(histogram, runProcConf.style, runProcConf.link);
+    }
 
     if (!runProcConf.modelFileUrl.toString().empty()) {
         filter_ostream stream(runProcConf.modelFileUrl);
@@ -210,7 +269,7 @@ ProbabilizeFunctionConfigDescription()
 }
 
 struct ProbabilizeFunction::Itl {
-    ML::GLZ_Probabilizer probabilizer;
+    ProbabilizerModel probabilizer;
 };
 
 ProbabilizeFunction::
@@ -222,10 +281,10 @@ ProbabilizeFunction(MldbEngine * owner,
     functionConfig = config.params.convert<ProbabilizeFunctionConfig>();
     itl.reset(new Itl());
     filter_istream stream(functionConfig.modelFileUrl);
-    auto repr = jsonDecodeStream<ProbabilizerModel>(stream);
-    itl->probabilizer.link = repr.link;
-    itl->probabilizer.params.resize(1);
-    itl->probabilizer.params[0] = repr.params;
+    itl->probabilizer = jsonDecodeStream<ProbabilizerModel>(stream);
+    itl->probabilizer.glz.link = itl->probabilizer.link;
+    itl->probabilizer.glz.params.resize(1);
+    itl->probabilizer.glz.params[0] = itl->probabilizer.params;
 }
 
 ProbabilizeFunction::
@@ -234,7 +293,8 @@ ProbabilizeFunction(MldbEngine * owner,
     : Function(owner, PolyConfig())
 {
     itl.reset(new Itl());
-    itl->probabilizer = in;
+    itl->probabilizer.link = in.link;
+    itl->probabilizer.glz = in;
 }
 
 ProbabilizeFunction::
@@ -255,7 +315,7 @@ apply(const FunctionApplier & applier,
       const ExpressionValue & context) const
 {
     ExpressionValue score = context.getColumn(PathElement("score"));
-    float prob  = itl->probabilizer.apply(ML::Label_Dist(1, score.toDouble()))[0];
+    float prob  = itl->probabilizer.apply(score.toDouble());
 
     StructValue result;
     result.emplace_back(PathElement("prob"),
@@ -32,7 +32,7 @@ struct ProbabilizerConfig : public ProcedureConfig {
     static constexpr const char * name = "probabilizer.train";
 
     ProbabilizerConfig()
-        : link(ML::LOGIT)
+        : link(ML::LOGIT), style("glz"), numBins(0)
     {
     }
 
@@ -45,6 +45,12 @@ struct ProbabilizerConfig : public ProcedureConfig {
     /// Link function to use
     ML::Link_Function link;
 
+    /// Kind of probabilizer to train: "glz" or "isotonic"
+    std::string style;
+
+    /// Number of score histogram bins to fit on; 0 fits on each example
+    int numBins;
+
     Utf8String functionName;
 };
 
@@ -13,6 +13,8 @@
 #include "mldb/arch/timers.h"
 #include "mldb/utils/profile.h"
 #include "mldb/plugins/jml/randomforest.h"
+#include "mldb/plugins/jml/feature_space_cache.h"
+#include "mldb/plugins/jml/frozen_classifier.h"
 #include "mldb/plugins/jml/value_descriptions.h"
 #include "mldb/builtin/sql_expression_extractors.h"
 #include "mldb/plugins/jml/classifier.h"
@@ -54,6 +56,21 @@ RandomForestProcedureConfigDescription()
     addField("modelFileUrl", &RandomForestProcedureConfig::modelFileUrl,
              "URL where the model file (with extension '.cls') should be saved. "
              "This file can be loaded by the ![](%%doclink classifier function). ");
+    addField("featureCacheUrl", &RandomForestProcedureConfig::featureCacheUrl,
+             "Directory (a `file://` URL) that keeps the bucketized "
+             "feature columns, which are memory mapped back by later forests "
+             "trained over the same columns of the same version of the "
+             "dataset.  Useful when tuning the forest's parameters; the "
+             "columns are bucketized again for each forest when this is "
+             "empty.");
+    addField("frozenModel", &RandomForestProcedureConfig::frozenModel,
+             "Save the model in the frozen format, where the trees are "
+             "flattened into arrays that the ![](%%doclink classifier function) "
+             "memory maps instead of reading them.  Frozen models load in "
+             "the same time whatever their size, and processes that load "
+             "the same model file share its memory.  Only decision trees "
+             "and ensembles of them (bagged decision trees and random "
+             "forests) can be frozen.", false);
     addField("featureVectorSamplings", &RandomForestProcedureConfig::featureVectorSamplings,
              "Number of samplings of feature vectors. "
              "The total number of bags will be featureVectorSamplings*featureSamplings.", 5);
@@ -225,8 +242,10 @@ run(const ProcedureRunConfig & run,
     std::set<ColumnPath> knownInputColumns
         = getColumnsInExpression(select);
 
-    auto featureSpace = std::make_shared<DatasetFeatureSpace>
-        (boundDataset.dataset, labelInfo, knownInputColumns, true /* bucketize */);
+    auto featureSpace = FeatureSpaceCache::get
+        (boundDataset.dataset, runProcConf.trainingData.stm->from->print(),
+         labelInfo, knownInputColumns, true /* bucketize */,
+         runProcConf.featureCacheUrl);
 
     INFO_MSG(logger) << "feature space construction took " << timer.elapsed();
     timer.restart();
@@ -386,7 +405,9 @@ run(const ProcedureRunConfig & run,
     try {
         makeUriDirectory(
             runProcConf.modelFileUrl.toDecodedString());
-        classifier.save(runProcConf.modelFileUrl.toString());
+        if (runProcConf.frozenModel)
+            FrozenTreeEnsemble::save(*result, runProcConf.modelFileUrl);
+        else classifier.save(runProcConf.modelFileUrl.toString());
     }
     catch (const std::exception & exc) {
         saved = false;
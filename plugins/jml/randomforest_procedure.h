@@ -23,7 +23,8 @@ namespace MLDB {
 struct RandomForestProcedureConfig : public ProcedureConfig {
     static constexpr const char * name = "randomforest.binary.train";
 
-    RandomForestProcedureConfig() : featureVectorSamplings(5),
+    RandomForestProcedureConfig() : frozenModel(false),
+                                    featureVectorSamplings(5),
                                     featureSamplings(20),
                                     featureVectorSamplingProp(0.3f),
                                     featureSamplingProp(0.3f),
@@ -38,6 +39,12 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
     /// Where to save the classifier to
     Url modelFileUrl;
 
+    /// Directory in which to keep the bucketed feature space between runs
+    Url featureCacheUrl;
+
+    /// Save the model in the flat, memory mapped format
+    bool frozenModel;
+
     /// Number of samplings of feature vectors
     int featureVectorSamplings;
 
@@ -0,0 +1,281 @@
+/* calibration.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Building blocks for score calibration.
+*/
+
+#include "mldb/plugins/jml/stats/calibration.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+Score_Histogram::Bin &
+Score_Histogram::Bin::
+operator += (const Bin & other)
+{
+    weight += other.weight;
+    pos_weight += other.pos_weight;
+    score_weight += other.score_weight;
+    count += other.count;
+    pos_count += other.pos_count;
+    return *this;
+}
+
+Score_Histogram::
+Score_Histogram(std::vector<float> bounds_)
+    : bounds(std::move(bounds_))
+{
+    for (size_t i = 1;  i < bounds.size();  ++i) {
+        if (!(bounds[i - 1] < bounds[i]))
+            throw MLDB::Exception("Score_Histogram: bin boundaries must be "
+                                  "strictly increasing");
+    }
+    bins.resize(bounds.size() + 1);
+}
+
+Score_Histogram &
+Score_Histogram::
+operator += (const Score_Histogram & other)
+{
+    if (other.bounds != bounds)
+        throw MLDB::Exception("Score_Histogram: can't merge histograms with "
+                              "different bins");
+    for (size_t i = 0;  i < bins.size();  ++i)
+        bins[i] += other.bins[i];
+    return *this;
+}
+
+Score_Histogram::Bin
+Score_Histogram::
+total() const
+{
+    Bin result;
+    for (auto & b: bins)
+        result += b;
+    return result;
+}
+
+Score_Histogram
+Score_Histogram::
+build(const std::vector<Examples> & examples, int num_bins)
+{
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    if (num_bins < 1)
+        throw MLDB::Exception("Score_Histogram: need at least one bin");
+
+    // Work is done over chunks of the parts, in order
+    struct Chunk {
+        const Examples * part;
+        size_t first, last;
+        size_t num_weighted;    ///< Examples with a weight in the chunk
+        size_t weighted_before; ///< Examples with a weight before it
+        size_t sample_offset;   ///< Index of its first sampled score
+    };
+
+    std::vector<Chunk> chunks;
+    for (auto & part: examples) {
+        for (size_t i = 0;  i < part.n;  i += CHUNK_SIZE)
+            chunks.push_back({ &part, i, std::min(part.n, i + CHUNK_SIZE),
+                               0, 0, 0 });
+    }
+
+    // 1.  Check the scores, and count those with a weight
+    auto onCount = [&] (size_t c)
+        {
+            Chunk & chunk = chunks[c];
+            const Examples & part = *chunk.part;
+            for (size_t i = chunk.first;  i < chunk.last;  ++i) {
+                if (part.weights[i] == 0.0)
+                    continue;
+                if (!std::isfinite(part.scores[i]))
+                    throw MLDB::Exception("Score_Histogram: score %f isn't "
+                                          "finite", part.scores[i]);
+                ++chunk.num_weighted;
+            }
+        };
+
+    MLDB::parallelMap(0, chunks.size(), onCount);
+
+    size_t num_weighted = 0;
+    for (auto & chunk: chunks)
+        num_weighted += chunk.num_weighted;
+
+    if (num_weighted == 0)
+        return Score_Histogram();
+
+    // 2.  Take every stride'th score with a weight as a sample, and use its
+    //     quantiles as the bin boundaries
+    size_t max_sample = std::max<size_t>((size_t)num_bins * 64, 1 << 20);
+    size_t stride = (num_weighted + max_sample - 1) / max_sample;
+
+    size_t weighted_before = 0;
+    for (auto & chunk: chunks) {
+        chunk.weighted_before = weighted_before;
+        chunk.sample_offset = (weighted_before + stride - 1) / stride;
+        weighted_before += chunk.num_weighted;
+    }
+    size_t sample_size = (num_weighted + stride - 1) / stride;
+
+    std::vector<float> sample(sample_size);
+
+    auto onSample = [&] (size_t c)
+        {
+            const Chunk & chunk = chunks[c];
+            const Examples & part = *chunk.part;
+            // Index among all scores with a weight of the next one to
+            // sample, and of the current one
+            size_t index = chunk.sample_offset * stride;
+            size_t seen = chunk.weighted_before;
+            float * out = sample.data() + chunk.sample_offset;
+            for (size_t i = chunk.first;  i < chunk.last;  ++i) {
+                if (part.weights[i] == 0.0)
+                    continue;
+                if (seen++ == index) {
+                    *out++ = part.scores[i];
+                    index += stride;
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, chunks.size(), onSample);
+
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<float> bounds;
+    for (int b = 1;  b < num_bins;  ++b) {
+        float bound = sample[sample.size() * b / num_bins];
+        if (bound > sample.front()
+            && (bounds.empty() || bound > bounds.back()))
+            bounds.push_back(bound);
+    }
+
+    Score_Histogram result(std::move(bounds));
+
+    // 3.  Fill in a histogram per group of chunks, and merge them in order
+    //     so that the result is deterministic
+    size_t num_parts = std::min<size_t>(chunks.size(), MLDB::numCpus());
+    std::vector<Score_Histogram> parts(num_parts, result);
+
+    auto onPart = [&] (size_t p)
+        {
+            Score_Histogram & hist = parts[p];
+            for (size_t c = chunks.size() * p / num_parts;
+                 c < chunks.size() * (p + 1) / num_parts;  ++c) {
+                const Chunk & chunk = chunks[c];
+                const Examples & part = *chunk.part;
+                for (size_t i = chunk.first;  i < chunk.last;  ++i) {
+                    if (part.weights[i] == 0.0)
+                        continue;
+                    hist.add(part.scores[i], part.labels[i] != 0.0,
+                             part.weights[i]);
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, num_parts, onPart);
+
+    for (auto & p: parts)
+        result += p;
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ISOTONIC REGRESSION                                                       */
+/*****************************************************************************/
+
+namespace {
+
+/** Pool the given blocks, which are in order, into the blocks of the
+    isotonic fit. */
+std::vector<PAV_Block>
+pool(std::vector<PAV_Block> blocks)
+{
+    std::vector<PAV_Block> result;
+    result.reserve(blocks.size());
+
+    for (auto & b: blocks) {
+        result.push_back(b);
+
+        // Merge backwards while the order is violated.  Blocks without
+        // weight have no value of their own, so they're always merged.
+        while (result.size() > 1) {
+            PAV_Block & cur = result.back();
+            PAV_Block & prev = result[result.size() - 2];
+            if (cur.weight > 0.0 && prev.weight > 0.0
+                && prev.value <= cur.value)
+                break;
+            double weight = prev.weight + cur.weight;
+            if (weight > 0.0)
+                prev.value = (prev.value * prev.weight
+                              + cur.value * cur.weight) / weight;
+            prev.weight = weight;
+            prev.last = cur.last;
+            result.pop_back();
+        }
+    }
+
+    return result;
+}
+
+std::vector<PAV_Block>
+pool_range(const double * y, const double * w, size_t first, size_t last)
+{
+    std::vector<PAV_Block> blocks;
+    blocks.reserve(last - first);
+    for (size_t i = first;  i < last;  ++i)
+        blocks.push_back({ i, i + 1, w[i], w[i] > 0.0 ? y[i] : 0.0 });
+    return pool(std::move(blocks));
+}
+
+} // file scope
+
+std::vector<PAV_Block>
+pool_adjacent_violators(const double * y, const double * w, size_t n)
+{
+    static constexpr size_t MIN_CHUNK_SIZE = 4096;
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (!(w[i] >= 0.0))
+            throw MLDB::Exception("pool_adjacent_violators(): negative weight");
+    }
+
+    size_t num_chunks
+        = std::min<size_t>(MLDB::numCpus() * 4,
+                           (n + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE);
+    if (num_chunks <= 1)
+        return pool_range(y, w, 0, n);
+
+    std::vector<std::vector<PAV_Block> > chunks(num_chunks);
+
+    auto onChunk = [&] (size_t c)
+        {
+            chunks[c] = pool_range(y, w, n * c / num_chunks,
+                                   n * (c + 1) / num_chunks);
+        };
+
+    MLDB::parallelMap(0, num_chunks, onChunk);
+
+    std::vector<PAV_Block> blocks;
+    for (auto & c: chunks)
+        blocks.insert(blocks.end(), c.begin(), c.end());
+
+    return pool(std::move(blocks));
+}
+
+} // namespace ML
@@ -0,0 +1,139 @@
+/* calibration.h                                                   -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Building blocks to calibrate scores into probabilities over very large
+   numbers of examples: a histogram of scores and labels, and isotonic
+   regression by pool adjacent violators.
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+/** Histogram of weighted examples with a binary label, over bins of their
+    score.  Calibration models fitted on the histogram only need to look
+    at each bin, not at each example, which makes them independent of the
+    number of examples.
+*/
+
+struct Score_Histogram {
+
+    struct Bin {
+        double weight = 0.0;       ///< Total weight of examples
+        double pos_weight = 0.0;   ///< Weight of positive examples
+        double score_weight = 0.0; ///< Sum of score * weight
+        uint64_t count = 0;        ///< Number of examples
+        uint64_t pos_count = 0;    ///< Number of positive examples
+
+        /** Weighted mean score of the examples in the bin. */
+        double mean_score() const { return score_weight / weight; }
+
+        /** Weighted proportion of positive examples in the bin. */
+        double pos_rate() const { return pos_weight / weight; }
+
+        Bin & operator += (const Bin & other);
+    };
+
+    /** Examples to build a histogram from, as parallel arrays. */
+    struct Examples {
+        const float * scores;
+        const float * labels;
+        const float * weights;
+        size_t n;
+    };
+
+    /** Create a histogram with the given bin boundaries, which must be
+        strictly increasing.  Bin i holds the scores in
+        [bounds[i - 1], bounds[i]), so there is one more bin than there
+        are boundaries.
+    */
+    Score_Histogram(std::vector<float> bounds = std::vector<float>());
+
+    std::vector<float> bounds;
+    std::vector<Bin> bins;
+
+    /** Return the bin that the given score falls in. */
+    int bin_of(float score) const
+    {
+        return std::upper_bound(bounds.begin(), bounds.end(), score)
+            - bounds.begin();
+    }
+
+    void add(float score, bool label, float weight)
+    {
+        Bin & bin = bins[bin_of(score)];
+        bin.weight += weight;
+        bin.pos_weight += label * weight;
+        bin.score_weight += (double)score * weight;
+        bin.count += 1;
+        bin.pos_count += label;
+    }
+
+    /** Merge another histogram with the same bins into this one. */
+    Score_Histogram & operator += (const Score_Histogram & other);
+
+    /** Return the totals over all bins. */
+    Bin total() const;
+
+    /** Build a histogram with up to num_bins bins over the given scores,
+        over multiple threads.  The boundaries are quantiles of the
+        scores, so that the bins hold about the same number of examples
+        however the scores are spread; there are fewer bins when many
+        examples have the same score.  The quantiles are estimated from a
+        sample of at most max(num_bins * 64, 1M) scores.
+
+        Examples with zero weight are skipped.  Labels are true when
+        they're non-zero.  The examples can be in several parts, which
+        are used in place.
+    */
+    static Score_Histogram
+    build(const std::vector<Examples> & examples, int num_bins);
+
+    static Score_Histogram
+    build(const float * scores, const float * labels, const float * weights,
+          size_t n, int num_bins)
+    {
+        return build({ { scores, labels, weights, n } }, num_bins);
+    }
+};
+
+
+/*****************************************************************************/
+/* ISOTONIC REGRESSION                                                       */
+/*****************************************************************************/
+
+/** A block of consecutive points which take the same value in an isotonic
+    regression.
+*/
+struct PAV_Block {
+    size_t first;    ///< Index of the first point
+    size_t last;     ///< Index one past the last point
+    double weight;   ///< Total weight of the points
+    double value;    ///< Weighted mean of the points, which is the fit
+};
+
+/** Fit the non-decreasing sequence closest (in weighted least squares) to
+    the n values y with weights w, using the pool adjacent violators
+    algorithm.  The fit is returned as a list of blocks, in order, that
+    cover all of the points.
+
+    The points are split into chunks which are fitted over multiple
+    threads; the blocks of the chunks are then pooled again, which gives
+    the same result as fitting all points at once.  Points with zero
+    weight are pooled with their neighbours.
+*/
+std::vector<PAV_Block>
+pool_adjacent_violators(const double * y, const double * w, size_t n);
+
+} // namespace ML
@@ -1,11 +1,12 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
 LIBSTATS_SOURCES := \
-	auc.cc
+	auc.cc \
+	calibration.cc
 
 $(eval $(call add_sources,$(LIBSTATS_SOURCES)))
 
-LIBSTATS_LINK :=	utils
+LIBSTATS_LINK :=	utils base arch
 
 $(eval $(call library,stats,$(LIBSTATS_SOURCES),$(LIBSTATS_LINK)))
 
@@ -0,0 +1,212 @@
+// This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+/* calibration_test.cc
+
+   Test for the score histogram and isotonic regression.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/stats/calibration.h"
+#include <random>
+#include <iostream>
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+/** Textbook serial PAV, to compare the parallel version against. */
+vector<double> serialPav(const vector<double> & y, const vector<double> & w)
+{
+    vector<double> value, weight;
+    vector<size_t> size;
+    for (size_t i = 0;  i < y.size();  ++i) {
+        value.push_back(y[i]);
+        weight.push_back(w[i]);
+        size.push_back(1);
+        while (value.size() > 1
+               && (weight[weight.size() - 2] == 0.0 || weight.back() == 0.0
+                   || value[value.size() - 2] > value.back())) {
+            size_t n = value.size();
+            double wt = weight[n - 2] + weight[n - 1];
+            if (wt > 0.0)
+                value[n - 2] = (value[n - 2] * weight[n - 2]
+                                + value[n - 1] * weight[n - 1]) / wt;
+            weight[n - 2] = wt;
+            size[n - 2] += size[n - 1];
+            value.pop_back();  weight.pop_back();  size.pop_back();
+        }
+    }
+
+    vector<double> result;
+    for (size_t i = 0;  i < value.size();  ++i)
+        result.insert(result.end(), size[i], value[i]);
+    return result;
+}
+
+vector<double> expand(const vector<PAV_Block> & blocks, size_t n)
+{
+    vector<double> result(n);
+    size_t expected = 0;
+    for (auto & b: blocks) {
+        BOOST_REQUIRE_EQUAL(b.first, expected);
+        for (size_t i = b.first;  i < b.last;  ++i)
+            result[i] = b.value;
+        expected = b.last;
+    }
+    BOOST_REQUIRE_EQUAL(expected, n);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_pav_small )
+{
+    vector<double> y = { 1, 3, 2, 4, 3, 5 };
+    vector<double> w = { 1, 1, 1, 1, 1, 1 };
+
+    auto blocks = pool_adjacent_violators(y.data(), w.data(), y.size());
+    BOOST_CHECK_EQUAL(blocks.size(), 4);
+
+    vector<double> expected = { 1, 2.5, 2.5, 3.5, 3.5, 5 };
+    vector<double> fitted = expand(blocks, y.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  fitted.begin(), fitted.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_pav_parallel_matches_serial )
+{
+    // Big enough to be split into chunks
+    size_t n = 1000000;
+    mt19937 rng(1);
+    normal_distribution<double> noise(0.0, 0.3);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    vector<double> y(n), w(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        y[i] = (double)i / n + noise(rng);
+        w[i] = uniform(rng) < 0.05 ? 0.0 : uniform(rng);
+    }
+
+    auto blocks = pool_adjacent_violators(y.data(), w.data(), n);
+    vector<double> fitted = expand(blocks, n);
+    vector<double> expected = serialPav(y, w);
+
+    for (size_t i = 1;  i < blocks.size();  ++i)
+        BOOST_CHECK_LT(blocks[i - 1].value, blocks[i].value);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (abs(fitted[i] - expected[i]) > 1e-9) {
+            BOOST_CHECK_CLOSE(fitted[i], expected[i], 1e-6);
+            break;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram )
+{
+    size_t n = 500000;
+    mt19937 rng(2);
+    uniform_real_distribution<float> uniform(-2.0, 3.0);
+
+    vector<float> scores(n), labels(n), weights(n);
+    double totalWeight = 0.0, posWeight = 0.0;
+    size_t numPos = 0, numWeighted = 0;
+    for (size_t i = 0;  i < n;  ++i) {
+        scores[i] = uniform(rng);
+        labels[i] = scores[i] > 0.5;
+        weights[i] = i % 10 == 0 ? 0.0 : 1.0 + (i % 3);
+        if (weights[i] == 0.0)
+            continue;
+        ++numWeighted;
+        totalWeight += weights[i];
+        posWeight += labels[i] * weights[i];
+        numPos += labels[i] != 0;
+    }
+
+    Score_Histogram hist = Score_Histogram::build(scores.data(), labels.data(),
+                                                  weights.data(), n, 100);
+    BOOST_CHECK_EQUAL(hist.bins.size(), 100);
+    BOOST_CHECK_EQUAL(hist.bounds.size(), 99);
+
+    auto total = hist.total();
+    BOOST_CHECK_EQUAL(total.count, numWeighted);
+    BOOST_CHECK_EQUAL(total.pos_count, numPos);
+    BOOST_CHECK_CLOSE(total.weight, totalWeight, 1e-9);
+    BOOST_CHECK_CLOSE(total.pos_weight, posWeight, 1e-9);
+
+    // Each bin holds the scores in its range
+    for (size_t i = 0;  i < hist.bins.size();  ++i) {
+        auto & b = hist.bins[i];
+        if (b.weight == 0.0)
+            continue;
+        BOOST_CHECK_EQUAL(hist.bin_of(b.mean_score()), i);
+    }
+
+    // The bins are quantiles, so they hold about the same number of
+    // examples
+    for (auto & b: hist.bins) {
+        BOOST_CHECK_GT(b.count, numWeighted / 100 * 0.9);
+        BOOST_CHECK_LT(b.count, numWeighted / 100 * 1.1);
+    }
+
+    // The positive rate can only go up with the score
+    double last = -1.0;
+    for (auto & b: hist.bins) {
+        BOOST_CHECK_GE(b.pos_rate(), last);
+        last = b.pos_rate();
+    }
+
+    // No examples with weight gives an empty histogram
+    vector<float> zeros(n, 0.0);
+    Score_Histogram empty = Score_Histogram::build(scores.data(), labels.data(),
+                                                   zeros.data(), n, 10);
+    BOOST_CHECK_EQUAL(empty.total().count, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_outliers_and_parts )
+{
+    size_t n = 200000;
+    mt19937 rng(3);
+    uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    vector<float> scores(n), labels(n), weights(n, 1.0);
+    for (size_t i = 0;  i < n;  ++i) {
+        scores[i] = uniform(rng);
+        labels[i] = uniform(rng) < scores[i];
+    }
+
+    // A few huge outliers don't squeeze the other scores into one bin
+    scores[10] = 1e30;
+    scores[20] = -1e30;
+
+    Score_Histogram hist = Score_Histogram::build(scores.data(), labels.data(),
+                                                  weights.data(), n, 50);
+    BOOST_CHECK_EQUAL(hist.bins.size(), 50);
+    for (auto & b: hist.bins)
+        BOOST_CHECK_LT(b.count, n / 50 * 1.2);
+
+    // Building from several parts gives the same bins and counts
+    size_t split = n / 3;
+    Score_Histogram hist2 = Score_Histogram::build
+        ({ { scores.data(), labels.data(), weights.data(), split },
+           { scores.data() + split, labels.data() + split,
+             weights.data() + split, n - split } }, 50);
+    BOOST_CHECK(hist2.bounds == hist.bounds);
+    for (size_t i = 0;  i < hist.bins.size();  ++i) {
+        BOOST_CHECK_EQUAL(hist2.bins[i].count, hist.bins[i].count);
+        BOOST_CHECK_EQUAL(hist2.bins[i].pos_count, hist.bins[i].pos_count);
+    }
+
+    // When most scores are the same, there are fewer bins
+    vector<float> tied(n, 0.5);
+    for (size_t i = 0;  i < 100;  ++i)
+        tied[i] = i;
+    Score_Histogram hist3 = Score_Histogram::build(tied.data(), labels.data(),
+                                                   weights.data(), n, 50);
+    BOOST_CHECK_LT(hist3.bins.size(), 50);
+    BOOST_CHECK_EQUAL(hist3.total().count, n);
+}
@@ -8,3 +8,4 @@
 
 $(eval $(call test,rmse_test,stats arch,boost))
 
+$(eval $(call test,calibration_test,stats base arch,boost))
@@ -67,6 +67,8 @@ RegularizationDescription()
     addValue("NONE", ML::Regularization_none, "No regularization.");
     addValue("L1", ML::Regularization_l1, "L1 regularization using LASSO.");
     addValue("L2", ML::Regularization_l2, "L2 regularization using ridge regression.");  
+    addValue("ELASTIC_NET", ML::Regularization_elastic_net,
+             "Mix of L1 and L2 regularization (lbfgs solver only).");
 }
 
 struct DenseFeatureSpaceDescription
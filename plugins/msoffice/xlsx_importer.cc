@@ -6,6 +6,10 @@
 
    Importer for Excel .xlsx files.  These files are actually .zip
    files full of .xml documents.
+
+   The (potentially very large) shared strings table and worksheets are
+   parsed with a streaming XML reader; the small workbook, relationship
+   and style documents are still parsed with tinyxml2.
 */
 
 #include "mldb/core/procedure.h"
@@ -17,6 +21,8 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/ext/tinyxml2/tinyxml2.h"
+#include "mldb/ext/utf8cpp/source/utf8.h"
+#include "mldb/base/parallel.h"
 #include "mldb/utils/log.h"
 
 
@@ -58,69 +64,435 @@ XlsxImporterConfigDescription()
              "Configuration for output dataset");
 }
 
-struct SharedStrings {
+/** Parse an integer out of an xlsx file.  These files come from users, so
+    a malformed number is a 400 error rather than letting the exceptions
+    from std::stoll escape.
+*/
+static int64_t parseXlsxInt(const std::string & str, const char * what,
+                            int base = 10)
+{
+    size_t pos = 0;
+    long long result = 0;
+    try {
+        result = std::stoll(str, &pos, base);
+    } catch (const std::exception &) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != str.size())
+        throw AnnotatedException(400, "xlsx file has malformed " + string(what),
+                                 "value", str);
+    return result;
+}
 
-    void load(std::streambuf * buf, shared_ptr<spdlog::logger> logger)
+
+/*****************************************************************************/
+/* XML STREAM READER                                                         */
+/*****************************************************************************/
+
+/** Minimal pull parser for the subset of XML that is used inside of xlsx
+    files.  It reads the underlying streambuf in fixed size chunks, and so
+    never needs to hold more than one chunk of the document in memory, as
+    opposed to the DOM parser which needs both the full text and the full
+    tree.
+
+    Element names are reported without their namespace prefix; attribute
+    names are reported verbatim.  Comments, processing instructions and
+    DOCTYPE declarations are skipped.  CDATA sections are reported as text.
+*/
+
+struct XmlStreamReader {
+
+    enum Event {
+        START_ELEMENT,   ///< Start of element; name() and attr() are valid
+        END_ELEMENT,     ///< End of element; name() is valid
+        TEXT,            ///< Character data; text() is valid
+        END_DOCUMENT     ///< End of the input
+    };
+
+    XmlStreamReader(std::streambuf * buf, size_t chunkSize = 1024 * 1024)
+        : buf(buf), data(chunkSize)
     {
-        std::ostringstream allText;
-        allText << buf;
+    }
 
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
+    /// Read the next event from the stream
+    Event next()
+    {
+        if (pendingEnd) {
+            pendingEnd = false;
+            return END_ELEMENT;
+        }
 
-        TRACE_MSG(logger) << "loaded document:\n" << printDoc(*xml);
+        for (;;) {
+            int c = peek();
+            if (c == EOF)
+                return END_DOCUMENT;
+            if (c != '<') {
+                readText();
+                return TEXT;
+            }
+            get();
 
-        using namespace tinyxml2;
+            c = peek();
+            if (c == '?') {
+                skipUntil("?>");
+                continue;
+            }
+            if (c == '!') {
+                if (lookingAt("![CDATA[")) {
+                    pos += 8;
+                    text_.clear();
+                    readUntil("]]>", text_);
+                    return TEXT;
+                }
+                else if (lookingAt("!--")) {
+                    pos += 3;
+                    skipUntil("-->");
+                }
+                else skipUntil(">");
+                continue;
+            }
+            if (c == '/') {
+                get();
+                readName(name_);
+                skipUntil(">");
+                return END_ELEMENT;
+            }
 
-        XMLHandle handle(*xml);
+            readName(name_);
+            readAttributes();
+            return START_ELEMENT;
+        }
+    }
 
-        XMLElement * sst = handle.FirstChildElement("sst").ToElement();
+    /// Local name (without namespace prefix) of the current element
+    const std::string & name() const
+    {
+        return name_;
+    }
 
-        if (!sst)
-            throw AnnotatedException(400, "xlsx file SharedStrings have no sst element");
+    /// Decoded text of the current TEXT event
+    const std::string & text() const
+    {
+        return text_;
+    }
 
+    /// Return the given attribute of the current element, or null
+    const std::string * attr(const char * attrName) const
+    {
+        for (size_t i = 0;  i < numAttrs;  ++i) {
+            if (attrs[i].first == attrName)
+                return &attrs[i].second;
+        }
+        return nullptr;
+    }
 
-        unsigned numStrings;
-        int res = sst->QueryUnsignedAttribute("uniqueCount", &numStrings);
-        if (res != XML_NO_ERROR)
-            throw AnnotatedException(400, "xlsx file SharedStrings have no uniqueCount");
+    Utf8String attrStr(const char * attrName) const
+    {
+        const std::string * result = attr(attrName);
+        return result ? Utf8String(*result) : Utf8String();
+    }
 
-        DEBUG_MSG(logger) << "got " << numStrings << " unique strings";
+private:
+    std::streambuf * buf;
+    std::vector<char> data;
+    size_t pos = 0;
+    size_t end = 0;
+    bool eof = false;
+    bool pendingEnd = false;
 
-        strings.reserve(numStrings);
+    std::string name_;
+    std::string text_;
 
+    // Attribute storage is reused from element to element to avoid
+    // allocating in the inner loop.
+    std::vector<std::pair<std::string, std::string> > attrs;
+    size_t numAttrs = 0;
 
+    /// Make sure at least n characters are available, if possible
+    bool ensure(size_t n)
+    {
+        while (end - pos < n && !eof) {
+            if (pos > 0) {
+                std::copy(data.begin() + pos, data.begin() + end, data.begin());
+                end -= pos;
+                pos = 0;
+            }
+            if (end == data.size())
+                data.resize(data.size() * 2);
+            auto numRead = buf->sgetn(data.data() + end, data.size() - end);
+            if (numRead <= 0)
+                eof = true;
+            else end += numRead;
+        }
+        return end - pos >= n;
+    }
 
-        for (XMLNode * node = sst->FirstChildElement();  node;
-             node = node->NextSibling()) {
-            XMLHandle handle(*node);
+    int peek()
+    {
+        if (pos == end && !ensure(1))
+            return EOF;
+        return (unsigned char)data[pos];
+    }
 
-            XMLElement * text = handle.FirstChildElement("t").ToElement();
+    int get()
+    {
+        int result = peek();
+        if (result != EOF)
+            ++pos;
+        return result;
+    }
 
-            if (!text)
-                throw AnnotatedException(400, "xlsx file SharedStrings <si> element has no child <t> element");
+    int expect()
+    {
+        int result = get();
+        if (result == EOF)
+            throw AnnotatedException(400, "xlsx file has truncated XML");
+        return result;
+    }
 
-            const char * t = text->GetText();
+    bool lookingAt(const char * str)
+    {
+        size_t len = strlen(str);
+        return ensure(len) && std::equal(str, str + len, data.begin() + pos);
+    }
 
-            Utf8String textStr(t ? t : "");
+    void readUntil(const char * terminator, std::string & into)
+    {
+        size_t len = strlen(terminator);
+        for (;;) {
+            if (lookingAt(terminator)) {
+                pos += len;
+                return;
+            }
+            into += (char)expect();
+        }
+    }
 
-            DEBUG_MSG(logger) << "got string " << textStr;
+    void skipUntil(const char * terminator)
+    {
+        size_t len = strlen(terminator);
+        while (!lookingAt(terminator))
+            expect();
+        pos += len;
+    }
+
+    void skipWhitespace()
+    {
+        int c;
+        while ((c = peek()) != EOF && isspace(c))
+            ++pos;
+    }
+
+    void readName(std::string & into)
+    {
+        into.clear();
+        for (int c = peek();  c != EOF;  c = peek()) {
+            if (isspace(c) || c == '/' || c == '>' || c == '=')
+                break;
+            if (c == ':')
+                into.clear();  // strip namespace prefix
+            else into += (char)c;
+            ++pos;
+        }
+    }
+
+    void readAttributes()
+    {
+        numAttrs = 0;
+        for (;;) {
+            skipWhitespace();
+            int c = expect();
+            if (c == '>')
+                return;
+            if (c == '/') {
+                skipUntil(">");
+                pendingEnd = true;
+                return;
+            }
+
+            if (numAttrs == attrs.size())
+                attrs.emplace_back();
+            auto & attr = attrs[numAttrs++];
+
+            // Attribute names keep their prefix (eg r:id)
+            attr.first.clear();
+            attr.first += (char)c;
+            for (c = peek();  c != EOF && c != '=' && !isspace(c);  c = peek())
+                attr.first += (char)get();
+
+            skipWhitespace();
+            if (expect() != '=')
+                throw AnnotatedException(400, "xlsx file has malformed XML attribute");
+            skipWhitespace();
+            int quote = expect();
+            if (quote != '"' && quote != '\'')
+                throw AnnotatedException(400, "xlsx file has unquoted XML attribute");
+
+            attr.second.clear();
+            for (c = expect();  c != quote;  c = expect()) {
+                if (c == '&')
+                    readEntity(attr.second);
+                else attr.second += (char)c;
+            }
+        }
+    }
+
+    void readText()
+    {
+        text_.clear();
+        for (int c = peek();  c != EOF && c != '<';  c = peek()) {
+            ++pos;
+            if (c == '&')
+                readEntity(text_);
+            else text_ += (char)c;
+        }
+    }
+
+    // Called just after the & has been consumed
+    void readEntity(std::string & into)
+    {
+        std::string entity;
+        for (int c = expect();  c != ';';  c = expect()) {
+            entity += (char)c;
+            if (entity.size() > 10)
+                throw AnnotatedException(400, "xlsx file has malformed XML entity");
+        }
+
+        if (entity == "lt") into += '<';
+        else if (entity == "gt") into += '>';
+        else if (entity == "amp") into += '&';
+        else if (entity == "quot") into += '"';
+        else if (entity == "apos") into += '\'';
+        else if (entity.size() > 1 && entity[0] == '#') {
+            int64_t codePoint;
+            if (entity[1] == 'x' || entity[1] == 'X')
+                codePoint = parseXlsxInt(entity.substr(2), "XML character reference", 16);
+            else codePoint = parseXlsxInt(entity.substr(1), "XML character reference");
+            if (codePoint < 0 || codePoint > 0x10ffff
+                || (codePoint >= 0xd800 && codePoint <= 0xdfff))
+                throw AnnotatedException(400, "xlsx file has invalid XML character reference",
+                                         "entity", entity);
+            utf8::append(codePoint, std::back_inserter(into));
+        }
+        else throw AnnotatedException(400, "xlsx file has unknown XML entity",
+                                      "entity", entity);
+    }
+};
+
+
+/*****************************************************************************/
+/* SHARED STRINGS                                                            */
+/*****************************************************************************/
+
+/** Shared strings table.  Workbooks with lots of text can have millions of
+    these, so they are stored as a single flat character buffer with an
+    offset table rather than as individual string objects.
+*/
+
+struct SharedStrings {
+
+    SharedStrings()
+        : offsets(1, 0)
+    {
+    }
+
+    void load(std::streambuf * buf, shared_ptr<spdlog::logger> logger)
+    {
+        XmlStreamReader reader(buf);
+
+        bool foundSst = false;
+        bool inString = false;
+        bool inText = false;
+        int phoneticDepth = 0;
+        unsigned numStrings = 0;
+
+        for (auto event = reader.next();
+             event != XmlStreamReader::END_DOCUMENT;
+             event = reader.next()) {
+
+            const std::string & name = reader.name();
+
+            switch (event) {
+            case XmlStreamReader::START_ELEMENT:
+                if (name == "sst") {
+                    const std::string * count = reader.attr("uniqueCount");
+                    if (!count)
+                        throw AnnotatedException(400, "xlsx file SharedStrings have no uniqueCount");
+                    numStrings = parseXlsxInt(*count, "shared string count");
+                    foundSst = true;
+
+                    DEBUG_MSG(logger) << "got " << numStrings << " unique strings";
 
-            strings.emplace_back(std::move(textStr));
+                    offsets.reserve(numStrings + 1);
+                }
+                else if (name == "si") {
+                    inString = true;
+                }
+                else if (name == "rPh") {
+                    // Phonetic runs also contain <t> elements, but are not
+                    // part of the string's value
+                    ++phoneticDepth;
+                }
+                else if (name == "t" && inString && !phoneticDepth) {
+                    inText = true;
+                }
+                break;
+
+            case XmlStreamReader::END_ELEMENT:
+                if (name == "si") {
+                    TRACE_MSG(logger) << "got string "
+                                      << string(data, offsets.back());
+                    offsets.push_back(data.size());
+                    inString = false;
+                }
+                else if (name == "rPh") {
+                    --phoneticDepth;
+                }
+                else if (name == "t") {
+                    inText = false;
+                }
+                break;
+
+            case XmlStreamReader::TEXT:
+                if (inText)
+                    data += reader.text();
+                break;
+
+            default:
+                break;
+            }
         }
 
-        DEBUG_MSG(logger) << "read " << strings.size() << " unique strings";
+        if (!foundSst)
+            throw AnnotatedException(400, "xlsx file SharedStrings have no sst element");
+
+        DEBUG_MSG(logger) << "read " << size() << " unique strings";
 
-        if (numStrings != strings.size()) {
+        if (numStrings != size()) {
             throw AnnotatedException(400, "xlsx file SharedStrings file consistency error: number of strings read doesn't match definition",
                                       "numDefined", numStrings,
-                                      "numRead", strings.size());
+                                      "numRead", size());
 
         }
+    }
 
+    size_t size() const
+    {
+        return offsets.size() - 1;
     }
 
-    std::vector<Utf8String> strings;
+    CellValue getCell(size_t index) const
+    {
+        if (index >= size())
+            throw AnnotatedException(400, "xlsx cell refers to unknown shared string",
+                                     "index", index,
+                                     "numStrings", size());
+        return CellValue(data.data() + offsets[index],
+                         offsets[index + 1] - offsets[index]);
+    }
+
+    std::string data;              ///< All strings, concatenated
+    std::vector<uint64_t> offsets; ///< Start of each string, plus end
 };
 
 const map<string, CellValue::CellType> FORMATS = {
@@ -252,7 +624,7 @@ struct Styles {
                     };
 
                 string formatCode = readAttr("formatCode");
-                int numFormatId = std::stoi(readAttr("numFmtId"));
+                int numFormatId = parseXlsxInt(readAttr("numFmtId"), "number format");
 
                 formats[numFormatId] = formatCode;
             }
@@ -280,7 +652,7 @@ struct Styles {
                         return std::string(foundAttr);
                     };
 
-                int numFormatId = std::stoi(readAttr("numFmtId"));
+                int numFormatId = parseXlsxInt(readAttr("numFmtId"), "number format");
 
                 std::string formatStr;
                 auto it = formats.find(numFormatId);
@@ -484,185 +856,203 @@ struct Workbook {
     }
 };
 
+/*****************************************************************************/
+/* SHEET                                                                     */
+/*****************************************************************************/
+
+/** Streaming parser for a worksheet.  Rows are handed to the onRow callback
+    as soon as they have been read, so that the sheet's XML never needs to
+    be held in memory.
+*/
+
 struct Sheet {
 
-    Sheet(std::streambuf * buf,
+    struct Row {
+        int64_t index = 0;   ///< Row index, 1-based
+        std::vector<std::tuple<int64_t, CellValue> > columns;
+    };
+
+    /** Parse the given sheet.  The onRow callback is called for each row
+        in the order they appear.
+    */
+    static void
+    parse(std::streambuf * buf,
           const Workbook & workbook,
           const SharedStrings & strings,
           const Styles & styles,
+          const std::function<void (Row row)> & onRow,
           shared_ptr<spdlog::logger> logger)
     {
-        std::ostringstream allText;
-        allText << buf;
-
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
-
-        TRACE_MSG(logger) << "workbook sheet contents" << printDoc(*xml);
-
-        using namespace tinyxml2;
-
-        XMLHandle handle(*xml);
-
-        XMLElement * data
-            = handle.FirstChildElement("worksheet")
-            .FirstChildElement("sheetData")
-            .ToElement();
-
-        if (!data)
-            throw AnnotatedException(400, "xlsx worksheet has no sheetData element");
-
-        for (XMLNode * node = data->FirstChildElement("row");  node;
-             node = node->NextSibling()) {
-            XMLElement * element = node->ToElement();
-            if (!element)
-                throw AnnotatedException(400, "xlsx worksheet Relationship entry is not an element");
-
-            auto readAttr = [&] (const std::string & attr) -> Utf8String
-                {
-                    const char * foundAttr
-                        = element->Attribute(attr.c_str());
-                    if (!foundAttr)
-                        return Utf8String();
-                    return Utf8String(foundAttr);
-                };
-
-            // What is the row index?
-            int64_t rowIndex = CellValue::parse(readAttr("r")).toInt();
-
-            Row row;
-            row.index = rowIndex;
-
-            int64_t colIndex = 0;
-
-            for (XMLNode * colNode = element->FirstChildElement("c");  colNode;
-                 colNode = colNode->NextSibling()) {
-
-                XMLElement * colElement = colNode->ToElement();
-
-                if (!colElement)
-                    throw AnnotatedException(400, "xlsx sheet column is not an element");
-
-                auto readAttr = [&] (const std::string & attr) -> Utf8String
-                    {
-                        const char * foundAttr
-                            = colElement->Attribute(attr.c_str());
-                        if (!foundAttr)
-                            return Utf8String();
-                        return Utf8String(foundAttr);
-                    };
-
-                Utf8String type = readAttr("t");
-                std::string cellid = readAttr("r").rawString();  // r stands for "reference"
-                Utf8String style = readAttr("s");
-
-                CellValue value;
-                Utf8String contents;
-
-                XMLNode * v = colNode->FirstChildElement("v");
-                XMLElement * ve = v ? v->ToElement(): nullptr;
-
-                if (ve) {
-                    if (ve->GetText())
-                        contents = ve->GetText();
+        XmlStreamReader reader(buf);
+
+        bool foundData = false;
+        bool inData = false;
+        bool inRow = false;
+        bool inCell = false;
+        bool inValue = false;
+        bool hasValue = false;
+
+        Row row;
+        int64_t colIndex = 0;
+        Utf8String type;
+        std::string cellid;
+        Utf8String style;
+        Utf8String contents;
+
+        for (auto event = reader.next();
+             event != XmlStreamReader::END_DOCUMENT;
+             event = reader.next()) {
+
+            const std::string & name = reader.name();
+
+            switch (event) {
+            case XmlStreamReader::START_ELEMENT:
+                if (name == "sheetData") {
+                    foundData = inData = true;
+                }
+                else if (name == "row" && inData) {
+                    // What is the row index?
+                    const std::string * r = reader.attr("r");
+                    row.index = r ? parseXlsxInt(*r, "row index") : row.index + 1;
+                    row.columns.clear();
+                    colIndex = 0;
+                    inRow = true;
+                }
+                else if (name == "c" && inRow) {
+                    type = reader.attrStr("t");
+                    // r stands for "reference"
+                    const std::string * r = reader.attr("r");
+                    cellid = r ? *r : std::string();
+                    style = reader.attrStr("s");
+                    contents = Utf8String();
+                    hasValue = false;
+                    inCell = true;
+                }
+                else if (name == "v" && inCell) {
+                    inValue = hasValue = true;
+                }
+                break;
 
-                    TRACE_MSG(logger) << "type = " << type;
-                    TRACE_MSG(logger) << "style = " << style;
+            case XmlStreamReader::TEXT:
+                if (inValue)
+                    contents += reader.text();
+                break;
 
-                    if (type == "s") {
-                        // shared string
-                        int index = std::stoi(contents.rawString());
-                        value = CellValue(strings.strings.at(index));
-                    }
-                    else if (!style.empty()) {
-                        int styleNum = CellValue::parse(style).toInt();
-                        const Styles::Style & style = styles.styles.at(styleNum);
-
-                        switch (style.repr) {
-                        case CellValue::TIMESTAMP: {
-                            double offset = CellValue::parse(contents).toDouble();
-                            value = workbook.baseDate.plusDays(offset);
-                            break;
-                        }
-                        case CellValue::TIMEINTERVAL: {
-                            uint16_t months = 0;
-                            uint16_t days = 0;
-                            uint16_t seconds = CellValue::parse(contents).toDouble();
-                            value = CellValue::fromMonthDaySecond(months, days, seconds);
-                            break;
-                        }
-                        case CellValue::FLOAT:  // fall through
-                        case CellValue::EMPTY: // fall through
-                            // These shouldn't occur
-                        case CellValue::INTEGER:
-                        case CellValue::ASCII_STRING:
-                        case CellValue::UTF8_STRING:
-                        default:
-                            value = CellValue::parse(contents);
-                        }
-                    }
-                    else if (type == "b" /* boolean */ || type.empty()) {
-                        // generic...
-                        value = CellValue::parse(contents);
-                    }
-                    else {
-                        // Probably a date... we should handle those
-                        INFO_MSG(logger) << "cell has unknown type";
-                        INFO_MSG(logger) << "type = " << type << " cellid = " << cellid
-                             << " s = " << style << " c " << contents;
-                    }
+            case XmlStreamReader::END_ELEMENT:
+                if (name == "v") {
+                    inValue = false;
                 }
+                else if (name == "c" && inCell) {
+                    CellValue value;
+                    if (hasValue) {
+                        value = getValue(type, style, contents,
+                                         workbook, strings, styles, logger);
+                    }
 
-                // Get the column out of it
-                std::string columnPart;
+                    // Get the column out of it
+                    if (cellid.empty())
+                        ++colIndex;
+                    else colIndex = getColIndex(cellid);
 
-                if (cellid.empty()) {
-                    ++colIndex;
+                    DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
+                    DEBUG_MSG(logger) << "row " << row.index << " column " << colIndex;
+                    row.columns.emplace_back(colIndex, std::move(value));
+                    inCell = false;
                 }
-                else {
-                    colIndex = 0;
-                    size_t numLetters = 0;
-                    while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
-                        ++numLetters;
-                    if (numLetters == 1) {
-                        colIndex = toupper(cellid[0]) - 'A';
-                    }
-                    else if (numLetters == 2) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26
-                            + toupper(cellid[1]) - 'A';
-                    }
-                    else if (numLetters == 3) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else if (numLetters == 4) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26 * 26
-                            + (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else throw AnnotatedException(400, "Unable to parse Cell ID '" + cellid + "'");
+                else if (name == "row" && inRow) {
+                    onRow(std::move(row));
+                    row.columns.clear();
+                    inRow = false;
                 }
+                else if (name == "sheetData") {
+                    inData = false;
+                }
+                break;
 
-                DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
-                DEBUG_MSG(logger) << "row " << rowIndex << " column " << colIndex;
-                row.columns.emplace_back(colIndex, std::move(value));
+            default:
+                break;
             }
-
-            rows.emplace_back(std::move(row));
         }
+
+        if (!foundData)
+            throw AnnotatedException(400, "xlsx worksheet has no sheetData element");
     }
 
-    struct Row {
-        int64_t index;   ///< Row index, 1-based
-        std::vector<std::tuple<int64_t, CellValue> > columns;
-    };
+    static CellValue getValue(const Utf8String & type,
+                              const Utf8String & style,
+                              const Utf8String & contents,
+                              const Workbook & workbook,
+                              const SharedStrings & strings,
+                              const Styles & styles,
+                              shared_ptr<spdlog::logger> logger)
+    {
+        TRACE_MSG(logger) << "type = " << type;
+        TRACE_MSG(logger) << "style = " << style;
+
+        if (type == "s") {
+            // shared string
+            int64_t index = parseXlsxInt(contents.rawString(), "shared string index");
+            if (index < 0)
+                throw AnnotatedException(400, "xlsx cell refers to unknown shared string",
+                                         "index", index);
+            return strings.getCell(index);
+        }
+        else if (!style.empty()) {
+            int64_t styleNum = parseXlsxInt(style.rawString(), "cell style");
+            if (styleNum < 0 || styleNum >= (int64_t)styles.styles.size())
+                throw AnnotatedException(400, "xlsx cell refers to unknown style",
+                                         "style", styleNum,
+                                         "numStyles", styles.styles.size());
+            const Styles::Style & style = styles.styles[styleNum];
+
+            switch (style.repr) {
+            case CellValue::TIMESTAMP: {
+                double offset = CellValue::parse(contents).toDouble();
+                return workbook.baseDate.plusDays(offset);
+            }
+            case CellValue::TIMEINTERVAL: {
+                uint16_t months = 0;
+                uint16_t days = 0;
+                uint16_t seconds = CellValue::parse(contents).toDouble();
+                return CellValue::fromMonthDaySecond(months, days, seconds);
+            }
+            case CellValue::FLOAT:  // fall through
+            case CellValue::EMPTY: // fall through
+                // These shouldn't occur
+            case CellValue::INTEGER:
+            case CellValue::ASCII_STRING:
+            case CellValue::UTF8_STRING:
+            default:
+                return CellValue::parse(contents);
+            }
+        }
+        else if (type == "b" /* boolean */ || type.empty()) {
+            // generic...
+            return CellValue::parse(contents);
+        }
 
-    vector<Row> rows;
+        // Probably a date... we should handle those
+        INFO_MSG(logger) << "cell has unknown type";
+        INFO_MSG(logger) << "type = " << type
+                         << " s = " << style << " c " << contents;
+        return CellValue();
+    }
+
+    /// Convert the letters of a cell reference (eg AB12) into a 0-based
+    /// column index
+    static int64_t getColIndex(const std::string & cellid)
+    {
+        size_t numLetters = 0;
+        while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
+            ++numLetters;
+        if (numLetters == 0 || numLetters > 4)
+            throw AnnotatedException(400, "Unable to parse Cell ID '" + cellid + "'");
+
+        int64_t result = 0;
+        for (size_t i = 0;  i < numLetters;  ++i)
+            result = result * 26 + (toupper(cellid[i]) - 'A' + 1);
+        return result - 1;
+    }
 
 }; // struct Sheet
 
@@ -678,6 +1068,9 @@ struct XlsxImporter: public Procedure {
 
     XlsxImporterConfig config;
 
+    /// Number of rows to accumulate before recording them in the dataset
+    static constexpr size_t ROWS_PER_CHUNK = 1000;
+
     virtual RunOutput run(const ProcedureRunConfig & run,
                           const std::function<bool (const Json::Value &)> & onProgress) const
     {
@@ -756,56 +1149,102 @@ struct XlsxImporter: public Procedure {
             output = obtainDataset(engine, runProcConf.output);
         }
 
-        // 4.  Load the worksheets, one by one
-        for (auto & sheetEntry: workbook.sheets) {
-            Utf8String filename =
-                "archive+" + runProcConf.dataFileUrl.toDecodedString()
-                + "#xl/" + sheetEntry.filename;
-            filter_istream sheetStream(filename.rawString());
+        // 4.  Load the worksheets.  Each sheet is streamed from its own
+        //     archive entry and recorded in chunks, so they can be
+        //     parsed in parallel.
+        auto getColName = [] (int64_t colIndex)
+            {
+                string result;
+
+                if (colIndex < 26) {
+                    result = char('A' + (colIndex));
+                }
+                else {
+                    result = char('A' + (colIndex % 26)) + result;
+                    colIndex /= 26;
+                    while (colIndex) {
+                        result = char('A' + (colIndex % 26) - 1) + result;
+                        colIndex /= 26;
+                    }
+                }
 
-            Sheet sheet(sheetStream.rdbuf(), workbook, strings, styles, logger);
+                return ColumnPath(result);
+            };
 
-            DEBUG_MSG(logger) << "sheet had " << sheet.rows.size() << " rows";
+        auto doSheet = [&] (size_t sheetNum)
+            {
+                const Workbook::Sheet & sheetEntry = workbook.sheets[sheetNum];
 
-            auto getColName = [] (int64_t colIndex)
-                {
-                    string result;
+                Utf8String filename =
+                    "archive+" + runProcConf.dataFileUrl.toDecodedString()
+                    + "#xl/" + sheetEntry.filename;
 
-                    if (colIndex < 26) {
-                        result = char('A' + (colIndex));
-                    }
-                    else {
-                        result = char('A' + (colIndex % 26)) + result;
-                        colIndex /= 26;
-                        while (colIndex) {
-                            result = char('A' + (colIndex % 26) - 1) + result;
-                            colIndex /= 26;
-                        }
-                    }
+                // Row names are padded to the width of the last row index,
+                // which isn't known until the end of the sheet.  The rows
+                // are kept as parsed, under their index, and named once
+                // it's known.  The <dimension> element can't be used for
+                // this, as it may cover more rows than are present.
+                std::vector<Sheet::Row> rows;
+                int indexLength = 0;
+                size_t numRows = 0;
 
-                    return ColumnPath(result);
-                };
+                std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > chunk;
 
-            if (output && !sheet.rows.empty()) {
-                int maxRowIndex = sheet.rows.back().index;
-                int indexLength = MLDB::format("%d", maxRowIndex).length();
+                auto flush = [&] ()
+                    {
+                        if (chunk.empty())
+                            return;
+                        output->recordRows(chunk);
+                        chunk.clear();
+                    };
 
-                for (auto & row: sheet.rows) {
-                    MatrixNamedRow outputRow;
-                    outputRow.rowHash = outputRow.rowName
-                        = RowPath(sheetEntry.name + MLDB::format(":%0*d", indexLength, row.index));
+                auto recordRow = [&] (Sheet::Row & row)
+                    {
+                        RowPath rowName(sheetEntry.name + MLDB::format(":%0*lld", indexLength, (long long)row.index));
+
+                        std::vector<std::tuple<ColumnPath, CellValue, Date> > columns;
+                        columns.reserve(row.columns.size());
+                        for (auto & col: row.columns) {
+                            columns.emplace_back(getColName(std::get<0>(col)),
+                                                 std::move(std::get<1>(col)),
+                                                 workbook.timestamp);
+                        }
 
-                    for (auto & col: row.columns) {
-                        outputRow.columns.emplace_back(getColName(std::get<0>(col)),
-                                                       std::get<1>(col),
-                                                       workbook.timestamp);
-                    }
+                        chunk.emplace_back(std::move(rowName), std::move(columns));
+                        if (chunk.size() >= ROWS_PER_CHUNK)
+                            flush();
+                    };
+
+                auto onRow = [&] (Sheet::Row row)
+                    {
+                        ++numRows;
+                        if (output)
+                            rows.emplace_back(std::move(row));
+                    };
+
+                filter_istream sheetStream(filename.rawString());
+                Sheet::parse(sheetStream.rdbuf(), workbook, strings, styles,
+                             onRow, logger);
 
-                    output->recordRow(outputRow.rowName, outputRow.columns);
+                if (!rows.empty()) {
+                    indexLength = MLDB::format("%lld",
+                                               (long long)rows.back().index)
+                        .length();
                 }
-            }
-        }
-        output->commit();
+                for (auto & row: rows) {
+                    recordRow(row);
+                    row = Sheet::Row();
+                }
+                flush();
+
+                DEBUG_MSG(logger) << "sheet " << sheetEntry.name
+                                  << " had " << numRows << " rows";
+            };
+
+        parallelMap(0, workbook.sheets.size(), doSheet);
+
+        if (output)
+            output->commit();
         return RunOutput();
     }
 
@@ -1046,6 +1046,14 @@ commit()
     // date.
     return itl->optimize();
 }
+
+int64_t
+SparseMatrixDataset::
+getGeneration() const
+{
+    // The epoch is bumped on every write, but not when optimizing
+    return itl->getReadTransaction()->epoch;
+}
     
 Date
 SparseMatrixDataset::
@@ -52,6 +52,9 @@ struct SparseMatrixDataset: public Dataset {
     /** Commit changes to the database. */
     virtual void commit() override;
 
+    /** Return the epoch of the current read transaction. */
+    virtual int64_t getGeneration() const override;
+
     // TODO: implement; the default version is very slow
     //virtual std::pair<Date, Date> getTimestampRange() const;
 
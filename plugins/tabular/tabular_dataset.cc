@@ -65,7 +65,11 @@ struct MutablePathIndex {
         void record(const Path & path,
                     uint32_t indexInChunk)
         {
-            uint64_t hash = path.hash();
+            record(path.hash(), indexInChunk);
+        }
+
+        void record(uint64_t hash, uint32_t indexInChunk)
+        {
             int shard = getShard(hash);
             toInsert[shard].emplace_back(hash, indexInChunk);
             maxChunkIndex = std::max(maxChunkIndex, indexInChunk);
@@ -1215,6 +1219,9 @@ struct TabularDataset::TabularDataStore
     /// by the datasetMutex; reading is unprotected as it's constant
     atomic_shared_ptr<const CurrentState> currentState;
 
+    /// Incremented each time a new current state is published
+    std::atomic<int64_t> generation { 0 };
+
     /// Everything below here is protected by the dataset lock
     /// Mutex to make changes in the current state
     std::mutex datasetMutex;
@@ -1359,7 +1366,12 @@ struct TabularDataset::TabularDataStore
                                "Information about the saved artifact",
                                &TabularDataStore::save,
                                this,
-                               JsonParam<Url>("dataFileUrl", "URI of artifact to save under"));
+                               JsonParam<Url>("dataFileUrl", "URI of artifact to save under"),
+                               JsonParamDefault<std::string>
+                               ("blockCompression",
+                                "Codec to block compress the saved columns "
+                                "with ('zstd' or 'lz4'), or empty for none",
+                                ""));
     }
 
     virtual RestRequestMatchResult
@@ -1458,14 +1470,27 @@ struct TabularDataset::TabularDataStore
             auto indexChunk = [&] (int chunkNum)
                 {
                     auto recorder = index.getRecorder(chunkNum);
-                    for (unsigned j = 0;
-                         j < newState->chunks[chunkNum]->rowCount();
-                         ++j) {
-                        RowPath rowNameStorage;
-                        const RowPath & rowName
-                            = newState->chunks[chunkNum]
-                            ->getRowPath(j, rowNameStorage);
-                        recorder.record(rowName, j);
+                    const auto & chunk = *newState->chunks[chunkNum];
+
+                    // Hash the row names in batches, which is faster
+                    static constexpr unsigned BATCH_SIZE = 256;
+                    std::vector<RowPath> rowNames;
+                    rowNames.reserve(BATCH_SIZE);
+                    uint64_t hashes[BATCH_SIZE];
+
+                    for (unsigned start = 0;  start < chunk.rowCount();
+                         start += BATCH_SIZE) {
+                        unsigned end = std::min<unsigned>(start + BATCH_SIZE,
+                                                          chunk.rowCount());
+                        rowNames.clear();
+                        for (unsigned j = start;  j < end;  ++j) {
+                            rowNames.emplace_back(chunk.getRowPath(j));
+                        }
+                        RowPath::hashBatch(rowNames.data(), rowNames.size(),
+                                           hashes);
+                        for (unsigned j = start;  j < end;  ++j) {
+                            recorder.record(hashes[j - start], j);
+                        }
                     }
                 
                     recorder.commit();
@@ -1546,13 +1571,26 @@ struct TabularDataset::TabularDataStore
         cs->serialize(serializer);
     }
 
-    PolyConfigT<Dataset> save(Url dataFileUrl) const
+    PolyConfigT<Dataset> save(Url dataFileUrl,
+                              const std::string & blockCompression) const
     {
         MLDB::makeUriDirectory(dataFileUrl.toString());
 
-        ZipStructuredSerializer serializer(dataFileUrl.toUtf8String());
+        std::unique_ptr<ZipStructuredSerializer> serializer;
+        if (blockCompression.empty()) {
+            serializer.reset
+                (new ZipStructuredSerializer(dataFileUrl.toUtf8String()));
+        }
+        else {
+            CompressedRegionOptions options;
+            options.compression = blockCompression;
+            serializer.reset
+                (new ZipStructuredSerializer(dataFileUrl.toUtf8String(),
+                                             options));
+        }
 
-        serialize(serializer);
+        serialize(*serializer);
+        serializer->commit();
 
         PolyConfigT<Dataset> result;
         result.type = "tabular";
@@ -1884,6 +1922,7 @@ struct TabularDataset::TabularDataStore
         auto newState = finalize(oldState, frozenChunks);
 
         currentState.store(newState);
+        ++generation;
         
         uint64_t totalRows = newState->rowCount;
         size_t mem = 0;
@@ -2205,6 +2244,13 @@ commit()
     return itl->commit();
 }
 
+int64_t
+TabularDataset::
+getGeneration() const
+{
+    return itl->generation;
+}
+
 Dataset::MultiChunkRecorder
 TabularDataset::
 getChunkRecorder()
@@ -69,6 +69,8 @@ struct TabularDataset : public Dataset {
     /** Commit changes to the database. */
     virtual void commit();
 
+    virtual int64_t getGeneration() const;
+
     virtual MultiChunkRecorder getChunkRecorder();
 
     virtual void
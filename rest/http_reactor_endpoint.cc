@@ -0,0 +1,947 @@
+/* http_reactor_endpoint.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   HTTP endpoint for REST calls running on several independent epoll
+   reactors.
+*/
+
+#include "http_reactor_endpoint.h"
+#include "mldb/io/epoll_loop.h"
+#include "mldb/http/http_header.h"
+#include "mldb/http/http_parsers.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include "mldb/utils/log.h"
+
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Size of the buffer that each reactor receives into
+constexpr size_t READ_BUFFER_SIZE = 65536;
+
+/// Listen backlog of each reactor's socket
+constexpr int LISTEN_BACKLOG = 1024;
+
+/// Number of pipelined requests waiting on a connection at which we stop
+/// reading from it until some have been handled
+constexpr size_t MAX_PENDING_REQUESTS = 16;
+
+/** Resolve the given host and port to an IPv4 address to bind to. */
+std::shared_ptr<struct addrinfo>
+resolveListenAddress(const std::string & host, int port)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+    struct addrinfo * addrs = nullptr;
+    int res = getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                          &hints, &addrs);
+    if (res != 0) {
+        throw MLDB::Exception("couldn't resolve host '" + host + "': "
+                              + gai_strerror(res));
+    }
+    return std::shared_ptr<struct addrinfo>(addrs, freeaddrinfo);
+}
+
+/** Find out if the given port is free by binding to it without
+    SO_REUSEPORT, which fails if any other socket holds it, even one with
+    SO_REUSEPORT set in a process of the same user.  Returns the port bound
+    (which is only different to the one passed if it was zero), or -1 with
+    errno set on error.  The port is released again before returning. */
+int probePort(const std::string & host, int port)
+{
+    auto addrs = resolveListenAddress(host, port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    int one = 1;
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1
+        || ::bind(fd, addrs->ai_addr, addrs->ai_addrlen) == -1
+        || getsockname(fd, (struct sockaddr *)&addr, &addrLen) == -1) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        return -1;
+    }
+
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+/** Open a non-blocking socket listening on the given host and port, which
+    other sockets can share with SO_REUSEPORT.  Returns -1 and sets errno
+    on error. */
+int openListener(const std::string & host, int port)
+{
+    auto addrs = resolveListenAddress(host, port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1
+        || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1
+        || ::bind(fd, addrs->ai_addr, addrs->ai_addrlen) == -1
+        || ::listen(fd, LISTEN_BACKLOG) == -1) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+std::string getPeerName(const struct sockaddr_storage & addr)
+{
+    char host[INET6_ADDRSTRLEN];
+    if (addr.ss_family == AF_INET) {
+        auto sin = reinterpret_cast<const struct sockaddr_in *>(&addr);
+        inet_ntop(AF_INET, &sin->sin_addr, host, sizeof(host));
+        return std::string(host) + ":" + std::to_string(ntohs(sin->sin_port));
+    }
+    else if (addr.ss_family == AF_INET6) {
+        auto sin6 = reinterpret_cast<const struct sockaddr_in6 *>(&addr);
+        inet_ntop(AF_INET6, &sin6->sin6_addr, host, sizeof(host));
+        return std::string(host) + ":" + std::to_string(ntohs(sin6->sin6_port));
+    }
+    return "unknown";
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* REACTOR                                                                   */
+/*****************************************************************************/
+
+/** A thread running an epoll loop over one listening socket and all of the
+    connections accepted from it.  Other threads talk to it by posting
+    functions, which it runs between events. */
+
+struct HttpReactorEndpoint::Reactor
+    : public std::enable_shared_from_this<Reactor> {
+
+    Reactor(HttpReactorEndpoint * endpoint, int listenFd)
+        : endpoint(endpoint),
+          loop([] (const std::exception_ptr & exc)
+               {
+                   try {
+                       std::rethrow_exception(exc);
+                   } catch (const std::exception & e) {
+                       cerr << "exception in HTTP reactor: " << e.what()
+                            << endl;
+                   }
+               }),
+          listenFd(listenFd),
+          readBuffer(new char[READ_BUFFER_SIZE])
+    {
+        wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeupFd == -1)
+            throw MLDB::Exception(errno, "eventfd");
+    }
+
+    ~Reactor()
+    {
+        ::close(wakeupFd);
+        ::close(listenFd);
+    }
+
+    /** Start the reactor thread. */
+    void start()
+    {
+        loop.addFd(listenFd, true, false,
+                   [this] (const ::epoll_event &) { onAccept(); });
+        loop.addFd(wakeupFd, true, false,
+                   [this] (const ::epoll_event &) { onWakeup(); });
+        thread = std::thread([this] () { run(); });
+    }
+
+    /** Stop the reactor thread and close all of its connections.  Functions
+        posted afterwards are dropped. */
+    void stop();
+
+    /** Run the given function on the reactor thread.  Returns false if the
+        reactor has been stopped, in which case it won't be run. */
+    bool post(std::function<void ()> fn)
+    {
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            if (stopped)
+                return false;
+            queue.emplace_back(std::move(fn));
+        }
+        uint64_t one = 1;
+        ssize_t res = ::write(wakeupFd, &one, sizeof(one));
+        (void)res;  // only fails if the counter is already huge
+        return true;
+    }
+
+    bool onReactorThread() const
+    {
+        return std::this_thread::get_id() == threadId;
+    }
+
+    void run()
+    {
+        threadId = std::this_thread::get_id();
+        while (!stopping.load(std::memory_order_relaxed)) {
+            loop.loop(64, -1);
+        }
+    }
+
+    void onAccept();
+
+    void onWakeup()
+    {
+        uint64_t count;
+        ssize_t res = ::read(wakeupFd, &count, sizeof(count));
+        (void)res;
+
+        std::vector<std::function<void ()> > toRun;
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            toRun.swap(queue);
+        }
+        for (auto & fn: toRun) {
+            try {
+                fn();
+            } catch (const std::exception & exc) {
+                cerr << "exception in HTTP reactor: " << exc.what() << endl;
+            }
+        }
+    }
+
+    HttpReactorEndpoint * endpoint;
+    EpollLoop loop;
+    int listenFd;
+    int wakeupFd;
+    std::thread thread;
+    std::thread::id threadId;
+    std::atomic<bool> stopping { false };
+
+    std::mutex queueLock;
+    std::vector<std::function<void ()> > queue;
+    bool stopped = false;
+
+    /// Connections of this reactor, by file descriptor.  Reactor thread only.
+    std::map<int, std::shared_ptr<Connection> > connections;
+
+    /// Buffer that data is received into before being parsed
+    std::unique_ptr<char[]> readBuffer;
+};
+
+
+/*****************************************************************************/
+/* CONNECTION                                                                */
+/*****************************************************************************/
+
+/** A connection, which lives on the reactor that accepted it.  The
+    HttpResponder methods can be called from any thread; they are forwarded
+    to the reactor thread if needed.  Everything else happens on the reactor
+    thread. */
+
+struct HttpReactorEndpoint::Connection
+    : public HttpResponder,
+      public std::enable_shared_from_this<Connection> {
+
+    typedef HttpLegacySocketHandler::NextAction NextAction;
+    typedef HttpLegacySocketHandler::OnWriteFinished OnWriteFinished;
+
+    Connection(std::shared_ptr<Reactor> reactor, int fd, std::string peerName)
+        : reactor(std::move(reactor)), fd(fd), peerName(std::move(peerName))
+    {
+        parser.onRequestStart = [this] (const char * methodData,
+                                        size_t methodSize,
+                                        const char * urlData, size_t urlSize,
+                                        const char * versionData,
+                                        size_t versionSize)
+            {
+                header.setRequestLine(methodData, methodSize,
+                                      urlData, urlSize,
+                                      versionData, versionSize);
+            };
+        parser.onHeader = [this] (const char * data, size_t size)
+            {
+                header.addHeaderLine(data, size);
+            };
+        parser.onExpect100Continue = [this] ()
+            {
+                queueWrite("HTTP/1.1 100 Continue\r\n\r\n",
+                           HttpLegacySocketHandler::NEXT_CONTINUE, nullptr);
+                return true;
+            };
+        parser.onData = [this] (const char * data, size_t size)
+            {
+                payload.append(data, size);
+            };
+        parser.onDone = [this] (bool requireClose)
+            {
+                pending.emplace_back();
+                Request & request = pending.back();
+                request.header.swap(header);
+                request.header.queryParams.swap(header.queryParams);
+                request.payload.swap(payload);
+                request.requireClose = requireClose;
+                header = HttpHeader();
+                payload.clear();
+            };
+    }
+
+    struct Request {
+        HttpHeader header;
+        std::string payload;
+        bool requireClose = false;
+    };
+
+    /* Reactor thread */
+
+    void onEvent(const ::epoll_event & event)
+    {
+        if (event.events & EPOLLERR) {
+            close();
+            return;
+        }
+        if ((event.events & EPOLLHUP) && readPaused) {
+            // Nothing can be read without buffering more requests, and
+            // the responses can't be delivered anyway
+            close();
+            return;
+        }
+        if (event.events & (EPOLLIN | EPOLLHUP))
+            doRead();
+        if (connected && (event.events & EPOLLOUT))
+            doWrite();
+    }
+
+    void doRead()
+    {
+        char * buf = reactor->readBuffer.get();
+        ssize_t n = ::recv(fd, buf, READ_BUFFER_SIZE, 0);
+        if (n > 0) {
+            try {
+                parser.feed(buf, n);
+            } catch (const std::exception & exc) {
+                // Malformed request; there's no way to recover the stream.
+                // The requests before it are answered first, and the error
+                // is sent once they have been.
+                parseError = string("error parsing request: ") + exc.what();
+                readClosed = true;
+                updateEvents();
+                dispatchNext();
+                return;
+            }
+            if (pending.size() >= MAX_PENDING_REQUESTS && !readPaused) {
+                readPaused = true;
+                updateEvents();
+            }
+            dispatchNext();
+        }
+        else if (n == 0) {
+            // The peer won't send anything else, but may still be waiting
+            // for the responses to what it did send.
+            readClosed = true;
+            if (!inFlight && pending.empty())
+                close();
+            else
+                updateEvents();
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            close();
+        }
+    }
+
+    /** Start handling the next request, if there is one and none is being
+        handled already. */
+    void dispatchNext()
+    {
+        if (dispatching)
+            return;  // called from an inline handler; the loop below continues
+        dispatching = true;
+
+        while (connected && !inFlight && !pending.empty()) {
+            auto request = std::make_shared<Request>
+                (std::move(pending.front()));
+            pending.pop_front();
+            inFlight = true;
+
+            if (readPaused && pending.size() < MAX_PENDING_REQUESTS) {
+                readPaused = false;
+                updateEvents();
+            }
+            closeAfterResponse = request->requireClose;
+
+            if (reactor->endpoint->logger) {
+                logVerb = request->header.verb;
+                logResource = request->header.resource;
+                clock_gettime(CLOCK_REALTIME, &timer);
+            }
+
+            auto & isInline = reactor->endpoint->isInlineRequest;
+            if (isInline && isInline(request->header)) {
+                handleRequest(*request);
+            }
+            else {
+                auto self = shared_from_this();
+                reactor->endpoint->workers->add([self, request] ()
+                    {
+                        self->handleRequest(*request);
+                    });
+            }
+        }
+
+        dispatching = false;
+
+        if (connected && !inFlight && pending.empty()
+            && !parseError.empty()) {
+            std::string error = std::move(parseError);
+            parseError.clear();
+            sendErrorResponse(400, error);
+            return;
+        }
+
+        if (readClosed && !inFlight && pending.empty())
+            close();
+    }
+
+    /** Run the handler for a request; on any thread. */
+    void handleRequest(const Request & request)
+    {
+        try {
+            reactor->endpoint->onRequest(shared_from_this(),
+                                         request.header, request.payload);
+        }
+        catch (const std::exception & exc) {
+            Json::Value response;
+            response["error"] =
+                "exception processing request "
+                + request.header.verb + " " + request.header.resource;
+            response["exception"] = exc.what();
+            sendErrorResponse(400, response);
+        }
+        catch (...) {
+            Json::Value response;
+            response["error"] =
+                "exception processing request "
+                + request.header.verb + " " + request.header.resource;
+            sendErrorResponse(400, response);
+        }
+    }
+
+    /** Called once the whole response to the current request has been
+        queued. */
+    void responseDone(bool close)
+    {
+        if (!inFlight)
+            return;
+        inFlight = false;
+        if (close || closeAfterResponse) {
+            closeAfterWrite = true;
+            pending.clear();
+            if (writeOffset == writeBuffer.size())
+                this->close();
+            return;
+        }
+        dispatchNext();
+    }
+
+    void queueWrite(std::string data, NextAction next,
+                    OnWriteFinished onWriteFinished)
+    {
+        if (!connected)
+            return;
+
+        bytesQueued += data.size();
+        if (writeOffset == writeBuffer.size()) {
+            writeBuffer = std::move(data);
+            writeOffset = 0;
+        }
+        else {
+            writeBuffer.append(data);
+        }
+        if (onWriteFinished)
+            writeCallbacks.emplace_back(bytesQueued, std::move(onWriteFinished));
+
+        doWrite();
+
+        if (connected
+            && (next == HttpLegacySocketHandler::NEXT_CLOSE
+                || next == HttpLegacySocketHandler::NEXT_RECYCLE)) {
+            responseDone(next == HttpLegacySocketHandler::NEXT_CLOSE);
+        }
+    }
+
+    void doWrite()
+    {
+        while (writeOffset < writeBuffer.size()) {
+            ssize_t n = ::send(fd, writeBuffer.data() + writeOffset,
+                               writeBuffer.size() - writeOffset,
+                               MSG_NOSIGNAL);
+            if (n > 0) {
+                writeOffset += n;
+                bytesWritten += n;
+                continue;
+            }
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                runWriteCallbacks();
+                if (!wantWrite) {
+                    wantWrite = true;
+                    updateEvents();
+                }
+                return;
+            }
+            close();
+            return;
+        }
+
+        writeBuffer.clear();
+        writeOffset = 0;
+        runWriteCallbacks();
+
+        if (wantWrite) {
+            wantWrite = false;
+            updateEvents();
+        }
+        if (closeAfterWrite && !inFlight)
+            close();
+    }
+
+    void runWriteCallbacks()
+    {
+        while (!writeCallbacks.empty()
+               && writeCallbacks.front().first <= bytesWritten) {
+            auto fn = std::move(writeCallbacks.front().second);
+            writeCallbacks.pop_front();
+            fn();
+        }
+    }
+
+    void updateEvents()
+    {
+        if (connected)
+            reactor->loop.modifyFd(fd, !readClosed && !readPaused, wantWrite);
+    }
+
+    void close()
+    {
+        if (!connected.exchange(false))
+            return;
+
+        // Keep ourselves alive until we return
+        auto self = shared_from_this();
+
+        reactor->loop.removeFd(fd, true /* unregister callback */);
+        ::close(fd);
+        reactor->connections.erase(fd);
+        pending.clear();
+        writeCallbacks.clear();
+
+        if (onDisconnect)
+            onDisconnect();
+    }
+
+    /** Run the function on the reactor thread, now if we're on it. */
+    template<typename Fn>
+    void inReactor(Fn && fn)
+    {
+        if (reactor->onReactorThread())
+            fn();
+        else reactor->post(std::forward<Fn>(fn));
+    }
+
+    void logRequest(int code)
+    {
+        auto & logger = reactor->endpoint->logger;
+        if (logger) {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            double elapsed = (now.tv_sec - timer.tv_sec) * 1000
+                + (now.tv_nsec - timer.tv_nsec) * 0.000001;
+            INFO_MSG(logger) << "\"" << logVerb << " " << logResource << "\" "
+                             << code << " " << std::setprecision(3)
+                             << elapsed << "ms";
+        }
+    }
+
+    /* HttpResponder interface; any thread */
+
+    virtual void sendErrorResponse(int code, std::string error) override
+    {
+        Json::Value val;
+        val["error"] = error;
+        sendErrorResponse(code, val);
+    }
+
+    virtual void sendErrorResponse(int code,
+                                   const Json::Value & error) override
+    {
+        HttpResponse response(code, "application/json", error.toString(),
+                              reactor->endpoint->extraHeaders);
+        auto self = shared_from_this();
+        inReactor([self, code, data = response.toWire()] () mutable
+                  {
+                      self->logRequest(code);
+                      self->inFlight = true;  // errors end the connection
+                      self->queueWrite(std::move(data),
+                                       HttpLegacySocketHandler::NEXT_CLOSE,
+                                       nullptr);
+                  });
+    }
+
+    virtual void sendResponse(int code,
+                              const Json::Value & response,
+                              std::string contentType,
+                              RestParams headers) override
+    {
+        sendResponse(code, response.toString(), std::move(contentType),
+                     std::move(headers));
+    }
+
+    virtual void sendResponse(int code,
+                              std::string body, std::string contentType,
+                              RestParams headers) override
+    {
+        for (auto & h: reactor->endpoint->extraHeaders)
+            headers.push_back(h);
+
+        HttpResponse response(code, std::move(contentType), std::move(body),
+                              std::move(headers));
+        auto self = shared_from_this();
+        inReactor([self, code, data = response.toWire()] () mutable
+                  {
+                      self->logRequest(code);
+                      self->queueWrite(std::move(data),
+                                       HttpLegacySocketHandler::NEXT_RECYCLE,
+                                       nullptr);
+                  });
+    }
+
+    virtual void sendResponseHeader(int code,
+                                    std::string contentType,
+                                    RestParams headers) override
+    {
+        for (auto & h: reactor->endpoint->extraHeaders)
+            headers.push_back(h);
+
+        HttpResponse response(code, std::move(contentType),
+                              std::move(headers));
+        auto self = shared_from_this();
+        inReactor([self, code, data = response.toWire()] () mutable
+                  {
+                      self->logRequest(code);
+                      self->queueWrite(std::move(data),
+                                       HttpLegacySocketHandler::NEXT_CONTINUE,
+                                       nullptr);
+                  });
+    }
+
+    virtual void sendHttpChunk(std::string chunk,
+                               NextAction next,
+                               OnWriteFinished onWriteFinished) override
+    {
+        // An empty chunk is the end of the body
+        std::string data = MLDB::format("%zx\r\n", chunk.size());
+        data.append(chunk);
+        data.append("\r\n");
+        if (!chunk.empty()
+            && (next == HttpLegacySocketHandler::NEXT_CLOSE
+                || next == HttpLegacySocketHandler::NEXT_RECYCLE))
+            data.append("0\r\n\r\n");
+        send(std::move(data), next, std::move(onWriteFinished));
+    }
+
+    virtual void send(std::string str,
+                      NextAction next,
+                      OnWriteFinished onWriteFinished) override
+    {
+        auto self = shared_from_this();
+        inReactor([self, str = std::move(str), next,
+                   onWriteFinished = std::move(onWriteFinished)] () mutable
+                  {
+                      self->queueWrite(std::move(str), next,
+                                       std::move(onWriteFinished));
+                  });
+    }
+
+    virtual bool isConnected() const override
+    {
+        return connected;
+    }
+
+    virtual std::string getPeerName() const override
+    {
+        return peerName;
+    }
+
+    std::shared_ptr<Reactor> reactor;
+    int fd;
+    std::string peerName;
+    std::atomic<bool> connected { true };
+
+    HttpRequestParser parser;
+    HttpHeader header;      ///< Header of the request being received
+    std::string payload;    ///< Body of the request being received
+
+    std::deque<Request> pending;     ///< Received, not yet handled
+    bool inFlight = false;           ///< Waiting for a response to finish
+    bool dispatching = false;
+    bool closeAfterResponse = false; ///< Request asked to close
+    bool readClosed = false;         ///< Peer has finished sending
+    bool readPaused = false;         ///< Too many requests are pending
+    std::string parseError;          ///< Sent once pending are answered
+
+    std::string writeBuffer;
+    size_t writeOffset = 0;
+    uint64_t bytesQueued = 0;
+    uint64_t bytesWritten = 0;
+    std::deque<std::pair<uint64_t, OnWriteFinished> > writeCallbacks;
+    bool wantWrite = false;
+    bool closeAfterWrite = false;
+
+    std::string logVerb;
+    std::string logResource;
+    timespec timer;
+};
+
+void
+HttpReactorEndpoint::Reactor::
+onAccept()
+{
+    for (;;) {
+        struct sockaddr_storage addr;
+        socklen_t addrLen = sizeof(addr);
+        int fd = accept4(listenFd, (struct sockaddr *)&addr, &addrLen,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                cerr << "error accepting HTTP connection: "
+                     << strerror(errno) << endl;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto connection = std::make_shared<Connection>
+            (shared_from_this(), fd, getPeerName(addr));
+        connections[fd] = connection;
+        loop.addFd(fd, true, false,
+                   [connection] (const ::epoll_event & event)
+                   {
+                       connection->onEvent(event);
+                   });
+    }
+}
+
+void
+HttpReactorEndpoint::Reactor::
+stop()
+{
+    {
+        std::unique_lock<std::mutex> guard(queueLock);
+        if (stopped)
+            return;
+        stopped = true;
+    }
+
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t res = ::write(wakeupFd, &one, sizeof(one));
+    (void)res;
+    if (thread.joinable())
+        thread.join();
+
+    // The thread is gone, so we can touch the connections from here.  The
+    // loop's callbacks hold references to the connections, which hold one
+    // to us, so they need to be unregistered right away.
+    for (auto & c: connections) {
+        c.second->connected = false;
+        loop.removeFd(c.first, false);
+        loop.unregisterFdCallback(c.first, false);
+        ::close(c.first);
+    }
+    connections.clear();
+}
+
+
+/*****************************************************************************/
+/* HTTP REACTOR ENDPOINT                                                     */
+/*****************************************************************************/
+
+HttpReactorEndpoint::
+HttpReactorEndpoint(unsigned numReactors, unsigned numWorkers,
+                    bool enableLogging)
+    : numReactors_(numReactors ? numReactors
+                   : std::max(1u, std::thread::hardware_concurrency())),
+      port_(-1),
+      workers(new ThreadPool(numWorkers ? numWorkers
+                             : std::max(1u,
+                                        std::thread::hardware_concurrency())))
+{
+    if (enableLogging)
+        logger = MLDB::getServerLog();
+}
+
+HttpReactorEndpoint::
+~HttpReactorEndpoint()
+{
+    shutdown();
+}
+
+void
+HttpReactorEndpoint::
+allowAllOrigins()
+{
+    extraHeaders.push_back({ "Access-Control-Allow-Origin", "*" });
+}
+
+void
+HttpReactorEndpoint::
+shutdown()
+{
+    // Stop the reactors first, so that no more requests are dispatched.
+    // Responses from requests that are still running are dropped.
+    for (auto & r: reactors)
+        r->stop();
+    workers->waitForAll();
+    reactors.clear();
+    port_ = -1;
+}
+
+std::string
+HttpReactorEndpoint::
+bindTcpAddress(const std::string & address)
+{
+    auto parsed = HttpRestEndpoint::parseTcpAddress(address);
+    return bindTcp(parsed.first, parsed.second);
+}
+
+std::string
+HttpReactorEndpoint::
+bindTcpFixed(std::string host, int port)
+{
+    return bindTcp(port, host);
+}
+
+std::string
+HttpReactorEndpoint::
+bindTcp(PortRange const & portRange, std::string host)
+{
+    if (!reactors.empty())
+        throw MLDB::Exception("HTTP reactor endpoint is already bound");
+
+    if (host == "" || host == "*")
+        host = "0.0.0.0";
+
+    // Find a port that nothing else is using.  The reactor sockets share
+    // their port through SO_REUSEPORT, which would also let them join a
+    // port that another process of the same user is listening on, so the
+    // port is probed first without it.
+    std::vector<int> fds;
+    int port = -1;
+
+    auto closeAll = [&] ()
+        {
+            for (int fd: fds)
+                ::close(fd);
+            fds.clear();
+        };
+
+    for (int p = portRange.first;  p < portRange.last;  ++p) {
+        int probed = probePort(host, p);
+        int err = errno;
+
+        if (probed != -1) {
+            // Another socket could take the port between the probe and
+            // the bind; in that case move on to the next one
+            while (fds.size() < numReactors_) {
+                int fd = openListener(host, probed);
+                if (fd == -1) {
+                    err = errno;
+                    break;
+                }
+                fds.push_back(fd);
+            }
+            if (fds.size() == numReactors_) {
+                port = probed;
+                break;
+            }
+            closeAll();
+        }
+
+        if (err != EADDRINUSE && err != EACCES) {
+            throw MLDB::Exception(err, "binding HTTP reactor to " + host
+                                  + ":" + std::to_string(p));
+        }
+    }
+
+    if (port == -1) {
+        throw MLDB::Exception("couldn't bind HTTP reactor to any port in "
+                              "range %d-%d on %s",
+                              portRange.first, portRange.last,
+                              host.c_str());
+    }
+
+    for (int fd: fds) {
+        reactors.emplace_back(std::make_shared<Reactor>(this, fd));
+    }
+    for (auto & r: reactors) {
+        r->start();
+    }
+
+    port_ = port;
+    return "http://" + host + ":" + std::to_string(port);
+}
+
+int
+HttpReactorEndpoint::
+port() const
+{
+    return port_;
+}
+
+unsigned
+HttpReactorEndpoint::
+numReactors() const
+{
+    return numReactors_;
+}
+
+} // namespace MLDB
@@ -0,0 +1,113 @@
+/* http_reactor_endpoint.h                                         -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   HTTP endpoint for REST calls running on several independent epoll
+   reactors.
+*/
+
+#pragma once
+
+#include "mldb/rest/http_rest_endpoint.h"
+#include "mldb/io/port_range_service.h"
+#include "mldb/utils/log_fwd.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+/* Forward declarations */
+struct HttpHeader;
+struct ThreadPool;
+
+
+/*****************************************************************************/
+/* HTTP REACTOR ENDPOINT                                                     */
+/*****************************************************************************/
+
+/** An HTTP endpoint for REST calls that serves connections from a number of
+    reactor threads, rather than from the shared EventLoop of the
+    HttpRestEndpoint.
+
+    Each reactor has its own epoll loop and its own listening socket, all of
+    them bound to the same port with SO_REUSEPORT so that the kernel spreads
+    incoming connections between them without a shared accept queue.  A
+    connection stays on the reactor that accepted it for its whole life.
+    Requests are parsed straight from the receive buffer by an
+    HttpRequestParser.
+
+    Requests for which isInlineRequest() returns true are handled directly
+    on the reactor thread, which is the fastest way to serve cheap requests
+    but holds up the other connections of the reactor while it runs.  The
+    others are handed to a pool of worker threads.  Either way, responses
+    can be sent from any thread; the data is written by the reactor.
+
+    Requests pipelined on a connection are handled one at a time, in order.
+    Nothing more is read from a connection while a few of them are waiting,
+    so that a client can't make it buffer an unbounded number.
+*/
+
+struct HttpReactorEndpoint {
+    /** Create an endpoint with the given number of reactors and of worker
+        threads for requests that aren't handled inline.  Zero for either
+        means one per CPU. */
+    HttpReactorEndpoint(unsigned numReactors, unsigned numWorkers,
+                        bool enableLogging);
+
+    ~HttpReactorEndpoint();
+
+    /** Set the Access-Control-Allow-Origin: * HTTP header */
+    void allowAllOrigins();
+
+    /** Stop accepting connections, wait for running requests and stop the
+        reactors. */
+    void shutdown();
+
+    /** Bind into a given address; see HttpRestEndpoint::bindTcpAddress(). */
+    std::string bindTcpAddress(const std::string & address);
+
+    /** Bind into a specific tcp port.  If the port is not available, it will
+        throw an exception.  Returns the uri to connect to.
+    */
+    std::string bindTcpFixed(std::string host, int port);
+
+    /** Bind into the first available port of the range, on all of the
+        reactors, and start serving.  Returns the uri to connect to.
+    */
+    std::string bindTcp(PortRange const & portRange, std::string host = "");
+
+    /// Port that we're listening on, or -1 if not bound
+    int port() const;
+
+    /// Number of reactor threads
+    unsigned numReactors() const;
+
+    typedef std::function<void (std::shared_ptr<HttpResponder> connection,
+                                const HttpHeader & header,
+                                const std::string & payload)> OnRequest;
+
+    /** Called to handle each request. */
+    OnRequest onRequest;
+
+    /** Returns whether the request can be handled on the reactor thread.
+        If it's not set, all requests go to the worker threads. */
+    std::function<bool (const HttpHeader & header)> isInlineRequest;
+
+    std::vector<std::pair<std::string, std::string> > extraHeaders;
+
+    /// Access log; null if logging is disabled
+    std::shared_ptr<spdlog::logger> logger;
+
+    struct Reactor;
+    struct Connection;
+
+private:
+    unsigned numReactors_;
+    int port_;
+    std::unique_ptr<ThreadPool> workers;
+    std::vector<std::shared_ptr<Reactor> > reactors;
+};
+
+} // namespace MLDB
@@ -67,12 +67,20 @@ closePeer()
 std::string
 HttpRestEndpoint::
 bindTcpAddress(const std::string & address)
+{
+    auto parsed = parseTcpAddress(address);
+    return bindTcp(parsed.first, parsed.second);
+}
+
+std::pair<PortRange, std::string>
+HttpRestEndpoint::
+parseTcpAddress(const std::string & address)
 {
     using namespace std;
     auto pos = address.find(':');
     if (pos == string::npos) {
         // No port specification; take any port
-        return bindTcp(PortRange(12000, 12999), address);
+        return { PortRange(12000, 12999), address };
     }
     string hostPart(address, 0, pos);
     string portPart(address, pos + 1);
@@ -85,13 +93,13 @@ bindTcpAddress(const std::string & address)
         unsigned port = boost::lexical_cast<unsigned>(string(portPart, 0, portPart.size() - 1));
         if(port < 65536) {
             unsigned last = port + 999;
-            return bindTcp(PortRange(port, last), hostPart);
+            return { PortRange(port, last), hostPart };
         }
 
         throw MLDB::Exception("invalid port " + to_string(port));
     }
 
-    return bindTcp(boost::lexical_cast<int>(portPart), hostPart);
+    return { PortRange(boost::lexical_cast<int>(portPart)), hostPart };
 }
 
 std::string
@@ -249,6 +257,29 @@ sendHttpChunk(std::string chunk,
     HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
 }
 
+void
+HttpRestEndpoint::RestConnectionHandler::
+send(std::string str,
+     NextAction next,
+     OnWriteFinished onWriteFinished)
+{
+    HttpLegacySocketHandler::send(std::move(str), next, onWriteFinished);
+}
+
+bool
+HttpRestEndpoint::RestConnectionHandler::
+isConnected() const
+{
+    return HttpLegacySocketHandler::isConnected();
+}
+
+std::string
+HttpRestEndpoint::RestConnectionHandler::
+getPeerName() const
+{
+    return HttpLegacySocketHandler::getPeerName();
+}
+
 inline void
 HttpRestEndpoint::RestConnectionHandler::
 logRequest(int code) const
@@ -12,6 +12,7 @@
 #include <atomic>
 #include <memory>
 #include <string>
+#include <utility>
 #include <time.h>
 
 namespace MLDB {
@@ -22,6 +23,61 @@ struct HttpHeader;
 struct TcpAcceptor;
 
 
+/*****************************************************************************/
+/* HTTP RESPONDER                                                            */
+/*****************************************************************************/
+
+/** Interface to the connection over which the response to an HTTP request
+    is sent.  This is what an HttpRestConnection talks to; it's implemented
+    by the connection handlers of both the HttpRestEndpoint and the
+    HttpReactorEndpoint.
+*/
+struct HttpResponder {
+    virtual ~HttpResponder()
+    {
+    }
+
+    virtual void sendErrorResponse(int code, std::string error) = 0;
+
+    virtual void sendErrorResponse(int code, const Json::Value & error) = 0;
+
+    virtual void sendResponse(int code,
+                              const Json::Value & response,
+                              std::string contentType = "application/json",
+                              RestParams headers = RestParams()) = 0;
+
+    virtual void sendResponse(int code,
+                              std::string body, std::string contentType,
+                              RestParams headers = RestParams()) = 0;
+
+    virtual void sendResponseHeader(int code,
+                                    std::string contentType,
+                                    RestParams headers = RestParams()) = 0;
+
+    /** Send an HTTP chunk with the appropriate headers back down the
+        wire. */
+    virtual void sendHttpChunk(std::string chunk,
+                               HttpLegacySocketHandler::NextAction next
+                                   = HttpLegacySocketHandler::NEXT_CONTINUE,
+                               HttpLegacySocketHandler::OnWriteFinished
+                                   onWriteFinished = nullptr) = 0;
+
+    /** Send raw data down the wire, and then do the given action. */
+    virtual void send(std::string str,
+                      HttpLegacySocketHandler::NextAction next
+                          = HttpLegacySocketHandler::NEXT_CONTINUE,
+                      HttpLegacySocketHandler::OnWriteFinished
+                          onWriteFinished = nullptr) = 0;
+
+    virtual bool isConnected() const = 0;
+
+    virtual std::string getPeerName() const = 0;
+
+    /** Disconnect handler. */
+    std::function<void ()> onDisconnect;
+};
+
+
 /*****************************************************************************/
 /* HTTP REST ENDPOINT                                                        */
 /*****************************************************************************/
@@ -64,42 +120,54 @@ struct HttpRestEndpoint {
     */
     virtual std::string
     bindTcp(PortRange const & portRange, std::string host = "");
+
+    /** Split an address as accepted by bindTcpAddress() into the range of
+        ports and the host. */
+    static std::pair<PortRange, std::string>
+    parseTcpAddress(const std::string & address);
     
     /** Connection handler structure for the endpoint. */
-    struct RestConnectionHandler: public HttpLegacySocketHandler {
+    struct RestConnectionHandler: public HttpLegacySocketHandler,
+                                  public HttpResponder {
         RestConnectionHandler(HttpRestEndpoint * endpoint, TcpSocket && socket, bool enableLogging);
 
         HttpRestEndpoint * endpoint;
 
-        /** Disconnect handler. */
-        std::function<void ()> onDisconnect;
-
         virtual void
         handleHttpPayload(const HttpHeader & header,
                           const std::string & payload);
 
-        void sendErrorResponse(int code, std::string error);
+        virtual void sendErrorResponse(int code, std::string error) override;
+
+        virtual void sendErrorResponse(int code,
+                                       const Json::Value & error) override;
+
+        virtual void sendResponse(int code,
+                                  const Json::Value & response,
+                                  std::string contentType = "application/json",
+                                  RestParams headers = RestParams()) override;
+
+        virtual void sendResponse(int code,
+                                  std::string body, std::string contentType,
+                                  RestParams headers = RestParams()) override;
 
-        void sendErrorResponse(int code, const Json::Value & error);
+        virtual void sendResponseHeader(int code,
+                                        std::string contentType,
+                                        RestParams headers = RestParams())
+            override;
 
-        void sendResponse(int code,
-                          const Json::Value & response,
-                          std::string contentType = "application/json",
-                          RestParams headers = RestParams());
+        virtual void sendHttpChunk(std::string chunk,
+                                   NextAction next = NEXT_CONTINUE,
+                                   OnWriteFinished onWriteFinished
+                                       = OnWriteFinished()) override;
 
-        void sendResponse(int code,
-                          std::string body, std::string contentType,
-                          RestParams headers = RestParams());
+        virtual void send(std::string str,
+                          NextAction next = NEXT_CONTINUE,
+                          OnWriteFinished onWriteFinished = nullptr) override;
 
-        void sendResponseHeader(int code,
-                                std::string contentType,
-                                RestParams headers = RestParams());
+        virtual bool isConnected() const override;
 
-        /** Send an HTTP chunk with the appropriate headers back down the
-            wire. */
-        void sendHttpChunk(std::string chunk,
-                           NextAction next = NEXT_CONTINUE,
-                           OnWriteFinished onWriteFinished = OnWriteFinished());
+        virtual std::string getPeerName() const override;
 
     private:
         void logRequest(int code) const;
@@ -13,6 +13,7 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/io/event_loop.h"
 #include "http_rest_endpoint.h"
+#include "http_reactor_endpoint.h"
 #include "http_rest_service.h"
 #include "mldb/utils/log.h"
 
@@ -239,7 +240,8 @@ HttpRestService(bool enableLogging)
     : eventLoop(new EventLoop()),
       threadPool(new AsioThreadPool(*eventLoop)),
       httpEndpoint(new HttpRestEndpoint(*eventLoop, enableLogging)),
-      logger(MLDB::getMldbLog<HttpRestService>())
+      logger(MLDB::getMldbLog<HttpRestService>()),
+      enableLogging(enableLogging)
 {
 }
 
@@ -256,10 +258,41 @@ shutdown()
     // 1.  Shut down the http endpoint, since it needs our threads to
     //     complete its shutdown
     httpEndpoint->shutdown();
+    if (reactorEndpoint)
+        reactorEndpoint->shutdown();
 
     threadPool->shutdown();
 }
 
+void
+HttpRestService::
+useReactors(unsigned numReactors, unsigned numWorkers,
+            std::function<bool (const HttpHeader &)> isInlineRequest)
+{
+    reactorEndpoint.reset(new HttpReactorEndpoint(numReactors, numWorkers,
+                                                  enableLogging));
+    reactorEndpoint->isInlineRequest = std::move(isInlineRequest);
+    reactorEndpoint->onRequest
+        = [=] (std::shared_ptr<HttpResponder> connection,
+               const HttpHeader & header,
+               const std::string & payload)
+        {
+            std::string requestId = this->getHttpRequestId();
+            HttpRestConnection restConnection(connection, requestId, this);
+            this->doHandleRequest(restConnection,
+                                  RestRequest(header, payload));
+        };
+}
+
+void
+HttpRestService::
+allowAllOrigins()
+{
+    httpEndpoint->allowAllOrigins();
+    if (reactorEndpoint)
+        reactorEndpoint->allowAllOrigins();
+}
+
 void
 HttpRestService::
 init()
@@ -282,7 +315,9 @@ std::string
 HttpRestService::
 bindTcp(PortRange const & httpRange, std::string host)
 {
-    std::string httpAddr = httpEndpoint->bindTcp(httpRange, host);
+    std::string httpAddr = reactorEndpoint
+        ? reactorEndpoint->bindTcp(httpRange, host)
+        : httpEndpoint->bindTcp(httpRange, host);
     DEBUG_MSG(logger) << "http listening on " << httpAddr;
     return httpAddr;
 }
@@ -291,6 +326,8 @@ std::string
 HttpRestService::
 bindFixedHttpAddress(std::string host, int port)
 {
+    if (reactorEndpoint)
+        return reactorEndpoint->bindTcpFixed(host, port);
     return httpEndpoint->bindTcpFixed(host, port);
 }
 
@@ -298,6 +335,8 @@ std::string
 HttpRestService::
 bindFixedHttpAddress(std::string address)
 {
+    if (reactorEndpoint)
+        return reactorEndpoint->bindTcpAddress(address);
     return httpEndpoint->bindTcpAddress(address);
 }
 
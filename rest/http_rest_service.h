@@ -26,6 +26,7 @@ namespace MLDB {
 
 struct EventLoop;
 struct HttpRestEndpoint;
+struct HttpReactorEndpoint;
 struct HttpRestService;
 
 
@@ -41,7 +42,7 @@ struct HttpRestConnection: public RestConnection {
     }
         
     /// Initialize for http
-    HttpRestConnection(std::shared_ptr<HttpRestEndpoint::RestConnectionHandler> http,
+    HttpRestConnection(std::shared_ptr<HttpResponder> http,
                        const std::string & requestId,
                        HttpRestService * endpoint)
         : http(http),
@@ -54,7 +55,7 @@ struct HttpRestConnection: public RestConnection {
     {
     }
 
-    std::shared_ptr<HttpRestEndpoint::RestConnectionHandler> http;
+    std::shared_ptr<HttpResponder> http;
     std::string requestId;
     HttpRestService * endpoint;
     bool responseSent_;
@@ -153,6 +154,19 @@ struct HttpRestService {
 
     void init();
 
+    /** Serve HTTP from the given number of epoll reactor threads, each with
+        its own listening socket on the same port, instead of from the
+        shared event loop.  Requests for which isInlineRequest returns true
+        are handled on the reactor thread; the rest go to numWorkers worker
+        threads.  Zero means one per CPU.  Must be called before binding.
+    */
+    void useReactors(unsigned numReactors, unsigned numWorkers,
+                     std::function<bool (const HttpHeader &)> isInlineRequest
+                         = nullptr);
+
+    /** Set the Access-Control-Allow-Origin: * HTTP header on responses */
+    void allowAllOrigins();
+
     /** Bind to TCP/IP port */
     std::string bindTcp(PortRange const & httpRange = PortRange(),
                         std::string host = "");
@@ -203,7 +217,14 @@ struct HttpRestService {
     std::unique_ptr<EventLoop> eventLoop;
     std::unique_ptr<AsioThreadPool> threadPool;
     std::unique_ptr<HttpRestEndpoint> httpEndpoint;
+
+    /// Set by useReactors(); serves HTTP in place of httpEndpoint
+    std::unique_ptr<HttpReactorEndpoint> reactorEndpoint;
+
     std::shared_ptr<spdlog::logger> logger;
+
+private:
+    bool enableLogging;
 };
 
 } // namespace MLDB
@@ -15,6 +15,7 @@ LIBREST_SOURCES := \
 	rest_service_endpoint.cc \
 	http_rest_endpoint.cc \
 	http_rest_service.cc \
+	http_reactor_endpoint.cc \
 	cancellation_exception.cc \
 
 LIBLINK_SOURCES := \
@@ -43,7 +44,7 @@ LIBSERVICE_PEER_SOURCES := \
 	event_service.cc
 
 
-$(eval $(call library,rest,$(LIBREST_SOURCES),arch types utils log))
+$(eval $(call library,rest,$(LIBREST_SOURCES),arch base types utils log))
 $(eval $(call library,link,$(LIBLINK_SOURCES),watch))
 $(eval $(call library,rest_entity,$(LIBREST_ENTITY_SOURCES),gc link any json_diff))
 $(eval $(call library,service_peer,$(LIBSERVICE_PEER_SOURCES),rest gc link rest_entity))
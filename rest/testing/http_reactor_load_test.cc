@@ -0,0 +1,161 @@
+/* http_reactor_load_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Load test of the multi-reactor HTTP endpoint against localhost.  Prints
+   the request rate for inline and offloaded requests with different
+   numbers of reactors.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/rest/http_reactor_endpoint.h"
+#include "mldb/http/http_header.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/timers.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+/// Number of concurrent keep-alive connections
+constexpr int NUM_CLIENTS = 64;
+
+/// How long to run each configuration for
+constexpr double SECONDS = 3.0;
+
+/// Number of requests each client keeps in flight
+constexpr int PIPELINE_DEPTH = 4;
+
+/** Run clients against the port, each sending fixed requests on one
+    connection as fast as responses come back.  Returns requests per
+    second. */
+double runClients(int port, const std::string & resource)
+{
+    std::string request = "GET " + resource
+        + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string batch;
+    for (int i = 0;  i < PIPELINE_DEPTH;  ++i)
+        batch += request;
+
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numDone(0);
+    std::atomic<int> errors(0);
+
+    auto runClient = [&] ()
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+                ++errors;
+                ::close(fd);
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            // All responses are identical, so we only need to count the
+            // bytes of each batch.
+            size_t responseSize = 0;
+            char buf[65536];
+            uint64_t done = 0;
+
+            while (!finished) {
+                if (::send(fd, batch.data(), batch.size(), MSG_NOSIGNAL)
+                    != (ssize_t)batch.size()) {
+                    ++errors;
+                    break;
+                }
+
+                size_t received = 0;
+                while (responseSize == 0 || received < responseSize) {
+                    ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+                    if (n <= 0) {
+                        ++errors;
+                        finished = true;
+                        break;
+                    }
+                    received += n;
+                    if (responseSize == 0 && received > 0) {
+                        // Learn the response size from the first batch
+                        std::string head(buf, n);
+                        size_t pos = head.find("Content-Length: ");
+                        size_t end = head.find("\r\n\r\n");
+                        if (pos == std::string::npos
+                            || end == std::string::npos)
+                            throw MLDB::Exception("unexpected response");
+                        responseSize
+                            = (end + 4 + std::stoul(head.substr(pos + 16)))
+                            * PIPELINE_DEPTH;
+                    }
+                }
+                done += PIPELINE_DEPTH;
+            }
+
+            numDone += done;
+            ::close(fd);
+        };
+
+    Timer timer;
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < NUM_CLIENTS;  ++i)
+        threads.emplace_back(runClient);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(SECONDS));
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    double elapsed = timer.elapsed_wall();
+    BOOST_CHECK_EQUAL(errors, 0);
+    return numDone / elapsed;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_reactor_load )
+{
+    unsigned ncpus = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned numReactors: { 1u, 2u, ncpus / 2, ncpus }) {
+        if (numReactors == 0)
+            continue;
+
+        HttpReactorEndpoint endpoint(numReactors, ncpus, false);
+        endpoint.onRequest = [] (std::shared_ptr<HttpResponder> connection,
+                                 const HttpHeader & header,
+                                 const std::string & payload)
+            {
+                connection->sendResponse(200, std::string("{\"output\":1}"),
+                                         "application/json");
+            };
+        endpoint.isInlineRequest = [] (const HttpHeader & header)
+            {
+                return header.resource == "/inline";
+            };
+        endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+        double inlineRate = runClients(endpoint.port(), "/inline");
+        double offloadedRate = runClients(endpoint.port(), "/offloaded");
+
+        cerr << numReactors << " reactors: "
+             << (int)inlineRate << " inline req/s, "
+             << (int)offloadedRate << " offloaded req/s" << endl;
+    }
+}
@@ -0,0 +1,369 @@
+/* http_reactor_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the multi-reactor HTTP endpoint.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/rest/http_reactor_endpoint.h"
+#include "mldb/http/http_header.h"
+#include "mldb/arch/exception.h"
+#include "mldb/types/json.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+/** Minimal blocking HTTP client over a raw socket, so that we control
+    exactly what goes on the wire. */
+struct TestClient {
+    TestClient(int port)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            throw MLDB::Exception(errno, "connect");
+    }
+
+    ~TestClient()
+    {
+        ::close(fd);
+    }
+
+    void write(const std::string & data)
+    {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::send(fd, data.data() + done, data.size() - done,
+                               MSG_NOSIGNAL);
+            if (n == -1)
+                throw MLDB::Exception(errno, "send");
+            done += n;
+        }
+    }
+
+    /// Returns false on end of stream
+    bool fill()
+    {
+        char buf[4096];
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return false;
+        buffer.append(buf, n);
+        return true;
+    }
+
+    /** Read one response, returning its code and body.  Code is -1 if the
+        connection was closed first. */
+    std::pair<int, std::string> readResponse()
+    {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill())
+                return { -1, "" };
+        }
+        std::string head = buffer.substr(0, end + 2);
+        buffer.erase(0, end + 4);
+
+        int code = std::stoi(head.substr(9, 3));
+        std::string body;
+
+        if (head.find("Transfer-Encoding: chunked") != std::string::npos) {
+            for (;;) {
+                size_t eol;
+                while ((eol = buffer.find("\r\n")) == std::string::npos)
+                    if (!fill()) return { -1, "" };
+                size_t len = std::stoul(buffer.substr(0, eol), nullptr, 16);
+                while (buffer.size() < eol + 2 + len + 2)
+                    if (!fill()) return { -1, "" };
+                body.append(buffer, eol + 2, len);
+                buffer.erase(0, eol + 2 + len + 2);
+                if (len == 0)
+                    break;
+            }
+            return { code, body };
+        }
+
+        size_t pos = head.find("Content-Length: ");
+        BOOST_REQUIRE(pos != std::string::npos);
+        size_t len = std::stoul(head.substr(pos + 16));
+        while (buffer.size() < len)
+            if (!fill()) return { -1, "" };
+        body = buffer.substr(0, len);
+        buffer.erase(0, len);
+        return { code, body };
+    }
+
+    /// Returns whether the server closed the connection
+    bool isClosed()
+    {
+        return buffer.empty() && !fill();
+    }
+
+    int fd;
+    std::string buffer;
+};
+
+std::string get(const std::string & resource)
+{
+    return "GET " + resource + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+}
+
+/** Endpoint which echoes the resource, and records which thread served
+    each request. */
+struct EchoEndpoint: public HttpReactorEndpoint {
+    EchoEndpoint(unsigned numReactors = 2)
+        : HttpReactorEndpoint(numReactors, 2, false /* logging */)
+    {
+        onRequest = [this] (std::shared_ptr<HttpResponder> connection,
+                            const HttpHeader & header,
+                            const std::string & payload)
+            {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    threads.insert(std::this_thread::get_id());
+                }
+                if (header.resource == "/throw")
+                    throw MLDB::Exception("handler threw");
+                if (header.resource == "/slow")
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                if (header.resource == "/chunked") {
+                    connection->sendResponseHeader
+                        (200, "text/plain",
+                         { { "Transfer-Encoding", "chunked" } });
+                    connection->sendHttpChunk("hello ");
+                    connection->sendHttpChunk
+                        ("world", HttpLegacySocketHandler::NEXT_RECYCLE);
+                    return;
+                }
+
+                std::string body = header.verb + " " + header.resource;
+                auto it = header.queryParams.begin();
+                for (;  it != header.queryParams.end();  ++it)
+                    body += " " + it->first.rawString() + "="
+                        + it->second.rawString();
+                if (!payload.empty())
+                    body += " " + payload;
+                connection->sendResponse(200, body, "text/plain");
+            };
+    }
+
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_basic_requests )
+{
+    EchoEndpoint endpoint;
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+    BOOST_REQUIRE_GT(endpoint.port(), 0);
+    BOOST_CHECK_EQUAL(endpoint.numReactors(), 2);
+
+    TestClient client(endpoint.port());
+    client.write(get("/hello?a=1&b=two"));
+    auto resp = client.readResponse();
+    BOOST_CHECK_EQUAL(resp.first, 200);
+    BOOST_CHECK_EQUAL(resp.second, "GET /hello a=1 b=two");
+
+    // Keep-alive: the same connection serves the next request
+    client.write("POST /data HTTP/1.1\r\nContent-Length: 7\r\n\r\npayload");
+    resp = client.readResponse();
+    BOOST_CHECK_EQUAL(resp.first, 200);
+    BOOST_CHECK_EQUAL(resp.second, "POST /data payload");
+
+    client.write(get("/chunked"));
+    resp = client.readResponse();
+    BOOST_CHECK_EQUAL(resp.first, 200);
+    BOOST_CHECK_EQUAL(resp.second, "hello world");
+
+    client.write(get("/after"));
+    resp = client.readResponse();
+    BOOST_CHECK_EQUAL(resp.second, "GET /after");
+
+    // A request split across several packets
+    std::string req = get("/split");
+    for (char c: req) {
+        client.write(std::string(1, c));
+    }
+    resp = client.readResponse();
+    BOOST_CHECK_EQUAL(resp.second, "GET /split");
+}
+
+BOOST_AUTO_TEST_CASE( test_port_not_shared )
+{
+    // The second endpoint must not join the first one's port through
+    // SO_REUSEPORT, but find another one
+    EchoEndpoint endpoint1, endpoint2;
+    endpoint1.bindTcp(PortRange(17000, 18000), "localhost");
+    endpoint2.bindTcp(PortRange(endpoint1.port(), 18000), "localhost");
+    BOOST_CHECK_NE(endpoint1.port(), endpoint2.port());
+
+    // Nor can it be bound to exactly that port
+    EchoEndpoint endpoint3;
+    BOOST_CHECK_THROW(endpoint3.bindTcpFixed("localhost", endpoint1.port()),
+                      MLDB::Exception);
+
+    TestClient client(endpoint2.port());
+    client.write(get("/second"));
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /second");
+}
+
+BOOST_AUTO_TEST_CASE( test_pipelining_keeps_order )
+{
+    EchoEndpoint endpoint;
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+    // The slow request is sent first, so its response must still come back
+    // before the others even though they'd be ready first.
+    TestClient client(endpoint.port());
+    client.write(get("/slow") + get("/1") + get("/2") + get("/3"));
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /slow");
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /1");
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /2");
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /3");
+}
+
+BOOST_AUTO_TEST_CASE( test_pipelining_many_requests )
+{
+    EchoEndpoint endpoint;
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+    // Far more than are allowed to be pending at once; reading is paused
+    // and resumed as they are answered, and none may be lost.
+    TestClient client(endpoint.port());
+    std::string requests = get("/slow");
+    for (unsigned i = 0;  i < 200;  ++i)
+        requests += get("/" + std::to_string(i));
+    client.write(requests);
+
+    BOOST_CHECK_EQUAL(client.readResponse().second, "GET /slow");
+    for (unsigned i = 0;  i < 200;  ++i)
+        BOOST_CHECK_EQUAL(client.readResponse().second,
+                          "GET /" + std::to_string(i));
+}
+
+BOOST_AUTO_TEST_CASE( test_inline_requests )
+{
+    EchoEndpoint endpoint(1);
+    endpoint.isInlineRequest = [] (const HttpHeader & header)
+        {
+            return header.resource == "/inline";
+        };
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+    TestClient client(endpoint.port());
+    for (unsigned i = 0;  i < 10;  ++i) {
+        client.write(get("/inline"));
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /inline");
+    }
+
+    // Only the single reactor thread handled them
+    BOOST_CHECK_EQUAL(endpoint.threads.size(), 1);
+
+    for (unsigned i = 0;  i < 10;  ++i) {
+        client.write(get("/offloaded"));
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /offloaded");
+    }
+    BOOST_CHECK_GT(endpoint.threads.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_errors_and_close )
+{
+    EchoEndpoint endpoint;
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+    {
+        // Exceptions in the handler give a 400 and close the connection
+        TestClient client(endpoint.port());
+        client.write(get("/throw"));
+        auto resp = client.readResponse();
+        BOOST_CHECK_EQUAL(resp.first, 400);
+        BOOST_CHECK(resp.second.find("handler threw") != std::string::npos);
+        BOOST_CHECK(client.isClosed());
+    }
+
+    {
+        // Connection: close is honoured after the response
+        TestClient client(endpoint.port());
+        client.write("GET /bye HTTP/1.1\r\nConnection: close\r\n\r\n");
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /bye");
+        BOOST_CHECK(client.isClosed());
+    }
+
+    {
+        // The client closing its side still gets its responses
+        TestClient client(endpoint.port());
+        client.write(get("/a") + get("/slow"));
+        shutdown(client.fd, SHUT_WR);
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /a");
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /slow");
+        BOOST_CHECK(client.isClosed());
+    }
+
+    {
+        // Garbage is rejected
+        TestClient client(endpoint.port());
+        client.write("NOT HTTP AT ALL\r\n\r\n");
+        BOOST_CHECK_EQUAL(client.readResponse().first, 400);
+    }
+
+    {
+        // Garbage after a valid request is only rejected once the valid
+        // request has been answered
+        TestClient client(endpoint.port());
+        client.write(get("/slow") + "NOT HTTP AT ALL\r\n\r\n");
+        BOOST_CHECK_EQUAL(client.readResponse().second, "GET /slow");
+        BOOST_CHECK_EQUAL(client.readResponse().first, 400);
+        BOOST_CHECK(client.isClosed());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_clients )
+{
+    EchoEndpoint endpoint(4);
+    endpoint.bindTcp(PortRange(17000, 18000), "localhost");
+
+    std::atomic<int> errors(0);
+    auto runClient = [&] (int clientNum)
+        {
+            TestClient client(endpoint.port());
+            for (int i = 0;  i < 200;  ++i) {
+                std::string resource = "/" + std::to_string(clientNum)
+                    + "/" + std::to_string(i);
+                client.write(get(resource));
+                if (client.readResponse().second != "GET " + resource)
+                    ++errors;
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 16;  ++i)
+        threads.emplace_back(runClient, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+
+    endpoint.shutdown();
+    BOOST_CHECK_EQUAL(endpoint.port(), -1);
+}
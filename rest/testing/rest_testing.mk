@@ -35,3 +35,5 @@ $(eval $(call test,rest_service_endpoint_test,rest,boost manual))
 $(eval $(call test,rest_request_router_test,rest,boost))
 $(eval $(call test,rest_request_binding_test,rest,boost))
 
+$(eval $(call test,http_reactor_test,rest,boost))
+$(eval $(call test,http_reactor_load_test,rest,boost manual))
@@ -13,6 +13,7 @@
 #include "mldb/http/http_rest_proxy.h"
 #include "mldb/engine/credential_collection.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/uri_read_cache.h"
 #include "mldb/utils/config.h"
 #include "mldb/credentials/credential_provider.h"
 #include "mldb/credentials/credentials.h"
@@ -85,6 +86,7 @@ int main(int argc, char ** argv)
     options_description plugin_options("Plugin options");
 
     int numThreads(16);
+    int numReactors(0);
     // Defaults for operational characteristics
     string httpListenPort = "11700-18000";
     string httpListenHost = "0.0.0.0";
@@ -92,6 +94,7 @@ int main(int argc, char ** argv)
     bool dontExitAfterScript = false;
 
     string cacheDir;
+    size_t remoteCacheSizeMb = 0;
     string httpBaseUrl = "";
 
 #if 0
@@ -129,6 +132,9 @@ int main(int argc, char ** argv)
          "Base path in etcd")
 #endif
         ("num-threads,t", value(&numThreads), "Number of HTTP worker threads")
+        ("http-reactors", value(&numReactors),
+         "Number of epoll reactor threads serving HTTP, each with its own "
+         "listening socket; 0 uses the shared event loop")
         ("http-listen-port,p",
          value(&httpListenPort)->default_value(httpListenPort),
          "Port to listen on for HTTP")
@@ -143,6 +149,11 @@ int main(int argc, char ** argv)
          "directory to serve documentation from")
         ("cache-dir", value(&cacheDir),
          "Cache directory to memory map large files and store downloads")
+        ("remote-cache-size-mb",
+         value(&remoteCacheSizeMb)->default_value(remoteCacheSizeMb),
+         "Keep copies of remote files that are read in the cache "
+         "directory, up to this size in megabytes; 0 (the default) "
+         "disables caching remote files")
 
 #if 0
         ("peer-listen-port,l",
@@ -325,6 +336,13 @@ int main(int argc, char ** argv)
         // Set up the SSD cache, if configured
         if (!cacheDir.empty()) {
             server.setCacheDirectory(cacheDir);
+
+            // Remote objects that are read are kept in the cache too
+            if (remoteCacheSizeMb > 0) {
+                setUriReadCache(std::make_shared<UriReadCache>
+                                (cacheDir + "/remote",
+                                 remoteCacheSizeMb * 1000000));
+            }
         }
 
         // Scan each of our plugin directories
@@ -333,10 +351,18 @@ int main(int argc, char ** argv)
         }
     }
 
+    if (numReactors > 0) {
+        // Every request, including function applications, goes to the
+        // worker threads: a function can run queries or plugin code that
+        // blocks for arbitrarily long, which would stall all of the other
+        // connections on its reactor.
+        server.useReactors(numReactors, numThreads);
+    }
+
+    server.allowAllOrigins();
     server.httpBoundAddress = server.bindTcp(httpListenPort, httpListenHost);
     server.router.addAutodocRoute("/autodoc", "/v1/help", "autodoc");
     server.threadPool->ensureThreads(numThreads);
-    server.httpEndpoint->allowAllOrigins();
 
     server.start();
 
@@ -454,6 +454,8 @@ shutdown()
 
     types.reset();
 
+    clearAttachments();
+
     // Graphite logging: just log a message bracketing service shutdown
     recordHit("serviceStopped");
 }
@@ -341,6 +341,14 @@ struct CellValue {
     */
     CellValueHash hash() const;
 
+    /** Put the hash() of each of the n values into hashes.  This is faster
+        than calling hash() in a loop over a large array, as the long
+        strings of the following values (and their cached hashes) are
+        prefetched while the current one is hashed.
+    */
+    static void hashBatch(const CellValue * values, size_t n,
+                          CellValueHash * hashes);
+
     operator CellValueHash() const
     {
         return this->hash();
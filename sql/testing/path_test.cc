@@ -13,6 +13,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/ext/cityhash/src/city.h"
 #include <set>
 #include <unordered_set>
 
@@ -403,3 +404,33 @@ BOOST_AUTO_TEST_CASE(test_null)
     BOOST_CHECK_THROW(p + null, MLDB::Exception); // path - pe, null rhs
     BOOST_CHECK_THROW(p + std::move(null), MLDB::Exception); // path - moved pe, null rhs
 }
+
+BOOST_AUTO_TEST_CASE(test_hash_batch)
+{
+    // Elements of every length up to past the inline hashing, which must
+    // give the same hash as CityHash64
+    std::vector<PathElement> elements;
+    std::vector<Path> paths;
+    std::string str;
+    for (int i = 0;  i < 70;  ++i) {
+        PathElement el(str);
+        BOOST_CHECK_EQUAL(el.hash(), CityHash64(str.data(), str.size()));
+        elements.push_back(el);
+        paths.push_back(Path(el));
+        paths.push_back(Path(el) + PathElement("x"));
+        str += (char)('a' + (i * 7) % 26);
+    }
+    paths.push_back(Path());
+
+    std::vector<uint64_t> hashes(elements.size());
+    PathElement::hashBatch(elements.data(), elements.size(), hashes.data());
+    for (size_t i = 0;  i < elements.size();  ++i) {
+        BOOST_CHECK_EQUAL(hashes[i], elements[i].hash());
+    }
+
+    hashes.resize(paths.size());
+    Path::hashBatch(paths.data(), paths.size(), hashes.data());
+    for (size_t i = 0;  i < paths.size();  ++i) {
+        BOOST_CHECK_EQUAL(hashes[i], paths[i].hash());
+    }
+}
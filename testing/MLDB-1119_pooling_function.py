@@ -211,5 +211,141 @@ class Mldb1119(MldbUnitTest):
                 ]
         self.assertEqual(res.json(), expected)
 
+    def test_native_matches_query(self):
+        # The same embedding in a sparse dataset with a missing cell, which
+        # can't be pooled natively and so goes through the SQL query
+        ds = mldb.create_dataset({'type': 'sparse.mutable',
+                                  'id': 'sparseEmbedding'})
+        now = datetime.datetime.strptime('Jun 1 2005  1:33PM',
+                                         '%b %d %Y %I:%M%p')
+        ds.record_row("allo", [["x", 0.2, now], ["y", 0, now]])
+        ds.record_row("mon",  [["x", 0.8, now], ["y", 0.95, now]])
+        ds.record_row("beau", [["x", 0.4, now], ["y", 0.01, now]])
+        ds.record_row("coco", [["x", 0, now],   ["y", 0.5, now]])
+        ds.record_row("sparse", [["x", 1, now]])
+        ds.commit()
+
+        for name, dataset in [('native', 'wordEmbedding'),
+                              ('query', 'sparseEmbedding')]:
+            mldb.put("/v1/functions/pool_" + name, {
+                "type": "pooling",
+                "params": {
+                    "embeddingDataset": dataset,
+                    "aggregators": ["sum", "avg", "min", "max"]
+                }
+            })
+
+        native = mldb.query(
+            "select pool_native({words: {*}})[embedding] as e "
+            "from bag_o_words order by rowName()")
+        query = mldb.query(
+            "select pool_query({words: {*}})[embedding] as e "
+            "from bag_o_words order by rowName()")
+
+        # The column order of the two datasets may differ
+        self.assertEqual(len(native), len(query))
+        for n, q in zip(native[1:], query[1:]):
+            self.assertEqual(n[0], q[0])
+            for a, b in zip(sorted(n[1:]), sorted(q[1:])):
+                self.assertAlmostEqual(a, b, places=6)
+
+        # doc2 is allo, mon, beau
+        doc2 = native[2]
+        self.assertEqual(doc2[0], 'doc2')
+        self.assertAlmostEqual(doc2[1], 1.4, places=6)   # sum x
+        self.assertAlmostEqual(doc2[4], 0.32, places=6)  # avg y
+        self.assertAlmostEqual(doc2[5], 0.2, places=6)   # min x
+        self.assertAlmostEqual(doc2[8], 0.95, places=6)  # max y
+
+    def test_embedding_changes_are_seen(self):
+        ds = mldb.create_dataset({'type': 'embedding',
+                                  'id': 'growingEmbedding'})
+        now = datetime.datetime.strptime('Jun 1 2005  1:33PM',
+                                         '%b %d %Y %I:%M%p')
+        ds.record_row("allo", [["x", 1, now], ["y", 2, now]])
+        ds.commit()
+
+        mldb.put("/v1/functions/pool_growing", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "growingEmbedding",
+                "aggregators": ["sum"]
+            }
+        })
+
+        def pooled():
+            return mldb.query(
+                "select pool_growing({words: {allo: 1, coco: 1}})[embedding] "
+                "as e")[1][1:]
+
+        self.assertEqual(pooled(), [1, 2])
+
+        ds.record_row("coco", [["x", 10, now], ["y", 20, now]])
+        ds.commit()
+
+        self.assertEqual(pooled(), [11, 22])
+
+    def test_embedding_changes_are_seen_by_route(self):
+        # The /application route keeps its bound function between calls
+        ds = mldb.create_dataset({'type': 'embedding',
+                                  'id': 'routeEmbedding'})
+        now = datetime.datetime.strptime('Jun 1 2005  1:33PM',
+                                         '%b %d %Y %I:%M%p')
+        ds.record_row("allo", [["x", 1, now], ["y", 2, now]])
+        ds.commit()
+
+        mldb.put("/v1/functions/pool_route", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "routeEmbedding",
+                "aggregators": ["sum"]
+            }
+        })
+
+        def pooled():
+            res = mldb.get("/v1/functions/pool_route/application",
+                           input={"words": {"allo": 1, "coco": 1}},
+                           outputFormat="json").json()
+            return res["embedding"]
+
+        self.assertEqual(pooled(), [1, 2])
+
+        ds.record_row("coco", [["x", 10, now], ["y", 20, now]])
+        ds.commit()
+
+        self.assertEqual(pooled(), [11, 22])
+
+    def test_updates_in_place_are_seen(self):
+        # Same number of rows and columns before and after the update
+        ds = mldb.create_dataset({'type': 'sparse.mutable',
+                                  'id': 'updatedEmbedding'})
+        then = datetime.datetime.strptime('Jun 1 2005  1:33PM',
+                                          '%b %d %Y %I:%M%p')
+        later = datetime.datetime.strptime('Jun 2 2005  1:33PM',
+                                           '%b %d %Y %I:%M%p')
+        ds.record_row("allo", [["x", 1, then], ["y", 2, then]])
+        ds.record_row("coco", [["x", 10, then], ["y", 20, then]])
+        ds.commit()
+
+        mldb.put("/v1/functions/pool_updated", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "updatedEmbedding",
+                "aggregators": ["sum"]
+            }
+        })
+
+        def pooled():
+            return mldb.query(
+                "select pool_updated({words: {allo: 1}})[embedding] "
+                "as e")[1][1:]
+
+        self.assertEqual(pooled(), [1, 2])
+
+        ds.record_row("allo", [["x", 5, later]])
+        ds.commit()
+
+        self.assertNotEqual(pooled(), [1, 2])
+
 mldb.run_tests()
 
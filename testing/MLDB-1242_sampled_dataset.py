@@ -168,6 +168,66 @@ class SampledDatasetTest(unittest.TestCase):
             SELECT COLUMN EXPR (AS columnName() ORDER BY rowCount() DESC)
             FROM test_sampled_over_merged_sampled""")
 
+    def get_sample(self, **params):
+        params['dataset'] = 'toy'
+        mldb.put('/v1/datasets/streamed', {
+            'type' : 'sampled',
+            'params' : params
+        })
+        res = mldb.query('SELECT rowName() AS n FROM streamed')
+        return set(r[1] for r in res[1:])
+
+    def test_reservoir(self):
+        rows = self.get_sample(sampling='reservoir', rows=50, seed=3)
+        self.assertEqual(len(rows), 50)
+        self.assertEqual(rows, self.get_sample(sampling='reservoir',
+                                               rows=50, seed=3))
+        self.assertNotEqual(rows, self.get_sample(sampling='reservoir',
+                                                  rows=50, seed=4))
+
+        # The same rows, however the dataset is split up to be streamed
+        self.assertEqual(rows, self.get_sample(sampling='reservoir',
+                                               rows=50, seed=3, blockRows=7))
+
+        self.assertEqual(len(self.get_sample(sampling='reservoir',
+                                             fraction=0.1)), 50)
+        self.assertEqual(len(self.get_sample(sampling='reservoir',
+                                             rows=500)), 500)
+
+        with self.assertRaises(ResponseException):
+            self.get_sample(sampling='reservoir', rows=501)
+        with self.assertRaises(ResponseException):
+            self.get_sample(sampling='reservoir', rows=5,
+                            withReplacement=True)
+
+    def test_bernoulli(self):
+        rows = self.get_sample(sampling='bernoulli', fraction=0.2, seed=3)
+        self.assertGreater(len(rows), 50)
+        self.assertLess(len(rows), 150)
+        self.assertEqual(rows, self.get_sample(sampling='bernoulli',
+                                               fraction=0.2, seed=3,
+                                               blockRows=13))
+
+        # A larger fraction keeps a superset of the rows
+        more = self.get_sample(sampling='bernoulli', fraction=0.4, seed=3)
+        self.assertTrue(rows <= more)
+
+        self.assertEqual(len(self.get_sample(sampling='bernoulli',
+                                             fraction=1)), 500)
+
+    def test_block(self):
+        rows = self.get_sample(sampling='block', rows=45, blockRows=10,
+                               seed=3)
+        self.assertEqual(len(rows), 50)
+
+        rows = self.get_sample(sampling='block', fraction=0.001,
+                               blockRows=10, seed=3)
+        self.assertEqual(len(rows), 10)
+
+        res = mldb.query("select count(*) from sample(toy, "
+                         "{fraction: 0.5, sampling: 'block', seed: 1})")
+        self.assertGreater(res[1][1], 0)
+
     def test_cant_create_wo_ds(self):
         # MLDB-1977
         msg = "You need to define the dataset key"
@@ -85,5 +85,45 @@ var expected3 = [
 
 unittest.assertEqual(res3.json, expected3, "undefined output of JS function");
 
+// Embeddings passed to parameters named with [] are typed arrays
+
+var query4 = "SELECT jseval('return (v instanceof Float64Array) + '','' + v.length + '','' + (v[0] + v[1])', 'v[]', [x, y]) AS res from test order by rowName()";
+
+var expected4 = [
+   [ "_rowName", "res" ],
+   [ "ex1", "true,2,3" ],
+   [ "ex2", "true,2,3" ],
+   [ "ex3", "true,2,3" ],
+   [ "ex4", "true,2,3" ]
+];
+
+// Run twice, the second time using the cached compiled function
+for (var i = 0;  i < 2;  ++i) {
+    var res4 = mldb.get("/v1/query", { q: query4, format: 'table' });
+    plugin.log(res4);
+    unittest.assertEqual(res4.json, expected4, "typed array input to JS function");
+}
+
+// Embeddings that aren't numeric are passed with the generic conversion
+
+var query5 = "SELECT jseval('return (v instanceof Float64Array) + '','' + v.length', 'v[]', ['a', x]) AS res from test order by rowName() limit 1";
+
+var res5 = mldb.get("/v1/query", { q: query5, format: 'table' });
+plugin.log(res5);
+unittest.assertEqual(res5.json, [ [ "_rowName", "res" ], [ "ex1", "false,2" ] ],
+                     "non-numeric embedding input to JS function");
+
+// Globals set by a function are not seen when the cached function is used
+// again by another query
+
+var query6 = "SELECT jseval('var r = typeof seen;  seen = 1;  return r', '') AS res";
+
+for (var i = 0;  i < 2;  ++i) {
+    var res6 = mldb.get("/v1/query", { q: query6, format: 'table' });
+    plugin.log(res6);
+    unittest.assertEqual(res6.json, [ [ "_rowName", "res" ], [ "result", "undefined" ] ],
+                         "globals of JS function are reset between queries");
+}
+
 
 "success"
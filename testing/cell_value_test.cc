@@ -521,3 +521,22 @@ BOOST_AUTO_TEST_CASE (test_sorting_absolute_order)
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_hash_batch)
+{
+    std::vector<CellValue> vals = {
+        CellValue(), 1, -1, 1.5, "short", "a string too long to be internal",
+        CellValue::blob(std::string(100, 'x')), Date::fromSecondsSinceEpoch(1),
+        CellValue(Path("x") + PathElement("y"))
+    };
+    for (int i = 0;  i < 50;  ++i) {
+        vals.push_back("string number " + std::to_string(i)
+                       + " of the batch test");
+    }
+
+    std::vector<CellValueHash> hashes(vals.size());
+    CellValue::hashBatch(vals.data(), vals.size(), hashes.data());
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        BOOST_CHECK(hashes[i] == vals[i].hash());
+    }
+}
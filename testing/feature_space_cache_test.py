@@ -0,0 +1,226 @@
+#
+# feature_space_cache_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test that classifiers trained from a cached feature space are the same as
+# those trained from scratch, and that the cache follows the dataset.
+#
+
+import os
+import random
+import shutil
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class FeatureSpaceCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(12)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(500):
+            x = random.random()
+            y = random.random()
+            color = random.choice(['red', 'green', 'blue'])
+            label = x + y + (0.5 if color == 'red' else 0) > 1.2
+            ds.record_row('row%d' % i, [['x', x, 0], ['y', y, 0],
+                                        ['color', color, 0],
+                                        ['label', label, 0]])
+        ds.commit()
+
+    def setUp(self):
+        self.cache_dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+
+    def tearDown(self):
+        shutil.rmtree(self.cache_dir)
+
+    def cache_files(self):
+        return sorted(f for f in os.listdir(self.cache_dir)
+                      if f.endswith('.fs.zip'))
+
+    def train_forest(self, name):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'modelFileUrl' : 'file://tmp/fs_cache_%s.cls' % name,
+                'featureCacheUrl' : 'file://' + self.cache_dir,
+                'functionName' : name,
+                'featureVectorSamplings' : 2,
+                'featureSamplings' : 2,
+                'runOnCreation' : True
+            }
+        })
+
+    def train_classifier(self, name):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'algorithm' : 'dt',
+                'configuration' : {
+                    'dt' : { 'type' : 'decision_tree', 'max_depth' : 4 }
+                },
+                'modelFileUrl' : 'file://tmp/fs_cache_%s.cls' % name,
+                'featureCacheUrl' : 'file://' + self.cache_dir,
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        })
+
+    def scores(self, function):
+        return mldb.query("""
+            SELECT {}({{features: {{x, y, color}}}})[score] AS score
+            FROM ds ORDER BY rowName()
+        """.format(function))
+
+    def test_forest(self):
+        self.train_forest('rf1')
+        self.assertEqual(len(self.cache_files()), 1)
+
+        # Served from memory
+        self.train_forest('rf2')
+        self.assertEqual(len(self.cache_files()), 1)
+        self.assertTableResultEquals(self.scores('rf2'), self.scores('rf1'))
+
+        # A different set of columns is a different entry
+        mldb.put('/v1/procedures/rf3', {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : "SELECT {x, y} AS features, label FROM ds",
+                'modelFileUrl' : 'file://tmp/fs_cache_rf3.cls',
+                'featureCacheUrl' : 'file://' + self.cache_dir,
+                'runOnCreation' : True
+            }
+        })
+        self.assertEqual(len(self.cache_files()), 2)
+
+    def test_classifier(self):
+        self.train_classifier('cls1')
+        self.assertEqual(len(self.cache_files()), 1)
+        self.train_classifier('cls2')
+        self.assertEqual(len(self.cache_files()), 1)
+        self.assertTableResultEquals(self.scores('cls2'),
+                                     self.scores('cls1'))
+
+    def test_dataset_changes(self):
+        mldb.put('/v1/datasets/changing', {'type' : 'sparse.mutable'})
+        mldb.post('/v1/datasets/changing/rows', {
+            'rowName' : 'a', 'columns' : [['x', 1, 0], ['label', True, 0]]
+        })
+        mldb.post('/v1/datasets/changing/rows', {
+            'rowName' : 'b', 'columns' : [['x', 2, 0], ['label', False, 0]]
+        })
+        mldb.post('/v1/datasets/changing/commit')
+
+        config = {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' :
+                    "SELECT {x} AS features, label FROM changing",
+                'modelFileUrl' : 'file://tmp/fs_cache_changing.cls',
+                'featureCacheUrl' : 'file://' + self.cache_dir,
+                'runOnCreation' : True
+            }
+        }
+        mldb.put('/v1/procedures/changing', config)
+        self.assertEqual(len(self.cache_files()), 1)
+
+        # Recording more data changes the version, so the features are
+        # extracted again
+        mldb.post('/v1/datasets/changing/rows', {
+            'rowName' : 'c', 'columns' : [['x', 3, 0], ['label', True, 0]]
+        })
+        mldb.post('/v1/datasets/changing/commit')
+        mldb.put('/v1/procedures/changing', config)
+        self.assertEqual(len(self.cache_files()), 2)
+
+    def test_dataset_replaced(self):
+        # A dataset deleted and created again with the same name, config
+        # and shape but other values must not reuse the cached features
+        def create(flip):
+            mldb.put('/v1/datasets/replaced', {'type' : 'sparse.mutable'})
+            for i in range(50):
+                label = (i % 2 == 0) != flip
+                mldb.post('/v1/datasets/replaced/rows', {
+                    'rowName' : 'r%d' % i,
+                    'columns' : [['x', i if flip else -i, 0],
+                                 ['label', label, 0]]
+                })
+            mldb.post('/v1/datasets/replaced/commit')
+
+        def train(name):
+            mldb.put('/v1/procedures/' + name, {
+                'type' : 'randomforest.binary.train',
+                'params' : {
+                    'trainingData' :
+                        "SELECT {x} AS features, label FROM replaced",
+                    'modelFileUrl' : 'file://tmp/fs_cache_%s.cls' % name,
+                    'featureCacheUrl' : 'file://' + self.cache_dir,
+                    'functionName' : name,
+                    'runOnCreation' : True
+                }
+            })
+
+        def scores(function):
+            return mldb.query("""
+                SELECT {}({{features: {{x}}}})[score] AS score
+                FROM replaced ORDER BY rowName()
+            """.format(function))
+
+        create(False)
+        train('replaced1')
+        mldb.delete('/v1/datasets/replaced')
+        create(True)
+        train('replaced2')
+
+        # Same as a forest trained without the cache
+        mldb.put('/v1/procedures/replaced3', {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' :
+                    "SELECT {x} AS features, label FROM replaced",
+                'modelFileUrl' : 'file://tmp/fs_cache_replaced3.cls',
+                'functionName' : 'replaced3',
+                'runOnCreation' : True
+            }
+        })
+        self.assertTableResultEquals(scores('replaced2'),
+                                     scores('replaced3'))
+
+    def test_untracked_dataset(self):
+        # A merged dataset can't tell when its contents change, so nothing
+        # is cached for it
+        mldb.put('/v1/procedures/untracked', {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y} AS features, label FROM merge(ds, ds)
+                """,
+                'modelFileUrl' : 'file://tmp/fs_cache_untracked.cls',
+                'featureCacheUrl' : 'file://' + self.cache_dir,
+                'runOnCreation' : True
+            }
+        })
+        self.assertEqual(len(self.cache_files()), 0)
+
+    def test_bad_cache_url(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/procedures/bad', {
+                'type' : 'randomforest.binary.train',
+                'params' : {
+                    'trainingData' :
+                        "SELECT {x, y} AS features, label FROM ds",
+                    'modelFileUrl' : 'file://tmp/fs_cache_bad.cls',
+                    'featureCacheUrl' : 's3://bucket/dir',
+                    'runOnCreation' : True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,214 @@
+#
+# fetcher-async.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of the asynchronous mode and the response cache of the fetcher
+# function, against a local HTTP server.
+#
+import subprocess
+import time
+import prctl
+import signal
+import os
+from socket import socket
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class FetcherAsyncTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        s = socket()
+        s.bind(('', 0))
+        cls.port = s.getsockname()[1]
+        s.close()
+
+        def pre_exec():
+            # new process group - all our child will be in that group
+            prctl.set_pdeathsig(signal.SIGTERM)
+            os.setpgid(0, 0)
+
+        cls.proc = subprocess.Popen(['/usr/bin/env', 'python',
+                                     'mldb/testing/test_server.py',
+                                     str(cls.port)],
+                                    preexec_fn=pre_exec)
+
+        mldb.put('/v1/functions/async_fetch', {
+            'type': 'fetcher',
+            'params': {
+                'async': True
+            }
+        })
+
+        for _ in range(10):
+            time.sleep(1)
+            res = mldb.query("SELECT async_fetch({{url: '{}'}})[error]"
+                             .format(cls.url('/200')))
+            if res[1][1] is None:
+                # test server ready
+                break
+        else:
+            raise RuntimeError("Failed to connect to test server")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.proc.terminate()
+
+    @classmethod
+    def url(cls, path):
+        return 'http://localhost:{}{}'.format(cls.port, path)
+
+    def fetch(self, function, path):
+        res = mldb.query(
+            "SELECT CAST ({}({{url: '{}'}})[content] AS STRING) AS content, "
+            "{}({{url: '{}'}})[error] AS error"
+            .format(function, self.url(path), function, self.url(path)))
+        return res[1][1:]
+
+    def test_content_and_error(self):
+        self.assertEqual(self.fetch('async_fetch', '/200'),
+                         ['<html><body><h1>status 200</h1></body></html>',
+                          None])
+
+        content, error = self.fetch('async_fetch', '/404')
+        self.assertTrue(content is None)
+        self.assertIn('HTTP code 404', error)
+
+        # Schemes other than http fall back to the synchronous path
+        res = mldb.query("SELECT async_fetch({url: "
+                         "'file://foo/bar/forthewin.txt'}) AS *")
+        self.assertTrue(res[1][1] is None)
+        self.assertTrue(type(res[1][2]) is str)
+
+    def test_same_as_sync(self):
+        mldb.put('/v1/functions/sync_fetch', { 'type': 'fetcher' })
+
+        # Redirections are followed, and only a 200 is a success
+        for path in ['/200', '/redirect/200', '/redirect/redirect/200',
+                     '/204', '/redirect/404', '/500']:
+            sync_content, sync_error = self.fetch('sync_fetch', path)
+            content, error = self.fetch('async_fetch', path)
+            self.assertEqual(content, sync_content, path)
+            self.assertEqual(error is None, sync_error is None, path)
+
+        self.assertEqual(self.fetch('async_fetch', '/redirect/200')[0],
+                         '<html><body><h1>status 200</h1></body></html>')
+
+        content, error = self.fetch('async_fetch', '/infinite_redirect')
+        self.assertTrue(content is None)
+        self.assertIn('redirect', error)
+
+    def test_many_rows(self):
+        ds = mldb.create_dataset({
+            'id' : 'fetcher_async_test',
+            'type' : 'sparse.mutable'
+        })
+        for i in range(20):
+            ds.record_row('r{}'.format(i),
+                          [['f', self.url('/{}'.format(200 + i % 2 * 204)),
+                            0]])
+        ds.commit()
+
+        res = mldb.query(
+            "SELECT CAST (async_fetch({url: f})[content] AS STRING) "
+            "AS content, async_fetch({url: f})[error] AS error "
+            "FROM fetcher_async_test ORDER BY rowName()")
+        self.assertEqual(len(res), 21)
+        for row in res[1:]:
+            if int(row[0][1:]) % 2 == 0:
+                self.assertEqual(
+                    row[1:],
+                    ['<html><body><h1>status 200</h1></body></html>', None])
+            else:
+                self.assertTrue(row[1] is None)
+                self.assertIn('HTTP code 404', row[2])
+
+    def test_batch(self):
+        # The whole batch is in flight at once, so it takes about as long
+        # as the slowest fetch rather than the sum of them
+        inputs = [{'url': self.url('/sleep/1')} for _ in range(20)]
+        inputs.append({'url': self.url('/404')})
+        inputs.append({'url': 'file://foo/bar/forthewin.txt'})
+
+        before = time.time()
+        res = mldb.get('/v1/functions/async_fetch/batch',
+                       input=inputs).json()
+        self.assertLess(time.time() - before, 10)
+
+        self.assertEqual(len(res), 22)
+        for output in res[:20]:
+            self.assertIsNone(output['error'])
+        self.assertIn('HTTP code 404', res[20]['error'])
+        self.assertIsNone(res[20]['content'])
+        self.assertIsNotNone(res[21]['error'])
+
+        # At most maxConcurrentFetch are in flight at once
+        mldb.put('/v1/functions/limited_fetch', {
+            'type': 'fetcher',
+            'params': {
+                'async': True,
+                'maxConcurrentFetch': 2
+            }
+        })
+        before = time.time()
+        res = mldb.get('/v1/functions/limited_fetch/batch',
+                       input=inputs[:4]).json()
+        self.assertGreaterEqual(time.time() - before, 2)
+        for output in res:
+            self.assertIsNone(output['error'])
+
+    def test_response_cache(self):
+        mldb.put('/v1/functions/cached_fetch', {
+            'type': 'fetcher',
+            'params': {
+                'async': True,
+                'responseCacheBytes': 1000000,
+                'responseCacheSeconds': 2
+            }
+        })
+
+        # Each fetch of /counter returns a new value from the server
+        first = self.fetch('async_fetch', '/counter')[0]
+        self.assertNotEqual(self.fetch('async_fetch', '/counter')[0], first)
+
+        # Until it expires, the cached value is returned
+        first = self.fetch('cached_fetch', '/counter')[0]
+        self.assertEqual(self.fetch('cached_fetch', '/counter')[0], first)
+        self.assertEqual(mldb.query(
+            "SELECT CAST (cached_fetch({{url: '{}'}})[content] AS STRING)"
+            .format(self.url('/counter').replace('localhost', 'LOCALHOST'))
+        )[1][1], first)
+
+        # Errors are not cached
+        self.assertIsNotNone(self.fetch('cached_fetch', '/404')[1])
+
+        time.sleep(3)
+        self.assertNotEqual(self.fetch('cached_fetch', '/counter')[0], first)
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/functions', {
+                'type': 'fetcher',
+                'params' : {
+                    'maxConnectionsPerHost': 0
+                }
+            })
+
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/functions', {
+                'type': 'fetcher',
+                'params' : {
+                    'timeoutSeconds': 0
+                }
+            })
+
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/functions', {
+                'type': 'fetcher',
+                'params' : {
+                    'responseCacheSeconds': 0
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,158 @@
+#
+# frozen_classifier_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test that tree ensembles saved in the frozen format give the same scores
+# as those saved in the standard format.
+#
+
+import random
+import struct
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class FrozenClassifierTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(3)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(500):
+            x = random.random()
+            y = random.random() if i % 7 else None
+            color = random.choice(['red', 'green', 'blue'])
+            label = x + (y or 0.5) + (0.5 if color == 'red' else 0) > 1.2
+            row = [['x', x, 0], ['color', color, 0], ['label', label, 0]]
+            if y is not None:
+                row.append(['y', y, 0])
+            ds.record_row('row%d' % i, row)
+        ds.commit()
+
+    def scores(self, function):
+        return mldb.query("""
+            SELECT {}({{features: {{x, y, color}}}})[score] AS score
+            FROM ds ORDER BY rowName()
+        """.format(function))
+
+    def train_forest(self, name, frozen):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'modelFileUrl' : 'file://tmp/frozen_%s.cls' % name,
+                'frozenModel' : frozen,
+                'functionName' : name,
+                'featureVectorSamplings' : 2,
+                'featureSamplings' : 3,
+                'runOnCreation' : True
+            }
+        })
+
+    def train_classifier(self, name, algorithm, config, frozen):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'algorithm' : algorithm,
+                'configuration' : { algorithm : config },
+                'modelFileUrl' : 'file://tmp/frozen_%s.cls' % name,
+                'frozenModel' : frozen,
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        })
+
+    def test_forest(self):
+        self.train_forest('rf', False)
+        self.train_forest('rf_frozen', True)
+        self.assertTableResultEquals(self.scores('rf_frozen'),
+                                     self.scores('rf'))
+
+        status = mldb.get('/v1/functions/rf_frozen').json()['status']
+        self.assertTrue(status['summary'].startswith('Frozen tree ensemble'))
+
+        # A function can be created from the frozen file directly
+        mldb.put('/v1/functions/rf_loaded', {
+            'type' : 'classifier',
+            'params' : { 'modelFileUrl' : 'file://tmp/frozen_rf_frozen.cls' }
+        })
+        self.assertTableResultEquals(self.scores('rf_loaded'),
+                                     self.scores('rf'))
+
+    def test_corrupt_nodes(self):
+        self.train_forest('rf_corrupt', True)
+        with open('tmp/frozen_rf_corrupt.cls', 'rb') as f:
+            contents = bytearray(f.read())
+
+        # Header is 40 bytes then the (offset, length) of each section;
+        # nodes are section 4, and are 24 bytes with the split operation
+        # at 8 and the children at 12
+        nodes_offset, nodes_length = \
+            struct.unpack_from('<QQ', contents, 40 + 4 * 16)
+        self.assertGreater(nodes_length, 0)
+
+        def check(value, field=12, fmt='<I'):
+            corrupt = bytearray(contents)
+            struct.pack_into(fmt, corrupt, nodes_offset + field, value)
+            with open('tmp/frozen_rf_corrupt2.cls', 'wb') as f:
+                f.write(corrupt)
+            with self.assertRaisesRegex(ResponseException, 'corrupt'):
+                mldb.put('/v1/functions/rf_corrupt_loaded', {
+                    'type' : 'classifier',
+                    'params' : {
+                        'modelFileUrl' : 'file://tmp/frozen_rf_corrupt2.cls'
+                    }
+                })
+
+        # A node that is its own child, and one past the end
+        check(0)
+        check(nodes_length // 24)
+
+        # A split operation that doesn't exist
+        check(3, field=8, fmt='<B')
+        check(255, field=8, fmt='<B')
+
+    def test_decision_tree(self):
+        config = { 'type' : 'decision_tree', 'max_depth' : 5 }
+        self.train_classifier('dt', 'dt', config, False)
+        self.train_classifier('dt_frozen', 'dt', config, True)
+        self.assertTableResultEquals(self.scores('dt_frozen'),
+                                     self.scores('dt'))
+
+    def test_bagged_trees(self):
+        config = {
+            'type' : 'bagging',
+            'num_bags' : 5,
+            'weak_learner' : { 'type' : 'decision_tree', 'max_depth' : 4 }
+        }
+        self.train_classifier('bdt', 'bdt', config, False)
+        self.train_classifier('bdt_frozen', 'bdt', config, True)
+
+        expected = self.scores('bdt')
+        actual = self.scores('bdt_frozen')
+        self.assertEqual(len(actual), len(expected))
+        for e, a in zip(expected[1:], actual[1:]):
+            self.assertEqual(e[0], a[0])
+            self.assertAlmostEqual(e[1], a[1], places=5)
+
+    def test_unsupported_classifier(self):
+        with self.assertRaisesRegex(ResponseException, 'frozen'):
+            self.train_classifier('glz', 'glz',
+                                  { 'type' : 'glz', 'verbosity' : 0 }, True)
+
+    def test_explain_not_supported(self):
+        self.train_forest('rf_explain', True)
+        with self.assertRaisesRegex(ResponseException, 'frozen'):
+            mldb.put('/v1/functions/explain', {
+                'type' : 'classifier.explain',
+                'params' : {
+                    'modelFileUrl' : 'file://tmp/frozen_rf_explain.cls'
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,110 @@
+#
+# gaussian_clustering_modes_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test the diagonal covariance and online (mini-batch) modes of gaussian
+# clustering.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class GaussianClusteringModesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put('/v1/procedures/import_iris', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                'outputDataset' : 'iris',
+                'headers' : ['sepal length', 'sepal width', 'petal length',
+                             'petal width', 'class'],
+                'runOnCreation' : True
+            }
+        })
+
+    def train(self, name, **params):
+        config = {
+            'type' : 'gaussianclustering.train',
+            'params' : {
+                'trainingData' : 'SELECT * EXCLUDING(class) FROM iris',
+                'outputDataset' : name + '_clusters',
+                'numClusters' : 3,
+                'modelFileUrl' : 'file://tmp/%s.gs' % name,
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        }
+        config['params'].update(params)
+        mldb.put('/v1/procedures/' + name, config)
+
+    def check_setosa_separated(self, name):
+        # Iris setosa is linearly separable from the other two classes, so
+        # any reasonable clustering puts it in a cluster of its own
+        res = mldb.query("""
+            SELECT cluster, class, count(*) AS num
+            FROM merge({0}_clusters, iris)
+            GROUP BY cluster, class
+        """.format(name))
+        setosa = [r for r in res[1:] if r[2] == 'Iris-setosa']
+        self.assertEqual(len(setosa), 1)
+        self.assertEqual(setosa[0][3], 50)
+        others = [r for r in res[1:]
+                  if r[1] == setosa[0][1] and r[2] != 'Iris-setosa']
+        self.assertEqual(others, [])
+
+        # The function agrees with the output dataset
+        expected = mldb.query("""
+            SELECT cluster FROM {0}_clusters ORDER BY rowName()
+        """.format(name))
+        res = mldb.query("""
+            SELECT {0}({{{{* EXCLUDING(class)}} AS embedding}})[cluster]
+                   AS cluster
+            FROM iris ORDER BY rowName()
+        """.format(name))
+        self.assertEqual([r[1] for r in res[1:]],
+                         [r[1] for r in expected[1:]])
+
+    def test_diagonal(self):
+        self.train('em_diagonal', diagonalCovariance=True)
+        self.check_setosa_separated('em_diagonal')
+
+    def test_batch(self):
+        self.train('em_batch', batchSize=16, maxIterations=20)
+        self.check_setosa_separated('em_batch')
+
+    def test_diagonal_batch(self):
+        self.train('em_diagonal_batch', diagonalCovariance=True,
+                   batchSize=32, maxIterations=20)
+        self.check_setosa_separated('em_diagonal_batch')
+
+    def test_function_from_model_file(self):
+        # A function created separately from the model file gives the same
+        # clusters as the procedure's output dataset
+        self.train('em_saved')
+        mldb.put('/v1/functions/em_loaded', {
+            'type' : 'gaussianclustering',
+            'params' : {
+                'modelFileUrl' : 'file://tmp/em_saved.gs'
+            }
+        })
+        expected = mldb.query(
+            "SELECT cluster FROM em_saved_clusters ORDER BY rowName()")
+        res = mldb.query("""
+            SELECT em_loaded({{* EXCLUDING(class)} AS embedding})[cluster]
+                   AS cluster
+            FROM iris ORDER BY rowName()
+        """)
+        self.assertEqual([r[1] for r in res[1:]],
+                         [r[1] for r in expected[1:]])
+
+        res = mldb.get('/v1/functions/em_loaded/application',
+                       input={'embedding' : [5.1, 3.5, 1.4, 0.2]}).json()
+        self.assertIn(res['output']['cluster'], [0, 1, 2])
+
+    def test_negative_batch_size(self):
+        with self.assertRaises(ResponseException):
+            self.train('em_bad', batchSize=-1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,124 @@
+#
+# lazy_joined_dataset_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test that a joined dataset with lazy evaluation gives the same rows as
+# one that is evaluated up front.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class LazyJoinedDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'a', 'type' : 'sparse.mutable'})
+        ds.record_row('row1', [['k', 1, 0], ['x', 10, 0]])
+        ds.record_row('row2', [['k', 2, 0], ['x', 20, 0]])
+        ds.record_row('row3', [['k', 2, 0], ['x', 30, 0]])
+        ds.record_row('row4', [['k', 4, 0], ['x', 40, 0]])
+        ds.record_row('row5', [['x', 50, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'b', 'type' : 'sparse.mutable'})
+        ds.record_row('row1', [['k', 1, 0], ['y', 'one', 0]])
+        ds.record_row('row2', [['k', 2, 0], ['y', 'two', 0]])
+        ds.record_row('row3', [['k', 2, 0], ['y', 'deux', 0]])
+        ds.record_row('row4', [['k', 3, 0], ['y', 'three', 0]])
+        ds.record_row('weird]-[name', [['k', 4, 0], ['y', 'four', 0]])
+        ds.commit()
+
+    def create_joined(self, name, qualification, on, lazy,
+                      left='a', right='b'):
+        mldb.put('/v1/datasets/' + name, {
+            'type' : 'joined',
+            'params' : {
+                'left' : left,
+                'right' : right,
+                'on' : on,
+                'qualification' : qualification,
+                'lazy' : lazy
+            }
+        })
+
+    def assert_same_join(self, qualification, on, left='a', right='b'):
+        self.create_joined('eager', qualification, on, False, left, right)
+        self.create_joined('lazy', qualification, on, True, left, right)
+
+        query = 'SELECT * FROM {} ORDER BY rowName()'
+        expected = mldb.query(query.format('eager'))
+        self.assertTableResultEquals(mldb.query(query.format('lazy')),
+                                     expected)
+
+        # Look each row up by name, which probes the sides directly
+        for row in expected[1:]:
+            res = mldb.query("SELECT * FROM lazy WHERE rowName() = '{}'"
+                             .format(row[0].replace("'", "''")))
+            self.assertEqual(len(res), 2, row[0])
+            self.assertEqual(res[1][0], row[0])
+
+        count = 'SELECT count(*) AS cnt FROM {}'
+        self.assertTableResultEquals(mldb.query(count.format('lazy')),
+                                     mldb.query(count.format('eager')))
+
+        mldb.delete('/v1/datasets/eager')
+        mldb.delete('/v1/datasets/lazy')
+
+    def test_inner(self):
+        self.assert_same_join('JOIN_INNER', 'a.k = b.k')
+
+    def test_left(self):
+        self.assert_same_join('JOIN_LEFT', 'a.k = b.k')
+
+    def test_right(self):
+        self.assert_same_join('JOIN_RIGHT', 'a.k = b.k')
+
+    def test_full(self):
+        self.assert_same_join('JOIN_FULL', 'a.k = b.k')
+
+    def test_side_conditions(self):
+        self.assert_same_join('JOIN_FULL', 'a.k = b.k AND a.x > 10')
+        self.assert_same_join('JOIN_LEFT', 'a.k = b.k AND b.y != \'two\'')
+
+    def test_key_expressions(self):
+        # Keys that aren't a plain column are evaluated row by row
+        self.assert_same_join('JOIN_INNER', 'a.k + 1 = b.k')
+        self.assert_same_join('JOIN_FULL', 'a.k = b.k - 1')
+
+    def test_key_with_several_values(self):
+        # Only the latest value of a key column is joined on
+        ds = mldb.create_dataset({'id' : 'c', 'type' : 'sparse.mutable'})
+        ds.record_row('row1', [['k', 4, 0], ['k', 1, 1], ['z', 1, 0]])
+        ds.record_row('row2', [['k', 1, 1], ['k', 3, 2], ['z', 2, 0]])
+        ds.commit()
+        self.assert_same_join('JOIN_FULL', 'c.k = b.k', left='c')
+        self.assert_same_join('JOIN_FULL', 'a.k = c.k', right='c')
+        mldb.delete('/v1/datasets/c')
+
+    def test_cross(self):
+        self.assert_same_join('JOIN_INNER', 'true')
+
+    def test_chained(self):
+        self.assert_same_join('JOIN_LEFT', 'a.k = c.k',
+                              left='a JOIN b ON a.k = b.k',
+                              right='b AS c')
+
+    def test_side_row_names(self):
+        self.create_joined('lazy', 'JOIN_LEFT', 'a.k = b.k', True)
+        res = mldb.query("""
+            SELECT leftRowName() AS l, rightRowName() AS r FROM lazy
+            WHERE rowName() = '[row4]-[weird]-[name]'""")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'l', 'r'],
+            ['[row4]-[weird]-[name]', 'row4', 'weird]-[name']
+        ])
+
+        # Rows that don't make part of the join aren't found
+        res = mldb.query("""
+            SELECT * FROM lazy WHERE rowName() = '[row1]-[row2]'""")
+        self.assertEqual(len(res), 1)
+
+        mldb.delete('/v1/datasets/lazy')
+
+if __name__ == '__main__':
+    mldb.run_tests()
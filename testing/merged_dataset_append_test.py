@@ -0,0 +1,109 @@
+#
+# merged_dataset_append_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test that datasets appended to a merge give the same result as merging
+# them all up front, including when the merge has sub-merges.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_DATASETS = 70
+
+class MergedDatasetAppendTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # One dataset per day; each has some rows of its own and one that's
+        # shared with all of the others.
+        for i in range(NUM_DATASETS):
+            ds = mldb.create_dataset({'id' : 'day{}'.format(i),
+                                      'type' : 'sparse.mutable'})
+            for j in range(i % 3 + 1):
+                ds.record_row('row{}_{}'.format(i, j),
+                              [['day{}'.format(i), j, 0], ['x', i, 0]])
+            ds.record_row('shared', [['day{}'.format(i), i, 0]])
+            ds.commit()
+
+    def create_merged(self, name, num):
+        mldb.put('/v1/datasets/' + name, {
+            'type' : 'merged',
+            'params' : {
+                'datasets' : [{'id' : 'day{}'.format(i)} for i in range(num)]
+            }
+        })
+
+    def assert_same(self, query, expected='expected', actual='appended'):
+        self.assertTableResultEquals(
+            mldb.query(query.format(actual)),
+            mldb.query(query.format(expected)))
+
+    def check_append(self, start):
+        self.create_merged('appended', start)
+        for i in range(start, NUM_DATASETS):
+            mldb.post('/v1/datasets/appended/routes/datasets', {
+                'dataset' : {'id' : 'day{}'.format(i)}
+            })
+
+        self.create_merged('expected', NUM_DATASETS)
+
+        self.assert_same('SELECT * FROM {} ORDER BY rowName()')
+        self.assert_same('SELECT day{} FROM {{}} ORDER BY rowName()'
+                         .format(NUM_DATASETS - 1))
+        self.assert_same('SELECT count(*) AS cnt, sum(x) AS x FROM {}')
+        self.assert_same("SELECT * FROM {} WHERE rowName() = 'shared'")
+
+        mldb.delete('/v1/datasets/appended')
+        mldb.delete('/v1/datasets/expected')
+
+    def test_append_direct(self):
+        # Everything fits without any sub-merges
+        self.check_append(NUM_DATASETS - 20)
+
+    def test_append_to_sub_merge(self):
+        # The appended datasets go into the sub-merges
+        self.check_append(40)
+
+    def test_append_from_one(self):
+        # Many appends in a row, which will eventually fill the tree
+        self.check_append(1)
+
+    def test_append_status(self):
+        self.create_merged('appended', 2)
+        mldb.post('/v1/datasets/appended/routes/datasets', {
+            'dataset' : {'id' : 'day2'}
+        })
+        res = mldb.get('/v1/datasets/appended').json()
+        config = res['config']
+        status = res['status']
+
+        # The configuration is left as it was created
+        self.assertEqual([d['id'] for d in config['params']['datasets']],
+                         ['day0', 'day1'])
+        self.assertEqual([d['id'] for d in status['appendedDatasets']],
+                         ['day2'])
+        self.assertEqual(len(status['datasets']), 3)
+
+        # Re-creating it with the appended datasets gives the same merge
+        mldb.put('/v1/datasets/expected', {
+            'type' : 'merged',
+            'params' : {
+                'datasets' : config['params']['datasets']
+                             + status['appendedDatasets']
+            }
+        })
+        self.assert_same('SELECT * FROM {} ORDER BY rowName()')
+
+        mldb.delete('/v1/datasets/appended')
+        mldb.delete('/v1/datasets/expected')
+
+    def test_append_unknown(self):
+        self.create_merged('appended', 2)
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/datasets/appended/routes/datasets', {
+                'dataset' : {'id' : 'does_not_exist'}
+            })
+        mldb.delete('/v1/datasets/appended')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,158 @@
+#
+# prepared_function_application_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of the /prepared route for applying functions to positional inputs.
+#
+import requests
+import struct
+
+from mldb import mldb, MldbUnitTest, ResponseException
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+class PreparedFunctionApplicationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put('/v1/functions/score', {
+            'type': 'sql.expression',
+            'params': {
+                'expression': 'x * 2 AS doubled, x + y AS sum'
+            }
+        })
+
+    def test_json_query_string(self):
+        res = mldb.get('/v1/functions/score/prepared',
+                       inputNames='x,y', input=[2, 3])
+        self.assertEqual(res.json(), {'doubled': 4, 'sum': 5})
+
+        # Same result as the generic route
+        res2 = mldb.get('/v1/functions/score/application',
+                        input={'x': 2, 'y': 3}, outputFormat='json')
+        self.assertEqual(res.json(), res2.json())
+
+    def test_names_as_json_and_order(self):
+        res = mldb.get('/v1/functions/score/prepared',
+                       inputNames=['y', 'x'], input=[3, 2])
+        self.assertEqual(res.json(), {'doubled': 4, 'sum': 5})
+
+    def test_json_body(self):
+        r = requests.post(url + '/v1/functions/score/prepared?inputNames=x,y',
+                          data='[10, 1]')
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), {'doubled': 20, 'sum': 11})
+
+    def test_binary(self):
+        r = requests.post(url + '/v1/functions/score/prepared'
+                          '?inputNames=x,y&outputFormat=binary',
+                          data=struct.pack('<2d', 1.5, 2.0),
+                          headers={'Content-Type': 'application/octet-stream'})
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.headers['Content-Type'], 'application/octet-stream')
+        self.assertEqual(struct.unpack('<2d', r.content), (3.0, 3.5))
+
+    def test_repeated_calls(self):
+        for i in range(100):
+            res = mldb.get('/v1/functions/score/prepared',
+                           inputNames='x,y', input=[i, 1])
+            self.assertEqual(res.json(), {'doubled': i * 2, 'sum': i + 1})
+
+    def test_dependency_replaced(self):
+        mldb.put('/v1/functions/inner', {
+            'type': 'sql.expression',
+            'params': { 'expression': 'x + 1 AS y' }
+        })
+        mldb.put('/v1/functions/outer', {
+            'type': 'sql.expression',
+            'params': { 'expression': 'inner({x})[y] AS z' }
+        })
+
+        def check(expected):
+            res = mldb.get('/v1/functions/outer/prepared',
+                           inputNames='x', input=[1])
+            self.assertEqual(res.json(), {'z': expected})
+            res = mldb.get('/v1/functions/outer/application',
+                           input={'x': 1}, outputFormat='json')
+            self.assertEqual(res.json(), {'z': expected})
+
+        check(2)
+
+        # Replacing the inner function is seen by the cached appliers
+        mldb.delete('/v1/functions/inner')
+        mldb.put('/v1/functions/inner', {
+            'type': 'sql.expression',
+            'params': { 'expression': 'x + 10 AS y' }
+        })
+        check(11)
+
+        mldb.delete('/v1/functions/inner')
+        with self.assertMldbRaises(status_code=400):
+            mldb.get('/v1/functions/outer/prepared',
+                     inputNames='x', input=[1])
+
+    def test_dataset_updated(self):
+        ds = mldb.create_dataset({'id': 'lookup_items',
+                                  'type': 'sparse.mutable'})
+        ds.record_row('a', [['x', 1, 0]])
+        ds.commit()
+
+        mldb.put('/v1/functions/lookup', {
+            'type': 'sql.query',
+            'params': {
+                'query': 'SELECT count(*) AS n FROM lookup_items '
+                         'WHERE x >= $min'
+            }
+        })
+
+        def check(expected):
+            res = mldb.get('/v1/functions/lookup/prepared',
+                           inputNames='min', input=[0])
+            self.assertEqual(res.json(), {'n': expected})
+            res = mldb.get('/v1/functions/lookup/application',
+                           input={'min': 0}, outputFormat='json')
+            self.assertEqual(res.json(), {'n': expected})
+
+        check(1)
+
+        # New rows in the dataset are seen by the cached appliers
+        ds.record_row('b', [['x', 2, 0]])
+        ds.commit()
+        check(2)
+
+    def test_many_input_names(self):
+        # More distinct input names than the cache holds; the most
+        # recently used ones are kept
+        for i in range(300):
+            res = mldb.get('/v1/functions/score/prepared',
+                           inputNames='x,y,unused{}'.format(i),
+                           input=[i, 1, 0])
+            self.assertEqual(res.json(), {'doubled': i * 2, 'sum': i + 1})
+            res = mldb.get('/v1/functions/score/prepared',
+                           inputNames='x,y', input=[i, 1])
+            self.assertEqual(res.json(), {'doubled': i * 2, 'sum': i + 1})
+
+    def test_errors(self):
+        with self.assertMldbRaises(status_code=400):
+            mldb.get('/v1/functions/score/prepared', input=[1, 2])
+
+        with self.assertMldbRaises(expected_regexp='expected 2 input values',
+                                   status_code=400):
+            mldb.get('/v1/functions/score/prepared',
+                     inputNames='x,y', input=[1])
+
+        with self.assertMldbRaises(expected_regexp='repeated',
+                                   status_code=400):
+            mldb.get('/v1/functions/score/prepared',
+                     inputNames='x,x', input=[1, 2])
+
+        with self.assertMldbRaises(status_code=400):
+            mldb.get('/v1/functions/score/prepared',
+                     inputNames='x,y', input=[1, 2], outputFormat='xml')
+
+        r = requests.post(url + '/v1/functions/score/prepared?inputNames=x,y',
+                          data=struct.pack('<d', 1.0),
+                          headers={'Content-Type': 'application/octet-stream'})
+        self.assertEqual(r.status_code, 400, r.text)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,73 @@
+#
+# probabilizer_calibration_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test the isotonic style of probabilizer, and probabilizers fitted on a
+# histogram of the scores.
+#
+
+import random
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class ProbabilizerCalibrationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(5)
+        ds = mldb.create_dataset({'id' : 'scores', 'type' : 'sparse.mutable'})
+        for i in range(2000):
+            score = random.uniform(-3, 3)
+            # True probability is a step function of the score
+            prob = 0.1 if score < 0 else 0.8
+            label = random.random() < prob
+            ds.record_row('row%d' % i, [['score', score, 0],
+                                        ['label', label, 0]])
+        ds.commit()
+
+    def train(self, name, **params):
+        config = {
+            'type' : 'probabilizer.train',
+            'params' : {
+                'trainingData' : 'SELECT score, label FROM scores',
+                'modelFileUrl' : 'file://tmp/calibration_%s.prb' % name,
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        }
+        config['params'].update(params)
+        mldb.put('/v1/procedures/' + name, config)
+
+    def prob(self, function, score):
+        return mldb.query("SELECT {}({{score: {}}})[prob]"
+                          .format(function, score))[1][1]
+
+    def test_isotonic(self):
+        self.train('iso', style='isotonic', numBins=100)
+
+        probs = [self.prob('iso', s) for s in [-5, -2, -1, 1, 2, 5]]
+        self.assertEqual(probs, sorted(probs))
+        self.assertAlmostEqual(probs[1], 0.1, delta=0.1)
+        self.assertAlmostEqual(probs[4], 0.8, delta=0.1)
+
+        # Clamped beyond the range of the training scores
+        self.assertEqual(probs[0], self.prob('iso', -100))
+        self.assertEqual(probs[-1], self.prob('iso', 100))
+
+    def test_binned_glz_matches_exact(self):
+        self.train('glz_exact')
+        self.train('glz_binned', numBins=1000)
+
+        for score in [-2, -0.5, 0, 0.5, 2]:
+            self.assertAlmostEqual(self.prob('glz_exact', score),
+                                   self.prob('glz_binned', score),
+                                   delta=0.01)
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            self.train('bad_style', style='histogram')
+        with self.assertRaises(ResponseException):
+            self.train('bad_bins', numBins=-1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,134 @@
+/** sensor_history_test.cc                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the history of sensors and the sensor_history() function.
+*/
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/core/sensor.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/types/structure_description.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+namespace {
+
+struct CounterSensorConfig {
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(CounterSensorConfig);
+DEFINE_STRUCTURE_DESCRIPTION_INLINE(CounterSensorConfig)
+{
+}
+
+/** Sensor that returns 0, 1, 2, ... each time it's read. */
+struct CounterSensor: public Sensor {
+    CounterSensor(MldbEngine * owner,
+                  PolyConfig config,
+                  const std::function<bool (const Json::Value &)> & onProgress)
+        : Sensor(owner)
+    {
+    }
+
+    virtual ExpressionValue latest()
+    {
+        return ExpressionValue(count++, Date::now());
+    }
+
+    virtual std::shared_ptr<ExpressionValueInfo> resultInfo() const
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    std::atomic<int64_t> count { 0 };
+};
+
+Package testPackage("test");
+
+RegisterSensorType<CounterSensor, CounterSensorConfig>
+regCounterSensor(testPackage,
+                 "test.counter",
+                 "Sensor that counts its reads",
+                 "sensors/CounterSensor.md");
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_sensor_history )
+{
+    MldbServer server;
+    server.init();
+    string httpBoundAddress = server.bindTcp(PortRange(17000,18000), "127.0.0.1");
+    server.start();
+    HttpRestProxy proxy(httpBoundAddress);
+
+    PolyConfig config;
+    config.type = "test.counter";
+    auto out = proxy.put("/v1/sensors/counter", jsonEncode(config));
+    BOOST_REQUIRE_EQUAL(out.code(), 201);
+
+    auto query = [&] (const std::string & q)
+        {
+            return proxy.get("/v1/query", { { "q", q }, { "format", "table" } });
+        };
+
+    // Reading the history doesn't enable it
+    out = query("SELECT * FROM sensor_history({sensor: 'counter'})");
+    cerr << out << endl;
+    BOOST_CHECK_EQUAL(out.code(), 400);
+
+    // The size of the history is bounded
+    out = proxy.put("/v1/sensors/counter/history",
+                    Json::parse("{\"samples\": 1000000000}"));
+    cerr << out << endl;
+    BOOST_CHECK_EQUAL(out.code(), 400);
+    out = proxy.put("/v1/sensors/counter/history",
+                    Json::parse("{\"samples\": -1}"));
+    BOOST_CHECK_EQUAL(out.code(), 400);
+
+    out = proxy.put("/v1/sensors/counter/history",
+                    Json::parse("{\"samples\": 3}"));
+    cerr << out << endl;
+    BOOST_REQUIRE_EQUAL(out.code(), 200);
+    BOOST_CHECK_EQUAL(out.jsonBody()["samples"].asInt(), 3);
+
+    // Nothing has been read yet
+    out = query("SELECT * FROM sensor_history({sensor: 'counter'})");
+    cerr << out << endl;
+    BOOST_REQUIRE_EQUAL(out.code(), 200);
+    BOOST_CHECK_EQUAL(out.jsonBody().size(), 1);  // just the header
+
+    for (int i = 0;  i < 5;  ++i) {
+        out = query("SELECT read_sensor('counter') AS x");
+        BOOST_REQUIRE_EQUAL(out.code(), 200);
+    }
+
+    // Only the last three are kept, oldest first
+    out = query("SELECT value FROM sensor_history({sensor: 'counter', "
+                "samples: 10}) ORDER BY rowName()");
+    cerr << out << endl;
+    BOOST_REQUIRE_EQUAL(out.code(), 200);
+    Json::Value expected = Json::parse(R"([
+        [ "_rowName", "value" ],
+        [ "2", 2 ],
+        [ "3", 3 ],
+        [ "4", 4 ]
+    ])");
+    BOOST_CHECK_EQUAL(out.jsonBody(), expected);
+
+    out = query("SELECT value FROM sensor_history({sensor: 'counter', "
+                "samples: 1})");
+    BOOST_REQUIRE_EQUAL(out.code(), 200);
+    BOOST_CHECK_EQUAL(out.jsonBody().size(), 2);
+    BOOST_CHECK_EQUAL(out.jsonBody()[1][1].asInt(), 4);
+}
@@ -0,0 +1,125 @@
+#
+# sql_query_lookup_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test that sql.query functions keyed on rowName() or rowPath() are run as a
+# direct row lookup, and give the same results as when they run the whole
+# query.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class SqlQueryLookupTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'items', 'type' : 'sparse.mutable'})
+        for i in range(20):
+            ds.record_row('item%d' % i, [['x', i, 0], ['y', i * 2, 0]])
+        ds.record_row('a.b', [['x', 100, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'refs', 'type' : 'sparse.mutable'})
+        for i in range(30):
+            ds.record_row('ref%d' % i, [['item', 'item%d' % i, 0]])
+        ds.record_row('dotted', [['item', 'a.b', 0]])
+        ds.record_row('quoted', [['item', '"a.b"', 0]])
+        ds.record_row('missing', [['other', 1, 0]])
+        ds.commit()
+
+    def create_function(self, name, query):
+        mldb.put('/v1/functions/' + name, {
+            'type' : 'sql.query',
+            'params' : { 'query' : query }
+        })
+        return mldb.get('/v1/functions/' + name).json()['status']['plan']
+
+    def check_same(self, lookup, pipeline):
+        def run(function):
+            return mldb.query("""
+                SELECT {}({{id: item}}) AS *
+                FROM refs ORDER BY rowName()
+            """.format(function))
+
+        self.assertEqual(run(lookup), run(pipeline))
+
+    def test_row_name(self):
+        plan = self.create_function(
+            'by_name', 'SELECT x, y, rowName() AS name, $id AS id '
+                       'FROM items WHERE rowName() = $id')
+        self.assertEqual(plan['type'], 'keyedLookup')
+        self.assertEqual(plan['keyFunction'], 'rowName')
+        self.assertEqual(plan['dataset'], 'items')
+
+        # The extra condition means that the query has to be run
+        plan = self.create_function(
+            'by_name_pipeline', 'SELECT x, y, rowName() AS name, $id AS id '
+                                'FROM items WHERE rowName() = $id AND true')
+        self.assertEqual(plan['type'], 'pipeline')
+
+        self.check_same('by_name', 'by_name_pipeline')
+
+        res = mldb.get('/v1/functions/by_name/application',
+                       input={'id' : 'item3'}).json()
+        self.assertEqual(res['output'],
+                         {'x' : 3, 'y' : 6, 'name' : 'item3', 'id' : 'item3'})
+
+    def test_row_path_and_alias(self):
+        plan = self.create_function(
+            'by_path', 'SELECT i.x AS x FROM items AS i '
+                       'WHERE $id = rowPath()')
+        self.assertEqual(plan['type'], 'keyedLookup')
+        self.assertEqual(plan['keyFunction'], 'rowPath')
+
+        self.create_function(
+            'by_path_pipeline', 'SELECT i.x AS x FROM items AS i '
+                                'WHERE $id = rowPath() AND true')
+
+        self.check_same('by_path', 'by_path_pipeline')
+
+    def test_not_rewritten(self):
+        # Aggregates return a row even when nothing matches
+        plan = self.create_function(
+            'count', 'SELECT count(*) AS n FROM items WHERE rowName() = $id')
+        self.assertEqual(plan['type'], 'pipeline')
+
+        # The key depends on the row
+        plan = self.create_function(
+            'row_key', 'SELECT x FROM items WHERE rowName() = y')
+        self.assertEqual(plan['type'], 'pipeline')
+
+        # Not a plain dataset
+        plan = self.create_function(
+            'subselect', 'SELECT x FROM (SELECT * FROM items) '
+                         'WHERE rowName() = $id')
+        self.assertEqual(plan['type'], 'pipeline')
+
+        res = mldb.get('/v1/functions/count/application',
+                       input={'id' : 'nothing'}).json()
+        self.assertEqual(res['output'], {'n' : 0})
+
+    def test_offset_and_limit(self):
+        # Skipping the only matching row leaves nothing
+        plan = self.create_function(
+            'offset_1', 'SELECT x FROM items WHERE rowName() = $id OFFSET 1')
+        self.assertEqual(plan['type'], 'pipeline')
+        res = mldb.get('/v1/functions/offset_1/application',
+                       input={'id' : 'item3'}).json()
+        self.assertFalse(res.get('output'))
+
+        plan = self.create_function(
+            'limit_0', 'SELECT x FROM items WHERE rowName() = $id LIMIT 0')
+        self.assertEqual(plan['type'], 'pipeline')
+        res = mldb.get('/v1/functions/limit_0/application',
+                       input={'id' : 'item3'}).json()
+        self.assertFalse(res.get('output'))
+
+        # A limit that keeps the row is still fine to run as a pipeline
+        self.create_function(
+            'limit_1', 'SELECT x FROM items WHERE rowName() = $id LIMIT 1')
+        self.create_function(
+            'no_limit', 'SELECT x FROM items WHERE rowName() = $id')
+        self.check_same('no_limit', 'limit_1')
+
+if __name__ == '__main__':
+    mldb.run_tests()
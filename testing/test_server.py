@@ -6,7 +6,9 @@ they simply return HTML content with their verb. GET has 3 behaviours.
 1. Calling it with /infinite_redirect will redirect to itself, hence an inifnite
    redirect.
 2. Calling it with /sleep/<seconds> will sleep for <seconds> seconds.
-3. Calling it with anything else (/<anything else>) will set <anything else> as
+3. Calling it with /redirect/<path> will redirect to /<path>.
+4. Calling it with /counter will return the number of times it was called.
+5. Calling it with anything else (/<anything else>) will set <anything else> as
    the response status. It is meant to be used with a valid status code so
    /200, /404, /500, etc.
 
@@ -24,11 +26,15 @@ Send a POST request:
 from socketserver import ThreadingMixIn
 from http.server import BaseHTTPRequestHandler, HTTPServer
 import socketserver
+import threading
 import time
 
 class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
     pass
 
+counter_lock = threading.Lock()
+counter = 0
+
 class S(BaseHTTPRequestHandler):
     def _set_headers(self):
         self.send_response(200)
@@ -45,6 +51,22 @@ class S(BaseHTTPRequestHandler):
                 "<html><body><h1>To infinity and beyond!</h1></body></html>".encode('utf-8'))
             return
 
+        if self.path.startswith('/redirect/'):
+            self.send_response(302)
+            self.send_header('Content-type', 'text/html')
+            self.send_header('Location', self.path[len('/redirect'):])
+            self.end_headers()
+            return
+
+        if self.path == '/counter':
+            global counter
+            with counter_lock:
+                counter += 1
+                value = counter
+            self._set_headers()
+            self.wfile.write(str(value).encode('utf-8'))
+            return
+
         if self.path.startswith('/sleep/'):
             duration = int(self.path[len('/sleep/'):])
             time.sleep(duration)
@@ -70,6 +70,7 @@ $(eval $(call test,mldb_startup_test,mldb,boost))
 $(eval $(call test,mldb_plugin_delete_test,mldb,boost))
 $(eval $(call test,pyplugin_static_folder_test,mldb,boost virtualenv))
 $(eval $(call test,mldb_function_delete_test,mldb mldb_test_function,boost))
+$(eval $(call test,sensor_history_test,mldb,boost))
 $(eval $(call test,MLDB-204-circular-references-initialization,mldb,boost))
 $(eval $(call test,MLDB-267-delete-while-loading,mldb,boost))
 $(eval $(call test,mldb_crash_multiple_py_routes,mldb,boost manual))  #manual - intermittent - MLDB-787
@@ -465,6 +466,7 @@ $(eval $(call mldb_unit_test,MLDB-1907-value-description-error.py))
 $(eval $(call mldb_unit_test,test_classifier_test_proc.py))
 $(eval $(call mldb_unit_test,MLDB-1937-svd-with-complex-select.py))
 $(eval $(call mldb_unit_test,fetcher-function.py))
+$(eval $(call mldb_unit_test,fetcher-async.py))
 $(eval $(call mldb_unit_test,MLDB-1950-crash-in-merge.py))
 $(eval $(call mldb_unit_test,MLDB-408-task-cancellation.py))
 $(eval $(call mldb_unit_test,MLDB-1921_merge_ds_strings.py))
@@ -505,6 +507,15 @@ $(eval $(call mldb_unit_test,multilabel-classifier-test.py))
 $(eval $(call mldb_unit_test,MLDB-2143-classifier-utf8.py))
 $(eval $(call mldb_unit_test,MLDB-2161-utf8-in-script-apply.py))
 $(eval $(call mldb_unit_test,MLDB-2163-POST-function-application.py))
+$(eval $(call mldb_unit_test,prepared_function_application_test.py))
+$(eval $(call mldb_unit_test,lazy_joined_dataset_test.py))
+$(eval $(call mldb_unit_test,merged_dataset_append_test.py))
+$(eval $(call mldb_unit_test,feature_space_cache_test.py))
+$(eval $(call mldb_unit_test,probabilizer_calibration_test.py))
+$(eval $(call mldb_unit_test,gaussian_clustering_modes_test.py))
+$(eval $(call mldb_unit_test,frozen_classifier_test.py))
+$(eval $(call mldb_unit_test,sql_query_lookup_test.py))
+$(eval $(call mldb_unit_test,xlsx_importer_test.py))
 $(eval $(call mldb_unit_test,MLDB-2166_mime_type.py))
 $(eval $(call mldb_unit_test,MLDB-2169-skip-extra-columns.js))
 $(eval $(call mldb_unit_test,MLDB-2180-dataset-split.py))
@@ -0,0 +1,125 @@
+#
+# xlsx_importer_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of the experimental.import.xlsx procedure, on workbooks that are
+# written out by the test itself.
+#
+
+import tempfile
+import zipfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+WORKBOOK = """<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<workbook xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+ xmlns:r="http://schemas.openxmlformats.org/officeDocument/2006/relationships">
+<workbookPr/>
+<sheets><sheet name="Sheet1" sheetId="1" r:id="rId1"/></sheets>
+</workbook>"""
+
+RELATIONSHIPS = """<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<Relationships xmlns="http://schemas.openxmlformats.org/package/2006/relationships">
+<Relationship Id="rId1"
+ Type="http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet"
+ Target="worksheets/sheet1.xml"/>
+</Relationships>"""
+
+STYLES = """<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<styleSheet xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main">
+<cellXfs count="1"><xf numFmtId="0"/></cellXfs>
+</styleSheet>"""
+
+SHARED_STRINGS = """<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<sst xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+ count="2" uniqueCount="2">
+<si><t>a &amp; b</t></si>
+<si><t>&#x41;&#66;C</t></si>
+</sst>"""
+
+SHEET = """<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<worksheet xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main">
+<dimension ref="{dimension}"/>
+<sheetData>{rows}</sheetData>
+</worksheet>"""
+
+
+class XlsxImporterTest(MldbUnitTest):  # noqa
+
+    def write_workbook(self, rows, dimension='A1:B1000',
+                       shared_strings=SHARED_STRINGS):
+        tmp_file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                               suffix='.xlsx')
+        with zipfile.ZipFile(tmp_file.name, 'w') as z:
+            z.writestr('xl/workbook.xml', WORKBOOK)
+            z.writestr('xl/_rels/workbook.xml.rels', RELATIONSHIPS)
+            z.writestr('xl/styles.xml', STYLES)
+            z.writestr('xl/sharedStrings.xml', shared_strings)
+            z.writestr('xl/worksheets/sheet1.xml',
+                       SHEET.format(dimension=dimension, rows=rows))
+        return tmp_file
+
+    def run_import(self, tmp_file, output):
+        mldb.post('/v1/procedures', {
+            'type' : 'experimental.import.xlsx',
+            'params' : {
+                'dataFileUrl' : 'file://' + tmp_file.name,
+                'output' : output,
+                'runOnCreation' : True
+            }
+        })
+
+    def test_import(self):
+        # The dimension covers more rows than there are, and some rows
+        # have no index; the row names are padded to the width of the
+        # last row.
+        rows = '<row r="1"><c r="A1" t="s"><v>0</v></c>' \
+               '<c r="B1"><v>1</v></c></row>'
+        rows += '<row><c t="s"><v>1</v></c><c><v>2.5</v></c></row>'
+        for i in range(9, 13):
+            rows += '<row r="{0}"><c r="B{0}"><v>{0}</v></c></row>'.format(i)
+
+        tmp_file = self.write_workbook(rows)
+        self.run_import(tmp_file, 'imported')
+
+        res = mldb.query('SELECT * FROM imported ORDER BY rowName()')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'A', 'B'],
+            ['Sheet1:01', 'a & b', 1],
+            ['Sheet1:02', 'ABC', 2.5],
+            ['Sheet1:09', None, 9],
+            ['Sheet1:10', None, 10],
+            ['Sheet1:11', None, 11],
+            ['Sheet1:12', None, 12]
+        ])
+
+    def test_malformed(self):
+        def check(rows, shared_strings=SHARED_STRINGS):
+            tmp_file = self.write_workbook(rows,
+                                           shared_strings=shared_strings)
+            with self.assertRaises(ResponseException) as exc:
+                self.run_import(tmp_file, 'malformed')
+            self.assertEqual(exc.exception.response.status_code, 400)
+
+        # Row index that isn't a number
+        check('<row r="x1"><c><v>1</v></c></row>')
+
+        # Shared string index that isn't a number, or doesn't exist
+        check('<row r="1"><c t="s"><v>zero</v></c></row>')
+        check('<row r="1"><c t="s"><v>-1</v></c></row>')
+        check('<row r="1"><c t="s"><v>2</v></c></row>')
+
+        # Unknown cell style
+        check('<row r="1"><c s="5"><v>1</v></c></row>')
+
+        # Malformed cell reference
+        check('<row r="1"><c r="11"><v>1</v></c></row>')
+
+        # Malformed character reference
+        check('<row r="1"><c t="s"><v>0</v></c></row>',
+              SHARED_STRINGS.replace('&#66;', '&#xZZ;'))
+        check('<row r="1"><c t="s"><v>0</v></c></row>',
+              SHARED_STRINGS.replace('&#66;', '&#xD800;'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
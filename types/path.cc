@@ -614,11 +614,69 @@ getStringView() const
     return { data(), dataLength() };
 }
 
+namespace {
+
+/* CityHash64 of the given string.  Path elements are mostly short, and
+   for those this inlines the same computation as CityHash64's for up to
+   16 bytes, avoiding the call and letting the compiler overlap the
+   hashing of consecutive elements in the batch functions.
+*/
+MLDB_ALWAYS_INLINE uint64_t cityHash64Inline(const char * s, size_t len)
+{
+    static constexpr uint64_t k2 = 0x9ae16a3b2f90404fULL;
+    static constexpr uint64_t k3 = 0xc949d7c7509e6557ULL;
+
+    if (len > 16)
+        return CityHash64(s, len);
+
+    if (len > 8) {
+        uint64_t a, b;
+        std::memcpy(&a, s, 8);
+        std::memcpy(&b, s + len - 8, 8);
+        uint64_t c = b + len;
+        c = (c >> len) | (c << (64 - len));
+        return Hash128to64({a, c}) ^ b;
+    }
+    if (len >= 4) {
+        uint32_t a, b;
+        std::memcpy(&a, s, 4);
+        std::memcpy(&b, s + len - 4, 4);
+        return Hash128to64({len + ((uint64_t)a << 3), b});
+    }
+    if (len > 0) {
+        uint8_t a = s[0];
+        uint8_t b = s[len >> 1];
+        uint8_t c = s[len - 1];
+        uint32_t y = (uint32_t)a + ((uint32_t)b << 8);
+        uint32_t z = len + ((uint32_t)c << 2);
+        uint64_t v = y * k2 ^ z * k3;
+        return (v ^ (v >> 47)) * k2;
+    }
+    return k2;
+}
+
+/// Number of items ahead of the one being hashed whose data is prefetched
+constexpr size_t HASH_PREFETCH_DISTANCE = 8;
+
+} // file scope
+
 uint64_t
 PathElement::
 oldHash() const
 {
-    return CityHash64(data(), dataLength());
+    return cityHash64Inline(data(), dataLength());
+}
+
+void
+PathElement::
+hashBatch(const PathElement * elements, size_t n, uint64_t * hashes)
+{
+    for (size_t i = 0;  i < n;  ++i) {
+        if (i + HASH_PREFETCH_DISTANCE < n)
+            __builtin_prefetch(elements[i + HASH_PREFETCH_DISTANCE].data());
+        hashes[i] = cityHash64Inline(elements[i].data(),
+                                     elements[i].dataLength());
+    }
 }
 
 constexpr HashSeed defaultSeedStable { .i64 = { 0x1958DF94340e7cbaULL, 0x8928Fc8B84a0ULL } };
@@ -1339,7 +1397,24 @@ Path::
 oldHashElement(size_t el) const
 {
     auto sv = getStringView(el);
-    return CityHash64(sv.first, sv.second);
+    return cityHash64Inline(sv.first, sv.second);
+}
+
+void
+Path::
+hashBatch(const Path * paths, size_t n, uint64_t * hashes)
+{
+    for (size_t i = 0;  i < n;  ++i) {
+        if (i + HASH_PREFETCH_DISTANCE < n)
+            __builtin_prefetch(paths[i + HASH_PREFETCH_DISTANCE].data());
+        const Path & path = paths[i];
+        if (path.size() == 1) {
+            // Most common case (row and column names); no combining needed
+            auto sv = path.getStringView(0);
+            hashes[i] = cityHash64Inline(sv.first, sv.second);
+        }
+        else hashes[i] = path.oldHash();
+    }
 }
 
 uint64_t
@@ -181,6 +181,14 @@ struct PathElement {
     /// with legacy hashes.
     uint64_t newHash() const;
 
+    /** Put the hash() of each of the n elements into hashes.  This is
+        faster than calling hash() in a loop over large arrays, as the
+        common short elements are hashed inline and the data of the
+        following elements is prefetched.
+    */
+    static void hashBatch(const PathElement * elements, size_t n,
+                          uint64_t * hashes);
+
     inline bool null() const
     {
         return storage_.empty();
@@ -594,6 +602,12 @@ struct Path {
     /// with legacy hashes.
     uint64_t newHash() const;
 
+    /** Put the hash() of each of the n paths into hashes.  This is faster
+        than calling hash() in a loop, for the same reasons as
+        PathElement::hashBatch().
+    */
+    static void hashBatch(const Path * paths, size_t n, uint64_t * hashes);
+
     size_t size() const
     {
         return length_;
@@ -16,6 +16,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "compressor.h"
+#include "io_uring.h"
 #include <fstream>
 #include <mutex>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -30,6 +31,7 @@
 #include <thread>
 #include <unordered_map>
 #include "fs_utils.h"
+#include "uri_read_cache.h"
 #include "mldb/base/exc_assert.h"
 
 
@@ -595,6 +597,14 @@ openFromHandler(const UriHandler & handler,
                 const std::string & resource,
                 const std::map<std::string, std::string> & options)
 {
+    if (handler.options.compressed) {
+        std::map<std::string, std::string> uncompressedOptions = options;
+        uncompressedOptions["compression"] = "none";
+        openFromStreambuf(handler.buf, handler.bufOwnership, resource,
+                          uncompressedOptions);
+        return;
+    }
+
     openFromStreambuf(handler.buf, handler.bufOwnership, resource, options);
 }
 
@@ -786,9 +796,17 @@ open(const std::string & uri,
         }
     };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler;
+    auto cache = getUriReadCache(scheme);
+    if (cache && !(mode & ios::out)) {
+        handler = cache->open(scheme, resource, options, onException,
+                              handlerFactory);
+    }
+    else {
+        handler = handlerFactory(scheme, resource, mode,
+                                 options,
+                                 onException);
+    }
     
     openFromHandler(handler, resource, options);
 }
@@ -819,7 +837,11 @@ open(const std::string & uri,
             this->deferredExcPtr = excPtr;
         }
     };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler;
+    if (auto cache = getUriReadCache(scheme))
+        handler = cache->open(scheme, resource, options, onException,
+                              handlerFactory);
+    else handler = handlerFactory(scheme, resource, ios::in, options, onException);
     openFromHandler(handler, resource, options);
 }
 
@@ -1037,6 +1059,59 @@ getUriHandler(const std::string & scheme)
 }
 
 struct RegisterFileHandler {
+    /* Return the io_uring options for the file, if it's to be read or
+       written through io_uring.  That's the case if the "io-uring" option
+       is true (the default being given by MLDB_FILE_IO_URING) or if the
+       "direct" option is, and io_uring is available. */
+    static bool
+    getIoUringOptions(const std::map<std::string, std::string> & options,
+                      IoUringFileOptions & result)
+    {
+        auto getBool = [&] (const std::string & name, bool def)
+            {
+                auto it = options.find(name);
+                if (it == options.end())
+                    return def;
+                if (it->second == "true" || it->second == "1")
+                    return true;
+                if (it->second == "false" || it->second == "0")
+                    return false;
+                throw MLDB::Exception("file option " + name
+                                      + " must be true or false, not "
+                                      + it->second);
+            };
+
+        auto getPositive = [&] (const std::string & name, size_t def)
+            {
+                auto it = options.find(name);
+                if (it == options.end())
+                    return def;
+                long long value = -1;
+                try {
+                    value = boost::lexical_cast<long long>(it->second);
+                } catch (const boost::bad_lexical_cast &) {
+                }
+                if (value <= 0)
+                    throw MLDB::Exception("file option " + name
+                                          + " must be a positive integer, not "
+                                          + it->second);
+                return (size_t)value;
+            };
+
+        static const bool defaultIoUring = [] ()
+            {
+                const char * env = getenv("MLDB_FILE_IO_URING");
+                return env && (string(env) == "1" || string(env) == "true");
+            } ();
+
+        result.direct = getBool("direct", false);
+        result.blockSize = getPositive("io-block-size", result.blockSize);
+        result.queueDepth = getPositive("io-queue-depth", result.queueDepth);
+
+        bool useIoUring = getBool("io-uring", defaultIoUring || result.direct);
+        return useIoUring && IoUring::available();
+    }
+
     static UriHandler
     getFileHandler(const std::string & scheme,
                    std::string resource,
@@ -1062,7 +1137,15 @@ struct RegisterFileHandler {
 
             // MLDB-1303 mmap fails on empty files - force filebuf interface
             // on empty files despite the mapped option
-            if (!options.count("mapped") || !info.size) {
+            IoUringFileOptions ioUringOptions;
+            bool ioUring = getIoUringOptions(options, ioUringOptions);
+
+            if (ioUring && !options.count("mapped")) {
+                shared_ptr<std::streambuf> buf
+                    = openIoUringReadBuf(resource, ioUringOptions);
+                return UriHandler(buf.get(), buf, info);
+            }
+            else if (!options.count("mapped") || !info.size) {
                 shared_ptr<std::filebuf> buf(new std::filebuf);
                 buf->open(resource, ios_base::openmode(mode));
 
@@ -1091,6 +1174,16 @@ struct RegisterFileHandler {
             if (resource == "-")
                 return UriHandler(cout.rdbuf(), nullptr);
 
+            // Appending or updating goes through a filebuf
+            IoUringFileOptions ioUringOptions;
+            bool ioUring = getIoUringOptions(options, ioUringOptions);
+            if (ioUring && (mode & ~(ios::binary | ios::trunc)) == ios::out) {
+                shared_ptr<std::streambuf> buf
+                    = openIoUringWriteBuf(resource, ioUringOptions,
+                                          onException);
+                return UriHandler(buf.get(), buf);
+            }
+
             shared_ptr<std::filebuf> buf(new std::filebuf);
             buf->open(resource, ios_base::openmode(mode));
 
@@ -42,7 +42,8 @@ struct UriHandlerOptions {
         : isForwardSeekable(false),
           isRandomSeekable(false),
           mapped(nullptr),
-          mappedSize(0)
+          mappedSize(0),
+          compressed(false)
     {
     }
 
@@ -55,6 +56,11 @@ struct UriHandlerOptions {
     /// If it's a mapped stream, returns the location and size
     const char * mapped;
     size_t mappedSize;
+
+    /// For output streams, the handler has already arranged for the
+    /// compression asked for by the options or the resource name to be
+    /// applied, so filter_ostream mustn't add it again
+    bool compressed;
 };
 
 struct UriHandler {
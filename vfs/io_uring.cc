@@ -0,0 +1,852 @@
+/* io_uring.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Local file I/O through the Linux io_uring interface.
+*/
+
+#include "mldb/vfs/io_uring.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* IO URING                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+int sysIoUringSetup(unsigned entries, struct io_uring_params * params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                    unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                   nullptr, 0);
+}
+
+int sysIoUringRegister(int fd, unsigned opcode, void * arg, unsigned nrArgs)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+template<typename T>
+T * ringPtr(void * ring, uint32_t offset)
+{
+    return reinterpret_cast<T *>(reinterpret_cast<char *>(ring) + offset);
+}
+
+} // file scope
+
+struct IoUring::Itl {
+    Itl(unsigned entries)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = sysIoUringSetup(entries, &params);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "io_uring_setup");
+
+        sqEntries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes
+            + params.cq_entries * sizeof(struct io_uring_cqe);
+        singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            int err = errno;
+            ::close(fd);
+            throw MLDB::Exception(err, "mmap of io_uring submission queue");
+        }
+
+        if (singleMmap) {
+            cqRing = sqRing;
+        }
+        else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                int err = errno;
+                munmap(sqRing, sqRingSize);
+                ::close(fd);
+                throw MLDB::Exception(err, "mmap of io_uring completion queue");
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void * sqesMem = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqesMem == MAP_FAILED) {
+            int err = errno;
+            unmapRings();
+            ::close(fd);
+            throw MLDB::Exception(err, "mmap of io_uring submission entries");
+        }
+        sqes = reinterpret_cast<struct io_uring_sqe *>(sqesMem);
+
+        sqHead = ringPtr<unsigned>(sqRing, params.sq_off.head);
+        sqTail = ringPtr<unsigned>(sqRing, params.sq_off.tail);
+        sqMask = *ringPtr<unsigned>(sqRing, params.sq_off.ring_mask);
+        sqArray = ringPtr<unsigned>(sqRing, params.sq_off.array);
+        cqHead = ringPtr<unsigned>(cqRing, params.cq_off.head);
+        cqTail = ringPtr<unsigned>(cqRing, params.cq_off.tail);
+        cqMask = *ringPtr<unsigned>(cqRing, params.cq_off.ring_mask);
+        cqes = ringPtr<struct io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+        probeOps();
+    }
+
+    ~Itl() noexcept
+    {
+        munmap(sqes, sqesSize);
+        unmapRings();
+        ::close(fd);
+    }
+
+    /* Find out which operations the kernel supports.  Kernels too old
+       for IORING_REGISTER_PROBE are also too old for IORING_OP_READ and
+       IORING_OP_WRITE, so if the probe fails nothing is marked as
+       supported. */
+    void probeOps()
+    {
+        static constexpr unsigned MAX_OPS = 256;
+        std::vector<char> mem(sizeof(struct io_uring_probe)
+                              + MAX_OPS * sizeof(struct io_uring_probe_op));
+        auto probe = reinterpret_cast<struct io_uring_probe *>(mem.data());
+        if (sysIoUringRegister(fd, IORING_REGISTER_PROBE, probe, MAX_OPS)
+            == -1)
+            return;
+        for (unsigned i = 0;  i < probe->ops_len && i < MAX_OPS;  ++i) {
+            if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+                supportedOps.push_back(probe->ops[i].op);
+        }
+    }
+
+    bool supports(unsigned op) const
+    {
+        return std::find(supportedOps.begin(), supportedOps.end(), op)
+            != supportedOps.end();
+    }
+
+    void unmapRings()
+    {
+        munmap(sqRing, sqRingSize);
+        if (!singleMmap)
+            munmap(cqRing, cqRingSize);
+    }
+
+    /* Return the next free submission entry, cleared, or null if the
+       submission queue is full. */
+    struct io_uring_sqe * getSqe()
+    {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        unsigned tail = *sqTail + toSubmit;
+        if (tail - head >= sqEntries)
+            return nullptr;
+        unsigned index = tail & sqMask;
+        struct io_uring_sqe * sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        ++toSubmit;
+        return sqe;
+    }
+
+    /* Make the entries returned by getSqe() visible to the kernel, and
+       tell it about them, optionally waiting for minComplete completions. */
+    void enter(unsigned minComplete)
+    {
+        if (toSubmit) {
+            __atomic_store_n(sqTail, *sqTail + toSubmit, __ATOMIC_RELEASE);
+        }
+
+        unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+        while (toSubmit || minComplete) {
+            int res = sysIoUringEnter(fd, toSubmit, minComplete, flags);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw MLDB::Exception(errno, "io_uring_enter");
+            }
+            toSubmit -= std::min<unsigned>(res, toSubmit);
+            if (minComplete)
+                break;
+        }
+    }
+
+    bool tryGetCompletion(IoUring::Completion & completion)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+        const struct io_uring_cqe & cqe = cqes[head & cqMask];
+        completion.userData = cqe.user_data;
+        completion.result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    int fd = -1;
+    unsigned sqEntries = 0;
+    unsigned toSubmit = 0;   ///< Entries filled in but not yet submitted
+    bool singleMmap = false;
+
+    void * sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void * cqRing = nullptr;
+    size_t cqRingSize = 0;
+    struct io_uring_sqe * sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned * sqHead = nullptr;
+    unsigned * sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned * sqArray = nullptr;
+    unsigned * cqHead = nullptr;
+    unsigned * cqTail = nullptr;
+    unsigned cqMask = 0;
+    struct io_uring_cqe * cqes = nullptr;
+
+    std::vector<unsigned> supportedOps;  ///< Opcodes the kernel supports
+};
+
+IoUring::
+IoUring(unsigned entries)
+    : itl(new Itl(entries)), numInFlight(0)
+{
+}
+
+IoUring::
+~IoUring()
+{
+}
+
+bool
+IoUring::
+available()
+{
+    static const bool result = [] ()
+        {
+            const char * env = getenv("MLDB_IO_URING");
+            if (env && string(env) == "0")
+                return false;
+            try {
+                // Setting up a ring isn't enough: the reads and writes
+                // need IORING_OP_READ and IORING_OP_WRITE (Linux 5.6)
+                IoUring probe(1);
+                return probe.itl->supports(IORING_OP_READ)
+                    && probe.itl->supports(IORING_OP_WRITE);
+            } catch (const std::exception & exc) {
+                return false;
+            }
+        } ();
+    return result;
+}
+
+bool
+IoUring::
+supportsWriteback() const
+{
+    return itl->supports(IORING_OP_SYNC_FILE_RANGE);
+}
+
+bool
+IoUring::
+queueRead(int fd, void * buf, unsigned len, uint64_t offset,
+          uint64_t userData)
+{
+    struct io_uring_sqe * sqe = itl->getSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ++numInFlight;
+    return true;
+}
+
+bool
+IoUring::
+queueWrite(int fd, const void * buf, unsigned len, uint64_t offset,
+           uint64_t userData)
+{
+    struct io_uring_sqe * sqe = itl->getSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ++numInFlight;
+    return true;
+}
+
+bool
+IoUring::
+queueWriteback(int fd, uint64_t offset, uint32_t len, uint64_t userData)
+{
+    struct io_uring_sqe * sqe = itl->getSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+    sqe->fd = fd;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+    sqe->user_data = userData;
+    ++numInFlight;
+    return true;
+}
+
+void
+IoUring::
+submit()
+{
+    itl->enter(0 /* minComplete */);
+}
+
+bool
+IoUring::
+tryGetCompletion(Completion & completion)
+{
+    if (!itl->tryGetCompletion(completion))
+        return false;
+    --numInFlight;
+    return true;
+}
+
+IoUring::Completion
+IoUring::
+waitCompletion()
+{
+    ExcAssertGreater(numInFlight, 0);
+    Completion result;
+    while (!tryGetCompletion(result)) {
+        itl->enter(1 /* minComplete */);
+    }
+    return result;
+}
+
+
+/*****************************************************************************/
+/* IO URING FILE BUFFERS                                                     */
+/*****************************************************************************/
+
+namespace {
+
+/// Alignment of buffers, offsets and sizes for O_DIRECT
+constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+struct AlignedBuffer {
+    AlignedBuffer(size_t size)
+    {
+        void * mem = nullptr;
+        if (posix_memalign(&mem, DIRECT_ALIGNMENT, size) != 0)
+            throw std::bad_alloc();
+        data.reset(reinterpret_cast<char *>(mem));
+    }
+
+    struct Free {
+        void operator () (char * p) const { free(p); }
+    };
+
+    std::unique_ptr<char, Free> data;
+};
+
+IoUringFileOptions checkOptions(IoUringFileOptions options)
+{
+    if (options.queueDepth < 1)
+        options.queueDepth = 1;
+    if (options.blockSize < DIRECT_ALIGNMENT)
+        options.blockSize = DIRECT_ALIGNMENT;
+    // Reads and writes need to be aligned for O_DIRECT
+    options.blockSize -= options.blockSize % DIRECT_ALIGNMENT;
+    return options;
+}
+
+/* Reads blocks of the file in order, keeping queueDepth of them in flight
+   ahead of the block being read from. */
+
+struct IoUringReadBuf: public std::streambuf {
+    IoUringReadBuf(const std::string & filename,
+                   const IoUringFileOptions & options)
+        : options(checkOptions(options)),
+          ring(this->options.queueDepth)
+    {
+        fd = ::open(filename.c_str(),
+                    O_RDONLY | (this->options.direct ? O_DIRECT : 0));
+        if (fd == -1 && this->options.direct && errno == EINVAL) {
+            // File system doesn't support O_DIRECT
+            this->options.direct = false;
+            fd = ::open(filename.c_str(), O_RDONLY);
+        }
+        if (fd == -1)
+            throw MLDB::Exception(errno, "couldn't open file " + filename);
+
+        /* Short reads are finished synchronously at an unaligned offset,
+           which O_DIRECT doesn't allow, so they go through a second,
+           buffered, descriptor. */
+        if (this->options.direct) {
+            tailFd = ::open(filename.c_str(), O_RDONLY);
+            if (tailFd == -1) {
+                int err = errno;
+                ::close(fd);
+                throw MLDB::Exception(err, "couldn't open file " + filename);
+            }
+        }
+        else tailFd = fd;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            int err = errno;
+            closeFds();
+            throw MLDB::Exception(err, "couldn't stat file " + filename);
+        }
+        fileSize = st.st_size;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        for (unsigned i = 0;  i < this->options.queueDepth;  ++i) {
+            blocks.emplace_back(this->options.blockSize);
+        }
+
+        startReading(0);
+    }
+
+    ~IoUringReadBuf() noexcept
+    {
+        // The buffers can't be freed while the kernel may still write to them
+        try {
+            drain();
+        } catch (const std::exception & exc) {
+            std::cerr << "error waiting for reads of file: " << exc.what()
+                      << endl;
+        }
+        closeFds();
+    }
+
+    struct Block: public AlignedBuffer {
+        using AlignedBuffer::AlignedBuffer;
+        uint64_t offset = 0;
+        int result = 0;
+        bool inFlight = false;
+        bool done = false;
+    };
+
+    virtual int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        // The current block has been read; reuse it further on
+        if (current != -1) {
+            queueBlock(current);
+            current = (current + 1) % blocks.size();
+        }
+        else current = first;
+
+        Block & block = blocks[current];
+        if (!block.inFlight && !block.done)
+            return traits_type::eof();  // past the end of the file
+
+        ring.submit();
+        while (!block.done) {
+            auto completion = ring.waitCompletion();
+            Block & completed = blocks.at(completion.userData);
+            completed.result = completion.result;
+            completed.inFlight = false;
+            completed.done = true;
+        }
+
+        if (block.result < 0)
+            throw MLDB::Exception(-block.result, "reading file");
+
+        size_t size = block.result;
+        uint64_t expected
+            = std::min<uint64_t>(options.blockSize, fileSize - block.offset);
+        if (size < expected) {
+            // Short read (for example, a signal); finish it synchronously
+            ssize_t res = pread(tailFd, block.data.get() + size,
+                                expected - size, block.offset + size);
+            if (res == -1)
+                throw MLDB::Exception(errno, "reading file");
+            size += res;
+        }
+
+        if (size == 0)
+            return traits_type::eof();
+
+        char * start = block.data.get();
+        setg(start, start + std::min(skip, size), start + size);
+        skip = 0;
+        if (gptr() == egptr())
+            return underflow();
+        return traits_type::to_int_type(*gptr());
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                             std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        uint64_t position = tell();
+        if (way == std::ios_base::cur) {
+            if (off == 0)
+                return pos_type(position);
+            position += off;
+        }
+        else if (way == std::ios_base::beg)
+            position = off;
+        else position = fileSize + off;
+
+        return seekpos(pos_type(position), which);
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        override
+    {
+        if (!(which & std::ios_base::in) || pos < 0)
+            return pos_type(off_type(-1));
+
+        // Within the block we already have?
+        if (current != -1 && eback()) {
+            uint64_t blockStart = blocks[current].offset;
+            if (pos >= blockStart && pos < blockStart + (egptr() - eback())) {
+                setg(eback(), eback() + (pos - blockStart), egptr());
+                return pos;
+            }
+        }
+
+        drain();
+        uint64_t blockStart = pos - pos % options.blockSize;
+        startReading(blockStart);
+        skip = pos - blockStart;
+        return pos;
+    }
+
+    virtual std::streamsize showmanyc() override
+    {
+        return fileSize - tell();
+    }
+
+private:
+    uint64_t tell() const
+    {
+        if (current == -1)
+            return blocks[first].offset + skip;
+        return blocks[current].offset + (gptr() - eback());
+    }
+
+    /* Start reading from the given offset, which is at a block boundary. */
+    void startReading(uint64_t offset)
+    {
+        nextOffset = offset;
+        for (auto & b: blocks) {
+            b.inFlight = b.done = false;
+            b.offset = offset;
+        }
+        current = -1;
+        setg(nullptr, nullptr, nullptr);
+        for (unsigned i = 0;  i < blocks.size();  ++i) {
+            queueBlock(i);
+        }
+        first = 0;
+        ring.submit();
+    }
+
+    /* Queue the read of the next block of the file into the given buffer,
+       unless we've reached the end of the file. */
+    void queueBlock(int index)
+    {
+        Block & block = blocks[index];
+        block.done = false;
+        block.result = 0;
+        block.offset = nextOffset;
+        if (nextOffset >= fileSize)
+            return;
+        if (!ring.queueRead(fd, block.data.get(), options.blockSize,
+                            nextOffset, index))
+            throw MLDB::Exception("io_uring submission queue full");
+        block.inFlight = true;
+        nextOffset += options.blockSize;
+    }
+
+    void closeFds()
+    {
+        if (tailFd != fd)
+            ::close(tailFd);
+        ::close(fd);
+    }
+
+    /* Wait for all of the reads in flight, so that buffers can be reused
+       or freed. */
+    void drain()
+    {
+        ring.submit();
+        while (ring.inFlight()) {
+            auto completion = ring.waitCompletion();
+            blocks.at(completion.userData).inFlight = false;
+        }
+    }
+
+    IoUringFileOptions options;
+    IoUring ring;
+    int fd = -1;
+    int tailFd = -1;         ///< Buffered descriptor for short reads
+    uint64_t fileSize = 0;
+    std::vector<Block> blocks;
+    int current = -1;        ///< Block being read from, or -1 before the first
+    int first = 0;           ///< Block with the first data after a seek
+    uint64_t nextOffset = 0; ///< Offset of the next block to queue
+    size_t skip = 0;         ///< Bytes to skip in the first block after a seek
+};
+
+/* Writes full blocks asynchronously, with queueDepth of them in flight
+   before the writer waits. */
+
+struct IoUringWriteBuf: public std::streambuf {
+    IoUringWriteBuf(const std::string & filename,
+                    const IoUringFileOptions & options,
+                    const std::function<void (const std::exception_ptr &)>
+                        & onException)
+        : options(checkOptions(options)),
+          onException(onException),
+          ring(this->options.queueDepth)
+    {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        fd = ::open(filename.c_str(),
+                    flags | (this->options.direct ? O_DIRECT : 0), 0666);
+        if (fd == -1 && this->options.direct && errno == EINVAL) {
+            this->options.direct = false;
+            fd = ::open(filename.c_str(), flags, 0666);
+        }
+        if (fd == -1)
+            throw MLDB::Exception(errno, "couldn't open file " + filename);
+
+        /* Partial blocks can't be written with O_DIRECT, so they go through
+           a second, buffered, descriptor. */
+        if (this->options.direct) {
+            tailFd = ::open(filename.c_str(), O_WRONLY);
+            if (tailFd == -1) {
+                int err = errno;
+                ::close(fd);
+                throw MLDB::Exception(err, "couldn't open file " + filename);
+            }
+        }
+        else tailFd = fd;
+
+        for (unsigned i = 0;  i < this->options.queueDepth;  ++i) {
+            blocks.emplace_back(this->options.blockSize);
+            freeBlocks.push_back(i);
+        }
+        nextBlock();
+    }
+
+    ~IoUringWriteBuf()
+    {
+        // sync() waits for every write in flight, even on error
+        if (sync() == -1) {
+            try {
+                throw MLDB::Exception(error);
+            } catch (...) {
+                if (onException)
+                    onException(std::current_exception());
+                else std::cerr << "error writing file: " << error << endl;
+            }
+        }
+
+        if (tailFd != fd)
+            ::close(tailFd);
+        ::close(fd);
+    }
+
+    virtual int_type overflow(int_type c) override
+    {
+        if (!error.empty())
+            return traits_type::eof();
+
+        if (pptr() == epptr()) {
+            try {
+                writeBlock();
+                nextBlock();
+            } catch (const std::exception & exc) {
+                error = exc.what();
+                return traits_type::eof();
+            }
+        }
+
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char * s, std::streamsize n) override
+    {
+        std::streamsize done = 0;
+        while (done < n) {
+            if (pptr() == epptr()
+                && traits_type::eq_int_type(overflow(traits_type::eof()),
+                                            traits_type::eof()))
+                break;
+            std::streamsize toDo = std::min<std::streamsize>(n - done,
+                                                             epptr() - pptr());
+            memcpy(pptr(), s + done, toDo);
+            pbump(toDo);
+            done += toDo;
+        }
+        return done;
+    }
+
+    /* Wait for the blocks in flight and write the partial block, without
+       consuming it: later writes carry on filling it, and it's written
+       again, whole, once it's full. */
+    virtual int sync() override
+    {
+        try {
+            drain();
+            size_t size = pptr() - pbase();
+            size_t done = 0;
+            while (done < size) {
+                ssize_t res = pwrite(tailFd, pbase() + done, size - done,
+                                     blockOffset + done);
+                if (res == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    throw MLDB::Exception(errno, "writing file");
+                }
+                done += res;
+            }
+        } catch (const std::exception & exc) {
+            if (error.empty())
+                error = exc.what();
+        }
+        return error.empty() ? 0 : -1;
+    }
+
+private:
+    struct Block: public AlignedBuffer {
+        using AlignedBuffer::AlignedBuffer;
+        uint64_t offset = 0;
+    };
+
+    void nextBlock()
+    {
+        while (freeBlocks.empty()) {
+            reap(ring.waitCompletion());
+        }
+        current = freeBlocks.back();
+        freeBlocks.pop_back();
+        char * start = blocks[current].data.get();
+        setp(start, start + options.blockSize);
+    }
+
+    void writeBlock()
+    {
+        Block & block = blocks[current];
+        block.offset = blockOffset;
+        if (!ring.queueWrite(fd, block.data.get(), options.blockSize,
+                             blockOffset, current))
+            throw MLDB::Exception("io_uring submission queue full");
+        ring.submit();
+        blockOffset += options.blockSize;
+    }
+
+    void reap(const IoUring::Completion & completion)
+    {
+        Block & block = blocks.at(completion.userData);
+        freeBlocks.push_back(completion.userData);
+        if (completion.result < 0) {
+            if (error.empty())
+                error = MLDB::Exception(-completion.result, "writing file")
+                    .what();
+            return;
+        }
+
+        // Short write; finish it synchronously
+        size_t done = completion.result;
+        while (done < options.blockSize && error.empty()) {
+            ssize_t res = pwrite(tailFd, block.data.get() + done,
+                                 options.blockSize - done,
+                                 block.offset + done);
+            if (res == -1 && errno != EINTR)
+                error = MLDB::Exception(errno, "writing file").what();
+            else if (res > 0)
+                done += res;
+        }
+    }
+
+    void drain()
+    {
+        ring.submit();
+        while (ring.inFlight()) {
+            reap(ring.waitCompletion());
+        }
+        if (!error.empty())
+            throw MLDB::Exception(error);
+    }
+
+    IoUringFileOptions options;
+    std::function<void (const std::exception_ptr &)> onException;
+    IoUring ring;
+    int fd = -1;
+    int tailFd = -1;
+    std::vector<Block> blocks;
+    std::vector<unsigned> freeBlocks;
+    unsigned current = 0;     ///< Block being filled
+    uint64_t blockOffset = 0; ///< Offset in the file of the current block
+    std::string error;        ///< First error, which makes writes fail
+};
+
+} // file scope
+
+std::unique_ptr<std::streambuf>
+openIoUringReadBuf(const std::string & filename,
+                   const IoUringFileOptions & options)
+{
+    return std::unique_ptr<std::streambuf>
+        (new IoUringReadBuf(filename, options));
+}
+
+std::unique_ptr<std::streambuf>
+openIoUringWriteBuf(const std::string & filename,
+                    const IoUringFileOptions & options,
+                    const std::function<void (const std::exception_ptr &)>
+                        & onException)
+{
+    return std::unique_ptr<std::streambuf>
+        (new IoUringWriteBuf(filename, options, onException));
+}
+
+} // namespace MLDB
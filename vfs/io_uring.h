@@ -0,0 +1,129 @@
+/* io_uring.h                                                      -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Local file I/O through the Linux io_uring interface.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* IO URING                                                                  */
+/*****************************************************************************/
+
+/** Minimal interface to an io_uring submission/completion queue pair, using
+    the system calls directly so that there is no dependency on liburing.
+
+    Requests are queued with the queue* methods, which return false if the
+    submission queue is full, and are sent to the kernel by submit() (or
+    implicitly when waiting for a completion).  Each request carries a user
+    value which is returned with its completion.
+
+    An IoUring isn't thread safe; callers that share one need to serialize
+    access to it.
+*/
+
+struct IoUring {
+    /** Create a ring with room for the given number of requests in flight.
+        Throws if io_uring isn't available; see available().
+    */
+    IoUring(unsigned entries);
+
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    void operator = (const IoUring &) = delete;
+
+    /** Return whether io_uring can be used in this process: the kernel
+        supports it along with its read and write operations, it's not
+        forbidden (for example by a seccomp filter in a container) and
+        MLDB_IO_URING isn't set to 0.  The result is probed once and
+        cached.
+    */
+    static bool available();
+
+    /// Return whether the kernel supports queueWriteback()
+    bool supportsWriteback() const;
+
+    /// Queue a read of len bytes at the given offset of the file into buf
+    bool queueRead(int fd, void * buf, unsigned len, uint64_t offset,
+                   uint64_t userData);
+
+    /// Queue a write of len bytes from buf at the given offset of the file
+    bool queueWrite(int fd, const void * buf, unsigned len, uint64_t offset,
+                    uint64_t userData);
+
+    /// Queue the start of the writeback of the given range of a file, like
+    /// sync_file_range(..., SYNC_FILE_RANGE_WRITE)
+    bool queueWriteback(int fd, uint64_t offset, uint32_t len,
+                        uint64_t userData);
+
+    /// Send the queued requests to the kernel
+    void submit();
+
+    /// Completion of a request: its user value and the result of the
+    /// operation, which is the number of bytes or -errno
+    struct Completion {
+        uint64_t userData;
+        int result;
+    };
+
+    /// Return the next completion if there is one, without waiting
+    bool tryGetCompletion(Completion & completion);
+
+    /// Submit the queued requests and wait for the next completion
+    Completion waitCompletion();
+
+    /// Number of requests queued or submitted which haven't completed
+    unsigned inFlight() const { return numInFlight; }
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+    unsigned numInFlight;
+};
+
+
+/*****************************************************************************/
+/* IO URING FILE BUFFERS                                                     */
+/*****************************************************************************/
+
+/** Options for reading and writing local files through io_uring. */
+struct IoUringFileOptions {
+    size_t blockSize = 1024 * 1024;  ///< Size of each read or write
+    unsigned queueDepth = 8;         ///< Number of blocks in flight
+    bool direct = false;             ///< Bypass the page cache (O_DIRECT)
+};
+
+/** Open a local file for sequential reading through io_uring.  Reads of
+    blockSize bytes are kept in flight queueDepth blocks ahead of the
+    reader.  Seeking is supported, but restarts the read-ahead.  Throws if
+    the file can't be opened.
+*/
+std::unique_ptr<std::streambuf>
+openIoUringReadBuf(const std::string & filename,
+                   const IoUringFileOptions & options);
+
+/** Open (creating or truncating it) a local file for writing through
+    io_uring.  Each full block is written asynchronously, with up to
+    queueDepth blocks in flight before the writer waits.  Errors are
+    returned by sync(); those that happen when the buffer is destroyed are
+    passed to onException.
+*/
+std::unique_ptr<std::streambuf>
+openIoUringWriteBuf(const std::string & filename,
+                    const IoUringFileOptions & options,
+                    const std::function<void (const std::exception_ptr &)>
+                        & onException);
+
+} // namespace MLDB
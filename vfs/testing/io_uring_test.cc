@@ -0,0 +1,214 @@
+/* io_uring_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of reading and writing local files through io_uring.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/io_uring.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/filesystem.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+using namespace std;
+namespace fs = std::filesystem;
+using namespace MLDB;
+
+
+namespace {
+
+struct TestDir {
+    TestDir()
+        : path("./build/x86_64/tmp/io_uring_test." + std::to_string(getpid()))
+    {
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+
+    ~TestDir()
+    {
+        fs::remove_all(path);
+    }
+
+    std::string path;
+};
+
+std::string makeContents(size_t size)
+{
+    std::string result;
+    for (int i = 0;  result.size() < size;  ++i) {
+        result += "line " + std::to_string(i) + " of the io_uring test\n";
+    }
+    result.resize(size);
+    return result;
+}
+
+void writeFile(const std::string & uri, const std::string & contents,
+               const std::map<std::string, std::string> & options)
+{
+    filter_ostream stream(uri, options);
+    // Write in odd sizes, so that writes straddle the blocks
+    for (size_t i = 0;  i < contents.size();  i += 10007) {
+        stream.write(contents.data() + i,
+                     std::min<size_t>(10007, contents.size() - i));
+    }
+    stream.close();
+}
+
+std::string readFile(const std::string & uri,
+                     const std::map<std::string, std::string> & options)
+{
+    filter_istream stream(uri, options);
+    std::ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_ring )
+{
+    if (!IoUring::available()) {
+        cerr << "io_uring isn't available; skipping" << endl;
+        return;
+    }
+
+    TestDir dir;
+    std::string filename = dir.path + "/ring";
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    BOOST_REQUIRE_NE(fd, -1);
+
+    IoUring ring(4);
+    std::string blocks[3] = { "first", "second", "third" };
+    for (int i = 0;  i < 3;  ++i) {
+        BOOST_CHECK(ring.queueWrite(fd, blocks[i].data(), blocks[i].size(),
+                                    i * 8, i));
+    }
+    BOOST_CHECK_EQUAL(ring.inFlight(), 3);
+
+    int done = 0;
+    while (ring.inFlight()) {
+        auto completion = ring.waitCompletion();
+        BOOST_REQUIRE_LT(completion.userData, 3);
+        BOOST_CHECK_EQUAL(completion.result,
+                          blocks[completion.userData].size());
+        ++done;
+    }
+    BOOST_CHECK_EQUAL(done, 3);
+
+    char buf[32] = { 0 };
+    BOOST_CHECK(ring.queueRead(fd, buf + 8, 6, 8, 42));
+    auto completion = ring.waitCompletion();
+    BOOST_CHECK_EQUAL(completion.userData, 42);
+    BOOST_CHECK_EQUAL(completion.result, 6);
+    BOOST_CHECK_EQUAL(std::string(buf + 8), "second");
+
+    // Errors come back as the result
+    BOOST_CHECK(ring.queueRead(-1, buf, 6, 0, 43));
+    completion = ring.waitCompletion();
+    BOOST_CHECK_EQUAL(completion.result, -EBADF);
+
+    // Writeback came before the probe, so it's there whenever reads are
+    BOOST_CHECK(ring.supportsWriteback());
+    BOOST_CHECK(ring.queueWriteback(fd, 0, 4096, 44));
+    BOOST_CHECK_EQUAL(ring.waitCompletion().result, 0);
+
+    IoUring::Completion none;
+    BOOST_CHECK(!ring.tryGetCompletion(none));
+
+    close(fd);
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip )
+{
+    TestDir dir;
+    std::map<std::string, std::string> options = {
+        { "io-uring", "true" },
+        { "io-block-size", "65536" },
+        { "io-queue-depth", "4" }
+    };
+
+    for (size_t size: { 0, 1, 65536, 1000000 }) {
+        std::string uri = "file://" + dir.path + "/file" + std::to_string(size);
+        std::string contents = makeContents(size);
+        writeFile(uri, contents, options);
+        BOOST_CHECK_EQUAL(fs::file_size(dir.path + "/file"
+                                        + std::to_string(size)), size);
+        BOOST_CHECK(readFile(uri, {}) == contents);
+        BOOST_CHECK(readFile(uri, options) == contents);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_direct )
+{
+    TestDir dir;
+    std::map<std::string, std::string> options = {
+        { "direct", "true" },
+        { "io-block-size", "65536" }
+    };
+
+    std::string uri = "file://" + dir.path + "/direct";
+    std::string contents = makeContents(1000001);
+    writeFile(uri, contents, options);
+    BOOST_CHECK(readFile(uri, {}) == contents);
+    BOOST_CHECK(readFile(uri, options) == contents);
+}
+
+BOOST_AUTO_TEST_CASE( test_flush )
+{
+    // A flushed partial block is visible, and is completed by later writes
+    TestDir dir;
+    std::string uri = "file://" + dir.path + "/flushed";
+    std::string contents = makeContents(200000);
+
+    filter_ostream stream(uri, { { "io-uring", "true" },
+                                 { "io-block-size", "65536" } });
+    stream.write(contents.data(), 100000);
+    stream.flush();
+    BOOST_CHECK(readFile(uri, {}) == contents.substr(0, 100000));
+    stream.write(contents.data() + 100000, 100000);
+    stream.close();
+    BOOST_CHECK(readFile(uri, {}) == contents);
+}
+
+BOOST_AUTO_TEST_CASE( test_seek )
+{
+    TestDir dir;
+    std::string uri = "file://" + dir.path + "/seek";
+    std::string contents = makeContents(500000);
+    writeFile(uri, contents, {});
+
+    filter_istream stream(uri, { { "io-uring", "true" },
+                                 { "io-block-size", "4096" },
+                                 { "io-queue-depth", "2" } });
+
+    for (size_t pos: { 100000, 10, 499990, 4096, 4095, 300000 }) {
+        stream.seekg(pos);
+        char buf[8];
+        stream.read(buf, 8);
+        size_t n = stream.gcount();
+        BOOST_CHECK_EQUAL(std::string(buf, n), contents.substr(pos, 8));
+        BOOST_CHECK_EQUAL(stream.tellg(), pos + n);
+        stream.clear();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_bad_options )
+{
+    TestDir dir;
+    std::string uri = "file://" + dir.path + "/bad";
+    BOOST_CHECK_THROW(filter_ostream(uri, { { "io-uring", "maybe" } }),
+                      std::exception);
+    BOOST_CHECK_THROW(filter_ostream(uri, { { "io-block-size", "-1" } }),
+                      std::exception);
+    BOOST_CHECK_THROW(readFile("file://" + dir.path + "/missing",
+                               { { "io-uring", "true" } }),
+                      std::exception);
+}
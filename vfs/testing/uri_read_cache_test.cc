@@ -0,0 +1,259 @@
+/* uri_read_cache_test.cc
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+   Test of the local cache for remote reads.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/uri_read_cache.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/filesystem.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+
+using namespace std;
+namespace fs = std::filesystem;
+using namespace MLDB;
+
+
+/* Scheme "cachetest://", which serves objects from memory and counts how
+   many times each one is read.
+*/
+
+namespace {
+
+struct TestObject {
+    std::string contents;
+    std::string etag;
+};
+
+std::mutex objectsLock;
+std::map<std::string, TestObject> objects;
+std::atomic<int> numReads(0);
+
+void setObject(const std::string & name, std::string contents,
+               std::string etag)
+{
+    std::unique_lock<std::mutex> guard(objectsLock);
+    objects[name] = { std::move(contents), std::move(etag) };
+}
+
+struct TestUrlFsHandler: public UrlFsHandler {
+    virtual FsObjectInfo getInfo(const Url & url) const
+    {
+        auto result = tryGetInfo(url);
+        if (!result)
+            throw MLDB::Exception("object not found");
+        return result;
+    }
+
+    virtual FsObjectInfo tryGetInfo(const Url & url) const
+    {
+        std::unique_lock<std::mutex> guard(objectsLock);
+        FsObjectInfo result;
+        auto it = objects.find(url.host() + url.path());
+        if (it == objects.end())
+            return result;
+        result.exists = true;
+        result.size = it->second.contents.size();
+        result.etag = it->second.etag;
+        return result;
+    }
+
+    virtual void makeDirectory(const Url & url) const
+    {
+    }
+
+    virtual bool erase(const Url & url, bool throwException) const
+    {
+        return false;
+    }
+
+    virtual bool forEach(const Url & prefix,
+                         const OnUriObject & onObject,
+                         const OnUriSubdir & onSubdir,
+                         const std::string & delimiter,
+                         const std::string & startAt) const
+    {
+        return true;
+    }
+};
+
+UriHandler
+getTestHandler(const std::string & scheme,
+               const std::string & resource,
+               std::ios_base::openmode mode,
+               const std::map<std::string, std::string> & options,
+               const OnUriHandlerException & onException)
+{
+    std::unique_lock<std::mutex> guard(objectsLock);
+    auto it = objects.find(resource);
+    if (it == objects.end())
+        throw MLDB::Exception("object not found");
+    ++numReads;
+    auto buf = std::make_shared<std::stringbuf>(it->second.contents,
+                                                std::ios::in);
+    FsObjectInfo info;
+    info.exists = true;
+    info.size = it->second.contents.size();
+    info.etag = it->second.etag;
+    return UriHandler(buf.get(), buf, info);
+}
+
+struct AtInit {
+    AtInit()
+    {
+        registerUriHandler("cachetest", getTestHandler);
+        registerUrlFsHandler("cachetest", new TestUrlFsHandler());
+    }
+} atInit;
+
+std::string readAll(const std::string & uri)
+{
+    filter_istream stream(uri);
+    std::ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+struct TestCacheDir {
+    TestCacheDir()
+        : path("./build/x86_64/tmp/uri_read_cache_test."
+               + std::to_string(getpid()))
+    {
+        fs::remove_all(path);
+    }
+
+    ~TestCacheDir()
+    {
+        setUriReadCache(nullptr);
+        fs::remove_all(path);
+    }
+
+    std::string path;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_read_through_cache )
+{
+    TestCacheDir dir;
+    auto cache = std::make_shared<UriReadCache>(dir.path, 1000000);
+    setUriReadCache(cache, { "cachetest" });
+
+    setObject("bucket/object1", "hello world", "etag1");
+
+    numReads = 0;
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/object1"), "hello world");
+    BOOST_CHECK_EQUAL(numReads, 1);
+
+    // Second read comes from the cache, through the mapped path
+    {
+        filter_istream stream("cachetest://bucket/object1");
+        BOOST_CHECK(stream.mapped().first != nullptr);
+        BOOST_CHECK_EQUAL(stream.mapped().second, 11);
+        BOOST_CHECK_EQUAL(stream.info().etag, "etag1");
+    }
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/object1"), "hello world");
+    BOOST_CHECK_EQUAL(numReads, 1);
+    BOOST_CHECK_EQUAL(cache->getSize(), 11);
+
+    // A new version is read again
+    setObject("bucket/object1", "hello again", "etag2");
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/object1"), "hello again");
+    BOOST_CHECK_EQUAL(numReads, 2);
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/object1"), "hello again");
+    BOOST_CHECK_EQUAL(numReads, 2);
+
+    // Turning the cache off reads directly
+    setUriReadCache(nullptr);
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/object1"), "hello again");
+    BOOST_CHECK_EQUAL(numReads, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_cache_eviction )
+{
+    TestCacheDir dir;
+    auto cache = std::make_shared<UriReadCache>(dir.path, 250);
+    setUriReadCache(cache, { "cachetest" });
+
+    std::string contents(100, 'x');
+    for (int i = 0;  i < 5;  ++i) {
+        setObject("bucket/evict" + std::to_string(i), contents,
+                  "etag" + std::to_string(i));
+    }
+
+    numReads = 0;
+    for (int i = 0;  i < 5;  ++i)
+        BOOST_CHECK_EQUAL(readAll("cachetest://bucket/evict"
+                                  + std::to_string(i)), contents);
+    BOOST_CHECK_EQUAL(numReads, 5);
+    BOOST_CHECK_LE(cache->getSize(), 250);
+
+    // An object bigger than the whole cache is still readable
+    std::string big(1000, 'y');
+    setObject("bucket/big", big, "etagbig");
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/big"), big);
+    BOOST_CHECK_LE(cache->getSize(), 250);
+
+    // A new cache over the same directory picks up the entries, and keeps
+    // on evicting the least recently used
+    uint64_t size = cache->getSize();
+    BOOST_CHECK_GT(size, 0);
+    auto cache2 = std::make_shared<UriReadCache>(dir.path, 250);
+    BOOST_CHECK_EQUAL(cache2->getSize(), size);
+    setUriReadCache(cache2, { "cachetest" });
+
+    numReads = 0;
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/evict4"), contents);
+    BOOST_CHECK_EQUAL(numReads, 0);
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/evict0"), contents);
+    BOOST_CHECK_EQUAL(numReads, 1);
+    BOOST_CHECK_LE(cache2->getSize(), 250);
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_population )
+{
+    TestCacheDir dir;
+    auto cache = std::make_shared<UriReadCache>(dir.path, 1000000);
+    setUriReadCache(cache, { "cachetest" });
+
+    std::string contents(100000, 'z');
+    setObject("bucket/shared", contents, "etag");
+
+    numReads = 0;
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 8;  ++i) {
+        threads.emplace_back([&] ()
+            {
+                if (readAll("cachetest://bucket/shared") != contents)
+                    ++errors;
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(numReads, 1);
+
+    // Nothing but the entry is left behind
+    int numFiles = 0;
+    for (auto & file: fs::recursive_directory_iterator(dir.path)) {
+        if (!fs::is_regular_file(file.path()))
+            continue;
+        ++numFiles;
+        BOOST_CHECK_EQUAL(file.path().extension().string().find(".lock"),
+                          std::string::npos);
+    }
+    BOOST_CHECK_EQUAL(numFiles, 1);
+}
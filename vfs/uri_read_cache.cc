@@ -0,0 +1,307 @@
+/* uri_read_cache.cc
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+   Local disk cache for objects read from remote file systems.
+*/
+
+#include "mldb/vfs/uri_read_cache.h"
+#include "mldb/arch/fslock.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/hash.h"
+#include "mldb/base/scope.h"
+#include "mldb/compiler/filesystem.h"
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+
+namespace MLDB {
+
+// defined in filter_streams.cc
+const UriHandlerFactory &
+getUriHandler(const std::string & scheme);
+
+
+/*****************************************************************************/
+/* URI READ CACHE                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/// Suffixes of files in the cache directory which aren't entries
+const std::string LOCK_SUFFIX = ".lock";
+const std::string TMP_SUFFIX = ".tmp";
+
+bool isEntry(const std::string & path)
+{
+    auto endsWith = [&] (const std::string & suffix)
+        {
+            return path.size() >= suffix.size()
+                && path.compare(path.size() - suffix.size(), suffix.size(),
+                                suffix) == 0;
+        };
+    return !endsWith(LOCK_SUFFIX) && !endsWith(TMP_SUFFIX);
+}
+
+} // file scope
+
+UriReadCache::
+UriReadCache(std::string directory, uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes)
+{
+    fs::create_directories(this->directory);
+
+    // Pick up the entries left by previous runs, in the order in which
+    // they were last used
+    std::vector<std::tuple<std::pair<time_t, long>, std::string, uint64_t> >
+        existing;
+
+    std::error_code ec;
+    for (auto & file: fs::recursive_directory_iterator(this->directory, ec)) {
+        std::string path = file.path().string();
+        struct stat st;
+        if (!isEntry(path) || ::stat(path.c_str(), &st) != 0
+            || !S_ISREG(st.st_mode))
+            continue;
+        existing.emplace_back(std::make_pair(st.st_mtim.tv_sec,
+                                             st.st_mtim.tv_nsec),
+                              path, st.st_size);
+    }
+
+    std::sort(existing.begin(), existing.end());
+
+    for (auto & e: existing)
+        touch(std::get<1>(e), std::get<2>(e));
+}
+
+void
+UriReadCache::
+touch(const std::string & path, uint64_t size) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = index.find(path);
+    if (it != index.end()) {
+        lru.splice(lru.end(), lru, it->second);
+        return;
+    }
+    index[path] = lru.insert(lru.end(), Entry{ path, size });
+    totalBytes += size;
+}
+
+std::string
+UriReadCache::
+getEntryPath(const std::string & uri, const FsObjectInfo & info) const
+{
+    std::string version
+        = info.etag.empty() ? info.lastModified.printIso8601() : info.etag;
+    std::string key = md5HashToHex(uri + '\n' + version);
+
+    // Two levels, so that no directory gets too big
+    return directory + "/" + key.substr(0, 2) + "/" + key;
+}
+
+UriHandler
+UriReadCache::
+open(const std::string & scheme,
+     const std::string & resource,
+     const std::map<std::string, std::string> & options,
+     const OnUriHandlerException & onException,
+     const UriHandlerFactory & uncached)
+{
+    std::string uri = scheme + "://" + resource;
+
+    auto openUncached = [&] ()
+        {
+            return uncached(scheme, resource, ios::in, options, onException);
+        };
+
+    FsObjectInfo info;
+    try {
+        info = tryGetUriObjectInfo(uri);
+    } MLDB_CATCH_ALL {
+        // No file system handler for the scheme, so no way of knowing
+        // the version
+        return openUncached();
+    }
+
+    if (!info || (info.etag.empty() && info.lastModified == Date()))
+        return openUncached();
+
+    // Caching it would evict everything else, and then itself
+    if (info.size > 0 && (uint64_t)info.size > maxBytes)
+        return openUncached();
+
+    std::string path = getEntryPath(uri, info);
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        // Mark it as recently used, for eviction here and for processes
+        // that start later
+        ::utime(path.c_str(), nullptr);
+        touch(path, st.st_size);
+    }
+    else {
+        populate(path, scheme, resource, info, options, onException, uncached);
+        if (::stat(path.c_str(), &st) == 0)
+            touch(path, st.st_size);
+        evict(path);
+    }
+
+    std::map<std::string, std::string> cachedOptions = options;
+    cachedOptions["mapped"] = "true";
+    UriHandler result;
+    try {
+        result = getUriHandler("file")("file", path, ios::in,
+                                       cachedOptions, onException);
+    } MLDB_CATCH_ALL {
+        // Evicted already, for example because it's bigger than the cache
+        return openUncached();
+    }
+
+    // Callers see the remote object, not the cache entry
+    result.info = std::make_shared<FsObjectInfo>(std::move(info));
+    return result;
+}
+
+void
+UriReadCache::
+populate(const std::string & path,
+         const std::string & scheme,
+         const std::string & resource,
+         const FsObjectInfo & info,
+         const std::map<std::string, std::string> & options,
+         const OnUriHandlerException & onException,
+         const UriHandlerFactory & uncached)
+{
+    fs::create_directories(fs::path(path).parent_path());
+
+    GuardedFsLock lock(path);
+    lock.lock();
+
+    // The lock file is removed while it's still held, so that one isn't
+    // left behind for every entry.  Anyone still waiting on it will find
+    // the entry once they get it; if it has been evicted since, two
+    // writers may populate it at once, which is why each one writes its
+    // own temporary file.
+    Scope_Exit(::unlink(lock.lockname.c_str()));
+
+    // Someone else got there first
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+        return;
+
+    static std::atomic<uint64_t> numTmpFiles(0);
+    std::string tmpPath = path + "." + std::to_string(getpid()) + "."
+        + std::to_string(++numTmpFiles) + TMP_SUFFIX;
+    bool done = false;
+    Scope_Exit(if (!done) ::unlink(tmpPath.c_str()));
+
+    std::map<std::string, std::string> downloadOptions = options;
+    downloadOptions.erase("mapped");
+    UriHandler handler = uncached(scheme, resource, ios::in,
+                                  downloadOptions, onException);
+
+    std::ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out)
+        throw MLDB::Exception("couldn't create cache entry %s: %s",
+                              tmpPath.c_str(), strerror(errno));
+
+    std::vector<char> buf(1024 * 1024);
+    int64_t bytesDone = 0;
+    for (;;) {
+        std::streamsize n = handler.buf->sgetn(buf.data(), buf.size());
+        if (n <= 0)
+            break;
+        out.write(buf.data(), n);
+        bytesDone += n;
+    }
+    out.close();
+
+    if (!out)
+        throw MLDB::Exception("couldn't write cache entry %s: %s",
+                              tmpPath.c_str(), strerror(errno));
+    if (info.size >= 0 && bytesDone != info.size)
+        throw MLDB::Exception("reading %s://%s for the cache returned %lld "
+                              "bytes but the object has %lld",
+                              scheme.c_str(), resource.c_str(),
+                              (long long)bytesDone, (long long)info.size);
+
+    // Atomic, so readers only ever see a complete entry
+    if (::rename(tmpPath.c_str(), path.c_str()) == -1)
+        throw MLDB::Exception("couldn't rename cache entry %s: %s",
+                              tmpPath.c_str(), strerror(errno));
+    done = true;
+}
+
+uint64_t
+UriReadCache::
+getSize() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return totalBytes;
+}
+
+void
+UriReadCache::
+evict(const std::string & keep) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // Readers that have an entry mapped keep it until they're done, so
+    // it's safe to unlink it.  An entry that another process has already
+    // removed is simply forgotten.
+    for (auto it = lru.begin();  it != lru.end() && totalBytes > maxBytes;) {
+        if (it->path == keep) {
+            ++it;
+            continue;
+        }
+        ::unlink(it->path.c_str());
+        totalBytes -= it->size;
+        index.erase(it->path);
+        it = lru.erase(it);
+    }
+}
+
+
+/*****************************************************************************/
+/* REGISTRATION                                                              */
+/*****************************************************************************/
+
+namespace {
+
+std::mutex uriReadCacheLock;
+std::shared_ptr<UriReadCache> uriReadCache;
+std::set<std::string> uriReadCacheSchemes;
+
+} // file scope
+
+void setUriReadCache(std::shared_ptr<UriReadCache> cache,
+                     std::vector<std::string> schemes)
+{
+    std::unique_lock<std::mutex> guard(uriReadCacheLock);
+    uriReadCache = std::move(cache);
+    uriReadCacheSchemes = std::set<std::string>(schemes.begin(), schemes.end());
+}
+
+std::shared_ptr<UriReadCache> getUriReadCache(const std::string & scheme)
+{
+    std::unique_lock<std::mutex> guard(uriReadCacheLock);
+    if (!uriReadCache || !uriReadCacheSchemes.count(scheme))
+        return nullptr;
+    return uriReadCache;
+}
+
+} // namespace MLDB
@@ -0,0 +1,118 @@
+/* uri_read_cache.h                                                -*- C++ -*-
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+   Local disk cache for objects read from remote file systems.
+*/
+
+#pragma once
+
+#include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/fs_utils.h"
+#include <vector>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URI READ CACHE                                                            */
+/*****************************************************************************/
+
+/** Cache of remote objects (s3://, http://, ...) in a local directory,
+    normally on an SSD, so that reading the same version of an object again
+    doesn't download it again.
+
+    Entries are keyed by the URI and the version of the object: its etag,
+    or its last modified date if there is no etag.  A modified object is
+    downloaded again, and the old version ages out.  Objects whose version
+    can't be found are read directly.
+
+    The total size of the entries is bounded; the least recently used are
+    evicted first.  The directory is scanned once on construction, and the
+    size and order of use of the entries is tracked in memory from then on.
+    Several threads and processes can share a directory: populating an
+    entry holds a GuardedFsLock on it, whose file is removed once it's
+    done, and an entry only appears once it has been completely
+    downloaded.  Each process only counts the entries
+    that it has seen towards the bound.
+
+    Opening a cached object still asks the remote file system for its
+    version, so the cache saves the download but not the round trip.
+
+    Cached objects are opened through the mapped file path, so readers
+    that use filter_istream::mapped() work directly on the cached file.
+*/
+
+struct UriReadCache {
+    UriReadCache(std::string directory, uint64_t maxBytes);
+
+    const std::string directory;  ///< Directory holding the entries
+    const uint64_t maxBytes;      ///< Maximum total size of the entries
+
+    /** Open the given URI for reading through the cache.  The uncached
+        handler factory is used to download the object if it's not already
+        in the cache.
+    */
+    UriHandler open(const std::string & scheme,
+                    const std::string & resource,
+                    const std::map<std::string, std::string> & options,
+                    const OnUriHandlerException & onException,
+                    const UriHandlerFactory & uncached);
+
+    /** Return the path of the cache entry for the given version of the
+        object at the URI.  The entry may not exist.
+    */
+    std::string getEntryPath(const std::string & uri,
+                             const FsObjectInfo & info) const;
+
+    /** Return the total size of the entries in the cache, in bytes. */
+    uint64_t getSize() const;
+
+    /** Remove the least recently used entries until the total size is
+        no more than maxBytes.  The entry at keep, if given, isn't removed.
+    */
+    void evict(const std::string & keep = std::string()) const;
+
+private:
+    struct Entry {
+        std::string path;
+        uint64_t size;
+    };
+
+    mutable std::mutex mutex;          ///< Protects the fields below
+    mutable std::list<Entry> lru;      ///< Least recently used first
+    mutable std::unordered_map<std::string, std::list<Entry>::iterator>
+        index;                         ///< Entry of each path in lru
+    mutable uint64_t totalBytes = 0;   ///< Total size of the entries in lru
+
+    /// Record that the entry at path, of the given size, was just used
+    void touch(const std::string & path, uint64_t size) const;
+
+    /// Download the object into the entry at path, unless another thread
+    /// or process has already done it
+    void populate(const std::string & path,
+                  const std::string & scheme,
+                  const std::string & resource,
+                  const FsObjectInfo & info,
+                  const std::map<std::string, std::string> & options,
+                  const OnUriHandlerException & onException,
+                  const UriHandlerFactory & uncached);
+};
+
+/** Read objects with the given schemes through the cache from now on.
+    Passing a null cache turns caching off.  Only streams opened for
+    reading are affected.
+*/
+void setUriReadCache(std::shared_ptr<UriReadCache> cache,
+                     std::vector<std::string> schemes
+                         = { "s3", "http", "https", "sftp", "azureblob" });
+
+/** Return the cache that reads of the given scheme go through, or null
+    if they're not cached.
+*/
+std::shared_ptr<UriReadCache> getUriReadCache(const std::string & scheme);
+
+} // namespace MLDB
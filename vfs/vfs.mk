@@ -4,7 +4,9 @@ LIBVFS_SOURCES := \
 	fs_utils.cc \
         filter_streams.cc \
 	http_streambuf.cc \
+	uri_read_cache.cc \
 	compressor.cc \
+	io_uring.cc \
 	exception_ptr.cc \
 	libdb_initialization.cc \
 	\
@@ -17,6 +19,7 @@ LIBVFS_SOURCES := \
 
 LIBVFS_LINK := \
 	arch \
+	hash \
 	boost_iostreams \
 	types \
 	$(STD_FILESYSTEM_LIBNAME) \
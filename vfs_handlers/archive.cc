@@ -10,9 +10,19 @@
 
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/scope.h"
+#include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/arch/exception.h"
+#include <boost/iostreams/stream_buffer.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
 
 // libarchive support
 #include "mldb/ext/libarchive/libarchive/archive.h"
@@ -146,56 +156,757 @@ bool iterateArchive(std::streambuf * archive,
 }
 
 
-struct ArchiveUrlFsHandler: UrlFsHandler {
+/*****************************************************************************/
+/* ARCHIVE INDEX                                                             */
+/*****************************************************************************/
 
-    ArchiveUrlFsHandler()
+namespace {
+
+/** How the data of an archive member can be reached. */
+enum struct ArchiveMemberStorage {
+    SCAN,      ///< Only by scanning the archive with libarchive
+    STORED,    ///< Stored as-is in the mapped archive
+    DEFLATED   ///< Zip member compressed with deflate in the mapped archive
+};
+
+struct ArchiveMember {
+    std::string name;
+    std::shared_ptr<FsObjectInfo> info;
+    ArchiveMemberStorage storage = ArchiveMemberStorage::SCAN;
+    uint64_t offset = 0;          ///< Tar: data; zip: local file header
+    uint64_t compressedSize = 0;  ///< Size of the data within the archive
+};
+
+/** Index of the members of an archive, so that they can be found by name
+    without scanning the archive each time.
+
+    Zip files and uncompressed tar files that can be mapped into memory
+    (local files, or remote files in the read cache) are indexed from their
+    central directory or their headers, and their members are read directly
+    from the mapping: stored members without any copy, and deflated ones by
+    inflating only that member.  Members can thus be read independently
+    and in parallel.
+
+    Other archives are indexed with one scan by libarchive; reading one of
+    their members still needs to scan the archive up to it.
+*/
+struct ArchiveIndex {
+    std::string uri;                         ///< URI of the archive
+    FsObjectInfo archiveInfo;                ///< Version that was indexed
+    std::shared_ptr<filter_istream> stream;  ///< Keeps the mapping alive
+    const char * mapped = nullptr;
+    size_t mappedSize = 0;
+    bool isZip = false;
+
+    std::vector<ArchiveMember> members;      ///< In archive order
+
+    /** Add a member.  If the name is already there, lookups return the
+        first one, as a scan would.
+    */
+    void add(ArchiveMember member)
     {
+        byName.emplace(member.name, members.size());
+        members.emplace_back(std::move(member));
     }
 
-    virtual FsObjectInfo getInfo(const Url & url) const
+    const ArchiveMember * find(const std::string & name) const
     {
-        auto info = tryGetInfo(url);
-        if (!info)
-            throw MLDB::Exception("Couldn't get URI info for archive " + url.toString());
-        return info;
+        auto it = byName.find(name);
+        if (it == byName.end())
+            return nullptr;
+        return &members[it->second];
     }
 
-    virtual FsObjectInfo tryGetInfo(const Url & url) const
+    /** Is the data of members read from the mapping? */
+    bool isDirect() const
     {
-        Utf8String archiveSource(url.toDecodedString());
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + url.toString() + "' doesn't start with 'archive+' when getting object info");
+        return mapped != nullptr;
+    }
 
-        // Look for a # to get the filename
-        auto it = archiveSource.rfind('#');
-        if (it == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
+private:
+    std::unordered_map<std::string, size_t> byName;
+};
 
-        Utf8String archiveUri(archiveSource.begin(), it);
+uint16_t readLE16(const char * p)
+{
+    const unsigned char * u = (const unsigned char *)p;
+    return u[0] | (u[1] << 8);
+}
 
-        // unused...
-        Utf8String toExtractPath(std::next(it), archiveSource.end());
+uint32_t readLE32(const char * p)
+{
+    return readLE16(p) | ((uint32_t)readLE16(p + 2) << 16);
+}
 
-        FsObjectInfo result;
+uint64_t readLE64(const char * p)
+{
+    return readLE32(p) | ((uint64_t)readLE32(p + 4) << 32);
+}
 
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                if (url.toString() == archiveMemberUri) {
-                    result = info;
-                    return false;
+/** Index a mapped zip file from its central directory.  Returns false if
+    it isn't a zip file that can be indexed that way.
+*/
+bool indexZip(const char * p, size_t n, std::vector<ArchiveMember> & members)
+{
+    // End of central directory record, at the end of the file before an
+    // optional comment of up to 64k
+    static const size_t EOCD_SIZE = 22;
+    if (n < EOCD_SIZE)
+        return false;
+    size_t minPos = n - EOCD_SIZE > 65535 ? n - EOCD_SIZE - 65535 : 0;
+    ssize_t eocd = -1;
+    for (size_t pos = n - EOCD_SIZE;  eocd == -1;  --pos) {
+        if (readLE32(p + pos) == 0x06054b50)
+            eocd = pos;
+        if (pos == minPos)
+            break;
+    }
+    if (eocd == -1)
+        return false;
+
+    // Multi-disk archives aren't supported
+    if (readLE16(p + eocd + 4) != 0 || readLE16(p + eocd + 6) != 0)
+        return false;
+
+    uint64_t numEntries = readLE16(p + eocd + 10);
+    uint64_t cdSize = readLE32(p + eocd + 12);
+    uint64_t cdOffset = readLE32(p + eocd + 16);
+
+    // Zip64 end of central directory locator, just before
+    if (eocd >= 20 && readLE32(p + eocd - 20) == 0x07064b50) {
+        uint64_t zip64Eocd = readLE64(p + eocd - 20 + 8);
+        if (zip64Eocd > n || n - zip64Eocd < 56
+            || readLE32(p + zip64Eocd) != 0x06064b50)
+            return false;
+        numEntries = readLE64(p + zip64Eocd + 32);
+        cdSize = readLE64(p + zip64Eocd + 40);
+        cdOffset = readLE64(p + zip64Eocd + 48);
+    }
+
+    if (cdOffset > n || cdSize > n - cdOffset)
+        return false;
+
+    const char * cd = p + cdOffset;
+    const char * end = cd + cdSize;
+
+    for (uint64_t i = 0;  i < numEntries;  ++i) {
+        static const size_t CD_ENTRY_SIZE = 46;
+        if (end - cd < (ssize_t)CD_ENTRY_SIZE || readLE32(cd) != 0x02014b50)
+            return false;
+
+        uint16_t madeBy = readLE16(cd + 4);
+        uint16_t flags = readLE16(cd + 8);
+        uint16_t method = readLE16(cd + 10);
+        uint16_t dosTime = readLE16(cd + 12);
+        uint16_t dosDate = readLE16(cd + 14);
+        uint64_t compressedSize = readLE32(cd + 20);
+        uint64_t size = readLE32(cd + 24);
+        uint16_t nameLength = readLE16(cd + 28);
+        uint16_t extraLength = readLE16(cd + 30);
+        uint16_t commentLength = readLE16(cd + 32);
+        uint32_t externalAttributes = readLE32(cd + 38);
+        uint64_t localOffset = readLE32(cd + 42);
+
+        size_t entryLength
+            = CD_ENTRY_SIZE + nameLength + extraLength + commentLength;
+        if (end - cd < (ssize_t)entryLength)
+            return false;
+
+        std::string name(cd + CD_ENTRY_SIZE, nameLength);
+        const char * extra = cd + CD_ENTRY_SIZE + nameLength;
+        const char * extraEnd = extra + extraLength;
+        cd += entryLength;
+
+        // DOS times have no time zone; the extended timestamp field, if
+        // there, is in UTC
+        Date lastModified(1980 + (dosDate >> 9), (dosDate >> 5) & 15,
+                          dosDate & 31, dosTime >> 11, (dosTime >> 5) & 63,
+                          (dosTime & 31) * 2);
+        uint64_t uid = 0;
+
+        for (const char * e = extra;  extraEnd - e >= 4;) {
+            uint16_t id = readLE16(e);
+            uint16_t fieldSize = readLE16(e + 2);
+            const char * d = e + 4;
+            if (extraEnd - d < fieldSize)
+                break;
+
+            if (id == 0x0001) {
+                // Zip64: 64 bit versions of the fields that overflowed
+                const char * q = d;
+                auto take = [&] (uint64_t & value)
+                    {
+                        if (value == 0xffffffff && d + fieldSize - q >= 8) {
+                            value = readLE64(q);
+                            q += 8;
+                        }
+                    };
+                take(size);
+                take(compressedSize);
+                take(localOffset);
+            }
+            else if (id == 0x5455 && fieldSize >= 5 && (d[0] & 1)) {
+                lastModified = Date::fromSecondsSinceEpoch
+                    ((int32_t)readLE32(d + 1));
+            }
+            else if (id == 0x7875 && fieldSize >= 2 && d[0] == 1) {
+                unsigned uidSize = (unsigned char)d[1];
+                if (uidSize <= 8 && 2 + uidSize <= fieldSize) {
+                    for (unsigned j = 0;  j < uidSize;  ++j)
+                        uid |= (uint64_t)(unsigned char)d[2 + j] << (8 * j);
                 }
-                return true;
-            };
+            }
+
+            e = d + fieldSize;
+        }
+
+        // As with a scan, only regular files are listed
+        if (!name.empty() && name.back() == '/')
+            continue;
+        if ((madeBy >> 8) == 3 /* unix */) {
+            uint32_t mode = externalAttributes >> 16;
+            if (mode != 0 && (mode & 0170000) != 0100000)
+                continue;
+        }
+
+        ArchiveMember member;
+        member.name = std::move(name);
+        member.info = std::make_shared<FsObjectInfo>();
+        member.info->exists = true;
+        member.info->size = size;
+        member.info->lastModified = lastModified;
+        member.info->ownerId = std::to_string(uid);
+        member.offset = localOffset;
+        member.compressedSize = compressedSize;
+
+        if (flags & 1) {
+            // Encrypted; left to libarchive
+        }
+        else if (method == 0 && compressedSize == size)
+            member.storage = ArchiveMemberStorage::STORED;
+        else if (method == 8)
+            member.storage = ArchiveMemberStorage::DEFLATED;
+
+        members.emplace_back(std::move(member));
+    }
+
+    return true;
+}
+
+/** Parse a numeric field of a tar header: octal, or base-256 for big
+    values in the GNU format.
+*/
+uint64_t parseTarNumber(const char * p, size_t n)
+{
+    uint64_t result = 0;
+    if ((unsigned char)p[0] & 0x80) {
+        for (size_t i = 1;  i < n;  ++i)
+            result = (result << 8) | (unsigned char)p[i];
+        return result;
+    }
+
+    size_t i = 0;
+    while (i < n && p[i] == ' ')
+        ++i;
+    for (;  i < n && p[i] >= '0' && p[i] <= '7';  ++i)
+        result = result * 8 + (p[i] - '0');
+    return result;
+}
+
+/// Read a NUL terminated field of a tar header
+std::string tarString(const char * p, size_t n)
+{
+    return std::string(p, strnlen(p, n));
+}
+
+/** Index a mapped uncompressed tar file from its headers, which are
+    visited without reading any data.  Returns false if it isn't a tar file
+    that can be indexed that way.
+*/
+bool indexTar(const char * p, size_t n, std::vector<ArchiveMember> & members)
+{
+    static const size_t BLOCK = 512;
+
+    // Attributes for the next header from GNU long names and pax headers
+    std::string nextName;
+    std::map<std::string, std::string> nextPax;
+
+    for (size_t offset = 0;  offset + BLOCK <= n;) {
+        const char * h = p + offset;
+
+        // End of archive is marked by zero blocks
+        if (h[0] == 0)
+            return offset > 0;
+
+        // Checksum of the header, with its own field counted as spaces
+        unsigned sum = 0;
+        for (size_t i = 0;  i < BLOCK;  ++i)
+            sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)h[i];
+        if (sum != parseTarNumber(h + 148, 8))
+            return false;
+
+        uint64_t size = parseTarNumber(h + 124, 12);
+        char type = h[156];
+        size_t dataOffset = offset + BLOCK;
+        if (dataOffset > n || size > n - dataOffset)
+            return false;
+        offset = dataOffset + (size + BLOCK - 1) / BLOCK * BLOCK;
+
+        switch (type) {
+        case 'L':
+            // GNU long name for the next entry
+            nextName = tarString(p + dataOffset, size);
+            continue;
+        case 'x': {
+            // pax extended header for the next entry: "len key=value\n"
+            const char * r = p + dataOffset;
+            const char * rEnd = r + size;
+            while (r < rEnd) {
+                char * lenEnd = nullptr;
+                long len = strtol(r, &lenEnd, 10);
+                if (len <= 0 || len > rEnd - r || *lenEnd != ' ')
+                    return false;
+                std::string record(lenEnd + 1, r + len - 1 - (lenEnd + 1));
+                auto eq = record.find('=');
+                if (eq != std::string::npos)
+                    nextPax[record.substr(0, eq)] = record.substr(eq + 1);
+                r += len;
+            }
+            continue;
+        }
+        case 'K':
+        case 'g':
+            // Long link names and global headers don't matter here
+            continue;
+        case 'S':
+            // Sparse files need libarchive to be read
+            return false;
+        default:
+            break;
+        }
+
+        std::string name = tarString(h, 100);
+        if (memcmp(h + 257, "ustar", 5) == 0) {
+            std::string prefix = tarString(h + 345, 155);
+            if (!prefix.empty())
+                name = prefix + "/" + name;
+        }
+        if (!nextName.empty())
+            name = std::move(nextName);
+
+        Date lastModified
+            = Date::fromSecondsSinceEpoch(parseTarNumber(h + 136, 12));
+        uint64_t uid = parseTarNumber(h + 108, 8);
+        std::string gname = tarString(h + 297, 32);
+
+        for (auto & kv: nextPax) {
+            if (kv.first == "path")
+                name = kv.second;
+            else if (kv.first == "size")
+                size = std::stoull(kv.second);
+            else if (kv.first == "mtime")
+                lastModified = Date::fromSecondsSinceEpoch(std::stod(kv.second));
+            else if (kv.first == "uid")
+                uid = std::stoull(kv.second);
+            else if (kv.first == "gname")
+                gname = kv.second;
+        }
+        if (nextPax.count("size")) {
+            if (size > n - dataOffset)
+                return false;
+            offset = dataOffset + (size + BLOCK - 1) / BLOCK * BLOCK;
+        }
+        nextName.clear();
+        nextPax.clear();
+
+        // As with a scan, only regular files are listed
+        if (type != '0' && type != '\0' && type != '7')
+            continue;
+
+        ArchiveMember member;
+        member.name = std::move(name);
+        member.info = std::make_shared<FsObjectInfo>();
+        member.info->exists = true;
+        member.info->size = size;
+        member.info->lastModified = lastModified;
+        member.info->ownerId = std::to_string(uid);
+        member.info->ownerName = gname;
+        member.storage = ArchiveMemberStorage::STORED;
+        member.offset = dataOffset;
+        member.compressedSize = size;
+
+        members.emplace_back(std::move(member));
+    }
+
+    return true;
+}
+
+/** Index the archive at the given URI, which must be the given version.
+    If the index can't be built from a mapping and scan is false, null is
+    returned instead of scanning the archive.
+*/
+std::shared_ptr<ArchiveIndex>
+buildArchiveIndex(const std::string & uri, const FsObjectInfo & archiveInfo,
+                  bool scan)
+{
+    auto result = std::make_shared<ArchiveIndex>();
+    result->uri = uri;
+    result->archiveInfo = archiveInfo;
+
+    auto stream = std::make_shared<filter_istream>
+        (uri, std::map<std::string, std::string>{ { "mapped", "true" } });
+
+    const char * mapped;
+    size_t mappedSize;
+    std::tie(mapped, mappedSize) = stream->mapped();
+
+    if (mapped) {
+        std::vector<ArchiveMember> members;
+        bool indexed = false;
+        if (indexZip(mapped, mappedSize, members)) {
+            result->isZip = true;
+            indexed = true;
+        }
+        else {
+            members.clear();
+            indexed = indexTar(mapped, mappedSize, members);
+        }
+
+        if (indexed) {
+            result->stream = stream;
+            result->mapped = mapped;
+            result->mappedSize = mappedSize;
+            for (auto & m: members)
+                result->add(std::move(m));
+            return result;
+        }
+
+        // Libarchive needs to read it from the start
+        stream = std::make_shared<filter_istream>(uri);
+    }
+
+    if (!scan)
+        return nullptr;
+
+    // Compressed, not mappable or another format: one scan with libarchive,
+    // which skips the data of the members
+    auto onObject = [&] (const std::string & name,
+                         const FsObjectInfo & info,
+                         const OpenUriObject & open,
+                         int depth)
+        {
+            ArchiveMember member;
+            member.name = name;
+            member.info = std::make_shared<FsObjectInfo>(info);
+            result->add(std::move(member));
+            return true;
+        };
+
+    iterateArchive(stream->rdbuf(), onObject);
+
+    return result;
+}
 
-        this->forEach(Url("archive+" + archiveUri), onObject, {},
-                      "/" /* delimiter */, "" /* startAt */);
-        
+bool sameVersion(const FsObjectInfo & info1, const FsObjectInfo & info2)
+{
+    return info1.size == info2.size
+        && info1.etag == info2.etag
+        && info1.lastModified == info2.lastModified;
+}
+
+/// Most recently used indexes first
+std::mutex archiveIndexesLock;
+std::list<std::shared_ptr<const ArchiveIndex> > archiveIndexes;
+constexpr size_t MAX_ARCHIVE_INDEXES = 16;
+
+/** Return the index of the current version of the archive at the given
+    URI, building it if it's not in the cache.  If scan is false and the
+    archive can only be indexed by scanning it, null is returned.
+*/
+std::shared_ptr<const ArchiveIndex>
+getArchiveIndex(const std::string & uri, bool scan = true)
+{
+    FsObjectInfo info = tryGetUriObjectInfo(uri);
+    if (!info)
+        throw MLDB::Exception("Couldn't find archive " + uri);
+
+    {
+        std::unique_lock<std::mutex> guard(archiveIndexesLock);
+        for (auto it = archiveIndexes.begin();  it != archiveIndexes.end();
+             ++it) {
+            if ((*it)->uri != uri)
+                continue;
+            if (!sameVersion((*it)->archiveInfo, info)) {
+                archiveIndexes.erase(it);
+                break;
+            }
+            archiveIndexes.splice(archiveIndexes.begin(), archiveIndexes, it);
+            return archiveIndexes.front();
+        }
+    }
+
+    // Built without the lock, so that indexing a big archive doesn't hold
+    // up the others.  Two threads may both build the same one.
+    std::shared_ptr<const ArchiveIndex> result
+        = buildArchiveIndex(uri, info, scan);
+    if (!result)
+        return nullptr;
+
+    std::unique_lock<std::mutex> guard(archiveIndexesLock);
+    for (auto it = archiveIndexes.begin();  it != archiveIndexes.end();  ++it) {
+        if ((*it)->uri == uri) {
+            archiveIndexes.erase(it);
+            break;
+        }
+    }
+    archiveIndexes.push_front(result);
+    if (archiveIndexes.size() > MAX_ARCHIVE_INDEXES)
+        archiveIndexes.pop_back();
+
+    return result;
+}
+
+/** Streambuf over a stored member, straight from the mapped archive. */
+struct ArchiveMemberBuf {
+    ArchiveMemberBuf(std::shared_ptr<const ArchiveIndex> index,
+                     const char * data, size_t size)
+        : index(std::move(index)), data(data), size(size),
+          buf(data, size)
+    {
+    }
+
+    std::shared_ptr<const ArchiveIndex> index;  ///< Keeps the mapping alive
+    const char * data;
+    size_t size;
+    boost::iostreams::stream_buffer<boost::iostreams::array_source> buf;
+};
+
+/** Streambuf that inflates a zip member compressed with deflate from the
+    mapped archive as it is read, so that only a buffer's worth of it is
+    ever held in memory.  Seeking forwards is done by inflating and
+    skipping; seeking backwards is not possible.
+*/
+struct InflatingMemberBuf: public std::streambuf {
+    InflatingMemberBuf(std::shared_ptr<const ArchiveIndex> index,
+                       const char * data, const ArchiveMember & member)
+        : index(std::move(index)), name(member.name),
+          size(member.info->size), buffer(BUFFER_SIZE), finished(false)
+    {
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, -15 /* raw deflate, no header */) != Z_OK)
+            throw MLDB::Exception("inflateInit2 failed");
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = member.compressedSize;
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    ~InflatingMemberBuf()
+    {
+        inflateEnd(&stream);
+    }
+
+    static constexpr size_t BUFFER_SIZE = 65536;
+
+    std::shared_ptr<const ArchiveIndex> index;  ///< Keeps the mapping alive
+    std::string name;
+    uint64_t size;               ///< Uncompressed size from the directory
+    z_stream stream;
+    std::vector<char> buffer;
+    bool finished;
+
+    /// Position in the member of the end of the buffer
+    uint64_t endPosition() const
+    {
+        return stream.total_out;
+    }
+
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if (finished)
+            return traits_type::eof();
+
+        stream.next_out = (Bytef *)buffer.data();
+        stream.avail_out = buffer.size();
+
+        // Members of zero size give no output, so this may need to be
+        // called more than once to see the end of the stream
+        while (stream.avail_out == buffer.size()) {
+            int res = inflate(&stream, Z_NO_FLUSH);
+            if (res == Z_STREAM_END) {
+                finished = true;
+                break;
+            }
+            if (res != Z_OK)
+                throw MLDB::Exception("Error inflating " + name
+                                      + " in archive " + index->uri);
+        }
+
+        size_t produced = buffer.size() - stream.avail_out;
+        if (stream.total_out > size
+            || (finished && stream.total_out != size))
+            throw MLDB::Exception("Inflated size of " + name
+                                  + " in archive " + index->uri
+                                  + " doesn't match its directory entry");
+
+        setg(buffer.data(), buffer.data(), buffer.data() + produced);
+        if (produced == 0)
+            return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        uint64_t current = endPosition() - (egptr() - gptr());
+        off_type target;
+        switch (dir) {
+        case std::ios_base::beg: target = off;  break;
+        case std::ios_base::cur: target = current + off;  break;
+        case std::ios_base::end: target = size + off;  break;
+        default: return pos_type(off_type(-1));
+        }
+        return seekpos(target, which);
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        off_type target = pos;
+        uint64_t current = endPosition() - (egptr() - gptr());
+        if (!(which & std::ios_base::in) || target < (off_type)current
+            || target > (off_type)size)
+            return pos_type(off_type(-1));
+
+        while ((off_type)current < target) {
+            if (gptr() == egptr()
+                && traits_type::eq_int_type(underflow(), traits_type::eof()))
+                return pos_type(off_type(-1));
+            size_t skip = std::min<uint64_t>(egptr() - gptr(),
+                                             target - current);
+            gbump(skip);
+            current += skip;
+        }
+        return pos_type(target);
+    }
+};
+
+/** Open a member of an indexed archive for reading. */
+UriHandler openMember(const std::shared_ptr<const ArchiveIndex> & index,
+                      const ArchiveMember & member,
+                      const std::map<std::string, std::string> & options)
+{
+    if (member.storage == ArchiveMemberStorage::SCAN) {
+        filter_istream stream(index->uri);
+        UriHandler result;
+        auto onObject = [&] (const std::string & name,
+                             const FsObjectInfo & info,
+                             const OpenUriObject & open,
+                             int depth)
+            {
+                if (name != member.name)
+                    return true;
+                result = open(options);
+                return false;
+            };
+        iterateArchive(stream.rdbuf(), onObject);
+        if (!result.buf)
+            throw MLDB::Exception("Couldn't find resource " + member.name
+                                  + " in archive " + index->uri);
         return result;
     }
 
+    uint64_t dataOffset = member.offset;
+    if (index->isZip) {
+        // The name and extra field in the local header may differ from the
+        // central directory, so they're only known here
+        static const size_t LOCAL_HEADER_SIZE = 30;
+        const char * h = index->mapped + member.offset;
+        if (member.offset + LOCAL_HEADER_SIZE > index->mappedSize
+            || readLE32(h) != 0x04034b50)
+            throw MLDB::Exception("Invalid local header for " + member.name
+                                  + " in archive " + index->uri);
+        dataOffset += LOCAL_HEADER_SIZE + readLE16(h + 26) + readLE16(h + 28);
+    }
+    if (dataOffset > index->mappedSize
+        || member.compressedSize > index->mappedSize - dataOffset)
+        throw MLDB::Exception("Member " + member.name + " is truncated in "
+                              "archive " + index->uri);
+
+    const char * data = index->mapped + dataOffset;
+    UriHandlerOptions handlerOptions;
+    handlerOptions.isForwardSeekable = true;
+
+    if (member.storage == ArchiveMemberStorage::STORED) {
+        auto buf = std::make_shared<ArchiveMemberBuf>
+            (index, data, member.compressedSize);
+        handlerOptions.isRandomSeekable = true;
+        handlerOptions.mapped = buf->data;
+        handlerOptions.mappedSize = buf->size;
+        return UriHandler(&buf->buf, buf, member.info, handlerOptions);
+    }
+
+    auto buf = std::make_shared<InflatingMemberBuf>(index, data, member);
+    return UriHandler(buf.get(), buf, member.info, handlerOptions);
+}
+
+/** Split an archive+ URI into the URI of the archive and the path of the
+    member within it.
+*/
+std::pair<std::string, std::string>
+parseArchiveMemberUri(const std::string & uri, const char * operation)
+{
+    Utf8String archiveSource(uri);
+    if (!archiveSource.removePrefix("archive+"))
+        throw MLDB::Exception("archive URI '" + uri + "' doesn't start with "
+                              "'archive+' when " + operation);
+
+    // Look for the last # to get the filename
+    auto foundIt = archiveSource.end();
+    for (auto it = archiveSource.begin(), end = archiveSource.end();
+         it != end;  ++it)
+        if (*it == '#')
+            foundIt = it;
+
+    if (foundIt == archiveSource.end())
+        throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
+
+    Utf8String archiveUri(archiveSource.begin(), foundIt);
+    Utf8String memberPath(std::next(foundIt), archiveSource.end());
+    return { archiveUri.rawString(), memberPath.rawString() };
+}
+
+} // file scope
+
+
+struct ArchiveUrlFsHandler: UrlFsHandler {
+
+    ArchiveUrlFsHandler()
+    {
+    }
+
+    virtual FsObjectInfo getInfo(const Url & url) const
+    {
+        auto info = tryGetInfo(url);
+        if (!info)
+            throw MLDB::Exception("Couldn't get URI info for archive " + url.toString());
+        return info;
+    }
+
+    virtual FsObjectInfo tryGetInfo(const Url & url) const
+    {
+        std::string archiveUri, memberPath;
+        std::tie(archiveUri, memberPath)
+            = parseArchiveMemberUri(url.toDecodedString(),
+                                    "getting object info");
+
+        auto index = getArchiveIndex(archiveUri);
+        const ArchiveMember * member = index->find(memberPath);
+        if (!member)
+            return FsObjectInfo();
+        return *member->info;
+    }
+
     virtual size_t getSize(const Url & url) const
     {
         return getInfo(url).size;
@@ -229,18 +940,37 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
         if (!archiveSource.removePrefix("archive+"))
             throw MLDB::Exception("archive URI '" + archiveSource.rawString() + "' doesn't start with 'archive+' when listing archive contents");
 
-        filter_istream archiveStream(archiveSource.rawString());
+        // Without a mapping, members can only be opened cheaply while
+        // scanning past them, so the listing is a scan
+        auto index = getArchiveIndex(archiveSource.rawString(),
+                                     false /* scan */);
 
-        auto onObject2 = [&] (const std::string & object,
-                              const FsObjectInfo & info,
-                              const OpenUriObject & open,
-                              int depth)
-            {
-                return onObject(prefix.toString() + "#" + object, info, open, depth);
-            };
+        if (!index || !index->isDirect()) {
+            filter_istream archiveStream(archiveSource.rawString());
+
+            auto onObject2 = [&] (const std::string & object,
+                                  const FsObjectInfo & info,
+                                  const OpenUriObject & open,
+                                  int depth)
+                {
+                    return onObject(prefix.toString() + "#" + object, info, open, depth);
+                };
+
+            return iterateArchive(archiveStream.rdbuf(), onObject2);
+        }
 
+        for (auto & member: index->members) {
+            const ArchiveMember * m = &member;
+            auto open = [index, m] (const std::map<std::string, std::string> & options)
+                {
+                    return openMember(index, *m, options);
+                };
+            if (!onObject(prefix.toString() + "#" + member.name,
+                          *member.info, open, 1 /* depth */))
+                return false;
+        }
 
-        return iterateArchive(archiveStream.rdbuf(), onObject2);
+        return true;
     }
 };
 
@@ -260,60 +990,18 @@ struct RegisterArchiveHandler {
             throw MLDB::Exception("Only input is accepted for archives");
         }
 
-        Utf8String uri = scheme + "://" + resource;
-
-        cerr << "uri = " << uri << endl;
-
-        Utf8String archiveSource = uri;
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + uri.rawString() + "' doesn't start with 'archive+' when opening archive member");
-
-        //cerr << "archiveSource = " << archiveSource << endl;
-
-        // Look for a # to get the filename
-        auto foundIt = archiveSource.end();
-        for (auto it = archiveSource.begin(), end = archiveSource.end();
-             it != end;  ++it)
-            if (*it == '#')
-                foundIt = it;
-        
-        if (foundIt == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
-
-        Utf8String archiveUri(archiveSource.begin(), foundIt);
+        std::string archiveUri, memberPath;
+        std::tie(archiveUri, memberPath)
+            = parseArchiveMemberUri(scheme + "://" + resource,
+                                    "opening archive member");
 
-        //cerr << "archiveUri = " << archiveUri << endl;
+        auto index = getArchiveIndex(archiveUri);
+        const ArchiveMember * member = index->find(memberPath);
+        if (!member)
+            throw MLDB::Exception("Couldn't find resource " + memberPath
+                                + " in archive " + archiveUri);
 
-        // unused...
-        Utf8String toExtractPath(std::next(foundIt), archiveSource.end());
-
-        //cerr << "uri = " << uri << " archiveSource = " << archiveSource
-        //     << " archiveUri = " << archiveUri << " toExtractPath = "
-        //     << toExtractPath << endl;
-
-        UriHandler result;
-
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                //cerr << "matching " << archiveMemberUri
-                //<< " against " << uri << endl;
-                if (uri.rawString() == archiveMemberUri) {
-                    result = open(options);
-                    return false;
-                }
-                return true;
-            };
-
-        forEachUriObject("archive+" + archiveUri.rawString(), onObject, {},
-                         "/" /* delimiter */, "" /* startAt */);
-        if (!result.buf)
-            throw MLDB::Exception("Couldn't find resource " + toExtractPath.rawString()
-                                + " in archive " + archiveUri.rawString());
-        
-        return result;
+        return openMember(index, *member, options);
     }
 
     RegisterArchiveHandler()
@@ -326,4 +1014,3 @@ struct RegisterArchiveHandler {
 
 
 } // namespace MLDB
-
@@ -555,16 +555,19 @@ std::unique_ptr<tinyxml2::XMLDocument>
 AwsBasicApi::
 performGet(RestParams && params,
            const std::string & resource,
-           double timeoutSeconds)
+           double timeoutSeconds,
+           int flags)
 {
-    return perform(signGet(std::move(params), resource), timeoutSeconds, 3);
+    return perform(signGet(std::move(params), resource), timeoutSeconds, 3,
+                   flags);
 }
 
 std::unique_ptr<tinyxml2::XMLDocument>
 AwsBasicApi::
 perform(const BasicRequest & request,
         double timeoutSeconds,
-        int retries)
+        int retries,
+        int flags)
 {
     int retry = 0;
     for (; retry < retries;  ++retry) {
@@ -575,7 +578,12 @@ perform(const BasicRequest & request,
                                      HttpRestProxy::Content(request.payload),
                                      request.queryParams,
                                      request.headers,
-                                     timeoutSeconds);
+                                     timeoutSeconds,
+                                     true /* exceptions */,
+                                     nullptr, nullptr,
+                                     false /* followRedirect */,
+                                     false /* abortOnSlowConnection */,
+                                     flags);
 
             if (response.code() == 200) {
                 std::unique_ptr<tinyxml2::XMLDocument> body(new tinyxml2::XMLDocument());
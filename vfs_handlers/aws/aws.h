@@ -154,10 +154,13 @@ struct AwsBasicApi : public AwsApi {
     std::string region;
     std::string serviceUri;
 
+    /** Perform the request, retrying on 503 errors.  The flags are
+        HttpRestProxy::RequestFlags for the request. */
     std::unique_ptr<tinyxml2::XMLDocument>
     perform(const BasicRequest & request,
             double timeoutSeconds,
-            int retries);
+            int retries,
+            int flags = 0);
 
     std::string performPost(RestParams && params, const std::string & resource,
                             const std::string & resultSelector,
@@ -172,7 +175,7 @@ struct AwsBasicApi : public AwsApi {
 
     std::unique_ptr<tinyxml2::XMLDocument>
     performGet(RestParams && params, const std::string & resource,
-               double timeoutSeconds = 10.0);
+               double timeoutSeconds = 10.0, int flags = 0);
     
     BasicRequest signPost(RestParams && params, const std::string & resource = "");
     BasicRequest signGet(RestParams && params, const std::string & resource = "");
@@ -52,22 +52,53 @@ struct S3Globals {
         loop.start();
     }
 
-    /* This method return an HttpClient attached to the given hostname. The
-       instances thereby created are kept alive until the death of the
-       process. This method is thread-safe. */
-    HttpClient & getClient(const string & bucket,
-                           const string & baseHostname = "s3.amazonaws.com")
+    /* Endpoint of the service, as given by the location of the
+       credentials: either a hostname, or a URL such as
+       "https://localhost:9000" whose scheme overrides the protocol. */
+    struct Endpoint {
+        string protocol;
+        string host; /* host name, with the port if there is one */
+
+        /* Endpoints with an explicit port, such as a local S3-compatible
+           server, are addressed path-style (the bucket is the first
+           component of the path), since the bucket can't be prepended to
+           their hostname. */
+        bool isPathStyle() const
+        {
+            return host.find(':') != string::npos;
+        }
+    };
+
+    static Endpoint getEndpoint(const string & serviceUri,
+                                const string & protocol)
     {
-        string hostname = bucket;
-        if (hostname.size() > 0) {
-            hostname += ".";
+        Endpoint result{protocol, serviceUri};
+        auto pos = serviceUri.find("://");
+        if (pos != string::npos) {
+            result.protocol = serviceUri.substr(0, pos);
+            result.host = serviceUri.substr(pos + 3);
         }
-        hostname += baseHostname;
+        while (!result.host.empty() && result.host.back() == '/') {
+            result.host.pop_back();
+        }
+        return result;
+    }
+
+    /* This method return an HttpClient attached to the given endpoint,
+       for the given bucket. The instances thereby created are kept alive
+       until the death of the process. This method is thread-safe. */
+    HttpClient & getClient(const string & bucket, const Endpoint & endpoint)
+    {
+        string baseUrl = endpoint.protocol + "://";
+        if (!endpoint.isPathStyle() && !bucket.empty()) {
+            baseUrl += bucket + ".";
+        }
+        baseUrl += endpoint.host;
 
         unique_lock<mutex> guard(clientsLock);
-        auto it = clients.find(hostname);
+        auto it = clients.find(baseUrl);
         if (it == clients.end()) {
-            HttpClient newClient(loop, "http://" + hostname, 30);
+            HttpClient newClient(loop, baseUrl, 30);
 
             /* By disabling "Expect: 100-Continue", we remove one round trip
                per put request. Since the chances to receive an error after
@@ -76,7 +107,7 @@ struct S3Globals {
                https://www.w3.org/Protocols/rfc2616/rfc2616-sec10.html#sec10.1.1
             */
             newClient.sendExpect100Continue(false);
-            it = clients.insert(std::make_pair(std::move(hostname),
+            it = clients.insert(std::make_pair(std::move(baseUrl),
                                                std::move(newClient)))
                         .first;
         }
@@ -177,14 +208,21 @@ struct S3RequestCallbacks : public HttpClientCallbacks {
 void
 performStateRequest(const shared_ptr<S3RequestState> & state)
 {
-    auto & client = getS3Globals().getClient(state->rq->params.bucket);
-
     const S3Api::RequestParams & params = state->rq->params;
+    auto endpoint = S3Globals::getEndpoint(state->rq->serviceUri,
+                                           state->rq->protocol);
+    auto & client = getS3Globals().getClient(params.bucket, endpoint);
+
+    string resource = state->rq->resource;
+    if (endpoint.isPathStyle() && !params.bucket.empty()) {
+        resource = "/" + params.bucket + resource;
+    }
+
     auto callbacks = make_shared<S3RequestCallbacks>(state);
     RestParams headers = state->makeHeaders();
     int timeout = state->makeTimeout();
 
-    if (!client.enqueueRequest(params.verb, state->rq->resource,
+    if (!client.enqueueRequest(params.verb, resource,
                                   callbacks,
                                   state->rq->params.content,
                                   /* query params already encoded in
@@ -580,7 +618,9 @@ S3Api::ObjectMetadata::
 ObjectMetadata()
     : redundancy(REDUNDANCY_DEFAULT),
       serverSideEncryption(SSE_NONE),
-      numRequests(8)
+      numRequests(8),
+      partSize(8 * 1024 * 1024),
+      numBuffers(4)
 {
 }
 
@@ -588,7 +628,9 @@ S3Api::ObjectMetadata::
 ObjectMetadata(Redundancy redundancy)
     : redundancy(redundancy),
       serverSideEncryption(SSE_NONE),
-      numRequests(8)
+      numRequests(8),
+      partSize(8 * 1024 * 1024),
+      numBuffers(4)
 {
 }
 
@@ -816,6 +858,8 @@ prepare(const RequestParams & request) const
     auto result = make_shared<SignedRequest>();
     result->params = request;
     result->bandwidthToServiceMbps = bandwidthToServiceMbps;
+    result->protocol = protocol;
+    result->serviceUri = serviceUri.empty() ? "s3.amazonaws.com" : serviceUri;
 
     if (request.resource.find("//") != string::npos)
         throw MLDB::Exception("attempt to perform s3 request with double slash: "
@@ -177,6 +177,16 @@ struct S3Api : public AwsApi {
 
         /* maximum number of concurrent requests */
         unsigned int numRequests;
+
+        /* size of the first parts of a multipart upload, in bytes; later
+           parts get bigger so that big objects fit in 10000 parts */
+        size_t partSize;
+
+        /* S3 rejects parts smaller than this, except for the last one */
+        static constexpr size_t MIN_PART_SIZE = 5 * 1024 * 1024;
+
+        /* number of part buffers the writer can fill ahead of the uploads */
+        unsigned int numBuffers;
     };
 
     /** Signed request that can be executed. */
@@ -185,6 +195,8 @@ struct S3Api : public AwsApi {
         std::string auth;
         std::string resource;
         double bandwidthToServiceMbps;
+        std::string protocol;
+        std::string serviceUri;
     };
 
     /** Calculate the signature for a given request. */
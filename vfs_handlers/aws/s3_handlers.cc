@@ -11,6 +11,9 @@
 #include <exception>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <boost/iostreams/stream_buffer.hpp>
 #include "mldb/utils/string_functions.h"
 #include "mldb/base/exc_assert.h"
@@ -19,6 +22,7 @@
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/exception_ptr.h"
+#include "mldb/vfs/compressor.h"
 #include "mldb/vfs_handlers/aws/s3.h"
 #include "mldb/arch/futex.h"
 
@@ -547,26 +551,50 @@ inline void touch(const char * start, size_t size)
 }
 
 
+/** Multipart upload of a stream to S3, organised as a pipeline:
+
+    - the writer fills part buffers of a fixed size, taken from a small pool;
+    - a pipeline thread takes the full buffers in order, compresses them if
+      the object is compressed and cuts the result into parts;
+    - up to numRequests parts are uploaded at once, each request being
+      retried by S3Api on transient errors.
+
+    The writer only blocks when every buffer of the pool is waiting for the
+    pipeline thread, which itself blocks when numRequests parts are in
+    flight.  This keeps the memory used bounded by about
+    (numBuffers + numRequests + 1) parts whatever the speed of the network,
+    while compression overlaps with both the writer and the uploads.
+*/
 struct S3Uploader {
     S3Uploader(const S3Api * api,
                const string & bucket,
                const string & resource, // starts with "/", unescaped (buggy)
                const OnUriHandlerException & excCallback,
-               const S3Api::ObjectMetadata & objectMetadata)
+               const S3Api::ObjectMetadata & objectMetadata,
+               std::shared_ptr<Compressor> compressor = nullptr)
         : api(api),
           bucket(bucket), resource(resource),
           metadata(objectMetadata),
           onException(excCallback),
+          compressor(std::move(compressor)),
           closed(false),
-          chunkSize(8 * 1024 * 1024), // start with 8MB and ramp up
-          currentRq(0),
-          activeRqs(0)
+          bufferSize(metadata.partSize),
+          partSize(metadata.partSize), // ramps up from there
+          numParts(0),
+          activeRqs(0),
+          numBuffers(0),
+          finishing(false)
     {
-        /* Maximum chunk size is what we can do in 3 seconds, up to 1% of
+        ExcAssertGreater(metadata.numRequests, 0);
+        ExcAssertGreater(metadata.numBuffers, 0);
+        ExcAssertGreater(bufferSize, 0);
+
+        /* Maximum part size is what we can do in 3 seconds, up to 1% of
            system memory. */
-        maxChunkSize = api->bandwidthToServiceMbps * 3.0 * 1000000;
+        maxPartSize = api->bandwidthToServiceMbps * 3.0 * 1000000;
         size_t sysMemory = getTotalSystemMemory();
-        maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
+        maxPartSize = std::max(partSize, std::min(maxPartSize,
+                                                  sysMemory / 100));
 
         try {
             S3Api::MultiPartUpload upload
@@ -580,6 +608,9 @@ struct S3Uploader {
             }
             throw;
         }
+
+        current = getBuffer();
+        pipelineThread = std::thread([this] () { this->runPipeline(); });
     }
 
     ~S3Uploader()
@@ -599,68 +630,229 @@ struct S3Uploader {
 
         touch(s, n);
 
-        size_t remaining = chunkSize - current.size();
         while (n > 0) {
-            if (excPtrHandler.hasException() && onException) {
-                onException(current_exception());
-            }
-            excPtrHandler.rethrowIfSet();
-            size_t toDo = min(remaining, (size_t) n);
-            if (toDo < n) {
-                flush();
-                remaining = chunkSize - current.size();
-            }
+            checkException();
+            size_t toDo = min(bufferSize - current.size(), (size_t) n);
             current.append(s, toDo);
             s += toDo;
             n -= toDo;
             done += toDo;
-            remaining -= toDo;
+            if (current.size() == bufferSize) {
+                submit(std::move(current));
+                current = getBuffer();
+            }
         }
 
         return done;
     }
 
-    void flush(bool force = false)
+    string close()
     {
-        if (!force) {
-            ExcAssert(current.size() > 0);
+        closed = true;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!current.empty()) {
+                full.emplace_back(std::move(current));
+            }
+            finishing = true;
         }
-        while (activeRqs == metadata.numRequests) {
-            MLDB::futex_wait(activeRqs, activeRqs);
+        changed.notify_all();
+        pipelineThread.join();
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] () { return activeRqs == 0; });
+        }
+
+        if (excPtrHandler.hasException()) {
+            abortUpload();
+            checkException();
         }
+
+        string finalEtag;
+        try {
+            finalEtag = api->finishMultiPartUpload(bucket, resource,
+                                                   uploadId, etags);
+        }
+        MLDB_CATCH_ALL {
+            if (onException) {
+                onException(current_exception());
+            }
+            throw;
+        }
+
+        return finalEtag;
+    }
+
+private:
+    /* Rethrow the first error of the pipeline or of an upload. */
+    void checkException()
+    {
         if (excPtrHandler.hasException() && onException) {
-            onException(current_exception());
+            onException(excPtrHandler.getException());
         }
         excPtrHandler.rethrowIfSet();
+    }
 
-        unsigned int rqNbr(currentRq);
-        auto onResponse = [&, rqNbr] (S3Api::Response && response,
-                                      std::exception_ptr excPtr) {
-            this->handleResponse(rqNbr, std::move(response), excPtr);
-        };
+    /* Return an empty buffer from the pool, waiting for one to be handed
+       back by the pipeline if they are all in use. */
+    string getBuffer()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] ()
+                     {
+                         return !freeBuffers.empty()
+                             || numBuffers < metadata.numBuffers
+                             || excPtrHandler.hasException();
+                     });
+
+        string result;
+        if (!freeBuffers.empty()) {
+            result = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+        else {
+            /* On error, the pipeline stops handing buffers back, so we
+               allocate one more to let the writer get to checkException. */
+            ++numBuffers;
+            result.reserve(bufferSize);
+        }
+        return result;
+    }
+
+    /* Hand a full buffer from the writer over to the pipeline thread. */
+    void submit(string && buffer)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            full.emplace_back(std::move(buffer));
+        }
+        changed.notify_all();
+    }
+
+    /* Body of the pipeline thread, which turns the buffers written into
+       uploaded parts until the writer closes the stream. */
+    void runPipeline()
+    {
+        string part;
+        part.reserve(partSize);
+
+        auto onCompressed = [&] (const char * data, size_t len) -> size_t
+            {
+                part.append(data, len);
+                if (part.size() >= partSize) {
+                    uploadPart(part);
+                    part.clear();
+                }
+                return len;
+            };
+
+        try {
+            for (;;) {
+                string buffer;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] ()
+                                 {
+                                     return !full.empty() || finishing;
+                                 });
+                    if (full.empty())
+                        break;
+                    buffer = std::move(full.front());
+                    full.pop_front();
+                }
+
+                if (!excPtrHandler.hasException()) {
+                    if (compressor) {
+                        compressor->compress(buffer.data(), buffer.size(),
+                                             onCompressed);
+                    }
+                    else if (part.empty() && buffer.size() >= partSize) {
+                        uploadPart(buffer);
+                    }
+                    else {
+                        onCompressed(buffer.data(), buffer.size());
+                    }
+                }
+
+                buffer.clear();
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    freeBuffers.emplace_back(std::move(buffer));
+                }
+                changed.notify_all();
+            }
 
-        unsigned int partNumber = currentRq + 1;
-        if (etags.size() < partNumber) {
+            if (!excPtrHandler.hasException()) {
+                if (compressor) {
+                    compressor->finish(onCompressed);
+                }
+                /* The last part can be smaller than the others; an empty
+                   object still needs a single, empty part. */
+                if (!part.empty() || numParts == 0) {
+                    uploadPart(part);
+                }
+            }
+        }
+        catch (const std::exception & exc) {
+            excPtrHandler.takeCurrentException();
+        }
+
+        /* Wake up a writer waiting for a buffer, so that it sees the
+           error. */
+        changed.notify_all();
+    }
+
+    /* Start the upload of the next part, waiting until fewer than
+       numRequests are in flight.  Only called from the pipeline thread. */
+    void uploadPart(const string & data)
+    {
+        unsigned int partNumber;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] ()
+                         {
+                             return activeRqs < metadata.numRequests
+                                 || excPtrHandler.hasException();
+                         });
+            excPtrHandler.rethrowIfSet();
+            partNumber = ++numParts;
             etags.resize(partNumber);
+            ++activeRqs;
         }
 
-        activeRqs++;
-        api->putAsync(onResponse, bucket, resource,
-                      MLDB::format("partNumber=%d&uploadId=%s",
-                                 partNumber, uploadId),
-                      {}, {}, current);
+        auto onResponse = [this, partNumber] (S3Api::Response && response,
+                                              std::exception_ptr excPtr)
+            {
+                this->handleResponse(partNumber, std::move(response), excPtr);
+            };
 
-        if (currentRq % 5 == 0 && chunkSize < maxChunkSize)
-            chunkSize *= 2;
+        try {
+            api->putAsync(onResponse, bucket, resource,
+                          MLDB::format("partNumber=%d&uploadId=%s",
+                                       partNumber, uploadId),
+                          {}, {}, data);
+        }
+        catch (...) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                --activeRqs;
+            }
+            changed.notify_all();
+            throw;
+        }
 
-        current.clear();
-        currentRq = partNumber;
+        if (numParts % 5 == 0 && partSize < maxPartSize) {
+            partSize = std::min(partSize * 2, maxPartSize);
+        }
     }
 
-    void handleResponse(unsigned int rqNbr,
+    void handleResponse(unsigned int partNumber,
                         S3Api::Response && response,
                         std::exception_ptr excPtr)
     {
+        string etag;
         try {
             if (excPtr) {
                 rethrow_exception(excPtr);
@@ -671,69 +863,66 @@ struct S3Uploader {
                 throw MLDB::Exception("put didn't work: %d", (int)response.code_);
             }
 
-            string etag = response.getHeader("etag");
+            etag = response.getHeader("etag");
             ExcAssert(etag.size() > 0);
-            etags[rqNbr] = etag;
         }
         catch (const std::exception & exc) {
             excPtrHandler.takeCurrentException();
         }
-        activeRqs--;
-        MLDB::futex_wake(activeRqs);
-    }
 
-    string close()
-    {
-        closed = true;
-        if (current.size() > 0) {
-            flush();
-        }
-        else if (currentRq == 0) {
-            /* for empty files, force the creation of a single empty part */
-            flush(true);
-        }
-        while (activeRqs > 0) {
-            MLDB::futex_wait(activeRqs, activeRqs);
-        }
-        if (excPtrHandler.hasException() && onException) {
-            onException(current_exception());
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            etags[partNumber - 1] = std::move(etag);
+            --activeRqs;
         }
-        excPtrHandler.rethrowIfSet();
+        changed.notify_all();
+    }
 
-        string finalEtag;
+    /* Abort the multipart upload after an error, so that S3 doesn't keep
+       the parts already uploaded.  Errors doing so are only logged, since
+       the original one is more relevant. */
+    void abortUpload()
+    {
         try {
-            finalEtag = api->finishMultiPartUpload(bucket, resource,
-                                                   uploadId, etags);
+            api->erase(bucket, resource, "uploadId=" + uploadId);
         }
-        MLDB_CATCH_ALL {
-            if (onException) {
-                onException(current_exception());
-            }
-            throw;
+        catch (const std::exception & exc) {
+            cerr << "error aborting multipart upload of " << resource
+                 << ": " << exc.what() << endl;
         }
-
-        return finalEtag;
     }
 
-private:
     const S3Api * api;
     std::string bucket;
     std::string resource;
     S3Api::ObjectMetadata metadata;
     OnUriHandlerException onException;
+    std::shared_ptr<Compressor> compressor; /* null if not compressed */
 
-    size_t maxChunkSize;
     std::string uploadId;
 
-    /* state variables, used between "start" and "stop" */
     bool closed; /* whether close() was invoked */
-    ExceptionPtrHandler excPtrHandler; /* TODO: use promise/future instead */
-
-    string current; /* current chunk data */
-    size_t chunkSize; /* current chunk size */
-    std::vector<std::string> etags; /* etags of individual chunks */
-    unsigned int currentRq;  /* number of done requests */
-    atomic<unsigned int> activeRqs; /* number of pending http requests */
+    ExceptionPtrHandler excPtrHandler;
+
+    /* writer state */
+    string current; /* buffer being filled */
+    const size_t bufferSize; /* size of the buffers written */
+
+    /* pipeline thread state */
+    std::thread pipelineThread;
+    size_t partSize; /* current part size */
+    size_t maxPartSize;
+
+    /* shared state, protected by lock */
+    std::mutex lock;
+    std::condition_variable changed; /* signalled on any change below */
+    std::vector<std::string> etags; /* etags of individual parts */
+    unsigned int numParts; /* number of parts started */
+    unsigned int activeRqs; /* number of pending http requests */
+    std::deque<string> full; /* buffers waiting for the pipeline */
+    std::vector<string> freeBuffers; /* buffers handed back by the pipeline */
+    unsigned int numBuffers; /* number of buffers allocated */
+    bool finishing; /* writer has closed the stream */
 };
 
 
@@ -744,13 +933,15 @@ private:
 struct StreamingUploadSource {
     StreamingUploadSource(const std::string & urlStr,
                           const OnUriHandlerException & excCallback,
-                          const S3Api::ObjectMetadata & metadata)
+                          const S3Api::ObjectMetadata & metadata,
+                          std::shared_ptr<Compressor> compressor)
         : owner(getS3ApiForUri(urlStr))
     {
         string bucket, resource;
         std::tie(bucket, resource) = S3Api::parseUri(urlStr);
         uploader.reset(new S3Uploader(owner.get(), bucket, "/" + resource,
-                                      excCallback, metadata));
+                                      excCallback, metadata,
+                                      std::move(compressor)));
     }
 
     typedef char char_type;
@@ -773,8 +964,9 @@ struct StreamingUploadSource {
 
     void close()
     {
-        uploader->close();
-        uploader.reset();
+        /* An uploader can only be closed once, even if that fails */
+        std::shared_ptr<S3Uploader> toClose = std::move(uploader);
+        toClose->close();
     }
 
 private:
@@ -785,11 +977,13 @@ private:
 std::unique_ptr<std::streambuf>
 makeStreamingUpload(const std::string & uri,
                     const OnUriHandlerException & onException,
-                    const S3Api::ObjectMetadata & metadata)
+                    const S3Api::ObjectMetadata & metadata,
+                    std::shared_ptr<Compressor> compressor = nullptr)
 {
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<StreamingUploadSource>
-                 (StreamingUploadSource(uri, onException, metadata),
+                 (StreamingUploadSource(uri, onException, metadata,
+                                        std::move(compressor)),
                   131072));
     return result;
 }
@@ -823,6 +1017,8 @@ struct RegisterS3Handler {
         else if (mode == ios::out) {
 
             S3Api::ObjectMetadata md;
+            string compression;
+            int compressionLevel = -1;
             for (auto & opt: options) {
                 string name = opt.first;
                 string value = opt.second;
@@ -843,8 +1039,13 @@ struct RegisterS3Handler {
                 else if (name == "acl" || name == "aws-acl") {
                     md.acl = value;
                 }
-                else if (name == "mode" || name == "compression"
-                         || name == "compressionLevel") {
+                else if (name == "compression") {
+                    compression = value;
+                }
+                else if (name == "compressionLevel") {
+                    compressionLevel = std::stoi(value);
+                }
+                else if (name == "mode") {
                     // do nothing
                 }
                 else if (name.find("aws-") == 0) {
@@ -861,15 +1062,47 @@ struct RegisterS3Handler {
                 {
                     md.numRequests = std::stoi(value);
                 }
+                else if (name == "part-size") {
+                    md.partSize = std::stoull(value);
+                }
+                else if (name == "num-buffers") {
+                    md.numBuffers = std::stoi(value);
+                }
                 else {
                     cerr << "warning: skipping unknown S3 option "
                          << name << "=" << value << endl;
                 }
             }
 
+            if (md.numRequests < 1 || md.numBuffers < 1)
+                throw MLDB::Exception("num-requests and num-buffers must be "
+                                      "positive writing S3 object "
+                                      + resource);
+            if (md.partSize < S3Api::ObjectMetadata::MIN_PART_SIZE)
+                throw MLDB::Exception("part-size must be at least %zu "
+                                      "bytes writing S3 object %s",
+                                      S3Api::ObjectMetadata::MIN_PART_SIZE,
+                                      resource.c_str());
+
+            /* We do the compression ourselves, so that it runs in the
+               upload pipeline instead of in the writer's thread. */
+            if (compression.empty())
+                compression = Compressor::filenameToCompression(resource);
+            std::shared_ptr<Compressor> compressor;
+            if (!compression.empty() && compression != "none") {
+                compressor.reset(Compressor::create(compression,
+                                                    compressionLevel));
+                if (!compressor)
+                    throw MLDB::Exception("unknown filter compression "
+                                          + compression);
+            }
+
             std::shared_ptr<std::streambuf> buf
-                (makeStreamingUpload("s3://" + resource, onException, md).release());
-            return UriHandler(buf.get(), buf);
+                (makeStreamingUpload("s3://" + resource, onException, md,
+                                     std::move(compressor)).release());
+            UriHandlerOptions handlerOptions;
+            handlerOptions.compressed = true;
+            return UriHandler(buf.get(), buf, nullptr, handlerOptions);
         }
         else throw MLDB::Exception("no way to create s3 handler for non in/out");
     }
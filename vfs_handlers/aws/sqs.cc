@@ -367,6 +367,7 @@ receiveMessageBatch(const std::string & queueUri,
                            to_string(maxNumberOfMessages)});
 
     double timeoutSeconds = 10.0;
+    int flags = 0;
 
     if (visibilityTimeout != -1)
         queryParams.push_back({"VisibilityTimeout", to_string(visibilityTimeout)});
@@ -375,8 +376,13 @@ receiveMessageBatch(const std::string & queueUri,
         timeoutSeconds = std::max(timeoutSeconds, waitTimeSeconds + 5.0);
     }
 
+    // The server holds on to long polls until a message arrives, so they
+    // mustn't take one of the host's slots in the connection pool
+    if (waitTimeSeconds > 0)
+        flags |= HttpRestProxy::LONG_POLL;
+
     auto xml = performGet(std::move(queryParams), getQueueResource(queueUri),
-                          timeoutSeconds);
+                          timeoutSeconds, flags);
 
     auto result = extractNode(xml->RootElement(), "ReceiveMessageResult");
     if (result->NoChildren()) {
@@ -3,3 +3,4 @@
 $(eval $(call test,aws_test,aws,boost))
 $(eval $(call test,sns_mock_test,aws,boost))
 
+$(eval $(call test,s3_upload_test,aws_vfs_handlers aws vfs http io_base test_services,boost))
@@ -0,0 +1,312 @@
+/* s3_upload_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the multipart upload pipeline of s3:// output streams, against
+   a local stand-in for S3.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/http/http_header.h"
+#include "mldb/http/testing/test_http_services.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs_handlers/aws/s3.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/* Minimal implementation of the multipart upload API of S3, which keeps
+   the objects in memory.  Parts can be made to fail, either once (which
+   S3Api retries) or always. */
+
+struct MockS3Service : public TestHttpService {
+    MockS3Service(EventLoop & eventLoop)
+        : TestHttpService(eventLoop),
+          failOnceEvery(0), failAlways(false),
+          inFlight(0), maxInFlight(0), numParts(0), numAborted(0)
+    {
+    }
+
+    virtual void handleHttpPayload(TestHttpSocketHandler & handler,
+                                   const HttpHeader & header,
+                                   const string & payload)
+    {
+        numReqs++;
+        const string & key = header.resource;
+        const RestParams & params = header.queryParams;
+
+        auto sendXml = [&] (const string & xml)
+            {
+                handler.sendResponse(200, xml, "application/xml");
+            };
+
+        if (header.verb == "GET" && params.hasValue("uploads")) {
+            sendXml("<ListMultipartUploadsResult>"
+                    "</ListMultipartUploadsResult>");
+        }
+        else if (header.verb == "POST" && params.hasValue("uploads")) {
+            std::unique_lock<std::mutex> guard(lock);
+            parts[key].clear();
+            sendXml("<InitiateMultipartUploadResult><UploadId>upload-"
+                    + to_string(numReqs)
+                    + "</UploadId></InitiateMultipartUploadResult>");
+        }
+        else if (header.verb == "PUT" && params.hasValue("partNumber")) {
+            int partNumber = std::stoi(params.getValue("partNumber")
+                                       .rawString());
+            int current = ++inFlight;
+            int prevMax = maxInFlight;
+            while (current > prevMax
+                   && !maxInFlight.compare_exchange_weak(prevMax, current)) {
+            }
+
+            // Give the other uploads the time to start
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            bool fail = failAlways;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (failOnceEvery && partNumber % failOnceEvery == 0
+                    && failed.insert(key + ":" + to_string(partNumber))
+                           .second) {
+                    fail = true;
+                }
+                if (!fail) {
+                    parts[key][partNumber] = payload;
+                    ++numParts;
+                }
+            }
+            --inFlight;
+
+            if (failAlways) {
+                handler.sendResponse(403, "forbidden", "text/plain");
+            }
+            else if (fail) {
+                handler.sendResponse(503, "slow down", "text/plain");
+            }
+            else {
+                string etag = "\"part-" + to_string(partNumber) + "\"";
+                handler.putResponseOnWire(HttpResponse(200, "text/plain", "",
+                                                       {{"ETag", etag}}));
+            }
+        }
+        else if (header.verb == "POST" && params.hasValue("uploadId")) {
+            std::unique_lock<std::mutex> guard(lock);
+            string object;
+            int partNumber = 1;
+            for (auto & p: parts[key]) {
+                BOOST_CHECK_EQUAL(p.first, partNumber++);
+                object += p.second;
+            }
+            objects[key] = object;
+            parts.erase(key);
+            sendXml("<CompleteMultipartUploadResult><ETag>\"final\"</ETag>"
+                    "</CompleteMultipartUploadResult>");
+        }
+        else if (header.verb == "DELETE" && params.hasValue("uploadId")) {
+            std::unique_lock<std::mutex> guard(lock);
+            parts.erase(key);
+            ++numAborted;
+            handler.sendResponse(204, "", "text/plain");
+        }
+        else {
+            handler.sendResponse(404, "not found", "text/plain");
+        }
+    }
+
+    string getObject(const string & key)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return objects[key];
+    }
+
+    std::mutex lock;
+    std::map<string, std::map<int, string> > parts;
+    std::map<string, string> objects;
+    std::set<string> failed;
+
+    int failOnceEvery;
+    bool failAlways;
+
+    std::atomic<int> inFlight;
+    std::atomic<int> maxInFlight;
+    std::atomic<int> numParts;
+    std::atomic<int> numAborted;
+};
+
+struct MockS3 {
+    MockS3()
+        : threadPool(eventLoop), service(eventLoop)
+    {
+        string baseUrl = service.start();
+        string serviceUri(baseUrl, 7); // remove http://
+        registerS3Bucket("mldb-upload-test", "accessKeyId", "accessKey",
+                         S3Api::defaultBandwidthToServiceMbps, "http",
+                         serviceUri);
+
+        // The location can also be a URL, whose scheme is the protocol
+        registerS3Bucket("mldb-upload-test-url", "accessKeyId", "accessKey",
+                         S3Api::defaultBandwidthToServiceMbps, "https",
+                         baseUrl);
+    }
+
+    ~MockS3()
+    {
+        threadPool.shutdown();
+    }
+
+    EventLoop eventLoop;
+    AsioThreadPool threadPool;
+    MockS3Service service;
+};
+
+MockS3 & getMockS3()
+{
+    // Never destroyed, since S3Api keeps connections to it until exit
+    static MockS3 * result = new MockS3();
+    return *result;
+}
+
+string makeContents(size_t size)
+{
+    string result;
+    for (int i = 0;  result.size() < size;  ++i) {
+        result += "line " + to_string(i) + " of the upload test\n";
+    }
+    result.resize(size);
+    return result;
+}
+
+void writeObject(const string & uri, const string & contents,
+                 const std::map<string, string> & options)
+{
+    filter_ostream stream(uri, options);
+    // Write in odd sizes, so that writes straddle the part buffers
+    for (size_t i = 0;  i < contents.size();  i += 10007) {
+        stream.write(contents.data() + i,
+                     std::min<size_t>(10007, contents.size() - i));
+    }
+    stream.close();
+}
+
+/// Smallest part size that S3 accepts
+const string minPartSize = to_string(S3Api::ObjectMetadata::MIN_PART_SIZE);
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_upload_parts )
+{
+    auto & s3 = getMockS3();
+    string contents = makeContents(32000000);
+
+    s3.service.maxInFlight = 0;
+    s3.service.numParts = 0;
+    writeObject("s3://mldb-upload-test/parts.txt", contents,
+                { { "part-size", minPartSize },
+                  { "num-requests", "4" },
+                  { "num-buffers", "2" } });
+
+    BOOST_CHECK(s3.service.getObject("/mldb-upload-test/parts.txt")
+                == contents);
+    BOOST_CHECK_GE(s3.service.numParts, 6);
+    BOOST_CHECK_LE(s3.service.maxInFlight, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_empty )
+{
+    auto & s3 = getMockS3();
+    writeObject("s3://mldb-upload-test/empty.txt", "", {});
+    BOOST_CHECK_EQUAL(s3.service.getObject("/mldb-upload-test/empty.txt"),
+                      "");
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_compressed )
+{
+    auto & s3 = getMockS3();
+    string contents = makeContents(2000000);
+
+    writeObject("s3://mldb-upload-test/compressed.txt.gz", contents,
+                { { "part-size", minPartSize } });
+
+    // The parts are consecutive pieces of a single compressed stream
+    string compressed
+        = s3.service.getObject("/mldb-upload-test/compressed.txt.gz");
+    BOOST_CHECK_LT(compressed.size(), contents.size() / 2);
+
+    setMemStreamString("compressed.txt.gz", compressed);
+    filter_istream stream("mem://compressed.txt.gz");
+    std::ostringstream decompressed;
+    decompressed << stream.rdbuf();
+    BOOST_CHECK(decompressed.str() == contents);
+    deleteMemStreamString("compressed.txt.gz");
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_retries )
+{
+    auto & s3 = getMockS3();
+    string contents = makeContents(16000000);
+
+    s3.service.failOnceEvery = 3;
+    writeObject("s3://mldb-upload-test/retried.txt", contents,
+                { { "part-size", minPartSize } });
+    s3.service.failOnceEvery = 0;
+
+    BOOST_CHECK(s3.service.getObject("/mldb-upload-test/retried.txt")
+                == contents);
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_failure )
+{
+    auto & s3 = getMockS3();
+    string contents = makeContents(1000000);
+
+    s3.service.failAlways = true;
+    s3.service.numAborted = 0;
+    BOOST_CHECK_THROW(writeObject("s3://mldb-upload-test/failed.txt",
+                                  contents,
+                                  { { "part-size", minPartSize },
+                                    { "num-buffers", "1" } }),
+                      std::exception);
+    s3.service.failAlways = false;
+
+    BOOST_CHECK_EQUAL(s3.service.numAborted, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_part_size )
+{
+    getMockS3();
+
+    // S3 would reject all but the last part, so we fail up front
+    string contents = makeContents(1000);
+    BOOST_CHECK_THROW(writeObject("s3://mldb-upload-test/small-parts.txt",
+                                  contents,
+                                  { { "part-size", "65536" } }),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_upload_location_url )
+{
+    auto & s3 = getMockS3();
+    string contents = makeContents(100000);
+
+    writeObject("s3://mldb-upload-test-url/url.txt", contents, {});
+    BOOST_CHECK(s3.service.getObject("/mldb-upload-test-url/url.txt")
+                == contents);
+}
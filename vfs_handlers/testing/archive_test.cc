@@ -0,0 +1,284 @@
+/* archive_test.cc
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+   Test of reading members of zip and tar archives through archive+ URIs.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs_handlers/archive.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/filesystem.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+// libarchive support
+#include "mldb/ext/libarchive/libarchive/archive.h"
+#include "mldb/ext/libarchive/libarchive/archive_entry.h"
+
+
+using namespace std;
+namespace fs = std::filesystem;
+using namespace MLDB;
+
+
+namespace {
+
+struct TestMember {
+    std::string name;
+    std::string contents;
+};
+
+/** Members with a mix of sizes and names, including one too long for the
+    name field of a tar header. */
+std::vector<TestMember> makeMembers(int n)
+{
+    std::vector<TestMember> result;
+    for (int i = 0;  i < n;  ++i) {
+        std::string name = "dir" + std::to_string(i % 3) + "/member"
+            + std::to_string(i) + ".txt";
+        std::string contents;
+        for (int j = 0;  j < i * 37;  ++j)
+            contents += "line " + std::to_string(j) + " of " + name + "\n";
+        result.push_back({ std::move(name), std::move(contents) });
+    }
+    result.push_back({ std::string(150, 'x') + "/long.txt", "long name" });
+    result.push_back({ "empty.txt", "" });
+    return result;
+}
+
+/** Write an archive with libarchive.  For zip files, members alternate
+    between stored and deflated. */
+void writeArchive(const std::string & path,
+                  const std::string & format,
+                  const std::vector<TestMember> & members,
+                  bool gzip = false)
+{
+    struct archive * a = archive_write_new();
+    if (format == "zip")
+        archive_write_set_format_zip(a);
+    else archive_write_set_format_pax_restricted(a);
+    if (gzip)
+        archive_write_add_filter_gzip(a);
+    if (archive_write_open_filename(a, path.c_str()) != ARCHIVE_OK)
+        throw MLDB::Exception("couldn't open " + path);
+
+    // A directory, which isn't listed
+    struct archive_entry * dir = archive_entry_new();
+    archive_entry_set_pathname(dir, "dir0/");
+    archive_entry_set_filetype(dir, AE_IFDIR);
+    archive_entry_set_perm(dir, 0755);
+    archive_write_header(a, dir);
+    archive_entry_free(dir);
+
+    for (size_t i = 0;  i < members.size();  ++i) {
+        if (format == "zip") {
+            if (i % 2)
+                archive_write_zip_set_compression_deflate(a);
+            else archive_write_zip_set_compression_store(a);
+        }
+
+        auto & m = members[i];
+        struct archive_entry * entry = archive_entry_new();
+        archive_entry_set_pathname(entry, m.name.c_str());
+        archive_entry_set_size(entry, m.contents.size());
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_perm(entry, 0644);
+        archive_entry_set_mtime(entry, 1500000000 + i, 0);
+        archive_write_header(a, entry);
+        archive_write_data(a, m.contents.data(), m.contents.size());
+        archive_entry_free(entry);
+    }
+
+    archive_write_close(a);
+    archive_write_free(a);
+}
+
+std::string readAll(const std::string & uri)
+{
+    filter_istream stream(uri);
+    std::ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+struct TestDir {
+    TestDir()
+        : path("./build/x86_64/tmp/archive_test." + std::to_string(getpid()))
+    {
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+
+    ~TestDir()
+    {
+        fs::remove_all(path);
+    }
+
+    std::string path;
+};
+
+/** Check listing, info and contents of every member of the archive.
+    expectMapped says whether the given member should be readable straight
+    from memory. */
+void checkArchive(const std::string & archiveUri,
+                  const std::vector<TestMember> & members,
+                  const std::function<bool (size_t)> & expectMapped)
+{
+    std::map<std::string, FsObjectInfo> listed;
+    forEachUriObject("archive+" + archiveUri,
+                     [&] (const std::string & uri,
+                          const FsObjectInfo & info,
+                          const OpenUriObject & open,
+                          int depth)
+                     {
+                         listed[uri] = info;
+                         return true;
+                     });
+    BOOST_CHECK_EQUAL(listed.size(), members.size());
+
+    for (size_t i = 0;  i < members.size();  ++i) {
+        auto & m = members[i];
+        std::string uri = "archive+" + archiveUri + "#" + m.name;
+        BOOST_CHECK_EQUAL(listed.count(uri), 1);
+        BOOST_CHECK_EQUAL(listed[uri].size, m.contents.size());
+
+        FsObjectInfo info = getUriObjectInfo(uri);
+        BOOST_CHECK(info.exists);
+        BOOST_CHECK_EQUAL(info.size, m.contents.size());
+        BOOST_CHECK_EQUAL(info.lastModified,
+                          Date::fromSecondsSinceEpoch(1500000000 + i));
+
+        BOOST_CHECK_EQUAL(readAll(uri), m.contents);
+
+        filter_istream stream(uri);
+        BOOST_CHECK_EQUAL(stream.mapped().first != nullptr, expectMapped(i));
+        if (stream.mapped().first) {
+            BOOST_CHECK_EQUAL(std::string(stream.mapped().first,
+                                          stream.mapped().second),
+                              m.contents);
+        }
+    }
+
+    BOOST_CHECK(!tryGetUriObjectInfo("archive+" + archiveUri + "#missing"));
+    BOOST_CHECK_THROW(readAll("archive+" + archiveUri + "#missing"),
+                      std::exception);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_zip_members )
+{
+    TestDir dir;
+    auto members = makeMembers(20);
+    writeArchive(dir.path + "/test.zip", "zip", members);
+
+    // Stored members are mapped; deflated ones are inflated as they're read
+    checkArchive("file://" + dir.path + "/test.zip", members,
+                 [] (size_t i) { return i % 2 == 0; });
+}
+
+BOOST_AUTO_TEST_CASE( test_tar_members )
+{
+    TestDir dir;
+    auto members = makeMembers(20);
+    writeArchive(dir.path + "/test.tar", "tar", members);
+    checkArchive("file://" + dir.path + "/test.tar", members,
+                 [] (size_t) { return true; });
+}
+
+BOOST_AUTO_TEST_CASE( test_compressed_tar_members )
+{
+    // Can't be mapped, so it's indexed by a scan
+    TestDir dir;
+    auto members = makeMembers(10);
+    writeArchive(dir.path + "/test.tar.gz", "tar", members, true /* gzip */);
+    checkArchive("file://" + dir.path + "/test.tar.gz", members,
+                 [] (size_t) { return false; });
+}
+
+BOOST_AUTO_TEST_CASE( test_streamed_deflated_member )
+{
+    // A deflated member much bigger than the inflation buffer
+    TestDir dir;
+    std::string contents;
+    for (int i = 0;  contents.size() < 5000000;  ++i)
+        contents += "row " + std::to_string(i) + "," + std::to_string(i * 7)
+            + "\n";
+    writeArchive(dir.path + "/big.zip", "zip",
+                 { { "first.txt", "stored" }, { "big.csv", contents } });
+    std::string uri = "archive+file://" + dir.path + "/big.zip#big.csv";
+
+    BOOST_CHECK(readAll(uri) == contents);
+
+    // Reading line by line, as the importers do
+    filter_istream stream(uri);
+    BOOST_CHECK(!stream.mapped().first);
+    std::string line;
+    size_t lines = 0, total = 0;
+    while (std::getline(stream, line)) {
+        ++lines;
+        total += line.size() + 1;
+    }
+    BOOST_CHECK_EQUAL(total, contents.size());
+    BOOST_CHECK_EQUAL(lines, std::count(contents.begin(), contents.end(),
+                                        '\n'));
+
+    // Seeking forwards skips over the data
+    filter_istream stream2(uri);
+    stream2.seekg(3000000);
+    BOOST_CHECK_EQUAL(stream2.tellg(), 3000000);
+    char buf[20];
+    stream2.read(buf, 20);
+    BOOST_CHECK_EQUAL(std::string(buf, 20), contents.substr(3000000, 20));
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_members )
+{
+    TestDir dir;
+    auto members = makeMembers(50);
+    writeArchive(dir.path + "/test.zip", "zip", members);
+    std::string archiveUri = "archive+file://" + dir.path + "/test.zip";
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < 4;  ++t) {
+        threads.emplace_back([&, t] ()
+            {
+                for (size_t i = t;  i < members.size();  i += 4) {
+                    if (readAll(archiveUri + "#" + members[i].name)
+                        != members[i].contents)
+                        ++errors;
+                }
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_modified_archive )
+{
+    // A new version of the archive is indexed again
+    TestDir dir;
+    std::string path = dir.path + "/test.zip";
+    writeArchive(path, "zip", { { "a.txt", "version 1" } });
+    BOOST_CHECK_EQUAL(readAll("archive+file://" + path + "#a.txt"),
+                      "version 1");
+
+    writeArchive(path, "zip", { { "a.txt", "version two" },
+                                { "b.txt", "new member" } });
+    BOOST_CHECK_EQUAL(readAll("archive+file://" + path + "#a.txt"),
+                      "version two");
+    BOOST_CHECK_EQUAL(readAll("archive+file://" + path + "#b.txt"),
+                      "new member");
+}
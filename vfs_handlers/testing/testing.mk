@@ -1,3 +1,4 @@
 #$(eval $(call test,hdfs_test,vfs_handlers,boost manual))
 $(eval $(call test,fs_utils_test,vfs_handlers test_utils,boost manual))
 #$(eval $(call test,azure_blob_storage_test,vfs vfs_handlers $(STD_FILESYSTEM_LIBNAME) boost_system,boost))
+$(eval $(call test,archive_test,vfs_handlers vfs $(LIBARCHIVE_LIB_NAME) $(STD_FILESYSTEM_LIBNAME) boost_system,boost))
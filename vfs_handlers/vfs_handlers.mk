@@ -12,6 +12,7 @@ LIBVFS_HANDLERS_LINK := \
 	$(LIBARCHIVE_LIB_NAME) \
 	ssh2 \
 	aws_vfs_handlers \
+	z \
 
 $(eval $(call library,vfs_handlers,$(LIBVFS_HANDLERS_SOURCES),$(LIBVFS_HANDLERS_LINK)))
 